@@ -49,8 +49,35 @@ typedef enum
 typedef enum
 {
 	IOCTL_NET_GET_MAC = 0,
+	IOCTL_NET_GET_STATS = 1,
 } NetIoctl;
 
+/* IOCTL_NET_GET_STATS */
+typedef struct
+{
+	/* Descriptors in each ring */
+	unsigned int RXRingSize;
+	unsigned int TXRingSize;
+
+	unsigned long RXPackets;
+	unsigned long RXBytes;
+	/* Frames the device reported as bad */
+	unsigned long RXErrors;
+	/* Good frames dropped for lack of a buffer */
+	unsigned long RXDropped;
+	/* Most frames taken in one interrupt */
+	unsigned long RXMaxBatch;
+
+	unsigned long TXPackets;
+	unsigned long TXBytes;
+	/* Frames dropped because the ring was full */
+	unsigned long TXDropped;
+	/* Tail writes, TXPackets / TXDoorbells frames were sent per write */
+	unsigned long TXDoorbells;
+
+	unsigned long Interrupts;
+} NetStatistics;
+
 typedef enum
 {
 	MAP_PRESENT = 1 << 0,
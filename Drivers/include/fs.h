@@ -301,6 +301,22 @@ struct Inode
 #endif // __cplusplus
 };
 
+/* Events reported by InodeOperations::Poll, same values as Linux */
+#define POLLIN 0x001
+#define POLLPRI 0x002
+#define POLLOUT 0x004
+#define POLLERR 0x008
+#define POLLHUP 0x010
+#define POLLNVAL 0x020
+#define POLLRDNORM 0x040
+#define POLLRDBAND 0x080
+#define POLLWRNORM 0x100
+#define POLLWRBAND 0x200
+#define POLLMSG 0x400
+#define POLLRDHUP 0x2000
+
+struct PollTable;
+
 struct InodeOperations
 {
 	int (*Lookup)(struct Inode *Parent, const char *Name, struct Inode **Result);
@@ -320,6 +336,19 @@ struct InodeOperations
 	ssize_t (*ReadLink)(struct Inode *Node, char *Buffer, size_t Size);
 	off_t (*Seek)(struct Inode *Node, off_t Offset);
 	int (*Stat)(struct Inode *Node, struct kstat *Stat);
+
+	/**
+	 * Get the ready events of a node.
+	 *
+	 * Every wait queue that is woken when the result can
+	 * change must be passed to PollWait() with Table.
+	 *
+	 * @param Node Inode to poll.
+	 * @param Table Wait registration, may be NULL.
+	 *
+	 * @return A mask of POLL* events, otherwise an error code.
+	 */
+	int (*Poll)(struct Inode *Node, struct PollTable *Table);
 } __attribute__((packed));
 
 struct FileSystemInfo;
@@ -409,6 +438,14 @@ struct SuperBlockOperations
 	int (*Unmount)(struct FileSystemInfo *FS);
 } __attribute__((packed));
 
+/**
+ * FileSystemInfo::Flags
+ *
+ * FS_NEGATIVE_CACHE: names only appear through the VFS, so
+ * lookups of missing names can be remembered.
+ */
+#define FS_NEGATIVE_CACHE 0x1
+
 struct FileSystemInfo
 {
 	const char *Name;
@@ -267,6 +267,52 @@ namespace Driver
 		return dOps->second.Ops->Ioctl(Node, Request, Argp);
 	}
 
+	int __fs_Poll(struct Inode *Node, struct PollTable *Table)
+	{
+		func("%#lx %#lx", Node, Table);
+
+		if ((dev_t)Node->GetMajor() == DeviceDirID)
+		{
+			switch (Node->GetMinor())
+			{
+			case 0: /* /dev/input/keyboard */
+			{
+				PollWait(Table, DriverManager->GlobalKeyboardInputQueue);
+				if (DriverManager->GlobalKeyboardInputReports.Count() > 0)
+					return POLLIN | POLLRDNORM;
+				return 0;
+			}
+			case 1: /* /dev/input/mouse */
+			{
+				PollWait(Table, DriverManager->GlobalMouseInputQueue);
+				if (DriverManager->GlobalMouseInputReports.Count() > 0)
+					return POLLIN | POLLRDNORM;
+				return 0;
+			}
+			default:
+				return -ENOENT;
+			};
+		}
+
+		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
+			DriverManager->GetDrivers();
+		const auto it = drivers.find(Node->GetMajor());
+		if (it == drivers.end())
+			ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+		const Driver::DriverObject *drv = &it->second;
+
+		auto dop = drv->DeviceOperations;
+		auto dOps = dop->find(Node->GetMinor());
+		if (dOps == dop->end())
+			ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
+		AssertReturnError(dOps->second.Ops, -ENOTSUP);
+
+		/* Devices that can't block are always ready */
+		if (dOps->second.Ops->Poll == nullptr)
+			return POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM;
+		return dOps->second.Ops->Poll(Node, Table);
+	}
+
 	__no_sanitize("alignment") ssize_t __fs_Readdir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
 	{
 		func("%#lx %#lx %d %d %d", _Node, Buffer, Size, Offset, Entries);
@@ -390,7 +436,7 @@ namespace Driver
 		Inode *dev = (Inode *)_dev;
 		dev->Mode = mode;
 
-		FileSystemInfo *fsi = new FileSystemInfo;
+		FileSystemInfo *fsi = new FileSystemInfo{};
 		fsi->Name = "devfs";
 		fsi->SuperOps = {};
 		fsi->Ops.Lookup = __fs_Lookup;
@@ -410,6 +456,7 @@ namespace Driver
 		fsi->Ops.ReadLink = nullptr;
 		fsi->Ops.Seek = nullptr;
 		fsi->Ops.Stat = __fs_Stat;
+		fsi->Ops.Poll = __fs_Poll;
 
 		DeviceDirID = dev->Device = fs->RegisterFileSystem(fsi);
 		dev->SetDevice(0, MinorID++);
@@ -686,7 +686,11 @@ namespace Driver
 		newDrvObj.Initialized = true;
 	}
 
-	Manager::Manager() { this->InitializeDeviceDirectory(); }
+	Manager::Manager()
+	{
+		this->InitializeDeviceDirectory();
+		this->StartInputThread();
+	}
 
 	Manager::~Manager()
 	{
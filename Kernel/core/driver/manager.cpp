@@ -35,6 +35,59 @@ using namespace vfs;
 
 namespace Driver
 {
+	/*
+		Input is reported from interrupt handlers, where the wait
+		queues can't be woken. Their lock is not interrupt safe and
+		the poll callbacks take locks and allocate. The handler only
+		marks the queue and this thread wakes it.
+	*/
+	enum InputQueue
+	{
+		KeyboardQueue = 1 << 0,
+		MouseQueue = 1 << 1,
+	};
+
+	std::atomic_int PendingInputQueues = 0;
+	Tasking::TCB *InputThread = nullptr;
+
+	static void InputThreadEntry()
+	{
+		while (true)
+		{
+			int pending = PendingInputQueues.exchange(0);
+			if (pending == 0)
+			{
+				thisThread->Block();
+
+				/* A report may have come before we blocked */
+				if (PendingInputQueues.load())
+					thisThread->Unblock();
+
+				TaskManager->Yield();
+				continue;
+			}
+
+			if (pending & KeyboardQueue)
+				DriverManager->GlobalKeyboardInputQueue.Wake(POLLIN | POLLRDNORM);
+			if (pending & MouseQueue)
+				DriverManager->GlobalMouseInputQueue.Wake(POLLIN | POLLRDNORM);
+		}
+	}
+
+	static void WakeInputQueue(InputQueue Queue)
+	{
+		PendingInputQueues.fetch_or(Queue);
+		if (InputThread)
+			InputThread->Unblock();
+	}
+
+	void Manager::StartInputThread()
+	{
+		InputThread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+												Tasking::IP(InputThreadEntry));
+		InputThread->Rename("Input Wake");
+	}
+
 	dev_t Manager::RegisterDevice(dev_t DriverID, DeviceType Type, const InodeOperations *Operations)
 	{
 		std::unordered_map<dev_t, Driver::DriverObject> &drivers = DriverManager->GetDrivers();
@@ -240,12 +293,14 @@ namespace Driver
 		{
 			KeyboardReport *kReport = &Report->Keyboard;
 			GlobalKeyboardInputReports.Write(kReport, 1);
+			WakeInputQueue(KeyboardQueue);
 			break;
 		}
 		case INPUT_TYPE_MOUSE:
 		{
 			MouseReport *mReport = &Report->Mouse;
 			GlobalMouseInputReports.Write(mReport, 1);
+			WakeInputQueue(MouseQueue);
 			break;
 		}
 		default:
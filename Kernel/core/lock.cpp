@@ -94,7 +94,7 @@ std::atomic_size_t LocksCount = 0;
 
 size_t GetLocksCount() { return LocksCount.load(); }
 
-void LockClass::Yield()
+static void YieldLock()
 {
 	if (CPU::Interrupts(CPU::Check) && TaskManager &&
 		!TaskManager->IsPanic())
@@ -105,6 +105,8 @@ void LockClass::Yield()
 	CPU::Pause();
 }
 
+void LockClass::Yield() { YieldLock(); }
+
 void LockClass::DeadLock(SpinLockData &Lock)
 {
 	if (ForceUnlock)
@@ -253,3 +255,99 @@ Retry:
 	__sync;
 	return 0;
 }
+
+void RWLockClass::Yield() { YieldLock(); }
+
+void RWLockClass::DeadLock(const char *FunctionName)
+{
+	if (ForceUnlock)
+	{
+		warn("Unlocking rwlock wanted by '%s' which it was held by '%s'...",
+			 FunctionName, CurrentWriter.load());
+		this->DeadLocks = 0;
+		this->State.store(0, std::memory_order_release);
+		return;
+	}
+
+	long state = State.load();
+	warn("Potential deadlock in rwlock wanted by '%s'! Held by %s%s, %ld %s waiting. (%ld times happened)",
+		 FunctionName, state == Exclusive ? "writer " : "readers",
+		 state == Exclusive ? CurrentWriter.load() : "",
+		 WritersWaiting.load(), WritersWaiting.load() == 1 ? "writer" : "writers",
+		 this->DeadLocks.load());
+
+	this->DeadLocks++;
+	this->Yield();
+}
+
+int RWLockClass::ReadLock(const char *FunctionName)
+{
+	int i = 0;
+	while (true)
+	{
+		long state = State.load(std::memory_order_relaxed);
+		if (state != Exclusive && WritersWaiting.load(std::memory_order_relaxed) == 0)
+		{
+			if (State.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+				break;
+			continue;
+		}
+
+		if (++i >= DEADLOCK_TIMEOUT)
+		{
+			DeadLock(FunctionName);
+			i = 0;
+			continue;
+		}
+
+		this->Yield();
+	}
+
+	LocksCount.fetch_add(1);
+	return 0;
+}
+
+int RWLockClass::ReadUnlock()
+{
+	assert(State.load() > 0);
+	State.fetch_sub(1, std::memory_order_release);
+	LocksCount.fetch_sub(1);
+	return 0;
+}
+
+int RWLockClass::WriteLock(const char *FunctionName)
+{
+	/* Keeps new readers out until we are in */
+	WritersWaiting.fetch_add(1);
+
+	int i = 0;
+	while (true)
+	{
+		long state = 0;
+		if (State.compare_exchange_weak(state, Exclusive, std::memory_order_acquire))
+			break;
+
+		if (++i >= DEADLOCK_TIMEOUT)
+		{
+			DeadLock(FunctionName);
+			i = 0;
+			continue;
+		}
+
+		this->Yield();
+	}
+
+	WritersWaiting.fetch_sub(1);
+	CurrentWriter.store(FunctionName);
+	LocksCount.fetch_add(1);
+	return 0;
+}
+
+int RWLockClass::WriteUnlock()
+{
+	assert(State.load() == Exclusive);
+	CurrentWriter.store("(nul)");
+	State.store(0, std::memory_order_release);
+	LocksCount.fetch_sub(1);
+	return 0;
+}
@@ -95,6 +95,11 @@ namespace Memory
 				vmm.Remap(AddressToMap, AddressToMap, PTFlag::RW);
 			}
 
+			{
+				/* Let copies that found the pages still mapped finish */
+				SmartCriticalSection(CopyLock);
+			}
+
 			KernelAllocator.FreePages(Address, Count);
 			AllocatedPagesList.erase(itr);
 			debug("%#lx -{%#lx, %lld}", this, Address, Count);
@@ -232,7 +237,6 @@ namespace Memory
 				void *pAddr = this->RequestPages(1);
 				if (pAddr == nullptr)
 					return false;
-				memset(pAddr, 0, PAGE_SIZE);
 
 				assert(pte->Present == true);
 				pte->ReadWrite = sr.Write;
@@ -302,7 +306,8 @@ namespace Memory
 			if (Address == nullptr)
 				return;
 
-			memcpy(Address, ap.Address, FROM_PAGES(ap.PageCount));
+			/* The child won't touch most of these soon, keep them out of the cache */
+			memcpy_nt(Address, ap.Address, FROM_PAGES(ap.PageCount));
 
 			for (size_t i = 0; i < ap.PageCount; i++)
 			{
@@ -474,6 +479,42 @@ namespace Memory
 		return -EFAULT;
 	}
 
+	int VirtualMemoryArea::__UserCopy(void *User, void *Kernel, size_t Length, bool ToUser)
+	{
+		Virtual vmm(this->Table);
+		uintptr_t address = (uintptr_t)User;
+		uint8_t *buffer = (uint8_t *)Kernel;
+
+		while (Length > 0)
+		{
+			size_t count = PAGE_SIZE - (address & (PAGE_SIZE - 1));
+			if (count > Length)
+				count = Length;
+
+			SmartCriticalSection(CopyLock);
+			if (!vmm.Check((void *)address, PTFlag::US) ||
+				(ToUser && !vmm.Check((void *)address, PTFlag::RW)))
+			{
+				debug("Unable to copy %#lx, page is not user accessible", address);
+				return -EFAULT;
+			}
+
+			uint8_t *page = (uint8_t *)this->Table->Get((void *)address);
+			if (page == nullptr)
+				return -EFAULT;
+
+			if (ToUser)
+				memcpy(page, buffer, count);
+			else
+				memcpy(buffer, page, count);
+
+			address += count;
+			buffer += count;
+			Length -= count;
+		}
+		return 0;
+	}
+
 	VirtualMemoryArea::VirtualMemoryArea(PageTable *_Table)
 		: Table(_Table)
 	{
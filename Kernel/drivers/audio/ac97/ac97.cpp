@@ -741,6 +741,7 @@ namespace Driver::AC97
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	std::list<PCI::PCIDevice> Devices;
@@ -107,6 +107,7 @@ namespace Driver::HighDefinitionAudio
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	std::list<PCI::PCIDevice> Devices;
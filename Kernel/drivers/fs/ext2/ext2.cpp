@@ -0,0 +1,2675 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ext2.hpp"
+
+#include <driver.hpp>
+#include <interface/fs.h>
+#include <algorithm>
+#include <debug.h>
+
+#include "../../../kernel.h"
+
+namespace Driver::ExtendedFilesystem
+{
+	dev_t DriverID;
+
+	static_assert(sizeof(EXT2::SuperBlock) == 1024);
+	static_assert(sizeof(EXT2::GroupDescriptor) == 32);
+	static_assert(sizeof(EXT2::RawInode) == 128);
+
+	/* Directory entry types, used with EXT2_FEATURE_INCOMPAT_FILETYPE */
+	enum EntryTypes : uint8_t
+	{
+		ENTRY_UNKNOWN = 0,
+		ENTRY_REGULAR = 1,
+		ENTRY_DIRECTORY = 2,
+		ENTRY_CHARACTER = 3,
+		ENTRY_BLOCK = 4,
+		ENTRY_FIFO = 5,
+		ENTRY_SOCKET = 6,
+		ENTRY_SYMLINK = 7
+	};
+
+	/* Entries are padded to four bytes */
+	static inline uint32_t EntrySize(size_t NameLength)
+	{
+		return (uint32_t)(8 + NameLength + 3) & ~3u;
+	}
+
+	static ssize_t FindClearBit(const uint8_t *Bitmap, uint32_t From, uint32_t Count)
+	{
+		uint32_t bit = From;
+		while (bit < Count)
+		{
+			if ((bit % 8) == 0 && Bitmap[bit / 8] == 0xFF)
+			{
+				bit += 8;
+				continue;
+			}
+
+			if (!(Bitmap[bit / 8] & (1 << (bit % 8))))
+				return bit;
+			bit++;
+		}
+		return -1;
+	}
+
+	/* A clear byte is eight free blocks in a row, a good place to start a run */
+	static ssize_t FindClearByte(const uint8_t *Bitmap, uint32_t From, uint32_t Count)
+	{
+		for (uint32_t bit = (From + 7) & ~7u; bit + 8 <= Count; bit += 8)
+		{
+			if (Bitmap[bit / 8] == 0)
+				return bit;
+		}
+		return -1;
+	}
+
+	static uint32_t ToUnixTime(const Time::Clock &Clock)
+	{
+		/* The RTC only keeps the last two digits of the year */
+		int64_t year = Clock.Year < 100 ? 2000 + Clock.Year : Clock.Year;
+		int64_t month = Clock.Month;
+
+		/* Days from civil, with March as the first month of the year */
+		year -= month <= 2;
+		int64_t era = (year >= 0 ? year : year - 399) / 400;
+		int64_t yoe = year - era * 400;
+		int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + Clock.Day - 1;
+		int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		int64_t days = era * 146097 + doe - 719468;
+
+		return (uint32_t)(days * 86400 + Clock.Hour * 3600 + Clock.Minute * 60 + Clock.Second);
+	}
+
+#pragma region Directory Hashing
+
+	/*
+		The hashes must match the ones Linux and e2fsprogs use,
+		otherwise indexed directories written by either of them
+		can't be searched.
+	*/
+
+	static inline uint32_t RotateLeft(uint32_t Value, int Shift)
+	{
+		return (Value << Shift) | (Value >> (32 - Shift));
+	}
+
+	/* MD4 cut down to three rounds over 32 bytes of the name */
+	static void HalfMD4(uint32_t Buffer[4], const uint32_t In[8])
+	{
+		uint32_t a = Buffer[0], b = Buffer[1], c = Buffer[2], d = Buffer[3];
+
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD4_ROUND(f, a, b, c, d, x, s) (a = RotateLeft(a + f(b, c, d) + (x), s))
+
+		MD4_ROUND(MD4_F, a, b, c, d, In[0], 3);
+		MD4_ROUND(MD4_F, d, a, b, c, In[1], 7);
+		MD4_ROUND(MD4_F, c, d, a, b, In[2], 11);
+		MD4_ROUND(MD4_F, b, c, d, a, In[3], 19);
+		MD4_ROUND(MD4_F, a, b, c, d, In[4], 3);
+		MD4_ROUND(MD4_F, d, a, b, c, In[5], 7);
+		MD4_ROUND(MD4_F, c, d, a, b, In[6], 11);
+		MD4_ROUND(MD4_F, b, c, d, a, In[7], 19);
+
+		MD4_ROUND(MD4_G, a, b, c, d, In[1] + 0x5A827999, 3);
+		MD4_ROUND(MD4_G, d, a, b, c, In[3] + 0x5A827999, 5);
+		MD4_ROUND(MD4_G, c, d, a, b, In[5] + 0x5A827999, 9);
+		MD4_ROUND(MD4_G, b, c, d, a, In[7] + 0x5A827999, 13);
+		MD4_ROUND(MD4_G, a, b, c, d, In[0] + 0x5A827999, 3);
+		MD4_ROUND(MD4_G, d, a, b, c, In[2] + 0x5A827999, 5);
+		MD4_ROUND(MD4_G, c, d, a, b, In[4] + 0x5A827999, 9);
+		MD4_ROUND(MD4_G, b, c, d, a, In[6] + 0x5A827999, 13);
+
+		MD4_ROUND(MD4_H, a, b, c, d, In[3] + 0x6ED9EBA1, 3);
+		MD4_ROUND(MD4_H, d, a, b, c, In[7] + 0x6ED9EBA1, 9);
+		MD4_ROUND(MD4_H, c, d, a, b, In[2] + 0x6ED9EBA1, 11);
+		MD4_ROUND(MD4_H, b, c, d, a, In[6] + 0x6ED9EBA1, 15);
+		MD4_ROUND(MD4_H, a, b, c, d, In[1] + 0x6ED9EBA1, 3);
+		MD4_ROUND(MD4_H, d, a, b, c, In[5] + 0x6ED9EBA1, 9);
+		MD4_ROUND(MD4_H, c, d, a, b, In[0] + 0x6ED9EBA1, 11);
+		MD4_ROUND(MD4_H, b, c, d, a, In[4] + 0x6ED9EBA1, 15);
+
+#undef MD4_F
+#undef MD4_G
+#undef MD4_H
+#undef MD4_ROUND
+
+		Buffer[0] += a;
+		Buffer[1] += b;
+		Buffer[2] += c;
+		Buffer[3] += d;
+	}
+
+	static void TEATransform(uint32_t Buffer[4], const uint32_t In[4])
+	{
+		uint32_t sum = 0;
+		uint32_t b0 = Buffer[0], b1 = Buffer[1];
+		for (int i = 0; i < 16; i++)
+		{
+			sum += 0x9E3779B9;
+			b0 += ((b1 << 4) + In[0]) ^ (b1 + sum) ^ ((b1 >> 5) + In[1]);
+			b1 += ((b0 << 4) + In[2]) ^ (b0 + sum) ^ ((b0 >> 5) + In[3]);
+		}
+
+		Buffer[0] += b0;
+		Buffer[1] += b1;
+	}
+
+	static uint32_t LegacyHash(const char *Name, size_t Length, bool Unsigned)
+	{
+		uint32_t hash = 0, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+		for (size_t i = 0; i < Length; i++)
+		{
+			int c = Unsigned ? (int)(unsigned char)Name[i] : (int)(signed char)Name[i];
+			hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+			if (hash & 0x80000000)
+				hash -= 0x7FFFFFFF;
+			hash1 = hash0;
+			hash0 = hash;
+		}
+		return hash0 << 1;
+	}
+
+	static void StringToHashBuffer(const char *Name, size_t Length, uint32_t *Buffer, int Count, bool Unsigned)
+	{
+		uint32_t pad = (uint32_t)Length | ((uint32_t)Length << 8);
+		pad |= pad << 16;
+
+		uint32_t value = pad;
+		if (Length > (size_t)Count * 4)
+			Length = Count * 4;
+
+		for (size_t i = 0; i < Length; i++)
+		{
+			int c = Unsigned ? (int)(unsigned char)Name[i] : (int)(signed char)Name[i];
+			value = (uint32_t)c + (value << 8);
+			if ((i % 4) == 3)
+			{
+				*Buffer++ = value;
+				value = pad;
+				Count--;
+			}
+		}
+
+		if (--Count >= 0)
+			*Buffer++ = value;
+		while (--Count >= 0)
+			*Buffer++ = pad;
+	}
+
+	uint32_t EXT2::DxHash(const char *Name, size_t Length, uint8_t Version)
+	{
+		uint32_t buffer[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
+		if (Super.HashSeed[0] | Super.HashSeed[1] | Super.HashSeed[2] | Super.HashSeed[3])
+			memcpy(buffer, Super.HashSeed, sizeof(buffer));
+
+		bool isUnsigned = Version >= EXT2_HASH_UNSIGNED;
+		uint32_t in[8];
+		uint32_t hash;
+
+		switch (Version % EXT2_HASH_UNSIGNED)
+		{
+		case EXT2_HASH_LEGACY:
+			hash = LegacyHash(Name, Length, isUnsigned);
+			break;
+		case EXT2_HASH_HALF_MD4:
+			for (ssize_t left = Length; left > 0; left -= 32, Name += 32)
+			{
+				StringToHashBuffer(Name, left, in, 8, isUnsigned);
+				HalfMD4(buffer, in);
+			}
+			hash = buffer[1];
+			break;
+		default:
+			for (ssize_t left = Length; left > 0; left -= 16, Name += 16)
+			{
+				StringToHashBuffer(Name, left, in, 4, isUnsigned);
+				TEATransform(buffer, in);
+			}
+			hash = buffer[0];
+			break;
+		}
+
+		/* The lowest bit marks hash collisions that continue in the next block */
+		hash &= ~1u;
+		if (hash == (0x7FFFFFFFu << 1))
+			hash = (0x7FFFFFFFu - 1) << 1;
+		return hash;
+	}
+
+#pragma endregion Directory Hashing
+
+#pragma region Device and Cache
+
+	ssize_t EXT2::DeviceRead(void *Buffer, size_t Size, off_t Offset)
+	{
+		ssize_t ret;
+		if (Device.Block)
+			ret = Device.Block->Ops->Read(&BlockInode, Buffer, Size, Offset);
+		else
+			ret = Device.inode.ops->Read(Device.inode.node, Buffer, Size, Offset);
+
+		Stats.DeviceReads++;
+		if (ret > 0)
+			Stats.DeviceBytesRead += ret;
+		return ret;
+	}
+
+	ssize_t EXT2::DeviceWrite(const void *Buffer, size_t Size, off_t Offset)
+	{
+		ssize_t ret;
+		if (Device.Block)
+			ret = Device.Block->Ops->Write(&BlockInode, Buffer, Size, Offset);
+		else
+			ret = Device.inode.ops->Write(Device.inode.node, Buffer, Size, Offset);
+
+		Stats.DeviceWrites++;
+		if (ret > 0)
+			Stats.DeviceBytesWritten += ret;
+		return ret;
+	}
+
+	bool EXT2::ReadBlocks(uint32_t Block, size_t Count, void *Buffer)
+	{
+		size_t size = Count * BlockSize;
+		return DeviceRead(Buffer, size, (off_t)Block * BlockSize) == (ssize_t)size;
+	}
+
+	bool EXT2::WriteBlocks(uint32_t Block, size_t Count, const void *Buffer)
+	{
+		size_t size = Count * BlockSize;
+		return DeviceWrite(Buffer, size, (off_t)Block * BlockSize) == (ssize_t)size;
+	}
+
+	uint32_t EXT2::Now()
+	{
+		uint64_t elapsed = TimeManager->GetTimeNs() - MountNanoseconds;
+		return MountTime + (uint32_t)Time::ToSeconds(elapsed);
+	}
+
+	EXT2::Buffer *EXT2::GetBuffer(uint32_t Block, bool Read)
+	{
+		auto it = Buffers.find(Block);
+		if (it != Buffers.end())
+		{
+			Buffer *buf = it->second;
+			if (buf->Position != BufferLRU.begin())
+			{
+				BufferLRU.erase(buf->Position);
+				BufferLRU.push_front(buf);
+				buf->Position = BufferLRU.begin();
+			}
+
+			if (!Read)
+				memset(buf->Data, 0, BlockSize);
+			Stats.CacheHits++;
+			return buf;
+		}
+
+		if (Block == 0 || Block >= Super.Blocks)
+		{
+			error("Block %u is out of range", Block);
+			return nullptr;
+		}
+
+		uint8_t *data = new uint8_t[BlockSize];
+		if (!Read)
+			memset(data, 0, BlockSize);
+		else if (!ReadBlocks(Block, 1, data))
+		{
+			error("Failed to read block %u", Block);
+			delete[] data;
+			return nullptr;
+		}
+
+		Stats.CacheMisses++;
+		Buffer *buf = new Buffer{Block, data, false, {}};
+		BufferLRU.push_front(buf);
+		buf->Position = BufferLRU.begin();
+		Buffers[Block] = buf;
+		return buf;
+	}
+
+	void EXT2::MarkDirty(Buffer *Buf)
+	{
+		if (Buf->Dirty)
+			return;
+
+		Buf->Dirty = true;
+		DirtyBuffers++;
+	}
+
+	void EXT2::Forget(uint32_t Block)
+	{
+		auto it = Buffers.find(Block);
+		if (it == Buffers.end())
+			return;
+
+		Buffer *buf = it->second;
+		if (buf->Dirty)
+			DirtyBuffers--;
+
+		BufferLRU.erase(buf->Position);
+		Buffers.erase(it);
+		delete[] buf->Data;
+		delete buf;
+	}
+
+	void EXT2::Writeback()
+	{
+		if (ReadOnly)
+			return;
+
+		struct Pending
+		{
+			uint32_t Block;
+			const uint8_t *Data;
+		};
+
+		std::vector<Pending> pending;
+		for (auto &&buf : BufferLRU)
+		{
+			if (!buf->Dirty)
+				continue;
+
+			pending.push_back({buf->Block, buf->Data});
+			buf->Dirty = false;
+		}
+		DirtyBuffers = 0;
+
+		for (uint32_t i = 0; i < GroupCount; i++)
+		{
+			Group &group = Groups[i];
+			if (group.BlockBitmapDirty)
+			{
+				pending.push_back({Descriptor(i)->BlockBitmap, group.BlockBitmap});
+				group.BlockBitmapDirty = false;
+			}
+
+			if (group.InodeBitmapDirty)
+			{
+				pending.push_back({Descriptor(i)->InodeBitmap, group.InodeBitmap});
+				group.InodeBitmapDirty = false;
+			}
+		}
+
+		if (DescriptorsDirty)
+		{
+			for (uint32_t i = 0; i < DescriptorBlocks; i++)
+				pending.push_back({Super.FirstDataBlock + 1 + i, Descriptors + i * BlockSize});
+			DescriptorsDirty = false;
+		}
+
+		std::sort(pending.begin(), pending.end(),
+				  [](const Pending &a, const Pending &b)
+				  { return a.Block < b.Block; });
+
+		size_t i = 0;
+		while (i < pending.size())
+		{
+			size_t count = 1;
+			while (i + count < pending.size() && count < EXT2_MAX_RUN &&
+				   pending[i + count].Block == pending[i].Block + count)
+				count++;
+
+			bool ok;
+			if (count == 1)
+				ok = WriteBlocks(pending[i].Block, 1, pending[i].Data);
+			else
+			{
+				/* Adjacent blocks go out in one request */
+				uint8_t *run = new uint8_t[count * BlockSize];
+				for (size_t j = 0; j < count; j++)
+					memcpy(run + j * BlockSize, pending[i + j].Data, BlockSize);
+				ok = WriteBlocks(pending[i].Block, count, run);
+				delete[] run;
+			}
+
+			if (!ok)
+				error("Failed to write blocks %u-%u", pending[i].Block, pending[i].Block + (uint32_t)count - 1);
+			i += count;
+		}
+
+		/* The superblock goes last, after everything it counts */
+		if (SuperDirty)
+		{
+			Super.LastWrittenTime = Now();
+			if (DeviceWrite(&Super, sizeof(SuperBlock), EXT2_SUPER_OFFSET) != sizeof(SuperBlock))
+				error("Failed to write the superblock");
+			SuperDirty = false;
+		}
+
+		Stats.Writebacks++;
+	}
+
+	void EXT2::Trim()
+	{
+		if (DirtyBuffers >= EXT2_DIRTY_LIMIT)
+			Writeback();
+
+		while (Buffers.size() > EXT2_CACHE_BLOCKS)
+		{
+			Buffer *buf = BufferLRU.back();
+			if (buf->Dirty)
+				Writeback();
+			Forget(buf->Block);
+		}
+	}
+
+#pragma endregion Device and Cache
+
+#pragma region Allocation
+
+	EXT2::GroupDescriptor *EXT2::Descriptor(uint32_t Group)
+	{
+		return (GroupDescriptor *)(Descriptors + Group * sizeof(GroupDescriptor));
+	}
+
+	uint32_t EXT2::BlocksInGroup(uint32_t Group)
+	{
+		if (Group + 1 < GroupCount)
+			return Super.BlocksPerGroup;
+		return Super.Blocks - Super.FirstDataBlock - Group * Super.BlocksPerGroup;
+	}
+
+	uint8_t *EXT2::GetBlockBitmap(uint32_t Group)
+	{
+		struct Group &group = Groups[Group];
+		if (group.BlockBitmap)
+			return group.BlockBitmap;
+
+		uint8_t *bitmap = new uint8_t[BlockSize];
+		if (!ReadBlocks(Descriptor(Group)->BlockBitmap, 1, bitmap))
+		{
+			error("Failed to read the block bitmap of group %u", Group);
+			delete[] bitmap;
+			return nullptr;
+		}
+
+		group.BlockBitmap = bitmap;
+		return bitmap;
+	}
+
+	uint8_t *EXT2::GetInodeBitmap(uint32_t Group)
+	{
+		struct Group &group = Groups[Group];
+		if (group.InodeBitmap)
+			return group.InodeBitmap;
+
+		uint8_t *bitmap = new uint8_t[BlockSize];
+		if (!ReadBlocks(Descriptor(Group)->InodeBitmap, 1, bitmap))
+		{
+			error("Failed to read the inode bitmap of group %u", Group);
+			delete[] bitmap;
+			return nullptr;
+		}
+
+		group.InodeBitmap = bitmap;
+		return bitmap;
+	}
+
+	uint32_t EXT2::AllocateBlock(uint32_t Goal)
+	{
+		if (Super.FreeBlock == 0)
+			return 0;
+
+		if (Goal < Super.FirstDataBlock || Goal >= Super.Blocks)
+			Goal = Super.FirstDataBlock;
+
+		uint32_t first = (Goal - Super.FirstDataBlock) / Super.BlocksPerGroup;
+		uint32_t start = (Goal - Super.FirstDataBlock) % Super.BlocksPerGroup;
+
+		for (uint32_t i = 0; i < GroupCount; i++)
+		{
+			uint32_t group = (first + i) % GroupCount;
+			GroupDescriptor *gd = Descriptor(group);
+			if (gd->FreeBlocks == 0)
+				continue;
+
+			uint8_t *bitmap = GetBlockBitmap(group);
+			if (bitmap == nullptr)
+				continue;
+
+			uint32_t count = BlocksInGroup(group);
+			ssize_t bit;
+			if (i == 0)
+			{
+				/*
+					The goal or close after it. Past that, filling
+					single holes left by deleted files would split
+					the file up, so look for a free run first.
+				*/
+				bit = FindClearBit(bitmap, start, MIN((start + 64) & ~63u, count));
+				if (bit < 0)
+					bit = FindClearByte(bitmap, start, count);
+			}
+			else
+				bit = FindClearByte(bitmap, 0, count);
+
+			if (bit < 0)
+				bit = FindClearBit(bitmap, 0, count);
+
+			if (bit < 0)
+				continue;
+
+			bitmap[bit / 8] |= 1 << (bit % 8);
+			Groups[group].BlockBitmapDirty = true;
+			gd->FreeBlocks--;
+			DescriptorsDirty = true;
+			Super.FreeBlock--;
+			SuperDirty = true;
+			return Super.FirstDataBlock + group * Super.BlocksPerGroup + (uint32_t)bit;
+		}
+
+		return 0;
+	}
+
+	void EXT2::FreeBlock(uint32_t Block)
+	{
+		if (Block < Super.FirstDataBlock || Block >= Super.Blocks)
+		{
+			error("Freeing invalid block %u", Block);
+			return;
+		}
+
+		Forget(Block);
+
+		uint32_t group = (Block - Super.FirstDataBlock) / Super.BlocksPerGroup;
+		uint32_t bit = (Block - Super.FirstDataBlock) % Super.BlocksPerGroup;
+		uint8_t *bitmap = GetBlockBitmap(group);
+		if (bitmap == nullptr)
+			return;
+
+		if (!(bitmap[bit / 8] & (1 << (bit % 8))))
+		{
+			warn("Block %u is already free", Block);
+			return;
+		}
+
+		bitmap[bit / 8] &= ~(1 << (bit % 8));
+		Groups[group].BlockBitmapDirty = true;
+		Descriptor(group)->FreeBlocks++;
+		DescriptorsDirty = true;
+		Super.FreeBlock++;
+		SuperDirty = true;
+	}
+
+	uint32_t EXT2::AllocateInode(EXT2Inode *Parent, bool Directory)
+	{
+		if (Super.FreeInodes == 0)
+			return 0;
+
+		uint32_t first = (Parent->Node.Index - 1) / Super.InodesPerGroup;
+		if (Directory)
+		{
+			/* Spread directories over the groups, so their files have room */
+			uint32_t average = Super.FreeInodes / GroupCount;
+			uint32_t mostFree = 0;
+			bool found = false;
+			for (uint32_t i = 0; i < GroupCount; i++)
+			{
+				GroupDescriptor *gd = Descriptor(i);
+				if (gd->FreeInodes == 0 || gd->FreeInodes < average)
+					continue;
+
+				if (!found || gd->FreeBlocks > mostFree)
+				{
+					first = i;
+					mostFree = gd->FreeBlocks;
+					found = true;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < GroupCount; i++)
+		{
+			uint32_t group = (first + i) % GroupCount;
+			GroupDescriptor *gd = Descriptor(group);
+			if (gd->FreeInodes == 0)
+				continue;
+
+			uint8_t *bitmap = GetInodeBitmap(group);
+			if (bitmap == nullptr)
+				continue;
+
+			ssize_t bit = FindClearBit(bitmap, 0, Super.InodesPerGroup);
+			while (bit >= 0 && group * Super.InodesPerGroup + bit + 1 < FirstInode)
+				bit = FindClearBit(bitmap, bit + 1, Super.InodesPerGroup);
+
+			if (bit < 0)
+				continue;
+
+			bitmap[bit / 8] |= 1 << (bit % 8);
+			Groups[group].InodeBitmapDirty = true;
+			gd->FreeInodes--;
+			if (Directory)
+				gd->UsedDirectories++;
+			DescriptorsDirty = true;
+			Super.FreeInodes--;
+			SuperDirty = true;
+			return group * Super.InodesPerGroup + (uint32_t)bit + 1;
+		}
+
+		return 0;
+	}
+
+	void EXT2::FreeInode(uint32_t Index, bool Directory)
+	{
+		uint32_t group = (Index - 1) / Super.InodesPerGroup;
+		uint32_t bit = (Index - 1) % Super.InodesPerGroup;
+		uint8_t *bitmap = GetInodeBitmap(group);
+		if (bitmap == nullptr)
+			return;
+
+		if (!(bitmap[bit / 8] & (1 << (bit % 8))))
+		{
+			warn("Inode %u is already free", Index);
+			return;
+		}
+
+		bitmap[bit / 8] &= ~(1 << (bit % 8));
+		Groups[group].InodeBitmapDirty = true;
+		GroupDescriptor *gd = Descriptor(group);
+		gd->FreeInodes++;
+		if (Directory)
+			gd->UsedDirectories--;
+		DescriptorsDirty = true;
+		Super.FreeInodes++;
+		SuperDirty = true;
+	}
+
+#pragma endregion Allocation
+
+#pragma region Inodes
+
+	bool EXT2::LocateInode(uint32_t Index, Buffer **Result, size_t *Offset)
+	{
+		if (Index == 0 || Index > Super.Inodes)
+			return false;
+
+		uint32_t group = (Index - 1) / Super.InodesPerGroup;
+		size_t byte = (size_t)((Index - 1) % Super.InodesPerGroup) * InodeSize;
+		Buffer *buf = GetBuffer(Descriptor(group)->InodeTable + (uint32_t)(byte / BlockSize));
+		if (buf == nullptr)
+			return false;
+
+		*Result = buf;
+		*Offset = byte % BlockSize;
+		return true;
+	}
+
+	void EXT2::SetupNode(EXT2Inode *Node, uint32_t Index)
+	{
+		Node->Node.Device = DriverID;
+		Node->Node.Index = Index;
+		Node->Node.Mode = Node->Raw.Mode;
+		Node->Node.Offset = 0;
+		Node->Node.PrivateData = this;
+		Node->Checksum = INODE_CHECKSUM;
+
+		if (S_ISCHR(Node->Raw.Mode) || S_ISBLK(Node->Raw.Mode))
+		{
+			/* Old style numbers in the first pointer, new style in the second */
+			uint32_t old = Node->Raw.Block[0];
+			uint32_t dev = Node->Raw.Block[1];
+			if (old)
+				Node->Node.SetDevice((old >> 8) & 0xFF, old & 0xFF);
+			else
+				Node->Node.SetDevice((dev >> 8) & 0xFFF, (dev & 0xFF) | ((dev >> 12) & 0xFFF00));
+		}
+	}
+
+	EXT2::EXT2Inode *EXT2::GetInode(uint32_t Index)
+	{
+		auto it = Inodes.find(Index);
+		if (it != Inodes.end())
+			return it->second;
+
+		Buffer *buf;
+		size_t offset;
+		if (!LocateInode(Index, &buf, &offset))
+			return nullptr;
+
+		EXT2Inode *node = new EXT2Inode{};
+		memcpy(&node->Raw, buf->Data + offset, sizeof(RawInode));
+		SetupNode(node, Index);
+		Inodes[Index] = node;
+		return node;
+	}
+
+	void EXT2::WriteInode(EXT2Inode *Node, bool Fresh)
+	{
+		Buffer *buf;
+		size_t offset;
+		if (!LocateInode(Node->Node.Index, &buf, &offset))
+		{
+			error("Failed to write inode %lu", Node->Node.Index);
+			return;
+		}
+
+		if (Fresh)
+		{
+			/* Clear what is left of the last inode in this slot */
+			memset(buf->Data + offset, 0, InodeSize);
+			if (InodeSize > sizeof(RawInode) + 4 && Super.MinExtraInodeSize)
+				*(uint16_t *)(buf->Data + offset + sizeof(RawInode)) = Super.MinExtraInodeSize;
+		}
+
+		Node->Node.Mode = Node->Raw.Mode;
+		memcpy(buf->Data + offset, &Node->Raw, sizeof(RawInode));
+		MarkDirty(buf);
+	}
+
+	void EXT2::ReleaseInode(EXT2Inode *Node)
+	{
+		if (HasDataBlocks(Node))
+			TruncateBlocks(Node, 0);
+
+		if (Node->Raw.FileACL)
+		{
+			/* Extended attribute blocks can be shared between inodes */
+			Buffer *buf = GetBuffer(Node->Raw.FileACL);
+			if (buf && ((uint32_t *)buf->Data)[0] == 0xEA020000)
+			{
+				uint32_t &references = ((uint32_t *)buf->Data)[1];
+				if (references > 1)
+				{
+					references--;
+					MarkDirty(buf);
+				}
+				else
+					FreeBlock(Node->Raw.FileACL);
+			}
+			Node->Raw.FileACL = 0;
+		}
+
+		Node->Raw.HardLinks = 0;
+		Node->Raw.DeleteTime = Now();
+		Node->Raw.Sectors = 0;
+		SetSize(Node, 0);
+		WriteInode(Node);
+		FreeInode(Node->Node.Index, S_ISDIR(Node->Raw.Mode));
+
+		/* The VFS may still hold the node, so it is only marked */
+		Node->Deleted = true;
+		Inodes.erase(Node->Node.Index);
+		Released.push_back(Node);
+	}
+
+	uint64_t EXT2::GetSize(EXT2Inode *Node)
+	{
+		uint64_t size = Node->Raw.Size;
+		if (S_ISREG(Node->Raw.Mode))
+			size |= (uint64_t)Node->Raw.SizeHigh << 32;
+		return size;
+	}
+
+	void EXT2::SetSize(EXT2Inode *Node, uint64_t Size)
+	{
+		Node->Raw.Size = (uint32_t)Size;
+		if (!S_ISREG(Node->Raw.Mode))
+			return;
+
+		Node->Raw.SizeHigh = (uint32_t)(Size >> 32);
+		if (Size > INT32_MAX && !(Super.FeatureRoCompatibility & EXT2_FEATURE_RO_COMPAT_LARGE_FILE))
+		{
+			Super.FeatureRoCompatibility |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+			SuperDirty = true;
+		}
+	}
+
+	bool EXT2::HasDataBlocks(EXT2Inode *Node)
+	{
+		switch (Node->Raw.Mode & S_IFMT)
+		{
+		case S_IFREG:
+		case S_IFDIR:
+			return true;
+		case S_IFLNK:
+		{
+			/* Short targets are kept in the block pointers */
+			uint32_t attributes = Node->Raw.FileACL ? BlockSize / 512 : 0;
+			return Node->Raw.Sectors - attributes != 0;
+		}
+		default:
+			return false;
+		}
+	}
+
+	uint32_t EXT2::MapBlock(EXT2Inode *Node, uint64_t Logical, bool Allocate, uint32_t Goal, bool *Fresh)
+	{
+		uint64_t perBlock = BlockSize / 4;
+		uint32_t path[4];
+		int depth;
+
+		if (Fresh)
+			*Fresh = false;
+
+		if (Logical < EXT2_DIRECT_BLOCKS)
+		{
+			depth = 0;
+			path[0] = (uint32_t)Logical;
+		}
+		else if ((Logical -= EXT2_DIRECT_BLOCKS) < perBlock)
+		{
+			depth = 1;
+			path[0] = EXT2_DIRECT_BLOCKS;
+			path[1] = (uint32_t)Logical;
+		}
+		else if ((Logical -= perBlock) < perBlock * perBlock)
+		{
+			depth = 2;
+			path[0] = EXT2_DIRECT_BLOCKS + 1;
+			path[1] = (uint32_t)(Logical / perBlock);
+			path[2] = (uint32_t)(Logical % perBlock);
+		}
+		else if ((Logical -= perBlock * perBlock) < perBlock * perBlock * perBlock)
+		{
+			depth = 3;
+			path[0] = EXT2_DIRECT_BLOCKS + 2;
+			path[1] = (uint32_t)(Logical / (perBlock * perBlock));
+			path[2] = (uint32_t)((Logical / perBlock) % perBlock);
+			path[3] = (uint32_t)(Logical % perBlock);
+		}
+		else
+			return 0;
+
+		if (Goal == 0)
+			Goal = Super.FirstDataBlock + ((uint32_t)(Node->Node.Index - 1) / Super.InodesPerGroup) * Super.BlocksPerGroup;
+
+		uint32_t *slot = &Node->Raw.Block[path[0]];
+		Buffer *holder = nullptr;
+		for (int level = 0;; level++)
+		{
+			if (*slot == 0)
+			{
+				if (!Allocate)
+					return 0;
+
+				uint32_t block = AllocateBlock(Goal);
+				if (block == 0)
+					return 0;
+
+				*slot = block;
+				Node->Raw.Sectors += BlockSize / 512;
+				if (holder)
+					MarkDirty(holder);
+				WriteInode(Node);
+
+				if (level < depth)
+				{
+					Buffer *table = GetBuffer(block, false);
+					if (table == nullptr)
+						return 0;
+					MarkDirty(table);
+				}
+				else if (Fresh)
+					*Fresh = true;
+				Goal = block + 1;
+			}
+
+			if (level == depth)
+				return *slot;
+
+			holder = GetBuffer(*slot);
+			if (holder == nullptr)
+				return 0;
+			slot = &((uint32_t *)holder->Data)[path[level + 1]];
+		}
+	}
+
+	uint32_t EXT2::MapRun(EXT2Inode *Node, uint64_t Logical, size_t Max, size_t *Count)
+	{
+		uint32_t first = MapBlock(Node, Logical, false);
+		size_t count = 1;
+		while (count < Max)
+		{
+			uint32_t next = MapBlock(Node, Logical + count, false);
+			if (first == 0 ? next != 0 : next != first + count)
+				break;
+			count++;
+		}
+
+		*Count = count;
+		return first;
+	}
+
+	uint32_t EXT2::GetGoal(EXT2Inode *Node, uint64_t Logical)
+	{
+		if (Logical > 0)
+		{
+			uint32_t previous = MapBlock(Node, Logical - 1, false);
+			if (previous)
+				return previous + 1;
+		}
+
+		return Super.FirstDataBlock + ((uint32_t)(Node->Node.Index - 1) / Super.InodesPerGroup) * Super.BlocksPerGroup;
+	}
+
+	void EXT2::TruncateTree(EXT2Inode *Node, uint32_t *Slot, int Depth, uint64_t Base, uint64_t First)
+	{
+		if (*Slot == 0)
+			return;
+
+		uint64_t perBlock = BlockSize / 4;
+		uint64_t span = 1;
+		for (int i = 1; i < Depth; i++)
+			span *= perBlock;
+
+		if (Base + span * perBlock <= First)
+			return;
+
+		Buffer *buf = GetBuffer(*Slot);
+		if (buf == nullptr)
+			return;
+
+		uint32_t *table = (uint32_t *)buf->Data;
+		for (uint64_t i = 0; i < perBlock; i++)
+		{
+			uint64_t childBase = Base + i * span;
+			if (table[i] == 0 || childBase + span <= First)
+				continue;
+
+			if (Depth > 1)
+				TruncateTree(Node, &table[i], Depth - 1, childBase, First);
+			else
+			{
+				FreeBlock(table[i]);
+				table[i] = 0;
+				Node->Raw.Sectors -= BlockSize / 512;
+			}
+			MarkDirty(buf);
+		}
+
+		/* The table goes too once nothing below it is kept */
+		if (Base >= First)
+		{
+			FreeBlock(*Slot);
+			*Slot = 0;
+			Node->Raw.Sectors -= BlockSize / 512;
+		}
+	}
+
+	void EXT2::TruncateBlocks(EXT2Inode *Node, uint64_t First)
+	{
+		for (uint64_t i = First; i < EXT2_DIRECT_BLOCKS; i++)
+		{
+			if (Node->Raw.Block[i] == 0)
+				continue;
+
+			FreeBlock(Node->Raw.Block[i]);
+			Node->Raw.Block[i] = 0;
+			Node->Raw.Sectors -= BlockSize / 512;
+		}
+
+		uint64_t perBlock = BlockSize / 4;
+		uint64_t base = EXT2_DIRECT_BLOCKS;
+		uint64_t span = perBlock;
+		for (int depth = 1; depth <= 3; depth++)
+		{
+			TruncateTree(Node, &Node->Raw.Block[EXT2_DIRECT_BLOCKS + depth - 1], depth, base, First);
+			base += span;
+			span *= perBlock;
+		}
+
+		WriteInode(Node);
+	}
+
+#pragma endregion Inodes
+
+#pragma region Directories
+
+	uint8_t EXT2::EntryType(mode_t Mode)
+	{
+		if (!(Super.FeatureIncompatibility & EXT2_FEATURE_INCOMPAT_FILETYPE))
+			return ENTRY_UNKNOWN;
+
+		switch (Mode & S_IFMT)
+		{
+		case S_IFREG:
+			return ENTRY_REGULAR;
+		case S_IFDIR:
+			return ENTRY_DIRECTORY;
+		case S_IFCHR:
+			return ENTRY_CHARACTER;
+		case S_IFBLK:
+			return ENTRY_BLOCK;
+		case S_IFIFO:
+			return ENTRY_FIFO;
+		case S_IFSOCK:
+			return ENTRY_SOCKET;
+		case S_IFLNK:
+			return ENTRY_SYMLINK;
+		default:
+			return ENTRY_UNKNOWN;
+		}
+	}
+
+	bool EXT2::CheckEntry(Buffer *Buf, uint32_t Offset)
+	{
+		if (Offset + 8 > BlockSize)
+			return false;
+
+		DirectoryEntry *entry = (DirectoryEntry *)(Buf->Data + Offset);
+		if (entry->RecordLength < 8 || entry->RecordLength % 4 ||
+			Offset + entry->RecordLength > BlockSize)
+			return false;
+
+		if (entry->Inode && 8u + entry->NameLength > entry->RecordLength)
+			return false;
+		return true;
+	}
+
+	bool EXT2::SearchBlock(Buffer *Buf, const char *Name, size_t Length, Location *Where)
+	{
+		uint32_t offset = 0;
+		uint32_t previous = UINT32_MAX;
+		while (offset < BlockSize)
+		{
+			if (!CheckEntry(Buf, offset))
+			{
+				error("Corrupted directory entry in block %u at %u", Buf->Block, offset);
+				return false;
+			}
+
+			DirectoryEntry *entry = (DirectoryEntry *)(Buf->Data + offset);
+			if (entry->Inode && entry->NameLength == Length &&
+				memcmp(entry->Name, Name, Length) == 0)
+			{
+				Where->Block = Buf->Block;
+				Where->Offset = offset;
+				Where->Previous = previous;
+				return true;
+			}
+
+			previous = offset;
+			offset += entry->RecordLength;
+		}
+		return false;
+	}
+
+	int EXT2::FindEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t *Index, Location *Where)
+	{
+		DxPath path;
+		if (IsIndexed(Directory) && DxFind(Directory, Name, Length, &path))
+		{
+			DxEntry *entries = path.Entries;
+			uint32_t i = path.Position;
+			while (true)
+			{
+				uint32_t block = MapBlock(Directory, entries[i].Block & EXT2_HASH_BLOCK_MASK, false);
+				Buffer *buf = block ? GetBuffer(block) : nullptr;
+				if (buf == nullptr)
+					return -EIO;
+
+				if (SearchBlock(buf, Name, Length, Where))
+				{
+					*Index = ((DirectoryEntry *)(buf->Data + Where->Offset))->Inode;
+					return 0;
+				}
+
+				/* Names with the same hash can spill into the next leaf */
+				DxCountLimit *cl = (DxCountLimit *)entries;
+				if (i + 1 < cl->Count)
+				{
+					if ((entries[++i].Hash & ~1u) != path.Hash)
+						break;
+					continue;
+				}
+
+				/* or into the first leaf of the next node */
+				DxCountLimit *rootCl = (DxCountLimit *)path.RootEntries;
+				if (path.Levels == 0 || path.RootPosition + 1 >= rootCl->Count)
+					break;
+
+				DxEntry *next = &path.RootEntries[++path.RootPosition];
+				if ((next->Hash & ~1u) != path.Hash)
+					break;
+
+				block = MapBlock(Directory, next->Block & EXT2_HASH_BLOCK_MASK, false);
+				buf = block ? GetBuffer(block) : nullptr;
+				if (buf == nullptr)
+					return -EIO;
+
+				entries = (DxEntry *)(buf->Data + 8);
+				i = 0;
+			}
+			return -ENOENT;
+		}
+
+		uint64_t blocks = GetSize(Directory) / BlockSize;
+		for (uint64_t i = 0; i < blocks; i++)
+		{
+			uint32_t block = MapBlock(Directory, i, false);
+			if (block == 0)
+				continue;
+
+			Buffer *buf = GetBuffer(block);
+			if (buf == nullptr)
+				return -EIO;
+
+			if (SearchBlock(buf, Name, Length, Where))
+			{
+				*Index = ((DirectoryEntry *)(buf->Data + Where->Offset))->Inode;
+				return 0;
+			}
+		}
+		return -ENOENT;
+	}
+
+	bool EXT2::InsertInBlock(Buffer *Buf, const char *Name, size_t Length, uint32_t Index, uint8_t Type)
+	{
+		uint32_t needed = EntrySize(Length);
+		uint32_t offset = 0;
+		while (offset < BlockSize)
+		{
+			if (!CheckEntry(Buf, offset))
+				return false;
+
+			DirectoryEntry *entry = (DirectoryEntry *)(Buf->Data + offset);
+			uint32_t used = entry->Inode ? EntrySize(entry->NameLength) : 0;
+			if (entry->RecordLength - used >= needed)
+			{
+				DirectoryEntry *target = entry;
+				if (used)
+				{
+					/* Take the slack at the end of this entry */
+					target = (DirectoryEntry *)(Buf->Data + offset + used);
+					target->RecordLength = (uint16_t)(entry->RecordLength - used);
+					entry->RecordLength = (uint16_t)used;
+				}
+
+				target->Inode = Index;
+				target->NameLength = (uint8_t)Length;
+				target->FileType = Type;
+				memcpy(target->Name, Name, Length);
+				MarkDirty(Buf);
+				return true;
+			}
+
+			offset += entry->RecordLength;
+		}
+		return false;
+	}
+
+	int EXT2::AddEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t Index, mode_t Mode)
+	{
+		uint8_t type = EntryType(Mode);
+		if (IsIndexed(Directory))
+		{
+			int ret = DxAddEntry(Directory, Name, Length, Index, type);
+			if (ret <= 0)
+				return ret;
+		}
+
+		uint64_t blocks = GetSize(Directory) / BlockSize;
+		for (uint64_t i = 0; i < blocks; i++)
+		{
+			uint32_t block = MapBlock(Directory, i, false);
+			if (block == 0)
+				continue;
+
+			Buffer *buf = GetBuffer(block);
+			if (buf == nullptr)
+				return -EIO;
+
+			if (InsertInBlock(buf, Name, Length, Index, type))
+				return 0;
+		}
+
+		/* A directory outgrowing its first block gets an index */
+		if (blocks == 1 && (Super.FeatureCompatibility & EXT2_FEATURE_COMPAT_DIR_INDEX) &&
+			!(Directory->Raw.Flags & EXT2_INDEX_FL))
+		{
+			int ret = MakeIndexed(Directory);
+			if (ret < 0)
+				return ret;
+
+			if (ret == 0)
+			{
+				ret = DxAddEntry(Directory, Name, Length, Index, type);
+				if (ret <= 0)
+					return ret;
+			}
+			blocks = GetSize(Directory) / BlockSize;
+		}
+
+		uint32_t block = MapBlock(Directory, blocks, true, GetGoal(Directory, blocks));
+		if (block == 0)
+			return -ENOSPC;
+
+		Buffer *buf = GetBuffer(block, false);
+		if (buf == nullptr)
+			return -EIO;
+
+		DirectoryEntry *entry = (DirectoryEntry *)buf->Data;
+		entry->Inode = 0;
+		entry->RecordLength = (uint16_t)BlockSize;
+		InsertInBlock(buf, Name, Length, Index, type);
+
+		SetSize(Directory, (blocks + 1) * BlockSize);
+		WriteInode(Directory);
+		return 0;
+	}
+
+	void EXT2::RemoveEntry(Location &Where)
+	{
+		Buffer *buf = GetBuffer(Where.Block);
+		if (buf == nullptr)
+			return;
+
+		DirectoryEntry *entry = (DirectoryEntry *)(buf->Data + Where.Offset);
+		if (Where.Previous == UINT32_MAX)
+			entry->Inode = 0;
+		else
+		{
+			/* The previous entry takes over the space */
+			DirectoryEntry *previous = (DirectoryEntry *)(buf->Data + Where.Previous);
+			previous->RecordLength += entry->RecordLength;
+		}
+		MarkDirty(buf);
+	}
+
+	bool EXT2::IsEmptyDirectory(EXT2Inode *Directory)
+	{
+		uint64_t blocks = GetSize(Directory) / BlockSize;
+		for (uint64_t i = 0; i < blocks; i++)
+		{
+			uint32_t block = MapBlock(Directory, i, false);
+			if (block == 0)
+				continue;
+
+			Buffer *buf = GetBuffer(block);
+			if (buf == nullptr)
+				return false;
+
+			for (uint32_t offset = 0; offset < BlockSize;)
+			{
+				if (!CheckEntry(buf, offset))
+					return false;
+
+				DirectoryEntry *entry = (DirectoryEntry *)(buf->Data + offset);
+				offset += entry->RecordLength;
+				if (entry->Inode == 0)
+					continue;
+
+				if (entry->NameLength == 1 && entry->Name[0] == '.')
+					continue;
+				if (entry->NameLength == 2 && entry->Name[0] == '.' && entry->Name[1] == '.')
+					continue;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool EXT2::IsIndexed(EXT2Inode *Directory)
+	{
+		return (Directory->Raw.Flags & EXT2_INDEX_FL) &&
+			   (Super.FeatureCompatibility & EXT2_FEATURE_COMPAT_DIR_INDEX);
+	}
+
+	bool EXT2::DxFind(EXT2Inode *Directory, const char *Name, size_t Length, DxPath *Path)
+	{
+		uint32_t block = MapBlock(Directory, 0, false);
+		Buffer *buf = block ? GetBuffer(block) : nullptr;
+		if (buf == nullptr)
+			return false;
+
+		/* The root info sits right after "." and ".." */
+		DxRootInfo *info = (DxRootInfo *)(buf->Data + 24);
+		if (info->ReservedZero != 0 || info->InfoLength != sizeof(DxRootInfo) ||
+			info->IndirectLevels > 1 || info->HashVersion > EXT2_HASH_TEA)
+		{
+			warn("Unsupported index on directory %lu", Directory->Node.Index);
+			return false;
+		}
+
+		uint8_t version = info->HashVersion;
+		if (Super.Flags & EXT2_FLAGS_UNSIGNED_HASH)
+			version += EXT2_HASH_UNSIGNED;
+
+		uint8_t levels = info->IndirectLevels;
+		uint32_t hash = DxHash(Name, Length, version);
+		DxEntry *entries = (DxEntry *)(buf->Data + 24 + sizeof(DxRootInfo));
+		for (uint8_t level = 0;; level++)
+		{
+			DxCountLimit *cl = (DxCountLimit *)entries;
+			if (cl->Count == 0 || cl->Count > cl->Limit)
+			{
+				error("Corrupted index in directory %lu", Directory->Node.Index);
+				return false;
+			}
+
+			/* Entry zero covers all hashes below entry one */
+			uint32_t low = 1, high = cl->Count;
+			while (low < high)
+			{
+				uint32_t middle = (low + high) / 2;
+				if (entries[middle].Hash > hash)
+					high = middle;
+				else
+					low = middle + 1;
+			}
+
+			uint32_t position = low - 1;
+			if (level == 0)
+			{
+				Path->Root = buf;
+				Path->RootEntries = entries;
+				Path->RootPosition = position;
+				Path->Levels = levels;
+			}
+
+			if (level == levels)
+			{
+				Path->Node = buf;
+				Path->Entries = entries;
+				Path->Position = position;
+				Path->Leaf = entries[position].Block & EXT2_HASH_BLOCK_MASK;
+				Path->Hash = hash;
+				Path->Version = version;
+				return true;
+			}
+
+			block = MapBlock(Directory, entries[position].Block & EXT2_HASH_BLOCK_MASK, false);
+			buf = block ? GetBuffer(block) : nullptr;
+			if (buf == nullptr)
+				return false;
+
+			/* Interior nodes start with an empty entry covering the block */
+			entries = (DxEntry *)(buf->Data + 8);
+		}
+	}
+
+	int EXT2::DxAddEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t Index, uint8_t Type)
+	{
+		DxPath path;
+		if (!DxFind(Directory, Name, Length, &path))
+		{
+			DropIndex(Directory);
+			return 1;
+		}
+
+		uint32_t block = MapBlock(Directory, path.Leaf, false);
+		Buffer *leaf = block ? GetBuffer(block) : nullptr;
+		if (leaf == nullptr)
+			return -EIO;
+
+		if (InsertInBlock(leaf, Name, Length, Index, Type))
+			return 0;
+
+		DxCountLimit *cl = (DxCountLimit *)path.Entries;
+		if (cl->Count >= cl->Limit)
+		{
+			int ret = DxGrowIndex(Directory, &path);
+			if (ret != 0)
+				return ret;
+
+			/* Start over, the leaf now hangs off a node with room */
+			return DxAddEntry(Directory, Name, Length, Index, Type);
+		}
+
+		struct Record
+		{
+			uint32_t Hash;
+			uint32_t Offset;
+			uint32_t Size;
+		};
+
+		std::vector<Record> records;
+		for (uint32_t offset = 0; offset < BlockSize;)
+		{
+			if (!CheckEntry(leaf, offset))
+				return -EIO;
+
+			DirectoryEntry *entry = (DirectoryEntry *)(leaf->Data + offset);
+			if (entry->Inode)
+				records.push_back({DxHash(entry->Name, entry->NameLength, path.Version),
+								   offset, EntrySize(entry->NameLength)});
+			offset += entry->RecordLength;
+		}
+
+		if (records.size() < 2)
+			return -EIO;
+
+		std::sort(records.begin(), records.end(),
+				  [](const Record &a, const Record &b)
+				  { return a.Hash < b.Hash; });
+
+		/* The upper half of the hashes moves to a new leaf */
+		size_t half = records.size() / 2;
+		uint32_t split = records[half].Hash;
+		bool continued = records[half - 1].Hash == split;
+
+		uint64_t logical = GetSize(Directory) / BlockSize;
+		uint32_t newBlock = MapBlock(Directory, logical, true, GetGoal(Directory, logical));
+		if (newBlock == 0)
+			return -ENOSPC;
+
+		SetSize(Directory, (logical + 1) * BlockSize);
+		WriteInode(Directory);
+
+		Buffer *upper = GetBuffer(newBlock, false);
+		if (upper == nullptr)
+			return -EIO;
+
+		uint8_t *copy = new uint8_t[BlockSize];
+		memcpy(copy, leaf->Data, BlockSize);
+
+		auto pack = [&](Buffer *Target, size_t From, size_t To)
+		{
+			uint32_t offset = 0;
+			DirectoryEntry *last = nullptr;
+			for (size_t i = From; i < To; i++)
+			{
+				last = (DirectoryEntry *)(Target->Data + offset);
+				memcpy(last, copy + records[i].Offset, records[i].Size);
+				last->RecordLength = (uint16_t)records[i].Size;
+				offset += records[i].Size;
+			}
+
+			last->RecordLength += (uint16_t)(BlockSize - offset);
+			MarkDirty(Target);
+		};
+
+		pack(leaf, 0, half);
+		pack(upper, half, records.size());
+		delete[] copy;
+
+		DxEntry *entries = path.Entries;
+		memmove(&entries[path.Position + 2], &entries[path.Position + 1],
+				(cl->Count - path.Position - 1) * sizeof(DxEntry));
+		entries[path.Position + 1].Hash = split | (continued ? 1 : 0);
+		entries[path.Position + 1].Block = (uint32_t)logical;
+		cl->Count++;
+		MarkDirty(path.Node);
+
+		Buffer *target = path.Hash >= split ? upper : leaf;
+		if (InsertInBlock(target, Name, Length, Index, Type))
+			return 0;
+
+		Buffer *other = target == upper ? leaf : upper;
+		if (InsertInBlock(other, Name, Length, Index, Type))
+			return 0;
+		return -ENOSPC;
+	}
+
+	int EXT2::DxGrowIndex(EXT2Inode *Directory, DxPath *Path)
+	{
+		DxCountLimit *rootCl = (DxCountLimit *)Path->RootEntries;
+		if (Path->Levels > 0 && rootCl->Count >= rootCl->Limit)
+		{
+			/* Two levels are all that is supported */
+			DropIndex(Directory);
+			return 1;
+		}
+
+		uint64_t logical = GetSize(Directory) / BlockSize;
+		uint32_t block = MapBlock(Directory, logical, true, GetGoal(Directory, logical));
+		Buffer *node = block ? GetBuffer(block, false) : nullptr;
+		if (node == nullptr)
+			return -ENOSPC;
+
+		SetSize(Directory, (logical + 1) * BlockSize);
+		WriteInode(Directory);
+
+		/* Nodes look like a block with one empty entry to everything else */
+		DirectoryEntry *empty = (DirectoryEntry *)node->Data;
+		empty->Inode = 0;
+		empty->RecordLength = (uint16_t)BlockSize;
+
+		DxEntry *entries = (DxEntry *)(node->Data + 8);
+		DxCountLimit *cl = (DxCountLimit *)entries;
+		uint16_t limit = (uint16_t)((BlockSize - 8) / sizeof(DxEntry));
+
+		if (Path->Levels == 0)
+		{
+			/* The root entries move down into the new node */
+			memcpy(entries, Path->RootEntries, rootCl->Count * sizeof(DxEntry));
+			cl->Limit = limit;
+			rootCl->Count = 1;
+			Path->RootEntries[0].Block = (uint32_t)logical;
+
+			DxRootInfo *info = (DxRootInfo *)(Path->Root->Data + 24);
+			info->IndirectLevels = 1;
+		}
+		else
+		{
+			/* The upper half of the full node moves to the new one */
+			DxEntry *from = Path->Entries;
+			DxCountLimit *fromCl = (DxCountLimit *)from;
+			uint16_t half = fromCl->Count / 2;
+			uint16_t moved = fromCl->Count - half;
+			uint32_t split = from[half].Hash;
+
+			memcpy(entries, from + half, moved * sizeof(DxEntry));
+			cl->Limit = limit;
+			cl->Count = moved;
+			fromCl->Count = half;
+			MarkDirty(Path->Node);
+
+			memmove(&Path->RootEntries[Path->RootPosition + 2], &Path->RootEntries[Path->RootPosition + 1],
+					(rootCl->Count - Path->RootPosition - 1) * sizeof(DxEntry));
+			Path->RootEntries[Path->RootPosition + 1].Hash = split;
+			Path->RootEntries[Path->RootPosition + 1].Block = (uint32_t)logical;
+			rootCl->Count++;
+		}
+
+		MarkDirty(node);
+		MarkDirty(Path->Root);
+		return 0;
+	}
+
+	int EXT2::MakeIndexed(EXT2Inode *Directory)
+	{
+		uint32_t block = MapBlock(Directory, 0, false);
+		Buffer *root = block ? GetBuffer(block) : nullptr;
+		if (root == nullptr)
+			return -EIO;
+
+		DirectoryEntry *dot = (DirectoryEntry *)root->Data;
+		if (!CheckEntry(root, 0) || !CheckEntry(root, 12) ||
+			dot->RecordLength != 12 || dot->NameLength != 1)
+			return 1;
+
+		DirectoryEntry *dotdot = (DirectoryEntry *)(root->Data + 12);
+		if (dotdot->NameLength != 2 || dotdot->Name[0] != '.' || dotdot->Name[1] != '.')
+			return 1;
+
+		uint32_t leafBlock = MapBlock(Directory, 1, true, GetGoal(Directory, 1));
+		if (leafBlock == 0)
+			return -ENOSPC;
+
+		Buffer *leaf = GetBuffer(leafBlock, false);
+		if (leaf == nullptr)
+			return -EIO;
+
+		/* Everything after ".." moves to the first leaf */
+		uint32_t start = 12 + dotdot->RecordLength;
+		uint32_t size = BlockSize - start;
+		memcpy(leaf->Data, root->Data + start, size);
+
+		DirectoryEntry *last = nullptr;
+		for (uint32_t offset = 0; offset < size;)
+		{
+			last = (DirectoryEntry *)(leaf->Data + offset);
+			offset += last->RecordLength;
+		}
+
+		if (last)
+			last->RecordLength += (uint16_t)start;
+		else
+		{
+			last = (DirectoryEntry *)leaf->Data;
+			last->Inode = 0;
+			last->RecordLength = (uint16_t)BlockSize;
+		}
+		MarkDirty(leaf);
+
+		dotdot->RecordLength = (uint16_t)(BlockSize - 12);
+		memset(root->Data + 24, 0, BlockSize - 24);
+
+		uint8_t version = Super.DefHashVersion;
+		if (version > EXT2_HASH_TEA)
+			version = EXT2_HASH_HALF_MD4;
+
+		DxRootInfo *info = (DxRootInfo *)(root->Data + 24);
+		info->HashVersion = version;
+		info->InfoLength = sizeof(DxRootInfo);
+
+		DxEntry *entries = (DxEntry *)(root->Data + 24 + sizeof(DxRootInfo));
+		DxCountLimit *cl = (DxCountLimit *)entries;
+		cl->Limit = (uint16_t)((BlockSize - 24 - sizeof(DxRootInfo)) / sizeof(DxEntry));
+		cl->Count = 1;
+		entries[0].Block = 1;
+		MarkDirty(root);
+
+		SetSize(Directory, 2 * (uint64_t)BlockSize);
+		Directory->Raw.Flags |= EXT2_INDEX_FL;
+		WriteInode(Directory);
+		return 0;
+	}
+
+	void EXT2::DropIndex(EXT2Inode *Directory)
+	{
+		/* Without the flag the index blocks read as empty entries */
+		debug("Dropping the index of directory %lu", Directory->Node.Index);
+		Directory->Raw.Flags &= ~EXT2_INDEX_FL;
+		WriteInode(Directory);
+	}
+
+	EXT2::EXT2Inode *EXT2::ResolveParent(EXT2Inode *Node, const char *Name, size_t Length)
+	{
+		uint32_t index;
+		Location where;
+		if (Node->Parent)
+		{
+			EXT2Inode *parent = GetInode(Node->Parent);
+			if (parent && FindEntry(parent, Name, Length, &index, &where) == 0 &&
+				index == Node->Node.Index)
+				return parent;
+		}
+
+		if (S_ISDIR(Node->Raw.Mode))
+			return Node;
+		return nullptr;
+	}
+
+#pragma endregion Directories
+
+	int EXT2::CreateNode(EXT2Inode *Parent, const char *Name, mode_t Mode, EXT2Inode **Result)
+	{
+		if (ReadOnly)
+			return -EROFS;
+
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(Name, &basename, &length);
+		if (basename == nullptr)
+			return -EINVAL;
+		if (length > EXT2_NAME_LENGTH)
+			return -ENAMETOOLONG;
+
+		uint32_t index;
+		Location where;
+		int ret = FindEntry(Parent, basename, length, &index, &where);
+		if (ret == 0)
+			return -EEXIST;
+		if (ret != -ENOENT)
+			return ret;
+
+		if ((Mode & S_IFMT) == 0)
+			Mode |= S_IFREG;
+
+		bool directory = S_ISDIR(Mode);
+		index = AllocateInode(Parent, directory);
+		if (index == 0)
+			return -ENOSPC;
+
+		uint32_t now = Now();
+		EXT2Inode *node = new EXT2Inode{};
+		node->Raw.Mode = (uint16_t)Mode;
+		node->Raw.HardLinks = directory ? 2 : 1;
+		node->Raw.AccessTime = now;
+		node->Raw.ChangeTime = now;
+		node->Raw.ModifyTime = now;
+		node->Parent = Parent->Node.Index;
+		SetupNode(node, index);
+		Inodes[index] = node;
+		WriteInode(node, true);
+
+		if (directory)
+		{
+			uint32_t block = MapBlock(node, 0, true);
+			Buffer *buf = block ? GetBuffer(block, false) : nullptr;
+			if (buf == nullptr)
+			{
+				ReleaseInode(node);
+				return -ENOSPC;
+			}
+
+			DirectoryEntry *dot = (DirectoryEntry *)buf->Data;
+			dot->Inode = index;
+			dot->RecordLength = 12;
+			dot->NameLength = 1;
+			dot->FileType = EntryType(S_IFDIR);
+			dot->Name[0] = '.';
+
+			DirectoryEntry *dotdot = (DirectoryEntry *)(buf->Data + 12);
+			dotdot->Inode = (uint32_t)Parent->Node.Index;
+			dotdot->RecordLength = (uint16_t)(BlockSize - 12);
+			dotdot->NameLength = 2;
+			dotdot->FileType = EntryType(S_IFDIR);
+			dotdot->Name[0] = '.';
+			dotdot->Name[1] = '.';
+			MarkDirty(buf);
+
+			SetSize(node, BlockSize);
+			WriteInode(node);
+		}
+
+		ret = AddEntry(Parent, basename, length, index, Mode);
+		if (ret < 0)
+		{
+			ReleaseInode(node);
+			return ret;
+		}
+
+		if (directory)
+			Parent->Raw.HardLinks++;
+		Parent->Raw.ModifyTime = now;
+		Parent->Raw.ChangeTime = now;
+		WriteInode(Parent);
+
+		*Result = node;
+		return 0;
+	}
+
+	int EXT2::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *parent = (EXT2Inode *)_Parent;
+		if (parent == nullptr)
+		{
+			*Result = GetRoot();
+			return 0;
+		}
+
+		assert(parent->Checksum == INODE_CHECKSUM);
+		if (parent->Deleted)
+			return -ENOENT;
+		if (!S_ISDIR(parent->Raw.Mode))
+			return -ENOTDIR;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(Name, &basename, &length);
+		if (basename == nullptr)
+		{
+			if (strcmp(Name, "/") == 0)
+			{
+				*Result = GetRoot();
+				return 0;
+			}
+			return -EINVAL;
+		}
+
+		if (length > EXT2_NAME_LENGTH)
+			return -ENAMETOOLONG;
+
+		uint32_t index;
+		Location where;
+		int ret = FindEntry(parent, basename, length, &index, &where);
+		if (ret < 0)
+			return ret;
+
+		EXT2Inode *node = GetInode(index);
+		if (node == nullptr)
+			return -EIO;
+
+		if (!(length == 2 && basename[0] == '.' && basename[1] == '.') &&
+			!(length == 1 && basename[0] == '.'))
+			node->Parent = (uint32_t)parent->Node.Index;
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int EXT2::Create(struct Inode *_Parent, const char *Name, mode_t Mode, struct Inode **Result)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *parent = (EXT2Inode *)_Parent;
+		assert(parent->Checksum == INODE_CHECKSUM);
+		if (parent->Deleted)
+			return -ENOENT;
+
+		EXT2Inode *node;
+		int ret = CreateNode(parent, Name, Mode, &node);
+		if (ret < 0)
+			return ret;
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int EXT2::Remove(struct Inode *_Node, const char *Name)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (ReadOnly)
+			return -EROFS;
+		if (node->Deleted)
+			return -ENOENT;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(Name, &basename, &length);
+		if (basename == nullptr)
+			return -EINVAL;
+		if ((length == 1 && basename[0] == '.') ||
+			(length == 2 && basename[0] == '.' && basename[1] == '.'))
+			return -EINVAL;
+
+		EXT2Inode *parent = ResolveParent(node, basename, length);
+		if (parent == nullptr)
+			return -ENOENT;
+
+		uint32_t index;
+		Location where;
+		int ret = FindEntry(parent, basename, length, &index, &where);
+		if (ret < 0)
+			return ret;
+
+		EXT2Inode *target = GetInode(index);
+		if (target == nullptr)
+			return -EIO;
+
+		bool directory = S_ISDIR(target->Raw.Mode);
+		if (directory && !IsEmptyDirectory(target))
+			return -ENOTEMPTY;
+
+		RemoveEntry(where);
+
+		uint32_t now = Now();
+		parent->Raw.ModifyTime = now;
+		parent->Raw.ChangeTime = now;
+		if (directory)
+		{
+			parent->Raw.HardLinks--;
+			ReleaseInode(target);
+		}
+		else
+		{
+			target->Raw.ChangeTime = now;
+			if (--target->Raw.HardLinks == 0)
+				ReleaseInode(target);
+			else
+				WriteInode(target);
+		}
+
+		WriteInode(parent);
+		return 0;
+	}
+
+	int EXT2::Rename(struct Inode *_Node, const char *OldName, const char *NewName)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (ReadOnly)
+			return -EROFS;
+		if (node->Deleted)
+			return -ENOENT;
+
+		const char *oldBase, *newBase;
+		size_t oldLength, newLength;
+		cwk_path_get_basename(OldName, &oldBase, &oldLength);
+		cwk_path_get_basename(NewName, &newBase, &newLength);
+		if (oldBase == nullptr || newBase == nullptr)
+			return -EINVAL;
+		if (newLength > EXT2_NAME_LENGTH)
+			return -ENAMETOOLONG;
+
+		EXT2Inode *parent = ResolveParent(node, oldBase, oldLength);
+		if (parent == nullptr)
+			return -ENOENT;
+
+		uint32_t index;
+		Location where;
+		int ret = FindEntry(parent, oldBase, oldLength, &index, &where);
+		if (ret < 0)
+			return ret;
+
+		EXT2Inode *moving = GetInode(index);
+		if (moving == nullptr)
+			return -EIO;
+
+		uint32_t existing;
+		uint32_t now = Now();
+		if (FindEntry(parent, newBase, newLength, &existing, &where) == 0)
+		{
+			if (existing == index)
+				return 0;
+
+			EXT2Inode *victim = GetInode(existing);
+			if (victim == nullptr)
+				return -EIO;
+			if (S_ISDIR(victim->Raw.Mode) || S_ISDIR(moving->Raw.Mode))
+				return -EEXIST;
+
+			RemoveEntry(where);
+			victim->Raw.ChangeTime = now;
+			if (--victim->Raw.HardLinks == 0)
+				ReleaseInode(victim);
+			else
+				WriteInode(victim);
+		}
+
+		ret = AddEntry(parent, newBase, newLength, index, moving->Raw.Mode);
+		if (ret < 0)
+			return ret;
+
+		/* Adding may have split a leaf and moved the old entry */
+		if (FindEntry(parent, oldBase, oldLength, &index, &where) == 0)
+			RemoveEntry(where);
+
+		parent->Raw.ModifyTime = now;
+		parent->Raw.ChangeTime = now;
+		WriteInode(parent);
+		moving->Raw.ChangeTime = now;
+		WriteInode(moving);
+		return 0;
+	}
+
+	ssize_t EXT2::Read(struct Inode *_Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (node->Deleted)
+			return -ENOENT;
+		if (S_ISDIR(node->Raw.Mode))
+			return -EISDIR;
+		if (Offset < 0)
+			return -EINVAL;
+
+		uint64_t start = TimeManager->GetTimeNs();
+		uint64_t size = GetSize(node);
+		if ((uint64_t)Offset >= size)
+			return 0;
+		if (Size > size - Offset)
+			Size = size - Offset;
+
+		uint8_t *out = (uint8_t *)Buffer;
+		uint64_t position = Offset;
+		size_t done = 0;
+		while (done < Size)
+		{
+			uint64_t logical = position / BlockSize;
+			uint32_t skip = position % BlockSize;
+
+			if (skip == 0 && Size - done >= BlockSize)
+			{
+				/* Whole blocks go straight to the caller, a run at a time */
+				size_t count;
+				size_t max = MIN((Size - done) / BlockSize, (size_t)EXT2_MAX_RUN);
+				uint32_t block = MapRun(node, logical, max, &count);
+				size_t bytes = count * BlockSize;
+
+				if (block == 0)
+					memset(out + done, 0, bytes);
+				else if (!ReadBlocks(block, count, out + done))
+					return -EIO;
+
+				done += bytes;
+				position += bytes;
+				continue;
+			}
+
+			size_t chunk = MIN((size_t)(BlockSize - skip), Size - done);
+			uint32_t block = MapBlock(node, logical, false);
+			if (block == 0)
+				memset(out + done, 0, chunk);
+			else
+			{
+				if (!ReadBlocks(block, 1, Bounce))
+					return -EIO;
+				memcpy(out + done, Bounce + skip, chunk);
+			}
+
+			done += chunk;
+			position += chunk;
+		}
+
+		Stats.BytesRead += done;
+		Stats.ReadTime += TimeManager->GetTimeNs() - start;
+		return done;
+	}
+
+	ssize_t EXT2::Write(struct Inode *_Node, const void *Buffer, size_t Size, off_t Offset)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (ReadOnly)
+			return -EROFS;
+		if (node->Deleted)
+			return -ENOENT;
+		if (S_ISDIR(node->Raw.Mode))
+			return -EISDIR;
+		if (Offset < 0)
+			return -EINVAL;
+		if (Size == 0)
+			return 0;
+		if ((uint64_t)Offset + Size > MaxFileSize)
+			return -EFBIG;
+
+		uint64_t start = TimeManager->GetTimeNs();
+		const uint8_t *in = (const uint8_t *)Buffer;
+		uint64_t position = Offset;
+		size_t done = 0;
+		int ret = 0;
+		while (done < Size)
+		{
+			uint64_t logical = position / BlockSize;
+			uint32_t skip = position % BlockSize;
+
+			if (skip == 0 && Size - done >= BlockSize)
+			{
+				/* Map the run first so it goes out in one request */
+				size_t max = MIN((Size - done) / BlockSize, (size_t)EXT2_MAX_RUN);
+				uint32_t first = 0;
+				size_t count = 0;
+				while (count < max)
+				{
+					uint32_t goal = count ? first + (uint32_t)count : GetGoal(node, logical);
+					uint32_t block = MapBlock(node, logical + count, true, goal);
+					if (block == 0)
+						break;
+
+					if (count == 0)
+						first = block;
+					else if (block != first + count)
+						break;
+					count++;
+				}
+
+				if (count == 0)
+				{
+					ret = -ENOSPC;
+					break;
+				}
+
+				if (!WriteBlocks(first, count, in + done))
+				{
+					ret = -EIO;
+					break;
+				}
+
+				done += count * BlockSize;
+				position += count * BlockSize;
+				continue;
+			}
+
+			size_t chunk = MIN((size_t)(BlockSize - skip), Size - done);
+			bool fresh;
+			uint32_t block = MapBlock(node, logical, true, GetGoal(node, logical), &fresh);
+			if (block == 0)
+			{
+				ret = -ENOSPC;
+				break;
+			}
+
+			/* A partial block is merged with what is already there */
+			if (fresh)
+				memset(Bounce, 0, BlockSize);
+			else if (!ReadBlocks(block, 1, Bounce))
+			{
+				ret = -EIO;
+				break;
+			}
+
+			memcpy(Bounce + skip, in + done, chunk);
+			if (!WriteBlocks(block, 1, Bounce))
+			{
+				ret = -EIO;
+				break;
+			}
+
+			done += chunk;
+			position += chunk;
+		}
+
+		if (done)
+		{
+			if (position > GetSize(node))
+				SetSize(node, position);
+			uint32_t now = Now();
+			node->Raw.ModifyTime = now;
+			node->Raw.ChangeTime = now;
+			WriteInode(node);
+		}
+
+		Stats.BytesWritten += done;
+		Stats.WriteTime += TimeManager->GetTimeNs() - start;
+		return done ? (ssize_t)done : ret;
+	}
+
+	int EXT2::Truncate(struct Inode *_Node, off_t Size)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (ReadOnly)
+			return -EROFS;
+		if (node->Deleted)
+			return -ENOENT;
+		if (S_ISDIR(node->Raw.Mode))
+			return -EISDIR;
+		if (Size < 0)
+			return -EINVAL;
+		if ((uint64_t)Size > MaxFileSize)
+			return -EFBIG;
+
+		uint64_t size = Size;
+		if (size < GetSize(node))
+		{
+			TruncateBlocks(node, (size + BlockSize - 1) / BlockSize);
+
+			/* The tail must read back as zero if the file grows again */
+			uint32_t tail = size % BlockSize;
+			uint32_t block = tail ? MapBlock(node, size / BlockSize, false) : 0;
+			if (block && ReadBlocks(block, 1, Bounce))
+			{
+				memset(Bounce + tail, 0, BlockSize - tail);
+				WriteBlocks(block, 1, Bounce);
+			}
+		}
+
+		SetSize(node, size);
+		uint32_t now = Now();
+		node->Raw.ModifyTime = now;
+		node->Raw.ChangeTime = now;
+		WriteInode(node);
+		return 0;
+	}
+
+	int EXT2::Ioctl(struct Inode *_Node, unsigned long Request, void *Argp)
+	{
+		if (Request != EXT2_GET_STATISTICS)
+			return -ENOTTY;
+		if (Argp == nullptr)
+			return -EFAULT;
+
+		*(Statistics *)Argp = GetStatistics();
+		return 0;
+	}
+
+	__no_sanitize("alignment") ssize_t EXT2::ReadDir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (node->Deleted)
+			return -ENOENT;
+		if (!S_ISDIR(node->Raw.Mode))
+			return -ENOTDIR;
+
+		static const unsigned char types[] = {DT_UNKNOWN, DT_REG, DT_DIR, DT_CHR,
+											  DT_BLK, DT_FIFO, DT_SOCK, DT_LNK};
+
+		size_t totalSize = 0;
+		off_t index = 0;
+		off_t entries = 0;
+		uint64_t blocks = GetSize(node) / BlockSize;
+		for (uint64_t i = 0; i < blocks && entries < Entries; i++)
+		{
+			uint32_t block = MapBlock(node, i, false);
+			if (block == 0)
+				continue;
+
+			EXT2::Buffer *buf = GetBuffer(block);
+			if (buf == nullptr)
+				return -EIO;
+
+			for (uint32_t offset = 0; offset < BlockSize && entries < Entries;)
+			{
+				if (!CheckEntry(buf, offset))
+				{
+					error("Corrupted directory entry in block %u at %u", block, offset);
+					return totalSize ? (ssize_t)totalSize : -EIO;
+				}
+
+				DirectoryEntry *entry = (DirectoryEntry *)(buf->Data + offset);
+				offset += entry->RecordLength;
+				if (entry->Inode == 0 || index++ < Offset)
+					continue;
+
+				uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + entry->NameLength + 1);
+				if (totalSize + reclen > Size)
+				{
+					if (totalSize == 0)
+						return -EINVAL;
+					return totalSize;
+				}
+
+				struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+				ent->d_ino = entry->Inode;
+				ent->d_off = index - 1;
+				ent->d_reclen = reclen;
+				if (Super.FeatureIncompatibility & EXT2_FEATURE_INCOMPAT_FILETYPE)
+					ent->d_type = entry->FileType <= ENTRY_SYMLINK ? types[entry->FileType] : DT_UNKNOWN;
+				else
+				{
+					EXT2Inode *child = GetInode(entry->Inode);
+					ent->d_type = child ? IFTODT(child->Raw.Mode) : DT_UNKNOWN;
+				}
+				memcpy(ent->d_name, entry->Name, entry->NameLength);
+				ent->d_name[entry->NameLength] = '\0';
+
+				totalSize += reclen;
+				entries++;
+			}
+		}
+
+		if (totalSize + sizeof(struct kdirent) >= Size)
+			return totalSize;
+
+		struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+		ent->d_ino = 0;
+		ent->d_off = 0;
+		ent->d_reclen = 0;
+		ent->d_type = DT_UNKNOWN;
+		ent->d_name[0] = '\0';
+		return totalSize;
+	}
+
+	int EXT2::SymLink(struct Inode *_Parent, const char *Name, const char *Target, struct Inode **Result)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *parent = (EXT2Inode *)_Parent;
+		assert(parent->Checksum == INODE_CHECKSUM);
+		if (parent->Deleted)
+			return -ENOENT;
+
+		size_t length = strlen(Target);
+		if (length >= BlockSize)
+			return -ENAMETOOLONG;
+
+		bool fast = length < sizeof(RawInode::Block);
+		if (!fast && Super.FreeBlock == 0)
+			return -ENOSPC;
+
+		EXT2Inode *node;
+		int ret = CreateNode(parent, Name, S_IFLNK | 0777, &node);
+		if (ret < 0)
+			return ret;
+
+		if (fast)
+			memcpy(node->Raw.Block, Target, length);
+		else
+		{
+			uint32_t block = MapBlock(node, 0, true);
+			if (block == 0)
+				return -ENOSPC;
+
+			memset(Bounce, 0, BlockSize);
+			memcpy(Bounce, Target, length);
+			if (!WriteBlocks(block, 1, Bounce))
+				return -EIO;
+		}
+
+		SetSize(node, length);
+		WriteInode(node);
+		*Result = &node->Node;
+		return 0;
+	}
+
+	ssize_t EXT2::ReadLink(struct Inode *_Node, char *Buffer, size_t Size)
+	{
+		SmartLock(Lock);
+		Trim();
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (node->Deleted)
+			return -ENOENT;
+		if (!S_ISLNK(node->Raw.Mode))
+			return -EINVAL;
+
+		size_t length = MIN((size_t)GetSize(node), Size);
+		if (!HasDataBlocks(node))
+			memcpy(Buffer, node->Raw.Block, length);
+		else
+		{
+			uint32_t block = MapBlock(node, 0, false);
+			if (block == 0 || !ReadBlocks(block, 1, Bounce))
+				return -EIO;
+			memcpy(Buffer, Bounce, length);
+		}
+
+		if (length < Size)
+			Buffer[length] = '\0';
+		return length;
+	}
+
+	int EXT2::Stat(struct Inode *_Node, struct kstat *Stat)
+	{
+		SmartLock(Lock);
+
+		EXT2Inode *node = (EXT2Inode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (node->Deleted)
+			return -ENOENT;
+
+		Stat->Device = DriverID;
+		Stat->Index = node->Node.Index;
+		Stat->Mode = node->Raw.Mode;
+		Stat->HardLinks = node->Raw.HardLinks;
+		Stat->UserID = node->Raw.UserID | ((uint32_t)node->Raw.UserIDHigh << 16);
+		Stat->GroupID = node->Raw.GroupID | ((uint32_t)node->Raw.GroupIDHigh << 16);
+		Stat->RawDevice = node->Node.RawDevice;
+		Stat->Size = GetSize(node);
+		Stat->AccessTime = node->Raw.AccessTime;
+		Stat->ModifyTime = node->Raw.ModifyTime;
+		Stat->ChangeTime = node->Raw.ChangeTime;
+		Stat->BlockSize = BlockSize;
+		Stat->Blocks = node->Raw.Sectors;
+		Stat->Attribute = 0;
+		return 0;
+	}
+
+	void EXT2::Synchronize()
+	{
+		SmartLock(Lock);
+		Writeback();
+	}
+
+	EXT2::Statistics EXT2::GetStatistics()
+	{
+		SmartLock(Lock);
+		return Stats;
+	}
+
+	int EXT2::Mount()
+	{
+		if (DeviceRead(&Super, sizeof(SuperBlock), EXT2_SUPER_OFFSET) != sizeof(SuperBlock))
+			return -EIO;
+		if (Super.Magic != EXT2_SUPER_MAGIC)
+			return -EINVAL;
+
+		if (Super.LogBlockSize > 5)
+		{
+			error("Blocks of %u bytes are not supported", 1024u << Super.LogBlockSize);
+			return -ENOTSUP;
+		}
+
+		BlockSize = 1024 << Super.LogBlockSize;
+		if (Super.RevLevel == 0)
+		{
+			InodeSize = sizeof(RawInode);
+			FirstInode = 11;
+		}
+		else
+		{
+			InodeSize = Super.InodeSize;
+			FirstInode = Super.FirstInode;
+
+			if (Super.FeatureIncompatibility & ~EXT2_FEATURE_INCOMPAT_SUPPORTED)
+			{
+				error("Unsupported incompatible features %#x",
+					  Super.FeatureIncompatibility & ~EXT2_FEATURE_INCOMPAT_SUPPORTED);
+				return -ENOTSUP;
+			}
+
+			if (Super.FeatureRoCompatibility & ~EXT2_FEATURE_RO_COMPAT_SUPPORTED)
+			{
+				warn("Unsupported read-only features %#x, mounting read-only",
+					 Super.FeatureRoCompatibility & ~EXT2_FEATURE_RO_COMPAT_SUPPORTED);
+				ReadOnly = true;
+			}
+		}
+
+		if (InodeSize < sizeof(RawInode) || InodeSize > BlockSize || (InodeSize & (InodeSize - 1)) ||
+			Super.BlocksPerGroup == 0 || Super.BlocksPerGroup > BlockSize * 8 ||
+			Super.InodesPerGroup == 0 || Super.InodesPerGroup > BlockSize * 8 ||
+			Super.FirstDataBlock >= Super.Blocks)
+		{
+			error("Invalid superblock");
+			return -EINVAL;
+		}
+
+		if (!(Super.State & EXT2_VALID_FS))
+			warn("Filesystem was not cleanly unmounted");
+
+		GroupCount = (Super.Blocks - Super.FirstDataBlock + Super.BlocksPerGroup - 1) / Super.BlocksPerGroup;
+		DescriptorBlocks = (uint32_t)((GroupCount * sizeof(GroupDescriptor) + BlockSize - 1) / BlockSize);
+		Descriptors = new uint8_t[DescriptorBlocks * BlockSize];
+		if (!ReadBlocks(Super.FirstDataBlock + 1, DescriptorBlocks, Descriptors))
+		{
+			delete[] Descriptors;
+			Descriptors = nullptr;
+			return -EIO;
+		}
+
+		Groups.resize(GroupCount);
+		Bounce = new uint8_t[BlockSize];
+
+		uint64_t perBlock = BlockSize / 4;
+		MaxFileSize = (EXT2_DIRECT_BLOCKS + perBlock + perBlock * perBlock +
+					   perBlock * perBlock * perBlock) *
+					  BlockSize;
+
+		MountTime = ToUnixTime(Time::ReadClock());
+		MountNanoseconds = TimeManager->GetTimeNs();
+
+		if (GetInode(EXT2_ROOT_INODE) == nullptr)
+			return -EIO;
+
+		if (!ReadOnly)
+		{
+			/* Set again when the filesystem is unmounted */
+			Super.State &= ~EXT2_VALID_FS;
+			Super.MountedTimes++;
+			Super.LastMountTime = Now();
+			SuperDirty = true;
+			Writeback();
+		}
+
+		KPrint("ext2: %u blocks of %u bytes in %u groups%s", Super.Blocks, BlockSize,
+			   GroupCount, ReadOnly ? ", read-only" : "");
+		return 0;
+	}
+
+	struct Inode *EXT2::GetRoot()
+	{
+		return &GetInode(EXT2_ROOT_INODE)->Node;
+	}
+
+	bool EXT2::Probe(FileSystemDevice *Device)
+	{
+		SuperBlock *super = new SuperBlock;
+		ssize_t ret;
+
+		if (Device->Block)
+		{
+			struct Inode node{};
+			node.PrivateData = Device->Block->PrivateData;
+			ret = Device->Block->Ops->Read(&node, super, sizeof(SuperBlock), EXT2_SUPER_OFFSET);
+		}
+		else if (Device->inode.node && Device->inode.ops && Device->inode.ops->Read)
+			ret = Device->inode.ops->Read(Device->inode.node, super, sizeof(SuperBlock), EXT2_SUPER_OFFSET);
+		else
+			ret = -EINVAL;
+
+		bool valid = ret == sizeof(SuperBlock) && super->Magic == EXT2_SUPER_MAGIC;
+		delete super;
+		return valid;
+	}
+
+	EXT2::EXT2(FileSystemDevice *Device)
+	{
+		this->Device = *Device;
+		this->BlockInode = {};
+		if (Device->Block)
+			this->BlockInode.PrivateData = Device->Block->PrivateData;
+	}
+
+	EXT2::~EXT2()
+	{
+		if (Descriptors && !ReadOnly)
+		{
+			Super.State |= EXT2_VALID_FS;
+			SuperDirty = true;
+			Writeback();
+		}
+
+		for (auto &&buf : BufferLRU)
+		{
+			delete[] buf->Data;
+			delete buf;
+		}
+
+		for (auto &&group : Groups)
+		{
+			delete[] group.BlockBitmap;
+			delete[] group.InodeBitmap;
+		}
+
+		for (auto &&node : Inodes)
+			delete node.second;
+		for (auto &&node : Released)
+			delete node;
+
+		delete[] Descriptors;
+		delete[] Bounce;
+	}
+
+	std::vector<EXT2 *> Namespaces;
+
+	int EXT2_AllocateInode(FileSystemInfo *Info, Inode **Result) { return -ENOTSUP; }
+	int EXT2_DeleteInode(FileSystemInfo *Info, Inode *Node) { return -ENOTSUP; }
+
+	int EXT2_Synchronize(FileSystemInfo *Info, Inode *Node)
+	{
+		/* Metadata goes out in batches, not per node */
+		if (Node)
+			return 0;
+
+		for (auto &&i : Namespaces)
+			i->Synchronize();
+		return 0;
+	}
+
+	int EXT2_Destroy(FileSystemInfo *Info)
+	{
+		for (auto &&i : Namespaces)
+			delete i;
+		Namespaces.clear();
+		return 0;
+	}
+
+	int EXT2_Probe(FileSystemDevice *Device)
+	{
+		return EXT2::Probe(Device) ? 0 : -ENODEV;
+	}
+
+	int EXT2_Mount(FileSystemInfo *FS, Inode **Root, FileSystemDevice *Device)
+	{
+		EXT2 *instance = new EXT2(Device);
+		int ret = instance->Mount();
+		if (ret < 0)
+		{
+			delete instance;
+			return ret;
+		}
+
+		*Root = instance->GetRoot();
+		Namespaces.push_back(instance);
+		return 0;
+	}
+
+	int EXT2_Unmount(FileSystemInfo *FS)
+	{
+		for (auto &&i : Namespaces)
+			i->Synchronize();
+		return 0;
+	}
+
+	int EXT2_Lookup(Inode *p, const char *nm, Inode **r) { return ((EXT2 *)p->PrivateData)->Lookup(p, nm, r); }
+	int EXT2_Create(Inode *p, const char *nm, mode_t m, Inode **r) { return ((EXT2 *)p->PrivateData)->Create(p, nm, m, r); }
+	int EXT2_Remove(Inode *p, const char *nm) { return ((EXT2 *)p->PrivateData)->Remove(p, nm); }
+	int EXT2_Rename(Inode *p, const char *on, const char *nn) { return ((EXT2 *)p->PrivateData)->Rename(p, on, nn); }
+	ssize_t EXT2_Read(Inode *n, void *b, size_t s, off_t o) { return ((EXT2 *)n->PrivateData)->Read(n, b, s, o); }
+	ssize_t EXT2_Write(Inode *n, const void *b, size_t s, off_t o) { return ((EXT2 *)n->PrivateData)->Write(n, b, s, o); }
+	int EXT2_Truncate(Inode *n, off_t s) { return ((EXT2 *)n->PrivateData)->Truncate(n, s); }
+	int EXT2_Open(Inode *n, int f, mode_t m) { return 0; }
+	int EXT2_Close(Inode *n) { return 0; }
+	int EXT2_Ioctl(Inode *n, unsigned long rq, void *ap) { return ((EXT2 *)n->PrivateData)->Ioctl(n, rq, ap); }
+	ssize_t EXT2_ReadDir(Inode *n, kdirent *b, size_t s, off_t o, off_t Entries) { return ((EXT2 *)n->PrivateData)->ReadDir(n, b, s, o, Entries); }
+	int EXT2_MkDir(Inode *p, const char *nm, mode_t m, Inode **r) { return ((EXT2 *)p->PrivateData)->Create(p, nm, S_IFDIR | (m & ~S_IFMT), r); }
+	int EXT2_RmDir(Inode *p, const char *nm) { return ((EXT2 *)p->PrivateData)->Remove(p, nm); }
+	int EXT2_SymLink(Inode *p, const char *nm, const char *t, Inode **r) { return ((EXT2 *)p->PrivateData)->SymLink(p, nm, t, r); }
+	ssize_t EXT2_ReadLink(Inode *n, char *b, size_t s) { return ((EXT2 *)n->PrivateData)->ReadLink(n, b, s); }
+	off_t EXT2_Seek(Inode *n, off_t o) { return o; }
+	int EXT2_Stat(Inode *n, kstat *st) { return ((EXT2 *)n->PrivateData)->Stat(n, st); }
+
+	static SuperBlockOperations ext2SuperOps = {
+		.AllocateInode = EXT2_AllocateInode,
+		.DeleteInode = EXT2_DeleteInode,
+		.Synchronize = EXT2_Synchronize,
+		.Destroy = EXT2_Destroy,
+		.Probe = EXT2_Probe,
+		.Mount = EXT2_Mount,
+		.Unmount = EXT2_Unmount};
+
+	static InodeOperations ext2InodeOps = {
+		.Lookup = EXT2_Lookup,
+		.Create = EXT2_Create,
+		.Remove = EXT2_Remove,
+		.Rename = EXT2_Rename,
+		.Read = EXT2_Read,
+		.Write = EXT2_Write,
+		.Truncate = EXT2_Truncate,
+		.Open = EXT2_Open,
+		.Close = EXT2_Close,
+		.Ioctl = EXT2_Ioctl,
+		.ReadDir = EXT2_ReadDir,
+		.MkDir = EXT2_MkDir,
+		.RmDir = EXT2_RmDir,
+		.SymLink = EXT2_SymLink,
+		.ReadLink = EXT2_ReadLink,
+		.Seek = EXT2_Seek,
+		.Stat = EXT2_Stat,
+		.Poll = nullptr};
+
+	int Entry()
+	{
+		FileSystemInfo *fsi = new FileSystemInfo{};
+		fsi->Name = "Second Extended Filesystem";
+		fsi->Flags = FS_NEGATIVE_CACHE;
+		fsi->SuperOps = ext2SuperOps;
+		fsi->Ops = ext2InodeOps;
+		v0::RegisterFileSystem(DriverID, fsi);
+		return 0;
+	}
+
+	int Final()
+	{
+		for (auto &&i : Namespaces)
+			delete i;
+		return 0;
+	}
+
+	int Panic() { return 0; }
+	int Probe() { return 0; }
+
+	REGISTER_BUILTIN_DRIVER(ext2,
+							"Second Extended Filesystem Driver",
+							"enderice2",
+							1, 0, 0,
+							Entry,
+							Final,
+							Panic,
+							Probe);
+}
@@ -21,6 +21,54 @@
 #include <types.h>
 
 #include <fs/vfs.hpp>
+#include <lock.hpp>
+#include <unordered_map>
+#include <vector>
+#include <list>
+
+#define EXT2_SUPER_MAGIC 0xEF53
+#define EXT2_SUPER_OFFSET 1024
+#define EXT2_ROOT_INODE 2
+#define EXT2_NAME_LENGTH 255
+
+/* Block pointers in the inode, the last three are indirect */
+#define EXT2_DIRECT_BLOCKS 12
+#define EXT2_BLOCK_POINTERS 15
+
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+
+#define EXT2_FEATURE_INCOMPAT_SUPPORTED EXT2_FEATURE_INCOMPAT_FILETYPE
+#define EXT2_FEATURE_RO_COMPAT_SUPPORTED (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | \
+										  EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+/* Superblock state and flags */
+#define EXT2_VALID_FS 0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+
+/* Inode flags */
+#define EXT2_INDEX_FL 0x00001000
+
+/* Hashed directory index */
+#define EXT2_HASH_LEGACY 0
+#define EXT2_HASH_HALF_MD4 1
+#define EXT2_HASH_TEA 2
+#define EXT2_HASH_UNSIGNED 3
+#define EXT2_HASH_BLOCK_MASK 0x0FFFFFFF
+
+/* Metadata blocks kept in memory */
+#define EXT2_CACHE_BLOCKS 1024
+
+/* Dirty metadata blocks that trigger a writeback */
+#define EXT2_DIRTY_LIMIT 64
+
+/* Largest run of contiguous blocks sent in one request */
+#define EXT2_MAX_RUN 256
+
+/* Ioctl on any node of the filesystem, fills an EXT2::Statistics */
+#define EXT2_GET_STATISTICS 0xE201
 
 namespace Driver::ExtendedFilesystem
 {
@@ -80,10 +128,343 @@ namespace Driver::ExtendedFilesystem
 			uint16_t ReservedWordPad;
 			uint32_t DefaultMountOptions;
 			uint32_t FirstMetaBg;
-			uint32_t Reserved[190];
+			uint32_t MakeTime;
+			uint32_t JournalBlocks[17];
+			uint32_t BlocksHigh;
+			uint32_t ReservedBlocksHigh;
+			uint32_t FreeBlocksHigh;
+			uint16_t MinExtraInodeSize;
+			uint16_t WantExtraInodeSize;
+			uint32_t Flags;
+			uint32_t Reserved[167];
+		};
+
+		struct GroupDescriptor
+		{
+			uint32_t BlockBitmap;
+			uint32_t InodeBitmap;
+			uint32_t InodeTable;
+			uint16_t FreeBlocks;
+			uint16_t FreeInodes;
+			uint16_t UsedDirectories;
+			uint16_t Padding;
+			uint32_t Reserved[3];
+		};
+
+		struct RawInode
+		{
+			uint16_t Mode;
+			uint16_t UserID;
+			uint32_t Size;
+			uint32_t AccessTime;
+			uint32_t ChangeTime;
+			uint32_t ModifyTime;
+			uint32_t DeleteTime;
+			uint16_t GroupID;
+			uint16_t HardLinks;
+			uint32_t Sectors;
+			uint32_t Flags;
+			uint32_t OSD1;
+			uint32_t Block[EXT2_BLOCK_POINTERS];
+			uint32_t Generation;
+			uint32_t FileACL;
+			uint32_t SizeHigh;
+			uint32_t FragmentAddress;
+			uint8_t Fragment;
+			uint8_t FragmentSize;
+			uint16_t Padding;
+			uint16_t UserIDHigh;
+			uint16_t GroupIDHigh;
+			uint32_t Reserved;
+		};
+
+		struct DirectoryEntry
+		{
+			uint32_t Inode;
+			uint16_t RecordLength;
+			uint8_t NameLength;
+			uint8_t FileType;
+			char Name[];
+		};
+
+		/**
+		 * Hashed directory index. The first block of an indexed
+		 * directory holds "." and ".." followed by this, then the
+		 * index entries. Older drivers see one big ".." entry.
+		 */
+		struct DxRootInfo
+		{
+			uint32_t ReservedZero;
+			uint8_t HashVersion;
+			uint8_t InfoLength;
+			uint8_t IndirectLevels;
+			uint8_t Flags;
+		};
+
+		struct DxEntry
+		{
+			uint32_t Hash;
+			uint32_t Block;
+		};
+
+		/* Takes the place of the hash in the first entry */
+		struct DxCountLimit
+		{
+			uint16_t Limit;
+			uint16_t Count;
+		};
+
+		struct Statistics
+		{
+			/* File data moved by Read() and Write() */
+			uint64_t BytesRead;
+			uint64_t BytesWritten;
+
+			/* Time spent in Read() and Write(), in nanoseconds */
+			uint64_t ReadTime;
+			uint64_t WriteTime;
+
+			/* Requests sent to the device */
+			uint64_t DeviceReads;
+			uint64_t DeviceWrites;
+			uint64_t DeviceBytesRead;
+			uint64_t DeviceBytesWritten;
+
+			/* Metadata block cache */
+			uint64_t CacheHits;
+			uint64_t CacheMisses;
+			uint64_t Writebacks;
+		};
+
+		constexpr static int INODE_CHECKSUM = 0xE27A11;
+
+		struct EXT2Inode
+		{
+			struct Inode Node;
+			RawInode Raw;
+
+			/* Directory the inode was last found in */
+			uint32_t Parent;
+			bool Deleted;
+			int Checksum;
 		};
 
-		EXT2(void *partition);
+	private:
+		struct Buffer
+		{
+			uint32_t Block;
+			uint8_t *Data;
+			bool Dirty;
+			std::list<Buffer *>::iterator Position;
+		};
+
+		struct Group
+		{
+			uint8_t *BlockBitmap = nullptr;
+			uint8_t *InodeBitmap = nullptr;
+			bool BlockBitmapDirty = false;
+			bool InodeBitmapDirty = false;
+		};
+
+		/* Where a directory entry was found */
+		struct Location
+		{
+			uint32_t Block;
+			uint32_t Offset;
+			uint32_t Previous;
+		};
+
+		/* Path to a leaf of a hashed directory */
+		struct DxPath
+		{
+			Buffer *Root;
+			DxEntry *RootEntries;
+			uint32_t RootPosition;
+			uint8_t Levels;
+
+			/* The bottom index node, the root if Levels is zero */
+			Buffer *Node;
+			DxEntry *Entries;
+			uint32_t Position;
+
+			uint32_t Leaf;
+			uint32_t Hash;
+			uint8_t Version;
+		};
+
+		NewLock(Lock);
+		FileSystemDevice Device;
+		struct Inode BlockInode;
+		bool ReadOnly = false;
+
+		SuperBlock Super;
+		bool SuperDirty = false;
+		uint32_t BlockSize = 0;
+		uint32_t InodeSize = 0;
+		uint32_t FirstInode = 0;
+		uint32_t GroupCount = 0;
+		uint64_t MaxFileSize = 0;
+
+		uint8_t *Descriptors = nullptr;
+		uint32_t DescriptorBlocks = 0;
+		bool DescriptorsDirty = false;
+		std::vector<Group> Groups;
+
+		std::unordered_map<uint32_t, Buffer *> Buffers;
+		std::list<Buffer *> BufferLRU;
+		size_t DirtyBuffers = 0;
+
+		std::unordered_map<uint32_t, EXT2Inode *> Inodes;
+
+		/* Deleted inodes, the VFS may still hold them */
+		std::vector<EXT2Inode *> Released;
+
+		/* Partial blocks of file data, not cached */
+		uint8_t *Bounce = nullptr;
+
+		/* Wall clock at mount, the clock is read once */
+		uint32_t MountTime = 0;
+		uint64_t MountNanoseconds = 0;
+
+		Statistics Stats{};
+
+		ssize_t DeviceRead(void *Buffer, size_t Size, off_t Offset);
+		ssize_t DeviceWrite(const void *Buffer, size_t Size, off_t Offset);
+		bool ReadBlocks(uint32_t Block, size_t Count, void *Buffer);
+		bool WriteBlocks(uint32_t Block, size_t Count, const void *Buffer);
+		uint32_t Now();
+
+		/**
+		 * Get a metadata block from the cache
+		 *
+		 * @param Read If false the block is new and is
+		 *             zero filled instead of read
+		 */
+		Buffer *GetBuffer(uint32_t Block, bool Read = true);
+		void MarkDirty(Buffer *Buf);
+		void Forget(uint32_t Block);
+
+		/**
+		 * Write dirty metadata in block order, adjacent
+		 * blocks are merged into one request
+		 */
+		void Writeback();
+
+		/**
+		 * Called before every operation, no buffer is in
+		 * use so least recently used ones can be dropped
+		 */
+		void Trim();
+
+		GroupDescriptor *Descriptor(uint32_t Group);
+		uint32_t BlocksInGroup(uint32_t Group);
+		uint8_t *GetBlockBitmap(uint32_t Group);
+		uint8_t *GetInodeBitmap(uint32_t Group);
+
+		/**
+		 * Allocate a block as close after Goal as possible,
+		 * so that files grow into contiguous runs
+		 *
+		 * @return The block, zero if the disk is full
+		 */
+		uint32_t AllocateBlock(uint32_t Goal);
+		void FreeBlock(uint32_t Block);
+		uint32_t AllocateInode(EXT2Inode *Parent, bool Directory);
+		void FreeInode(uint32_t Index, bool Directory);
+
+		EXT2Inode *GetInode(uint32_t Index);
+		void SetupNode(EXT2Inode *Node, uint32_t Index);
+		bool LocateInode(uint32_t Index, Buffer **Result, size_t *Offset);
+		void WriteInode(EXT2Inode *Node, bool Fresh = false);
+		void ReleaseInode(EXT2Inode *Node);
+		uint64_t GetSize(EXT2Inode *Node);
+		void SetSize(EXT2Inode *Node, uint64_t Size);
+		bool HasDataBlocks(EXT2Inode *Node);
+
+		/**
+		 * Map a block of a file to a block of the device
+		 *
+		 * @param Allocate Allocate the block and any missing
+		 *                 indirect blocks, starting at Goal
+		 * @param Fresh Set if the block was just allocated
+		 * @return The block, zero for a hole or a full disk
+		 */
+		uint32_t MapBlock(EXT2Inode *Node, uint64_t Logical, bool Allocate,
+						  uint32_t Goal = 0, bool *Fresh = nullptr);
+
+		/**
+		 * Map a run of blocks that are contiguous on the
+		 * device, or a run of holes
+		 */
+		uint32_t MapRun(EXT2Inode *Node, uint64_t Logical, size_t Max, size_t *Count);
+		uint32_t GetGoal(EXT2Inode *Node, uint64_t Logical);
+		void TruncateTree(EXT2Inode *Node, uint32_t *Slot, int Depth, uint64_t Base, uint64_t First);
+		void TruncateBlocks(EXT2Inode *Node, uint64_t First);
+
+		uint8_t EntryType(mode_t Mode);
+		bool CheckEntry(Buffer *Buf, uint32_t Offset);
+		bool SearchBlock(Buffer *Buf, const char *Name, size_t Length, Location *Where);
+		int FindEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t *Index, Location *Where);
+		bool InsertInBlock(Buffer *Buf, const char *Name, size_t Length, uint32_t Index, uint8_t Type);
+		int AddEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t Index, mode_t Mode);
+		void RemoveEntry(Location &Where);
+		bool IsEmptyDirectory(EXT2Inode *Directory);
+
+		bool IsIndexed(EXT2Inode *Directory);
+		uint32_t DxHash(const char *Name, size_t Length, uint8_t Version);
+		bool DxFind(EXT2Inode *Directory, const char *Name, size_t Length, DxPath *Path);
+		int DxAddEntry(EXT2Inode *Directory, const char *Name, size_t Length, uint32_t Index, uint8_t Type);
+
+		/**
+		 * Make room in the full bottom node of Path, by moving
+		 * the root down a level or by splitting the node
+		 *
+		 * @return Zero if there is room, one if the index was
+		 *         dropped, otherwise an error code
+		 */
+		int DxGrowIndex(EXT2Inode *Directory, DxPath *Path);
+		int MakeIndexed(EXT2Inode *Directory);
+		void DropIndex(EXT2Inode *Directory);
+
+		/**
+		 * Find the directory holding Name for Remove() and
+		 * Rename(), which get either the directory or the
+		 * node itself
+		 */
+		EXT2Inode *ResolveParent(EXT2Inode *Node, const char *Name, size_t Length);
+		int CreateNode(EXT2Inode *Parent, const char *Name, mode_t Mode, EXT2Inode **Result);
+
+	public:
+		int Lookup(struct Inode *Parent, const char *Name, struct Inode **Result);
+		int Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int Remove(struct Inode *Parent, const char *Name);
+		int Rename(struct Inode *Parent, const char *OldName, const char *NewName);
+		ssize_t Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset);
+		ssize_t Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset);
+		int Truncate(struct Inode *Node, off_t Size);
+		int Ioctl(struct Inode *Node, unsigned long Request, void *Argp);
+		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
+		int SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result);
+		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
+		int Stat(struct Inode *Node, struct kstat *Stat);
+
+		/**
+		 * Write all pending metadata to the device
+		 */
+		void Synchronize();
+		Statistics GetStatistics();
+
+		/**
+		 * Read the superblock and group descriptors
+		 *
+		 * @return Zero on success, otherwise an error code
+		 */
+		int Mount();
+		struct Inode *GetRoot();
+
+		static bool Probe(FileSystemDevice *Device);
+
+		EXT2(FileSystemDevice *Device);
 		~EXT2();
 	};
 }
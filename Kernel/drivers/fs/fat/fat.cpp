@@ -15,14 +15,967 @@
 	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "fat.hpp"
+
 #include <driver.hpp>
+#include <interface/fs.h>
+#include <debug.h>
+
+#include "../../../kernel.h"
+
+/* Directories can't have more entries than this */
+#define FAT_MAX_DIRECTORY_SIZE (65536 * sizeof(FATDirectoryEntry))
+
+/* Characters in each long name entry */
+#define FAT_LFN_CHARACTERS 13
 
 namespace Driver::FileAllocationTable
 {
 	dev_t DriverID;
 
-	int Entry() { return 0; }
-	int Final() { return 0; }
+	static_assert(sizeof(BIOSParameterBlock) == 36);
+	static_assert(sizeof(FATDirectoryEntry) == 32);
+	static_assert(sizeof(FATLongNameEntry) == 32);
+
+	static time_t FromFATTime(uint16_t Date, uint16_t Time)
+	{
+		if (Date == 0)
+			return 0;
+
+		int64_t year = 1980 + (Date >> 9);
+		int64_t month = (Date >> 5) & 0xF;
+		int64_t day = Date & 0x1F;
+		if (month < 1 || month > 12 || day < 1)
+			return 0;
+
+		/* Days from civil, with March as the first month of the year */
+		year -= month <= 2;
+		int64_t era = (year >= 0 ? year : year - 399) / 400;
+		int64_t yoe = year - era * 400;
+		int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+		int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		int64_t days = era * 146097 + doe - 719468;
+
+		return (time_t)(days * 86400 + (Time >> 11) * 3600 + ((Time >> 5) & 0x3F) * 60 + (Time & 0x1F) * 2);
+	}
+
+	static uint8_t ShortNameChecksum(const uint8_t *Name)
+	{
+		uint8_t sum = 0;
+		for (int i = 0; i < 11; i++)
+			sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + Name[i]);
+		return sum;
+	}
+
+	static void AppendUTF8(std::string &String, uint32_t Character)
+	{
+		if (Character < 0x80)
+			String += (char)Character;
+		else if (Character < 0x800)
+		{
+			String += (char)(0xC0 | (Character >> 6));
+			String += (char)(0x80 | (Character & 0x3F));
+		}
+		else if (Character < 0x10000)
+		{
+			String += (char)(0xE0 | (Character >> 12));
+			String += (char)(0x80 | ((Character >> 6) & 0x3F));
+			String += (char)(0x80 | (Character & 0x3F));
+		}
+		else
+		{
+			String += (char)(0xF0 | (Character >> 18));
+			String += (char)(0x80 | ((Character >> 12) & 0x3F));
+			String += (char)(0x80 | ((Character >> 6) & 0x3F));
+			String += (char)(0x80 | (Character & 0x3F));
+		}
+	}
+
+	/* FAT names are case insensitive, at least for ASCII */
+	static std::string FoldName(const char *Name, size_t Length)
+	{
+		std::string folded(Name, Length);
+		for (auto &&c : folded)
+		{
+			if (c >= 'A' && c <= 'Z')
+				c = (char)(c - 'A' + 'a');
+		}
+		return folded;
+	}
+
+	static bool IsPowerOfTwo(uint32_t Value) { return Value && !(Value & (Value - 1)); }
+
+	/* exFAT and NTFS zero the fields checked here */
+	static bool CheckBootRecord(const uint8_t *Sector)
+	{
+		if (Sector[510] != 0x55 || Sector[511] != 0xAA)
+			return false;
+
+		if (Sector[0] != 0xEB && Sector[0] != 0xE9)
+			return false;
+
+		const BIOSParameterBlock *bpb = (const BIOSParameterBlock *)Sector;
+		const ExtendedBootRecord_FAT32 *ebr = (const ExtendedBootRecord_FAT32 *)(Sector + sizeof(BIOSParameterBlock));
+		if (bpb->BytesPerSector < 512 || bpb->BytesPerSector > 4096 || !IsPowerOfTwo(bpb->BytesPerSector))
+			return false;
+		if (!IsPowerOfTwo(bpb->SectorsPerCluster))
+			return false;
+		if (bpb->ReservedSectors == 0 || bpb->NumberOfFATs == 0)
+			return false;
+		if (bpb->SectorsPerFAT == 0 && ebr->SectorsPerFAT == 0)
+			return false;
+		if (bpb->Sectors16 == 0 && bpb->Sectors32 == 0)
+			return false;
+		return true;
+	}
+
+#pragma region Device and Table
+
+	ssize_t FAT::DeviceRead(void *Buffer, size_t Size, off_t Offset)
+	{
+		if (Device.Block)
+			return Device.Block->Ops->Read(&BlockInode, Buffer, Size, Offset);
+		return Device.inode.ops->Read(Device.inode.node, Buffer, Size, Offset);
+	}
+
+	bool FAT::ReadSectors(uint64_t Sector, size_t Count, void *Buffer)
+	{
+		size_t size = Count * BytesPerSector;
+		return DeviceRead(Buffer, size, (off_t)(Sector * BytesPerSector)) == (ssize_t)size;
+	}
+
+	uint8_t *FAT::GetChunk(uint32_t Index)
+	{
+		auto it = Chunks.find(Index);
+		if (it != Chunks.end())
+		{
+			Chunk *chunk = it->second;
+			ChunkLRU.splice(ChunkLRU.begin(), ChunkLRU, chunk->Position);
+			return chunk->Data;
+		}
+
+		uint64_t offset = (uint64_t)Index * FAT_CHUNK_SIZE;
+		uint64_t tableSize = (uint64_t)FATSectors * BytesPerSector;
+		if (offset >= tableSize)
+			return nullptr;
+
+		Chunk *chunk;
+		if (Chunks.size() >= FAT_CACHE_CHUNKS)
+		{
+			chunk = ChunkLRU.back();
+			ChunkLRU.pop_back();
+			Chunks.erase(chunk->Index);
+		}
+		else
+		{
+			chunk = new Chunk;
+			chunk->Data = new uint8_t[FAT_CHUNK_SIZE];
+		}
+
+		/* Sectors are never larger than a chunk, so this stays whole */
+		size_t length = (size_t)MIN((uint64_t)FAT_CHUNK_SIZE, tableSize - offset);
+		if (!ReadSectors(FATStart + offset / BytesPerSector, length / BytesPerSector, chunk->Data))
+		{
+			error("Failed to read the FAT at %#lx", offset);
+			delete[] chunk->Data;
+			delete chunk;
+			return nullptr;
+		}
+
+		chunk->Index = Index;
+		ChunkLRU.push_front(chunk);
+		chunk->Position = ChunkLRU.begin();
+		Chunks[Index] = chunk;
+		return chunk->Data;
+	}
+
+	uint32_t FAT::NextCluster(uint32_t Cluster)
+	{
+		uint64_t tableSize = (uint64_t)FATSectors * BytesPerSector;
+		uint32_t next;
+
+		switch (Type)
+		{
+		case FAT12:
+		{
+			uint32_t offset = Cluster + Cluster / 2;
+			if (offset + 1 >= tableSize)
+				return 0;
+
+			uint16_t value = (uint16_t)(Table[offset] | (Table[offset + 1] << 8));
+			next = (Cluster & 1) ? (value >> 4) : (value & 0xFFF);
+			break;
+		}
+		case FAT16:
+		{
+			uint32_t offset = Cluster * 2;
+			if (offset + 1 >= tableSize)
+				return 0;
+
+			next = (uint32_t)(Table[offset] | (Table[offset + 1] << 8));
+			break;
+		}
+		case FAT32:
+		{
+			uint64_t offset = (uint64_t)Cluster * 4;
+			uint8_t *data = GetChunk((uint32_t)(offset / FAT_CHUNK_SIZE));
+			if (data == nullptr)
+				return 0;
+
+			uint32_t value;
+			memcpy(&value, data + offset % FAT_CHUNK_SIZE, sizeof(value));
+			next = value & 0x0FFFFFFF;
+			break;
+		}
+		default:
+			return 0;
+		}
+
+		/* End of chain, bad cluster or a free one in the middle of a chain */
+		return IsValidCluster(next) ? next : 0;
+	}
+
+#pragma endregion Device and Table
+
+#pragma region Cluster Chains
+
+	uint32_t FAT::MapCluster(FATInode *Node, uint32_t Logical, uint32_t *Run)
+	{
+		if (Logical >= Node->Mapped)
+		{
+			if (Node->ChainEnd)
+				return 0;
+
+			if (Node->Extents.empty())
+			{
+				if (!IsValidCluster(Node->FirstCluster))
+				{
+					Node->ChainEnd = true;
+					return 0;
+				}
+
+				Node->Extents.push_back({0, Node->FirstCluster, 1});
+				Node->Mapped = 1;
+			}
+
+			while (Logical >= Node->Mapped)
+			{
+				Extent &last = Node->Extents.back();
+				uint32_t next = NextCluster(last.Cluster + last.Length - 1);
+				if (next == 0)
+				{
+					Node->ChainEnd = true;
+					return 0;
+				}
+
+				if (Node->Mapped >= Clusters)
+				{
+					error("Cluster chain of \"%s\" loops", Node->Name.c_str());
+					Node->ChainEnd = true;
+					return 0;
+				}
+
+				if (next == last.Cluster + last.Length)
+					last.Length++;
+				else
+					Node->Extents.push_back({Node->Mapped, next, 1});
+				Node->Mapped++;
+			}
+		}
+
+		/* Extents are sorted and cover [0, Mapped) without gaps */
+		size_t low = 0;
+		size_t high = Node->Extents.size();
+		while (high - low > 1)
+		{
+			size_t middle = (low + high) / 2;
+			if (Node->Extents[middle].Logical <= Logical)
+				low = middle;
+			else
+				high = middle;
+		}
+
+		const Extent &extent = Node->Extents[low];
+		uint32_t within = Logical - extent.Logical;
+		if (Run)
+			*Run = extent.Length - within;
+		return extent.Cluster + within;
+	}
+
+	ssize_t FAT::ReadData(FATInode *Node, uint8_t *Buffer, size_t Size, uint64_t Offset)
+	{
+		if (Offset >= Node->Size)
+			return 0;
+		Size = (size_t)MIN((uint64_t)Size, Node->Size - Offset);
+		if (Size == 0)
+			return 0;
+
+		/* Walk the chain up to the end of the request once, so that
+		   the loop below gets whole runs instead of single clusters */
+		MapCluster(Node, (uint32_t)((Offset + Size - 1) / ClusterSize), nullptr);
+
+		uint32_t maxRun = MAX(FAT_MAX_REQUEST / ClusterSize, 1u);
+		size_t done = 0;
+		while (done < Size)
+		{
+			uint64_t position = Offset + done;
+			uint32_t logical = (uint32_t)(position / ClusterSize);
+			uint32_t within = (uint32_t)(position % ClusterSize);
+
+			uint32_t run;
+			uint32_t cluster = MapCluster(Node, logical, &run);
+			if (cluster == 0)
+			{
+				error("\"%s\" is shorter than its size", Node->Name.c_str());
+				break;
+			}
+
+			if (within == 0 && Size - done >= ClusterSize)
+			{
+				uint32_t count = (uint32_t)MIN((size_t)MIN(run, maxRun), (Size - done) / ClusterSize);
+				if (!ReadSectors(ClusterSector(cluster), (size_t)count * SectorsPerCluster, Buffer + done))
+					return done ? (ssize_t)done : -EIO;
+				done += (size_t)count * ClusterSize;
+				continue;
+			}
+
+			/* Only fetch the sectors the request touches */
+			uint32_t sector = within / BytesPerSector;
+			uint32_t skip = within % BytesPerSector;
+			size_t length = MIN((size_t)(ClusterSize - within), Size - done);
+			size_t sectors = (skip + length + BytesPerSector - 1) / BytesPerSector;
+			if (!ReadSectors(ClusterSector(cluster) + sector, sectors, Bounce))
+				return done ? (ssize_t)done : -EIO;
+
+			memcpy(Buffer + done, Bounce + skip, length);
+			done += length;
+		}
+
+		return done ? (ssize_t)done : -EIO;
+	}
+
+#pragma endregion Cluster Chains
+
+#pragma region Directories
+
+	FAT::FATInode *FAT::AddChild(FATInode *Directory, const std::string &Name,
+								 const std::string &ShortName, const FATDirectoryEntry *Entry, uint64_t Position)
+	{
+		FATInode *node = new FATInode;
+		node->Node = {};
+		node->Node.Device = DriverID;
+		node->Node.Index = Position / sizeof(FATDirectoryEntry) + 2;
+		node->Node.Offset = 0;
+		node->Node.PrivateData = this;
+
+		node->Name = Name;
+		node->Parent = Directory;
+		node->Attributes = Entry->Attributes;
+		node->FirstCluster = Entry->ClusterLow;
+		if (Type == FAT32)
+			node->FirstCluster |= (uint32_t)Entry->ClusterHigh << 16;
+		node->Size = Entry->Size;
+		node->ModifyTime = FromFATTime(Entry->ModifyDate, Entry->ModifyTime);
+		node->AccessTime = FromFATTime(Entry->AccessDate, 0);
+		node->CreationTime = FromFATTime(Entry->CreationDate, Entry->CreationTime);
+		node->Mapped = 0;
+		node->ChainEnd = false;
+		node->Scanned = false;
+		node->Checksum = INODE_CHECKSUM;
+
+		mode_t mode = (Entry->Attributes & FAT_ATTRIBUTE_READ_ONLY) ? 0555 : 0755;
+		if (Entry->Attributes & FAT_ATTRIBUTE_DIRECTORY)
+		{
+			node->Node.Mode = S_IFDIR | mode;
+			node->Size = 0;
+		}
+		else
+			node->Node.Mode = S_IFREG | (mode & 0666);
+
+		Directory->Children.push_back(node);
+		Directory->Names.insert({FoldName(Name.c_str(), Name.size()), node});
+		if (ShortName != Name)
+			Directory->Names.insert({FoldName(ShortName.c_str(), ShortName.size()), node});
+		return node;
+	}
+
+	int FAT::Scan(FATInode *Directory)
+	{
+		if (Directory->Scanned)
+			return 0;
+
+		std::vector<uint8_t> data;
+		std::vector<uint32_t> clusters;
+		if (Directory == Root && Type != FAT32)
+		{
+			/* The FAT12 and FAT16 root directory has a fixed place */
+			data.resize((size_t)RootSectors * BytesPerSector);
+			if (!ReadSectors(RootStart, RootSectors, data.data()))
+				return -EIO;
+		}
+		else
+		{
+			for (uint32_t logical = 0; data.size() < FAT_MAX_DIRECTORY_SIZE;)
+			{
+				uint32_t run;
+				uint32_t cluster = MapCluster(Directory, logical, &run);
+				if (cluster == 0)
+					break;
+
+				size_t offset = data.size();
+				data.resize(offset + (size_t)run * ClusterSize);
+				if (!ReadSectors(ClusterSector(cluster), (size_t)run * SectorsPerCluster, data.data() + offset))
+					return -EIO;
+
+				for (uint32_t i = 0; i < run; i++)
+					clusters.push_back(cluster + i);
+				logical += run;
+			}
+		}
+
+		auto position = [&](size_t Offset) -> uint64_t
+		{
+			if (clusters.empty())
+				return (uint64_t)RootStart * BytesPerSector + Offset;
+			return ClusterSector(clusters[Offset / ClusterSize]) * BytesPerSector + Offset % ClusterSize;
+		};
+
+		uint16_t longName[20 * FAT_LFN_CHARACTERS];
+		bool longValid = false;
+		uint8_t longSum = 0;
+		int longNext = 0;
+		int longPieces = 0;
+
+		for (size_t offset = 0; offset + sizeof(FATDirectoryEntry) <= data.size(); offset += sizeof(FATDirectoryEntry))
+		{
+			const FATDirectoryEntry *entry = (const FATDirectoryEntry *)(data.data() + offset);
+			if (entry->Name[0] == 0x00)
+				break;
+
+			if (entry->Name[0] == 0xE5)
+			{
+				longValid = false;
+				continue;
+			}
+
+			if ((entry->Attributes & 0x3F) == FAT_ATTRIBUTE_LONG_NAME)
+			{
+				const FATLongNameEntry *piece = (const FATLongNameEntry *)entry;
+				int order = piece->Order & 0x1F;
+
+				if (piece->Order & 0x40)
+				{
+					longValid = order >= 1 && order <= 20;
+					longSum = piece->Checksum;
+					longNext = order;
+					longPieces = order;
+				}
+				else if (!longValid || order != longNext || piece->Checksum != longSum)
+				{
+					longValid = false;
+					continue;
+				}
+
+				if (!longValid)
+					continue;
+
+				uint16_t *chars = longName + (order - 1) * FAT_LFN_CHARACTERS;
+				memcpy(chars, piece->Name1, sizeof(piece->Name1));
+				memcpy(chars + 5, piece->Name2, sizeof(piece->Name2));
+				memcpy(chars + 11, piece->Name3, sizeof(piece->Name3));
+				longNext--;
+				continue;
+			}
+
+			if (entry->Attributes & FAT_ATTRIBUTE_VOLUME_ID)
+			{
+				longValid = false;
+				continue;
+			}
+
+			std::string shortName;
+			for (int i = 0; i < 8 && entry->Name[i] != ' '; i++)
+			{
+				char c = (char)(i == 0 && entry->Name[0] == 0x05 ? 0xE5 : entry->Name[i]);
+				if ((entry->NTReserved & 0x08) && c >= 'A' && c <= 'Z')
+					c = (char)(c - 'A' + 'a');
+				shortName += c;
+			}
+
+			if (entry->Name[8] != ' ')
+			{
+				shortName += '.';
+				for (int i = 8; i < 11 && entry->Name[i] != ' '; i++)
+				{
+					char c = (char)entry->Name[i];
+					if ((entry->NTReserved & 0x10) && c >= 'A' && c <= 'Z')
+						c = (char)(c - 'A' + 'a');
+					shortName += c;
+				}
+			}
+
+			std::string name;
+			if (longValid && longNext == 0 && ShortNameChecksum(entry->Name) == longSum)
+			{
+				int length = longPieces * FAT_LFN_CHARACTERS;
+				for (int i = 0; i < length && longName[i] != 0x0000; i++)
+				{
+					uint32_t c = longName[i];
+					if (c >= 0xD800 && c <= 0xDBFF && i + 1 < length &&
+						longName[i + 1] >= 0xDC00 && longName[i + 1] <= 0xDFFF)
+					{
+						c = 0x10000 + ((c - 0xD800) << 10) + (longName[i + 1] - 0xDC00);
+						i++;
+					}
+					AppendUTF8(name, c);
+				}
+			}
+			longValid = false;
+
+			if (name.empty())
+				name = shortName;
+			if (name == "." || name == ".." || shortName.empty())
+				continue;
+
+			AddChild(Directory, name, shortName, entry, position(offset));
+		}
+
+		Directory->Scanned = true;
+		return 0;
+	}
+
+	void FAT::FreeTree(FATInode *Node)
+	{
+		for (auto &&child : Node->Children)
+			FreeTree(child);
+		delete Node;
+	}
+
+#pragma endregion Directories
+
+#pragma region Operations
+
+	int FAT::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
+	{
+		SmartLock(Lock);
+
+		FATInode *parent = (FATInode *)_Parent;
+		if (parent == nullptr)
+		{
+			*Result = GetRoot();
+			return 0;
+		}
+
+		assert(parent->Checksum == INODE_CHECKSUM);
+		if (!S_ISDIR(parent->Node.Mode))
+			return -ENOTDIR;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(Name, &basename, &length);
+		if (basename == nullptr)
+		{
+			if (strcmp(Name, "/") == 0)
+			{
+				*Result = GetRoot();
+				return 0;
+			}
+			return -EINVAL;
+		}
+
+		if (length == 1 && basename[0] == '.')
+		{
+			*Result = &parent->Node;
+			return 0;
+		}
+
+		if (length == 2 && basename[0] == '.' && basename[1] == '.')
+		{
+			*Result = parent->Parent ? &parent->Parent->Node : GetRoot();
+			return 0;
+		}
+
+		if (length > 255)
+			return -ENAMETOOLONG;
+
+		int ret = Scan(parent);
+		if (ret < 0)
+			return ret;
+
+		auto it = parent->Names.find(FoldName(basename, length));
+		if (it == parent->Names.end())
+			return -ENOENT;
+
+		*Result = &it->second->Node;
+		return 0;
+	}
+
+	ssize_t FAT::Read(struct Inode *_Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		SmartLock(Lock);
+
+		FATInode *node = (FATInode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (S_ISDIR(node->Node.Mode))
+			return -EISDIR;
+		if (Offset < 0)
+			return -EINVAL;
+
+		return ReadData(node, (uint8_t *)Buffer, Size, (uint64_t)Offset);
+	}
+
+	__no_sanitize("alignment") ssize_t FAT::ReadDir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	{
+		SmartLock(Lock);
+
+		FATInode *node = (FATInode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+		if (!S_ISDIR(node->Node.Mode))
+			return -ENOTDIR;
+
+		int ret = Scan(node);
+		if (ret < 0)
+			return ret;
+
+		/* "." and ".." come first, the children follow */
+		size_t totalSize = 0;
+		off_t entries = 0;
+		off_t count = (off_t)node->Children.size() + 2;
+		for (off_t i = Offset; i < count && entries < Entries; i++)
+		{
+			const char *name;
+			size_t length;
+			FATInode *target;
+			if (i == 0)
+			{
+				name = ".";
+				length = 1;
+				target = node;
+			}
+			else if (i == 1)
+			{
+				name = "..";
+				length = 2;
+				target = node->Parent ? node->Parent : node;
+			}
+			else
+			{
+				target = node->Children[i - 2];
+				name = target->Name.c_str();
+				length = target->Name.size();
+			}
+
+			uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + length + 1);
+			if (totalSize + reclen > Size)
+			{
+				if (totalSize == 0)
+					return -EINVAL;
+				return totalSize;
+			}
+
+			struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+			ent->d_ino = target->Node.Index;
+			ent->d_off = i;
+			ent->d_reclen = reclen;
+			ent->d_type = S_ISDIR(target->Node.Mode) ? DT_DIR : DT_REG;
+			memcpy(ent->d_name, name, length);
+			ent->d_name[length] = '\0';
+
+			totalSize += reclen;
+			entries++;
+		}
+
+		if (totalSize + sizeof(struct kdirent) >= Size)
+			return totalSize;
+
+		struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+		ent->d_ino = 0;
+		ent->d_off = 0;
+		ent->d_reclen = 0;
+		ent->d_type = DT_UNKNOWN;
+		ent->d_name[0] = '\0';
+		return totalSize;
+	}
+
+	int FAT::Stat(struct Inode *_Node, struct kstat *Stat)
+	{
+		SmartLock(Lock);
+
+		FATInode *node = (FATInode *)_Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+
+		uint64_t size = node->Size;
+		if (S_ISDIR(node->Node.Mode))
+		{
+			/* Walks the whole chain, which scanning does anyway */
+			MapCluster(node, UINT32_MAX - 1, nullptr);
+			size = (uint64_t)node->Mapped * ClusterSize;
+			if (node == Root && Type != FAT32)
+				size = (uint64_t)RootSectors * BytesPerSector;
+		}
+
+		Stat->Device = DriverID;
+		Stat->Index = node->Node.Index;
+		Stat->Mode = node->Node.Mode;
+		Stat->HardLinks = 1;
+		Stat->UserID = 0;
+		Stat->GroupID = 0;
+		Stat->RawDevice = 0;
+		Stat->Size = size;
+		Stat->AccessTime = node->AccessTime;
+		Stat->ModifyTime = node->ModifyTime;
+		Stat->ChangeTime = node->ModifyTime;
+		Stat->BlockSize = ClusterSize;
+		Stat->Blocks = (size + ClusterSize - 1) / ClusterSize * (ClusterSize / 512);
+		Stat->Attribute = 0;
+		return 0;
+	}
+
+	int FAT::Mount()
+	{
+		uint8_t *sector = new uint8_t[512];
+		if (DeviceRead(sector, 512, 0) != 512 || !CheckBootRecord(sector))
+		{
+			delete[] sector;
+			return -EINVAL;
+		}
+
+		BIOSParameterBlock bpb;
+		ExtendedBootRecord_FAT32 ebr;
+		memcpy(&bpb, sector, sizeof(bpb));
+		memcpy(&ebr, sector + sizeof(bpb), sizeof(ebr));
+		delete[] sector;
+
+		BytesPerSector = bpb.BytesPerSector;
+		SectorsPerCluster = bpb.SectorsPerCluster;
+		ClusterSize = BytesPerSector * SectorsPerCluster;
+
+		uint32_t totalSectors = bpb.Sectors16 ? bpb.Sectors16 : bpb.Sectors32;
+		FATSectors = bpb.SectorsPerFAT ? bpb.SectorsPerFAT : ebr.SectorsPerFAT;
+		FATStart = bpb.ReservedSectors;
+		RootSectors = (bpb.RootDirectoryEntries * (uint32_t)sizeof(FATDirectoryEntry) + BytesPerSector - 1) / BytesPerSector;
+		RootStart = FATStart + bpb.NumberOfFATs * FATSectors;
+		DataStart = RootStart + RootSectors;
+		if (DataStart >= totalSectors)
+		{
+			error("Data region starts past the end of the volume");
+			return -EINVAL;
+		}
+
+		/* The cluster count alone decides the type (Microsoft FAT specification 3.5) */
+		Clusters = (totalSectors - DataStart) / SectorsPerCluster;
+		if (Clusters < 4085)
+			Type = FAT12;
+		else if (Clusters < 65525)
+			Type = FAT16;
+		else
+			Type = FAT32;
+
+		if (Type == FAT32)
+		{
+			if (bpb.RootDirectoryEntries != 0)
+				return -EINVAL;
+
+			/* Mirroring is off, only one FAT is in use */
+			if (ebr.Flags & 0x80)
+			{
+				uint32_t active = ebr.Flags & 0xF;
+				if (active >= bpb.NumberOfFATs)
+					return -EINVAL;
+				FATStart += active * FATSectors;
+			}
+		}
+
+		/* Don't trust the volume size over what the FAT can describe */
+		uint64_t tableSize = (uint64_t)FATSectors * BytesPerSector;
+		uint64_t tableEntries = Type == FAT12 ? tableSize * 2 / 3 : tableSize / (Type == FAT16 ? 2 : 4);
+		if (tableEntries < 3)
+			return -EINVAL;
+		if (Clusters > tableEntries - 2)
+			Clusters = (uint32_t)(tableEntries - 2);
+
+		if (Type != FAT32)
+		{
+			Table = new uint8_t[tableSize];
+			if (!ReadSectors(FATStart, FATSectors, Table))
+			{
+				error("Failed to read the FAT");
+				return -EIO;
+			}
+		}
+
+		Bounce = new uint8_t[ClusterSize];
+
+		Root = new FATInode;
+		Root->Node = {};
+		Root->Node.Device = DriverID;
+		Root->Node.Index = 1;
+		Root->Node.Mode = S_IFDIR | 0755;
+		Root->Node.Offset = 0;
+		Root->Node.PrivateData = this;
+		Root->Parent = nullptr;
+		Root->Attributes = FAT_ATTRIBUTE_DIRECTORY;
+		Root->FirstCluster = Type == FAT32 ? ebr.RootDirectoryCluster : 0;
+		Root->Size = 0;
+		Root->ModifyTime = Root->AccessTime = Root->CreationTime = 0;
+		Root->Mapped = 0;
+		Root->ChainEnd = Type != FAT32;
+		Root->Scanned = false;
+		Root->Checksum = INODE_CHECKSUM;
+
+		debug("Mounted FAT%d volume with %u clusters of %u bytes",
+			  Type == FAT12 ? 12 : (Type == FAT16 ? 16 : 32), Clusters, ClusterSize);
+		return 0;
+	}
+
+	bool FAT::Probe(FileSystemDevice *Device)
+	{
+		uint8_t *sector = new uint8_t[512];
+		ssize_t ret;
+
+		if (Device->Block)
+		{
+			struct Inode node{};
+			node.PrivateData = Device->Block->PrivateData;
+			ret = Device->Block->Ops->Read(&node, sector, 512, 0);
+		}
+		else if (Device->inode.node && Device->inode.ops && Device->inode.ops->Read)
+			ret = Device->inode.ops->Read(Device->inode.node, sector, 512, 0);
+		else
+			ret = -EINVAL;
+
+		bool valid = ret == 512 && CheckBootRecord(sector);
+		delete[] sector;
+		return valid;
+	}
+
+	FAT::FAT(FileSystemDevice *Device)
+	{
+		this->Device = *Device;
+		this->BlockInode = {};
+		if (Device->Block)
+			this->BlockInode.PrivateData = Device->Block->PrivateData;
+	}
+
+	FAT::~FAT()
+	{
+		if (Root)
+			FreeTree(Root);
+
+		for (auto &&chunk : ChunkLRU)
+		{
+			delete[] chunk->Data;
+			delete chunk;
+		}
+
+		delete[] Table;
+		delete[] Bounce;
+	}
+
+#pragma endregion Operations
+
+	std::vector<FAT *> Namespaces;
+
+	int FAT_AllocateInode(FileSystemInfo *Info, Inode **Result) { return -ENOTSUP; }
+	int FAT_DeleteInode(FileSystemInfo *Info, Inode *Node) { return -ENOTSUP; }
+	int FAT_Synchronize(FileSystemInfo *Info, Inode *Node) { return 0; }
+
+	int FAT_Destroy(FileSystemInfo *Info)
+	{
+		for (auto &&i : Namespaces)
+			delete i;
+		Namespaces.clear();
+		return 0;
+	}
+
+	int FAT_Probe(FileSystemDevice *Device)
+	{
+		return FAT::Probe(Device) ? 0 : -ENODEV;
+	}
+
+	int FAT_Mount(FileSystemInfo *FS, Inode **Root, FileSystemDevice *Device)
+	{
+		FAT *instance = new FAT(Device);
+		int ret = instance->Mount();
+		if (ret < 0)
+		{
+			delete instance;
+			return ret;
+		}
+
+		*Root = instance->GetRoot();
+		Namespaces.push_back(instance);
+		return 0;
+	}
+
+	int FAT_Unmount(FileSystemInfo *FS) { return 0; }
+
+	/* Read only for now, nothing is ever written back */
+	int FAT_Lookup(Inode *p, const char *nm, Inode **r) { return ((FAT *)p->PrivateData)->Lookup(p, nm, r); }
+	int FAT_Create(Inode *p, const char *nm, mode_t m, Inode **r) { return -EROFS; }
+	int FAT_Remove(Inode *p, const char *nm) { return -EROFS; }
+	int FAT_Rename(Inode *p, const char *on, const char *nn) { return -EROFS; }
+	ssize_t FAT_Read(Inode *n, void *b, size_t s, off_t o) { return ((FAT *)n->PrivateData)->Read(n, b, s, o); }
+	ssize_t FAT_Write(Inode *n, const void *b, size_t s, off_t o) { return -EROFS; }
+	int FAT_Truncate(Inode *n, off_t s) { return -EROFS; }
+	int FAT_Open(Inode *n, int f, mode_t m) { return (f & O_ACCMODE) == O_RDONLY ? 0 : -EROFS; }
+	int FAT_Close(Inode *n) { return 0; }
+	int FAT_Ioctl(Inode *n, unsigned long rq, void *ap) { return -ENOTTY; }
+	ssize_t FAT_ReadDir(Inode *n, kdirent *b, size_t s, off_t o, off_t Entries) { return ((FAT *)n->PrivateData)->ReadDir(n, b, s, o, Entries); }
+	int FAT_MkDir(Inode *p, const char *nm, mode_t m, Inode **r) { return -EROFS; }
+	int FAT_RmDir(Inode *p, const char *nm) { return -EROFS; }
+	int FAT_SymLink(Inode *p, const char *nm, const char *t, Inode **r) { return -EROFS; }
+	ssize_t FAT_ReadLink(Inode *n, char *b, size_t s) { return -EINVAL; }
+	off_t FAT_Seek(Inode *n, off_t o) { return o; }
+	int FAT_Stat(Inode *n, kstat *st) { return ((FAT *)n->PrivateData)->Stat(n, st); }
+
+	static SuperBlockOperations fatSuperOps = {
+		.AllocateInode = FAT_AllocateInode,
+		.DeleteInode = FAT_DeleteInode,
+		.Synchronize = FAT_Synchronize,
+		.Destroy = FAT_Destroy,
+		.Probe = FAT_Probe,
+		.Mount = FAT_Mount,
+		.Unmount = FAT_Unmount};
+
+	static InodeOperations fatInodeOps = {
+		.Lookup = FAT_Lookup,
+		.Create = FAT_Create,
+		.Remove = FAT_Remove,
+		.Rename = FAT_Rename,
+		.Read = FAT_Read,
+		.Write = FAT_Write,
+		.Truncate = FAT_Truncate,
+		.Open = FAT_Open,
+		.Close = FAT_Close,
+		.Ioctl = FAT_Ioctl,
+		.ReadDir = FAT_ReadDir,
+		.MkDir = FAT_MkDir,
+		.RmDir = FAT_RmDir,
+		.SymLink = FAT_SymLink,
+		.ReadLink = FAT_ReadLink,
+		.Seek = FAT_Seek,
+		.Stat = FAT_Stat,
+		.Poll = nullptr};
+
+	int Entry()
+	{
+		FileSystemInfo *fsi = new FileSystemInfo{};
+		fsi->Name = "File Allocation Table";
+		fsi->Flags = FS_NEGATIVE_CACHE;
+		fsi->SuperOps = fatSuperOps;
+		fsi->Ops = fatInodeOps;
+		v0::RegisterFileSystem(DriverID, fsi);
+		return 0;
+	}
+
+	int Final()
+	{
+		for (auto &&i : Namespaces)
+			delete i;
+		return 0;
+	}
+
 	int Panic() { return 0; }
 	int Probe() { return 0; }
 
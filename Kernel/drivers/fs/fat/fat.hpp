@@ -19,6 +19,13 @@
 
 #include <types.h>
 
+#include <fs/vfs.hpp>
+#include <lock.hpp>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <list>
+
 /* Source: https://wiki.osdev.org/FAT */
 
 struct BIOSParameterBlock
@@ -285,3 +292,211 @@ struct exFATBootRecord
 	/** Reserved (set to 0). */
 	uint8_t Reserved2[7];
 } __packed;
+
+#define FAT_ATTRIBUTE_READ_ONLY 0x01
+#define FAT_ATTRIBUTE_HIDDEN 0x02
+#define FAT_ATTRIBUTE_SYSTEM 0x04
+#define FAT_ATTRIBUTE_VOLUME_ID 0x08
+#define FAT_ATTRIBUTE_DIRECTORY 0x10
+#define FAT_ATTRIBUTE_ARCHIVE 0x20
+#define FAT_ATTRIBUTE_LONG_NAME 0x0F
+
+struct FATDirectoryEntry
+{
+	/** Short name, eight characters and a three character extension,
+	 * both padded with spaces. A first byte of 0xE5 marks a free
+	 * entry and 0x00 the end of the directory. 0x05 stands for a
+	 * real 0xE5. */
+	uint8_t Name[11];
+
+	/** FAT_ATTRIBUTE_* flags. */
+	uint8_t Attributes;
+
+	/** Reserved for Windows NT. Bits 3 and 4 mark the name and the
+	 * extension as lowercase when there is no long name. */
+	uint8_t NTReserved;
+
+	/** Creation time in tenths of a second. */
+	uint8_t CreationTimeTenths;
+
+	/** Hour, minutes and seconds / 2 in 5, 6 and 5 bits. */
+	uint16_t CreationTime;
+
+	/** Year since 1980, month and day in 7, 4 and 5 bits. */
+	uint16_t CreationDate;
+	uint16_t AccessDate;
+
+	/** High 16 bits of the first cluster, FAT32 only. */
+	uint16_t ClusterHigh;
+
+	uint16_t ModifyTime;
+	uint16_t ModifyDate;
+	uint16_t ClusterLow;
+
+	/** File size in bytes, zero for directories. */
+	uint32_t Size;
+} __packed;
+
+struct FATLongNameEntry
+{
+	/** Position of this piece in the name, starting at 1. The piece
+	 * with the end of the name is stored first, with 0x40 set. */
+	uint8_t Order;
+
+	/** UCS-2 characters, the name ends with 0x0000 and is padded
+	 * with 0xFFFF. */
+	uint16_t Name1[5];
+
+	/** Always FAT_ATTRIBUTE_LONG_NAME. */
+	uint8_t Attributes;
+	uint8_t Type;
+
+	/** Checksum of the short name the long name belongs to. */
+	uint8_t Checksum;
+	uint16_t Name2[6];
+	uint16_t Zero;
+	uint16_t Name3[2];
+} __packed;
+
+/* FAT32 tables are cached in chunks of this many bytes */
+#define FAT_CHUNK_SIZE 4096
+#define FAT_CACHE_CHUNKS 256
+
+/* Largest request sent to the device when reading file data */
+#define FAT_MAX_REQUEST (1024 * 1024)
+
+namespace Driver::FileAllocationTable
+{
+	class FAT
+	{
+	public:
+		enum Types
+		{
+			FAT12,
+			FAT16,
+			FAT32
+		};
+
+		/* Clusters [Logical, Logical + Length) of a file, stored from Cluster on */
+		struct Extent
+		{
+			uint32_t Logical;
+			uint32_t Cluster;
+			uint32_t Length;
+		};
+
+		constexpr static int INODE_CHECKSUM = 0xFA7C0DE;
+
+		struct FATInode
+		{
+			struct Inode Node;
+			std::string Name;
+			FATInode *Parent;
+
+			uint8_t Attributes;
+			uint32_t FirstCluster;
+			uint32_t Size;
+			time_t ModifyTime;
+			time_t AccessTime;
+			time_t CreationTime;
+
+			/**
+			 * The part of the chain walked so far, merged into
+			 * runs of contiguous clusters. The chain is only
+			 * walked further when a read goes past Mapped.
+			 */
+			std::vector<Extent> Extents;
+			uint32_t Mapped;
+			bool ChainEnd;
+
+			/* Directories are read once, on first use */
+			bool Scanned;
+			std::vector<FATInode *> Children;
+
+			/* Long and short names, case folded */
+			std::unordered_map<std::string, FATInode *> Names;
+
+			int Checksum;
+		};
+
+	private:
+		struct Chunk
+		{
+			uint32_t Index;
+			uint8_t *Data;
+			std::list<Chunk *>::iterator Position;
+		};
+
+		NewLock(Lock);
+		FileSystemDevice Device;
+		struct Inode BlockInode;
+
+		Types Type = FAT12;
+		uint32_t BytesPerSector = 0;
+		uint32_t SectorsPerCluster = 0;
+		uint32_t ClusterSize = 0;
+		uint32_t Clusters = 0;
+
+		/* In sectors */
+		uint32_t FATStart = 0;
+		uint32_t FATSectors = 0;
+		uint32_t RootStart = 0;
+		uint32_t RootSectors = 0;
+		uint32_t DataStart = 0;
+
+		/* The whole table for FAT12 and FAT16 */
+		uint8_t *Table = nullptr;
+
+		/* Chunks of the table for FAT32 */
+		std::unordered_map<uint32_t, Chunk *> Chunks;
+		std::list<Chunk *> ChunkLRU;
+
+		uint8_t *Bounce = nullptr;
+		FATInode *Root = nullptr;
+
+		ssize_t DeviceRead(void *Buffer, size_t Size, off_t Offset);
+		bool ReadSectors(uint64_t Sector, size_t Count, void *Buffer);
+
+		uint8_t *GetChunk(uint32_t Index);
+		uint32_t NextCluster(uint32_t Cluster);
+		bool IsValidCluster(uint32_t Cluster) { return Cluster >= 2 && Cluster < Clusters + 2; }
+		uint64_t ClusterSector(uint32_t Cluster) { return DataStart + (uint64_t)(Cluster - 2) * SectorsPerCluster; }
+
+		/**
+		 * Map a cluster of a file
+		 *
+		 * @param Run Set to the number of clusters that follow
+		 *            it on the device, itself included
+		 * @return The cluster, zero past the end of the chain
+		 */
+		uint32_t MapCluster(FATInode *Node, uint32_t Logical, uint32_t *Run);
+		ssize_t ReadData(FATInode *Node, uint8_t *Buffer, size_t Size, uint64_t Offset);
+
+		/**
+		 * Read a directory and create its children
+		 */
+		int Scan(FATInode *Directory);
+		FATInode *AddChild(FATInode *Directory, const std::string &Name,
+						   const std::string &ShortName, const FATDirectoryEntry *Entry, uint64_t Position);
+		void FreeTree(FATInode *Node);
+
+	public:
+		int Lookup(struct Inode *Parent, const char *Name, struct Inode **Result);
+		ssize_t Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset);
+		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
+		int Stat(struct Inode *Node, struct kstat *Stat);
+
+		/**
+		 * Read the boot record and the FAT
+		 *
+		 * @return Zero on success, otherwise an error code
+		 */
+		int Mount();
+		struct Inode *GetRoot() { return &Root->Node; }
+
+		static bool Probe(FileSystemDevice *Device);
+
+		FAT(FileSystemDevice *Device);
+		~FAT();
+	};
+}
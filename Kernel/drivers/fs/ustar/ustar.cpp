@@ -87,23 +87,15 @@ namespace Driver::UnixStandardTAR
 #define TVERSION "00"
 #define TVERSLEN 2
 
-	inline uint32_t GetSize(const char *String)
+	/* Numeric header fields end with a null byte, a space or nothing at all */
+	inline uint64_t ParseOctal(const char *Field, size_t Length)
 	{
-		uint32_t ret = 0;
-		while (*String)
-		{
-			ret *= 8;
-			ret += *String - '0';
-			String++;
-		}
-		return ret;
-	}
-
-	inline int StringToInt(const char *String)
-	{
-		int ret = 0;
-		for (int i = 0; String[i] != '\0'; ++i)
-			ret = ret * 10 + String[i] - '0';
+		uint64_t ret = 0;
+		size_t i = 0;
+		while (i < Length && Field[i] == ' ')
+			i++;
+		for (; i < Length && Field[i] >= '0' && Field[i] <= '7'; i++)
+			ret = ret * 8 + (Field[i] - '0');
 		return ret;
 	}
 
@@ -120,6 +112,16 @@ namespace Driver::UnixStandardTAR
 			std::vector<USTARInode *> Children;
 			bool Deleted;
 			int Checksum;
+
+			/* Parsed from the header once, so that reads and
+			   stats don't go back to the device for it */
+			size_t Size = 0;
+			uid_t UserID = 0;
+			gid_t GroupID = 0;
+			time_t ModifyTime = 0;
+			dev_t RawDevice = 0;
+			char Type = AREGTYPE;
+			std::string Link{};
 		};
 		std::unordered_map<ino_t, USTARInode *> Files;
 		ino_t NextInode = 0;
@@ -275,6 +277,7 @@ namespace Driver::UnixStandardTAR
 
 			node->Name.assign(basename, length);
 			node->Path.assign(Name, strlen(Name));
+			node->Type = hdr->typeflag[0];
 
 			auto file = Files.insert(std::make_pair(NextInode, node));
 			assert(file.second == true);
@@ -307,10 +310,7 @@ namespace Driver::UnixStandardTAR
 				return -ENOENT;
 
 			USTARInode *node = fileItr->second;
-			TarHeader header;
-			if (DeviceRead(&header, sizeof(TarHeader), node->HeaderOffset) != sizeof(TarHeader))
-				return -EIO;
-			size_t fileSize = GetSize(header.size);
+			size_t fileSize = node->Size;
 
 			if (Size <= 0)
 			{
@@ -441,16 +441,6 @@ namespace Driver::UnixStandardTAR
 				if (var->Deleted)
 					continue;
 
-				TarHeader header;
-				ssize_t hdrRead = DeviceRead(&header, sizeof(TarHeader), var->HeaderOffset);
-				if (hdrRead != sizeof(TarHeader))
-				{
-					warn("Failed to read header for %s at offset %ld", var->Name.c_str(), var->HeaderOffset);
-					continue;
-				}
-				size_t fileSize = GetSize(header.size);
-				debug("Entry: %s, typeflag: %c, size: %zu, offset: %ld", var->Name.c_str(), header.typeflag[0], fileSize, var->HeaderOffset);
-
 				reclen = (uint16_t)(offsetof(struct kdirent, d_name) + var->Name.size() + 1);
 
 				if (totalSize + reclen > Size)
@@ -463,14 +453,14 @@ namespace Driver::UnixStandardTAR
 				ent->d_ino = var->Node.Index;
 				ent->d_off = var->Node.Offset;
 				ent->d_reclen = reclen;
-				switch (header.typeflag[0])
+				switch (var->Type)
 				{
 				case AREGTYPE:
 				case REGTYPE:
 					ent->d_type = DT_REG;
 					break;
 				case LNKTYPE:
-					fixme("Hard link not implemented for %s", header.name);
+					fixme("Hard link not implemented for %s", var->Name.c_str());
 					ent->d_type = DT_LNK;
 					break;
 				case SYMTYPE:
@@ -494,7 +484,6 @@ namespace Driver::UnixStandardTAR
 					break;
 				}
 				strncpy(ent->d_name, var->Name.c_str(), strlen(var->Name.c_str()));
-				debug("Added entry: %s, type: %d, size: %zu", var->Name.c_str(), ent->d_type, fileSize);
 				totalSize += reclen;
 				entries++;
 			}
@@ -528,10 +517,7 @@ namespace Driver::UnixStandardTAR
 				return ret;
 
 			USTARInode *node = (USTARInode *)*Result;
-			TarHeader header;
-			if (DeviceRead(&header, sizeof(TarHeader), node->HeaderOffset) != sizeof(TarHeader))
-				return -EIO;
-			strncpy(header.link, Target, MIN(sizeof(header.link) - 1, strlen(Target)));
+			node->Link.assign(Target, MIN(sizeof(TarHeader::link) - 1, strlen(Target)));
 			return 0;
 		}
 
@@ -544,16 +530,10 @@ namespace Driver::UnixStandardTAR
 				return -ENOENT;
 
 			USTARInode *node = fileItr->second;
-			TarHeader header;
-			if (DeviceRead(&header, sizeof(TarHeader), node->HeaderOffset) != sizeof(TarHeader))
-				return -EIO;
-
-			size_t linkLen = 0;
-			while (linkLen < sizeof(header.link) && header.link[linkLen] != '\0')
-				++linkLen;
+			size_t linkLen = node->Link.size();
 			if (linkLen > Size)
 				linkLen = Size;
-			memcpy(Buffer, header.link, linkLen);
+			memcpy(Buffer, node->Link.data(), linkLen);
 			debug("Read %zu bytes from %d: \"%.*s\"", linkLen, Node->Index, (int)linkLen, Buffer);
 			return linkLen;
 		}
@@ -571,85 +551,20 @@ namespace Driver::UnixStandardTAR
 				return -ENOENT;
 
 			USTARInode *node = fileItr->second;
-			TarHeader header;
-			if (DeviceRead(&header, sizeof(TarHeader), node->HeaderOffset) != sizeof(TarHeader))
-				return -EIO;
-			size_t fileSize = GetSize(header.size);
-
-			debug("Header: \"%.*s\"", (int)sizeof(struct TarHeader), &header);
 			Stat->Device = DriverID;
 			Stat->Index = Node->Index;
+			Stat->Mode = Node->Mode;
 			Stat->HardLinks = 1;
-			Stat->UserID = GetSize(header.uid);
-			Stat->GroupID = GetSize(header.gid);
-			Stat->RawDevice = Stat->MakeDevice(GetSize(header.dev_maj), GetSize(header.dev_min));
-			Stat->Size = fileSize;
-			Stat->AccessTime = GetSize(header.mtime);
-			Stat->ModifyTime = GetSize(header.mtime);
-			Stat->ChangeTime = GetSize(header.mtime);
+			Stat->UserID = node->UserID;
+			Stat->GroupID = node->GroupID;
+			Stat->RawDevice = node->RawDevice;
+			Stat->Size = node->Size;
+			Stat->AccessTime = node->ModifyTime;
+			Stat->ModifyTime = node->ModifyTime;
+			Stat->ChangeTime = node->ModifyTime;
 			Stat->BlockSize = 512;
-			Stat->Blocks = (fileSize + 511) / 512;
+			Stat->Blocks = (node->Size + 511) / 512;
 			Stat->Attribute = 0;
-
-			mode_t hdrMode = StringToInt(header.mode);
-
-			if (hdrMode & TSUID)
-				Stat->Mode |= S_ISUID;
-			else if (hdrMode & TSGID)
-				Stat->Mode |= S_ISGID;
-			else if (hdrMode & TSVTX)
-				Stat->Mode |= S_ISVTX;
-			else if (hdrMode & TUREAD)
-				Stat->Mode |= S_IRUSR;
-			else if (hdrMode & TUWRITE)
-				Stat->Mode |= S_IWUSR;
-			else if (hdrMode & TUEXEC)
-				Stat->Mode |= S_IXUSR;
-			else if (hdrMode & TGREAD)
-				Stat->Mode |= S_IRGRP;
-			else if (hdrMode & TGWRITE)
-				Stat->Mode |= S_IWGRP;
-			else if (hdrMode & TGEXEC)
-				Stat->Mode |= S_IXGRP;
-			else if (hdrMode & TOREAD)
-				Stat->Mode |= S_IROTH;
-			else if (hdrMode & TOWRITE)
-				Stat->Mode |= S_IWOTH;
-			else if (hdrMode & TOEXEC)
-				Stat->Mode |= S_IXOTH;
-
-			switch (header.typeflag[0])
-			{
-			case AREGTYPE:
-			case REGTYPE:
-				Stat->Mode |= S_IFREG;
-				break;
-			case LNKTYPE:
-				fixme("Hard link not implemented for %s", header.name);
-				Stat->Mode |= S_IFLNK;
-				break;
-			case SYMTYPE:
-				Stat->Mode |= S_IFLNK;
-				break;
-			case CHRTYPE:
-				Stat->Mode |= S_IFCHR;
-				break;
-			case BLKTYPE:
-				Stat->Mode |= S_IFBLK;
-				break;
-			case DIRTYPE:
-				Stat->Mode |= S_IFDIR;
-				break;
-			case FIFOTYPE:
-				Stat->Mode |= S_IFIFO;
-				break;
-			case CONTTYPE:
-				warn("Reserved type for %s", header.name);
-				__fallthrough;
-			default:
-				error("Unknown type: %d for %s", header.typeflag[0], header.name);
-				break;
-			}
 			return 0;
 		}
 
@@ -660,31 +575,8 @@ namespace Driver::UnixStandardTAR
 
 			auto SetMode = [&](Inode &uNode, TarHeader *header)
 			{
-				mode_t hdrMode = StringToInt(header->mode);
-				if (hdrMode & TSUID)
-					uNode.Mode |= S_ISUID;
-				else if (hdrMode & TSGID)
-					uNode.Mode |= S_ISGID;
-				else if (hdrMode & TSVTX)
-					uNode.Mode |= S_ISVTX;
-				else if (hdrMode & TUREAD)
-					uNode.Mode |= S_IRUSR;
-				else if (hdrMode & TUWRITE)
-					uNode.Mode |= S_IWUSR;
-				else if (hdrMode & TUEXEC)
-					uNode.Mode |= S_IXUSR;
-				else if (hdrMode & TGREAD)
-					uNode.Mode |= S_IRGRP;
-				else if (hdrMode & TGWRITE)
-					uNode.Mode |= S_IWGRP;
-				else if (hdrMode & TGEXEC)
-					uNode.Mode |= S_IXGRP;
-				else if (hdrMode & TOREAD)
-					uNode.Mode |= S_IROTH;
-				else if (hdrMode & TOWRITE)
-					uNode.Mode |= S_IWOTH;
-				else if (hdrMode & TOEXEC)
-					uNode.Mode |= S_IXOTH;
+				/* The permission bits in the header match the POSIX ones */
+				uNode.Mode = ParseOctal(header->mode, sizeof(header->mode)) & 07777;
 
 				switch (header->typeflag[0])
 				{
@@ -763,10 +655,23 @@ namespace Driver::UnixStandardTAR
 					node->Name.assign((const char *)header.name, strlen(header.name));
 				node->Path.assign((const char *)header.name, strlen(header.name));
 
+				size_t size = ParseOctal(header.size, sizeof(header.size));
+				node->Size = size;
+				node->UserID = ParseOctal(header.uid, sizeof(header.uid));
+				node->GroupID = ParseOctal(header.gid, sizeof(header.gid));
+				node->ModifyTime = ParseOctal(header.mtime, sizeof(header.mtime));
+				node->RawDevice = kstat().MakeDevice(ParseOctal(header.dev_maj, sizeof(header.dev_maj)),
+													 ParseOctal(header.dev_min, sizeof(header.dev_min)));
+				node->Type = header.typeflag[0];
+
+				size_t linkLen = 0;
+				while (linkLen < sizeof(header.link) && header.link[linkLen] != '\0')
+					linkLen++;
+				node->Link.assign((const char *)header.link, linkLen);
+
 				Files.insert(std::make_pair(NextInode, node));
 				tmpNodes.push_back(node);
 
-				size_t size = GetSize(header.size);
 				offset += ((size / 512) + 1) * 512;
 				if (size % 512)
 					offset += 512;
@@ -1051,11 +956,12 @@ namespace Driver::UnixStandardTAR
 		.SymLink = USTAR_SymLink,
 		.ReadLink = USTAR_ReadLink,
 		.Seek = USTAR_Seek,
-		.Stat = USTAR_Stat};
+		.Stat = USTAR_Stat,
+		.Poll = nullptr};
 
 	int Entry()
 	{
-		FileSystemInfo *fsi = new FileSystemInfo;
+		FileSystemInfo *fsi = new FileSystemInfo{};
 		fsi->Name = "Unix Standard TAR";
 		fsi->SuperOps = ustarSuperOps;
 		fsi->Ops = ustarInodeOps;
@@ -46,6 +46,7 @@ namespace Driver::AdvancedIntegratedPeripheral
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	void MasterInterruptHandler(CPU::TrapFrame *)
@@ -132,6 +132,7 @@ namespace Driver::AdvancedIntegratedPeripheral
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	int InitializeKeyboard()
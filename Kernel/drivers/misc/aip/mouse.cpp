@@ -168,6 +168,7 @@ namespace Driver::AdvancedIntegratedPeripheral
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	int InitializeMouse()
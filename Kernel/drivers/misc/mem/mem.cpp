@@ -115,6 +115,7 @@ namespace Driver::MemoryDevices
 		.ReadLink = nullptr,
 		.Seek = Seek,
 		.Stat = Stat,
+		.Poll = nullptr,
 	};
 
 	int Entry()
@@ -123,6 +123,24 @@ namespace Driver::TeleTypeDevices
 		return -ENODEV;
 	}
 
+	int Poll(struct Inode *Node, struct PollTable *Table)
+	{
+		dev_t min = Node->GetMinor();
+		if (min == ids.kcon)
+			return KernelConsole::CurrentTerminal.load()->Term->Poll(Table);
+		else if (min == ids.tty)
+		{
+			TTY::TeletypeDriver *tty = (TTY::TeletypeDriver *)thisProcess->tty;
+			if (tty == nullptr)
+				return -ENOTTY;
+			return tty->Poll(Table);
+		}
+		else if (min == ids.ptmx)
+			return POLLERR;
+
+		return -ENODEV;
+	}
+
 	off_t Seek(struct Inode *Node, off_t Offset) { return -ENOSYS; }
 	int Stat(struct Inode *Node, struct kstat *Stat) { return -ENOSYS; }
 
@@ -144,6 +162,7 @@ namespace Driver::TeleTypeDevices
 		.ReadLink = nullptr,
 		.Seek = Seek,
 		.Stat = Stat,
+		.Poll = Poll,
 	};
 
 	int Entry()
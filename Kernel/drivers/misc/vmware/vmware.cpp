@@ -836,6 +836,7 @@ namespace Driver::VMwareToolBox
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	bool ToolboxSupported = false;
@@ -21,11 +21,16 @@
 #include <cpu.hpp>
 #include <pci.hpp>
 #include <net/net.hpp>
+#include <net/nc.hpp>
+#include <net/packet.hpp>
+#include <kconfig.hpp>
+#include <lock.hpp>
 
 #include "e1000.hpp"
 
 extern Driver::Manager *DriverManager;
 extern PCI::Manager *PCIManager;
+extern KernelConfig Config;
 namespace Driver::E1000
 {
 	dev_t DriverID;
@@ -46,18 +51,27 @@ namespace Driver::E1000
 			uint64_t MemoryBase;
 		} BAR;
 
-#define E1000_NUM_RX_DESC 32
-#define E1000_NUM_TX_DESC 8
-		RXDescriptor *RX[E1000_NUM_RX_DESC];
-		TXDescriptor *TX[E1000_NUM_TX_DESC];
+		size_t RXCount = 0;
+		size_t TXCount = 0;
+		RXDescriptor *RXRing = nullptr;
+		TXDescriptor *TXRing = nullptr;
 
-		uint16_t RXCurrent;
-		uint16_t TXCurrent;
+		/* The device receives straight into these, they go up the stack as they are */
+		NetworkPacket::Buffer **RXPackets = nullptr;
 
-		const int BaseBufferSize = 8192;
-		const int AdditionalBytes = 16;
+		/* Sent frames, freed once the device is done with them */
+		NetworkPacket::Buffer **TXPackets = nullptr;
+
+		size_t RXCurrent = 0;
+		size_t TXTail = 0;
+		size_t TXClean = 0;
+		size_t TXInFlight = 0;
 
-		uint32_t CurrentPacket;
+		/* Taken from the interrupt handler, always with interrupts disabled */
+		NewLock(TXLock);
+		NetStatistics Stats{};
+
+		const int AdditionalBytes = 16;
 
 		void WriteCMD(uint16_t Address, uint32_t Value)
 		{
@@ -101,65 +115,91 @@ namespace Driver::E1000
 			return Data;
 		}
 
+		/* Ring lengths must be a multiple of 128 bytes, 8 descriptors */
+		static size_t RingSize(int Requested)
+		{
+			size_t count = (size_t)Requested;
+			if (Requested < E1000_MIN_DESC)
+				count = E1000_MIN_DESC;
+			else if (Requested > E1000_MAX_DESC)
+				count = E1000_MAX_DESC;
+			return count & ~(size_t)7;
+		}
+
+		/* ITR counts in 256 ns units, zero turns throttling off */
+		static uint32_t ThrottleInterval(int Rate)
+		{
+			if (Rate <= 0)
+				return 0;
+			uint32_t interval = (uint32_t)(1000000000ULL / ((uint64_t)Rate * 256));
+			return interval > 0xFFFF ? 0xFFFF : interval;
+		}
+
 		void InitializeRX()
 		{
-			debug("Initializing RX...");
+			RXCount = RingSize(Config.NetRXDescriptors);
+			debug("Initializing RX with %ld descriptors...", RXCount);
 			uintptr_t Ptr = (uintptr_t)v0::AllocateMemory(DriverID,
 														  TO_PAGES(sizeof(RXDescriptor) *
-																	   E1000_NUM_RX_DESC +
+																	   RXCount +
 																   AdditionalBytes));
 
-			for (int i = 0; i < E1000_NUM_RX_DESC; i++)
+			RXRing = (RXDescriptor *)Ptr;
+			RXPackets = new NetworkPacket::Buffer *[RXCount];
+			for (size_t i = 0; i < RXCount; i++)
 			{
-				RX[i] = (RXDescriptor *)(Ptr + i * 16);
-				RX[i]->Address = (uint64_t)v0::AllocateMemory(DriverID,
-															  TO_PAGES(BaseBufferSize + AdditionalBytes));
-				RX[i]->Status = 0;
+				RXPackets[i] = NetworkPacket::Allocate(PACKET_BUFFER_SIZE, 0);
+				assert(RXPackets[i] != nullptr);
+				RXRing[i].Address = (uint64_t)RXPackets[i]->Head;
+				RXRing[i].Status = 0;
 			}
 
-#pragma GCC diagnostic ignored "-Wshift-count-overflow"
+			WriteCMD(REG::RXDESCLO, (uint32_t)((uint64_t)Ptr & 0xFFFFFFFF));
+			WriteCMD(REG::RXDESCHI, (uint32_t)((uint64_t)Ptr >> 32));
 
-			WriteCMD(REG::TXDESCLO, (uint32_t)(Ptr >> 32));
-			WriteCMD(REG::TXDESCHI, (uint32_t)(Ptr & 0xFFFFFFFF));
-
-			WriteCMD(REG::RXDESCLO, (uint32_t)Ptr);
-			WriteCMD(REG::RXDESCHI, 0);
-
-			WriteCMD(REG::RXDESCLEN, E1000_NUM_RX_DESC * 16);
+			WriteCMD(REG::RXDESCLEN, (uint32_t)(RXCount * sizeof(RXDescriptor)));
 
 			WriteCMD(REG::RXDESCHEAD, 0);
-			WriteCMD(REG::RXDESCTAIL, E1000_NUM_RX_DESC - 1);
+			WriteCMD(REG::RXDESCTAIL, (uint32_t)(RXCount - 1));
 			RXCurrent = 0;
+			Stats.RXRingSize = (unsigned int)RXCount;
+
+			/* Let the device check IPv4, TCP and UDP checksums */
+			WriteCMD(REG::RXCSUM, RXCSUM_IPOFL | RXCSUM_TUOFL);
 			WriteCMD(REG::RCTRL, RCTL::EN | RCTL::SBP | RCTL::UPE |
 									 RCTL::MPE | RCTL::LBM_NONE |
 									 RTCL::RDMTS_HALF | RCTL::BAM |
-									 RCTL::SECRC | RCTL::BSIZE_8192);
+									 RCTL::SECRC | RCTL::BSIZE_2048);
 		}
 
 		void InitializeTX()
 		{
-			debug("Initializing TX...");
+			TXCount = RingSize(Config.NetTXDescriptors);
+			debug("Initializing TX with %ld descriptors...", TXCount);
 			uintptr_t Ptr = (uintptr_t)v0::AllocateMemory(DriverID,
 														  TO_PAGES(sizeof(TXDescriptor) *
-																	   E1000_NUM_RX_DESC +
+																	   TXCount +
 																   AdditionalBytes));
 
-			for (short i = 0; i < E1000_NUM_TX_DESC; i++)
+			TXRing = (TXDescriptor *)Ptr;
+			TXPackets = new NetworkPacket::Buffer *[TXCount];
+			for (size_t i = 0; i < TXCount; i++)
 			{
-				TX[i] = (TXDescriptor *)((uintptr_t)Ptr + i * 16);
-				TX[i]->Address = 0;
-				TX[i]->Command = 0;
-				TX[i]->Status = TSTA::DD;
+				TXPackets[i] = nullptr;
+				TXRing[i].Address = 0;
+				TXRing[i].Command = 0;
+				TXRing[i].Status = TSTA::DD;
 			}
 
 			WriteCMD(REG::TXDESCHI, (uint32_t)((uint64_t)Ptr >> 32));
 			WriteCMD(REG::TXDESCLO, (uint32_t)((uint64_t)Ptr & 0xFFFFFFFF));
 
-			WriteCMD(REG::TXDESCLEN, E1000_NUM_TX_DESC * 16);
+			WriteCMD(REG::TXDESCLEN, (uint32_t)(TXCount * sizeof(TXDescriptor)));
 
 			WriteCMD(REG::TXDESCHEAD, 0);
 			WriteCMD(REG::TXDESCTAIL, 0);
-			TXCurrent = 0;
+			TXTail = TXClean = TXInFlight = 0;
+			Stats.TXRingSize = (unsigned int)TXCount;
 			WriteCMD(REG::TCTRL, TCTL::EN_ | TCTL::PSP |
 									 (15 << TCTL::CT_SHIFT) |
 									 (64 << TCTL::COLD_SHIFT) |
@@ -169,22 +209,91 @@ namespace Driver::E1000
 			WriteCMD(REG::TIPG, 0x0060200A);
 		}
 
+		/* Free the frames the device has sent, TXLock must be held */
+		void ReclaimTX()
+		{
+			while (TXInFlight && (TXRing[TXClean].Status & TSTA::DD))
+			{
+				if (TXPackets[TXClean])
+				{
+					TXPackets[TXClean]->Put();
+					TXPackets[TXClean] = nullptr;
+				}
+				TXClean = (TXClean + 1) % TXCount;
+				TXInFlight--;
+			}
+		}
+
 	public:
 		dev_t ID;
 
 		bool IsInitialized() { return Initialized; }
 
-		size_t write(uint8_t *Buffer, size_t Size)
+		/**
+		 * Queue frames for transmission. All of them are put
+		 * on the ring before the tail is written, so the device
+		 * is told about the whole batch at once. Takes over the
+		 * caller's references, frames that don't fit are dropped.
+		 *
+		 * @return The number of frames queued
+		 */
+		size_t Transmit(NetworkPacket::Buffer **Packets, size_t Count)
 		{
-			TX[TXCurrent]->Address = (uint64_t)Buffer;
-			TX[TXCurrent]->Length = (uint16_t)Size;
-			TX[TXCurrent]->Command = CMD::EOP | CMD::IFCS | CMD::RS;
-			TX[TXCurrent]->Status = 0;
-			uint16_t OldTXCurrent = TXCurrent;
-			TXCurrent = (uint16_t)((TXCurrent + 1) % E1000_NUM_TX_DESC);
-			WriteCMD(REG::TXDESCTAIL, TXCurrent);
-			while (!(TX[OldTXCurrent]->Status & 0xFF))
-				v0::Yield(DriverID);
+			SmartCriticalSection(TXLock);
+			ReclaimTX();
+
+			size_t sent = 0;
+			for (; sent < Count; sent++)
+			{
+				NetworkPacket::Buffer *packet = Packets[sent];
+				size_t fragments = 0;
+				for (NetworkPacket::Buffer *b = packet; b; b = b->Next)
+					fragments++;
+
+				/* One slot stays empty so that a full ring doesn't look empty */
+				if (TXInFlight + fragments > TXCount - 1)
+					break;
+
+				for (NetworkPacket::Buffer *b = packet; b; b = b->Next)
+				{
+					TXDescriptor *desc = &TXRing[TXTail];
+					desc->Address = (uint64_t)b->Data;
+					desc->Length = (uint16_t)b->Length;
+					desc->Command = CMD::IFCS | CMD::RS | (b->Next ? 0 : CMD::EOP);
+					desc->Status = 0;
+
+					/* The last descriptor of the frame owns it */
+					TXPackets[TXTail] = b->Next ? nullptr : packet;
+					TXTail = (TXTail + 1) % TXCount;
+					TXInFlight++;
+				}
+
+				Stats.TXPackets++;
+				Stats.TXBytes += packet->TotalLength();
+			}
+
+			for (size_t i = sent; i < Count; i++)
+			{
+				Packets[i]->Put();
+				Stats.TXDropped++;
+			}
+
+			if (sent)
+			{
+				WriteCMD(REG::TXDESCTAIL, (uint32_t)TXTail);
+				Stats.TXDoorbells++;
+			}
+			return sent;
+		}
+
+		ssize_t write(uint8_t *Buffer, size_t Size)
+		{
+			NetworkPacket::Buffer *packet = NetworkPacket::FromData(Buffer, Size, 0);
+			if (packet == nullptr)
+				return -ENOMEM;
+
+			if (Transmit(&packet, 1) == 0)
+				return -ENOBUFS;
 			return Size;
 		}
 
@@ -231,6 +340,12 @@ namespace Driver::E1000
 				*((uint48_t *)arg) = mac.ToHex(); /* UNTESTED */
 				return 0;
 			}
+			case IOCTL_NET_GET_STATS:
+			{
+				SmartCriticalSection(TXLock);
+				*((NetStatistics *)arg) = Stats;
+				return 0;
+			}
 			default:
 				return -EINVAL;
 			}
@@ -239,25 +354,64 @@ namespace Driver::E1000
 
 		int OnInterruptReceived(CPU::TrapFrame *)
 		{
-			WriteCMD(REG::IMASK, 0x1);
-			uint32_t status = ReadCMD(0xC0);
-			UNUSED(status);
+			/* Reading the cause acknowledges it */
+			uint32_t cause = ReadCMD(REG::ICR);
+			Stats.Interrupts++;
 
-			while ((RX[RXCurrent]->Status & 0x1))
+			if (cause & ICR_TXDW)
 			{
-				uint8_t *data = (uint8_t *)RX[RXCurrent]->Address;
-				uint16_t dataSz = RX[RXCurrent]->Length;
-
-				// ReportNetworkPacket(ID, data, dataSz);
-				/* FIXME: Implement */
-				trace("FIXME: Received packet");
-				(void)data;
-				(void)dataSz;
-
-				RX[RXCurrent]->Status = 0;
-				uint16_t OldRXCurrent = RXCurrent;
-				RXCurrent = (uint16_t)((RXCurrent + 1) % E1000_NUM_RX_DESC);
-				WriteCMD(REG::RXDESCTAIL, OldRXCurrent);
+				SmartCriticalSection(TXLock);
+				ReclaimTX();
+			}
+
+			/* Take everything the device has filled, ITR keeps
+			   the interrupts far enough apart for this to batch */
+			size_t handled = 0;
+			size_t last = 0;
+			while (RXRing[RXCurrent].Status & RSTA_DD)
+			{
+				RXDescriptor *desc = &RXRing[RXCurrent];
+				uint16_t dataSz = desc->Length;
+
+				/* Swap in a fresh buffer and hand the filled one up.
+				   Without one to swap in the frame is dropped and
+				   the old buffer is reused. */
+				NetworkPacket::Buffer *fresh = nullptr;
+				uint8_t rxStatus = desc->Status;
+				uint8_t errors = desc->Errors;
+				if ((errors & RERR_FRAME) || !(rxStatus & RSTA_EOP) || dataSz > PACKET_BUFFER_SIZE)
+					Stats.RXErrors++;
+				else if ((fresh = NetworkPacket::Allocate(PACKET_BUFFER_SIZE, 0)) == nullptr)
+					Stats.RXDropped++;
+
+				if (fresh)
+				{
+					NetworkPacket::Buffer *packet = RXPackets[RXCurrent];
+					packet->Append(dataSz);
+
+					/* Frames with a bad checksum still go up, software checks them again */
+					if (!(rxStatus & RSTA_IXSM) && (rxStatus & RSTA_TCPCS) && !(errors & RERR_TCPE))
+						packet->Checksum = NetworkPacket::CHECKSUM_VERIFIED;
+
+					RXPackets[RXCurrent] = fresh;
+					desc->Address = (uint64_t)fresh->Head;
+					Stats.RXPackets++;
+					Stats.RXBytes += dataSz;
+					NetworkInterfaceManager::ReceiveFrame(ID, packet);
+				}
+
+				desc->Status = 0;
+				last = RXCurrent;
+				RXCurrent = (RXCurrent + 1) % RXCount;
+				handled++;
+			}
+
+			/* Give the descriptors back in one go */
+			if (handled)
+			{
+				WriteCMD(REG::RXDESCTAIL, (uint32_t)last);
+				if (handled > Stats.RXMaxBatch)
+					Stats.RXMaxBatch = handled;
 			}
 
 			return EOK;
@@ -307,9 +461,10 @@ namespace Driver::E1000
 				for (int i = 0; i < 0x80; i++)
 					WriteCMD((uint16_t)(0x5200 + i * 4), 0);
 
+				WriteCMD(REG::ITR, ThrottleInterval(Config.NetInterruptRate));
 				WriteCMD(REG::IMASK, 0x1F6DC);
 				WriteCMD(REG::IMASK, 0xFF & ~4);
-				ReadCMD(0xC0);
+				ReadCMD(REG::ICR);
 
 				InitializeRX();
 				InitializeTX();
@@ -334,9 +489,11 @@ namespace Driver::E1000
 			{
 			case 0x100E:
 			{
-				// Clearing Enable bit in Receive Control Register
+				// Clearing Enable bit in Receive and Transmit Control Registers
 				uint32_t cmdret = ReadCMD(REG::RCTRL);
 				WriteCMD(REG::RCTRL, cmdret & ~RCTL::EN);
+				cmdret = ReadCMD(REG::TCTRL);
+				WriteCMD(REG::TCTRL, cmdret & ~TCTL::EN_);
 
 				// Masking Interrupt Mask, Interrupt Throttling Rate & Interrupt Auto-Mask
 				WriteCMD(REG::IMASK, 0x00000000);
@@ -352,6 +509,16 @@ namespace Driver::E1000
 
 				// Powering down the device (?)
 				WriteCMD(REG::CTRL, PCTRL::POWER_DOWN);
+
+				for (size_t i = 0; i < RXCount; i++)
+					RXPackets[i]->Put();
+				for (size_t i = 0; i < TXCount; i++)
+				{
+					if (TXPackets[i])
+						TXPackets[i]->Put();
+				}
+				delete[] RXPackets;
+				delete[] TXPackets;
 				/* TODO: Stop link; further testing required */
 				break;
 			}
@@ -411,6 +578,7 @@ namespace Driver::E1000
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	std::list<PCI::PCIDevice> Devices;
@@ -425,6 +593,7 @@ namespace Driver::E1000
 			if (e1000->IsInitialized())
 			{
 				dev_t ret = v0::RegisterDevice(DriverID, NETWORK_TYPE_ETHERNET, &ops);
+				e1000->ID = ret;
 				Drivers[ret] = e1000;
 			}
 		}
@@ -19,11 +19,15 @@
 
 #include <types.h>
 
+/* Bounds for the configured ring sizes, in descriptors */
+#define E1000_MIN_DESC 256
+#define E1000_MAX_DESC 4096
+
 enum REG
 {
 	CTRL = 0x0000,
 	STATUS = 0x0008,
-	ICR = 0x000C,
+	ICR = 0x00C0,
 	EEPROM = 0x0014,
 	CTRL_EXT = 0x0018,
 	ITR = 0x00C4,
@@ -45,7 +49,51 @@ enum REG
 	RXDCTL = 0x3828,
 	RADV = 0x282C,
 	RSRPD = 0x2C00,
-	TIPG = 0x0410
+	TIPG = 0x0410,
+	RXCSUM = 0x5000
+};
+
+/* Interrupt causes */
+enum ICRBITS
+{
+	ICR_TXDW = (1 << 0),
+	ICR_TXQE = (1 << 1),
+	ICR_LSC = (1 << 2),
+	ICR_RXSEQ = (1 << 3),
+	ICR_RXDMT0 = (1 << 4),
+	ICR_RXO = (1 << 6),
+	ICR_RXT0 = (1 << 7)
+};
+
+enum RXCSUMCTL
+{
+	RXCSUM_IPOFL = (1 << 8),
+	RXCSUM_TUOFL = (1 << 9)
+};
+
+/* Receive descriptor status */
+enum RSTA
+{
+	RSTA_DD = (1 << 0),
+	RSTA_EOP = (1 << 1),
+	RSTA_IXSM = (1 << 2),
+	RSTA_TCPCS = (1 << 5),
+	RSTA_IPCS = (1 << 6)
+};
+
+/* Receive descriptor errors */
+enum RERR
+{
+	RERR_CE = (1 << 0),
+	RERR_SE = (1 << 1),
+	RERR_SEQ = (1 << 2),
+	RERR_CXE = (1 << 4),
+	RERR_TCPE = (1 << 5),
+	RERR_IPE = (1 << 6),
+	RERR_RXE = (1 << 7),
+
+	/* The frame itself is bad, as opposed to only its checksums */
+	RERR_FRAME = RERR_CE | RERR_SE | RERR_SEQ | RERR_CXE | RERR_RXE
 };
 
 enum PCTRL
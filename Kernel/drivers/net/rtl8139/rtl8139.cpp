@@ -21,6 +21,8 @@
 #include <cpu.hpp>
 #include <pci.hpp>
 #include <net/net.hpp>
+#include <net/nc.hpp>
+#include <net/packet.hpp>
 #include <io.h>
 
 #include "rtl8139.hpp"
@@ -105,11 +107,14 @@ namespace Driver::RTL8139
 				uint16_t dataSz = *(data + 1);
 				data += 2;
 
-				// ReportNetworkPacket(ID, data, dataSz);
-				/* FIXME: Implement */
-				fixme("Received packet");
-				(void)data;
-				(void)dataSz;
+				/* The device receives into one ring, so this is the
+				   only copy a frame gets. The length includes the CRC. */
+				if (dataSz > 4)
+				{
+					NetworkPacket::Buffer *packet = NetworkPacket::FromData(data, dataSz - 4, 0);
+					if (packet)
+						NetworkInterfaceManager::ReceiveFrame(ID, packet);
+				}
 
 				/* Update CAPR */
 #define RX_READ_PTR_MASK (~0x3)
@@ -226,6 +231,7 @@ namespace Driver::RTL8139
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	std::list<PCI::PCIDevice> Devices;
@@ -238,6 +244,7 @@ namespace Driver::RTL8139
 			if (rtl8139->IsInitialized())
 			{
 				dev_t ret = v0::RegisterDevice(DriverID, NETWORK_TYPE_ETHERNET, &ops);
+				rtl8139->ID = ret;
 				Drivers[ret] = rtl8139;
 			}
 		}
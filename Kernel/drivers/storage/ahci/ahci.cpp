@@ -934,6 +934,7 @@ namespace Driver::AHCI
 		.ReadLink = nullptr,
 		.Seek = nullptr,
 		.Stat = nullptr,
+		.Poll = nullptr,
 	};
 
 	std::list<PCI::PCIDevice> Devices;
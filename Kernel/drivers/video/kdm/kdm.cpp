@@ -93,6 +93,7 @@ namespace Driver::KernelDisplayManager
 		.ReadLink = nullptr,
 		.Seek = Seek,
 		.Stat = Stat,
+		.Poll = nullptr,
 	};
 
 	int Entry()
@@ -126,6 +126,8 @@ namespace Execute
 
 				fixme("free allocated memory");
 				// Process->vma->FreeAllPages();
+
+				Process->FileDescriptors->CloseOnExecDescriptors();
 			}
 			else
 			{
@@ -154,15 +156,16 @@ namespace Execute
 				if (unlikely(SearchNode.get() == nullptr))
 					return false;
 
-				for (const auto &ffd : pfdt->FileMap)
+				for (int fd = 0; fd < pfdt->GetTableSize(); fd++)
 				{
-					if (ffd.second.Flags & O_CLOEXEC)
+					auto ffd = pfdt->GetFileDescriptor(fd);
+					if (ffd == nullptr || (pfdt->GetDescriptorFlags(fd) & FD_CLOEXEC))
 						continue;
 
-					if (ffd.second.node.get() != SearchNode.get())
+					if (ffd->node.get() != SearchNode.get())
 						continue;
 
-					fdt->usr_open(ffd.second.node->Path.c_str(), ffd.second.Flags, ffd.second.Mode);
+					fdt->usr_open(ffd->node->Path.c_str(), ffd->Flags, ffd->Mode);
 					return true;
 				}
 				return false;
@@ -0,0 +1,199 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fs/dcache.hpp>
+
+#include <fs/node.hpp>
+#include <lock.hpp>
+#include <debug.h>
+#include <atomic>
+#include <list>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	struct NameEntry
+	{
+		uint64_t ParentID;
+		uint64_t Hash;
+
+		/* nullptr for negative entries */
+		Node Target;
+
+		std::list<NameEntry *>::iterator BucketEntry;
+		std::list<NameEntry *>::iterator LRUEntry;
+
+		uint8_t Length;
+		char Name[DCACHE_NAME_LENGTH + 1];
+	};
+
+	NewLock(NameCacheLock);
+	static std::list<NameEntry *> NameBuckets[DCACHE_HASH_SIZE];
+
+	/* Most recently used first */
+	static std::list<NameEntry *> NameLRU;
+	static NameCacheStatistics NameStats{};
+	static std::atomic<uint64_t> NextNodeID = 1;
+
+	uint64_t HashName(const char *Name, size_t Length)
+	{
+		/* FNV-1a */
+		uint64_t hash = 0xCBF29CE484222325;
+		for (size_t i = 0; i < Length; i++)
+		{
+			hash ^= (uint8_t)Name[i];
+			hash *= 0x100000001B3;
+		}
+		return hash;
+	}
+
+	uint64_t AllocateNodeID()
+	{
+		return NextNodeID.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static std::list<NameEntry *> &Bucket(uint64_t ParentID, uint64_t Hash)
+	{
+		uint64_t key = Hash ^ (ParentID * 0x9E3779B97F4A7C15);
+		key ^= key >> 29;
+		return NameBuckets[key & (DCACHE_HASH_SIZE - 1)];
+	}
+
+	static NameEntry *Find(uint64_t ParentID, const char *Name, size_t Length, uint64_t Hash)
+	{
+		for (NameEntry *entry : Bucket(ParentID, Hash))
+		{
+			if (entry->ParentID != ParentID || entry->Hash != Hash)
+				continue;
+			if (entry->Length != Length || memcmp(entry->Name, Name, Length) != 0)
+				continue;
+			return entry;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Unlink an entry, the caller drops the returned
+	 * node once the lock is released.
+	 */
+	static Node Unlink(NameEntry *Entry)
+	{
+		Bucket(Entry->ParentID, Entry->Hash).erase(Entry->BucketEntry);
+		NameLRU.erase(Entry->LRUEntry);
+
+		Node target = std::move(Entry->Target);
+		if (target == nullptr)
+			NameStats.Negative--;
+		NameStats.Entries--;
+		delete Entry;
+		return target;
+	}
+
+	NameCacheResult NameCacheLookup(NodeCache *Parent, const char *Name, size_t Length, uint64_t Hash, Node *Result)
+	{
+		SmartLock(NameCacheLock);
+		NameEntry *entry = Find(Parent->CacheID, Name, Length, Hash);
+		if (entry == nullptr)
+		{
+			NameStats.Misses++;
+			return NAME_CACHE_MISS;
+		}
+
+		NameLRU.splice(NameLRU.begin(), NameLRU, entry->LRUEntry);
+		if (entry->Target == nullptr)
+		{
+			NameStats.NegativeHits++;
+			return NAME_CACHE_NEGATIVE;
+		}
+
+		NameStats.Hits++;
+		*Result = entry->Target;
+		return NAME_CACHE_HIT;
+	}
+
+	void NameCacheInsert(NodeCache *Parent, const char *Name, size_t Length, uint64_t Hash, Node Target)
+	{
+		if (Length > DCACHE_NAME_LENGTH)
+			return;
+
+		/* Released after the lock is dropped, a node
+		   destructor can sync to disk */
+		Node released;
+
+		NameCacheLock.Lock(__FUNCTION__);
+		NameEntry *entry = Find(Parent->CacheID, Name, Length, Hash);
+		if (entry)
+		{
+			if (entry->Target == nullptr && Target != nullptr)
+				NameStats.Negative--;
+			else if (entry->Target != nullptr && Target == nullptr)
+				NameStats.Negative++;
+
+			released = std::move(entry->Target);
+			entry->Target = std::move(Target);
+			NameLRU.splice(NameLRU.begin(), NameLRU, entry->LRUEntry);
+			NameCacheLock.Unlock();
+			return;
+		}
+
+		if (NameStats.Entries >= DCACHE_MAX_ENTRIES)
+		{
+			released = Unlink(NameLRU.back());
+			NameStats.Evictions++;
+		}
+
+		entry = new NameEntry;
+		entry->ParentID = Parent->CacheID;
+		entry->Hash = Hash;
+		entry->Length = (uint8_t)Length;
+		memcpy(entry->Name, Name, Length);
+		entry->Name[Length] = '\0';
+		if (Target == nullptr)
+			NameStats.Negative++;
+		entry->Target = std::move(Target);
+
+		std::list<NameEntry *> &bucket = Bucket(entry->ParentID, Hash);
+		bucket.push_front(entry);
+		entry->BucketEntry = bucket.begin();
+		NameLRU.push_front(entry);
+		entry->LRUEntry = NameLRU.begin();
+		NameStats.Entries++;
+		NameCacheLock.Unlock();
+	}
+
+	void NameCacheInvalidate(NodeCache *Parent, const char *Name, size_t Length)
+	{
+		if (Length > DCACHE_NAME_LENGTH)
+			return;
+
+		Node released;
+		uint64_t hash = HashName(Name, Length);
+
+		NameCacheLock.Lock(__FUNCTION__);
+		NameEntry *entry = Find(Parent->CacheID, Name, Length, hash);
+		if (entry)
+			released = Unlink(entry);
+		NameCacheLock.Unlock();
+	}
+
+	NameCacheStatistics GetNameCacheStatistics()
+	{
+		SmartLock(NameCacheLock);
+		return NameStats;
+	}
+}
@@ -16,6 +16,10 @@
 */
 
 #include <fs/vfs.hpp>
+#include <fs/pipe.hpp>
+#include <fs/epoll.hpp>
+#include <fs/uring.hpp>
+#include <net/socket.hpp>
 
 #include <convert.h>
 #include <stropts.h>
@@ -28,28 +32,142 @@
 
 namespace vfs
 {
+	FileDescriptorTable::FildesReference FileDescriptorTable::GetFileDescriptor(int FileDescriptor)
+	{
+		SmartLock(TableLock);
+		if ((size_t)FileDescriptor >= Slots.size())
+			return nullptr;
+
+		Fildes *fildes = Slots[FileDescriptor].Description;
+		if (fildes == nullptr)
+			return nullptr;
+
+		fildes->Get();
+		return FildesReference(fildes);
+	}
+
+	int FileDescriptorTable::GetTableSize()
+	{
+		SmartLock(TableLock);
+		return (int)Slots.size();
+	}
+
 	int FileDescriptorTable::GetFlags(int FileDescriptor)
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(FileDescriptor);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
 
-		return it->second.Flags;
+		return fildes->Flags;
 	}
 
 	int FileDescriptorTable::SetFlags(int FileDescriptor, int Flags)
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(FileDescriptor);
+		if (fildes == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
+
+		fildes->Flags = Flags & ~O_CLOEXEC;
+		return 0;
+	}
+
+	int FileDescriptorTable::GetDescriptorFlags(int FileDescriptor)
+	{
+		SmartLock(TableLock);
+		if ((size_t)FileDescriptor >= Slots.size() || Slots[FileDescriptor].Description == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
+
+		return Slots[FileDescriptor].CloseOnExec ? FD_CLOEXEC : 0;
+	}
+
+	int FileDescriptorTable::SetDescriptorFlags(int FileDescriptor, int Flags)
+	{
+		SmartLock(TableLock);
+		if ((size_t)FileDescriptor >= Slots.size() || Slots[FileDescriptor].Description == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
 
-		it->second.Flags = Flags;
+		Slots[FileDescriptor].CloseOnExec = Flags & FD_CLOEXEC;
 		return 0;
 	}
 
+	int FileDescriptorTable::GetFreeFileDescriptor(int Minimum)
+	{
+		Tasking::PCB *pcb = (Tasking::PCB *)this->Owner;
+		size_t limit = pcb->SoftLimits.OpenFiles;
+
+		size_t first = Minimum ? (size_t)Minimum / 64 : FreeHint;
+		for (size_t i = first; i < Used.size(); i++)
+		{
+			uint64_t free = ~Used[i];
+			if (i == (size_t)Minimum / 64)
+				free &= ~0ULL << (Minimum % 64);
+			if (free == 0)
+				continue;
+
+			size_t fd = i * 64 + __builtin_ctzll(free);
+			return fd < limit ? (int)fd : -EMFILE;
+		}
+
+		/* Everything is in use, the table has to grow */
+		size_t fd = MAX(Used.size() * 64, (size_t)Minimum);
+		return fd < limit ? (int)fd : -EMFILE;
+	}
+
+	void FileDescriptorTable::SetSlot(int FileDescriptor, Fildes *Description, bool CloseOnExec)
+	{
+		size_t fd = FileDescriptor;
+		if (fd >= Slots.size())
+		{
+			size_t size = MAX(Slots.size(), (size_t)64);
+			while (size <= fd)
+				size *= 2;
+
+			Slots.resize(size);
+			Used.resize(size / 64, 0);
+		}
+
+		assert(Slots[fd].Description == nullptr);
+		Slots[fd].Description = Description;
+		Slots[fd].CloseOnExec = CloseOnExec;
+		Used[fd / 64] |= 1ULL << (fd % 64);
+	}
+
+	FileDescriptorTable::Fildes *FileDescriptorTable::ClearSlot(int FileDescriptor)
+	{
+		size_t fd = FileDescriptor;
+		if (fd >= Slots.size())
+			return nullptr;
+
+		Fildes *fildes = Slots[fd].Description;
+		Slots[fd].Description = nullptr;
+		Slots[fd].CloseOnExec = false;
+		Used[fd / 64] &= ~(1ULL << (fd % 64));
+		FreeHint = MIN(FreeHint, fd / 64);
+		return fildes;
+	}
+
+	int FileDescriptorTable::InstallFileDescriptor(Fildes *Description, bool CloseOnExec, int Minimum)
+	{
+		int fd;
+		{
+			SmartLock(TableLock);
+			fd = this->GetFreeFileDescriptor(Minimum);
+			if (fd >= 0)
+			{
+				this->SetSlot(fd, Description, CloseOnExec);
+				if (Minimum == 0)
+					FreeHint = fd / 64;
+			}
+		}
+
+		if (fd < 0)
+			Description->Put();
+		return fd;
+	}
+
 	int FileDescriptorTable::AddFileDescriptor(const char *AbsolutePath, mode_t Mode, int Flags)
 	{
-		Tasking::PCB *pcb = thisProcess;
+		Tasking::PCB *pcb = (Tasking::PCB *)this->Owner;
 
 		auto ProbeMode = [](mode_t Mode, int Flags) -> int
 		{
@@ -101,11 +219,6 @@ namespace vfs
 			}
 		}
 
-		if (Flags & O_CLOEXEC)
-		{
-			fixme("O_CLOEXEC");
-		}
-
 		eNode ret = fs->Lookup(pcb->CWD, AbsolutePath);
 		if (ret == false)
 		{
@@ -120,26 +233,24 @@ namespace vfs
 			fs->Truncate(node, 0);
 		}
 
-		Fildes fd{};
+		Fildes *fd = new Fildes;
 
 		if (Flags & O_APPEND)
 		{
 			debug("Appending to file %s", AbsolutePath);
 			struct kstat stat;
 			fs->Stat(node, &stat);
-			fd.Offset = fs->Seek(node, stat.Size);
+			fd->Offset = fs->Seek(node, stat.Size);
 		}
 
-		fd.Mode = Mode;
-		fd.Flags = Flags;
-		fd.node = node;
+		fd->Mode = Mode;
+		fd->Flags = Flags & ~O_CLOEXEC;
+		fd->node = node;
 
-		int fdn = this->GetFreeFileDescriptor();
+		int fdn = this->InstallFileDescriptor(fd, Flags & O_CLOEXEC);
 		if (fdn < 0)
 			return fdn;
 
-		this->FileMap.insert({fdn, fd});
-
 		char linkName[64];
 		snprintf(linkName, 64, "%d", fdn);
 		assert(fs->CreateLink(this->fdDir, linkName, AbsolutePath) == true);
@@ -147,43 +258,69 @@ namespace vfs
 		return fdn;
 	}
 
-	int FileDescriptorTable::RemoveFileDescriptor(int FileDescriptor)
+	FileDescriptorTable::Fildes::~Fildes()
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
-			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
-
-		fs->Remove(it->second.node);
-		this->FileMap.erase(it);
-		return 0;
+		EventPoll::Release(this);
+		delete Directory;
 	}
 
-	int FileDescriptorTable::GetFreeFileDescriptor()
+	void FileDescriptorTable::RemoveLink(int FileDescriptor)
 	{
-		Tasking::PCB *pcb = thisProcess;
+		/* Only descriptors opened by path have one */
+		char linkName[64];
+		snprintf(linkName, 64, "%d", FileDescriptor);
+		fs->Remove(this->fdDir, linkName);
+	}
 
-		for (size_t i = 0; i < pcb->SoftLimits.OpenFiles; i++)
+	int FileDescriptorTable::RemoveFileDescriptor(int FileDescriptor)
+	{
+		Fildes *fildes;
 		{
-			auto it = this->FileMap.find(i);
-			if (it == this->FileMap.end())
-				return i;
+			SmartLock(TableLock);
+			fildes = this->ClearSlot(FileDescriptor);
 		}
 
-		return -EMFILE;
+		if (fildes == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
+
+		/* The last reference may go away here, keep it out of the lock */
+		this->RemoveLink(FileDescriptor);
+		fildes->Put();
+		return 0;
 	}
 
 	void FileDescriptorTable::Fork(FileDescriptorTable *Parent)
 	{
-		this->FileMap = Parent->FileMap;
+		SmartLock(Parent->TableLock);
+		for (size_t i = 0; i < Parent->Slots.size(); i++)
+		{
+			Slot &slot = Parent->Slots[i];
+			if (slot.Description == nullptr)
+				continue;
 
-		for (const auto &fd : this->FileMap)
+			/* The child shares the description, offset included */
+			slot.Description->Get();
+			this->SetSlot(i, slot.Description, slot.CloseOnExec);
+		}
+	}
+
+	void FileDescriptorTable::CloseOnExecDescriptors()
+	{
+		std::vector<int> closing;
 		{
-			if (fd.second.Flags & O_CLOEXEC)
+			SmartLock(TableLock);
+			for (size_t i = 0; i < Slots.size(); i++)
 			{
-				debug("O_CLOEXEC flag set, removing fd %d", fd.first);
-				this->FileMap.erase(fd.first);
+				if (Slots[i].Description != nullptr && Slots[i].CloseOnExec)
+					closing.push_back(i);
 			}
 		}
+
+		for (int fd : closing)
+		{
+			debug("FD_CLOEXEC set, closing fd %d", fd);
+			this->RemoveFileDescriptor(fd);
+		}
 	}
 
 	int FileDescriptorTable::usr_open(const char *pathname, int flags, mode_t mode)
@@ -201,74 +338,73 @@ namespace vfs
 
 	ssize_t FileDescriptorTable::usr_read(int fd, void *buf, size_t count)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return fs->Read(it->second.node, buf, count, it->second.Offset);
+		return fs->Read(fildes->node, buf, count, fildes->Offset);
 	}
 
 	ssize_t FileDescriptorTable::usr_pread(int fd, void *buf, size_t count, off_t offset)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return fs->Read(it->second.node, buf, count, offset);
+		return fs->Read(fildes->node, buf, count, offset);
 	}
 
 	ssize_t FileDescriptorTable::usr_write(int fd, const void *buf, size_t count)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return fs->Write(it->second.node, buf, count, it->second.Offset);
+		return fs->Write(fildes->node, buf, count, fildes->Offset);
 	}
 
 	ssize_t FileDescriptorTable::usr_pwrite(int fd, const void *buf, size_t count, off_t offset)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return fs->Write(it->second.node, buf, count, offset);
+		return fs->Write(fildes->node, buf, count, offset);
 	}
 
 	int FileDescriptorTable::usr_close(int fd)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
-			ReturnLogError(-EBADF, "Invalid fd %d", fd);
-
 		return RemoveFileDescriptor(fd);
 	}
 
 	off_t FileDescriptorTable::usr_lseek(int fd, off_t offset, int whence)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		off_t &newOffset = it->second.Offset;
+		if (fildes->Type == Fildes::FD_PIPE)
+			return -ESPIPE;
+
+		off_t &newOffset = fildes->Offset;
 
 		switch (whence)
 		{
 		case SEEK_SET:
 		{
-			newOffset = fs->Seek(it->second.node, offset);
+			newOffset = fs->Seek(fildes->node, offset);
 			break;
 		}
 		case SEEK_CUR:
 		{
-			newOffset = fs->Seek(it->second.node, newOffset + offset);
+			newOffset = fs->Seek(fildes->node, newOffset + offset);
 			break;
 		}
 		case SEEK_END:
 		{
 			struct kstat stat{};
-			fs->Stat(it->second.node, &stat);
-			newOffset = fs->Seek(it->second.node, stat.Size + offset);
+			fs->Stat(fildes->node, &stat);
+			newOffset = fs->Seek(fildes->node, stat.Size + offset);
 			break;
 		}
 		default:
@@ -304,12 +440,11 @@ namespace vfs
 
 	int FileDescriptorTable::usr_fstat(int fd, kstat *statbuf)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		vfs::FileDescriptorTable::Fildes &fildes = it->second;
-		return fs->Stat(fildes.node, statbuf);
+		return fs->Stat(fildes->node, statbuf);
 	}
 
 	int FileDescriptorTable::usr_lstat(const char *pathname, kstat *statbuf)
@@ -324,55 +459,279 @@ namespace vfs
 
 	int FileDescriptorTable::usr_dup(int oldfd)
 	{
-		auto it = this->FileMap.find(oldfd);
-		if (it == this->FileMap.end())
-			ReturnLogError(-EBADF, "Invalid fd %d", oldfd);
+		return this->usr_dupfd(oldfd, 0, 0);
+	}
 
-		int newfd = this->GetFreeFileDescriptor();
-		if (newfd < 0)
-			return -EMFILE;
+	int FileDescriptorTable::usr_dup2(int oldfd, int newfd)
+	{
+		Tasking::PCB *pcb = (Tasking::PCB *)this->Owner;
+		if (newfd < 0 || (size_t)newfd >= pcb->SoftLimits.OpenFiles)
+			ReturnLogError(-EBADF, "Invalid newfd %d", newfd);
 
-		Fildes new_dfd{};
-		new_dfd.node = it->second.node;
-		new_dfd.Mode = it->second.Mode;
+		Fildes *fildes;
+		Fildes *replaced;
+		{
+			SmartLock(TableLock);
+			if ((size_t)oldfd >= Slots.size() || Slots[oldfd].Description == nullptr)
+				ReturnLogError(-EBADF, "Invalid oldfd %d", oldfd);
+
+			if (newfd == oldfd)
+				return newfd;
+
+			/* Closing newfd and reusing it is one step, like on Linux */
+			fildes = Slots[oldfd].Description;
+			fildes->Get();
+			replaced = this->ClearSlot(newfd);
+			this->SetSlot(newfd, fildes, false);
+		}
 
-		this->FileMap.insert({newfd, new_dfd});
+		if (replaced)
+		{
+			this->RemoveLink(newfd);
+			replaced->Put();
+		}
 
 		debug("Duplicated file descriptor %d to %d", oldfd, newfd);
 		return newfd;
 	}
 
-	int FileDescriptorTable::usr_dup2(int oldfd, int newfd)
+	int FileDescriptorTable::usr_dupfd(int oldfd, int minfd, int flags)
 	{
-		if (newfd < 0)
-			ReturnLogError(-EBADF, "Invalid newfd %d", newfd);
+		if (minfd < 0)
+			return -EINVAL;
 
-		auto it = this->FileMap.find(oldfd);
-		if (it == this->FileMap.end())
-			ReturnLogError(-EBADF, "Invalid oldfd %d", oldfd);
+		FildesReference fildes = this->GetFileDescriptor(oldfd);
+		if (fildes == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", oldfd);
 
-		if (newfd == oldfd)
+		/* The new descriptor shares the offset and status flags */
+		fildes->Get();
+		int newfd = this->InstallFileDescriptor(fildes.get(), flags & O_CLOEXEC, minfd);
+		if (newfd < 0)
 			return newfd;
 
-		/* Even if it's not valid we ignore it. */
-		this->usr_close(newfd);
-
-		Fildes new_dfd{};
-		new_dfd.node = it->second.node;
-		new_dfd.Mode = it->second.Mode;
-
-		this->FileMap.insert({newfd, new_dfd});
 		debug("Duplicated file descriptor %d to %d", oldfd, newfd);
 		return newfd;
 	}
 
 	int FileDescriptorTable::usr_ioctl(int fd, unsigned long request, void *argp)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		FildesReference fildes = this->GetFileDescriptor(fd);
+		if (fildes == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return fs->Ioctl(it->second.node, request, argp);
+		return fs->Ioctl(fildes->node, request, argp);
+	}
+
+	int FileDescriptorTable::usr_pipe(int pipefd[2], int flags)
+	{
+		if (flags & ~(O_NONBLOCK | O_CLOEXEC))
+			return -EINVAL;
+
+		/* O_CLOEXEC belongs to the descriptors, the rest to the descriptions */
+		bool closeOnExec = flags & O_CLOEXEC;
+		int statusFlags = flags & O_NONBLOCK;
+
+		Fildes *rfd = new Fildes;
+		rfd->Type = Fildes::FD_PIPE;
+		rfd->Mode = S_IFIFO | S_IRUSR | S_IWUSR;
+		rfd->Flags = O_RDONLY | statusFlags;
+
+		Fildes *wfd = new Fildes;
+		wfd->Type = rfd->Type;
+		wfd->Mode = rfd->Mode;
+		wfd->Flags = O_WRONLY | statusFlags;
+
+		int ret = Pipe::Create(rfd->node, wfd->node, statusFlags);
+		if (ret < 0)
+		{
+			rfd->Put();
+			wfd->Put();
+			return ret;
+		}
+
+		int rfdn = this->InstallFileDescriptor(rfd, closeOnExec);
+		if (rfdn < 0)
+		{
+			wfd->Put();
+			return rfdn;
+		}
+
+		int wfdn = this->InstallFileDescriptor(wfd, closeOnExec);
+		if (wfdn < 0)
+		{
+			this->RemoveFileDescriptor(rfdn);
+			return wfdn;
+		}
+
+		pipefd[0] = rfdn;
+		pipefd[1] = wfdn;
+		debug("Created pipe fds %d and %d", rfdn, wfdn);
+		return 0;
+	}
+
+	ssize_t FileDescriptorTable::usr_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+	{
+		FildesReference in = this->GetFileDescriptor(in_fd);
+		FildesReference out = this->GetFileDescriptor(out_fd);
+		if (in == nullptr || out == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d or %d", in_fd, out_fd);
+
+		Node inNode = in->node;
+		Node outNode = out->node;
+		bool nonBlock = (in->Flags | out->Flags) & O_NONBLOCK;
+
+		off_t inOffset = offset ? *offset : in->Offset;
+		if (inOffset < 0)
+			return -EINVAL;
+
+		/* Like a single read(), keep the result representable */
+		count = std::min(count, (size_t)INT_MAX & ~(PAGE_SIZE - 1));
+
+		ssize_t ret = fs->Transfer(inNode, inOffset, outNode, out->Offset, count, nonBlock);
+		if (ret <= 0)
+			return ret;
+
+		if (offset)
+			*offset += ret;
+		else
+			this->usr_lseek(in_fd, ret, SEEK_CUR);
+		this->usr_lseek(out_fd, ret, SEEK_CUR);
+		return ret;
+	}
+
+	ssize_t FileDescriptorTable::usr_copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags)
+	{
+		if (flags != 0)
+			return -EINVAL;
+
+		FildesReference in = this->GetFileDescriptor(fd_in);
+		FildesReference out = this->GetFileDescriptor(fd_out);
+		if (in == nullptr || out == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d or %d", fd_in, fd_out);
+
+		Node inNode = in->node;
+		Node outNode = out->node;
+		if (inNode->IsDirectory() || outNode->IsDirectory())
+			return -EISDIR;
+		if (!inNode->IsRegularFile() || !outNode->IsRegularFile())
+			return -EINVAL;
+
+		off_t inOffset = off_in ? *off_in : in->Offset;
+		off_t outOffset = off_out ? *off_out : out->Offset;
+		if (inOffset < 0 || outOffset < 0)
+			return -EINVAL;
+
+		len = std::min(len, (size_t)INT_MAX & ~(PAGE_SIZE - 1));
+
+		/* Overlapping ranges of the same file would read back what we wrote */
+		if (inNode->inode == outNode->inode &&
+			inOffset < outOffset + (off_t)len &&
+			outOffset < inOffset + (off_t)len)
+			return -EINVAL;
+
+		ssize_t ret = fs->Transfer(inNode, inOffset, outNode, outOffset, len, false);
+		if (ret <= 0)
+			return ret;
+
+		if (off_in)
+			*off_in += ret;
+		else
+			this->usr_lseek(fd_in, ret, SEEK_CUR);
+
+		if (off_out)
+			*off_out += ret;
+		else
+			this->usr_lseek(fd_out, ret, SEEK_CUR);
+		return ret;
+	}
+
+	int FileDescriptorTable::usr_epoll_create(int flags)
+	{
+		if (flags & ~O_CLOEXEC)
+			return -EINVAL;
+
+		Fildes *fd = new Fildes;
+		fd->Type = Fildes::FD_INODE;
+		fd->Mode = S_IRUSR | S_IWUSR;
+		fd->Flags = O_RDWR;
+
+		int ret = EventPoll::Create(fd->node);
+		if (ret < 0)
+		{
+			fd->Put();
+			return ret;
+		}
+
+		return this->InstallFileDescriptor(fd, flags & O_CLOEXEC);
+	}
+
+	int FileDescriptorTable::usr_socket(int domain, int type, int protocol, int flags)
+	{
+		if (flags & ~(O_NONBLOCK | O_CLOEXEC))
+			return -EINVAL;
+
+		NetworkSocket::Socket *sock = nullptr;
+		int ret = NetworkSocket::Create(domain, type, protocol, &sock);
+		if (ret < 0)
+			return ret;
+
+		Fildes *fd = new Fildes;
+		fd->Type = Fildes::FD_SOCKET;
+		fd->Mode = S_IFSOCK | S_IRUSR | S_IWUSR;
+		fd->Flags = O_RDWR | (flags & ~O_CLOEXEC);
+		fd->node = NetworkSocket::CreateNode(sock, flags);
+		return this->InstallFileDescriptor(fd, flags & O_CLOEXEC);
+	}
+
+	int FileDescriptorTable::usr_accept(int sockfd, NetworkSocket::SocketAddress *addr, int flags)
+	{
+		if (flags & ~(O_NONBLOCK | O_CLOEXEC))
+			return -EINVAL;
+
+		FildesReference fildes = this->GetFileDescriptor(sockfd);
+		if (fildes == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", sockfd);
+
+		/* Hold the node, the descriptor may be closed while we block */
+		Node node = fildes->node;
+		bool nonBlock = fildes->Flags & O_NONBLOCK;
+		NetworkSocket::Socket *sock = NetworkSocket::FromNode(node);
+		if (sock == nullptr)
+			return -ENOTSOCK;
+
+		NetworkSocket::Socket *conn = nullptr;
+		int ret = sock->Accept(&conn, addr, nonBlock);
+		if (ret < 0)
+			return ret;
+
+		Fildes *fd = new Fildes;
+		fd->Type = Fildes::FD_SOCKET;
+		fd->Mode = S_IFSOCK | S_IRUSR | S_IWUSR;
+		fd->Flags = O_RDWR | (flags & ~O_CLOEXEC);
+		fd->node = NetworkSocket::CreateNode(conn, flags);
+		return this->InstallFileDescriptor(fd, flags & O_CLOEXEC);
+	}
+
+	int FileDescriptorTable::usr_io_uring_setup(uint32_t entries, kio_uring_params *params,
+												int (*ConvertResult)(int Result))
+	{
+		Fildes *fd = new Fildes;
+		fd->Type = Fildes::FD_INODE;
+		fd->Mode = S_IRUSR | S_IWUSR;
+		fd->Flags = O_RDWR;
+
+		int ret = IoUring::Create(entries, params, (Tasking::PCB *)this->Owner,
+								  fd->node, ConvertResult);
+		if (ret < 0)
+		{
+			fd->Put();
+			return ret;
+		}
+
+		/* The rings are mapped into this process only. A forked
+		   child inherits the descriptor but can only close it. */
+		return this->InstallFileDescriptor(fd, true);
 	}
 
 	FileDescriptorTable::FileDescriptorTable(void *_Owner)
@@ -388,4 +747,13 @@ namespace vfs
 		Tasking::PCB *pcb = (Tasking::PCB *)_Owner;
 		this->fdDir = fs->Create(pcb->ProcDirectory, "fd", Mode);
 	}
+
+	FileDescriptorTable::~FileDescriptorTable()
+	{
+		for (auto &&slot : Slots)
+		{
+			if (slot.Description)
+				slot.Description->Put();
+		}
+	}
 }
@@ -0,0 +1,429 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <fs/epoll.hpp>
+
+#include <task.hpp>
+#include <time.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	static int EventPollPoll(struct Inode *Node, struct PollTable *Table)
+	{
+		EventPoll *ep = ((EventPoll::EventPollInode *)Node)->Owner;
+		return ep->Poll(Table);
+	}
+
+	static int EventPollStat(struct Inode *Node, struct kstat *Stat)
+	{
+		*Stat = {};
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		return 0;
+	}
+
+	static FileSystemInfo *GetEventPollFileSystem()
+	{
+		static FileSystemInfo *fsi = nullptr;
+		if (likely(fsi))
+			return fsi;
+
+		fsi = new FileSystemInfo{};
+		fsi->Name = "epollfs";
+		fsi->Ops.Stat = EventPollStat;
+		fsi->Ops.Poll = EventPollPoll;
+		return fsi;
+	}
+
+	static std::atomic<ino_t> NextEventPollIndex = 1;
+
+	/*
+	 * Guards the item lists of open files and keeps the nesting
+	 * graph still while it is walked. Taken before any EpollLock.
+	 */
+	NewLock(EpollWatchLock);
+
+	class EventPollNode : public NodeCache
+	{
+	public:
+		EventPoll::EventPollInode Instance;
+
+		EventPollNode(EventPoll *Owner, ino_t Index)
+		{
+			Instance.Owner = Owner;
+			Instance.Node.Index = Index;
+			Instance.Node.Mode = S_IRUSR | S_IWUSR;
+
+			this->inode = &Instance.Node;
+			this->fsi = GetEventPollFileSystem();
+			this->Flags.raw = 0;
+			this->Name = std::string("anon_inode:[eventpoll]");
+			this->Path = this->Name;
+		}
+
+		~EventPollNode()
+		{
+			delete Instance.Owner;
+		}
+	};
+
+	void EventPoll::ItemCallback(PollEntry *Entry, int Events)
+	{
+		Item *item = (Item *)Entry->Private;
+		EventPoll *ep = item->Owner;
+
+		/* Skip wakeups for events nobody asked for */
+		if (Events && !(Events & (item->Events | POLLERR | POLLHUP)))
+			return;
+
+		bool queued;
+		{
+			SmartLock(ep->EpollLock);
+			queued = ep->MarkReady(item);
+		}
+
+		if (queued)
+			ep->ReadyQueue.Wake(POLLIN | POLLRDNORM);
+	}
+
+	bool EventPoll::MarkReady(Item *item)
+	{
+		if (item->Ready || item->Disabled || item->Removed)
+			return false;
+
+		item->Ready = true;
+		item->ReadyEntry = ReadyList.insert(ReadyList.end(), item);
+		return true;
+	}
+
+	void EventPoll::Put(Item *item)
+	{
+		/* The destructor unregisters the poll table */
+		if (--item->References == 0)
+			delete item;
+	}
+
+	void EventPoll::Unwatch(Item *item)
+	{
+		if (item->Description == nullptr)
+			return;
+
+		item->Description->EventPollItems.erase(item->DescriptionEntry);
+		item->Description = nullptr;
+	}
+
+	int EventPoll::CheckNesting(EventPoll *From, EventPoll *To, int Depth)
+	{
+		if (From == To || Depth > EPOLL_MAX_NESTS)
+			return -ELOOP;
+
+		/* Nested instances can't go away while the watch lock is held */
+		std::vector<EventPoll *> nested;
+		{
+			SmartLock(From->EpollLock);
+			for (auto &it : From->Items)
+			{
+				EventPoll *ep = FromNode(it.second->node);
+				if (ep)
+					nested.push_back(ep);
+			}
+		}
+
+		for (EventPoll *ep : nested)
+		{
+			int ret = CheckNesting(ep, To, Depth + 1);
+			if (ret < 0)
+				return ret;
+		}
+		return 0;
+	}
+
+	int EventPoll::Harvest(Event *Events, int MaxEvents)
+	{
+		std::vector<Item *> batch;
+		{
+			SmartLock(EpollLock);
+			while (!ReadyList.empty() && batch.size() < (size_t)MaxEvents)
+			{
+				Item *item = ReadyList.front();
+				ReadyList.pop_front();
+				item->Ready = false;
+				item->References++;
+				batch.push_back(item);
+			}
+		}
+
+		int count = 0;
+		for (Item *item : batch)
+		{
+			/* Ready list entries are only hints, ask the node again */
+			int mask = fs->Poll(item->node, nullptr);
+			if (mask < 0)
+				mask = POLLERR;
+
+			bool queued = false;
+			{
+				SmartLock(EpollLock);
+				mask &= item->Events | POLLERR | POLLHUP;
+				if (mask && !item->Removed && !item->Disabled)
+				{
+					Events[count].Events = mask;
+					Events[count].Data = item->Data;
+					count++;
+
+					/* Level-triggered items stay queued while they are ready */
+					if (item->Events & EPOLLONESHOT)
+						item->Disabled = true;
+					else if (!(item->Events & EPOLLET))
+						queued = MarkReady(item);
+				}
+			}
+
+			if (queued)
+				ReadyQueue.Wake(POLLIN | POLLRDNORM);
+			Put(item);
+		}
+		return count;
+	}
+
+	int EventPoll::Control(int Operation, int Descriptor, FileDescriptorTable::Fildes *Description, const Event *event)
+	{
+		if (Description == nullptr || Description->node == nullptr)
+			return -EBADF;
+
+		Node &Target = Description->node;
+		EventPoll *nested = FromNode(Target);
+		if (nested == this)
+			return -EINVAL;
+
+		if (Operation != EPOLL_CTL_DEL && event == nullptr)
+			return -EFAULT;
+
+		Item *item = nullptr;
+		switch (Operation)
+		{
+		case EPOLL_CTL_ADD:
+		{
+			/* Regular files are always ready, watching them makes no sense */
+			if (Target->fsi->Ops.Poll == nullptr)
+				return -EPERM;
+
+			/* A loop would make the wakeup callbacks recurse forever */
+			SmartLock(EpollWatchLock);
+			if (nested)
+			{
+				int ret = CheckNesting(nested, this, 1);
+				if (ret < 0)
+					return ret;
+			}
+
+			{
+				SmartLock(EpollLock);
+				if (Items.find(Descriptor) != Items.end())
+					return -EEXIST;
+
+				item = new Item;
+				item->Owner = this;
+				item->Descriptor = Descriptor;
+				item->node = Target;
+				item->Events = event->Events;
+				item->Data = event->Data;
+				item->Table.Callback = ItemCallback;
+				item->Table.Private = item;
+				item->References = 2;
+				item->Description = Description;
+				item->DescriptionEntry = Description->EventPollItems.insert(Description->EventPollItems.end(), item);
+				Items[Descriptor] = item;
+			}
+			break;
+		}
+		case EPOLL_CTL_MOD:
+		{
+			SmartLock(EpollLock);
+			auto it = Items.find(Descriptor);
+			if (it == Items.end())
+				return -ENOENT;
+
+			item = it->second;
+			item->Events = event->Events;
+			item->Data = event->Data;
+			item->Disabled = false;
+			item->References++;
+			break;
+		}
+		case EPOLL_CTL_DEL:
+		{
+			{
+				SmartLock(EpollWatchLock);
+				{
+					SmartLock(EpollLock);
+					auto it = Items.find(Descriptor);
+					if (it == Items.end())
+						return -ENOENT;
+
+					item = it->second;
+					Unwatch(item);
+					Items.erase(it);
+					item->Removed = true;
+					if (item->Ready)
+					{
+						ReadyList.erase(item->ReadyEntry);
+						item->Ready = false;
+					}
+				}
+			}
+
+			Put(item);
+			return 0;
+		}
+		default:
+			return -EINVAL;
+		}
+
+		/* Register on the first call only and pick up the current state */
+		PollTable *pt = Operation == EPOLL_CTL_ADD ? &item->Table : nullptr;
+		int mask = fs->Poll(item->node, pt);
+		if (mask < 0)
+			mask = POLLERR;
+
+		bool queued = false;
+		if (mask & (item->Events | POLLERR | POLLHUP))
+		{
+			SmartLock(EpollLock);
+			queued = MarkReady(item);
+		}
+
+		if (queued)
+			ReadyQueue.Wake(POLLIN | POLLRDNORM);
+		Put(item);
+		return 0;
+	}
+
+	int EventPoll::Wait(Event *Events, int MaxEvents, int64_t Timeout)
+	{
+		if (MaxEvents <= 0)
+			return -EINVAL;
+
+		PollWaiter waiter;
+		if (Timeout != 0)
+			PollWait(&waiter.Table, ReadyQueue);
+
+		uint64_t deadline = 0;
+		if (Timeout > 0)
+			deadline = TimeManager->GetTimeNs() + Timeout;
+
+		while (true)
+		{
+			waiter.Arm();
+
+			int count = Harvest(Events, MaxEvents);
+			if (count || Timeout == 0)
+				return count;
+
+			int ret = waiter.Sleep(deadline);
+			if (ret == -ETIMEDOUT)
+				return 0;
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	int EventPoll::Poll(PollTable *Table)
+	{
+		PollWait(Table, ReadyQueue);
+
+		SmartLock(EpollLock);
+		return ReadyList.empty() ? 0 : POLLIN | POLLRDNORM;
+	}
+
+	int EventPoll::Create(Node &Result)
+	{
+		ino_t index = NextEventPollIndex++;
+		auto deleter = [](EventPollNode *node)
+		{
+			delete node;
+		};
+		Result = Node(new EventPollNode(new EventPoll, index), deleter);
+		debug("Created epoll instance %ld", (long)index);
+		return 0;
+	}
+
+	EventPoll *EventPoll::FromNode(Node &node)
+	{
+		if (node == nullptr || node->fsi != GetEventPollFileSystem())
+			return nullptr;
+
+		return ((EventPollInode *)node->inode)->Owner;
+	}
+
+	void EventPoll::Release(FileDescriptorTable::Fildes *Description)
+	{
+		std::vector<Item *> items;
+		{
+			SmartLock(EpollWatchLock);
+			for (Item *item : Description->EventPollItems)
+			{
+				/* Owners can't be destroyed while the watch lock is held */
+				EventPoll *ep = item->Owner;
+				SmartLock(ep->EpollLock);
+				auto it = ep->Items.find(item->Descriptor);
+				if (it != ep->Items.end() && it->second == item)
+					ep->Items.erase(it);
+				item->Removed = true;
+				item->Description = nullptr;
+				if (item->Ready)
+				{
+					ep->ReadyList.erase(item->ReadyEntry);
+					item->Ready = false;
+				}
+				items.push_back(item);
+			}
+			Description->EventPollItems.clear();
+		}
+
+		/* Dropping the last item may destroy a nested instance */
+		for (Item *item : items)
+			Put(item);
+	}
+
+	EventPoll::~EventPoll()
+	{
+		std::vector<Item *> items;
+		{
+			SmartLock(EpollWatchLock);
+			{
+				SmartLock(EpollLock);
+				for (auto &it : Items)
+				{
+					Unwatch(it.second);
+					it.second->Removed = true;
+					items.push_back(it.second);
+				}
+				Items.clear();
+				ReadyList.clear();
+			}
+		}
+
+		for (Item *item : items)
+			Put(item);
+	}
+}
@@ -0,0 +1,709 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fs/pipe.hpp>
+
+#include <memory.hpp>
+#include <signal.hpp>
+#include <task.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+using namespace Tasking;
+
+namespace vfs
+{
+	static ssize_t PipeRead(struct Inode *Node, void *Buffer, size_t Size, off_t)
+	{
+		if ((Node->Flags & O_ACCMODE) != O_RDONLY)
+			return -EBADF;
+
+		Pipe *pipe = ((Pipe::PipeInode *)Node)->Owner;
+		return pipe->Read(Buffer, Size, Node->Flags & O_NONBLOCK);
+	}
+
+	static ssize_t PipeWrite(struct Inode *Node, const void *Buffer, size_t Size, off_t)
+	{
+		if ((Node->Flags & O_ACCMODE) != O_WRONLY)
+			return -EBADF;
+
+		Pipe *pipe = ((Pipe::PipeInode *)Node)->Owner;
+		return pipe->Write(Buffer, Size, Node->Flags & O_NONBLOCK);
+	}
+
+	static off_t PipeSeek(struct Inode *, off_t)
+	{
+		return -ESPIPE;
+	}
+
+	static int PipePoll(struct Inode *Node, struct PollTable *Table)
+	{
+		Pipe *pipe = ((Pipe::PipeInode *)Node)->Owner;
+		return pipe->Poll((Node->Flags & O_ACCMODE) == O_WRONLY, Table);
+	}
+
+	static int PipeStat(struct Inode *Node, struct kstat *Stat)
+	{
+		Pipe *pipe = ((Pipe::PipeInode *)Node)->Owner;
+
+		*Stat = {};
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		Stat->Size = pipe->Available();
+		Stat->BlockSize = PAGE_SIZE;
+		return 0;
+	}
+
+	static FileSystemInfo *GetPipeFileSystem()
+	{
+		static FileSystemInfo *fsi = nullptr;
+		if (likely(fsi))
+			return fsi;
+
+		fsi = new FileSystemInfo{};
+		fsi->Name = "pipefs";
+		fsi->Ops.Read = PipeRead;
+		fsi->Ops.Write = PipeWrite;
+		fsi->Ops.Seek = PipeSeek;
+		fsi->Ops.Stat = PipeStat;
+		fsi->Ops.Poll = PipePoll;
+		return fsi;
+	}
+
+	static std::atomic<ino_t> NextPipeIndex = 1;
+
+	/**
+	 * One end of a pipe. Fildes copies made by fork and dup
+	 * share the node, so the end is closed when the last
+	 * reference to it is dropped.
+	 */
+	class PipeNode : public NodeCache
+	{
+	public:
+		Pipe::PipeInode End;
+
+		PipeNode(Pipe *Owner, ino_t Index, int Flags)
+		{
+			End.Owner = Owner;
+			End.Node.Index = Index;
+			End.Node.Mode = S_IFIFO | S_IRUSR | S_IWUSR;
+			End.Node.Flags = Flags;
+
+			this->inode = &End.Node;
+			this->fsi = GetPipeFileSystem();
+			this->Flags.raw = 0;
+
+			char name[32];
+			snprintf(name, sizeof(name), "pipe:[%ld]", (long)Index);
+			this->Name = std::string(name);
+			this->Path = this->Name;
+		}
+
+		~PipeNode()
+		{
+			End.Owner->Release((End.Node.Flags & O_ACCMODE) == O_WRONLY);
+		}
+	};
+
+	Pipe::PipePage *Pipe::AllocatePage()
+	{
+		PipePage *page = new PipePage;
+		page->Data = (uint8_t *)KernelAllocator.RequestPages(1);
+		return page;
+	}
+
+	void Pipe::ReleasePage(PipePage *Page)
+	{
+		if (--Page->References > 0)
+			return;
+
+		KernelAllocator.FreePages(Page->Data, 1);
+		delete Page;
+	}
+
+	size_t Pipe::TailRoom()
+	{
+		if (Count == 0)
+			return 0;
+
+		/* Shared pages are read-only */
+		PipeBuffer &tail = Slot(Count - 1);
+		if (tail.Page->References != 1)
+			return 0;
+
+		return PAGE_SIZE - (tail.Offset + tail.Length);
+	}
+
+	void Pipe::WakeAll(WaitQueue &Queue, int Events)
+	{
+		Queue.Wake(Events);
+		PollQueue.Wake(Events);
+	}
+
+	int Pipe::Wait(WaitQueue &Queue, Pipe *Other)
+	{
+		/* Registered before unlocking, so a wakeup in between isn't lost */
+		PollWaiter waiter;
+		waiter.Arm();
+		waiter.Table.Wait(Queue);
+
+		if (Other)
+			Other->PipeLock.Unlock();
+		PipeLock.Unlock();
+
+		int ret = waiter.Sleep(0);
+		waiter.Table.Clear();
+
+		LockPair(this, Other);
+		return ret;
+	}
+
+	void Pipe::LockPair(Pipe *First, Pipe *Second)
+	{
+		if (Second == nullptr)
+		{
+			First->PipeLock.Lock(__FUNCTION__);
+			return;
+		}
+
+		/* Always lock in address order to avoid deadlocks */
+		if (First > Second)
+			std::swap(First, Second);
+
+		First->PipeLock.Lock(__FUNCTION__);
+		Second->PipeLock.Lock(__FUNCTION__);
+	}
+
+	void Pipe::UnlockPair(Pipe *First, Pipe *Second)
+	{
+		First->PipeLock.Unlock();
+		Second->PipeLock.Unlock();
+	}
+
+	int Pipe::WaitPair(Pipe *In, Pipe *Out, bool NonBlock)
+	{
+		while (true)
+		{
+			if (Out->Readers == 0)
+				return -EPIPE;
+
+			if (In->Bytes == 0)
+			{
+				if (In->Writers == 0)
+					return 0;
+				if (NonBlock)
+					return -EAGAIN;
+
+				int ret = In->Wait(In->ReadQueue, Out);
+				if (ret < 0)
+					return ret;
+				continue;
+			}
+
+			if (Out->Count == Out->Slots)
+			{
+				if (NonBlock)
+					return -EAGAIN;
+
+				int ret = Out->Wait(Out->WriteQueue, In);
+				if (ret < 0)
+					return ret;
+				continue;
+			}
+
+			return 1;
+		}
+	}
+
+	void Pipe::PopHead(bool Release)
+	{
+		PipeBuffer &head = Slot(0);
+		PipePage *page = head.Page;
+		head = {};
+		Head = (Head + 1) & (Slots - 1);
+		Count--;
+
+		if (!Release)
+			return;
+
+		/* Keep one page around, most pipes hold a few bytes at a time */
+		if (Spare == nullptr && page->References == 1)
+		{
+			Spare = page;
+			return;
+		}
+
+		ReleasePage(page);
+	}
+
+	void Pipe::PushPage(PipePage *Page, size_t Offset, size_t Length)
+	{
+		Slot(Count) = {Page, Offset, Length};
+		Count++;
+		Bytes += Length;
+	}
+
+	void Pipe::Consume(size_t Length)
+	{
+		PipeBuffer &head = Slot(0);
+		head.Offset += Length;
+		head.Length -= Length;
+		Bytes -= Length;
+
+		if (head.Length == 0)
+			PopHead(true);
+	}
+
+	size_t Pipe::Fill(const uint8_t *Buffer, size_t Size)
+	{
+		size_t done = 0;
+
+		size_t room = TailRoom();
+		if (room)
+		{
+			PipeBuffer &tail = Slot(Count - 1);
+			size_t n = std::min(room, Size);
+			memcpy(tail.Page->Data + tail.Offset + tail.Length, Buffer, n);
+			tail.Length += n;
+			Bytes += n;
+			done += n;
+		}
+
+		while (done < Size && Count < Slots)
+		{
+			PipePage *page = Spare;
+			Spare = nullptr;
+			if (page == nullptr)
+				page = AllocatePage();
+
+			size_t n = std::min((size_t)PAGE_SIZE, Size - done);
+			memcpy(page->Data, Buffer + done, n);
+			PushPage(page, 0, n);
+			done += n;
+		}
+
+		return done;
+	}
+
+	ssize_t Pipe::Read(void *Buffer, size_t Size, bool NonBlock)
+	{
+		if (Size == 0)
+			return 0;
+
+		PipeLock.Lock(__FUNCTION__);
+		while (Bytes == 0)
+		{
+			if (Writers == 0)
+			{
+				PipeLock.Unlock();
+				return 0;
+			}
+
+			if (NonBlock)
+			{
+				PipeLock.Unlock();
+				return -EAGAIN;
+			}
+
+			if (Wait(ReadQueue) < 0)
+			{
+				PipeLock.Unlock();
+				return -EINTR;
+			}
+		}
+
+		uint8_t *dst = (uint8_t *)Buffer;
+		size_t done = 0;
+		while (done < Size && Count > 0)
+		{
+			PipeBuffer &head = Slot(0);
+			size_t n = std::min(Size - done, head.Length);
+			memcpy(dst + done, head.Page->Data + head.Offset, n);
+			Consume(n);
+			done += n;
+		}
+
+		WakeAll(WriteQueue, POLLOUT | POLLWRNORM);
+		PipeLock.Unlock();
+		return done;
+	}
+
+	ssize_t Pipe::Write(const void *Buffer, size_t Size, bool NonBlock)
+	{
+		if (Size == 0)
+			return 0;
+
+		const uint8_t *src = (const uint8_t *)Buffer;
+		size_t done = 0;
+
+		PipeLock.Lock(__FUNCTION__);
+		while (done < Size)
+		{
+			if (Readers == 0)
+			{
+				PipeLock.Unlock();
+				thisProcess->SendSignal(SIGPIPE);
+				return done ? done : -EPIPE;
+			}
+
+			/* Writes up to PIPE_BUF are never interleaved with other writers */
+			size_t room = Room();
+			if (room == 0 || (Size <= PIPE_BUF && room < Size))
+			{
+				if (NonBlock)
+				{
+					PipeLock.Unlock();
+					return done ? done : -EAGAIN;
+				}
+
+				if (Wait(WriteQueue) < 0)
+				{
+					PipeLock.Unlock();
+					return done ? done : -EINTR;
+				}
+				continue;
+			}
+
+			done += Fill(src + done, Size - done);
+			WakeAll(ReadQueue, POLLIN | POLLRDNORM);
+		}
+
+		PipeLock.Unlock();
+		return done;
+	}
+
+	size_t Pipe::Available()
+	{
+		SmartLock(PipeLock);
+		return Bytes;
+	}
+
+	int Pipe::Poll(bool Writer, PollTable *Table)
+	{
+		SmartLock(PipeLock);
+		PollWait(Table, PollQueue);
+
+		int mask = 0;
+		if (Writer)
+		{
+			if (Readers == 0)
+				mask |= POLLERR;
+			else if (Count < Slots)
+				mask |= POLLOUT | POLLWRNORM;
+		}
+		else
+		{
+			if (Bytes)
+				mask |= POLLIN | POLLRDNORM;
+			if (Writers == 0)
+				mask |= POLLHUP;
+		}
+		return mask;
+	}
+
+	size_t Pipe::GetSize()
+	{
+		SmartLock(PipeLock);
+		return Slots * PAGE_SIZE;
+	}
+
+	ssize_t Pipe::SetSize(size_t Size)
+	{
+		size_t pages = 1;
+		while (pages * PAGE_SIZE < Size)
+			pages <<= 1;
+
+		if (pages > PIPE_MAX_PAGES)
+			return -EPERM;
+
+		SmartLock(PipeLock);
+		if (Count > pages)
+			return -EBUSY;
+
+		PipeBuffer *ring = new PipeBuffer[pages];
+		for (size_t i = 0; i < Count; i++)
+			ring[i] = Slot(i);
+
+		delete[] Ring;
+		Ring = ring;
+		Slots = pages;
+		Head = 0;
+
+		WakeAll(WriteQueue, POLLOUT | POLLWRNORM);
+		return Slots * PAGE_SIZE;
+	}
+
+	ssize_t Pipe::Splice(Pipe *In, Pipe *Out, size_t Length, bool NonBlock)
+	{
+		if (In == Out)
+			return -EINVAL;
+
+		if (Length == 0)
+			return 0;
+
+		LockPair(In, Out);
+		int ret = WaitPair(In, Out, NonBlock);
+		if (ret <= 0)
+		{
+			UnlockPair(In, Out);
+			if (ret == -EPIPE)
+				thisProcess->SendSignal(SIGPIPE);
+			return ret;
+		}
+
+		size_t done = 0;
+		while (done < Length && In->Count > 0 && Out->Count < Out->Slots)
+		{
+			PipeBuffer &head = In->Slot(0);
+			size_t n = std::min(Length - done, head.Length);
+
+			if (n == head.Length)
+			{
+				/* The whole slot moves, the reference goes with it */
+				Out->PushPage(head.Page, head.Offset, n);
+				In->Bytes -= n;
+				In->PopHead(false);
+			}
+			else
+			{
+				head.Page->References++;
+				Out->PushPage(head.Page, head.Offset, n);
+				In->Consume(n);
+			}
+
+			done += n;
+		}
+
+		In->WakeAll(In->WriteQueue, POLLOUT | POLLWRNORM);
+		Out->WakeAll(Out->ReadQueue, POLLIN | POLLRDNORM);
+		UnlockPair(In, Out);
+		return done;
+	}
+
+	ssize_t Pipe::Tee(Pipe *In, Pipe *Out, size_t Length, bool NonBlock)
+	{
+		if (In == Out)
+			return -EINVAL;
+
+		if (Length == 0)
+			return 0;
+
+		LockPair(In, Out);
+		int ret = WaitPair(In, Out, NonBlock);
+		if (ret <= 0)
+		{
+			UnlockPair(In, Out);
+			if (ret == -EPIPE)
+				thisProcess->SendSignal(SIGPIPE);
+			return ret;
+		}
+
+		size_t done = 0;
+		for (size_t i = 0; done < Length && i < In->Count && Out->Count < Out->Slots; i++)
+		{
+			PipeBuffer &buf = In->Slot(i);
+			size_t n = std::min(Length - done, buf.Length);
+
+			buf.Page->References++;
+			Out->PushPage(buf.Page, buf.Offset, n);
+			done += n;
+		}
+
+		Out->WakeAll(Out->ReadQueue, POLLIN | POLLRDNORM);
+		UnlockPair(In, Out);
+		return done;
+	}
+
+	ssize_t Pipe::SpliceFrom(Node &File, off_t Offset, size_t Length, bool NonBlock)
+	{
+		size_t done = 0;
+		while (done < Length)
+		{
+			PipeLock.Lock(__FUNCTION__);
+			while (Readers > 0 && Count == Slots)
+			{
+				if (NonBlock || done)
+				{
+					PipeLock.Unlock();
+					return done ? done : -EAGAIN;
+				}
+
+				if (Wait(WriteQueue) < 0)
+				{
+					PipeLock.Unlock();
+					return -EINTR;
+				}
+			}
+
+			if (Readers == 0)
+			{
+				PipeLock.Unlock();
+				thisProcess->SendSignal(SIGPIPE);
+				return done ? done : -EPIPE;
+			}
+			PipeLock.Unlock();
+
+			/* The filesystem may block, read without holding the lock */
+			PipePage *page = AllocatePage();
+			size_t want = std::min((size_t)PAGE_SIZE, Length - done);
+			ssize_t ret = fs->Read(File, page->Data, want, Offset + done);
+			if (ret <= 0)
+			{
+				ReleasePage(page);
+				return done ? done : ret;
+			}
+
+			PipeLock.Lock(__FUNCTION__);
+			if (Count == Slots || Readers == 0)
+			{
+				/* Lost the slot to another writer */
+				PipeLock.Unlock();
+				ReleasePage(page);
+				continue;
+			}
+
+			PushPage(page, 0, ret);
+			WakeAll(ReadQueue, POLLIN | POLLRDNORM);
+			PipeLock.Unlock();
+
+			done += ret;
+			if ((size_t)ret < want)
+				break;
+		}
+
+		return done;
+	}
+
+	ssize_t Pipe::SpliceTo(Node &File, off_t Offset, size_t Length, bool NonBlock)
+	{
+		PipeLock.Lock(__FUNCTION__);
+		while (Bytes == 0)
+		{
+			if (Writers == 0 || NonBlock)
+			{
+				PipeLock.Unlock();
+				return Writers == 0 ? 0 : -EAGAIN;
+			}
+
+			if (Wait(ReadQueue) < 0)
+			{
+				PipeLock.Unlock();
+				return -EINTR;
+			}
+		}
+
+		size_t done = 0;
+		while (done < Length && Count > 0)
+		{
+			PipeBuffer head = Slot(0);
+			size_t n = std::min(Length - done, head.Length);
+
+			/* The extra reference keeps writers from appending to the page */
+			head.Page->References++;
+			PipeLock.Unlock();
+			ssize_t ret = fs->Write(File, head.Page->Data + head.Offset, n, Offset + done);
+			PipeLock.Lock(__FUNCTION__);
+			ReleasePage(head.Page);
+
+			if (ret <= 0)
+			{
+				WakeAll(WriteQueue, POLLOUT | POLLWRNORM);
+				PipeLock.Unlock();
+				return done ? done : ret;
+			}
+
+			/* Another reader may have consumed the slot meanwhile */
+			if (Count == 0 || Slot(0).Page != head.Page || Slot(0).Offset != head.Offset)
+				break;
+
+			Consume(ret);
+			done += ret;
+			if ((size_t)ret < n)
+				break;
+		}
+
+		WakeAll(WriteQueue, POLLOUT | POLLWRNORM);
+		PipeLock.Unlock();
+		return done;
+	}
+
+	void Pipe::Release(bool Writer)
+	{
+		PipeLock.Lock(__FUNCTION__);
+		if (Writer)
+		{
+			Writers--;
+			WakeAll(ReadQueue, POLLHUP);
+		}
+		else
+		{
+			Readers--;
+			WakeAll(WriteQueue, POLLERR);
+		}
+
+		bool last = Readers == 0 && Writers == 0;
+		PipeLock.Unlock();
+
+		if (last)
+			delete this;
+	}
+
+	int Pipe::Create(Node &ReadEnd, Node &WriteEnd, int Flags)
+	{
+		Pipe *pipe = new Pipe(PIPE_DEF_PAGES);
+		pipe->Readers = 1;
+		pipe->Writers = 1;
+
+		ino_t index = NextPipeIndex++;
+		int nonblock = Flags & O_NONBLOCK;
+		auto deleter = [](PipeNode *node)
+		{
+			delete node;
+		};
+		ReadEnd = Node(new PipeNode(pipe, index, O_RDONLY | nonblock), deleter);
+		WriteEnd = Node(new PipeNode(pipe, index, O_WRONLY | nonblock), deleter);
+		debug("Created pipe %ld", (long)index);
+		return 0;
+	}
+
+	Pipe *Pipe::FromNode(Node &node)
+	{
+		if (node == nullptr || node->fsi != GetPipeFileSystem())
+			return nullptr;
+
+		return ((PipeInode *)node->inode)->Owner;
+	}
+
+	Pipe::Pipe(size_t Pages)
+	{
+		Ring = new PipeBuffer[Pages];
+		Slots = Pages;
+	}
+
+	Pipe::~Pipe()
+	{
+		while (Count > 0)
+			PopHead(true);
+
+		if (Spare)
+			ReleasePage(Spare);
+
+		delete[] Ring;
+	}
+}
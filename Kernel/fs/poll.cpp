@@ -0,0 +1,166 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fs/poll.hpp>
+
+#include <signal.hpp>
+#include <task.hpp>
+#include <time.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+using namespace Tasking;
+
+namespace vfs
+{
+	void WaitQueue::Add(PollEntry *Entry)
+	{
+		SmartLock(QueueLock);
+		Entry->Queue = this;
+		Entries.push_back(Entry);
+	}
+
+	void WaitQueue::Remove(PollEntry *Entry)
+	{
+		SmartLock(QueueLock);
+		Entries.remove(Entry);
+		Entry->Queue = nullptr;
+	}
+
+	void WaitQueue::Wake(int Events)
+	{
+		SmartLock(QueueLock);
+		for (PollEntry *entry : Entries)
+			entry->Callback(entry, Events);
+	}
+
+	WaitQueue::~WaitQueue()
+	{
+		SmartLock(QueueLock);
+		for (PollEntry *entry : Entries)
+			entry->Queue = nullptr;
+	}
+}
+
+void PollTable::Wait(vfs::WaitQueue &Queue)
+{
+	vfs::PollEntry *entry = new vfs::PollEntry;
+	entry->Callback = Callback;
+	entry->Private = Private;
+	Entries.push_back(entry);
+	Queue.Add(entry);
+}
+
+void PollTable::Clear()
+{
+	for (vfs::PollEntry *entry : Entries)
+	{
+		if (entry->Queue)
+			entry->Queue->Remove(entry);
+		delete entry;
+	}
+	Entries.clear();
+}
+
+namespace vfs
+{
+	void PollWaiter::Callback(PollEntry *Entry, int Events)
+	{
+		PollWaiter *waiter = (PollWaiter *)Entry->Private;
+		waiter->Triggered.store(true);
+		waiter->Thread->Unblock();
+	}
+
+	int PollWaiter::Sleep(uint64_t Deadline)
+	{
+		if (Thread->Parent->Signals.HasPendingSignal())
+			return -EINTR;
+
+		if (Deadline)
+		{
+			uint64_t now = TimeManager->GetTimeNs();
+			if (now >= Deadline)
+				return -ETIMEDOUT;
+
+			TaskManager->Sleep(Deadline - now, true);
+		}
+		else
+			Thread->Block();
+
+		/* A callback may have run before we went to sleep */
+		if (Triggered.load())
+			Thread->Unblock();
+
+		TaskManager->Yield();
+		return 0;
+	}
+
+	PollWaiter::PollWaiter()
+	{
+		Thread = thisThread;
+		Table.Callback = Callback;
+		Table.Private = this;
+	}
+
+	int PollNodes(PollRequest *Requests, size_t Count, int64_t Timeout)
+	{
+		PollWaiter waiter;
+
+		uint64_t deadline = 0;
+		if (Timeout > 0)
+			deadline = TimeManager->GetTimeNs() + Timeout;
+
+		/* Register on the first pass only, the entries stay until we return */
+		PollTable *pt = Timeout == 0 ? nullptr : &waiter.Table;
+		while (true)
+		{
+			waiter.Arm();
+
+			int ready = 0;
+			for (size_t i = 0; i < Count; i++)
+			{
+				PollRequest &req = Requests[i];
+				if (req.node == nullptr)
+				{
+					req.Revents = POLLNVAL;
+					ready++;
+					continue;
+				}
+
+				int mask = fs->Poll(req.node, pt);
+				if (mask < 0)
+					mask = POLLERR;
+
+				/* Errors and hangups are reported even if not requested */
+				req.Revents = mask & (req.Events | POLLERR | POLLHUP);
+				if (req.Revents)
+					ready++;
+			}
+			pt = nullptr;
+
+			if (ready || Timeout == 0)
+				return ready;
+
+			int ret = waiter.Sleep(deadline);
+			if (ret == -ETIMEDOUT)
+				return 0;
+			if (ret < 0)
+				return ret;
+		}
+	}
+}
@@ -24,6 +24,207 @@
 
 namespace vfs
 {
+	/* Pages covered by one slot of a node at Level, leaves are level 1 */
+	static inline size_t SlotSpan(int Level)
+	{
+		return (size_t)1 << (RAMFS_RADIX_SHIFT * (Level - 1));
+	}
+
+	static inline size_t SlotIndex(size_t Index, int Level)
+	{
+		return (Index >> (RAMFS_RADIX_SHIFT * (Level - 1))) & (RAMFS_RADIX_SIZE - 1);
+	}
+
+	static inline bool TreeCovers(int Height, size_t Index)
+	{
+		size_t bits = (size_t)Height * RAMFS_RADIX_SHIFT;
+		return bits >= sizeof(size_t) * 8 || (Index >> bits) == 0;
+	}
+
+	static void **AllocateTreeNode()
+	{
+		static_assert(RAMFS_RADIX_SIZE * sizeof(void *) == PAGE_SIZE);
+
+		void **node = (void **)KernelAllocator.RequestPages(1);
+		if (node)
+			memset(node, 0, PAGE_SIZE);
+		return node;
+	}
+
+	/* Level 0 is a data page */
+	void RAMFS::PageTree::FreeNode(void **Node, int Level)
+	{
+		if (Level > 0)
+		{
+			for (size_t i = 0; i < RAMFS_RADIX_SIZE; i++)
+			{
+				if (Node[i])
+					FreeNode((void **)Node[i], Level - 1);
+			}
+		}
+		else
+			Pages--;
+
+		KernelAllocator.FreePages(Node, 1);
+	}
+
+	bool RAMFS::PageTree::Prune(void **Node, int Level, size_t Base, size_t First)
+	{
+		bool empty = true;
+		for (size_t i = 0; i < RAMFS_RADIX_SIZE; i++)
+		{
+			if (Node[i] == nullptr)
+				continue;
+
+			size_t base = Base + i * SlotSpan(Level);
+			if (base >= First)
+			{
+				FreeNode((void **)Node[i], Level - 1);
+				Node[i] = nullptr;
+				continue;
+			}
+
+			/* The slot straddles the new end */
+			if (Level > 1 && base + SlotSpan(Level) > First &&
+				Prune((void **)Node[i], Level - 1, base, First))
+			{
+				KernelAllocator.FreePages(Node[i], 1);
+				Node[i] = nullptr;
+				continue;
+			}
+
+			empty = false;
+		}
+		return empty;
+	}
+
+	void *RAMFS::PageTree::Lookup(size_t Index)
+	{
+		if (Root == nullptr || !TreeCovers(Height, Index))
+			return nullptr;
+
+		void **node = Root;
+		for (int level = Height; level > 0; level--)
+		{
+			node = (void **)node[SlotIndex(Index, level)];
+			if (node == nullptr)
+				return nullptr;
+		}
+		return node;
+	}
+
+	void *RAMFS::PageTree::Get(size_t Index)
+	{
+		/* Only as tall as Index needs, a one page file has no tree node */
+		if (Root == nullptr)
+		{
+			Height = 0;
+			while (!TreeCovers(Height, Index))
+				Height++;
+
+			Root = AllocateTreeNode();
+			if (Root == nullptr)
+				return nullptr;
+			if (Height == 0)
+			{
+				Pages++;
+				return Root;
+			}
+		}
+
+		/* Grow from the top, the old tree becomes slot 0 */
+		while (!TreeCovers(Height, Index))
+		{
+			void **node = AllocateTreeNode();
+			if (node == nullptr)
+				return nullptr;
+			node[0] = Root;
+			Root = node;
+			Height++;
+		}
+
+		if (Height == 0)
+			return Root;
+
+		void **node = Root;
+		for (int level = Height; level > 1; level--)
+		{
+			size_t slot = SlotIndex(Index, level);
+			if (node[slot] == nullptr)
+			{
+				node[slot] = AllocateTreeNode();
+				if (node[slot] == nullptr)
+					return nullptr;
+			}
+			node = (void **)node[slot];
+		}
+
+		size_t slot = SlotIndex(Index, 1);
+		if (node[slot] == nullptr)
+		{
+			void *page = KernelAllocator.RequestPages(1);
+			if (page == nullptr)
+				return nullptr;
+			memset(page, 0, PAGE_SIZE);
+			node[slot] = page;
+			Pages++;
+		}
+		return node[slot];
+	}
+
+	void RAMFS::PageTree::Truncate(size_t Size)
+	{
+		size_t first = (Size + PAGE_SIZE - 1) / PAGE_SIZE;
+		if (first == 0)
+		{
+			Free();
+			return;
+		}
+
+		if (Root && Height > 0 && Prune(Root, Height, 0, first))
+		{
+			KernelAllocator.FreePages(Root, 1);
+			Root = nullptr;
+			Height = 0;
+		}
+
+		/* Drop the levels that only lead to slot 0 now */
+		while (Root && Height > 0 && first <= SlotSpan(Height))
+		{
+			void **child = (void **)Root[0];
+			KernelAllocator.FreePages(Root, 1);
+			Root = child;
+			Height--;
+		}
+
+		/* Bytes past the end must read as zeros if the file grows again */
+		size_t tail = Size % PAGE_SIZE;
+		if (tail == 0)
+			return;
+
+		uint8_t *page = (uint8_t *)Lookup(Size / PAGE_SIZE);
+		if (page)
+			memset(page + tail, 0, PAGE_SIZE - tail);
+	}
+
+	void RAMFS::PageTree::Free()
+	{
+		if (Root)
+			FreeNode(Root, Height);
+		Root = nullptr;
+		Height = 0;
+		Pages = 0;
+	}
+
+	RAMFS::RAMFSInode *RAMFS::Find(ino_t Index)
+	{
+		SmartReadLock(FilesLock);
+		auto it = Files.find(Index);
+		if (it == Files.end())
+			return nullptr;
+		return it->second;
+	}
+
 	int RAMFS::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
 	{
 		auto Parent = (RAMFSInode *)_Parent;
@@ -35,8 +236,7 @@ namespace vfs
 		{
 			if (strcmp(Name, RootName.c_str()) == 0)
 			{
-				auto &it = Files.at(0);
-				*Result = &it->Node;
+				*Result = &Find(0)->Node;
 				return 0;
 			}
 
@@ -58,6 +258,7 @@ namespace vfs
 			return -ENOENT;
 		}
 
+		SmartReadLock(FilesLock);
 		for (auto &&i : Files)
 		{
 			RAMFSInode *node = i.second;
@@ -74,6 +275,7 @@ namespace vfs
 	{
 		RAMFSInode *Parent = (RAMFSInode *)_Parent;
 
+		SmartWriteLock(FilesLock);
 		Inode inode{};
 		inode.Mode = Mode;
 		inode.Device = this->DeviceID;
@@ -100,12 +302,53 @@ namespace vfs
 		return 0;
 	}
 
-	ssize_t RAMFS::Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+	int RAMFS::Remove(struct Inode *_Parent, const char *Name)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
+		RAMFSInode *Parent = (RAMFSInode *)_Parent;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(Name, &basename, &length);
+		if (basename == NULL)
+			return -EINVAL;
+
+		for (auto &&child : Parent->Children)
+		{
+			if (child->Name.size() != length || strncmp(child->Name.c_str(), basename, length) != 0)
+				continue;
+
+			if (!child->Children.empty())
+				return -ENOTEMPTY;
+
+			/* Open files keep working until the VFS deletes the inode */
+			Parent->RemoveChild(child);
+			return 0;
+		}
 
-		RAMFSInode *node = fileItr->second;
+		return -ENOENT;
+	}
+
+	int RAMFS::DeleteInode(struct Inode *Node)
+	{
+		RAMFSInode *node;
+		{
+			SmartWriteLock(FilesLock);
+			auto it = Files.find(Node->Index);
+			if (it == Files.end())
+				return -ENOENT;
+			node = it->second;
+			Files.erase(it);
+		}
+
+		assert(node->Parent == nullptr);
+		delete node;
+		return 0;
+	}
+
+	ssize_t RAMFS::Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
 		size_t fileSize = node->Stat.Size;
 
 		if (Size <= 0)
@@ -130,23 +373,31 @@ namespace vfs
 		{
 			debug("Offset %d + Size %d is greater than file size %d",
 				  Offset, Size, fileSize);
-			Size = fileSize;
+			Size = fileSize - Offset;
 		}
 
-		memcpy(Buffer, node->Buffer.Data, Size);
+		uint8_t *out = (uint8_t *)Buffer;
+		size_t done = 0;
+		while (done < Size)
+		{
+			size_t position = Offset + done;
+			size_t offset = position % PAGE_SIZE;
+			size_t chunk = std::min(PAGE_SIZE - offset, Size - done);
+
+			uint8_t *page = (uint8_t *)node->Pages.Lookup(position / PAGE_SIZE);
+			if (page)
+				memcpy(out + done, page + offset, chunk);
+			else
+				memset(out + done, 0, chunk);
+			done += chunk;
+		}
 		return Size;
 	}
 
 	ssize_t RAMFS::Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
-
-		RAMFSInode *node = fileItr->second;
-
-		if (node->Buffer.IsAllocated() == false)
-			node->Buffer.Allocate(node->Stat.Size);
-
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
 		size_t fileSize = node->Stat.Size;
 
 		if (Size <= 0)
@@ -155,28 +406,49 @@ namespace vfs
 			return -EINVAL;
 		}
 
-		if ((size_t)Offset > fileSize)
+		/* Pages of a hole are only allocated once written to */
+		const uint8_t *in = (const uint8_t *)Buffer;
+		size_t done = 0;
+		while (done < Size)
 		{
-			debug("Offset %d is greater than file size %d", Offset, fileSize);
-			node->Buffer.Allocate(Offset + Size, true, true);
-		}
+			size_t position = Offset + done;
+			size_t offset = position % PAGE_SIZE;
+			size_t chunk = std::min(PAGE_SIZE - offset, Size - done);
 
-		if ((fileSize - Offset) == 0)
-		{
-			debug("Offset %d is equal to file size %d", Offset, fileSize);
-			node->Buffer.Allocate(Size, true, true);
+			uint8_t *page = (uint8_t *)node->Pages.Get(position / PAGE_SIZE);
+			if (page == nullptr)
+				break;
+			memcpy(page + offset, in + done, chunk);
+			done += chunk;
 		}
 
-		if ((size_t)Offset + Size > fileSize)
-		{
-			debug("Offset %d + Size %d is greater than file size %d",
-				  Offset, Size, fileSize);
-			node->Buffer.Allocate(Offset + Size, true, true);
-		}
+		if (done == 0)
+			return -ENOSPC;
+
+		size_t end = (size_t)Offset + done;
+		if (end > fileSize)
+			node->Stat.Size = end;
+		node->Stat.BlockSize = PAGE_SIZE;
+		node->Stat.Blocks = node->Pages.Count() * (PAGE_SIZE / 512);
+		return done;
+	}
+
+	int RAMFS::Truncate(struct Inode *Node, off_t Size)
+	{
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
+		if (S_ISDIR(node->Node.Mode))
+			return -EISDIR;
+		if (Size < 0)
+			return -EINVAL;
+
+		/* Growing only moves the end, the new range is a hole */
+		if ((size_t)Size < (size_t)node->Stat.Size)
+			node->Pages.Truncate(Size);
 
-		memcpy(static_cast<char *>(node->Buffer.Data) + Offset, Buffer, Size);
 		node->Stat.Size = Size;
-		return Size;
+		node->Stat.Blocks = node->Pages.Count() * (PAGE_SIZE / 512);
+		return 0;
 	}
 
 	__no_sanitize("alignment")
@@ -304,10 +576,8 @@ namespace vfs
 
 	ssize_t RAMFS::ReadLink(struct Inode *Node, char *Buffer, size_t Size)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
-
-		RAMFSInode *node = fileItr->second;
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
 
 		if (node->SymLink.size() > Size)
 			Size = node->SymLink.size();
@@ -319,13 +589,23 @@ namespace vfs
 
 	int RAMFS::Stat(struct Inode *Node, struct kstat *Stat)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
-
-		RAMFSInode *node = fileItr->second;
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
 		*Stat = node->Stat;
 		return 0;
 	}
+
+	void *RAMFS::GetPage(struct Inode *Node, size_t Index, bool Allocate)
+	{
+		RAMFSInode *node = Find(Node->Index);
+		assert(node != nullptr);
+		if (!Allocate)
+			return node->Pages.Lookup(Index);
+
+		void *page = node->Pages.Get(Index);
+		node->Stat.Blocks = node->Pages.Count() * (PAGE_SIZE / 512);
+		return page;
+	}
 }
 
 int __ramfs_Lookup(struct Inode *Parent, const char *Name, struct Inode **Result)
@@ -338,6 +618,11 @@ int __ramfs_Create(struct Inode *Parent, const char *Name, mode_t Mode, struct I
 	return ((vfs::RAMFS *)Parent->PrivateData)->Create(Parent, Name, Mode, Result);
 }
 
+int __ramfs_Remove(struct Inode *Parent, const char *Name)
+{
+	return ((vfs::RAMFS *)Parent->PrivateData)->Remove(Parent, Name);
+}
+
 ssize_t __ramfs_Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
 {
 	return ((vfs::RAMFS *)Node->PrivateData)->Read(Node, Buffer, Size, Offset);
@@ -348,6 +633,11 @@ ssize_t __ramfs_Write(struct Inode *Node, const void *Buffer, size_t Size, off_t
 	return ((vfs::RAMFS *)Node->PrivateData)->Write(Node, Buffer, Size, Offset);
 }
 
+int __ramfs_Truncate(struct Inode *Node, off_t Size)
+{
+	return ((vfs::RAMFS *)Node->PrivateData)->Truncate(Node, Size);
+}
+
 ssize_t __ramfs_Readdir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
 {
 	return ((vfs::RAMFS *)Node->PrivateData)->ReadDir(Node, Buffer, Size, Offset, Entries);
@@ -370,9 +660,7 @@ int __ramfs_Stat(struct Inode *Node, kstat *Stat)
 
 int __ramfs_DestroyInode(FileSystemInfo *Info, Inode *Node)
 {
-	vfs::RAMFS::RAMFSInode *inode = (vfs::RAMFS::RAMFSInode *)Node;
-	delete inode;
-	return 0;
+	return ((vfs::RAMFS *)Node->PrivateData)->DeleteInode(Node);
 }
 
 int __ramfs_Destroy(FileSystemInfo *fsi)
@@ -383,30 +671,51 @@ int __ramfs_Destroy(FileSystemInfo *fsi)
 	return 0;
 }
 
-bool MountAndRootRAMFS(Node Parent, const char *Name, size_t Index)
+static vfs::RAMFS *CreateRAMFS(const char *FSName, const char *Name, FileSystemInfo **Info, Inode **Root)
 {
 	vfs::RAMFS *ramfs = new vfs::RAMFS;
 	ramfs->RootName.assign(Name);
 
-	FileSystemInfo *fsi = new FileSystemInfo;
-	fsi->Name = "ramfs";
+	FileSystemInfo *fsi = new FileSystemInfo{};
+	fsi->Name = FSName;
+	fsi->Flags = FS_NEGATIVE_CACHE;
 	fsi->SuperOps.DeleteInode = __ramfs_DestroyInode;
 	fsi->SuperOps.Destroy = __ramfs_Destroy;
 	fsi->Ops.Lookup = __ramfs_Lookup;
 	fsi->Ops.Create = __ramfs_Create;
+	fsi->Ops.Remove = __ramfs_Remove;
 	fsi->Ops.Read = __ramfs_Read;
 	fsi->Ops.Write = __ramfs_Write;
+	fsi->Ops.Truncate = __ramfs_Truncate;
 	fsi->Ops.ReadDir = __ramfs_Readdir;
 	fsi->Ops.SymLink = __ramfs_SymLink;
 	fsi->Ops.ReadLink = __ramfs_ReadLink;
 	fsi->Ops.Stat = __ramfs_Stat;
+	fsi->Ops.Poll = nullptr;
 	fsi->PrivateData = ramfs;
 	ramfs->DeviceID = fs->RegisterFileSystem(fsi);
 
+	ramfs->Create(nullptr, Name, S_IFDIR | 0755, Root);
+	*Info = fsi;
+	return ramfs;
+}
+
+bool MountAndRootRAMFS(Node Parent, const char *Name, size_t Index)
+{
+	FileSystemInfo *fsi = nullptr;
 	Inode *root = nullptr;
-	ramfs->Create(nullptr, Name, S_IFDIR | 0755, &root);
+	CreateRAMFS("ramfs", Name, &fsi, &root);
 
 	fs->Mount(Parent, root, Name, fsi);
 	fs->AddRoot(Index, fs->Convert(root));
 	return true;
 }
+
+eNode MountTMPFS(Node Parent, const char *Name)
+{
+	FileSystemInfo *fsi = nullptr;
+	Inode *root = nullptr;
+	CreateRAMFS("tmpfs", Name, &fsi, &root);
+
+	return fs->Mount(Parent, root, Name, fsi);
+}
@@ -0,0 +1,1134 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <fs/uring.hpp>
+
+#include <memory.hpp>
+#include <task.hpp>
+#include <time.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+using namespace Tasking;
+
+/* Field offsets inside the rings mapping, head and tail get their own cache line */
+#define RING_HEAD 0
+#define RING_TAIL 64
+#define RING_MASK 128
+#define RING_ENTRIES 132
+#define RING_FLAGS 136
+#define RING_DROPPED 140
+#define RING_ARRAY 192
+
+#define URING_AT_FDCWD -100
+
+namespace
+{
+	/* Requests ready to run, shared by all rings */
+	NewLock(PoolLock);
+	std::list<vfs::IoUring::Request *> PoolQueue;
+	std::list<TCB *> IdleWorkers;
+	bool PoolStarted = false;
+
+	/* Rings waiting for their SQ polling thread to pick them up */
+	NewLock(SqStartLock);
+	std::list<vfs::IoUring *> SqStartQueue;
+
+	/* Every ring, so a destroyed process can be detached from its own */
+	NewLock(RingsLock);
+	std::list<vfs::IoUring *> AllRings;
+
+	inline uint32_t LoadAcquire(uint32_t *Value)
+	{
+		return __atomic_load_n(Value, __ATOMIC_ACQUIRE);
+	}
+
+	inline void StoreRelease(uint32_t *Value, uint32_t New)
+	{
+		__atomic_store_n(Value, New, __ATOMIC_RELEASE);
+	}
+
+	bool IsAlive(PCB *pcb)
+	{
+		TaskState state = pcb->State.load();
+		return state != TaskState::Terminated &&
+			   state != TaskState::Zombie &&
+			   state != TaskState::CoreDump;
+	}
+}
+
+namespace vfs
+{
+	static int IoUringPoll(struct Inode *Node, struct PollTable *Table)
+	{
+		IoUring *ring = ((IoUring::IoUringInode *)Node)->Owner;
+		return ring->Poll(Table);
+	}
+
+	static int IoUringStat(struct Inode *Node, struct kstat *Stat)
+	{
+		*Stat = {};
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		return 0;
+	}
+
+	static FileSystemInfo *GetIoUringFileSystem()
+	{
+		static FileSystemInfo *fsi = nullptr;
+		if (likely(fsi))
+			return fsi;
+
+		fsi = new FileSystemInfo{};
+		fsi->Name = "io_uring";
+		fsi->Ops.Stat = IoUringStat;
+		fsi->Ops.Poll = IoUringPoll;
+		return fsi;
+	}
+
+	static std::atomic<ino_t> NextIoUringIndex = 1;
+
+	class IoUringNode : public NodeCache
+	{
+	public:
+		IoUring::IoUringInode Instance;
+
+		IoUringNode(IoUring *Owner, ino_t Index)
+		{
+			Instance.Owner = Owner;
+			Instance.Node.Index = Index;
+			Instance.Node.Mode = S_IRUSR | S_IWUSR;
+
+			this->inode = &Instance.Node;
+			this->fsi = GetIoUringFileSystem();
+			this->Flags.raw = 0;
+			this->Name = std::string("anon_inode:[io_uring]");
+			this->Path = this->Name;
+		}
+
+		~IoUringNode()
+		{
+			Instance.Owner->Release();
+		}
+	};
+
+	void IoUring::WorkerEntry()
+	{
+		TCB *tcb = thisThread;
+		while (true)
+		{
+			PoolLock.Lock(__FUNCTION__);
+			while (PoolQueue.empty())
+			{
+				IdleWorkers.push_back(tcb);
+				tcb->Block();
+				PoolLock.Unlock();
+				TaskManager->Yield();
+				PoolLock.Lock(__FUNCTION__);
+				IdleWorkers.remove(tcb);
+			}
+
+			Request *req = PoolQueue.front();
+			PoolQueue.pop_front();
+
+			/* Counted before the lock is dropped, so Release()
+			   either cancels it or waits for it */
+			IoUring *ring = req->Ring;
+			ring->References++;
+			ring->Running++;
+			PoolLock.Unlock();
+
+			ring->Execute(req);
+			ring->Running--;
+			ring->Put();
+		}
+	}
+
+	void IoUring::Queue(Request *req)
+	{
+		SmartLock(PoolLock);
+		PoolQueue.push_back(req);
+		if (!IdleWorkers.empty())
+		{
+			IdleWorkers.front()->Unblock();
+			IdleWorkers.pop_front();
+		}
+	}
+
+	PCB *IoUring::PinOwner()
+	{
+		SmartCriticalSection(OwnerLock);
+		PCB *pcb = Owner;
+		if (pcb == nullptr)
+			return nullptr;
+
+		/* Held before the state is checked, the scheduler
+		   checks them the other way around */
+		pcb->Holds++;
+		if (!IsAlive(pcb))
+		{
+			pcb->Holds--;
+			return nullptr;
+		}
+		return pcb;
+	}
+
+	void IoUring::UnpinOwner(PCB *pcb)
+	{
+		pcb->Holds--;
+	}
+
+	void IoUring::DetachOwner(PCB *Owner)
+	{
+		SmartCriticalSection(RingsLock);
+		for (IoUring *ring : AllRings)
+		{
+			if (ring->Owner != Owner)
+				continue;
+
+			SmartCriticalSection(ring->OwnerLock);
+			ring->Owner = nullptr;
+		}
+	}
+
+	int IoUring::CopyUser(void *User, void *Kernel, size_t Length, bool ToUser)
+	{
+		if (Closing.load())
+			return -ECANCELED;
+
+		PCB *pcb = PinOwner();
+		if (pcb == nullptr)
+			return -ECANCELED;
+
+		int ret;
+		if (ToUser)
+			ret = pcb->vma->CopyToUser(User, Kernel, Length);
+		else
+			ret = pcb->vma->CopyFromUser(Kernel, User, Length);
+		UnpinOwner(pcb);
+		return ret;
+	}
+
+	uint32_t IoUring::SqPending()
+	{
+		return LoadAcquire(SqTail) - *SqHead;
+	}
+
+	uint32_t IoUring::CqReady()
+	{
+		return LoadAcquire(CqTail) - LoadAcquire(CqHead);
+	}
+
+	void IoUring::FlushOverflow()
+	{
+		uint32_t tail = *CqTail;
+		uint32_t head = LoadAcquire(CqHead);
+		while (!Overflow.empty() && tail - head < CqEntries)
+		{
+			Cqes[tail & (CqEntries - 1)] = Overflow.front();
+			Overflow.pop_front();
+			tail++;
+		}
+		StoreRelease(CqTail, tail);
+
+		if (Overflow.empty())
+			__atomic_and_fetch(SqFlags, ~(uint32_t)__SYS_IORING_SQ_CQ_OVERFLOW, __ATOMIC_RELEASE);
+	}
+
+	void IoUring::Post(uint64_t UserData, int32_t Result)
+	{
+		if (Result < 0 && ConvertResult)
+			Result = ConvertResult(Result);
+
+		{
+			SmartLock(CompletionLock);
+			if (!Overflow.empty())
+				FlushOverflow();
+
+			uint32_t tail = *CqTail;
+			if (!Overflow.empty() || tail - LoadAcquire(CqHead) >= CqEntries)
+			{
+				/* Never drop completions, keep them until there is room */
+				Overflow.push_back({UserData, Result, 0});
+				(*CqOverflow)++;
+				__atomic_or_fetch(SqFlags, (uint32_t)__SYS_IORING_SQ_CQ_OVERFLOW, __ATOMIC_RELEASE);
+			}
+			else
+			{
+				Cqes[tail & (CqEntries - 1)] = {UserData, Result, 0};
+				StoreRelease(CqTail, tail + 1);
+			}
+		}
+
+		CompletionQueue.Wake(POLLIN | POLLRDNORM);
+	}
+
+	Node IoUring::ResolveFile(const kio_uring_sqe &sqe, int &Result)
+	{
+		if (sqe.flags & __SYS_IOSQE_FIXED_FILE)
+		{
+			SmartLock(SubmitLock);
+			if (sqe.fd < 0 || (size_t)sqe.fd >= Files.size() || Files[sqe.fd] == nullptr)
+			{
+				Result = -EBADF;
+				return nullptr;
+			}
+			return Files[sqe.fd];
+		}
+
+		FileDescriptorTable::FildesReference fildes = Owner->FileDescriptors->GetFileDescriptor(sqe.fd);
+		if (fildes == nullptr)
+		{
+			Result = -EBADF;
+			return nullptr;
+		}
+		return fildes->node;
+	}
+
+	int IoUring::MapBuffer(const kio_uring_sqe &sqe, Request *req)
+	{
+		switch (sqe.opcode)
+		{
+		case __SYS_IORING_OP_READ:
+		case __SYS_IORING_OP_WRITE:
+			req->Vectors.push_back({(void *)sqe.addr, sqe.len});
+			return 0;
+		case __SYS_IORING_OP_READ_FIXED:
+		case __SYS_IORING_OP_WRITE_FIXED:
+		{
+			SmartLock(SubmitLock);
+			if (sqe.buf_index >= Buffers.size())
+				return -EFAULT;
+
+			FixedBuffer &fb = Buffers[sqe.buf_index];
+			if (sqe.addr < fb.Base || sqe.addr + sqe.len > fb.Base + fb.Length)
+				return -EFAULT;
+
+			req->Vectors.push_back({(void *)sqe.addr, sqe.len});
+			return 0;
+		}
+		case __SYS_IORING_OP_READV:
+		case __SYS_IORING_OP_WRITEV:
+		{
+			if (sqe.len > KIOV_MAX)
+				return -EINVAL;
+
+			/* Only the array is read now, the buffers when the request runs */
+			req->Vectors.resize(sqe.len);
+			return Owner->vma->CopyFromUser(req->Vectors.data(), (const void *)sqe.addr,
+											sizeof(kiovec) * sqe.len);
+		}
+		default:
+			return 0;
+		}
+	}
+
+	int IoUring::OpenAt(const kio_uring_sqe &sqe)
+	{
+		const char *path = Owner->vma->UserCheckAndGetAddress((const char *)sqe.addr);
+		if (path == nullptr)
+			return -EFAULT;
+
+		FileDescriptorTable *fdt = Owner->FileDescriptors;
+		if (!fs->PathIsRelative(path))
+			return fdt->usr_open(path, sqe.op_flags, sqe.len);
+
+		if (sqe.fd != URING_AT_FDCWD)
+			return -ENOSYS;
+
+		/* Resolve against the owner's directory, not the submitting thread's */
+		eNode ret = fs->Lookup(Owner->CWD, path);
+		if (ret == false)
+			return -ret.Error;
+
+		Node node = ret;
+		std::string absolute = node->Path;
+		return fdt->usr_open(absolute.c_str(), sqe.op_flags, sqe.len);
+	}
+
+	bool IoUring::Prepare(const kio_uring_sqe &sqe, Request *req, int *Result)
+	{
+		switch (sqe.opcode)
+		{
+		case __SYS_IORING_OP_NOP:
+			*Result = 0;
+			return false;
+		case __SYS_IORING_OP_OPENAT:
+			*Result = OpenAt(sqe);
+			return false;
+		case __SYS_IORING_OP_CLOSE:
+			*Result = Owner->FileDescriptors->usr_close(sqe.fd);
+			return false;
+		case __SYS_IORING_OP_FSYNC:
+		{
+			/* Every filesystem in the tree writes through, there is nothing to flush */
+			int ret = 0;
+			ResolveFile(sqe, ret);
+			*Result = ret;
+			return false;
+		}
+		case __SYS_IORING_OP_POLL_ADD:
+		case __SYS_IORING_OP_READ:
+		case __SYS_IORING_OP_WRITE:
+		case __SYS_IORING_OP_READ_FIXED:
+		case __SYS_IORING_OP_WRITE_FIXED:
+		case __SYS_IORING_OP_READV:
+		case __SYS_IORING_OP_WRITEV:
+			break;
+		default:
+			*Result = -EINVAL;
+			return false;
+		}
+
+		int ret = 0;
+		req->node = ResolveFile(sqe, ret);
+		if (req->node == nullptr)
+		{
+			*Result = ret;
+			return false;
+		}
+
+		ret = MapBuffer(sqe, req);
+		if (ret < 0)
+		{
+			*Result = ret;
+			return false;
+		}
+
+		req->Offset = (off_t)sqe.off;
+		req->Events = sqe.op_flags & 0xFFFF;
+
+		/* Offset -1 means the file position, which only the
+		   submitter can update in order */
+		bool positioned = sqe.opcode != __SYS_IORING_OP_POLL_ADD && req->Offset == -1;
+		if (positioned && !(sqe.flags & __SYS_IOSQE_FIXED_FILE) &&
+			req->node->fsi->Ops.Poll == nullptr)
+		{
+			FileDescriptorTable *fdt = Owner->FileDescriptors;
+			FileDescriptorTable::FildesReference fildes = fdt->GetFileDescriptor(sqe.fd);
+			if (fildes == nullptr)
+			{
+				*Result = -EBADF;
+				return false;
+			}
+			req->Offset = fildes->Offset;
+			*Result = Run(req);
+			if (*Result > 0)
+				fdt->usr_lseek(sqe.fd, *Result, SEEK_CUR);
+			return false;
+		}
+
+		if (positioned)
+			req->Offset = 0;
+		return true;
+	}
+
+	int IoUring::RequestEvents(Request *req)
+	{
+		switch (req->Opcode)
+		{
+		case __SYS_IORING_OP_POLL_ADD:
+			return req->Events;
+		case __SYS_IORING_OP_READ:
+		case __SYS_IORING_OP_READ_FIXED:
+		case __SYS_IORING_OP_READV:
+			return POLLIN | POLLRDNORM;
+		case __SYS_IORING_OP_WRITE:
+		case __SYS_IORING_OP_WRITE_FIXED:
+		case __SYS_IORING_OP_WRITEV:
+			return POLLOUT | POLLWRNORM;
+		default:
+			return 0;
+		}
+	}
+
+	int IoUring::Run(Request *req)
+	{
+		bool write = RequestEvents(req) & POLLOUT;
+		ssize_t total = 0;
+		off_t offset = req->Offset;
+
+		size_t length = 0;
+		for (const kiovec &iov : req->Vectors)
+			length += iov.iov_len;
+		if (length == 0)
+			return 0;
+
+		/* The user pages are only touched by CopyUser(), never
+		   while the filesystem may sleep */
+		size_t bounceSize = MIN(length, (size_t)IO_URING_BOUNCE_SIZE);
+		uint8_t *bounce = new uint8_t[bounceSize];
+
+		for (const kiovec &iov : req->Vectors)
+		{
+			size_t done = 0;
+			while (done < iov.iov_len)
+			{
+				uint8_t *user = (uint8_t *)iov.iov_base + done;
+				size_t count = MIN(iov.iov_len - done, bounceSize);
+				ssize_t ret;
+				if (write)
+				{
+					ret = CopyUser(user, bounce, count, false);
+					if (ret == 0)
+						ret = fs->Write(req->node, bounce, count, offset);
+				}
+				else
+				{
+					ret = fs->Read(req->node, bounce, count, offset);
+					if (ret > 0)
+					{
+						int copied = CopyUser(user, bounce, ret, true);
+						if (copied < 0)
+							ret = copied;
+					}
+				}
+
+				if (ret < 0)
+				{
+					delete[] bounce;
+					return total ? total : ret;
+				}
+
+				total += ret;
+				offset += ret;
+				done += ret;
+				if ((size_t)ret < count)
+				{
+					delete[] bounce;
+					return (int)total;
+				}
+			}
+		}
+
+		delete[] bounce;
+		return (int)total;
+	}
+
+	void IoUring::PollCallback(PollEntry *Entry, int Events)
+	{
+		Request *req = (Request *)Entry->Private;
+		if (Events && !(Events & (RequestEvents(req) | POLLERR | POLLHUP)))
+			return;
+
+		IoUring *ring = req->Ring;
+		{
+			SmartLock(ring->RequestLock);
+			if (!req->Armed)
+			{
+				/* Arm() hasn't given it away yet, it checks this */
+				req->Woken = true;
+				return;
+			}
+
+			req->Armed = false;
+			ring->Waiting.erase(req->WaitingEntry);
+		}
+		ring->Queue(req);
+	}
+
+	void IoUring::Arm(Request *req, int Events)
+	{
+		req->Woken = false;
+		req->Table.Callback = PollCallback;
+		req->Table.Private = req;
+
+		/* The node may have become ready before we registered */
+		int mask = fs->Poll(req->node, &req->Table);
+		bool ready = mask < 0 || (mask & (Events | POLLERR | POLLHUP));
+
+		{
+			SmartLock(RequestLock);
+			if (!ready && !req->Woken && !Closing.load())
+			{
+				/* From here the wake up or Release() own the
+				   request, it must not be touched anymore */
+				req->Armed = true;
+				req->WaitingEntry = Waiting.insert(Waiting.end(), req);
+				return;
+			}
+		}
+
+		/* Ready, or the ring is closing, the worker sees which */
+		Queue(req);
+	}
+
+	void IoUring::Execute(Request *req)
+	{
+		/* Drop the registration of a previous wait */
+		req->Table.Clear();
+
+		if (Closing.load())
+		{
+			Finish(req, -ECANCELED);
+			return;
+		}
+
+		/* Pollable nodes are only run once ready, so a worker
+		   never sleeps on a pipe or a terminal */
+		int events = RequestEvents(req);
+		if (req->node->fsi->Ops.Poll)
+		{
+			int mask = fs->Poll(req->node, nullptr);
+			if (mask >= 0 && !(mask & (events | POLLERR | POLLHUP)))
+			{
+				Arm(req, events);
+				return;
+			}
+
+			if (req->Opcode == __SYS_IORING_OP_POLL_ADD)
+			{
+				Finish(req, mask < 0 ? POLLERR : mask & (events | POLLERR | POLLHUP));
+				return;
+			}
+		}
+		else if (req->Opcode == __SYS_IORING_OP_POLL_ADD)
+		{
+			Finish(req, events & (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM));
+			return;
+		}
+
+		Finish(req, Run(req));
+	}
+
+	void IoUring::Finish(Request *req, int Result)
+	{
+		Post(req->UserData, Result);
+		delete req;
+		Put();
+	}
+
+	int IoUring::Submit(uint32_t ToSubmit)
+	{
+		/* Entries are prepared against the owner's descriptors
+		   and memory, even from the SQ polling thread */
+		PCB *pcb = PinOwner();
+		if (pcb == nullptr)
+			return -EOWNERDEAD;
+
+		std::vector<kio_uring_sqe> batch;
+		{
+			SmartLock(SubmitLock);
+			uint32_t head = *SqHead;
+			uint32_t tail = LoadAcquire(SqTail);
+			while (batch.size() < ToSubmit && head != tail)
+			{
+				uint32_t index = SqArray[head & (SqEntries - 1)];
+				head++;
+				if (index >= SqEntries)
+				{
+					(*SqDropped)++;
+					continue;
+				}
+
+				/* Copied, so userspace can reuse the entry as soon as we return */
+				batch.push_back(Entries[index]);
+			}
+			StoreRelease(SqHead, head);
+		}
+
+		for (const kio_uring_sqe &sqe : batch)
+		{
+			Request *req = new Request;
+			req->Ring = this;
+			req->Opcode = sqe.opcode;
+			req->UserData = sqe.user_data;
+
+			int result = 0;
+			if (!Prepare(sqe, req, &result))
+			{
+				Post(req->UserData, result);
+				delete req;
+				continue;
+			}
+
+			References++;
+			Queue(req);
+		}
+
+		UnpinOwner(pcb);
+		return (int)batch.size();
+	}
+
+	void IoUring::WakeSqThread()
+	{
+		if (SqSleeping.exchange(false))
+			SqThread->Unblock();
+	}
+
+	void IoUring::SqThreadEntry()
+	{
+		IoUring *ring;
+		{
+			SmartLock(SqStartLock);
+			ring = SqStartQueue.front();
+			SqStartQueue.pop_front();
+		}
+		ring->SqThreadLoop();
+	}
+
+	void IoUring::SqThreadLoop()
+	{
+		TCB *tcb = thisThread;
+		uint64_t idleSince = TimeManager->GetTimeNs();
+		while (!Closing.load())
+		{
+			int submitted = Submit(SqEntries);
+			if (submitted < 0)
+				break;
+
+			if (submitted > 0)
+			{
+				idleSince = TimeManager->GetTimeNs();
+				TaskManager->Yield();
+				continue;
+			}
+
+			if (TimeManager->GetTimeNs() - idleSince < SqIdle)
+			{
+				TaskManager->Yield();
+				continue;
+			}
+
+			/* From now on userspace has to ask for a wakeup */
+			__atomic_or_fetch(SqFlags, (uint32_t)__SYS_IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+			tcb->Block();
+			SqSleeping.store(true);
+			if (SqPending() || Closing.load())
+				WakeSqThread();
+			TaskManager->Yield();
+
+			SqSleeping.store(false);
+			__atomic_and_fetch(SqFlags, ~(uint32_t)__SYS_IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+			idleSince = TimeManager->GetTimeNs();
+		}
+
+		SqExited.store(true);
+		Put();
+	}
+
+	int IoUring::Enter(uint32_t ToSubmit, uint32_t MinComplete, uint32_t Flags)
+	{
+		if (Flags & ~(__SYS_IORING_ENTER_GETEVENTS | __SYS_IORING_ENTER_SQ_WAKEUP))
+			return -EINVAL;
+
+		int submitted = 0;
+		if (SqThread)
+		{
+			if (Flags & __SYS_IORING_ENTER_SQ_WAKEUP)
+				WakeSqThread();
+		}
+		else if (ToSubmit)
+		{
+			submitted = Submit(ToSubmit);
+			if (submitted < 0)
+				return submitted;
+		}
+
+		if (!(Flags & __SYS_IORING_ENTER_GETEVENTS) || MinComplete == 0)
+			return submitted;
+
+		if (MinComplete > CqEntries)
+			MinComplete = CqEntries;
+
+		PollWaiter waiter;
+		PollWait(&waiter.Table, CompletionQueue);
+		while (true)
+		{
+			waiter.Arm();
+			{
+				SmartLock(CompletionLock);
+				FlushOverflow();
+			}
+
+			if (CqReady() >= MinComplete)
+				return submitted;
+
+			int ret = waiter.Sleep(0);
+			if (ret < 0)
+				return submitted ? submitted : ret;
+		}
+	}
+
+	int IoUring::Register(uint32_t Opcode, void *Arg, uint32_t Count)
+	{
+		Memory::VirtualMemoryArea *vma = Owner->vma;
+		switch (Opcode)
+		{
+		case __SYS_IORING_REGISTER_BUFFERS:
+		{
+			if (Count == 0 || Count > KIOV_MAX)
+				return -EINVAL;
+
+			std::vector<kiovec> iov(Count);
+			if (vma->CopyFromUser(iov.data(), Arg, sizeof(kiovec) * Count) < 0)
+				return -EFAULT;
+
+			/* Only checked here, the pages are translated again
+			   by every request since they can be unmapped */
+			std::vector<FixedBuffer> buffers;
+			for (const kiovec &buffer : iov)
+			{
+				uintptr_t base = (uintptr_t)buffer.iov_base;
+				for (uintptr_t page = ALIGN_DOWN(base, PAGE_SIZE); page < base + buffer.iov_len; page += PAGE_SIZE)
+				{
+					if (vma->UserCheck((void *)page) < 0)
+						return -EFAULT;
+				}
+				buffers.push_back({base, buffer.iov_len});
+			}
+
+			SmartLock(SubmitLock);
+			if (!Buffers.empty())
+				return -EBUSY;
+			Buffers = buffers;
+			return 0;
+		}
+		case __SYS_IORING_UNREGISTER_BUFFERS:
+		{
+			SmartLock(SubmitLock);
+			if (Buffers.empty())
+				return -ENXIO;
+			Buffers.clear();
+			return 0;
+		}
+		case __SYS_IORING_REGISTER_FILES:
+		{
+			if (Count == 0 || Count > KIO_URING_MAX_ENTRIES)
+				return -EINVAL;
+
+			std::vector<int> fds(Count);
+			if (vma->CopyFromUser(fds.data(), Arg, sizeof(int) * Count) < 0)
+				return -EFAULT;
+
+			/* -1 leaves a slot empty */
+			FileDescriptorTable *fdt = Owner->FileDescriptors;
+			std::vector<Node> files;
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				if (fds[i] == -1)
+				{
+					files.push_back(nullptr);
+					continue;
+				}
+
+				FileDescriptorTable::FildesReference fildes = fdt->GetFileDescriptor(fds[i]);
+				if (fildes == nullptr || FromNode(fildes->node) == this)
+					return -EBADF;
+				files.push_back(fildes->node);
+			}
+
+			SmartLock(SubmitLock);
+			if (!Files.empty())
+				return -EBUSY;
+			Files = files;
+			return 0;
+		}
+		case __SYS_IORING_UNREGISTER_FILES:
+		{
+			std::vector<Node> files;
+			{
+				SmartLock(SubmitLock);
+				if (Files.empty())
+					return -ENXIO;
+				files.swap(Files);
+			}
+			return 0;
+		}
+		default:
+			return -EINVAL;
+		}
+	}
+
+	int IoUring::Poll(PollTable *Table)
+	{
+		PollWait(Table, CompletionQueue);
+
+		int mask = 0;
+		if (CqReady())
+			mask |= POLLIN | POLLRDNORM;
+		if (LoadAcquire(SqTail) - LoadAcquire(SqHead) < SqEntries)
+			mask |= POLLOUT | POLLWRNORM;
+		return mask;
+	}
+
+	void *IoUring::GetMapping(uint64_t Offset, size_t Length)
+	{
+		switch (Offset)
+		{
+		case __SYS_IORING_OFF_SQ_RING:
+		case __SYS_IORING_OFF_CQ_RING:
+			if (Length > FROM_PAGES(RingsPages))
+				return nullptr;
+			return Rings;
+		case __SYS_IORING_OFF_SQES:
+			if (Length > FROM_PAGES(EntriesPages))
+				return nullptr;
+			return Entries;
+		default:
+			return nullptr;
+		}
+	}
+
+	void IoUring::Release()
+	{
+		Closing.store(true);
+
+		/* The scheduler releases the ring while destroying the
+		   owner, nothing can be waited for there. The SQ thread and
+		   running requests hold references of their own and stop at
+		   their next copy, the owner is already detached. */
+		bool canWait = CPU::Interrupts(CPU::Check);
+		if (SqThread)
+		{
+			WakeSqThread();
+			while (canWait && !SqExited.load())
+				TaskManager->Yield();
+		}
+
+		std::vector<Request *> cancelled;
+		{
+			SmartLock(RequestLock);
+			for (Request *req : Waiting)
+			{
+				req->Armed = false;
+				cancelled.push_back(req);
+			}
+			Waiting.clear();
+		}
+
+		{
+			SmartLock(PoolLock);
+			auto itr = PoolQueue.begin();
+			while (itr != PoolQueue.end())
+			{
+				if ((*itr)->Ring != this)
+				{
+					itr++;
+					continue;
+				}
+
+				cancelled.push_back(*itr);
+				itr = PoolQueue.erase(itr);
+			}
+		}
+
+		for (Request *req : cancelled)
+		{
+			req->Table.Clear();
+			Finish(req, -ECANCELED);
+		}
+
+		/* Nothing writes to the process once close() returns */
+		while (canWait && Running.load() > 0)
+			TaskManager->Yield();
+
+		PCB *pcb = PinOwner();
+		if (pcb)
+		{
+			pcb->vma->Unmap(Rings, FROM_PAGES(RingsPages));
+			pcb->vma->Unmap(Entries, FROM_PAGES(EntriesPages));
+			UnpinOwner(pcb);
+		}
+
+		Put();
+	}
+
+	void IoUring::Put()
+	{
+		if (--References == 0)
+			delete this;
+	}
+
+	static uint32_t RoundUpPow2(uint32_t Value)
+	{
+		uint32_t result = 1;
+		while (result < Value)
+			result <<= 1;
+		return result;
+	}
+
+	int IoUring::Create(uint32_t Entries, kio_uring_params *Params,
+						PCB *Owner, Node &Result,
+						int (*ConvertResult)(int Result))
+	{
+		const uint32_t known = __SYS_IORING_SETUP_SQPOLL |
+							   __SYS_IORING_SETUP_CQSIZE |
+							   __SYS_IORING_SETUP_CLAMP;
+		uint32_t flags = Params->flags;
+		if (flags & ~known)
+			return -EINVAL;
+
+		if (Entries == 0)
+			return -EINVAL;
+
+		if (Entries > KIO_URING_MAX_ENTRIES)
+		{
+			if (!(flags & __SYS_IORING_SETUP_CLAMP))
+				return -EINVAL;
+			Entries = KIO_URING_MAX_ENTRIES;
+		}
+
+		uint32_t sq = RoundUpPow2(Entries);
+		uint32_t cq = sq * 2;
+		if (flags & __SYS_IORING_SETUP_CQSIZE)
+		{
+			if (Params->cq_entries == 0)
+				return -EINVAL;
+
+			cq = Params->cq_entries;
+			if (cq > KIO_URING_MAX_ENTRIES * 2)
+			{
+				if (!(flags & __SYS_IORING_SETUP_CLAMP))
+					return -EINVAL;
+				cq = KIO_URING_MAX_ENTRIES * 2;
+			}
+
+			cq = RoundUpPow2(cq);
+			if (cq < sq)
+				return -EINVAL;
+		}
+
+		IoUring *ring = new IoUring;
+		ring->Owner = Owner;
+		ring->ConvertResult = ConvertResult;
+		ring->SqEntries = sq;
+		ring->CqEntries = cq;
+
+		/* SQ ring header and index array, then the CQ ring header and
+		   its entries. The SQEs are in a mapping of their own. */
+		size_t cqBase = ALIGN_UP(RING_ARRAY + sizeof(uint32_t) * sq, 64);
+		size_t ringsSize = cqBase + RING_ARRAY + sizeof(kio_uring_cqe) * cq;
+		ring->RingsPages = TO_PAGES(ringsSize);
+		ring->EntriesPages = TO_PAGES(sizeof(kio_uring_sqe) * sq);
+
+		/* Owned by the kernel, so completions can still be posted
+		   after the process is gone */
+		ring->Rings = (uint8_t *)KernelAllocator.RequestPages(ring->RingsPages);
+		ring->Entries = (kio_uring_sqe *)KernelAllocator.RequestPages(ring->EntriesPages);
+		memset(ring->Rings, 0, FROM_PAGES(ring->RingsPages));
+		memset(ring->Entries, 0, FROM_PAGES(ring->EntriesPages));
+
+		int ret = Owner->vma->Map(ring->Rings, ring->Rings, FROM_PAGES(ring->RingsPages),
+								  Memory::US | Memory::RW);
+		if (ret == 0)
+			ret = Owner->vma->Map(ring->Entries, ring->Entries, FROM_PAGES(ring->EntriesPages),
+								  Memory::US | Memory::RW);
+		if (ret < 0)
+		{
+			Owner->vma->Unmap(ring->Rings, FROM_PAGES(ring->RingsPages));
+			delete ring;
+			return ret;
+		}
+
+		uint8_t *sqRing = ring->Rings;
+		uint8_t *cqRing = ring->Rings + cqBase;
+		ring->SqHead = (uint32_t *)(sqRing + RING_HEAD);
+		ring->SqTail = (uint32_t *)(sqRing + RING_TAIL);
+		ring->SqFlags = (uint32_t *)(sqRing + RING_FLAGS);
+		ring->SqDropped = (uint32_t *)(sqRing + RING_DROPPED);
+		ring->SqArray = (uint32_t *)(sqRing + RING_ARRAY);
+		*(uint32_t *)(sqRing + RING_MASK) = sq - 1;
+		*(uint32_t *)(sqRing + RING_ENTRIES) = sq;
+
+		ring->CqHead = (uint32_t *)(cqRing + RING_HEAD);
+		ring->CqTail = (uint32_t *)(cqRing + RING_TAIL);
+		ring->CqOverflow = (uint32_t *)(cqRing + RING_DROPPED);
+		ring->Cqes = (kio_uring_cqe *)(cqRing + RING_ARRAY);
+		*(uint32_t *)(cqRing + RING_MASK) = cq - 1;
+		*(uint32_t *)(cqRing + RING_ENTRIES) = cq;
+
+		Params->sq_entries = sq;
+		Params->cq_entries = cq;
+		Params->features = __SYS_IORING_FEAT_SINGLE_MMAP |
+						   __SYS_IORING_FEAT_NODROP |
+						   __SYS_IORING_FEAT_SUBMIT_STABLE;
+		Params->sq_off = {RING_HEAD, RING_TAIL, RING_MASK, RING_ENTRIES,
+						  RING_FLAGS, RING_DROPPED, RING_ARRAY, 0,
+						  (uintptr_t)ring->Entries};
+		Params->cq_off = {(uint32_t)cqBase + RING_HEAD, (uint32_t)cqBase + RING_TAIL,
+						  (uint32_t)cqBase + RING_MASK, (uint32_t)cqBase + RING_ENTRIES,
+						  (uint32_t)cqBase + RING_DROPPED, (uint32_t)cqBase + RING_ARRAY,
+						  (uint32_t)cqBase + RING_FLAGS, 0,
+						  (uintptr_t)ring->Rings};
+
+		{
+			SmartCriticalSection(RingsLock);
+			AllRings.push_back(ring);
+		}
+
+		{
+			SmartLock(PoolLock);
+			if (!PoolStarted)
+			{
+				PoolStarted = true;
+				for (int i = 0; i < IO_URING_WORKERS; i++)
+				{
+					TCB *worker = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+															Tasking::IP(WorkerEntry));
+					worker->Rename("io_uring worker");
+				}
+			}
+		}
+
+		if (flags & __SYS_IORING_SETUP_SQPOLL)
+		{
+			uint32_t idle = Params->sq_thread_idle ? Params->sq_thread_idle : IO_URING_SQ_IDLE;
+			ring->SqIdle = Time::FromMilliseconds(idle);
+			ring->References++;
+
+			{
+				SmartLock(SqStartLock);
+				SqStartQueue.push_back(ring);
+			}
+			ring->SqThread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													   Tasking::IP(SqThreadEntry));
+			ring->SqThread->Rename("io_uring sq");
+		}
+
+		ino_t index = NextIoUringIndex++;
+		auto deleter = [](IoUringNode *node)
+		{
+			delete node;
+		};
+		Result = Node(new IoUringNode(ring, index), deleter);
+		debug("Created io_uring %ld (%d/%d entries)", (long)index, sq, cq);
+		return 0;
+	}
+
+	IoUring *IoUring::FromNode(Node &node)
+	{
+		if (node == nullptr || node->fsi != GetIoUringFileSystem())
+			return nullptr;
+
+		return ((IoUringInode *)node->inode)->Owner;
+	}
+
+	IoUring::~IoUring()
+	{
+		{
+			SmartCriticalSection(RingsLock);
+			AllRings.remove(this);
+		}
+
+		KernelAllocator.FreePages(Rings, RingsPages);
+		KernelAllocator.FreePages(Entries, EntriesPages);
+	}
+}
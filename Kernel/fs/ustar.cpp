@@ -18,7 +18,10 @@
 #include <fs/ustar.hpp>
 #include <memory.hpp>
 #include <functional>
+#include <algorithm>
+#include <smp.hpp>
 #include <debug.h>
+#include <list>
 
 #include "../kernel.h"
 
@@ -27,12 +30,80 @@
 #define TVERSION "00"
 #define TVERSLEN 2
 
+namespace
+{
+	/* Archives waiting for a prefetch worker to pick them up */
+	NewLock(PrefetchLock);
+	std::list<vfs::USTAR *> PrefetchQueue;
+
+	/* Mounted archives that are inflated lazily */
+	std::vector<vfs::USTAR *> CompressedArchives;
+}
+
 namespace vfs
 {
+	uint64_t USTAR::IndexKey(ino_t Parent, const char *Name, size_t Length)
+	{
+		return HashName(Name, Length) ^ ((uint64_t)Parent * 0x9E3779B97F4A7C15);
+	}
+
+	void USTAR::IndexInsert(USTARInode *Node)
+	{
+		if (Node->Parent == nullptr)
+			return;
+
+		/* Keep the chains short, grow at a load factor of one */
+		if (Indexed + 1 > Index.size())
+			IndexRebuild(Index.empty() ? 64 : Index.size() * 2);
+
+		uint64_t key = IndexKey(Node->Parent->Node.Index, Node->Name.c_str(), Node->Name.size());
+		USTARInode *&bucket = Index[key & (Index.size() - 1)];
+		Node->HashNext = bucket;
+		bucket = Node;
+		Indexed++;
+	}
+
+	void USTAR::IndexRebuild(size_t Buckets)
+	{
+		std::vector<USTARInode *> old(std::move(Index));
+		Index.assign(Buckets, nullptr);
+		Indexed = 0;
+
+		for (USTARInode *head : old)
+		{
+			while (head)
+			{
+				USTARInode *next = head->HashNext;
+				uint64_t key = IndexKey(head->Parent->Node.Index, head->Name.c_str(), head->Name.size());
+				USTARInode *&bucket = Index[key & (Index.size() - 1)];
+				head->HashNext = bucket;
+				bucket = head;
+				Indexed++;
+				head = next;
+			}
+		}
+	}
+
+	USTAR::USTARInode *USTAR::IndexFind(USTARInode *Parent, const char *Name, size_t Length)
+	{
+		if (Index.empty())
+			return nullptr;
+
+		uint64_t key = IndexKey(Parent->Node.Index, Name, Length);
+		for (USTARInode *node = Index[key & (Index.size() - 1)]; node; node = node->HashNext)
+		{
+			if (node->Parent != Parent || node->Deleted)
+				continue;
+			if (node->Name.size() != Length || memcmp(node->Name.data(), Name, Length) != 0)
+				continue;
+			return node;
+		}
+		return nullptr;
+	}
+
 	int USTAR::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
 	{
 		auto Parent = (USTARInode *)_Parent;
-		debug("looking up for %s", Name);
 		const char *basename;
 		size_t length;
 		cwk_path_get_basename(Name, &basename, &length);
@@ -51,16 +122,12 @@ namespace vfs
 
 		if (_Parent)
 		{
-			for (const auto &child : Parent->Children)
-			{
-				if (child->Deleted || strcmp(child->Name.c_str(), basename) != 0)
-					continue;
-
-				*Result = &child->Node;
-				return 0;
-			}
+			USTARInode *child = IndexFind(Parent, basename, length);
+			if (child == nullptr)
+				return -ENOENT;
 
-			return -ENOENT;
+			*Result = &child->Node;
+			return 0;
 		}
 
 		auto fileItr = Files.begin();
@@ -165,6 +232,7 @@ namespace vfs
 		{
 			Parent->Children.push_back(Files.at(NextInode));
 			Files.at(NextInode)->Parent = Parent;
+			IndexInsert(node);
 		}
 		NextInode++;
 		return 0;
@@ -172,14 +240,13 @@ namespace vfs
 
 	ssize_t USTAR::Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
 
-		if (fileItr->second->Deleted)
+		if (node->Deleted)
 			return -ENOENT;
 
-		USTARInode *node = fileItr->second;
-		size_t fileSize = GetSize(node->Header->size);
+		size_t fileSize = node->Size;
 
 		if (Size <= 0)
 		{
@@ -203,11 +270,13 @@ namespace vfs
 		{
 			debug("Offset %d + Size %d is greater than file size %d",
 				  Offset, Size, fileSize);
-			Size = fileSize;
+			Size = fileSize - Offset;
 		}
 
-		memcpy(Buffer, (uint8_t *)((uintptr_t)node->Header + sizeof(FileHeader) + Offset), Size);
-		// debug("Read %d bytes from %d[%d]", Size, Node->Index, Offset);
+		if (__atomic_load_n(&node->Compressed, __ATOMIC_ACQUIRE) && !Inflate(node))
+			return -EIO;
+
+		memcpy(Buffer, node->Data + Offset, Size);
 		return Size;
 	}
 
@@ -385,107 +454,192 @@ namespace vfs
 
 	ssize_t USTAR::ReadLink(struct Inode *Node, char *Buffer, size_t Size)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
 
-		if (fileItr->second->Deleted)
+		if (node->Deleted)
 			return -ENOENT;
 
-		USTARInode *node = fileItr->second;
+		size_t length = 0;
+		while (length < sizeof(node->Header->link) && node->Header->link[length] != '\0')
+			length++;
+		if (length > Size)
+			length = Size;
 
-		if (strlen(node->Header->link) > Size)
-			Size = strlen(node->Header->link);
+		memcpy(Buffer, node->Header->link, length);
 
-		strncpy(Buffer, node->Header->link, Size);
-		debug("Read %d bytes from %d: \"%s\"", Size, Node->Index, Buffer);
-		return Size;
+		/* Callers treat the target as a string */
+		if (length < Size)
+			Buffer[length] = '\0';
+		return length;
 	}
 
 	int USTAR::Stat(struct Inode *Node, struct kstat *Stat)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
-		if (fileItr->second->Deleted)
-			return -ENOENT;
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
 
-		USTARInode *node = fileItr->second;
-		size_t fileSize = GetSize(node->Header->size);
+		if (node->Deleted)
+			return -ENOENT;
 
-		debug("Header: \"%.*s\"", sizeof(struct FileHeader), node->Header);
 		Stat->Device = this->DeviceID;
 		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
 		Stat->HardLinks = 1;
-		Stat->UserID = GetSize(node->Header->uid);
-		Stat->GroupID = GetSize(node->Header->gid);
-		Stat->RawDevice = Stat->MakeDevice(GetSize(node->Header->dev_maj), GetSize(node->Header->dev_min));
-		Stat->Size = fileSize;
-		Stat->AccessTime = GetSize(node->Header->mtime);
-		Stat->ModifyTime = GetSize(node->Header->mtime);
-		Stat->ChangeTime = GetSize(node->Header->mtime);
+		Stat->UserID = node->UserID;
+		Stat->GroupID = node->GroupID;
+		Stat->RawDevice = node->RawDevice;
+		Stat->Size = node->Size;
+		Stat->AccessTime = node->ModifyTime;
+		Stat->ModifyTime = node->ModifyTime;
+		Stat->ChangeTime = node->ModifyTime;
 		Stat->BlockSize = 512;
-		Stat->Blocks = (fileSize + 511) / 512;
+		Stat->Blocks = (node->Size + 511) / 512;
 		Stat->Attribute = 0;
+		return 0;
+	}
 
-		mode_t hdrMode = StringToInt(node->Header->mode);
-
-		if (hdrMode & TSUID)
-			Stat->Mode |= S_ISUID;
-		else if (hdrMode & TSGID)
-			Stat->Mode |= S_ISGID;
-		else if (hdrMode & TSVTX)
-			Stat->Mode |= S_ISVTX;
-		else if (hdrMode & TUREAD)
-			Stat->Mode |= S_IRUSR;
-		else if (hdrMode & TUWRITE)
-			Stat->Mode |= S_IWUSR;
-		else if (hdrMode & TUEXEC)
-			Stat->Mode |= S_IXUSR;
-		else if (hdrMode & TGREAD)
-			Stat->Mode |= S_IRGRP;
-		else if (hdrMode & TGWRITE)
-			Stat->Mode |= S_IWGRP;
-		else if (hdrMode & TGEXEC)
-			Stat->Mode |= S_IXGRP;
-		else if (hdrMode & TOREAD)
-			Stat->Mode |= S_IROTH;
-		else if (hdrMode & TOWRITE)
-			Stat->Mode |= S_IWOTH;
-		else if (hdrMode & TOEXEC)
-			Stat->Mode |= S_IXOTH;
-
-		switch (node->Header->typeflag[0])
-		{
-		case AREGTYPE:
-		case REGTYPE:
-			Stat->Mode |= S_IFREG;
-			break;
-		case LNKTYPE:
-			fixme("Hard link not implemented for %s", node->Header->name);
-			Stat->Mode |= S_IFLNK;
-			break;
-		case SYMTYPE:
-			Stat->Mode |= S_IFLNK;
-			break;
-		case CHRTYPE:
-			Stat->Mode |= S_IFCHR;
-			break;
-		case BLKTYPE:
-			Stat->Mode |= S_IFBLK;
+	const void *USTAR::GetData(struct Inode *Node, size_t *Size)
+	{
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+
+		if (node->Deleted)
+			return nullptr;
+
+		if (__atomic_load_n(&node->Compressed, __ATOMIC_ACQUIRE) && !Inflate(node))
+			return nullptr;
+
+		if (node->Data == nullptr)
+			return nullptr;
+
+		*Size = node->Size;
+		return node->Data;
+	}
+
+	ssize_t USTAR::FindChunk(size_t Offset)
+	{
+		size_t low = 0, high = Chunks.size();
+		while (low < high)
+		{
+			size_t middle = (low + high) / 2;
+			const StreamChunk &chunk = Chunks[middle];
+			if (Offset < chunk.Offset)
+				high = middle;
+			else if (Offset >= chunk.Offset + chunk.Length)
+				low = middle + 1;
+			else
+				return middle;
+		}
+		return -1;
+	}
+
+	const uint8_t *USTAR::DecodeChunk(size_t Index, uint8_t *Buffer)
+	{
+		const StreamChunk &chunk = Chunks[Index];
+		ssize_t length;
+		switch (chunk.Format)
+		{
+		case ChunkStored:
+			return chunk.Data;
+		case ChunkLZ4Block:
+			length = LZ4::DecompressBlock(chunk.Data, chunk.Size, Buffer, chunk.Length);
 			break;
-		case DIRTYPE:
-			Stat->Mode |= S_IFDIR;
+		case ChunkLZ4Frame:
+		{
+			LZ4::Frame frame;
+			if (!frame.Open(chunk.Data, chunk.Size) || !frame.Decompress(Buffer))
+				return nullptr;
+			length = frame.ContentSize;
 			break;
-		case FIFOTYPE:
-			Stat->Mode |= S_IFIFO;
+		}
+		case ChunkZstdFrame:
+			length = ZSTD::DecompressFrame(chunk.Data, chunk.Size, Buffer, chunk.Length);
 			break;
-		case CONTTYPE:
-			warn("Reserved type for %s", node->Header->name);
-			__fallthrough;
 		default:
-			error("Unknown type: %d for %s", node->Header->typeflag[0], node->Header->name);
-			break;
+			assert(!"Unknown chunk format");
+			return nullptr;
 		}
-		return 0;
+
+		if (length != (ssize_t)chunk.Length)
+			return nullptr;
+		return Buffer;
+	}
+
+	bool USTAR::ReadStream(void *Buffer, size_t Size, size_t Offset)
+	{
+		uint8_t *out = (uint8_t *)Buffer;
+		while (Size > 0)
+		{
+			ssize_t index = FindChunk(Offset);
+			if (index < 0)
+				return false;
+
+			StreamChunk &chunk = Chunks[index];
+			size_t skip = Offset - chunk.Offset;
+			size_t count = chunk.Length - skip;
+			if (count > Size)
+				count = Size;
+
+			if (chunk.Format == ChunkStored)
+				memcpy(out, chunk.Data + skip, count);
+			else if (skip == 0 && count == chunk.Length && CachedChunk != index)
+			{
+				/* The whole chunk is wanted, skip the cache */
+				if (DecodeChunk(index, out) == nullptr)
+					return false;
+			}
+			else
+			{
+				if (CachedChunk != index)
+				{
+					CachedChunk = -1;
+					if (DecodeChunk(index, StreamCache) == nullptr)
+						return false;
+					CachedChunk = index;
+				}
+				memcpy(out, StreamCache + skip, count);
+			}
+
+			out += count;
+			Offset += count;
+			Size -= count;
+		}
+		return true;
+	}
+
+	bool USTAR::Inflate(USTARInode *Node)
+	{
+		{
+			SmartLock(StreamLock);
+			if (!Node->Compressed)
+				return true;
+
+			if (!Node->Prefetched)
+			{
+				size_t pages = TO_PAGES(Node->Size);
+				uint8_t *data = (uint8_t *)KernelAllocator.RequestPages(pages);
+				if (!ReadStream(data, Node->Size, Node->StreamOffset))
+				{
+					error("Failed to inflate \"%s\"", Node->Path.c_str());
+					KernelAllocator.FreePages(data, pages);
+					return false;
+				}
+
+				Node->Data = data;
+				__atomic_store_n(&Node->Compressed, false, __ATOMIC_RELEASE);
+				return true;
+			}
+		}
+
+		/* A prefetch worker owns the file, wait for it */
+		while (__atomic_load_n(&Node->Compressed, __ATOMIC_ACQUIRE))
+		{
+			if (__atomic_load_n(&Node->Broken, __ATOMIC_ACQUIRE))
+				return false;
+			TaskManager->Yield();
+		}
+		return true;
 	}
 
 	bool USTAR::TestArchive(uintptr_t Address)
@@ -509,37 +663,12 @@ namespace vfs
 		return true;
 	}
 
-	void USTAR::ReadArchive(uintptr_t Address, size_t Size)
+	USTAR::USTARInode *USTAR::AddEntry(FileHeader *header)
 	{
-		trace("Initializing USTAR with address %#lx and size %d", Address, Size);
-
 		auto SetMode = [&](Inode &uNode, FileHeader *header)
 		{
-			mode_t hdrMode = StringToInt(header->mode);
-			if (hdrMode & TSUID)
-				uNode.Mode |= S_ISUID;
-			else if (hdrMode & TSGID)
-				uNode.Mode |= S_ISGID;
-			else if (hdrMode & TSVTX)
-				uNode.Mode |= S_ISVTX;
-			else if (hdrMode & TUREAD)
-				uNode.Mode |= S_IRUSR;
-			else if (hdrMode & TUWRITE)
-				uNode.Mode |= S_IWUSR;
-			else if (hdrMode & TUEXEC)
-				uNode.Mode |= S_IXUSR;
-			else if (hdrMode & TGREAD)
-				uNode.Mode |= S_IRGRP;
-			else if (hdrMode & TGWRITE)
-				uNode.Mode |= S_IWGRP;
-			else if (hdrMode & TGEXEC)
-				uNode.Mode |= S_IXGRP;
-			else if (hdrMode & TOREAD)
-				uNode.Mode |= S_IROTH;
-			else if (hdrMode & TOWRITE)
-				uNode.Mode |= S_IWOTH;
-			else if (hdrMode & TOEXEC)
-				uNode.Mode |= S_IXOTH;
+			/* The permission bits in the header match the POSIX ones */
+			uNode.Mode = ParseOctal(header->mode, sizeof(header->mode)) & 07777;
 
 			switch (header->typeflag[0])
 			{
@@ -574,13 +703,146 @@ namespace vfs
 			}
 		};
 
+		/* This removes the "." at the beginning of the file name
+			"./foo/bar" > "/foo/bar" */
+		if (header->name[0] == '.' && header->name[1] == '/')
+			memmove(header->name, header->name + 1, strlen(header->name));
+
+		if (isempty((char *)header->name))
+			fixme("Ignoring empty file name \"%.*s\"", sizeof(struct FileHeader), header);
+
+		struct Inode uNode;
+		uNode.Device = this->DeviceID;
+		uNode.RawDevice = 0;
+		uNode.Index = NextInode;
+		SetMode(uNode, header);
+		uNode.Offset = 0;
+		uNode.PrivateData = this;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(header->name, &basename, &length);
+
+		USTARInode *node = new USTARInode{.Node = uNode,
+										  .Header = header,
+										  .Parent = nullptr,
+										  .Name{},
+										  .Path{},
+										  .Children{},
+										  .Deleted = false,
+										  .Checksum = INODE_CHECKSUM};
+
+		if (basename)
+			node->Name.assign(basename, length);
+		else
+			node->Name.assign((const char *)header->name, strlen(header->name));
+		node->Path.assign((const char *)header->name, strlen(header->name));
+
+		node->Size = ParseOctal(header->size, sizeof(header->size));
+		node->UserID = ParseOctal(header->uid, sizeof(header->uid));
+		node->GroupID = ParseOctal(header->gid, sizeof(header->gid));
+		node->ModifyTime = ParseOctal(header->mtime, sizeof(header->mtime));
+		node->RawDevice = kstat().MakeDevice(ParseOctal(header->dev_maj, sizeof(header->dev_maj)),
+											 ParseOctal(header->dev_min, sizeof(header->dev_min)));
+
+		Files.insert(std::make_pair(NextInode, node));
+		NextInode++;
+		return node;
+	}
+
+	void USTAR::LinkArchive()
+	{
+		/* Entries can come in any order, so find every
+			directory first and then link each entry to
+			the directory its path is in */
+		std::unordered_map<std::string, USTARInode *> directories;
+		for (auto &file : Files)
+		{
+			if (file.second->Path.back() == '/')
+				directories[file.second->Path] = file.second;
+		}
+
+		auto rootItr = directories.find(std::string("/"));
+		if (rootItr == directories.end())
+		{
+			error("Archive has no root directory");
+			return;
+		}
+		USTARInode *root = rootItr->second;
+
+		for (auto &file : Files)
+		{
+			USTARInode *node = file.second;
+			if (node == root)
+				continue;
+
+			/* This converts /one/two/path.txt to /one/two/ */
+			const char *path = node->Path.c_str();
+			size_t length;
+			cwk_path_get_dirname(path, &length);
+
+			auto parent = directories.find(std::string(path, length));
+			if (parent == directories.end())
+			{
+				warn("No directory for \"%s\"", path);
+				continue;
+			}
+
+			parent->second->Children.push_back(node);
+			node->Parent = parent->second;
+		}
+
+		std::function<void(vfs::USTAR::USTARInode *, int, const std::string &)> ustarTree = [&](vfs::USTAR::USTARInode *node, int level, const std::string &prefix)
+		{
+			debug("%*s\"%s\"%ld", level * 4, prefix.c_str(), node->Name.c_str(), node->Node.Offset);
+			off_t offset = 2; /* 0 . | 1 .. */
+			for (auto &child : node->Children)
+			{
+#ifdef DEBUG
+				if (offset <= 2)
+				{
+					if (offset == 2)
+						offset = 0;
+					/* Pseudo directories . and .. */
+					USTARInode pseudoDot{};
+					pseudoDot.Node = node->Node;
+					pseudoDot.Name = ".";
+					pseudoDot.Node.Offset = offset++;
+					USTARInode pseudoDDot{};
+					pseudoDDot.Node = node->Parent ? node->Parent->Node : node->Node;
+					pseudoDDot.Name = "..";
+					pseudoDDot.Node.Offset = offset++;
+					ustarTree(&pseudoDot, level + 1, "|-- ");
+					ustarTree(&pseudoDDot, level + 1, "|-- ");
+				}
+#endif
+
+				child->Node.Offset = offset++;
+				ustarTree(child, level + 1, child == node->Children.back() ? "`-- " : "|-- ");
+			}
+		};
+
+		ustarTree(root, 0, "");
+
+		/* Index every name once, lookups no longer walk Children */
+		size_t buckets = 64;
+		while (buckets < Files.size())
+			buckets *= 2;
+		IndexRebuild(buckets);
+		for (auto &file : Files)
+			IndexInsert(file.second);
+	}
+
+	void USTAR::ReadArchive(uintptr_t Address, size_t Size)
+	{
+		trace("Initializing USTAR with address %#lx and size %d", Address, Size);
+
 		FileHeader *header = (FileHeader *)Address;
 
 		debug("USTAR signature valid! Name:\"%s\" Signature:\"%s\" Mode:%d Size:%lu",
 			  header->name, header->signature, StringToInt(header->mode), header->size);
 
 		Memory::Virtual vmm;
-		std::vector<USTARInode *> tmpNodes; /* FIXME: bug in unordered_map for iterators */
 		for (size_t i = 0;; i++)
 		{
 			if (!vmm.Check((void *)header))
@@ -591,205 +853,321 @@ namespace vfs
 
 			if (strncmp(header->signature, TMAGIC, TMAGLEN - 1) != 0)
 				break;
-			// debug("\"%s\"", header->name);
-
-			/* This removes the "." at the beginning of the file name
-				"./foo/bar" > "/foo/bar" */
-			if (header->name[0] == '.' && header->name[1] == '/')
-				memmove(header->name, header->name + 1, strlen(header->name));
 
-			if (isempty((char *)header->name))
-				fixme("Ignoring empty file name \"%.*s\"", sizeof(struct FileHeader), header);
+			USTARInode *node = AddEntry(header);
+			node->Data = (const uint8_t *)header + sizeof(FileHeader);
 
-			struct Inode uNode;
-			uNode.Device = this->DeviceID;
-			uNode.RawDevice = 0;
-			uNode.Index = NextInode;
-			SetMode(uNode, header);
-			uNode.Offset = 0;
-			uNode.PrivateData = this;
-
-			const char *basename;
-			size_t length;
-			cwk_path_get_basename(header->name, &basename, &length);
-
-			USTARInode *node = new USTARInode{.Node = uNode,
-											  .Header = header,
-											  .Parent = nullptr,
-											  .Name{},
-											  .Path{},
-											  .Children{},
-											  .Deleted = false,
-											  .Checksum = INODE_CHECKSUM};
-
-			if (basename)
-				node->Name.assign(basename, length);
-			else
-				node->Name.assign((const char *)header->name, strlen(header->name));
-			node->Path.assign((const char *)header->name, strlen(header->name));
-
-			Files.insert(std::make_pair(NextInode, node));
-			tmpNodes.push_back(node);
-
-			size_t size = GetSize(header->size);
+			size_t size = node->Size;
 			Address += ((size / 512) + 1) * 512;
 			if (size % 512)
 				Address += 512;
 
 			header = (FileHeader *)Address;
-			NextInode++;
 		}
 
-		/* TODO: This code can be significantly optimized but good luck understanding it */
-		USTARInode *parent = nullptr;
-		std::vector<USTARInode *> parentStack;
-		std::vector<std::string *> pathStack;
-		for (auto &file : tmpNodes)
+		LinkArchive();
+	}
+
+	bool USTAR::AddLZ4Chunks(const uint8_t *Data, size_t Size)
+	{
+		LZ4::Frame frame;
+		if (!frame.Open(Data, Size))
 		{
-			if (file->Path == "/") /* This is root / */
+			error("Invalid LZ4 frame!");
+			return false;
+		}
+
+		if (!frame.Independent)
+		{
+			/* Linked blocks depend on the output before them,
+				so the archive can only be inflated as a whole */
+			Chunks.push_back({Data, Size, ChunkLZ4Frame, 0, frame.ContentSize});
+			ChunkMaxLength = StreamSize = frame.ContentSize;
+			return true;
+		}
+
+		for (const LZ4::Block &block : frame.Blocks)
+		{
+			Chunks.push_back({block.Data, block.Size,
+							  (uint8_t)(block.Compressed ? ChunkLZ4Block : ChunkStored),
+							  block.Offset, block.Length});
+			ChunkMaxLength = MAX(ChunkMaxLength, block.Length);
+		}
+		StreamSize = frame.ContentSize;
+		return true;
+	}
+
+	bool USTAR::AddZstdChunks(const uint8_t *Data, size_t Size)
+	{
+		/* Every frame decodes on its own, so an archive
+			compressed in more than one frame (zstd -T0,
+			pzstd or the seekable format) can be read lazily */
+		size_t offset = 0;
+		while (offset < Size)
+		{
+			ZSTD::FrameInfo info;
+			if (!ZSTD::GetFrameInfo(Data + offset, Size - offset, &info))
 			{
-				parentStack.push_back(file);
-				pathStack.push_back(&file->Path);
-				// debug("root / generated");
-				continue;
+				if (Chunks.empty())
+				{
+					error("Invalid zstd frame!");
+					return false;
+				}
+
+				warn("Ignoring %ld bytes after the last zstd frame", Size - offset);
+				break;
 			}
 
-			/* pathStack is never empty */
+			const uint8_t *frame = Data + offset;
+			offset += info.FrameSize;
+			if (info.Skippable)
+				continue;
 
-			if (file->Path.back() == '/') /* This is a directory */
+			size_t length = info.Known ? info.ContentSize : 0;
+			if (!info.Known && info.Bound > 0)
 			{
-				const char *path = file->Path.c_str();
-				size_t length;
-				/* This converts /one/two/path.txt to /one/two/ */
-				cwk_path_get_dirname(path, &length);
-				std::string dirName(path, length);
-
-				/* Check if the directory is at the same level as the current directory */
-				if (dirName == *pathStack.back())
+				/* Decode it once just to know how long it is */
+				uint8_t *buffer = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(info.Bound));
+				ssize_t ret = ZSTD::DecompressFrame(frame, info.FrameSize, buffer, info.Bound);
+				KernelAllocator.FreePages(buffer, TO_PAGES(info.Bound));
+				if (ret < 0)
 				{
-					parent = parentStack.back();
-					parentStack.push_back(file);
-					pathStack.push_back(&file->Path);
-					parent->Children.push_back(file);
-					file->Parent = parent;
-					// debug("adding \"%s\" to \"%s\"", file->Path.c_str(), parent->Path.c_str());
-					continue;
-				}
-				else
-				{
-					/* Check if the directory is at a higher level */
-					for (size_t i = 0; i < parentStack.size(); i++)
-					{
-						if (dirName != *pathStack[i])
-							continue;
-
-						/* Adjust vectors */
-						while (!parentStack.empty())
-						{
-							if (dirName == *pathStack.back())
-								break;
-
-							// debug("popping \"%s\"", pathStack.back()->c_str());
-							parentStack.pop_back();
-							pathStack.pop_back();
-						}
-
-						parent = parentStack.back();
-						parentStack.push_back(file);
-						pathStack.push_back(&file->Path);
-						parent->Children.push_back(file);
-						file->Parent = parent;
-						// debug("adding \"%s\" to \"%s\"", file->Path.c_str(), parent->Path.c_str());
-						goto foundEnd;
-					}
-
-					// This is a new directory level
-					parentStack.pop_back();
-					pathStack.pop_back();
-					parent = parentStack.back();
-					parentStack.push_back(file);
-					pathStack.push_back(&file->Path);
-					parent->Children.push_back(file);
-					file->Parent = parent;
-					// debug("adding \"%s\" to \"%s\"", file->Path.c_str(), parent->Path.c_str());
-				foundEnd:
-					continue;
+					error("Corrupted zstd frame at %#lx", frame - Data);
+					return false;
 				}
+				length = ret;
 			}
 
-			/* From here, it's a file */
+			if (length == 0)
+				continue;
 
-			const char *path = file->Path.c_str();
-			size_t length;
-			/* This converts /one/two/path.txt to /one/two/ */
-			cwk_path_get_dirname(path, &length);
-			std::string dirName(path, length);
+			Chunks.push_back({frame, info.FrameSize, ChunkZstdFrame, StreamSize, length});
+			ChunkMaxLength = MAX(ChunkMaxLength, length);
+			StreamSize += length;
+		}
+		return true;
+	}
+
+	bool USTAR::ReadCompressedArchive(uintptr_t Address, size_t Size)
+	{
+		trace("Initializing compressed USTAR with address %#lx and size %d", Address, Size);
+
+		const uint8_t *data = (const uint8_t *)Address;
+		bool valid = LZ4::IsFrame(data, Size) ? AddLZ4Chunks(data, Size)
+											  : AddZstdChunks(data, Size);
+		if (!valid || StreamSize < sizeof(FileHeader))
+		{
+			Chunks.clear();
+			return false;
+		}
 
-			/* Check if the file is at the same level as the current directory */
-			if (dirName == *pathStack.back())
+		if (Chunks.size() == 1)
+		{
+			/* Nothing to gain from reading it lazily */
+			const uint8_t *archive = Chunks[0].Data;
+			uint8_t *buffer = nullptr;
+			if (Chunks[0].Format != ChunkStored)
 			{
-				parent = parentStack.back();
-				parent->Children.push_back(file);
-				file->Parent = parent;
-				// debug("adding \"%s\" to \"%s\"", file->Path.c_str(), parent->Path.c_str());
-				continue;
+				buffer = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(StreamSize));
+				archive = DecodeChunk(0, buffer);
+			}
+			Chunks.clear();
+
+			if (archive == nullptr || !TestArchive((uintptr_t)archive))
+			{
+				if (buffer)
+					KernelAllocator.FreePages(buffer, TO_PAGES(StreamSize));
+				return false;
+			}
+
+			ReadArchive((uintptr_t)archive, StreamSize);
+			return true;
+		}
+
+		StreamCache = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(ChunkMaxLength));
+		CachedChunk = -1;
+
+		FileHeader first;
+		if (!ReadStream(&first, sizeof(FileHeader), 0) ||
+			!TestArchive((uintptr_t)&first))
+		{
+			KernelAllocator.FreePages(StreamCache, TO_PAGES(ChunkMaxLength));
+			StreamCache = nullptr;
+			Chunks.clear();
+			return false;
+		}
+
+		/* Only the headers are decoded now, file contents
+			are inflated by Read() and GetData() */
+		size_t offset = 0;
+		while (offset + sizeof(FileHeader) <= StreamSize)
+		{
+			FileHeader *header = new FileHeader;
+			if (!ReadStream(header, sizeof(FileHeader), offset) ||
+				strncmp(header->signature, TMAGIC, TMAGLEN - 1) != 0)
+			{
+				delete header;
+				break;
 			}
 
-			/* Check if the file is at a higher level */
-			for (size_t i = 0; i < parentStack.size(); i++)
+			USTARInode *node = AddEntry(header);
+			node->StreamOffset = offset + sizeof(FileHeader);
+			node->Compressed = node->Size > 0;
+
+			offset += ((node->Size / 512) + 1) * 512;
+			if (node->Size % 512)
+				offset += 512;
+		}
+
+		debug("%ld entries in %ld chunks of up to %ld bytes",
+			  Files.size(), Chunks.size(), ChunkMaxLength);
+		LinkArchive();
+		return true;
+	}
+
+	void USTAR::Prefetch()
+	{
+		size_t workers;
+		{
+			SmartLock(StreamLock);
+			if (Chunks.empty() || PrefetchWorkers.load() > 0)
+				return;
+
+			PrefetchFiles.clear();
+			PrefetchFiles.resize(Chunks.size());
+			PrefetchNext.store(0);
+
+			size_t claimed = 0;
+			for (auto &file : Files)
 			{
-				if (dirName != *pathStack[i])
+				USTARInode *node = file.second;
+				if (!node->Compressed || node->Prefetched || node->Deleted)
 					continue;
 
-				/* Adjust vectors */
-				while (!parentStack.empty())
-				{
-					if (dirName == *pathStack.back())
-						break;
+				/* Files cut off by a short stream fail when read */
+				if (node->StreamOffset + node->Size > StreamSize)
+					continue;
 
-					// debug("popping \"%s\"", pathStack.back()->c_str());
-					parentStack.pop_back();
-					pathStack.pop_back();
-				}
+				node->Inflating = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(node->Size));
+				node->Remaining = node->Size;
+				node->Prefetched = true;
 
-				parent = parentStack.back();
-				parent->Children.push_back(file);
-				file->Parent = parent;
-				// debug("adding \"%s\" to \"%s\"", file->Path.c_str(), parent->Path.c_str());
+				size_t last = FindChunk(node->StreamOffset + node->Size - 1);
+				for (size_t i = FindChunk(node->StreamOffset); i <= last; i++)
+					PrefetchFiles[i].push_back(node);
+				claimed++;
 			}
+
+			if (claimed == 0)
+			{
+				PrefetchFiles.clear();
+				return;
+			}
+
+			workers = MIN((size_t)MAX(SMP::CPUCores, 1), Chunks.size());
+			PrefetchWorkers.store(workers);
+			debug("Inflating %ld files with %ld workers", claimed, workers);
 		}
 
-		std::function<void(vfs::USTAR::USTARInode *, int, const std::string &)> ustarTree = [&](vfs::USTAR::USTARInode *node, int level, const std::string &prefix)
+		for (size_t i = 0; i < workers; i++)
 		{
-			debug("%*s\"%s\"%ld", level * 4, prefix.c_str(), node->Name.c_str(), node->Node.Offset);
-			off_t offset = 2; /* 0 . | 1 .. */
-			for (auto &child : node->Children)
 			{
-#ifdef DEBUG
-				if (offset <= 2)
+				SmartLock(PrefetchLock);
+				PrefetchQueue.push_back(this);
+			}
+
+			TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+									  Tasking::IP(PrefetchEntry))
+				->Rename("ustar inflate");
+		}
+	}
+
+	void USTAR::PrefetchEntry()
+	{
+		USTAR *ustar;
+		{
+			SmartLock(PrefetchLock);
+			ustar = PrefetchQueue.front();
+			PrefetchQueue.pop_front();
+		}
+		ustar->PrefetchLoop();
+	}
+
+	void USTAR::PrefetchLoop()
+	{
+		uint8_t *buffer = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(ChunkMaxLength));
+
+		/* Chunks are handed out in order, so the
+			start of the archive is ready first */
+		while (true)
+		{
+			size_t index = PrefetchNext.fetch_add(1);
+			if (index >= PrefetchFiles.size())
+				break;
+
+			std::vector<USTARInode *> &files = PrefetchFiles[index];
+			if (files.empty())
+				continue;
+
+			const StreamChunk &chunk = Chunks[index];
+			const uint8_t *decoded = DecodeChunk(index, buffer);
+			if (decoded == nullptr)
+				error("Failed to inflate chunk %ld", index);
+
+			for (USTARInode *node : files)
+			{
+				size_t start = MAX(node->StreamOffset, chunk.Offset);
+				size_t end = MIN(node->StreamOffset + node->Size, chunk.Offset + chunk.Length);
+
+				if (decoded)
+					memcpy(node->Inflating + (start - node->StreamOffset),
+						   decoded + (start - chunk.Offset), end - start);
+				else
+					__atomic_store_n(&node->Broken, true, __ATOMIC_RELEASE);
+
+				/* The file can span chunks other workers are decoding */
+				if (__atomic_sub_fetch(&node->Remaining, end - start, __ATOMIC_ACQ_REL) != 0)
+					continue;
+
+				if (__atomic_load_n(&node->Broken, __ATOMIC_ACQUIRE))
 				{
-					if (offset == 2)
-						offset = 0;
-					/* Pseudo directories . and .. */
-					USTARInode pseudoDot{};
-					pseudoDot.Node = node->Node;
-					pseudoDot.Name = ".";
-					pseudoDot.Node.Offset = offset++;
-					USTARInode pseudoDDot{};
-					pseudoDDot.Node = node->Parent ? node->Parent->Node : node->Node;
-					pseudoDDot.Name = "..";
-					pseudoDDot.Node.Offset = offset++;
-					ustarTree(&pseudoDot, level + 1, "|-- ");
-					ustarTree(&pseudoDDot, level + 1, "|-- ");
+					error("Failed to inflate \"%s\"", node->Path.c_str());
+					KernelAllocator.FreePages(node->Inflating, TO_PAGES(node->Size));
+					node->Inflating = nullptr;
+					continue;
 				}
-#endif
 
-				child->Node.Offset = offset++;
-				ustarTree(child, level + 1, child == node->Children.back() ? "`-- " : "|-- ");
+				node->Data = node->Inflating;
+				__atomic_store_n(&node->Compressed, false, __ATOMIC_RELEASE);
 			}
-		};
+			files.clear();
+		}
+
+		KernelAllocator.FreePages(buffer, TO_PAGES(ChunkMaxLength));
+
+		SmartLock(StreamLock);
+		if (PrefetchWorkers.fetch_sub(1) == 1)
+		{
+			debug("Archive %ld is inflated", DeviceID);
+			PrefetchFiles.clear();
+		}
+	}
 
-		ustarTree(tmpNodes[0], 0, "");
+	USTAR::~USTAR()
+	{
+		{
+			SmartLock(PrefetchLock);
+			auto itr = std::find(CompressedArchives.begin(), CompressedArchives.end(), this);
+			if (itr != CompressedArchives.end())
+				CompressedArchives.erase(itr);
+		}
+
+		/* The workers still reference the chunks */
+		while (PrefetchWorkers.load() > 0)
+			TaskManager->Yield();
+
+		if (StreamCache)
+			KernelAllocator.FreePages(StreamCache, TO_PAGES(ChunkMaxLength));
 	}
 }
 
@@ -842,17 +1220,11 @@ O2 int __ustar_Destroy(FileSystemInfo *fsi)
 	return 0;
 }
 
-bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size, size_t Index)
+static FileSystemInfo *CreateUSTARInfo(vfs::USTAR *ustar)
 {
-	vfs::USTAR *ustar = new vfs::USTAR();
-	if (!ustar->TestArchive(Address))
-	{
-		delete ustar;
-		return false;
-	}
-
-	FileSystemInfo *fsi = new FileSystemInfo;
+	FileSystemInfo *fsi = new FileSystemInfo{};
 	fsi->Name = "ustar";
+	fsi->Flags = FS_NEGATIVE_CACHE;
 	fsi->SuperOps.DeleteInode = __ustar_DestroyInode;
 	fsi->SuperOps.Destroy = __ustar_Destroy;
 	fsi->Ops.Lookup = __ustar_Lookup;
@@ -862,11 +1234,13 @@ bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size, size_t Index)
 	fsi->Ops.SymLink = __ustar_SymLink;
 	fsi->Ops.ReadLink = __ustar_ReadLink;
 	fsi->Ops.Stat = __ustar_Stat;
+	fsi->Ops.Poll = nullptr;
 	fsi->PrivateData = ustar;
+	return fsi;
+}
 
-	ustar->DeviceID = fs->RegisterFileSystem(fsi);
-	ustar->ReadArchive(Address, Size);
-
+static void AddUSTARRoot(vfs::USTAR *ustar, FileSystemInfo *fsi, size_t Index)
+{
 	Inode *rootfs = nullptr;
 	ustar->Lookup(nullptr, "/", &rootfs);
 	assert(rootfs != nullptr);
@@ -881,5 +1255,59 @@ bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size, size_t Index)
 	node->Path = "/";
 
 	fs->AddRoot(Index, node);
+}
+
+bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size, size_t Index)
+{
+	vfs::USTAR *ustar = new vfs::USTAR();
+	if (!ustar->TestArchive(Address))
+	{
+		delete ustar;
+		return false;
+	}
+
+	FileSystemInfo *fsi = CreateUSTARInfo(ustar);
+	ustar->DeviceID = fs->RegisterFileSystem(fsi);
+	ustar->ReadArchive(Address, Size);
+
+	AddUSTARRoot(ustar, fsi, Index);
+	return true;
+}
+
+bool TestAndInitializeCompressedUSTAR(uintptr_t Address, size_t Size, size_t Index)
+{
+	if (!LZ4::IsFrame((const void *)Address, Size) &&
+		!ZSTD::IsFrame((const void *)Address, Size) &&
+		!ZSTD::IsSkippableFrame((const void *)Address, Size))
+		return false;
+
+	vfs::USTAR *ustar = new vfs::USTAR();
+	FileSystemInfo *fsi = CreateUSTARInfo(ustar);
+	ustar->DeviceID = fs->RegisterFileSystem(fsi);
+	if (!ustar->ReadCompressedArchive(Address, Size))
+	{
+		/* Frees ustar and fsi */
+		fs->UnregisterFileSystem(ustar->DeviceID);
+		return false;
+	}
+
+	AddUSTARRoot(ustar, fsi, Index);
+
+	{
+		SmartLock(PrefetchLock);
+		CompressedArchives.push_back(ustar);
+	}
 	return true;
 }
+
+void PrefetchCompressedUSTAR()
+{
+	std::vector<vfs::USTAR *> archives;
+	{
+		SmartLock(PrefetchLock);
+		archives = CompressedArchives;
+	}
+
+	for (vfs::USTAR *ustar : archives)
+		ustar->Prefetch();
+}
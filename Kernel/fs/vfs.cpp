@@ -16,6 +16,7 @@
 */
 
 #include <fs/vfs.hpp>
+#include <fs/pipe.hpp>
 
 #include "../kernel.h"
 
@@ -132,92 +133,137 @@ namespace vfs
 		return 0;
 	}
 
-	eNode Virtual::Lookup(Node &Parent, std::string Path)
+	eNode Virtual::LookupName(Node &Parent, const char *Name, size_t Length)
 	{
-		assert(Parent != nullptr);
-
-		debug("looking up \"%s\" in \"%s\"", Path.c_str(), Parent->Path.c_str());
+		uint64_t hash = HashName(Name, Length);
 
-		if (Path == ".")
-			return {Parent, 0};
-		else if (Path == "..")
-			return {Parent->Parent ? Parent->Parent : Parent, 0};
-
-		Node base = Parent;
-		bool absolute = PathIsAbsolute(Path);
-		if (absolute == true)
+		Node cached;
+		switch (NameCacheLookup(Parent.get(), Name, Length, hash, &cached))
 		{
-			while (base->Parent)
-				base = base->Parent;
+		case NAME_CACHE_HIT:
+			return {cached, 0};
+		case NAME_CACHE_NEGATIVE:
+			return {nullptr, -ENOENT};
+		default:
+			break;
 		}
 
-		debug("base is \"%s\" and path is \"%s\"  %d", base->Path.c_str(), Path.c_str(), absolute);
-		Path = this->NormalizePath(base, Path, !absolute);
-		debug("after normalizing, path is \"%s\" %d", Path.c_str(), absolute);
+		auto search = [&]() -> Node
+		{
+			for (const Node &child : Parent->Children)
+			{
+				if (child.get() == nullptr || child->Name.size() != Length)
+					continue;
+				if (memcmp(child->Name.data(), Name, Length) != 0)
+					continue;
+				return child;
+			}
+			return nullptr;
+		};
 
-		struct cwk_segment segment;
-		if (!cwk_path_get_first_segment(Path.c_str(), &segment))
+		/* Components in the middle of a path are not terminated */
+		char name[256];
+		Inode *inode;
+		uint64_t generation;
 		{
-			debug("%s no segments; %d", Path.c_str(), absolute);
-			if (Path == "/")
-				return {base, 0};
+			/* Other lookups in this directory can ask the filesystem too */
+			SmartReadLock(Parent->ChildrenLock);
+			if (Node child = search())
+			{
+				NameCacheInsert(Parent.get(), Name, Length, hash, child);
+				return {child, 0};
+			}
 
-			assert(!"Path doesn't have any segments.");
-		}
+			if (Parent->fsi->Ops.Lookup == nullptr)
+				return {nullptr, ENOTSUP};
 
-		Node node = base;
-		/* We need to go to the root after NormalizePath even if Path is relative */
-		if (absolute == false)
-		{
-			while (node->Parent)
+			if (Length > 255)
+				return {nullptr, ENAMETOOLONG};
+
+			memcpy(name, Name, Length);
+			name[Length] = '\0';
+			debug("cache miss for \"%s\" in \"%s\"", name, Parent->Path.c_str());
+
+			int ret = Parent->fsi->Ops.Lookup(Parent->inode, name, &inode);
+			if (ret != 0)
 			{
-				debug("current parent \"%s\"", node->Parent->Path.c_str());
-				node = node->Parent;
-				debug("new parent \"%s\"", node->Parent ? node->Parent->Path.c_str() : "<null>");
+				if (ret == -ENOENT && (Parent->fsi->Flags & FS_NEGATIVE_CACHE))
+					NameCacheInsert(Parent.get(), Name, Length, hash, nullptr);
+				return {nullptr, ret};
 			}
+			generation = Parent->Generation;
 		}
 
-		std::string currentPath = node->Path;
-		if (currentPath.empty())
-			currentPath = "/";
+		SmartWriteLock(Parent->ChildrenLock);
+
+		/* Another lookup got here first */
+		if (Node child = search())
+			return {child, 0};
 
-		do
+		/* The entry may be gone or replaced, ask again while nothing can change */
+		if (Parent->Generation != generation)
 		{
-			std::string segmentStr(segment.begin, segment.size);
-			debug("Current segment is \"%s\"", segmentStr.c_str());
+			int ret = Parent->fsi->Ops.Lookup(Parent->inode, name, &inode);
+			if (ret != 0)
+				return {nullptr, ret};
+		}
 
-			eNode ret = node->CachedSearch(segmentStr);
-			if (ret == false)
-			{
-				debug("cache miss for \"%s\"", segmentStr.c_str());
+		Node node = Convert(Parent, inode);
+		node->Name.assign(Name, Length);
+		if (Parent->Path.empty() || Parent->Path == "/")
+			node->Path = "/" + node->Name;
+		else
+			node->Path = Parent->Path + "/" + node->Name;
+
+		NameCacheInsert(Parent.get(), Name, Length, hash, node);
+		return {node, 0};
+	}
 
-				if (node->fsi->Ops.Lookup == nullptr)
-					return {nullptr, ENOTSUP};
+	eNode Virtual::Lookup(Node &Parent, const char *Path)
+	{
+		assert(Parent != nullptr);
 
-				Inode *inode;
-				int ret = node->fsi->Ops.Lookup(node->inode, segmentStr.c_str(), &inode);
-				if (ret != 0)
-					return {nullptr, ret};
+		Node node = Parent;
+		if (Path[0] == '/')
+		{
+			while (node->Parent)
+				node = node->Parent;
+		}
 
-				if (currentPath == "/")
-					currentPath += segmentStr;
-				else
-					currentPath += "/" + segmentStr;
+		const char *segment = Path;
+		while (true)
+		{
+			while (*segment == '/')
+				segment++;
+			if (*segment == '\0')
+				break;
+
+			const char *end = segment;
+			while (*end != '\0' && *end != '/')
+				end++;
+			size_t length = end - segment;
 
-				node = Convert(node, inode);
-				node->Name = segmentStr;
-				node->Path = currentPath;
+			if (length == 1 && segment[0] == '.')
+			{
+				segment = end;
+				continue;
 			}
-			else
+
+			if (length == 2 && segment[0] == '.' && segment[1] == '.')
 			{
-				debug("cache hit for \"%s\"", segmentStr.c_str());
-				node = ret;
-				if (currentPath == "/")
-					currentPath += segmentStr;
-				else
-					currentPath += "/" + segmentStr;
+				if (node->Parent)
+					node = node->Parent;
+				segment = end;
+				continue;
 			}
-		} while (cwk_path_get_next_segment(&segment));
+
+			eNode ret = this->LookupName(node, segment, length);
+			if (ret.Error != 0)
+				return ret;
+
+			node = ret.Value;
+			segment = end;
+		}
 
 		return {node, 0};
 	}
@@ -241,6 +287,18 @@ namespace vfs
 		if (Parent->fsi->Ops.Create == nullptr)
 			return {nullptr, ENOTSUP};
 
+		SmartWriteLock(Parent->ChildrenLock);
+
+		/* Created by someone else since the lookup above */
+		for (const Node &child : Parent->Children)
+		{
+			if (child.get() == nullptr || child->Name != Name)
+				continue;
+			if (ErrorIfExists)
+				return {nullptr, EEXIST};
+			return {child, 0};
+		}
+
 		Inode *inode;
 		int ret = Parent->fsi->Ops.Create(Parent->inode, Name.c_str(), Mode, &inode);
 		if (ret != 0)
@@ -250,6 +308,10 @@ namespace vfs
 		node->Name = Name;
 		std::string unormalized = Parent->Path == "/" ? "/" + Name : Parent->Path + "/" + Name;
 		node->Path = fs->NormalizePath(Parent, unormalized);
+		Parent->Generation++;
+
+		/* Replaces the negative entry left by the lookup above */
+		NameCacheInsert(Parent.get(), Name.c_str(), Name.size(), HashName(Name.c_str(), Name.size()), node);
 		return {node, 0};
 	}
 
@@ -259,48 +321,78 @@ namespace vfs
 			return -EINVAL;
 		if (Parent->fsi->Ops.Remove == nullptr)
 			return -ENOTSUP;
-		int ret = Parent->fsi->Ops.Remove(Parent->inode, Name.c_str());
-		if (ret == 0)
+
+		/* Dropped after the lock, the last reference deletes the inode */
+		Node removed;
+		SmartWriteLock(Parent->ChildrenLock);
+
+		auto it = Parent->Children.begin();
+		for (; it != Parent->Children.end(); ++it)
 		{
-			for (auto it = Parent->Children.begin(); it != Parent->Children.end(); ++it)
-			{
-				if (it->get()->Name != Name)
-					continue;
-				Parent->Children.erase(it);
+			if (it->get() != nullptr && it->get()->Name == Name)
 				break;
-			}
 		}
-		return ret;
+
+		/* Nothing caches the inode, so it can be deleted right away */
+		Inode *uncached = nullptr;
+		if (it == Parent->Children.end())
+		{
+			int ret = Parent->fsi->Ops.Lookup(Parent->inode, Name.c_str(), &uncached);
+			if (ret != 0)
+				return ret;
+		}
+
+		int ret = Parent->fsi->Ops.Remove(Parent->inode, Name.c_str());
+		if (ret != 0)
+			return ret;
+
+		NameCacheInvalidate(Parent.get(), Name.c_str(), Name.size());
+		Parent->Generation++;
+		if (uncached == nullptr)
+		{
+			removed = std::move(*it);
+			Parent->Children.erase(it);
+			removed->Flags.Unlinked = 1;
+		}
+		else if (Parent->fsi->SuperOps.DeleteInode)
+			Parent->fsi->SuperOps.DeleteInode(Parent->fsi, uncached);
+		return 0;
 	}
 
 	int Virtual::Remove(Node &node)
 	{
-		if (!node->Parent)
+		/* Keeps the name and parent from changing under us */
+		SmartLock(RenameLock);
+		Node parent = node->Parent;
+		if (!parent)
 			return -EINVAL;
-		if (node->Parent->fsi->Ops.Remove == nullptr)
-			return -ENOTSUP;
-		int ret = node->Parent->fsi->Ops.Remove(node->inode, node->Name.c_str());
-		if (ret == 0)
-		{
-			Node &p = node->Parent;
-			for (auto it = p->Children.begin(); it != p->Children.end(); ++it)
-			{
-				if (it->get() != node.get())
-					continue;
-				p->Children.erase(it);
-				break;
-			}
-		}
-		return ret;
+		return this->Remove(parent, node->Name);
 	}
 
 	int Virtual::Rename(Node &node, std::string NewName)
 	{
 		if (node->fsi->Ops.Rename == nullptr)
 			return -ENOTSUP;
+
+		SmartLock(RenameLock);
+		Node parent = node->Parent;
+		if (parent)
+			parent->ChildrenLock.WriteLock(__FUNCTION__);
+
 		int ret = node->fsi->Ops.Rename(node->inode, node->Name.c_str(), NewName.c_str());
 		if (ret == 0)
+		{
+			if (parent)
+			{
+				NameCacheInvalidate(parent.get(), node->Name.c_str(), node->Name.size());
+				NameCacheInvalidate(parent.get(), NewName.c_str(), NewName.size());
+				parent->Generation++;
+			}
 			node->Name = NewName;
+		}
+
+		if (parent)
+			parent->ChildrenLock.WriteUnlock();
 		return ret;
 	}
 
@@ -314,6 +406,11 @@ namespace vfs
 
 		/* TODO: cache buffer */
 
+		/* Pipes and devices block and order their I/O themselves */
+		if (!Target->IsRegularFile())
+			return Target->__Read(Buffer, Size, Offset);
+
+		SmartReadLock(Target->IOLock);
 		return Target->__Read(Buffer, Size, Offset);
 	}
 
@@ -327,6 +424,10 @@ namespace vfs
 
 		/* TODO: cache buffer */
 
+		if (!Target->IsRegularFile())
+			return Target->__Write(Buffer, Size, Offset);
+
+		SmartWriteLock(Target->IOLock);
 		return Target->__Write(Buffer, Size, Offset);
 	}
 
@@ -340,142 +441,214 @@ namespace vfs
 
 		/* TODO: cache buffer */
 
+		SmartWriteLock(Target->IOLock);
 		return Target->__Truncate(Size);
 	}
 
-	__no_sanitize("alignment") ssize_t Virtual::ReadDirectory(Node &Target, kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	__no_sanitize("alignment") int Virtual::FillSnapshot(Node &Target, DirectorySnapshot &Snapshot)
 	{
-		if (!Target->IsDirectory() && !Target->IsMountPoint())
-			return -ENOTDIR;
+		SmartReadLock(Target->ChildrenLock);
+		Snapshot.Entries.clear();
 
-		ssize_t total = 0;
-		off_t entryIndex = 0;
-		std::list<std::string> seen;
+		/* Index of the first entry with a given name hash */
+		flat_hash_map<uint64_t, size_t> seen;
+		auto listed = [&](const char *Name, size_t Length, uint64_t Hash)
+		{
+			auto it = seen.find(Hash);
+			if (it == seen.end())
+				return false;
 
-		uint8_t *bufPtr = reinterpret_cast<uint8_t *>(Buffer);
+			if (Snapshot.Entries[it->second].Name.compare(0, std::string::npos, Name, Length) == 0)
+				return true;
 
-		if (Target->fsi && Target->fsi->Ops.ReadDir)
+			/* Two names with the same hash, rare enough to just scan */
+			for (const auto &entry : Snapshot.Entries)
+			{
+				if (entry.Name.compare(0, std::string::npos, Name, Length) == 0)
+					return true;
+			}
+			return false;
+		};
+
+		auto add = [&](ino_t Inode, unsigned char Type, const char *Name, size_t Length)
 		{
-			const size_t tempBufSize = 4096;
-			std::unique_ptr<uint8_t[]> tempBuf(new uint8_t[tempBufSize]);
+			uint64_t hash = HashName(Name, Length);
+			if (listed(Name, Length, hash))
+				return;
 
-			off_t fsOffset = Offset;
-			ssize_t read = Target->fsi->Ops.ReadDir(Target->inode, (kdirent *)tempBuf.get(), tempBufSize, fsOffset, Entries);
-			if (read > 0)
+			seen[hash] = Snapshot.Entries.size();
+			Snapshot.Entries.push_back({Inode, Type, std::string(Name, Length)});
+		};
+
+		if (Target->fsi && Target->fsi->Ops.ReadDir)
+		{
+			const size_t bufSize = 4096;
+			std::unique_ptr<uint8_t[]> buf(new uint8_t[bufSize]);
+			off_t offset = 0;
+			while (true)
 			{
+				ssize_t read = Target->fsi->Ops.ReadDir(Target->inode, (kdirent *)buf.get(), bufSize, offset, LONG_MAX);
+				if (read < 0)
+				{
+					Snapshot.Entries.clear();
+					return (int)read;
+				}
+				if (read == 0)
+					break;
+
+				/* d_off is the offset of the entry itself */
+				off_t next = offset;
 				ssize_t pos = 0;
 				while (pos < read)
 				{
-					kdirent *ent = (kdirent *)(tempBuf.get() + pos);
+					kdirent *ent = (kdirent *)(buf.get() + pos);
 					if (ent->d_reclen == 0)
 						break;
 
-					size_t reclen = ent->d_reclen;
-					if (total + reclen > Size)
-						break;
-
-					memcpy(bufPtr, ent, reclen);
-					seen.push_back(ent->d_name);
-					bufPtr += reclen;
-					total += reclen;
-					pos += reclen;
-					entryIndex++;
+					add(ent->d_ino, ent->d_type, ent->d_name, strlen(ent->d_name));
+					if (ent->d_off >= next)
+						next = ent->d_off + 1;
+					pos += ent->d_reclen;
 				}
+
+				if (next == offset)
+					break;
+				offset = next;
 			}
 		}
+		else
+		{
+			add(Target->inode ? Target->inode->Index : 0, DT_DIR, ".", 1);
+			if (Target->Parent && Target->Parent->inode)
+				add(Target->Parent->inode->Index, DT_DIR, "..", 2);
+		}
 
 		for (const auto &child : Target->Children)
 		{
-			if (std::find(seen.begin(), seen.end(), child->Name) != seen.end())
+			if (!child)
 				continue;
 
-			if (entryIndex < Offset)
-			{
-				entryIndex++;
-				continue;
-			}
+			add(child->inode ? child->inode->Index : 0,
+				child->inode ? IFTODT(child->inode->Mode) : DT_UNKNOWN,
+				child->Name.c_str(), child->Name.size());
+		}
+		return 0;
+	}
 
-			uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + child->Name.size() + 1);
-			if (total + reclen > (ssize_t)Size)
+	/**
+	 * Copy entries of Snapshot starting at Offset, up to Size bytes
+	 * or Entries entries, and move Offset past the copied ones
+	 */
+	__no_sanitize("alignment") static ssize_t CopySnapshot(DirectorySnapshot &Snapshot, kdirent *Buffer, size_t Size, off_t &Offset, off_t Entries)
+	{
+		if (Offset < 0)
+			return -EINVAL;
+
+		uint8_t *bufPtr = reinterpret_cast<uint8_t *>(Buffer);
+		size_t total = 0;
+		off_t copied = 0;
+		while ((size_t)Offset < Snapshot.Entries.size() && copied < Entries)
+		{
+			const DirectorySnapshot::Entry &entry = Snapshot.Entries[Offset];
+			uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + entry.Name.size() + 1);
+			if (total + reclen > Size)
+			{
+				/* Not even one entry fits */
+				if (total == 0)
+					return -EINVAL;
 				break;
+			}
 
-			kdirent *ent = (kdirent *)bufPtr;
-			ent->d_ino = child->inode ? child->inode->Index : 0;
-			ent->d_off = entryIndex++;
+			kdirent *ent = (kdirent *)(bufPtr + total);
+			ent->d_ino = entry.Inode;
+			ent->d_off = Offset;
 			ent->d_reclen = reclen;
-			ent->d_type = child->inode ? IFTODT(child->inode->Mode) : DT_UNKNOWN;
-			strcpy(ent->d_name, child->Name.c_str());
+			ent->d_type = entry.Type;
+			memcpy(ent->d_name, entry.Name.c_str(), entry.Name.size() + 1);
 
-			bufPtr += reclen;
 			total += reclen;
-			seen.push_back(child->Name);
+			copied++;
+			Offset++;
 		}
 
 		return total;
 	}
 
-	__no_sanitize("alignment") std::list<Node> Virtual::ReadDirectory(Node &Target)
+	ssize_t Virtual::ReadDirectory(Node &Target, kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	{
+		if (!Target->IsDirectory() && !Target->IsMountPoint())
+			return -ENOTDIR;
+
+		DirectorySnapshot snapshot;
+		int ret = FillSnapshot(Target, snapshot);
+		if (ret < 0)
+			return ret;
+		return CopySnapshot(snapshot, Buffer, Size, Offset, Entries);
+	}
+
+	ssize_t Virtual::ReadDirectory(Node &Target, DirectorySnapshot *&Snapshot, kdirent *Buffer, size_t Size, off_t &Offset)
+	{
+		if (!Target->IsDirectory() && !Target->IsMountPoint())
+			return -ENOTDIR;
+
+		/* Offset indexes the snapshot, rebuilding it in the middle of a
+		   pass would shift the entries after a removed one past the
+		   cursor. Changes made since the pass started are only seen
+		   after rewinding. */
+		bool refill = Snapshot == nullptr || Offset == 0;
+		if (Snapshot == nullptr)
+			Snapshot = new DirectorySnapshot;
+
+		if (refill)
+		{
+			int ret = FillSnapshot(Target, *Snapshot);
+			if (ret < 0)
+			{
+				/* Half filled, the next call has to start over */
+				delete Snapshot;
+				Snapshot = nullptr;
+				return ret;
+			}
+		}
+
+		return CopySnapshot(*Snapshot, Buffer, Size, Offset, LONG_MAX);
+	}
+
+	std::list<Node> Virtual::ReadDirectory(Node &Target)
 	{
 		if (!Target->IsDirectory() && !Target->IsMountPoint())
 			return {};
-		std::list<Node> ret;
-		std::list<std::string> seen;
 
-		if (Target->fsi && Target->fsi->Ops.ReadDir)
+		DirectorySnapshot snapshot;
+		if (FillSnapshot(Target, snapshot) < 0)
+			return {};
+
+		flat_hash_map<uint64_t, Node> cached;
 		{
-			const size_t bufSize = 4096;
-			std::unique_ptr<uint8_t[]> buf(new uint8_t[bufSize]);
-			off_t offset = 0;
-			while (true)
+			SmartReadLock(Target->ChildrenLock);
+			for (const auto &child : Target->Children)
 			{
-				ssize_t read = Target->fsi->Ops.ReadDir(Target->inode, (kdirent *)buf.get(), bufSize, offset, LONG_MAX);
-				if (read <= 0)
-					break;
-				ssize_t pos = 0;
-				while (pos < read)
-				{
-					kdirent *ent = (kdirent *)(buf.get() + pos);
-					if (ent->d_reclen == 0)
-						break;
-					debug("%s", ent->d_name);
-					if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
-					{
-						pos += ent->d_reclen;
-						continue;
-					}
-
-					seen.push_back(ent->d_name);
-
-					auto it = std::find_if(Target->Children.begin(), Target->Children.end(),
-										   [&](const Node &n)
-										   { return n->Name == ent->d_name; });
-
-					if (it != Target->Children.end())
-						ret.push_back(*it);
-					else
-					{
-						eNode result = Lookup(Target, ent->d_name);
-						if (result.Error == 0 && result.Value)
-						{
-							Target->Children.push_back(result.Value);
-							result.Value->Parent = Target;
-							ret.push_back(result.Value);
-						}
-					}
-					pos += ent->d_reclen;
-				}
-				offset += read;
+				if (child)
+					cached[HashName(child->Name.c_str(), child->Name.size())] = child;
 			}
 		}
 
-		for (const auto &child : Target->Children)
+		std::list<Node> ret;
+		for (const auto &entry : snapshot.Entries)
 		{
-			if (std::find(seen.begin(), seen.end(), child->Name) != seen.end())
+			if (entry.Name == "." || entry.Name == "..")
 				continue;
-			if (child->Name == "." || child->Name == "..")
+
+			auto it = cached.find(HashName(entry.Name.c_str(), entry.Name.size()));
+			if (it != cached.end() && it->second->Name == entry.Name)
+			{
+				ret.push_back(it->second);
 				continue;
-			ret.push_back(child);
-			seen.push_back(child->Name.c_str());
+			}
+
+			eNode result = Lookup(Target, entry.Name.c_str());
+			if (result.Error == 0 && result.Value)
+				ret.push_back(result.Value);
 		}
 
 		return ret;
@@ -500,6 +673,10 @@ namespace vfs
 	{
 		/* TODO: cache */
 
+		if (Target->inode == nullptr || !Target->IsRegularFile())
+			return Target->__Stat(Stat);
+
+		SmartReadLock(Target->IOLock);
 		return Target->__Stat(Stat);
 	}
 
@@ -524,6 +701,65 @@ namespace vfs
 		return Target->__Close();
 	}
 
+	int Virtual::Poll(Node &Target, PollTable *Table)
+	{
+		if (Target->fsi->Ops.Poll == nullptr)
+			return POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM;
+
+		return Target->__Poll(Table);
+	}
+
+	ssize_t Virtual::Transfer(Node &In, off_t InOffset, Node &Out, off_t OutOffset, size_t Length, bool NonBlock)
+	{
+		if (In->IsDirectory() || Out->IsDirectory())
+			return -EISDIR;
+
+		/* Pipes hold page buffers already, fill or drain them in place */
+		Pipe *inPipe = Pipe::FromNode(In);
+		Pipe *outPipe = Pipe::FromNode(Out);
+		if (inPipe && (In->inode->Flags & O_ACCMODE) != O_RDONLY)
+			return -EBADF;
+		if (outPipe && (Out->inode->Flags & O_ACCMODE) != O_WRONLY)
+			return -EBADF;
+
+		if (inPipe && outPipe)
+			return Pipe::Splice(inPipe, outPipe, Length, NonBlock);
+		if (outPipe)
+			return outPipe->SpliceFrom(In, InOffset, Length, NonBlock);
+		if (inPipe)
+			return inPipe->SpliceTo(Out, OutOffset, Length, NonBlock);
+
+		uint8_t *page = (uint8_t *)KernelAllocator.RequestPages(1);
+		size_t done = 0;
+		ssize_t ret = 0;
+		while (done < Length)
+		{
+			size_t want = std::min((size_t)PAGE_SIZE, Length - done);
+			ret = this->Read(In, page, want, InOffset + done);
+			if (ret <= 0)
+				break;
+
+			size_t got = ret;
+			size_t written = 0;
+			while (written < got)
+			{
+				ret = this->Write(Out, page + written, got - written, OutOffset + done + written);
+				if (ret <= 0)
+					break;
+				written += ret;
+			}
+
+			done += written;
+			if (written < got || got < want)
+				break;
+		}
+
+		KernelAllocator.FreePages(page, 1);
+		if (done == 0 && ret < 0)
+			return ret;
+		return done;
+	}
+
 	FileSystemInfo *Virtual::Probe(FileSystemDevice *Device)
 	{
 		for (auto &&i : FileSystems)
@@ -557,7 +793,13 @@ namespace vfs
 		ret->Path = fs->NormalizePath(Parent, unormalized);
 		// ret->Link =
 		ret->Parent = Parent;
+
+		SmartWriteLock(Parent->ChildrenLock);
 		Parent->Children.push_back(ret);
+		Parent->Generation++;
+
+		/* The mount hides whatever the name resolved to before */
+		NameCacheInsert(Parent.get(), Name.c_str(), Name.size(), HashName(Name.c_str(), Name.size()), ret);
 		return {ret, 0};
 	}
 
@@ -591,6 +833,13 @@ namespace vfs
 		}
 
 		fixme("untested code");
+		if (node->Parent)
+		{
+			SmartWriteLock(node->Parent->ChildrenLock);
+			NameCacheInvalidate(node->Parent.get(), node->Name.c_str(), node->Name.size());
+			node->Parent->Generation++;
+		}
+
 		std::shared_ptr<NodeCache> &ptr = node;
 		ptr.reset();
 		return 0;
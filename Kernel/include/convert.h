@@ -61,26 +61,16 @@ extern "C"
 	int memcmp(const void *vl, const void *vr, size_t n);
 	void *memchr(const void *ptr, int ch, size_t count);
 
-	void *memcpy_sse(void *dest, const void *src, size_t n);
-	void *memcpy_sse2(void *dest, const void *src, size_t n);
-	void *memcpy_sse3(void *dest, const void *src, size_t n);
-	void *memcpy_ssse3(void *dest, const void *src, size_t n);
-	void *memcpy_sse4_1(void *dest, const void *src, size_t n);
-	void *memcpy_sse4_2(void *dest, const void *src, size_t n);
-
-	void *memset_sse(void *dest, int c, size_t n);
-	void *memset_sse2(void *dest, int c, size_t n);
-	void *memset_sse3(void *dest, int c, size_t n);
-	void *memset_ssse3(void *dest, int c, size_t n);
-	void *memset_sse4_1(void *dest, int c, size_t n);
-	void *memset_sse4_2(void *dest, int c, size_t n);
-
-	void *memmove_sse(void *dest, const void *src, size_t n);
-	void *memmove_sse2(void *dest, const void *src, size_t n);
-	void *memmove_sse3(void *dest, const void *src, size_t n);
-	void *memmove_ssse3(void *dest, const void *src, size_t n);
-	void *memmove_sse4_1(void *dest, const void *src, size_t n);
-	void *memmove_sse4_2(void *dest, const void *src, size_t n);
+	void *memcpy_erms(void *dest, const void *src, size_t n);
+	void *memset_erms(void *dest, int c, size_t n);
+	void *memcpy_nt(void *dest, const void *src, size_t n);
+	void *memset_nt(void *dest, int c, size_t n);
+	void *memcpy_avx2(void *dest, const void *src, size_t n);
+	void *memset_avx2(void *dest, int c, size_t n);
+
+	void *memcpy_engine(void *dest, const void *src, size_t n);
+	void *memset_engine(void *dest, int c, size_t n);
+	void *memmove_engine(void *dest, const void *src, size_t n);
 
 	long unsigned __strlen(const char s[]);
 
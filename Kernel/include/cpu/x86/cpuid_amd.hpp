@@ -352,7 +352,8 @@ namespace CPU
 						uint32_t Reserved2 : 1;
 						uint32_t SMEP : 1;
 						uint32_t BMI2 : 1;
-						uint32_t Reserved3 : 1;
+						/** @brief Enhanced REP MOVSB/STOSB */
+						uint32_t ERMS : 1;
 						uint32_t INVPCID : 1;
 						uint32_t Reserved4 : 1;
 						uint32_t PQM : 1;
@@ -399,7 +400,10 @@ namespace CPU
 				{
 					struct
 					{
-						uint32_t Reserved : 32;
+						uint32_t Reserved0 : 4;
+						/** @brief Fast Short REP MOVSB */
+						uint32_t FSRM : 1;
+						uint32_t Reserved1 : 27;
 					};
 					cpuid_t raw;
 				} EDX;
@@ -25,6 +25,7 @@
 #include <interface/block.h>
 #include <interface/usb.h>
 #include <fs/vfs.hpp>
+#include <fs/poll.hpp>
 #include <unordered_map>
 #include <memory.hpp>
 #include <ints.hpp>
@@ -132,9 +133,14 @@ namespace Driver
 
 		void InitializeDeviceDirectory();
 
+		/** Start the thread that wakes the input queues for interrupt handlers */
+		void StartInputThread();
+
 	public:
 		RingBuffer<KeyboardReport> GlobalKeyboardInputReports;
 		RingBuffer<MouseReport> GlobalMouseInputReports;
+		vfs::WaitQueue GlobalKeyboardInputQueue;
+		vfs::WaitQueue GlobalMouseInputQueue;
 
 		struct DeviceInode
 		{
@@ -0,0 +1,87 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <types.h>
+#include <memory>
+
+class NodeCache;
+typedef std::shared_ptr<NodeCache> Node;
+
+/* Hash buckets, must be a power of two */
+#define DCACHE_HASH_SIZE 4096
+
+/* Entries kept before the least recently used ones are dropped */
+#define DCACHE_MAX_ENTRIES 16384
+
+/* Longer names are not cached, the walk falls back to the filesystem */
+#define DCACHE_NAME_LENGTH 39
+
+namespace vfs
+{
+	enum NameCacheResult
+	{
+		NAME_CACHE_MISS,
+		NAME_CACHE_HIT,
+		/* The name is known not to exist */
+		NAME_CACHE_NEGATIVE
+	};
+
+	struct NameCacheStatistics
+	{
+		size_t Entries;
+		size_t Negative;
+		uint64_t Hits;
+		uint64_t NegativeHits;
+		uint64_t Misses;
+		uint64_t Evictions;
+	};
+
+	/**
+	 * Hash a path component in place
+	 */
+	uint64_t HashName(const char *Name, size_t Length);
+
+	/**
+	 * Unique for every NodeCache ever created, names are cached
+	 * under the ID of their parent so that entries of a freed
+	 * node can never match a new one at the same address.
+	 */
+	uint64_t AllocateNodeID();
+
+	/**
+	 * Look a name up in the name cache
+	 *
+	 * @param Result Set on NAME_CACHE_HIT
+	 */
+	NameCacheResult NameCacheLookup(NodeCache *Parent, const char *Name, size_t Length, uint64_t Hash, Node *Result);
+
+	/**
+	 * Remember that Name in Parent is Target, or that
+	 * it doesn't exist if Target is nullptr
+	 */
+	void NameCacheInsert(NodeCache *Parent, const char *Name, size_t Length, uint64_t Hash, Node Target);
+
+	/**
+	 * Forget Name in Parent, call on anything that adds,
+	 * removes or renames it
+	 */
+	void NameCacheInvalidate(NodeCache *Parent, const char *Name, size_t Length);
+
+	NameCacheStatistics GetNameCacheStatistics();
+}
@@ -0,0 +1,156 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <fs/poll.hpp>
+#include <fs/vfs.hpp>
+#include <unordered_map>
+#include <lock.hpp>
+#include <atomic>
+#include <list>
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLLEXCLUSIVE (1U << 28)
+#define EPOLLWAKEUP (1U << 29)
+#define EPOLLONESHOT (1U << 30)
+#define EPOLLET (1U << 31)
+
+/* Instances nested deeper than this fail with ELOOP */
+#define EPOLL_MAX_NESTS 4
+
+namespace vfs
+{
+	class EventPoll;
+
+	/**
+	 * A watched descriptor. The item is referenced by the
+	 * interest map and by epoll_wait while it re-polls it
+	 * without the epoll lock held.
+	 */
+	struct EventPollItem
+	{
+		EventPoll *Owner = nullptr;
+		int Descriptor = -1;
+		Node node = nullptr;
+		uint32_t Events = 0;
+		uint64_t Data = 0;
+		PollTable Table;
+		std::atomic_int References = 1;
+
+		bool Ready = false;
+		bool Disabled = false;
+		bool Removed = false;
+		std::list<EventPollItem *>::iterator ReadyEntry;
+
+		/* The description watched, on whose list this item is */
+		FileDescriptorTable::Fildes *Description = nullptr;
+		std::list<EventPollItem *>::iterator DescriptionEntry;
+	};
+
+	class EventPoll
+	{
+	public:
+		struct Event
+		{
+			uint32_t Events;
+			uint64_t Data;
+		};
+
+		class EventPollInode
+		{
+		public:
+			struct Inode Node;
+			EventPoll *Owner = nullptr;
+		};
+
+	private:
+		typedef EventPollItem Item;
+
+		NewLock(EpollLock);
+		std::unordered_map<int, Item *> Items;
+		std::list<Item *> ReadyList;
+		WaitQueue ReadyQueue;
+
+		static void ItemCallback(PollEntry *Entry, int Events);
+
+		/**
+		 * Queue an item on the ready list, the epoll lock must be held
+		 * @return true if the item was queued
+		 */
+		bool MarkReady(Item *item);
+
+		/**
+		 * Drop a reference, never call with the epoll lock held
+		 */
+		static void Put(Item *item);
+
+		/**
+		 * Take an item off the list of its description,
+		 * the watch lock must be held
+		 */
+		static void Unwatch(Item *item);
+
+		/**
+		 * Look for To in From and the instances nested in it,
+		 * the watch lock must be held so none are added meanwhile
+		 *
+		 * @return -ELOOP if found or nested too deep, 0 otherwise
+		 */
+		static int CheckNesting(EventPoll *From, EventPoll *To, int Depth);
+
+		int Harvest(Event *Events, int MaxEvents);
+
+	public:
+		/**
+		 * Add, modify or remove a watched node
+		 *
+		 * @param Operation EPOLL_CTL_*
+		 * @param Descriptor The file descriptor, used as the key
+		 * @param Description The open file behind Descriptor, the
+		 *                    item is dropped when it is released
+		 * @param event Events and user data, ignored for EPOLL_CTL_DEL
+		 */
+		int Control(int Operation, int Descriptor, FileDescriptorTable::Fildes *Description, const Event *event);
+
+		/**
+		 * Drop the items watching an open file description,
+		 * called when its last reference goes away
+		 */
+		static void Release(FileDescriptorTable::Fildes *Description);
+
+		/**
+		 * Wait for events
+		 *
+		 * @param Timeout Timeout in nanoseconds, negative to wait forever
+		 * @return Number of events stored, -EINTR if a signal is pending
+		 */
+		int Wait(Event *Events, int MaxEvents, int64_t Timeout);
+
+		int Poll(PollTable *Table);
+
+		static int Create(Node &Result);
+		static EventPoll *FromNode(Node &node);
+
+		EventPoll() = default;
+		~EventPoll();
+	};
+}
@@ -17,14 +17,47 @@
 
 #pragma once
 
+#include <interface/syscalls.h>
 #include <fs/node.hpp>
-#include <unordered_map>
+#include <lock.hpp>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <list>
+
+namespace NetworkSocket
+{
+	struct SocketAddress;
+}
 
 namespace vfs
 {
+	struct EventPollItem;
+
+	/**
+	 * A listing of a directory, filled once and served
+	 * to getdents until the directory changes.
+	 */
+	struct DirectorySnapshot
+	{
+		struct Entry
+		{
+			ino_t Inode;
+			unsigned char Type;
+			std::string Name;
+		};
+
+		std::vector<Entry> Entries;
+	};
+
 	class FileDescriptorTable
 	{
 	public:
+		/**
+		 * An open file description. Descriptors made by dup()
+		 * and fork() point to the same one, so they share the
+		 * offset and the status flags.
+		 */
 		struct Fildes
 		{
 			enum FildesType
@@ -32,39 +65,144 @@ namespace vfs
 				FD_INODE,
 				FD_PIPE,
 				FD_SOCKET,
-			} Type;
+			} Type = FD_INODE;
 			mode_t Mode = 0;
 			int Flags = 0;
 			Node node = nullptr;
-			int References = 0;
 			off_t Offset = 0;
+			std::atomic_int References = 1;
+
+			/* Built by the first getdents on a directory */
+			DirectorySnapshot *Directory = nullptr;
+			NewLock(DirectoryLock);
+
+			/* epoll items watching this, dropped with it like on Linux */
+			std::list<EventPollItem *> EventPollItems;
+
+			void Get() { References++; }
+			void Put()
+			{
+				if (--References == 0)
+					delete this;
+			}
+
+			~Fildes();
+		};
+
+		/**
+		 * Keeps an open file description alive while in scope,
+		 * even if another thread closes the descriptor.
+		 */
+		class FildesReference
+		{
+		private:
+			Fildes *Pointer = nullptr;
 
-			int operator==(const Fildes &other)
+		public:
+			Fildes *get() const { return Pointer; }
+			Fildes *operator->() const { return Pointer; }
+			Fildes &operator*() const { return *Pointer; }
+			bool operator==(std::nullptr_t) const { return Pointer == nullptr; }
+			explicit operator bool() const { return Pointer != nullptr; }
+
+			FildesReference &operator=(const FildesReference &Other)
+			{
+				if (Other.Pointer)
+					Other.Pointer->Get();
+				if (Pointer)
+					Pointer->Put();
+				Pointer = Other.Pointer;
+				return *this;
+			}
+
+			FildesReference() = default;
+			FildesReference(std::nullptr_t) {}
+
+			/* Takes over the reference the caller holds */
+			explicit FildesReference(Fildes *Adopt) : Pointer(Adopt) {}
+			FildesReference(const FildesReference &Other) : Pointer(Other.Pointer)
 			{
-				return Type == other.Type &&
-					   Mode == other.Mode &&
-					   Flags == other.Flags &&
-					   node.get() == other.node.get() &&
-					   References == other.References &&
-					   Offset == other.Offset;
+				if (Pointer)
+					Pointer->Get();
+			}
+			FildesReference(FildesReference &&Other) : Pointer(Other.Pointer) { Other.Pointer = nullptr; }
+
+			~FildesReference()
+			{
+				if (Pointer)
+					Pointer->Put();
 			}
 		};
 
 	private:
+		struct Slot
+		{
+			Fildes *Description = nullptr;
+			bool CloseOnExec = false;
+		};
+
 		Node fdDir = nullptr;
 		void *Owner;
 
+		/**
+		 * Descriptors index Slots directly. Used has a bit set
+		 * for every open descriptor, and no free descriptor
+		 * is below word FreeHint of it.
+		 */
+		NewLock(TableLock);
+		std::vector<Slot> Slots;
+		std::vector<uint64_t> Used;
+		size_t FreeHint = 0;
+
 		int AddFileDescriptor(const char *AbsolutePath, mode_t Mode, int Flags);
 		int RemoveFileDescriptor(int FileDescriptor);
-		int GetFreeFileDescriptor();
+
+		/* Drops the /proc link of a closed descriptor, never the file */
+		void RemoveLink(int FileDescriptor);
+
+		/* These expect TableLock to be held */
+		int GetFreeFileDescriptor(int Minimum);
+		void SetSlot(int FileDescriptor, Fildes *Description, bool CloseOnExec);
+		Fildes *ClearSlot(int FileDescriptor);
+
+		/**
+		 * Give a description the lowest free descriptor
+		 *
+		 * @param Description Takes over the caller's reference,
+		 *                    which is dropped on failure
+		 * @return The descriptor, or -EMFILE
+		 */
+		int InstallFileDescriptor(Fildes *Description, bool CloseOnExec, int Minimum = 0);
 
 	public:
-		std::unordered_map<int, Fildes> FileMap;
+		/**
+		 * Look up an open descriptor
+		 *
+		 * @return The description, nullptr if FileDescriptor
+		 *         isn't open
+		 */
+		FildesReference GetFileDescriptor(int FileDescriptor);
 
+		/**
+		 * @return One past the highest descriptor that can be
+		 *         open right now
+		 */
+		int GetTableSize();
+
+		/* Status flags, shared with dup()ed descriptors */
 		int GetFlags(int FileDescriptor);
 		int SetFlags(int FileDescriptor, int Flags);
+
+		/* FD_CLOEXEC, private to the descriptor */
+		int GetDescriptorFlags(int FileDescriptor);
+		int SetDescriptorFlags(int FileDescriptor, int Flags);
+
+		/* Copies every descriptor, FD_CLOEXEC included */
 		void Fork(FileDescriptorTable *Parent);
 
+		/* Closes the FD_CLOEXEC descriptors, called by exec */
+		void CloseOnExecDescriptors();
+
 		int usr_open(const char *pathname, int flags, mode_t mode);
 		int usr_creat(const char *pathname, mode_t mode);
 		ssize_t usr_read(int fd, void *buf, size_t count);
@@ -78,9 +216,18 @@ namespace vfs
 		int usr_lstat(const char *pathname, kstat *statbuf);
 		int usr_dup(int oldfd);
 		int usr_dup2(int oldfd, int newfd);
+		int usr_dupfd(int oldfd, int minfd, int flags);
 		int usr_ioctl(int fd, unsigned long request, void *argp);
+		int usr_pipe(int pipefd[2], int flags);
+		ssize_t usr_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+		ssize_t usr_copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+		int usr_epoll_create(int flags);
+		int usr_socket(int domain, int type, int protocol, int flags);
+		int usr_accept(int sockfd, NetworkSocket::SocketAddress *addr, int flags);
+		int usr_io_uring_setup(uint32_t entries, kio_uring_params *params,
+							   int (*ConvertResult)(int Result) = nullptr);
 
 		FileDescriptorTable(void *Owner);
-		~FileDescriptorTable() = default;
+		~FileDescriptorTable();
 	};
 }
@@ -18,7 +18,10 @@
 #pragma once
 
 #include <interface/fs.h>
+#include <fs/dcache.hpp>
 #include <errno.h>
+#include <lock.hpp>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -58,7 +61,9 @@ namespace vfs
 			struct
 			{
 				uint8_t MountPoint : 1;
-				uint8_t __reserved : 7;
+				/* The name is gone, the inode is deleted with this node */
+				uint8_t Unlinked : 1;
+				uint8_t __reserved : 6;
 			};
 			uint8_t raw;
 		} Flags;
@@ -80,6 +85,7 @@ namespace vfs
 		ssize_t __ReadLink(auto Buffer, size_t Size) { __check_op(ReadLink, ENOTSUP, (char *)Buffer, Size); }
 		off_t __Seek(off_t Offset) { __check_op(Seek, ENOTSUP, Offset); }
 		int __Stat(struct kstat *Stat) { __check_op(Stat, ENOTSUP, Stat); }
+		int __Poll(struct PollTable *Table) { __check_op(Poll, ENOTSUP, Table); }
 
 		~NodeObject()
 		{
@@ -118,6 +124,13 @@ class NodeCache : public vfs::NodeObject
 public:
 	std::string Name, Path, Link;
 
+	/**
+	 * @brief Key of this node in the name cache
+	 *
+	 * Never reused, see vfs::AllocateNodeID()
+	 */
+	uint64_t CacheID = vfs::AllocateNodeID();
+
 	/**
 	 * @brief Parent of this node
 	 *
@@ -133,6 +146,29 @@ public:
 	 */
 	std::vector<Node> Children;
 
+	/**
+	 * @brief Bumped when an entry is added to or removed from this directory
+	 *
+	 * Lookups use it to tell whether a name they resolved may be stale.
+	 */
+	std::atomic_uint64_t Generation = 0;
+
+	/**
+	 * @brief Guards Children, Generation and the names of the children
+	 *
+	 * Held for reading while the directory is searched or listed,
+	 * for writing while an entry is added, removed or renamed.
+	 * Never held while taking the lock of another directory.
+	 */
+	NewRWLock(ChildrenLock);
+
+	/**
+	 * @brief Orders reads and writes of a regular file
+	 *
+	 * Reads share it, writes and truncation hold it alone.
+	 */
+	NewRWLock(IOLock);
+
 	std::string GetName() { return Name; }
 	std::string GetPath() { return Path; }
 	std::string GetLink() { return Link; }
@@ -156,6 +192,7 @@ public:
 	 */
 	eNode CachedSearch(std::string Name)
 	{
+		SmartWriteLock(ChildrenLock);
 		for (auto it = Children.begin(); it != Children.end(); ++it)
 		{
 			if ((*it).get() == nullptr)
@@ -164,12 +201,8 @@ public:
 				continue;
 			}
 
-			debug("comparing \"%s\" with \"%s\"", (*it)->Name.c_str(), Name.c_str());
 			if ((*it)->Name == Name)
-			{
-				debug("\"%s\" found", Name.c_str());
 				return {*it, 0};
-			}
 		}
 
 		return {nullptr, ENOENT};
@@ -194,10 +227,13 @@ public:
 	{
 		debug("%#lx\"%s\" destructor called", this, Name.c_str());
 
-		if (this->Parent)
-			this->Parent->Children.erase(std::remove(this->Parent->Children.begin(), this->Parent->Children.end(), Node(this)), this->Parent->Children.end());
-
-		if (fsi->SuperOps.Synchronize)
+		/* The parent's list holds a reference, so this node is already out of it */
+		if (Flags.Unlinked)
+		{
+			if (fsi->SuperOps.DeleteInode)
+				fsi->SuperOps.DeleteInode(this->fsi, this->inode);
+		}
+		else if (fsi->SuperOps.Synchronize)
 			fsi->SuperOps.Synchronize(this->fsi, this->inode);
 
 		// FIXME: recursive deletion of nodes children
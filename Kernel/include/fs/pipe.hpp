@@ -0,0 +1,180 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <fs/poll.hpp>
+#include <fs/vfs.hpp>
+#include <memory.hpp>
+#include <lock.hpp>
+#include <atomic>
+
+/* Writes up to this size are atomic */
+#define PIPE_BUF 4096
+
+/* Default and maximum pipe capacity, in pages */
+#define PIPE_DEF_PAGES 16
+#define PIPE_MAX_PAGES 256
+
+namespace vfs
+{
+	class Pipe
+	{
+	public:
+		/**
+		 * A page of pipe data. Pages can be referenced by more
+		 * than one pipe after tee(), in which case they become
+		 * read-only until only one reference is left.
+		 */
+		struct PipePage
+		{
+			uint8_t *Data = nullptr;
+			std::atomic_int References = 1;
+		};
+
+		/**
+		 * A slot in the ring. Offset and Length select the
+		 * part of the page that is still unread.
+		 */
+		struct PipeBuffer
+		{
+			PipePage *Page = nullptr;
+			size_t Offset = 0;
+			size_t Length = 0;
+		};
+
+		class PipeInode
+		{
+		public:
+			struct Inode Node;
+			Pipe *Owner = nullptr;
+		};
+
+	private:
+		NewLock(PipeLock);
+
+		PipeBuffer *Ring = nullptr;
+		PipePage *Spare = nullptr;
+		size_t Slots = 0;
+		size_t Head = 0;
+		size_t Count = 0;
+		size_t Bytes = 0;
+
+		int Readers = 0;
+		int Writers = 0;
+
+		/* Blocked readers and writers */
+		WaitQueue ReadQueue;
+		WaitQueue WriteQueue;
+		WaitQueue PollQueue;
+
+		PipeBuffer &Slot(size_t Index) { return Ring[(Head + Index) & (Slots - 1)]; }
+		size_t TailRoom();
+		size_t Room() { return TailRoom() + (Slots - Count) * PAGE_SIZE; }
+
+		/**
+		 * Block on a wait queue. The pipe lock (and Other's,
+		 * if given) must be held and is held again on return.
+		 *
+		 * @return 0 when woken, -EINTR if a signal is pending
+		 */
+		int Wait(WaitQueue &Queue, Pipe *Other = nullptr);
+		void WakeAll(WaitQueue &Queue, int Events);
+
+		static void LockPair(Pipe *First, Pipe *Second);
+		static void UnlockPair(Pipe *First, Pipe *Second);
+		static int WaitPair(Pipe *In, Pipe *Out, bool NonBlock);
+
+		void PopHead(bool Release);
+		void PushPage(PipePage *Page, size_t Offset, size_t Length);
+		void Consume(size_t Length);
+		size_t Fill(const uint8_t *Buffer, size_t Size);
+
+		static PipePage *AllocatePage();
+		static void ReleasePage(PipePage *Page);
+
+	public:
+		ssize_t Read(void *Buffer, size_t Size, bool NonBlock);
+		ssize_t Write(const void *Buffer, size_t Size, bool NonBlock);
+		size_t Available();
+
+		/**
+		 * Get the ready events of one end
+		 */
+		int Poll(bool Writer, PollTable *Table);
+
+		/**
+		 * Get the capacity of the pipe in bytes
+		 */
+		size_t GetSize();
+
+		/**
+		 * Resize the ring, the size is rounded up to
+		 * a power of two number of pages.
+		 *
+		 * @return The new capacity, -EBUSY if the data in the
+		 * pipe doesn't fit in the new ring.
+		 */
+		ssize_t SetSize(size_t Size);
+
+		/**
+		 * Move up to Length bytes of pages to another pipe.
+		 * Whole slots are moved without copying.
+		 */
+		static ssize_t Splice(Pipe *In, Pipe *Out, size_t Length, bool NonBlock);
+
+		/**
+		 * Duplicate up to Length bytes to another pipe
+		 * without consuming them. Pages are shared.
+		 */
+		static ssize_t Tee(Pipe *In, Pipe *Out, size_t Length, bool NonBlock);
+
+		/**
+		 * Read from a file directly into pipe pages.
+		 */
+		ssize_t SpliceFrom(Node &File, off_t Offset, size_t Length, bool NonBlock);
+
+		/**
+		 * Write pipe pages to a file and consume them.
+		 */
+		ssize_t SpliceTo(Node &File, off_t Offset, size_t Length, bool NonBlock);
+
+		/**
+		 * Create both ends of a new pipe
+		 *
+		 * @param ReadEnd Node for reading
+		 * @param WriteEnd Node for writing
+		 * @param Flags O_NONBLOCK is applied to both ends
+		 */
+		static int Create(Node &ReadEnd, Node &WriteEnd, int Flags);
+
+		/**
+		 * Get the pipe of a node, nullptr if the
+		 * node is not a pipe end.
+		 */
+		static Pipe *FromNode(Node &node);
+
+		/**
+		 * Drop a reader or writer, called when an end
+		 * is closed. The last one frees the pipe.
+		 */
+		void Release(bool Writer);
+
+		Pipe(size_t Pages);
+		~Pipe();
+	};
+}
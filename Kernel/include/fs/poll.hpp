@@ -0,0 +1,153 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <fs/node.hpp>
+#include <lock.hpp>
+#include <atomic>
+#include <vector>
+#include <list>
+
+namespace vfs
+{
+	class WaitQueue;
+
+	/**
+	 * A callback registered on a wait queue
+	 */
+	struct PollEntry
+	{
+		WaitQueue *Queue = nullptr;
+		void (*Callback)(PollEntry *Entry, int Events) = nullptr;
+		void *Private = nullptr;
+	};
+
+	/**
+	 * Readiness wait queue. Objects that can block (pipes,
+	 * terminals, sockets) own one and wake it when their
+	 * state changes.
+	 */
+	class WaitQueue
+	{
+	private:
+		NewLock(QueueLock);
+		std::list<PollEntry *> Entries;
+
+	public:
+		void Add(PollEntry *Entry);
+		void Remove(PollEntry *Entry);
+
+		/**
+		 * Run the callbacks of all registered entries
+		 *
+		 * Callbacks run with the queue locked, so don't call
+		 * this while holding a lock that a callback may take.
+		 *
+		 * @param Events Events that may have changed
+		 */
+		void Wake(int Events);
+
+		WaitQueue() = default;
+		~WaitQueue();
+	};
+}
+
+/**
+ * Wait registration passed to InodeOperations::Poll
+ */
+struct PollTable
+{
+	void (*Callback)(vfs::PollEntry *Entry, int Events) = nullptr;
+	void *Private = nullptr;
+	std::vector<vfs::PollEntry *> Entries;
+
+	void Wait(vfs::WaitQueue &Queue);
+
+	/**
+	 * Remove all entries from their queues
+	 */
+	void Clear();
+
+	~PollTable() { Clear(); }
+};
+
+/**
+ * Register Table on Queue, Table can be nullptr
+ */
+inline void PollWait(PollTable *Table, vfs::WaitQueue &Queue)
+{
+	if (Table)
+		Table->Wait(Queue);
+}
+
+namespace Tasking
+{
+	class TCB;
+}
+
+namespace vfs
+{
+	/**
+	 * Blocks the current thread until one of the queues
+	 * registered with Table is woken
+	 */
+	class PollWaiter
+	{
+	private:
+		Tasking::TCB *Thread;
+		std::atomic_bool Triggered = false;
+
+		static void Callback(PollEntry *Entry, int Events);
+
+	public:
+		PollTable Table;
+
+		/**
+		 * Call before checking for readiness, wakeups from
+		 * then on make Sleep() return immediately
+		 */
+		void Arm() { Triggered.store(false); }
+
+		/**
+		 * @param Deadline Absolute time in nanoseconds, zero to wait forever
+		 * @return 0 when woken, -ETIMEDOUT or -EINTR
+		 */
+		int Sleep(uint64_t Deadline);
+
+		PollWaiter();
+	};
+
+	struct PollRequest
+	{
+		Node node;
+		int Events;
+		int Revents;
+	};
+
+	/**
+	 * Wait until at least one node is ready
+	 *
+	 * Requests with a null node are reported as POLLNVAL.
+	 *
+	 * @param Requests Nodes and events to wait for
+	 * @param Count Number of requests
+	 * @param Timeout Timeout in nanoseconds, negative to wait forever
+	 * @return Number of ready requests, -EINTR if a signal is pending
+	 */
+	int PollNodes(PollRequest *Requests, size_t Count, int64_t Timeout);
+}
@@ -19,74 +19,65 @@
 
 #include <fs/vfs.hpp>
 #include <memory.hpp>
+#include <lock.hpp>
+#include <flat_hash_map>
+
+/* Slots per radix tree node, a node is one page of pointers */
+#define RAMFS_RADIX_SHIFT 9
+#define RAMFS_RADIX_SIZE (1 << RAMFS_RADIX_SHIFT)
 
 namespace vfs
 {
 	class RAMFS
 	{
 	public:
-		class InodeBuffer
+		/**
+		 * File data, stored as a radix tree of pages.
+		 *
+		 * Every tree node is a page of RAMFS_RADIX_SIZE slots,
+		 * the leaves point to data pages. Missing pages are
+		 * holes and read as zeros. The tree only grows in
+		 * height when a page past its reach is touched, a
+		 * file of one page has no node and Root is the page.
+		 */
+		class PageTree
 		{
-		public:
-			void *Data = nullptr;
-			size_t DataSize = 0;
+		private:
+			/* The data page itself while Height is 0 */
+			void **Root = nullptr;
+			int Height = 0;
+			size_t Pages = 0;
 
-			void Allocate(size_t size, bool extend = false, bool atEnd = true)
-			{
-				if (extend == false)
-				{
-					if (Data)
-						Free();
-					Data = kmalloc(size);
-					if (!Data)
-						throw std::bad_alloc();
-					DataSize = size;
-				}
-				else
-				{
-					if (Data == nullptr)
-					{
-						Data = kmalloc(size);
-						if (!Data)
-							throw std::bad_alloc();
-						DataSize = size;
-					}
-					else
-					{
-						size_t newSize = DataSize + size;
-						void *newData = kmalloc(newSize);
-						if (!newData)
-							throw std::bad_alloc();
-
-						if (atEnd)
-							memcpy(newData, Data, DataSize);
-						else
-							memcpy(static_cast<char *>(newData) + size, Data, DataSize);
-
-						kfree(Data);
-						Data = newData;
-						DataSize = newSize;
-					}
-				}
-			}
+			void FreeNode(void **Node, int Level);
+			bool Prune(void **Node, int Level, size_t Base, size_t First);
 
-			void Free()
-			{
-				if (Data)
-				{
-					kfree(Data);
-					Data = nullptr;
-					DataSize = 0;
-				}
-			}
-
-			bool IsAllocated() const
-			{
-				return Data != nullptr;
-			}
-
-			InodeBuffer() = default;
-			~InodeBuffer() { Free(); }
+		public:
+			/**
+			 * @return The page at Index, nullptr for a hole
+			 */
+			void *Lookup(size_t Index);
+
+			/**
+			 * @return The page at Index, a zeroed one is
+			 *         allocated for holes
+			 */
+			void *Get(size_t Index);
+
+			/**
+			 * Free the pages past Size and zero the
+			 * rest of the last one
+			 */
+			void Truncate(size_t Size);
+
+			void Free();
+
+			/**
+			 * @return Number of data pages allocated
+			 */
+			size_t Count() { return Pages; }
+
+			PageTree() = default;
+			~PageTree() { Free(); }
 		};
 
 		class RAMFSInode
@@ -97,7 +88,7 @@ namespace vfs
 			std::string Name;
 			kstat Stat{};
 			mode_t Mode = 0;
-			InodeBuffer Buffer;
+			PageTree Pages;
 			std::string SymLink;
 			std::vector<RAMFSInode *> Children;
 
@@ -126,7 +117,17 @@ namespace vfs
 		};
 
 	private:
-		std::unordered_map<ino_t, RAMFSInode *> Files;
+		flat_hash_map<ino_t, RAMFSInode *> Files;
+
+		/**
+		 * Guards Files and NextInode. A removed file stays in
+		 * Files until DeleteInode, so an inode stays valid after
+		 * the lock is dropped for as long as the VFS holds it.
+		 */
+		NewRWLock(FilesLock);
+
+		/** @return The file with this inode number, nullptr if none */
+		RAMFSInode *Find(ino_t Index);
 
 	public:
 		dev_t DeviceID = -1;
@@ -135,16 +136,34 @@ namespace vfs
 
 		int Lookup(struct Inode *Parent, const char *Name, struct Inode **Result);
 		int Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int Remove(struct Inode *Parent, const char *Name);
+		int DeleteInode(struct Inode *Node);
 		ssize_t Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset);
 		ssize_t Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset);
+		int Truncate(struct Inode *Node, off_t Size);
 		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
 		int SymLink(struct Inode *Node, const char *Name, const char *Target, struct Inode **Result);
 		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
 		int Stat(struct Inode *Node, struct kstat *Stat);
 
+		/**
+		 * Hand out a page of a file without copying it,
+		 * for the page cache and file mappings. The page
+		 * stays owned by the file.
+		 *
+		 * @param Allocate Fill a hole instead of returning nullptr
+		 */
+		void *GetPage(struct Inode *Node, size_t Index, bool Allocate);
+
 		RAMFS() = default;
 		~RAMFS() = default;
 	};
 }
 
 bool MountAndRootRAMFS(Node Parent, const char *Name, size_t Index);
+
+/**
+ * Mount an empty RAMFS instance on Name in Parent,
+ * without registering it as a root
+ */
+eNode MountTMPFS(Node Parent, const char *Name);
@@ -0,0 +1,232 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <interface/syscalls.h>
+#include <fs/poll.hpp>
+#include <fs/vfs.hpp>
+#include <lock.hpp>
+#include <atomic>
+#include <vector>
+#include <list>
+
+namespace Tasking
+{
+	class PCB;
+	class TCB;
+}
+
+/* Number of kernel threads running ring requests */
+#define IO_URING_WORKERS 4
+
+/* Default idle time of the SQ polling thread, in milliseconds */
+#define IO_URING_SQ_IDLE 1000
+
+/* Requests move data through a kernel buffer this large at most */
+#define IO_URING_BOUNCE_SIZE (64 * 1024)
+
+namespace vfs
+{
+	/**
+	 * Submission/completion ring pair shared with a process
+	 *
+	 * Requests that can complete right away (nop, openat, close,
+	 * fsync, reads and writes at the file position) run in the
+	 * submitting thread. The others are handed to a pool of kernel
+	 * workers. Requests on pollable nodes are only run once the node
+	 * is ready, until then they wait on its wait queue without
+	 * occupying a worker.
+	 */
+	class IoUring
+	{
+	public:
+		class IoUringInode
+		{
+		public:
+			struct Inode Node;
+			IoUring *Owner = nullptr;
+		};
+
+		struct Request
+		{
+			IoUring *Ring = nullptr;
+			uint8_t Opcode = 0;
+			uint64_t UserData = 0;
+			Node node = nullptr;
+			off_t Offset = 0;
+			int Events = 0;
+
+			/* User addresses of the buffers, translated again on every copy */
+			std::vector<kiovec> Vectors;
+
+			PollTable Table;
+			bool Armed = false;
+			bool Woken = false;
+			std::list<Request *>::iterator WaitingEntry;
+		};
+
+	private:
+		struct FixedBuffer
+		{
+			uintptr_t Base;
+			size_t Length;
+		};
+
+		/* Cleared by DetachOwner() before the process is destroyed */
+		Tasking::PCB *Owner = nullptr;
+		NewLock(OwnerLock);
+		int (*ConvertResult)(int Result) = nullptr;
+
+		uint8_t *Rings = nullptr;
+		size_t RingsPages = 0;
+		kio_uring_sqe *Entries = nullptr;
+		size_t EntriesPages = 0;
+
+		uint32_t SqEntries = 0;
+		uint32_t CqEntries = 0;
+		uint32_t *SqHead, *SqTail, *SqFlags, *SqDropped, *SqArray;
+		uint32_t *CqHead, *CqTail, *CqOverflow;
+		kio_uring_cqe *Cqes;
+
+		/* Serializes consumers of the SQ ring and the registered tables */
+		NewLock(SubmitLock);
+		std::vector<FixedBuffer> Buffers;
+		std::vector<Node> Files;
+
+		NewLock(CompletionLock);
+		std::list<kio_uring_cqe> Overflow;
+		WaitQueue CompletionQueue;
+
+		/* Requests waiting for their node to become ready */
+		NewLock(RequestLock);
+		std::list<Request *> Waiting;
+
+		std::atomic_int References = 1;
+		std::atomic_bool Closing = false;
+
+		/* Requests a worker is executing right now */
+		std::atomic_int Running = 0;
+
+		Tasking::TCB *SqThread = nullptr;
+		uint64_t SqIdle = 0;
+		std::atomic_bool SqSleeping = false;
+		std::atomic_bool SqExited = false;
+
+		static void SqThreadEntry();
+		static void WorkerEntry();
+		void SqThreadLoop();
+		void WakeSqThread();
+
+		/**
+		 * Keep the owner from being destroyed while its address
+		 * space or file descriptors are used
+		 *
+		 * @return nullptr if the owner is gone or exiting
+		 */
+		Tasking::PCB *PinOwner();
+		void UnpinOwner(Tasking::PCB *pcb);
+
+		/**
+		 * Copy a request buffer through the owner's address space
+		 *
+		 * @return 0, -EFAULT or -ECANCELED if the ring is closing
+		 *         or the owner is gone
+		 */
+		int CopyUser(void *User, void *Kernel, size_t Length, bool ToUser);
+
+		uint32_t SqPending();
+		uint32_t CqReady();
+		void FlushOverflow();
+
+		Node ResolveFile(const kio_uring_sqe &sqe, int &Result);
+		int MapBuffer(const kio_uring_sqe &sqe, Request *req);
+		int OpenAt(const kio_uring_sqe &sqe);
+
+		/**
+		 * Validate an entry and run it if it completes right away
+		 * @return true if the request was queued, otherwise *Result is set
+		 */
+		bool Prepare(const kio_uring_sqe &sqe, Request *req, int *Result);
+		void Queue(Request *req);
+		void Arm(Request *req, int Events);
+		static void PollCallback(PollEntry *Entry, int Events);
+		static int RequestEvents(Request *req);
+		int Run(Request *req);
+		void Execute(Request *req);
+		void Finish(Request *req, int Result);
+		void Post(uint64_t UserData, int32_t Result);
+		void Put();
+
+	public:
+		/**
+		 * Consume up to ToSubmit entries from the SQ ring
+		 * @return Number of entries consumed, -EOWNERDEAD if
+		 *         the process the ring belongs to is gone
+		 */
+		int Submit(uint32_t ToSubmit);
+
+		/**
+		 * The rings and buffers are only reachable in the process
+		 * that created the ring. Others may hold the descriptor
+		 * (after fork() or dup()) but only close it.
+		 */
+		bool IsOwner(Tasking::PCB *pcb) { return Owner == pcb; }
+
+		int Enter(uint32_t ToSubmit, uint32_t MinComplete, uint32_t Flags);
+		int Register(uint32_t Opcode, void *Arg, uint32_t Count);
+		int Poll(PollTable *Table);
+
+		/**
+		 * Return the ring mapping that matches an mmap() offset
+		 * of the Linux ABI, or nullptr
+		 */
+		void *GetMapping(uint64_t Offset, size_t Length);
+
+		/**
+		 * Close the ring and cancel queued and waiting requests.
+		 * Running ones are waited for, unless this is called by
+		 * the scheduler while destroying the owner, then they
+		 * stop at their next copy. The rings are freed with the
+		 * last reference.
+		 */
+		void Release();
+
+		/**
+		 * Called when a process is destroyed, before its address
+		 * space is freed, so no ring reaches it afterwards
+		 */
+		static void DetachOwner(Tasking::PCB *Owner);
+
+		/**
+		 * @param Entries Number of SQ entries
+		 * @param Params In: flags and sizes, out: ring layout
+		 * @param Owner Process the rings are mapped into
+		 * @param Result The new ring node
+		 * @param ConvertResult Translates negative errno values
+		 *                      posted to the CQ ring, can be nullptr
+		 */
+		static int Create(uint32_t Entries, kio_uring_params *Params,
+						  Tasking::PCB *Owner, Node &Result,
+						  int (*ConvertResult)(int Result) = nullptr);
+		static IoUring *FromNode(Node &node);
+
+		IoUring() = default;
+		~IoUring();
+	};
+}
@@ -19,6 +19,11 @@
 #define __FENNIX_KERNEL_FILESYSTEM_USTAR_H__
 
 #include <fs/vfs.hpp>
+#include <lock.hpp>
+#include <lz4.hpp>
+#include <zstd.hpp>
+#include <unordered_map>
+#include <atomic>
 
 namespace vfs
 {
@@ -87,11 +92,132 @@ namespace vfs
 			std::vector<USTARInode *> Children;
 			bool Deleted;
 			int Checksum;
+
+			/* Parsed from the header once, when the archive is read */
+			size_t Size = 0;
+			uid_t UserID = 0;
+			gid_t GroupID = 0;
+			time_t ModifyTime = 0;
+			dev_t RawDevice = 0;
+
+			/* File contents inside the archive */
+			const uint8_t *Data = nullptr;
+
+			/* Contents are still compressed, at this offset
+			   of the decoded stream */
+			bool Compressed = false;
+			size_t StreamOffset = 0;
+
+			/* Claimed by Prefetch(), the workers fill Inflating
+			   and the last one to finish publishes it as Data */
+			bool Prefetched = false;
+			bool Broken = false;
+			uint8_t *Inflating = nullptr;
+			size_t Remaining = 0;
+
+			/* Chain in the (parent, name) index */
+			USTARInode *HashNext = nullptr;
 		};
 
 	private:
 		std::unordered_map<ino_t, USTARInode *> Files;
 
+		/* Buckets of the (parent, name) index, a power of two */
+		std::vector<USTARInode *> Index;
+		size_t Indexed = 0;
+
+		uint64_t IndexKey(ino_t Parent, const char *Name, size_t Length);
+		void IndexInsert(USTARInode *Node);
+		void IndexRebuild(size_t Buckets);
+		USTARInode *IndexFind(USTARInode *Parent, const char *Name, size_t Length);
+
+		enum ChunkFormat
+		{
+			ChunkStored,
+			ChunkLZ4Block,
+			ChunkLZ4Frame,
+			ChunkZstdFrame
+		};
+
+		/* Part of the compressed archive that decodes on its own */
+		struct StreamChunk
+		{
+			const uint8_t *Data;
+			size_t Size;
+			uint8_t Format;
+
+			/* Position and size in the decoded stream */
+			size_t Offset;
+			size_t Length;
+		};
+
+		/* Compressed archive, decoded one chunk at a time */
+		std::vector<StreamChunk> Chunks;
+		size_t ChunkMaxLength = 0;
+		size_t StreamSize = 0;
+		uint8_t *StreamCache = nullptr;
+		ssize_t CachedChunk = -1;
+		NewLock(StreamLock);
+
+		/* Files to fill from each chunk while prefetching */
+		std::vector<std::vector<USTARInode *>> PrefetchFiles;
+		std::atomic_size_t PrefetchNext = 0;
+		std::atomic_int PrefetchWorkers = 0;
+
+		/**
+		 * @return The chunk holding Offset of the decoded
+		 *         stream, -1 if past the end
+		 */
+		ssize_t FindChunk(size_t Offset);
+
+		/**
+		 * Decode a chunk into Buffer, which must hold
+		 * ChunkMaxLength bytes
+		 *
+		 * @return The decoded bytes, which are the archive
+		 *         itself for stored chunks, nullptr if the
+		 *         chunk is corrupted
+		 */
+		const uint8_t *DecodeChunk(size_t Index, uint8_t *Buffer);
+
+		bool AddLZ4Chunks(const uint8_t *Data, size_t Size);
+		bool AddZstdChunks(const uint8_t *Data, size_t Size);
+
+		static void PrefetchEntry();
+		void PrefetchLoop();
+
+		/**
+		 * Copy bytes out of the decoded stream
+		 *
+		 * @return false if the stream is corrupted or too short
+		 */
+		bool ReadStream(void *Buffer, size_t Size, size_t Offset);
+
+		/**
+		 * Decompress a file into its own pages
+		 *
+		 * @return false if the stream is corrupted
+		 */
+		bool Inflate(USTARInode *Node);
+
+		USTARInode *AddEntry(FileHeader *Header);
+		void LinkArchive();
+
+		/**
+		 * Parse a numeric header field, the field can end
+		 * with a null byte, a space or nothing at all
+		 */
+		inline uint64_t ParseOctal(const char *Field, size_t Length)
+		{
+			uint64_t ret = 0;
+			size_t i = 0;
+			while (i < Length && Field[i] == ' ')
+				i++;
+			for (; i < Length && Field[i] >= '0' && Field[i] <= '7'; i++)
+				ret = ret * 8 + (Field[i] - '0');
+			return ret;
+		}
+
 		inline uint32_t GetSize(const char *String)
 		{
 			uint32_t ret = 0;
@@ -124,14 +250,43 @@ namespace vfs
 		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
 		int Stat(struct Inode *Node, struct kstat *Stat);
 
+		/**
+		 * Get the contents of a file inside the archive,
+		 * for mapping it read-only without a copy
+		 *
+		 * @return nullptr if the file is not backed by the archive
+		 */
+		const void *GetData(struct Inode *Node, size_t *Size);
+
 		bool TestArchive(uintptr_t Address);
 		void ReadArchive(uintptr_t Address, size_t Size);
 
+		/**
+		 * Read an LZ4 or zstd compressed archive. When it
+		 * is made of more than one independent chunk only
+		 * the headers are decoded here and files are
+		 * inflated when they are first read.
+		 *
+		 * @return false if the stream is invalid or doesn't
+		 *         hold a USTAR archive
+		 */
+		bool ReadCompressedArchive(uintptr_t Address, size_t Size);
+
+		/**
+		 * Inflate every file that is still compressed, each
+		 * core decoding its own chunks in the background
+		 */
+		void Prefetch();
+
 		USTAR() = default;
-		~USTAR() = default;
+		~USTAR();
 	};
 }
 
 bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size, size_t Index);
+bool TestAndInitializeCompressedUSTAR(uintptr_t Address, size_t Size, size_t Index);
+
+/** Start inflating every compressed archive that was mounted */
+void PrefetchCompressedUSTAR();
 
 #endif // !__FENNIX_KERNEL_FILESYSTEM_USTAR_H__
@@ -23,6 +23,7 @@
 #include <atomic>
 #include <string>
 #include <list>
+#include <flat_hash_map>
 
 /* sanity checks */
 static_assert(DTTOIF(DT_FIFO) == S_IFIFO);
@@ -30,11 +31,46 @@ static_assert(IFTODT(S_IFCHR) == DT_CHR);
 
 namespace vfs
 {
+	/**
+	 * Locks are taken in this order and released before
+	 * going further down:
+	 *
+	 * 1. Virtual::RenameLock
+	 * 2. NodeCache::ChildrenLock of one directory
+	 * 3. NodeCache::IOLock of one file
+	 * 4. Locks private to the filesystem and the name cache
+	 *
+	 * Path walks hold one directory at a time, so lookups in
+	 * different directories and reads of different files never
+	 * wait on each other.
+	 */
 	class Virtual
 	{
 	private:
-		std::unordered_map<dev_t, Node> Roots;
-		std::unordered_map<dev_t, FileSystemInfo *> FileSystems;
+		flat_hash_map<dev_t, Node> Roots;
+		flat_hash_map<dev_t, FileSystemInfo *> FileSystems;
+
+		/**
+		 * Serializes renames, so one that moves a node between
+		 * directories can hold both of them without deadlocking
+		 */
+		NewLock(RenameLock);
+
+		/**
+		 * Resolve a single path component, Name
+		 * doesn't have to be null terminated
+		 */
+		eNode LookupName(Node &Parent, const char *Name, size_t Length);
+
+		/**
+		 * List a directory, entries from the filesystem
+		 * come first and cached children it doesn't know
+		 * about (mount points) follow
+		 *
+		 * @return 0, or the error ReadDir of the filesystem
+		 *         failed with, leaving Snapshot empty
+		 */
+		int FillSnapshot(Node &Target, DirectorySnapshot &Snapshot);
 
 	public:
 #pragma region Utilities
@@ -64,6 +100,7 @@ namespace vfs
 		 * This function will automatically assign the FSI, parents and children.
 		 *
 		 * @note Name and Path won't be set.
+		 * @note Parent->ChildrenLock must be held for writing.
 		 *
 		 * @param Parent Parent Node
 		 * @param inode Inode to convert
@@ -112,7 +149,15 @@ namespace vfs
 
 #pragma region Node Operations
 
-		eNode Lookup(Node &Parent, std::string Path);
+		/**
+		 * @brief Resolve a path relative to Parent
+		 *
+		 * Components are hashed in place and looked up in
+		 * the name cache, the filesystem is only asked on
+		 * a miss.
+		 */
+		eNode Lookup(Node &Parent, const char *Path);
+		eNode Lookup(Node &Parent, const std::string &Path) { return Lookup(Parent, Path.c_str()); }
 
 		eNode Create(Node &Parent, std::string Name, mode_t Mode, bool ErrorIfExists = true);
 
@@ -126,6 +171,23 @@ namespace vfs
 
 		int Truncate(Node &Target, off_t Size);
 
+		/**
+		 * @brief Copy data from one node to another in the kernel
+		 *
+		 * Data is moved a page at a time from the read path of In
+		 * to the write path of Out. If one side is a pipe end, the
+		 * pipe pages are filled or drained directly.
+		 *
+		 * @param In Node to read from
+		 * @param InOffset Offset in In, ignored for pipes
+		 * @param Out Node to write to
+		 * @param OutOffset Offset in Out, ignored for pipes
+		 * @param Length Maximum number of bytes to copy
+		 * @param NonBlock Don't wait for a pipe
+		 * @return Number of bytes copied, or an error code
+		 */
+		ssize_t Transfer(Node &In, off_t InOffset, Node &Out, off_t OutOffset, size_t Length, bool NonBlock);
+
 		/**
 		 * @brief Read directory entries
 		 *
@@ -140,6 +202,25 @@ namespace vfs
 		 */
 		ssize_t ReadDirectory(Node &Target, kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
 
+		/**
+		 * @brief Read directory entries from a snapshot
+		 *
+		 * The snapshot is filled on the first call and when rewinding
+		 * to 0. Later calls copy from it without asking the filesystem
+		 * again, so a pass lists every entry that was there when it
+		 * started exactly once, whatever is created or removed meanwhile.
+		 *
+		 * @note This function includes "." and ".."
+		 *
+		 * @param Target Directory to read
+		 * @param Snapshot Snapshot of the open file description, allocated if nullptr
+		 * @param Buffer Buffer to fill
+		 * @param Size Size of Buffer in bytes
+		 * @param Offset Index of the next entry, advanced past the returned ones
+		 * @return Number of bytes written to Buffer, or an error code
+		 */
+		ssize_t ReadDirectory(Node &Target, DirectorySnapshot *&Snapshot, kdirent *Buffer, size_t Size, off_t &Offset);
+
 		/**
 		 * @brief Read directory entries
 		 *
@@ -161,6 +242,18 @@ namespace vfs
 		int Close(Node &Target);
 		int Ioctl(Node &Target, unsigned long Request, void *Argp) { return Target->__Ioctl(Request, Argp); }
 
+		/**
+		 * @brief Get the ready events of a node
+		 *
+		 * Nodes without a Poll operation never block and
+		 * are always readable and writable.
+		 *
+		 * @param Target Node to poll
+		 * @param Table Wait registration, can be nullptr
+		 * @return A mask of POLL* events
+		 */
+		int Poll(Node &Target, PollTable *Table);
+
 #pragma endregion Node Operations
 
 #pragma region Mounting
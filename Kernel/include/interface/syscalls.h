@@ -642,6 +642,198 @@ struct kutsname
 	char machine[65];
 };
 
+/**
+ * @brief Socket constants
+ *
+ * The values match the ones in the C library headers.
+ */
+typedef enum
+{
+	__SYS_AF_INET = 2,
+
+	__SYS_SOCK_DGRAM = 1,
+	__SYS_SOCK_STREAM = 4,
+	/** @brief Flags ORed into the socket type */
+	__SYS_SOCK_NONBLOCK = 0x800,
+	__SYS_SOCK_CLOEXEC = 0x80000,
+
+	__SYS_MSG_PEEK = 0x2,
+	__SYS_MSG_WAITALL = 0x100,
+	__SYS_MSG_NOSIGNAL = 0x4000,
+
+	__SYS_SHUT_RD = 0,
+	__SYS_SHUT_WR = 1,
+	__SYS_SHUT_RDWR = 2,
+} syscall_socket_t;
+
+/** @brief IPv4 socket address, same layout as struct sockaddr_in */
+struct ksockaddr_in
+{
+	__UINT32_TYPE__ sin_family;
+	/** @brief Port in network byte order */
+	__UINT16_TYPE__ sin_port;
+	/** @brief Address in network byte order */
+	__UINT32_TYPE__ sin_addr;
+};
+
+/** @brief Maximum number of entries accepted by SYS_READV and SYS_WRITEV */
+#define KIOV_MAX 1024
+
+/** @brief Buffer descriptor for SYS_READV and SYS_WRITEV, same layout as struct iovec */
+struct kiovec
+{
+	void *iov_base;
+	__SIZE_TYPE__ iov_len;
+};
+
+/**
+ * @brief Submission and completion rings
+ *
+ * The layout of the structures, flags and opcodes below matches
+ * Linux's io_uring, so the same kernel code serves both ABIs.
+ */
+
+/** @brief Maximum number of submission queue entries */
+#define KIO_URING_MAX_ENTRIES 4096
+
+typedef enum
+{
+	__SYS_IORING_OP_NOP = 0,
+	__SYS_IORING_OP_READV = 1,
+	__SYS_IORING_OP_WRITEV = 2,
+	__SYS_IORING_OP_FSYNC = 3,
+	__SYS_IORING_OP_READ_FIXED = 4,
+	__SYS_IORING_OP_WRITE_FIXED = 5,
+	__SYS_IORING_OP_POLL_ADD = 6,
+	__SYS_IORING_OP_OPENAT = 18,
+	__SYS_IORING_OP_CLOSE = 19,
+	__SYS_IORING_OP_READ = 22,
+	__SYS_IORING_OP_WRITE = 23,
+} syscall_io_uring_op_t;
+
+typedef enum
+{
+	/** @brief Use a kernel thread to poll the submission queue */
+	__SYS_IORING_SETUP_SQPOLL = 2,
+	/** @brief cq_entries is valid */
+	__SYS_IORING_SETUP_CQSIZE = 8,
+	/** @brief Clamp sq_entries and cq_entries instead of failing */
+	__SYS_IORING_SETUP_CLAMP = 16,
+} syscall_io_uring_setup_flags_t;
+
+typedef enum
+{
+	/** @brief Wait for min_complete completions */
+	__SYS_IORING_ENTER_GETEVENTS = 1,
+	/** @brief Wake up the submission queue polling thread */
+	__SYS_IORING_ENTER_SQ_WAKEUP = 2,
+} syscall_io_uring_enter_flags_t;
+
+typedef enum
+{
+	/** @brief Set in the SQ ring flags when the polling thread sleeps */
+	__SYS_IORING_SQ_NEED_WAKEUP = 1,
+	/** @brief Set in the SQ ring flags when completions are held back */
+	__SYS_IORING_SQ_CQ_OVERFLOW = 2,
+} syscall_io_uring_sq_flags_t;
+
+typedef enum
+{
+	/** @brief fd is an index into the registered files */
+	__SYS_IOSQE_FIXED_FILE = 1,
+} syscall_io_uring_sqe_flags_t;
+
+typedef enum
+{
+	__SYS_IORING_REGISTER_BUFFERS = 0,
+	__SYS_IORING_UNREGISTER_BUFFERS = 1,
+	__SYS_IORING_REGISTER_FILES = 2,
+	__SYS_IORING_UNREGISTER_FILES = 3,
+} syscall_io_uring_register_op_t;
+
+typedef enum
+{
+	/** @brief Both rings are in the same mapping */
+	__SYS_IORING_FEAT_SINGLE_MMAP = 1,
+	/** @brief Completions are never dropped */
+	__SYS_IORING_FEAT_NODROP = 2,
+	/** @brief Entries are consumed when io_uring_enter returns */
+	__SYS_IORING_FEAT_SUBMIT_STABLE = 4,
+} syscall_io_uring_features_t;
+
+/** @brief Offsets for mmap() on the Linux ABI */
+#define __SYS_IORING_OFF_SQ_RING 0ULL
+#define __SYS_IORING_OFF_CQ_RING 0x8000000ULL
+#define __SYS_IORING_OFF_SQES 0x10000000ULL
+
+struct kio_uring_sqe
+{
+	__UINT8_TYPE__ opcode;
+	__UINT8_TYPE__ flags;
+	__UINT16_TYPE__ ioprio;
+	__INT32_TYPE__ fd;
+	__UINT64_TYPE__ off;
+	__UINT64_TYPE__ addr;
+	__UINT32_TYPE__ len;
+	/** @brief rw_flags, fsync_flags, poll32_events or open_flags */
+	__UINT32_TYPE__ op_flags;
+	__UINT64_TYPE__ user_data;
+	__UINT16_TYPE__ buf_index;
+	__UINT16_TYPE__ personality;
+	__INT32_TYPE__ file_index;
+	__UINT64_TYPE__ __pad2[2];
+};
+
+struct kio_uring_cqe
+{
+	__UINT64_TYPE__ user_data;
+	__INT32_TYPE__ res;
+	__UINT32_TYPE__ flags;
+};
+
+struct kio_sqring_offsets
+{
+	__UINT32_TYPE__ head;
+	__UINT32_TYPE__ tail;
+	__UINT32_TYPE__ ring_mask;
+	__UINT32_TYPE__ ring_entries;
+	__UINT32_TYPE__ flags;
+	__UINT32_TYPE__ dropped;
+	__UINT32_TYPE__ array;
+	__UINT32_TYPE__ resv1;
+	/** @brief Address of the ring, filled in by the native ABI */
+	__UINT64_TYPE__ user_addr;
+};
+
+struct kio_cqring_offsets
+{
+	__UINT32_TYPE__ head;
+	__UINT32_TYPE__ tail;
+	__UINT32_TYPE__ ring_mask;
+	__UINT32_TYPE__ ring_entries;
+	__UINT32_TYPE__ overflow;
+	__UINT32_TYPE__ cqes;
+	__UINT32_TYPE__ flags;
+	__UINT32_TYPE__ resv1;
+	/** @brief Address of the ring, filled in by the native ABI */
+	__UINT64_TYPE__ user_addr;
+};
+
+struct kio_uring_params
+{
+	__UINT32_TYPE__ sq_entries;
+	__UINT32_TYPE__ cq_entries;
+	__UINT32_TYPE__ flags;
+	__UINT32_TYPE__ sq_thread_cpu;
+	/** @brief Idle time of the polling thread, in milliseconds */
+	__UINT32_TYPE__ sq_thread_idle;
+	__UINT32_TYPE__ features;
+	__UINT32_TYPE__ wq_fd;
+	__UINT32_TYPE__ resv[3];
+	struct kio_sqring_offsets sq_off;
+	struct kio_cqring_offsets cq_off;
+};
+
 /**
  * @brief List of syscalls
  *
@@ -851,6 +1043,112 @@ typedef enum
 	 * - #EINVAL if the request is invalid
 	 */
 	SYS_FCNTL,
+	/**
+	 * @brief Read data into multiple buffers
+	 *
+	 * @code
+	 * ssize_t readv(int fd, const struct kiovec *iov, int iovcnt);
+	 * @endcode
+	 *
+	 * @details Fills the buffers described by `iov` in order, stopping
+	 * early on a short read. The file offset advances like SYS_READ.
+	 *
+	 * @param fd File descriptor to read from
+	 * @param iov Array of buffers
+	 * @param iovcnt Number of entries in `iov`
+	 *
+	 * @return
+	 * - Number of bytes read on success
+	 * - #EBADF if `fd` is not valid
+	 * - #EFAULT if `iov` or one of its buffers is outside the address space
+	 * - #EINVAL if `iovcnt` is negative or larger than #KIOV_MAX
+	 */
+	SYS_READV,
+	/**
+	 * @brief Write data from multiple buffers
+	 *
+	 * @code
+	 * ssize_t writev(int fd, const struct kiovec *iov, int iovcnt);
+	 * @endcode
+	 *
+	 * @details Writes the buffers described by `iov` in order with a
+	 * single call, stopping early on a short write. The file offset
+	 * advances like SYS_WRITE.
+	 *
+	 * @param fd File descriptor to write to
+	 * @param iov Array of buffers
+	 * @param iovcnt Number of entries in `iov`
+	 *
+	 * @return
+	 * - Number of bytes written on success
+	 * - #EBADF if `fd` is not valid
+	 * - #EFAULT if `iov` or one of its buffers is outside the address space
+	 * - #EINVAL if `iovcnt` is negative or larger than #KIOV_MAX
+	 */
+	SYS_WRITEV,
+	/**
+	 * @brief Create a submission/completion ring pair
+	 *
+	 * @code
+	 * int io_uring_setup(unsigned int entries, struct kio_uring_params *params);
+	 * @endcode
+	 *
+	 * @details Allocates the rings and maps them into the process. The
+	 * addresses are returned in `params->sq_off.user_addr` (the
+	 * submission entries) and `params->cq_off.user_addr` (SQ ring,
+	 * followed by the CQ ring). The ring offsets are relative to the
+	 * latter.
+	 *
+	 * @param entries Number of submission entries, a power of two is used
+	 * @param params Setup flags in, ring layout out
+	 *
+	 * @return
+	 * - File descriptor of the ring on success
+	 * - #EINVAL if `entries` or `params->flags` is invalid
+	 * - #EFAULT if `params` is outside accessible address space
+	 */
+	SYS_IO_URING_SETUP,
+	/**
+	 * @brief Submit entries and wait for completions
+	 *
+	 * @code
+	 * int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+	 * @endcode
+	 *
+	 * @param fd File descriptor returned by SYS_IO_URING_SETUP
+	 * @param to_submit Number of entries to consume from the SQ ring
+	 * @param min_complete With #__SYS_IORING_ENTER_GETEVENTS, wait until
+	 *                     this many completions are available
+	 * @param flags #syscall_io_uring_enter_flags_t
+	 *
+	 * @return
+	 * - Number of entries submitted on success
+	 * - #EBADF if `fd` is not a ring
+	 * - #EINTR if interrupted by a signal while waiting
+	 */
+	SYS_IO_URING_ENTER,
+	/**
+	 * @brief Register buffers or files with a ring
+	 *
+	 * @code
+	 * int io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args);
+	 * @endcode
+	 *
+	 * @details Registered buffers are used by the *_FIXED opcodes and skip
+	 * the address translation on every request. Registered files are
+	 * selected with #__SYS_IOSQE_FIXED_FILE.
+	 *
+	 * @param fd File descriptor returned by SYS_IO_URING_SETUP
+	 * @param opcode #syscall_io_uring_register_op_t
+	 * @param arg Array of `struct kiovec` or `int` file descriptors
+	 * @param nr_args Number of entries in `arg`
+	 *
+	 * @return
+	 * - #EOK on success
+	 * - #EBUSY if buffers or files are already registered
+	 * - #ENXIO if nothing is registered on unregister
+	 */
+	SYS_IO_URING_REGISTER,
 
 	/* File Status */
 
@@ -1702,6 +2000,21 @@ typedef enum
 /** @copydoc SYS_FCNTL */
 #define call_fcntl(fd, cmd, arg) syscall3(SYS_FCNTL, (scarg)fd, (scarg)cmd, (scarg)arg)
 
+/** @copydoc SYS_READV */
+#define call_readv(fd, iov, iovcnt) syscall3(SYS_READV, (scarg)fd, (scarg)iov, (scarg)iovcnt)
+
+/** @copydoc SYS_WRITEV */
+#define call_writev(fd, iov, iovcnt) syscall3(SYS_WRITEV, (scarg)fd, (scarg)iov, (scarg)iovcnt)
+
+/** @copydoc SYS_IO_URING_SETUP */
+#define call_io_uring_setup(entries, params) syscall2(SYS_IO_URING_SETUP, (scarg)entries, (scarg)params)
+
+/** @copydoc SYS_IO_URING_ENTER */
+#define call_io_uring_enter(fd, to_submit, min_complete, flags) syscall4(SYS_IO_URING_ENTER, (scarg)fd, (scarg)to_submit, (scarg)min_complete, (scarg)flags)
+
+/** @copydoc SYS_IO_URING_REGISTER */
+#define call_io_uring_register(fd, opcode, arg, nr_args) syscall4(SYS_IO_URING_REGISTER, (scarg)fd, (scarg)opcode, (scarg)arg, (scarg)nr_args)
+
 /* File Status */
 
 /** @copydoc SYS_STAT */
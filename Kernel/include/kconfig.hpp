@@ -40,6 +40,14 @@ struct KernelConfig
 	bool UnlockDeadLock;
 	bool SIMD;
 	bool Quiet;
+
+	/* Network card rings and interrupts per second, 0 = unlimited */
+	int NetRXDescriptors;
+	int NetTXDescriptors;
+	int NetInterruptRate;
+
+	/* Inflate compressed rootfs chunks on all cores after boot */
+	bool PrefetchRootfs;
 };
 
 void ParseConfig(char *ConfigString, KernelConfig *ModConfig);
@@ -68,6 +68,43 @@ public:
 	int TimeoutLock(const char *FunctionName, uint64_t Timeout);
 };
 
+/**
+ * @brief Please use this macro to create a new reader/writer lock.
+ *
+ * Any number of readers can hold it at once, a writer holds it
+ * alone. New readers wait while a writer is waiting so writers
+ * don't starve, which also means a reader must not take the same
+ * lock again before releasing it.
+ */
+class RWLockClass
+{
+private:
+	/* Number of readers, or Exclusive while a writer holds it */
+	std::atomic_long State = 0;
+	std::atomic_long WritersWaiting = 0;
+	std::atomic<const char *> CurrentWriter = "(nul)";
+	std::atomic_ulong DeadLocks = 0;
+
+	void DeadLock(const char *FunctionName);
+	void Yield();
+
+public:
+	static constexpr long Exclusive = -1;
+
+	bool Locked() { return State.load() != 0; }
+	bool WriteLocked() { return State.load() == Exclusive; }
+	long Readers()
+	{
+		long state = State.load();
+		return state > 0 ? state : 0;
+	}
+
+	int ReadLock(const char *FunctionName);
+	int ReadUnlock();
+	int WriteLock(const char *FunctionName);
+	int WriteUnlock();
+};
+
 class spin_lock
 {
 private:
@@ -158,6 +195,34 @@ public:
 	}
 };
 
+class SmartReadLockClass
+{
+private:
+	RWLockClass *LockPointer = nullptr;
+
+public:
+	SmartReadLockClass(RWLockClass &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->ReadLock(FunctionName);
+	}
+	~SmartReadLockClass() { this->LockPointer->ReadUnlock(); }
+};
+
+class SmartWriteLockClass
+{
+private:
+	RWLockClass *LockPointer = nullptr;
+
+public:
+	SmartWriteLockClass(RWLockClass &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->WriteLock(FunctionName);
+	}
+	~SmartWriteLockClass() { this->LockPointer->WriteUnlock(); }
+};
+
 class SmartLockCriticalSectionClass
 {
 private:
@@ -234,6 +299,27 @@ public:
 								 __FUNCTION__,   \
 								 Timeout)
 
+/** Create a new reader/writer lock */
+#define NewRWLock(Name) RWLockClass Name
+
+/**
+ * Shared hold of a reader/writer lock that is
+ * automatically released when the scope ends.
+ */
+#define SmartReadLock(RWLockClassName)            \
+	SmartReadLockClass                            \
+	CONCAT(lock##_, __COUNTER__)(RWLockClassName, \
+								 __FUNCTION__)
+
+/**
+ * Exclusive hold of a reader/writer lock that is
+ * automatically released when the scope ends.
+ */
+#define SmartWriteLock(RWLockClassName)           \
+	SmartWriteLockClass                           \
+	CONCAT(lock##_, __COUNTER__)(RWLockClassName, \
+								 __FUNCTION__)
+
 /**
  * Simple critical section that is
  * automatically released when the scope ends
@@ -0,0 +1,104 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_LZ4_H__
+#define __FENNIX_KERNEL_LZ4_H__
+
+#include <types.h>
+#include <vector>
+
+/*
+	LZ4 frame format decoder.
+	https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+	https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+*/
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+
+/* Linked blocks can reference this much of the previous output */
+#define LZ4_WINDOW_SIZE (64 * 1024)
+
+namespace LZ4
+{
+	uint32_t XXH32(const void *Data, size_t Length, uint32_t Seed);
+
+	/**
+	 * Decode a single block
+	 *
+	 * @param Prefix Bytes of earlier output right before
+	 *               Destination that matches can reference
+	 * @return Bytes written, -1 if the block is corrupted
+	 *         or doesn't fit
+	 */
+	ssize_t DecompressBlock(const uint8_t *Source, size_t SourceSize,
+							uint8_t *Destination, size_t Capacity,
+							size_t Prefix = 0);
+
+	/**
+	 * Get the decoded size of a block by walking its
+	 * sequences, without writing anything
+	 *
+	 * @return The size, -1 if the block is corrupted
+	 */
+	ssize_t BlockLength(const uint8_t *Source, size_t SourceSize);
+
+	struct Block
+	{
+		const uint8_t *Data;
+		uint32_t Size;
+		bool Compressed;
+
+		/* Position and size of the block in the decoded stream */
+		size_t Offset;
+		size_t Length;
+	};
+
+	/**
+	 * A parsed frame. The block table gives random access
+	 * to the decoded stream when the blocks are independent.
+	 */
+	class Frame
+	{
+	public:
+		std::vector<Block> Blocks;
+		size_t BlockMaxSize = 0;
+		size_t ContentSize = 0;
+		bool Independent = false;
+		bool ContentChecksum = false;
+		uint32_t Checksum = 0;
+
+		/**
+		 * Parse the frame header and build the block table
+		 *
+		 * @return false if Data is not a valid LZ4 frame
+		 */
+		bool Open(const void *Data, size_t Size);
+
+		/**
+		 * Decode the whole frame into Destination, which
+		 * must hold ContentSize bytes
+		 */
+		bool Decompress(uint8_t *Destination);
+	};
+
+	inline bool IsFrame(const void *Data, size_t Size)
+	{
+		return Size >= 4 && *(const uint32_t *)Data == LZ4_FRAME_MAGIC;
+	}
+}
+
+#endif // !__FENNIX_KERNEL_LZ4_H__
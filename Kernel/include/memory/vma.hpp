@@ -52,6 +52,10 @@ namespace Memory
 		NewLock(MgrLock);
 		Bitmap PageBitmap;
 
+		/* Held with interrupts disabled while a page is copied,
+		   FreePages() waits on it after revoking user access */
+		NewLock(CopyLock);
+
 		std::list<AllocatedPages> AllocatedPagesList;
 		std::list<SharedRegion> SharedRegions;
 
@@ -92,6 +96,26 @@ namespace Memory
 		int Unmap(void *VirtualAddress, size_t Length);
 		void *__UserCheckAndGetAddress(void *Address, size_t Length);
 		int __UserCheck(void *Address, size_t Length);
+		int __UserCopy(void *User, void *Kernel, size_t Length, bool ToUser);
+
+		/**
+		 * Copy to or from user memory. Every page is translated
+		 * again while it is copied, so the buffer doesn't need to
+		 * be physically contiguous and can be unmapped at any time.
+		 * Safe to call from kernel threads of other processes.
+		 *
+		 * @return 0, -EFAULT if a page is not mapped for the user
+		 *         (or not writable when copying to it)
+		 */
+		int CopyToUser(void *Destination, const void *Source, size_t Length)
+		{
+			return __UserCopy(Destination, (void *)Source, Length, true);
+		}
+
+		int CopyFromUser(void *Destination, const void *Source, size_t Length)
+		{
+			return __UserCopy((void *)Source, Destination, Length, false);
+		}
 
 		template <typename T>
 		T UserCheckAndGetAddress(T Address, size_t Length = 0)
@@ -20,8 +20,30 @@
 
 #include <net/eth.hpp>
 #include <net/nc.hpp>
+#include <net/packet.hpp>
+#include <lock.hpp>
 #include <types.h>
-#include <vector>
+#include <list>
+
+/* Neighbour hash buckets, must be a power of two */
+#define ARP_HASH_SIZE 256
+#define ARP_MAX_ENTRIES 4096
+
+/* Frames held on an unresolved entry */
+#define ARP_QUEUE_LENGTH 8
+
+/* Aging, how often the cache is scanned */
+#define ARP_TICK_MS 500
+
+/* A reply keeps an entry reachable for this long */
+#define ARP_REACHABLE_MS 30000
+
+/* Stale entries that nothing was sent to for this long are freed */
+#define ARP_GC_MS 60000
+
+/* Unanswered requests are retried this often, ARP_MAX_PROBES times */
+#define ARP_RETRANSMIT_MS 1000
+#define ARP_MAX_PROBES 3
 
 namespace NetworkARP
 {
@@ -57,10 +79,37 @@ namespace NetworkARP
 		uint32_t TargetIP;
 	} __packed;
 
-	struct DiscoveredAddress
+	enum NeighbourState
+	{
+		/* A request is out, packets are queued on the entry */
+		NEIGHBOUR_INCOMPLETE,
+		/* Confirmed within ARP_REACHABLE_MS */
+		NEIGHBOUR_REACHABLE,
+		/* Still used, but re-probed before it is trusted again */
+		NEIGHBOUR_STALE
+	};
+
+	struct Neighbour
 	{
-		MediaAccessControl MAC;
-		InternetProtocol IP;
+		/* Host byte order */
+		uint32_t Address = 0;
+		uint48_t MAC = 0;
+		NeighbourState State = NEIGHBOUR_INCOMPLETE;
+
+		/* Timestamps in nanoseconds */
+		uint64_t Confirmed = 0;
+		uint64_t Used = 0;
+		uint64_t Probed = 0;
+		int Probes = 0;
+
+		struct PendingFrame
+		{
+			NetworkEthernet::FrameType Type;
+			NetworkPacket::Buffer *Packet;
+		};
+
+		/* At most ARP_QUEUE_LENGTH frames, oldest first */
+		std::list<PendingFrame> Queue;
 	};
 
 	class ARP : public NetworkEthernet::EthernetEvents
@@ -68,18 +117,24 @@ namespace NetworkARP
 	private:
 		NetworkEthernet::Ethernet *Ethernet;
 
-		enum DAType
-		{
-			DA_ADD = 1,
-			DA_DEL = 2,
-			DA_SEARCH = 3,
-			DA_UPDATE = 4
-		};
+		NewLock(TableLock);
+		std::list<Neighbour *> Table[ARP_HASH_SIZE];
+		size_t Entries = 0;
+		uint64_t HashSecret = 0;
 
-		std::vector<NetworkARP::DiscoveredAddress *> DiscoveredAddresses;
-		DiscoveredAddress *ManageDiscoveredAddresses(DAType Type, InternetProtocol IP, MediaAccessControl MAC);
-		DiscoveredAddress *Search(InternetProtocol TargetIP);
-		DiscoveredAddress *Update(InternetProtocol TargetIP, MediaAccessControl TargetMAC);
+		std::list<Neighbour *> &Bucket(uint32_t Address);
+		Neighbour *Find(uint32_t Address);
+		Neighbour *Create(uint32_t Address, uint64_t Now);
+		void Remove(Neighbour *Entry);
+
+		/**
+		 * Send an ARP request
+		 *
+		 * @param Target The address to ask for
+		 * @param MAC Where to send it, broadcast for a new entry
+		 *            and the cached address to re-probe one
+		 */
+		void Request(uint32_t Target, uint48_t MAC);
 		bool OnEthernetPacketReceived(uint8_t *Data, size_t Length);
 
 	public:
@@ -89,17 +144,46 @@ namespace NetworkARP
 		/**
 		 * @brief Resolve an IP address to a MAC address.
 		 *
+		 * Blocks until the neighbour answers, prefer Output()
+		 * which queues the frame instead.
+		 *
 		 * @param IP The IP address to resolve. (Little-endian)
-		 * @return uint48_t The MAC address of the IP address.
+		 * @return uint48_t The MAC address of the IP address, zero on timeout.
 		 */
 		uint48_t Resolve(InternetProtocol IP);
 
+		/**
+		 * @brief Send a frame to a neighbour.
+		 *
+		 * If the address is not resolved yet the frame is
+		 * queued on the entry and sent when the reply arrives,
+		 * or dropped if it never does. Takes over the caller's
+		 * reference to Packet.
+		 *
+		 * @param IP The next hop. (Little-endian)
+		 */
+		void Output(InternetProtocol IP, NetworkEthernet::FrameType Type, NetworkPacket::Buffer *Packet);
+
 		/**
 		 * @brief Broadcast an ARP packet.
 		 *
 		 * @param IP The IP address to broadcast.
 		 */
 		void Broadcast(InternetProtocol IP);
+
+		/**
+		 * @brief Announce our address with a gratuitous ARP.
+		 *
+		 * Neighbours that already know us update their caches
+		 * (RFC 5227 2.3). Send it after the address changes.
+		 */
+		void Announce();
+
+		/**
+		 * Expire entries, retry unanswered requests and drop
+		 * the frames of neighbours that never answered
+		 */
+		void Age(uint64_t Now);
 	};
 }
 
@@ -102,6 +102,18 @@ namespace NetworkEthernet
 		 * @param Length The length of the data.
 		 */
 		void Send(MediaAccessControl MAC, FrameType Type, uint8_t *Data, size_t Length);
+
+		/**
+		 * @brief Send an Ethernet packet without copying it.
+		 *
+		 * The header is written in the buffer's headroom. Takes
+		 * over the caller's reference to Packet.
+		 *
+		 * @param MAC The MAC address of the destination. (Big-endian)
+		 * @param Type The type of the packet.
+		 * @param Packet The payload.
+		 */
+		void Send(MediaAccessControl MAC, FrameType Type, NetworkPacket::Buffer *Packet);
 	};
 }
 
@@ -108,6 +108,18 @@ namespace NetworkIPv4
 		 * @param DestinationIP The IP address of the destination. (Big-endian)
 		 */
 		void Send(uint8_t *Data, size_t Length, uint8_t Protocol, InternetProtocol DestinationIP);
+
+		/**
+		 * @brief Send an IPv4 packet without copying it.
+		 *
+		 * The header is written in the buffer's headroom. Takes
+		 * over the caller's reference to Packet.
+		 *
+		 * @param Packet The payload.
+		 * @param Protocol The protocol of the packet.
+		 * @param DestinationIP The IP address of the destination. (Big-endian)
+		 */
+		void Send(NetworkPacket::Buffer *Packet, uint8_t Protocol, InternetProtocol DestinationIP);
 	};
 
 	class IPv4Events
@@ -0,0 +1,93 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_NETWORK_LOOPBACK_H__
+#define __FENNIX_KERNEL_NETWORK_LOOPBACK_H__
+
+#include <net/nc.hpp>
+#include <types.h>
+
+namespace NetworkEthernet
+{
+	class Ethernet;
+}
+
+namespace NetworkARP
+{
+	class ARP;
+}
+
+namespace NetworkIPv4
+{
+	class IPv4;
+}
+
+namespace NetworkUDP
+{
+	class UDP;
+}
+
+namespace NetworkTCP
+{
+	class TCP;
+}
+
+/* Frames queued on the loopback device before new ones are dropped */
+#define LOOPBACK_QUEUE_LENGTH 4096
+
+namespace NetworkLoopback
+{
+	/**
+	 * Protocol instances bound to the loopback interface
+	 */
+	struct Stack
+	{
+		NetworkInterfaceManager::DeviceInterface *Interface;
+		NetworkEthernet::Ethernet *Ethernet;
+		NetworkARP::ARP *ARP;
+		NetworkIPv4::IPv4 *IPv4;
+		NetworkUDP::UDP *UDP;
+		NetworkTCP::TCP *TCP;
+	};
+
+	struct Statistics
+	{
+		uint64_t Frames;
+		uint64_t Bytes;
+		uint64_t Dropped;
+	};
+
+	/**
+	 * Bring up the loopback interface (lo, 127.0.0.1/8)
+	 * and its protocol stack on the first call.
+	 */
+	Stack *GetStack();
+
+	bool IsLoopback(NetworkInterfaceManager::DeviceInterface *Interface);
+
+	/**
+	 * Queue a frame sent on the loopback interface. It is
+	 * received from the loopback thread, never from the
+	 * caller's context. Takes over the caller's reference
+	 * to Packet, the frame itself is not copied.
+	 */
+	void Transmit(NetworkInterfaceManager::DeviceInterface *Interface, NetworkPacket::Buffer *Packet);
+
+	Statistics GetStatistics();
+}
+
+#endif // !__FENNIX_KERNEL_NETWORK_LOOPBACK_H__
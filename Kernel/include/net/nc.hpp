@@ -19,14 +19,24 @@
 #define __FENNIX_KERNEL_NETWORK_CONTROLLER_H__
 
 #include <net/net.hpp>
+#include <net/packet.hpp>
 #include <memory.hpp>
 #include <task.hpp>
 #include <types.h>
 #include <debug.h>
 #include <vector>
 
+/* Frames received by drivers that wait for the receive thread */
+#define NETWORK_BACKLOG_LENGTH 1024
+
 namespace NetworkInterfaceManager
 {
+	enum DeviceFeatures
+	{
+		/** The device fills in CHECKSUM_PARTIAL transport checksums */
+		FEATURE_TX_CHECKSUM = (1 << 0)
+	};
+
 	struct DeviceInterface
 	{
 		/** @brief Device interface name */
@@ -43,6 +53,12 @@ namespace NetworkInterfaceManager
 
 		/** @brief Reserved */
 		unsigned long DriverID;
+
+		/** @brief DeviceFeatures */
+		unsigned long Features;
+
+		/** @brief The frame the protocols are handling, only set during DeliverFrame() */
+		NetworkPacket::Buffer *Current;
 	};
 
 	class Events
@@ -87,6 +103,27 @@ namespace NetworkInterfaceManager
 		}
 	};
 
+	/**
+	 * Pass a received frame to the protocols bound to Interface.
+	 * Takes over the caller's reference to Packet.
+	 */
+	void DeliverFrame(DeviceInterface *Interface, NetworkPacket::Buffer *Packet);
+
+	/**
+	 * Called by network drivers for every received frame, the
+	 * buffer is handed up the stack without copying. Takes
+	 * over the caller's reference to Packet.
+	 *
+	 * @param Device The device the frame arrived on
+	 */
+	void ReceiveFrame(dev_t Device, NetworkPacket::Buffer *Packet);
+
+	/**
+	 * Make the receive thread look at its backlog and
+	 * the packet pool, safe from interrupt handlers
+	 */
+	void WakeReceiveThread();
+
 	class NetworkInterface
 	{
 	private:
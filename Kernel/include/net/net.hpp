@@ -227,6 +227,72 @@ struct InternetProtocol
 	} v6;
 };
 
+/**
+ * Spread a key over hash buckets (the MurmurHash3 finalizer)
+ */
+static inline uint64_t NetworkHashMix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+/*
+	Internet checksum (RFC 1071). Partial sums are kept unfolded
+	in 64 bits and are built from the bytes as they are in memory,
+	so a finished checksum is stored in the header as it is,
+	without byte swapping.
+*/
+
+/**
+ * @return The checksum of Data, ready to be stored in a header
+ */
 uint16_t CalculateChecksum(uint16_t *Data, size_t Length);
 
+/**
+ * Add Data to a partial sum. Data is taken to start at an
+ * even offset, see ChecksumAdd() for anything else.
+ */
+uint64_t ChecksumPartial(const void *Data, size_t Length, uint64_t Sum = 0);
+
+/**
+ * Copy Source to Destination and add it to a partial sum
+ */
+uint64_t ChecksumCopy(void *Destination, const void *Source, size_t Length, uint64_t Sum = 0);
+
+/**
+ * Add the partial sum of a block that starts at Offset
+ * in the checksummed data
+ */
+uint64_t ChecksumAdd(uint64_t Sum, uint64_t Partial, size_t Offset);
+
+/**
+ * Fold a partial sum to 16 bits, without complementing it
+ */
+uint16_t ChecksumFold(uint64_t Sum);
+
+/**
+ * @return The checksum of a partial sum, ready to be stored
+ */
+static inline uint16_t ChecksumFinish(uint64_t Sum) { return (uint16_t)~ChecksumFold(Sum); }
+
+/**
+ * Update a checksum after a 16-bit field changed (RFC 1624 eqn. 3).
+ * All values are as stored in the packet.
+ */
+uint16_t ChecksumUpdate16(uint16_t Checksum, uint16_t Old, uint16_t New);
+
+/**
+ * Update a checksum after a 32-bit field changed, like an address
+ */
+uint16_t ChecksumUpdate32(uint16_t Checksum, uint32_t Old, uint32_t New);
+
+/* The implementations behind ChecksumPartial(), exposed for the tests */
+uint64_t ChecksumScalar(const void *Data, size_t Length, uint64_t Sum);
+uint64_t ChecksumSSE2(const void *Data, size_t Length, uint64_t Sum);
+uint64_t ChecksumAVX2(const void *Data, size_t Length, uint64_t Sum);
+
 #endif // !__FENNIX_KERNEL_NETWORK_H__
@@ -0,0 +1,207 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_NETWORK_PACKET_H__
+#define __FENNIX_KERNEL_NETWORK_PACKET_H__
+
+#include <types.h>
+#include <atomic>
+
+/* Room kept in front of the payload for the link, IP and transport headers */
+#define PACKET_HEADROOM 128
+
+/* Size of a pooled buffer. A whole Ethernet frame and its headroom fit in one. */
+#define PACKET_BUFFER_SIZE 2048
+
+/* Free buffers cached per CPU, and how many move to or from the global pool at once */
+#define PACKET_CACHE_SIZE 128
+#define PACKET_CACHE_BATCH 32
+
+/* Buffers put in the pool at boot, and the free count the receive thread keeps it above */
+#define PACKET_POOL_RESERVE 512
+#define PACKET_POOL_LOW 128
+
+namespace NetworkPacket
+{
+	enum ChecksumState : uint8_t
+	{
+		/** Nothing is known, software checks or fills it */
+		CHECKSUM_NONE,
+
+		/**
+		 * Transmit: the transport checksum field holds only the
+		 * folded pseudo-header sum, the device sums the rest
+		 * from ChecksumStart and stores it at ChecksumOffset.
+		 */
+		CHECKSUM_PARTIAL,
+
+		/** Receive: the device already verified the transport checksum */
+		CHECKSUM_VERIFIED
+	};
+
+	/**
+	 * Reference counted packet buffer.
+	 *
+	 *  Head           Data            Data + Length       Head + Size
+	 *   |  headroom    |    payload    |     tailroom      |
+	 *
+	 * Headers are added with Push() while a packet goes down
+	 * the stack and removed with Pull() while it goes up, the
+	 * payload is never moved. A packet can be a chain of
+	 * buffers linked with Next, only the first one carries
+	 * the reference count of the chain.
+	 *
+	 * Pooled buffers never cross a page, so the storage is
+	 * physically contiguous and can be given to a device.
+	 */
+	struct Buffer
+	{
+		std::atomic_int References = 1;
+
+		uint8_t *Head = nullptr;
+		uint8_t *Data = nullptr;
+		size_t Length = 0;
+		size_t Size = 0;
+
+		/** Next fragment of the packet */
+		Buffer *Next = nullptr;
+
+		/** Storage comes from the pool */
+		bool Pooled = false;
+
+		/** ChecksumState */
+		uint8_t Checksum = CHECKSUM_NONE;
+
+		/** Offsets from Data of the checksummed area and of the checksum field */
+		uint16_t ChecksumStart = 0;
+		uint16_t ChecksumOffset = 0;
+
+		size_t Headroom() { return (size_t)(Data - Head); }
+		size_t Tailroom() { return Size - Headroom() - Length; }
+
+		/**
+		 * Length of the whole chain
+		 */
+		size_t TotalLength();
+
+		/**
+		 * Prepend Bytes to the payload
+		 *
+		 * @return Pointer to the new first byte
+		 */
+		uint8_t *Push(size_t Bytes);
+
+		/**
+		 * Strip Bytes from the front of the payload
+		 *
+		 * @return Pointer to the new first byte
+		 */
+		uint8_t *Pull(size_t Bytes);
+
+		/**
+		 * Extend the payload at its end
+		 *
+		 * @return Pointer to the first added byte
+		 */
+		uint8_t *Append(size_t Bytes);
+
+		/**
+		 * Cut the payload down to Length bytes
+		 */
+		void Trim(size_t Length);
+
+		/**
+		 * Link Fragment at the end of the chain. The
+		 * chain takes over the fragment's reference.
+		 */
+		void Chain(Buffer *Fragment);
+
+		/**
+		 * Copy bytes out of the chain
+		 *
+		 * @return Bytes copied
+		 */
+		size_t Copy(size_t Offset, void *Destination, size_t Length);
+
+		void Get() { References++; }
+
+		/**
+		 * Drop a reference, the chain goes back to the
+		 * pool with the last one.
+		 */
+		void Put();
+	};
+
+	struct Statistics
+	{
+		/** Buffers created for the pool */
+		uint64_t Created;
+
+		/** Buffers in use */
+		uint64_t InUse;
+
+		/** Allocations served by a per-CPU cache */
+		uint64_t CacheHits;
+
+		/** Allocations too big for the pool */
+		uint64_t Oversized;
+	};
+
+	/**
+	 * Fill the pool with PACKET_POOL_RESERVE buffers
+	 */
+	void Initialize();
+
+	/**
+	 * Grow the pool if it is running low. Must not be
+	 * called with interrupts disabled.
+	 */
+	void Refill();
+
+	/**
+	 * Allocate a packet buffer
+	 *
+	 * With interrupts disabled only free pooled buffers are
+	 * handed out, the pool never grows there. An interrupt
+	 * handler that gets nullptr drops its frame and the
+	 * receive thread refills the pool.
+	 *
+	 * @param Length Payload bytes that must fit after the headroom
+	 * @param Headroom Bytes to reserve in front of the payload
+	 * @return The buffer with an empty payload, nullptr
+	 *         if there is no memory
+	 */
+	Buffer *Allocate(size_t Length, size_t Headroom = PACKET_HEADROOM);
+
+	/**
+	 * Allocate a buffer and copy Data into its payload
+	 */
+	Buffer *FromData(const void *Data, size_t Length, size_t Headroom = PACKET_HEADROOM);
+
+	/**
+	 * Make the chain a single buffer, copying only if
+	 * it has more than one fragment.
+	 *
+	 * @return The linear packet, which replaces the old
+	 *         one. nullptr if there is no memory.
+	 */
+	Buffer *Linearize(Buffer *Packet);
+
+	Statistics GetStatistics();
+}
+
+#endif // !__FENNIX_KERNEL_NETWORK_PACKET_H__
@@ -0,0 +1,169 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_SOCKET_H__
+#define __FENNIX_KERNEL_SOCKET_H__
+
+#include <fs/node.hpp>
+#include <types.h>
+
+struct PollTable;
+
+/*
+	Kernel side of the BSD socket API. The values here are not
+	part of any ABI, the syscall layers translate their own
+	constants and address structures to these.
+*/
+
+namespace NetworkSocket
+{
+	enum SocketDomain
+	{
+		DOMAIN_INET = 1
+	};
+
+	enum SocketType
+	{
+		TYPE_STREAM = 1,
+		TYPE_DGRAM = 2
+	};
+
+	enum MessageFlags
+	{
+		MESSAGE_PEEK = 0x1,
+		MESSAGE_DONTWAIT = 0x2,
+		MESSAGE_WAITALL = 0x4,
+		MESSAGE_NOSIGNAL = 0x8
+	};
+
+	enum ShutdownHow
+	{
+		SHUTDOWN_READ = 0x1,
+		SHUTDOWN_WRITE = 0x2,
+		SHUTDOWN_BOTH = SHUTDOWN_READ | SHUTDOWN_WRITE
+	};
+
+	enum SocketOption
+	{
+		OPTION_REUSEADDR,
+		OPTION_KEEPALIVE,
+		OPTION_ERROR,
+		OPTION_TYPE,
+		OPTION_ACCEPTCONN,
+		OPTION_SNDBUF,
+		OPTION_RCVBUF,
+		OPTION_NODELAY,
+		OPTION_MAXSEG,
+		OPTION_CONGESTION
+	};
+
+	/**
+	 * IPv4 address and port, both in host byte order
+	 */
+	struct SocketAddress
+	{
+		uint32_t Address = 0;
+		uint16_t Port = 0;
+	};
+
+	class Socket
+	{
+	public:
+		int Type;
+
+		virtual int Bind(const SocketAddress &Address) = 0;
+		virtual int Connect(const SocketAddress &Address, bool NonBlock) = 0;
+		virtual int Listen(int Backlog) = 0;
+
+		/**
+		 * @param Result The new connected socket
+		 * @param Peer Filled with the remote address, can be nullptr
+		 */
+		virtual int Accept(Socket **Result, SocketAddress *Peer, bool NonBlock) = 0;
+
+		/**
+		 * @param Flags MessageFlags
+		 * @return Bytes queued, or a negative errno
+		 */
+		virtual ssize_t Send(const void *Buffer, size_t Length, int Flags, bool NonBlock) = 0;
+
+		/**
+		 * @param Flags MessageFlags
+		 * @return Bytes received, zero at end of stream
+		 */
+		virtual ssize_t Receive(void *Buffer, size_t Length, int Flags, bool NonBlock) = 0;
+
+		/**
+		 * @param How ShutdownHow
+		 */
+		virtual int Shutdown(int How) = 0;
+
+		virtual int GetName(SocketAddress *Address) = 0;
+		virtual int GetPeerName(SocketAddress *Address) = 0;
+
+		/**
+		 * Integer options take an int, OPTION_CONGESTION
+		 * takes the algorithm name.
+		 */
+		virtual int SetOption(int Option, const void *Value, size_t Length) = 0;
+
+		/**
+		 * @param Length In: size of Value. Out: bytes written
+		 */
+		virtual int GetOption(int Option, void *Value, size_t *Length) = 0;
+
+		/**
+		 * @return Ready POLL* events
+		 */
+		virtual int Poll(PollTable *Table) = 0;
+
+		/**
+		 * Called when the last file referencing the
+		 * socket is closed. The socket frees itself.
+		 */
+		virtual void Release() = 0;
+
+		Socket(int Type) : Type(Type) {}
+		virtual ~Socket() = default;
+	};
+
+	/**
+	 * Create a socket
+	 *
+	 * @param Domain SocketDomain
+	 * @param Type SocketType
+	 * @param Protocol Zero or the IPPROTO number matching Type
+	 * @param Result The new socket
+	 */
+	int Create(int Domain, int Type, int Protocol, Socket **Result);
+
+	/**
+	 * Wrap a socket in a node. The socket is released
+	 * when the last reference to the node is dropped.
+	 *
+	 * @param Flags O_NONBLOCK is applied to the node
+	 */
+	Node CreateNode(Socket *Sock, int Flags);
+
+	/**
+	 * Get the socket of a node, nullptr if the
+	 * node is not a socket.
+	 */
+	Socket *FromNode(Node &node);
+}
+
+#endif // !__FENNIX_KERNEL_SOCKET_H__
@@ -18,10 +18,364 @@
 #ifndef __FENNIX_KERNEL_TCP_H__
 #define __FENNIX_KERNEL_TCP_H__
 
+#include <net/socket.hpp>
+#include <net/ipv4.hpp>
+#include <net/nc.hpp>
+#include <fs/poll.hpp>
 #include <types.h>
+#include <atomic>
+#include <list>
+
+/* Connection hash buckets, must be a power of two */
+#define TCP_CONN_HASH_SIZE 1024
+#define TCP_LISTEN_HASH_SIZE 64
+
+/* Timer wheel resolution and size */
+#define TCP_TICK_MS 10
+#define TCP_WHEEL_SLOTS 512
+
+/* Per connection buffer sizes, in bytes */
+#define TCP_SEND_BUFFER (256 * 1024)
+#define TCP_RECEIVE_BUFFER (256 * 1024)
+
+/* Defaults for peers that don't send the MSS option (RFC 9293 3.7.1) */
+#define TCP_DEFAULT_MSS 536
+#define TCP_MAX_BACKLOG 4096
+
+/* Ephemeral port range, the same as Linux uses */
+#define TCP_EPHEMERAL_FIRST 32768
+#define TCP_EPHEMERAL_LAST 60999
 
 namespace NetworkTCP
 {
+	struct TCPHeader
+	{
+		uint16_t SourcePort;
+		uint16_t DestinationPort;
+		uint32_t SequenceNumber;
+		uint32_t AcknowledgementNumber;
+		uint8_t Reserved : 4;
+		uint8_t DataOffset : 4;
+		uint8_t Flags;
+		uint16_t Window;
+		uint16_t Checksum;
+		uint16_t UrgentPointer;
+	} __packed;
+
+	enum TCPFlags : uint8_t
+	{
+		FLAG_FIN = 0x01,
+		FLAG_SYN = 0x02,
+		FLAG_RST = 0x04,
+		FLAG_PSH = 0x08,
+		FLAG_ACK = 0x10,
+		FLAG_URG = 0x20,
+		FLAG_ECE = 0x40,
+		FLAG_CWR = 0x80
+	};
+
+	enum TCPOptions : uint8_t
+	{
+		OPTION_END = 0,
+		OPTION_NOP = 1,
+		OPTION_MSS = 2,
+		OPTION_WINDOW_SCALE = 3,
+		OPTION_SACK_PERMITTED = 4,
+		OPTION_SACK = 5,
+		OPTION_TIMESTAMP = 8
+	};
+
+	enum TCPState
+	{
+		STATE_CLOSED,
+		STATE_LISTEN,
+		STATE_SYN_SENT,
+		STATE_SYN_RECEIVED,
+		STATE_ESTABLISHED,
+		STATE_FIN_WAIT_1,
+		STATE_FIN_WAIT_2,
+		STATE_CLOSE_WAIT,
+		STATE_CLOSING,
+		STATE_LAST_ACK,
+		STATE_TIME_WAIT
+	};
+
+	/* Sequence number comparisons, modulo 2^32 */
+	inline bool SeqLT(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+	inline bool SeqLE(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+	inline bool SeqGT(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+	inline bool SeqGE(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+	/**
+	 * A [Start, End) range of sequence numbers, used
+	 * for SACK blocks on both sides of a connection.
+	 */
+	struct SequenceRange
+	{
+		uint32_t Start;
+		uint32_t End;
+	};
+
+	class TimerWheel;
+
+	struct Timer
+	{
+		void (*Callback)(Timer *Timer) = nullptr;
+		void *Private = nullptr;
+		uint64_t Expires = 0;
+		bool Armed = false;
+		std::list<Timer *>::iterator Entry;
+	};
+
+	/**
+	 * Hashed timer wheel. A timer sits in the slot of its
+	 * expiry tick; timers more than one revolution away stay
+	 * in their slot until their tick comes around.
+	 */
+	class TimerWheel
+	{
+	private:
+		std::list<Timer *> Slots[TCP_WHEEL_SLOTS];
+		uint64_t Current = 0;
+
+	public:
+		void Start(uint64_t Now) { Current = Now; }
+
+		/**
+		 * Arm or re-arm a timer
+		 *
+		 * @param Ticks Delay from now, at least one tick
+		 */
+		void Schedule(Timer *Timer, uint64_t Ticks);
+		void Cancel(Timer *Timer);
+
+		/**
+		 * Move the wheel towards Now and disarm the next
+		 * expired timer. Timers are handed out one at a
+		 * time so that a callback can still cancel others.
+		 *
+		 * @return The timer, nullptr when none is left
+		 */
+		Timer *Expire(uint64_t Now);
+	};
+
+	/**
+	 * Byte ring used for the send and receive buffers.
+	 *
+	 * Bytes [0, Used()) are queued. The receive side also
+	 * stores out-of-order data past Used() with WriteAt()
+	 * and commits it once the hole before it is filled.
+	 */
+	class ByteRing
+	{
+	private:
+		uint8_t *Data = nullptr;
+		size_t Capacity = 0;
+		size_t Head = 0;
+		size_t Size = 0;
+
+	public:
+		size_t Used() { return Size; }
+		size_t Free() { return Capacity - Size; }
+		size_t GetCapacity() { return Capacity; }
+
+		size_t Write(const void *Buffer, size_t Length);
+		size_t WriteAt(size_t Offset, const void *Buffer, size_t Length);
+
+		/**
+		 * Copy queued bytes out without consuming them
+		 *
+		 * @param Sum If set, the copied bytes are added to
+		 *            this checksum partial sum
+		 */
+		size_t Peek(size_t Offset, void *Buffer, size_t Length, uint64_t *Sum = nullptr);
+		void Commit(size_t Length);
+		void Consume(size_t Length);
+
+		ByteRing(size_t Capacity);
+		~ByteRing();
+	};
+
+	class Connection;
+
+	/**
+	 * Congestion control algorithm. Only cwnd and ssthresh
+	 * are touched here, loss detection and recovery are
+	 * done by the connection.
+	 */
+	class CongestionControl
+	{
+	public:
+		const char *Name;
+
+		/**
+		 * Called when the connection becomes established
+		 */
+		virtual void Initialize(Connection *Conn) = 0;
+
+		/**
+		 * New data was cumulatively acknowledged outside
+		 * of loss recovery
+		 */
+		virtual void OnAck(Connection *Conn, uint32_t Acked) = 0;
+
+		/**
+		 * Loss was detected, set the new ssthresh
+		 */
+		virtual void OnLoss(Connection *Conn, bool Timeout) = 0;
+
+		CongestionControl(const char *Name) : Name(Name) {}
+		virtual ~CongestionControl() = default;
+	};
+
+	/**
+	 * @param Name "reno" or "cubic"
+	 * @return The algorithm, nullptr if unknown
+	 */
+	CongestionControl *GetCongestionControl(const char *Name);
+	CongestionControl *GetDefaultCongestionControl();
+
+	class TCP;
+
+	class Connection
+	{
+	public:
+		std::atomic_int References = 1;
+
+		TCP *Stack = nullptr;
+		TCPState State = STATE_CLOSED;
+		uint32_t LocalAddress = 0;
+		uint32_t RemoteAddress = 0;
+		uint16_t LocalPort = 0;
+		uint16_t RemotePort = 0;
+		bool Hashed = false;
+		bool Bound = false;
+
+		/* Send sequence space (RFC 9293 3.3.1) */
+		uint32_t InitialSend = 0;
+		uint32_t SendUnacked = 0;
+		uint32_t SendNext = 0;
+		uint32_t SendMax = 0;
+		uint32_t SendWindow = 0;
+		uint32_t SendWL1 = 0;
+		uint32_t SendWL2 = 0;
+		uint32_t MaxSendWindow = 0;
+		uint16_t SendMSS = TCP_DEFAULT_MSS;
+		uint8_t SendScale = 0;
+		ByteRing SendBuffer;
+		bool FinQueued = false;
+		bool FinSent = false;
+		uint32_t FinSequence = 0;
+
+		/* Receive sequence space */
+		uint32_t InitialReceive = 0;
+		uint32_t ReceiveNext = 0;
+		uint32_t ReceiveAdvertised = 0;
+		uint8_t ReceiveScale = 0;
+		ByteRing ReceiveBuffer;
+		std::list<SequenceRange> OutOfOrder;
+		uint32_t LastOutOfOrder = 0;
+		bool FinReceived = false;
+
+		/* Options we offer, cleared if the peer doesn't */
+		bool WindowScaling = true;
+		bool SackPermitted = true;
+
+		/* RTT estimation and retransmission (RFC 6298), in microseconds */
+		uint64_t SmoothedRTT = 0;
+		uint64_t RTTVariance = 0;
+		uint64_t RTO = 1000000;
+		bool RTTTiming = false;
+		uint32_t RTTSequence = 0;
+		uint64_t RTTStart = 0;
+		int Retries = 0;
+		int PersistBackoff = 0;
+
+		/* Congestion control */
+		CongestionControl *Congestion = nullptr;
+		uint32_t CongestionWindow = 0;
+		uint32_t SlowStartThreshold = UINT32_MAX;
+		uint32_t BytesAcked = 0;
+		uint32_t DuplicateAcks = 0;
+		bool InRecovery = false;
+		uint32_t RecoveryPoint = 0;
+		uint32_t HighRetransmitted = 0;
+		std::list<SequenceRange> Scoreboard;
+		uint32_t SackedBytes = 0;
+
+		/* CUBIC state (RFC 9438) */
+		struct
+		{
+			uint64_t EpochStart;
+			uint32_t LastMax;
+			uint32_t Origin;
+			uint64_t K;
+			uint32_t Estimate;
+			uint64_t Credit;
+		} Cubic{};
+
+		/* Delayed acknowledgements */
+		int UnackedSegments = 0;
+		bool AckNow = false;
+
+		Timer RetransmitTimer;
+		Timer DelayedAckTimer;
+		Timer PersistTimer;
+		Timer LingerTimer;
+
+		/* Listening sockets */
+		Connection *Parent = nullptr;
+		std::list<Connection *> AcceptQueue;
+		int Backlog = 0;
+		int Pending = 0;
+
+		/* Socket side */
+		vfs::WaitQueue Queue;
+		int Error = 0;
+		bool NoDelay = false;
+		bool ReuseAddress = false;
+		bool ReadShutdown = false;
+		bool Orphaned = false;
+		bool WasConnected = false;
+
+		void Get() { References++; }
+		void Put();
+
+		Connection();
+		~Connection();
+	};
+
+	class TCP : public NetworkIPv4::IPv4Events
+	{
+	private:
+		NetworkIPv4::IPv4 *ipv4;
+		NetworkInterfaceManager::DeviceInterface *Interface;
+
+	public:
+		NetworkInterfaceManager::DeviceInterface *GetInterface() { return this->Interface; }
+		uint32_t GetAddress() { return this->Interface->IP.v4.ToHex(); }
+
+		/**
+		 * Get the MSS to announce on this interface
+		 */
+		uint16_t GetMSS();
+
+		/**
+		 * Hand a finished segment to IPv4, which takes
+		 * over the reference to it
+		 */
+		void Transmit(uint32_t Destination, NetworkPacket::Buffer *Segment);
+
+		virtual bool OnIPv4PacketReceived(InternetProtocol SourceIP, InternetProtocol DestinationIP, uint8_t *Data, size_t Length);
+
+		TCP(NetworkIPv4::IPv4 *ipv4, NetworkInterfaceManager::DeviceInterface *Interface);
+		~TCP();
+	};
+
+	/**
+	 * Create an unconnected TCP socket
+	 */
+	NetworkSocket::Socket *CreateSocket();
 }
 
 #endif // !__FENNIX_KERNEL_TCP_H__
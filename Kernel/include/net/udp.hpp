@@ -21,7 +21,17 @@
 #include <net/ipv4.hpp>
 #include <net/udp.hpp>
 #include <net/nc.hpp>
+#include <lock.hpp>
 #include <types.h>
+#include <list>
+
+/* Socket hash buckets, must be powers of two */
+#define UDP_HASH_SIZE 256
+#define UDP_PORT_HASH_SIZE 64
+
+/* Ephemeral port range, the same as TCP uses */
+#define UDP_EPHEMERAL_FIRST 32768
+#define UDP_EPHEMERAL_LAST 60999
 
 namespace NetworkUDP
 {
@@ -63,14 +73,53 @@ namespace NetworkUDP
 		NetworkIPv4::IPv4 *ipv4;
 		NetworkInterfaceManager::DeviceInterface *Interface;
 
+		/*
+			Sockets are hashed on (local port, remote address,
+			remote port). Unconnected ones go in the bucket of
+			(local port, 0, 0) and catch whatever the connected
+			ones don't. Ports holds every socket by local port.
+		*/
+		NewLock(SocketLock);
+		std::list<Socket *> Sockets[UDP_HASH_SIZE];
+		std::list<Socket *> Ports[UDP_PORT_HASH_SIZE];
+		uint64_t HashSecret = 0;
+		uint16_t NextPort = UDP_EPHEMERAL_FIRST;
+
+		std::list<Socket *> &Bucket(uint16_t LocalPort, uint32_t RemoteAddress, uint16_t RemotePort);
+		std::list<Socket *> &PortBucket(uint16_t LocalPort);
+		void Hash(Socket *Socket);
+		void Unhash(Socket *Socket);
+		Socket *Lookup(uint16_t LocalPort, uint32_t RemoteAddress, uint16_t RemotePort);
+		bool PortInUse(uint16_t Port);
+		uint16_t AllocatePort();
+
 	public:
 		NetworkInterfaceManager::DeviceInterface *GetInterface() { return this->Interface; }
 
 		UDP(NetworkIPv4::IPv4 *ipv4, NetworkInterfaceManager::DeviceInterface *Interface);
 		~UDP();
 
+		/**
+		 * Create a socket on an ephemeral port that only
+		 * receives from IP:Port. A broadcast IP or a zero
+		 * port receives from anyone.
+		 */
 		virtual Socket *Connect(InternetProtocol IP, uint16_t Port);
+
+		/**
+		 * Create a socket that connects itself to the
+		 * sender of the first datagram it receives
+		 *
+		 * @param Port Zero for an ephemeral port
+		 * @return nullptr if the port is taken
+		 */
 		virtual Socket *Listen(uint16_t Port);
+
+		/**
+		 * Close and free a socket. No handler of the socket
+		 * runs after this returns, so it must not be called
+		 * from one.
+		 */
 		virtual void Disconnect(Socket *Socket);
 		virtual void Send(Socket *Socket, uint8_t *Data, size_t Length);
 		virtual void Bind(Socket *Socket, UDPEvents *EventHandler);
@@ -81,6 +130,7 @@ namespace NetworkUDP
 	class Socket
 	{
 	public:
+		/* Ports are in network byte order */
 		InternetProtocol LocalIP;
 		uint16_t LocalPort = 0;
 		InternetProtocol RemoteIP;
@@ -451,6 +451,11 @@ namespace Tasking
 		std::atomic_int ExitCode;
 		std::atomic<TaskState> State = Waiting;
 
+		/* Kernel threads using the address space or the file
+		   descriptors, a terminated process is only destroyed
+		   once they all let go */
+		std::atomic_int Holds = 0;
+
 		/* Info & Security info */
 		struct
 		{
@@ -18,6 +18,7 @@
 #ifndef __FENNIX_KERNEL_TTY_H__
 #define __FENNIX_KERNEL_TTY_H__
 
+#include <fs/poll.hpp>
 #include <termios.h>
 #include <mutex>
 
@@ -32,6 +33,9 @@ namespace TTY
 		std::mutex Mutex;
 
 	public:
+		/** Woken with POLLIN when data is written */
+		vfs::WaitQueue ReadQueue;
+
 		TerminalBuffer(size_t Size) : Buffer(Size), ReadIndex(0), WriteIndex(0) {}
 
 		ssize_t Read(char *OutputBuffer, size_t Size)
@@ -50,19 +54,33 @@ namespace TTY
 
 		ssize_t Write(const char *InputBuffer, size_t Size)
 		{
-			std::lock_guard<std::mutex> lock(Mutex);
 			size_t bytesWritten = 0;
-
-			for (size_t i = 0; i < Size; ++i)
 			{
-				Buffer[WriteIndex] = InputBuffer[i];
-				WriteIndex = (WriteIndex + 1) % Buffer.size();
-				bytesWritten++;
+				std::lock_guard<std::mutex> lock(Mutex);
+				for (size_t i = 0; i < Size; ++i)
+				{
+					Buffer[WriteIndex] = InputBuffer[i];
+					WriteIndex = (WriteIndex + 1) % Buffer.size();
+					bytesWritten++;
+				}
 			}
 
+			if (bytesWritten)
+				ReadQueue.Wake(POLLIN | POLLRDNORM);
 			return bytesWritten;
 		}
 
+		int Poll(PollTable *Table)
+		{
+			PollWait(Table, ReadQueue);
+			int mask = 0;
+			if (AvailableToRead())
+				mask |= POLLIN | POLLRDNORM;
+			if (AvailableToWrite())
+				mask |= POLLOUT | POLLWRNORM;
+			return mask;
+		}
+
 		void DrainOutput()
 		{
 			std::lock_guard<std::mutex> lock(Mutex);
@@ -94,6 +112,7 @@ namespace TTY
 		virtual ssize_t Read(void *Buffer, size_t Size, off_t Offset);
 		virtual ssize_t Write(const void *Buffer, size_t Size, off_t Offset);
 		virtual int Ioctl(unsigned long Request, void *Argp);
+		virtual int Poll(PollTable *Table);
 
 		TeletypeDriver();
 		virtual ~TeletypeDriver() = default;
@@ -120,6 +139,11 @@ namespace TTY
 			{
 				return TermBuf.Write((const char *)Buffer, Size);
 			}
+
+			int Poll(PollTable *Table)
+			{
+				return TermBuf.Poll(Table);
+			}
 		};
 
 		class PTYSlave
@@ -140,6 +164,11 @@ namespace TTY
 			{
 				return TermBuf.Write((const char *)Buffer, Size);
 			}
+
+			int Poll(PollTable *Table)
+			{
+				return TermBuf.Poll(Table);
+			}
 		};
 
 		PTYMaster Master;
@@ -170,6 +199,14 @@ namespace TTY
 		{
 			return Master.Write(Buffer, Size);
 		}
+
+		int Poll(PollTable *Table)
+		{
+			/* Readable from the slave side, writable into the master */
+			int mask = Slave.Poll(Table) & (POLLIN | POLLRDNORM);
+			mask |= Master.Poll(Table) & (POLLOUT | POLLWRNORM);
+			return mask;
+		}
 	};
 
 	class PTMXDevice
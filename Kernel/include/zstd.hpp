@@ -0,0 +1,88 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_ZSTD_H__
+#define __FENNIX_KERNEL_ZSTD_H__
+
+#include <types.h>
+
+/*
+	Zstandard frame decoder, without dictionary support.
+	https://datatracker.ietf.org/doc/html/rfc8878
+*/
+
+#define ZSTD_FRAME_MAGIC 0xFD2FB528
+
+/* Skippable frames use any of the 16 magics from this one */
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A50
+#define ZSTD_SKIPPABLE_MASK 0xFFFFFFF0
+
+/* Decoded size of a block is never larger than this */
+#define ZSTD_BLOCK_SIZE_MAX (128 * 1024)
+
+namespace ZSTD
+{
+	uint64_t XXH64(const void *Data, size_t Length, uint64_t Seed);
+
+	struct FrameInfo
+	{
+		/* Bytes the frame takes in the source, checksum included */
+		size_t FrameSize;
+
+		/* Decoded size, ContentSize is only valid if Known is set */
+		size_t ContentSize;
+		bool Known;
+
+		/* Upper bound of the decoded size from the block headers */
+		size_t Bound;
+
+		/* Skippable frames hold no content */
+		bool Skippable;
+	};
+
+	/**
+	 * Parse a frame header and walk the block headers,
+	 * without decoding anything
+	 *
+	 * @return false if Data doesn't start with a valid frame
+	 */
+	bool GetFrameInfo(const void *Data, size_t Size, FrameInfo *Info);
+
+	/**
+	 * Decode a single frame
+	 *
+	 * @param Source Start of the frame
+	 * @param Capacity Size of Destination, the frame must fit whole
+	 * @return Bytes written, -1 if the frame is corrupted, uses a
+	 *         dictionary or doesn't fit
+	 */
+	ssize_t DecompressFrame(const void *Source, size_t SourceSize,
+							void *Destination, size_t Capacity);
+
+	inline bool IsFrame(const void *Data, size_t Size)
+	{
+		return Size >= 4 && *(const uint32_t *)Data == ZSTD_FRAME_MAGIC;
+	}
+
+	inline bool IsSkippableFrame(const void *Data, size_t Size)
+	{
+		return Size >= 8 &&
+			   (*(const uint32_t *)Data & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC;
+	}
+}
+
+#endif // !__FENNIX_KERNEL_ZSTD_H__
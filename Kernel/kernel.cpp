@@ -52,6 +52,10 @@ struct KernelConfig Config = {
 	.UnlockDeadLock = false,
 	.SIMD = true,
 	.Quiet = false,
+	.NetRXDescriptors = 1024,
+	.NetTXDescriptors = 1024,
+	.NetInterruptRate = 8000,
+	.PrefetchRootfs = true,
 };
 
 Video::Display *Display = nullptr;
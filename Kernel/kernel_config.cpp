@@ -91,6 +91,30 @@ static struct cag_option ConfigOptions[] = {
 	 .value_name = "BOOL",
 	 .description = "Enable quiet boot"},
 
+	{.identifier = 'r',
+	 .access_letters = NULL,
+	 .access_name = "rxdesc",
+	 .value_name = "VALUE",
+	 .description = "Receive descriptors per network card (256-4096)"},
+
+	{.identifier = 'x',
+	 .access_letters = NULL,
+	 .access_name = "txdesc",
+	 .value_name = "VALUE",
+	 .description = "Transmit descriptors per network card (256-4096)"},
+
+	{.identifier = 'n',
+	 .access_letters = NULL,
+	 .access_name = "itr",
+	 .value_name = "VALUE",
+	 .description = "Network card interrupts per second (0 = unlimited)"},
+
+	{.identifier = 'f',
+	 .access_letters = NULL,
+	 .access_name = "prefetch",
+	 .value_name = "BOOL",
+	 .description = "Inflate the compressed rootfs on all cores at boot"},
+
 	{.identifier = 'h',
 	 .access_letters = "h",
 	 .access_name = "help",
@@ -243,6 +267,35 @@ void ParseConfig(char *ConfigString, KernelConfig *ModConfig)
 			KPrint("Quiet boot: %s", value);
 			break;
 		}
+		case 'r':
+		{
+			value = cag_option_get_value(&context);
+			ModConfig->NetRXDescriptors = atoi(value);
+			KPrint("Network receive descriptors: %s", value);
+			break;
+		}
+		case 'x':
+		{
+			value = cag_option_get_value(&context);
+			ModConfig->NetTXDescriptors = atoi(value);
+			KPrint("Network transmit descriptors: %s", value);
+			break;
+		}
+		case 'n':
+		{
+			value = cag_option_get_value(&context);
+			ModConfig->NetInterruptRate = atoi(value);
+			KPrint("Network interrupt rate: %s", atoi(value) ? value : "unlimited");
+			break;
+		}
+		case 'f':
+		{
+			value = cag_option_get_value(&context);
+			strcmp(value, "true") == 0 ? ModConfig->PrefetchRootfs = true
+									   : ModConfig->PrefetchRootfs = false;
+			KPrint("Prefetch rootfs: %s", value);
+			break;
+		}
 		case 'h':
 		{
 			KPrint("Usage: fennix.elf [OPTION]...");
@@ -22,6 +22,7 @@
 
 #include <fs/ustar.hpp>
 #include <subsystems.hpp>
+#include <net/packet.hpp>
 #include <kshell.hpp>
 #include <power.hpp>
 #include <lock.hpp>
@@ -102,6 +103,10 @@ void KernelMainThread()
 {
 	thisThread->SetPriority(Tasking::Critical);
 
+	/* The rootfs is mounted before the scheduler runs */
+	if (Config.PrefetchRootfs)
+		PrefetchCompressedUSTAR();
+
 #ifdef DEBUG
 	StressKernel();
 	// TaskManager->CreateThread(thisProcess, Tasking::IP(tasking_test_fb));
@@ -110,6 +115,13 @@ void KernelMainThread()
 	TaskManager->CreateThread(thisProcess, Tasking::IP(TaskMgr));
 	TaskManager->CreateThread(thisProcess, Tasking::IP(TaskHeartbeat));
 	TreeFS(fs->GetRoot(0), 0);
+	TestNameCache();
+	TestRAMFS();
+	TestFileDescriptors();
+	TestEventPoll();
+	TestIoUring();
+	TestDirectorySnapshot();
+	TestVFSConcurrency();
 	coroutineTest();
 #endif
 
@@ -121,6 +133,9 @@ void KernelMainThread()
 	if (IsVirtualizedEnvironment())
 		KPrint("Running in a virtualized environment");
 
+	KPrint("Initializing Network Packet Pool");
+	NetworkPacket::Initialize();
+
 	KPrint("Initializing USB Subsystem");
 	usb = new UniversalSerialBus::Manager;
 
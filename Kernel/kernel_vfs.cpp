@@ -18,6 +18,7 @@
 #include "kernel.h"
 
 #include <fs/ustar.hpp>
+#include <fs/ramfs.hpp>
 #include <memory.hpp>
 
 vfs::Virtual *fs = nullptr;
@@ -43,7 +44,15 @@ void SearchForInitrd()
 		if (strcmp(moduleCommand, "rootfs") == 0)
 		{
 			KPrint("rootfs found at %#lx", moduleAddress);
-			if (TestAndInitializeUSTAR(moduleAddress, moduleSize, 0))
+			if (LZ4::IsFrame((void *)moduleAddress, moduleSize) ||
+				ZSTD::IsFrame((void *)moduleAddress, moduleSize) ||
+				ZSTD::IsSkippableFrame((void *)moduleAddress, moduleSize))
+			{
+				if (TestAndInitializeCompressedUSTAR(moduleAddress, moduleSize, 0))
+					continue;
+				error("rootfs is not a valid LZ4 or zstd compressed USTAR archive");
+			}
+			else if (TestAndInitializeUSTAR(moduleAddress, moduleSize, 0))
 				continue;
 		}
 	}
@@ -56,4 +65,11 @@ EXTERNC nif void KernelVFS()
 	fs = new vfs::Virtual;
 	SearchForInitrd();
 	fs->Initialize();
+
+	if (fs->RootExists(0))
+	{
+		eNode tmp = MountTMPFS(fs->GetRoot(0), "tmp");
+		if (!tmp)
+			error("Failed to mount /tmp: %s", tmp.what());
+	}
 }
@@ -44,6 +44,7 @@ void cmd_modinfo(const char *args);
 void cmd_panic(const char *args);
 void cmd_dump(const char *args);
 void cmd_theme(const char *args);
+void cmd_netbench(const char *args);
 
 #define IF_ARG(x) strcmp(args, x) == 0
 
@@ -78,6 +78,7 @@ static Command commands[] = {
 	{"panic", cmd_panic},
 	{"dump", cmd_dump},
 	{"theme", cmd_theme},
+	{"netbench", cmd_netbench},
 	{"builtin", __cmd_builtin},
 };
 
@@ -869,33 +869,7 @@ EXTERNC __no_stack_protector void *__memcpy_chk(void *dest, const void *src, siz
 	if (unlikely(len > slen))
 		__chk_fail();
 
-	void *ret = nullptr;
-	if (Config.SIMD)
-	{
-		uint64_t simd = CPU::CheckSIMD();
-		if (simd & CPU::x86SIMDType::SIMD_SSE42)
-			ret = memcpy_sse4_2(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE41)
-			ret = memcpy_sse4_1(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSSE3)
-			ret = memcpy_ssse3(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE3)
-			ret = memcpy_sse3(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE2)
-			ret = memcpy_sse2(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE)
-			ret = memcpy_sse(dest, src, len);
-		else
-			ret = memcpy_unsafe(dest, src, len);
-	}
-	else
-	{
-		static int once = 0;
-		if (!once++)
-			fixme("SIMD memcpy disabled");
-		ret = memcpy_unsafe(dest, src, len);
-	}
-	return ret;
+	return memcpy_engine(dest, src, len);
 }
 
 EXTERNC __no_stack_protector void *__memset_chk(void *dest, int val, size_t len, size_t slen)
@@ -933,33 +907,7 @@ EXTERNC __no_stack_protector void *__memset_chk(void *dest, int val, size_t len,
 	if (unlikely(len > slen))
 		__chk_fail();
 
-	void *ret = nullptr;
-	if (Config.SIMD)
-	{
-		uint64_t simd = CPU::CheckSIMD();
-		if (simd & CPU::x86SIMDType::SIMD_SSE42)
-			ret = memset_sse4_2(dest, val, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE41)
-			ret = memset_sse4_1(dest, val, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSSE3)
-			ret = memset_ssse3(dest, val, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE3)
-			ret = memset_sse3(dest, val, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE2)
-			ret = memset_sse2(dest, val, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE)
-			ret = memset_sse(dest, val, len);
-		else
-			ret = memset_unsafe(dest, val, len);
-	}
-	else
-	{
-		static int once = 0;
-		if (!once++)
-			fixme("SIMD memset disabled");
-		ret = memset_unsafe(dest, val, len);
-	}
-	return ret;
+	return memset_engine(dest, val, len);
 }
 
 EXTERNC __no_stack_protector void *__memmove_chk(void *dest, const void *src, size_t len, size_t slen)
@@ -1007,33 +955,7 @@ EXTERNC __no_stack_protector void *__memmove_chk(void *dest, const void *src, si
 	if (unlikely(len > slen))
 		__chk_fail();
 
-	void *ret = nullptr;
-	if (Config.SIMD)
-	{
-		uint64_t simd = CPU::CheckSIMD();
-		if (simd & CPU::x86SIMDType::SIMD_SSE42)
-			ret = memmove_sse4_2(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE41)
-			ret = memmove_sse4_1(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSSE3)
-			ret = memmove_ssse3(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE3)
-			ret = memmove_sse3(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE2)
-			ret = memmove_sse2(dest, src, len);
-		else if (simd & CPU::x86SIMDType::SIMD_SSE)
-			ret = memmove_sse(dest, src, len);
-		else
-			ret = memmove_unsafe(dest, src, len);
-	}
-	else
-	{
-		static int once = 0;
-		if (!once++)
-			fixme("SIMD memmove disabled");
-		ret = memmove_unsafe(dest, src, len);
-	}
-	return ret;
+	return memmove_engine(dest, src, len);
 }
 
 EXTERNC __no_stack_protector char *__strcat_chk(char *dest, const char *src, size_t slen)
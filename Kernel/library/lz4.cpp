@@ -0,0 +1,324 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <lz4.hpp>
+
+#include <debug.h>
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME32_4 0x27D4EB2FU
+#define XXH_PRIME32_5 0x165667B1U
+
+/* Match lengths in a token don't include the minimum */
+#define LZ4_MIN_MATCH 4
+
+namespace LZ4
+{
+	static inline uint32_t Read32(const uint8_t *p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			   ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static inline uint32_t Rotate(uint32_t x, int r)
+	{
+		return (x << r) | (x >> (32 - r));
+	}
+
+	static inline uint32_t Round(uint32_t Accumulator, uint32_t Input)
+	{
+		Accumulator += Input * XXH_PRIME32_2;
+		return Rotate(Accumulator, 13) * XXH_PRIME32_1;
+	}
+
+	uint32_t XXH32(const void *Data, size_t Length, uint32_t Seed)
+	{
+		const uint8_t *p = (const uint8_t *)Data;
+		const uint8_t *end = p + Length;
+		uint32_t h;
+
+		if (Length >= 16)
+		{
+			uint32_t v1 = Seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+			uint32_t v2 = Seed + XXH_PRIME32_2;
+			uint32_t v3 = Seed;
+			uint32_t v4 = Seed - XXH_PRIME32_1;
+			do
+			{
+				v1 = Round(v1, Read32(p));
+				v2 = Round(v2, Read32(p + 4));
+				v3 = Round(v3, Read32(p + 8));
+				v4 = Round(v4, Read32(p + 12));
+				p += 16;
+			} while (end - p >= 16);
+			h = Rotate(v1, 1) + Rotate(v2, 7) + Rotate(v3, 12) + Rotate(v4, 18);
+		}
+		else
+			h = Seed + XXH_PRIME32_5;
+
+		h += (uint32_t)Length;
+		for (; end - p >= 4; p += 4)
+			h = Rotate(h + Read32(p) * XXH_PRIME32_3, 17) * XXH_PRIME32_4;
+		for (; p < end; p++)
+			h = Rotate(h + *p * XXH_PRIME32_5, 11) * XXH_PRIME32_1;
+
+		h ^= h >> 15;
+		h *= XXH_PRIME32_2;
+		h ^= h >> 13;
+		h *= XXH_PRIME32_3;
+		h ^= h >> 16;
+		return h;
+	}
+
+	/* Read the 255-terminated length extension of a token */
+	static inline bool ReadLength(const uint8_t *&ip, const uint8_t *end, size_t &Length)
+	{
+		uint8_t b;
+		do
+		{
+			if (ip >= end)
+				return false;
+			b = *ip++;
+			Length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	ssize_t DecompressBlock(const uint8_t *Source, size_t SourceSize,
+							uint8_t *Destination, size_t Capacity,
+							size_t Prefix)
+	{
+		const uint8_t *ip = Source;
+		const uint8_t *iend = Source + SourceSize;
+		uint8_t *op = Destination;
+		uint8_t *oend = Destination + Capacity;
+		size_t window = std::min(Prefix, (size_t)LZ4_WINDOW_SIZE);
+
+		while (ip < iend)
+		{
+			uint8_t token = *ip++;
+
+			size_t literals = token >> 4;
+			if (literals == 15 && !ReadLength(ip, iend, literals))
+				return -1;
+			if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals)
+				return -1;
+
+			memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+
+			/* The last sequence has no match */
+			if (ip == iend)
+				break;
+
+			if (iend - ip < 2)
+				return -1;
+			size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > (size_t)(op - Destination) + window)
+				return -1;
+
+			size_t length = token & 15;
+			if (length == 15 && !ReadLength(ip, iend, length))
+				return -1;
+			length += LZ4_MIN_MATCH;
+			if ((size_t)(oend - op) < length)
+				return -1;
+
+			const uint8_t *match = op - offset;
+			if (offset >= length)
+				memcpy(op, match, length);
+			else
+			{
+				/* Overlapping match, repeats the last offset bytes */
+				for (size_t i = 0; i < length; i++)
+					op[i] = match[i];
+			}
+			op += length;
+		}
+
+		return op - Destination;
+	}
+
+	ssize_t BlockLength(const uint8_t *Source, size_t SourceSize)
+	{
+		const uint8_t *ip = Source;
+		const uint8_t *iend = Source + SourceSize;
+		size_t total = 0;
+
+		while (ip < iend)
+		{
+			uint8_t token = *ip++;
+
+			size_t literals = token >> 4;
+			if (literals == 15 && !ReadLength(ip, iend, literals))
+				return -1;
+			if ((size_t)(iend - ip) < literals)
+				return -1;
+			ip += literals;
+			total += literals;
+
+			if (ip == iend)
+				break;
+
+			if (iend - ip < 2)
+				return -1;
+			ip += 2;
+
+			size_t length = token & 15;
+			if (length == 15 && !ReadLength(ip, iend, length))
+				return -1;
+			total += length + LZ4_MIN_MATCH;
+		}
+
+		return total;
+	}
+
+	bool Frame::Open(const void *Data, size_t Size)
+	{
+		const uint8_t *p = (const uint8_t *)Data;
+		const uint8_t *end = p + Size;
+
+		if (!IsFrame(Data, Size) || Size < 7)
+			return false;
+
+		uint8_t flags = p[4];
+		uint8_t descriptor = p[5];
+		if ((flags >> 6) != 1)
+		{
+			error("Unsupported LZ4 frame version %d", flags >> 6);
+			return false;
+		}
+
+		if (flags & 0x1)
+		{
+			error("LZ4 frames with a dictionary are not supported");
+			return false;
+		}
+
+		Independent = flags & 0x20;
+		bool blockChecksum = flags & 0x10;
+		bool contentSize = flags & 0x08;
+		ContentChecksum = flags & 0x04;
+
+		int maxSize = (descriptor >> 4) & 0x7;
+		if (maxSize < 4)
+			return false;
+		BlockMaxSize = (size_t)1 << (8 + 2 * maxSize);
+
+		size_t header = 6 + (contentSize ? 8 : 0);
+		if (Size < header + 1)
+			return false;
+
+		uint8_t hc = (XXH32(p + 4, header - 4, 0) >> 8) & 0xFF;
+		if (hc != p[header])
+		{
+			error("LZ4 frame header checksum mismatch");
+			return false;
+		}
+
+		size_t declared = 0;
+		if (contentSize)
+		{
+			for (int i = 7; i >= 0; i--)
+				declared = (declared << 8) | p[6 + i];
+		}
+
+		p += header + 1;
+		Blocks.clear();
+		size_t offset = 0;
+		while (true)
+		{
+			if (end - p < 4)
+				return false;
+			uint32_t word = Read32(p);
+			p += 4;
+			if (word == 0)
+				break;
+
+			Block block;
+			block.Size = word & 0x7FFFFFFF;
+			block.Compressed = !(word & 0x80000000);
+			if (block.Size > BlockMaxSize || (size_t)(end - p) < block.Size)
+				return false;
+			block.Data = p;
+
+			if (block.Compressed)
+			{
+				ssize_t length = BlockLength(block.Data, block.Size);
+				if (length < 0 || (size_t)length > BlockMaxSize)
+					return false;
+				block.Length = length;
+			}
+			else
+				block.Length = block.Size;
+
+			block.Offset = offset;
+			offset += block.Length;
+			Blocks.push_back(block);
+
+			p += block.Size;
+			if (blockChecksum)
+				p += 4;
+		}
+
+		if (ContentChecksum)
+		{
+			if (end - p < 4)
+				return false;
+			Checksum = Read32(p);
+		}
+
+		if (contentSize && declared != offset)
+		{
+			error("LZ4 content size is %ld, blocks hold %ld", declared, offset);
+			return false;
+		}
+
+		ContentSize = offset;
+		return true;
+	}
+
+	bool Frame::Decompress(uint8_t *Destination)
+	{
+		for (const Block &block : Blocks)
+		{
+			uint8_t *out = Destination + block.Offset;
+			if (!block.Compressed)
+			{
+				memcpy(out, block.Data, block.Size);
+				continue;
+			}
+
+			/* Linked blocks reference the output before them */
+			size_t prefix = Independent ? 0 : block.Offset;
+			ssize_t ret = DecompressBlock(block.Data, block.Size, out, block.Length, prefix);
+			if (ret != (ssize_t)block.Length)
+				return false;
+		}
+
+		if (ContentChecksum && XXH32(Destination, ContentSize, 0) != Checksum)
+		{
+			error("LZ4 content checksum mismatch");
+			return false;
+		}
+		return true;
+	}
+}
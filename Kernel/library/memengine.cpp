@@ -0,0 +1,331 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <convert.h>
+
+#include <memory.hpp>
+#include <debug.h>
+#include <cpu.hpp>
+
+#include "../kernel.h"
+
+/*
+	memcpy/memset/memmove engine used by the __mem*_chk functions.
+
+	Small sizes go to the word loops in memop.c. From there on the
+	strategy is picked by size and CPU features:
+	  - ERMS (and FSRM for shorter lengths) "rep movsb"/"rep stosb"
+	  - AVX2 128 byte loops, only with Config.SIMD and YMM state
+	    enabled in XCR0
+	  - movnti streaming stores for buffers larger than the cache
+	    budget, like page copies during fork
+*/
+
+#define SMALL_THRESHOLD 64
+#define ERMS_THRESHOLD 1024
+#define FSRM_THRESHOLD 128
+#define NT_THRESHOLD (1024 * 1024)
+
+namespace
+{
+	struct
+	{
+		bool Detected;
+		bool ERMS;
+		bool FSRM;
+		bool AVX2;
+	} MemFeatures;
+
+	void DetectMemFeatures()
+	{
+		/* Set first, CPU::Vendor() uses memcpy */
+		MemFeatures.Detected = true;
+
+#if defined(__amd64__)
+		bool osxsave = false, avx = false;
+		if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_AMD) == 0)
+		{
+			CPU::x86::AMD::CPUID0x00000001 cpuid1;
+			CPU::x86::AMD::CPUID0x00000007_ECX_0 cpuid7;
+			osxsave = cpuid1.ECX.OSXSAVE;
+			avx = cpuid1.ECX.AVX;
+			MemFeatures.ERMS = cpuid7.EBX.ERMS;
+			MemFeatures.FSRM = cpuid7.EDX.FSRM;
+			MemFeatures.AVX2 = cpuid7.EBX.AVX2;
+		}
+		else if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_INTEL) == 0)
+		{
+			CPU::x86::Intel::CPUID0x00000001 cpuid1;
+			CPU::x86::Intel::CPUID0x00000007_0 cpuid7;
+			osxsave = cpuid1.ECX.OSXSAVE;
+			avx = cpuid1.ECX.AVX;
+			MemFeatures.ERMS = cpuid7.EBX.ERMS;
+			MemFeatures.FSRM = cpuid7.EDX.FSRM;
+			MemFeatures.AVX2 = cpuid7.EBX.AVX2;
+		}
+
+		/* The CPU may support AVX2 while the YMM state is not enabled */
+		if (!osxsave || !avx || !CPU::x64::readxcr0().AVX)
+			MemFeatures.AVX2 = false;
+
+		debug("ERMS: %d, FSRM: %d, AVX2: %d",
+			  MemFeatures.ERMS, MemFeatures.FSRM, MemFeatures.AVX2);
+#endif
+	}
+
+	nsa inline __always_inline void CheckMemFeatures()
+	{
+		if (unlikely(!MemFeatures.Detected))
+			DetectMemFeatures();
+	}
+
+#if defined(__amd64__)
+	/* The source is only as aligned as the destination allows */
+	nsa inline __always_inline uint64_t LoadQword(const uint8_t *Source)
+	{
+		uint64_t value;
+		__builtin_memcpy(&value, Source, sizeof(value));
+		return value;
+	}
+
+	nsa inline __always_inline void StreamQword(void *Destination, uint64_t Value)
+	{
+		asmv("movnti %1, %0"
+			 : "=m"(*(uint64_t *)Destination)
+			 : "r"(Value));
+	}
+#endif
+}
+
+EXTERNC __no_stack_protector void *memcpy_erms(void *dest, const void *src, size_t n)
+{
+#if defined(__amd64__) || defined(__i386__)
+	void *d = dest;
+	asmv("rep movsb"
+		 : "+D"(d), "+S"(src), "+c"(n)
+		 :
+		 : "memory");
+	return dest;
+#else
+	return memcpy_unsafe(dest, src, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memset_erms(void *dest, int c, size_t n)
+{
+#if defined(__amd64__) || defined(__i386__)
+	void *d = dest;
+	asmv("rep stosb"
+		 : "+D"(d), "+c"(n)
+		 : "a"(c)
+		 : "memory");
+	return dest;
+#else
+	return memset_unsafe(dest, c, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memcpy_nt(void *dest, const void *src, size_t n)
+{
+#if defined(__amd64__)
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+
+	size_t head = (0 - (uintptr_t)d) & 63;
+	if (head > n)
+		head = n;
+	memcpy_unsafe(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+
+	for (; n >= 64; n -= 64, d += 64, s += 64)
+	{
+		asmv("prefetchnta 512(%0)" ::"r"(s));
+		uint64_t a = LoadQword(s + 0), b = LoadQword(s + 8);
+		uint64_t e = LoadQword(s + 16), f = LoadQword(s + 24);
+		StreamQword(d + 0, a);
+		StreamQword(d + 8, b);
+		StreamQword(d + 16, e);
+		StreamQword(d + 24, f);
+		a = LoadQword(s + 32), b = LoadQword(s + 40);
+		e = LoadQword(s + 48), f = LoadQword(s + 56);
+		StreamQword(d + 32, a);
+		StreamQword(d + 40, b);
+		StreamQword(d + 48, e);
+		StreamQword(d + 56, f);
+	}
+	asmv("sfence" ::: "memory");
+
+	memcpy_unsafe(d, s, n);
+	return dest;
+#else
+	return memcpy_unsafe(dest, src, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memset_nt(void *dest, int c, size_t n)
+{
+#if defined(__amd64__)
+	uint8_t *d = (uint8_t *)dest;
+	uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+
+	size_t head = (0 - (uintptr_t)d) & 63;
+	if (head > n)
+		head = n;
+	memset_unsafe(d, c, head);
+	d += head;
+	n -= head;
+
+	for (; n >= 64; n -= 64, d += 64)
+	{
+		for (size_t i = 0; i < 64; i += 8)
+			StreamQword(d + i, pattern);
+	}
+	asmv("sfence" ::: "memory");
+
+	memset_unsafe(d, c, n);
+	return dest;
+#else
+	return memset_unsafe(dest, c, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memcpy_avx2(void *dest, const void *src, size_t n)
+{
+#if defined(__amd64__)
+	uint8_t *d = (uint8_t *)dest;
+	const uint8_t *s = (const uint8_t *)src;
+
+	size_t head = (0 - (uintptr_t)d) & 31;
+	if (head > n)
+		head = n;
+	memcpy_unsafe(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+
+	for (; n >= 128; n -= 128, d += 128, s += 128)
+	{
+		asmv("vmovdqu 0(%0), %%ymm0\n"
+			 "vmovdqu 32(%0), %%ymm1\n"
+			 "vmovdqu 64(%0), %%ymm2\n"
+			 "vmovdqu 96(%0), %%ymm3\n"
+			 "vmovdqa %%ymm0, 0(%1)\n"
+			 "vmovdqa %%ymm1, 32(%1)\n"
+			 "vmovdqa %%ymm2, 64(%1)\n"
+			 "vmovdqa %%ymm3, 96(%1)\n"
+			 :
+			 : "r"(s), "r"(d)
+			 : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+	}
+	asmv("vzeroupper");
+
+	memcpy_unsafe(d, s, n);
+	return dest;
+#else
+	return memcpy_unsafe(dest, src, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memset_avx2(void *dest, int c, size_t n)
+{
+#if defined(__amd64__)
+	uint8_t *d = (uint8_t *)dest;
+
+	size_t head = (0 - (uintptr_t)d) & 31;
+	if (head > n)
+		head = n;
+	memset_unsafe(d, c, head);
+	d += head;
+	n -= head;
+
+	if (n >= 128)
+	{
+		asmv("vmovd %0, %%xmm0\n"
+			 "vpbroadcastb %%xmm0, %%ymm0\n"
+			 :
+			 : "r"(c)
+			 : "xmm0");
+
+		for (; n >= 128; n -= 128, d += 128)
+		{
+			asmv("vmovdqa %%ymm0, 0(%0)\n"
+				 "vmovdqa %%ymm0, 32(%0)\n"
+				 "vmovdqa %%ymm0, 64(%0)\n"
+				 "vmovdqa %%ymm0, 96(%0)\n"
+				 :
+				 : "r"(d)
+				 : "memory");
+		}
+		asmv("vzeroupper");
+	}
+
+	memset_unsafe(d, c, n);
+	return dest;
+#else
+	return memset_unsafe(dest, c, n);
+#endif
+}
+
+EXTERNC __no_stack_protector void *memcpy_engine(void *dest, const void *src, size_t n)
+{
+	CheckMemFeatures();
+
+	if (n < SMALL_THRESHOLD)
+		return memcpy_unsafe(dest, src, n);
+
+	if (n >= NT_THRESHOLD)
+		return memcpy_nt(dest, src, n);
+
+	if (MemFeatures.ERMS && n >= (MemFeatures.FSRM ? FSRM_THRESHOLD : ERMS_THRESHOLD))
+		return memcpy_erms(dest, src, n);
+
+	if (MemFeatures.AVX2 && Config.SIMD)
+		return memcpy_avx2(dest, src, n);
+
+	return memcpy_unsafe(dest, src, n);
+}
+
+EXTERNC __no_stack_protector void *memset_engine(void *dest, int c, size_t n)
+{
+	CheckMemFeatures();
+
+	if (n < SMALL_THRESHOLD)
+		return memset_unsafe(dest, c, n);
+
+	if (n >= NT_THRESHOLD)
+		return memset_nt(dest, c, n);
+
+	if (MemFeatures.ERMS && n >= ERMS_THRESHOLD)
+		return memset_erms(dest, c, n);
+
+	if (MemFeatures.AVX2 && Config.SIMD)
+		return memset_avx2(dest, c, n);
+
+	return memset_unsafe(dest, c, n);
+}
+
+EXTERNC __no_stack_protector void *memmove_engine(void *dest, const void *src, size_t n)
+{
+	/* Only disjoint buffers can take the memcpy paths */
+	if ((uintptr_t)dest - (uintptr_t)src >= n &&
+		(uintptr_t)src - (uintptr_t)dest >= n)
+		return memcpy_engine(dest, src, n);
+
+	return memmove_unsafe(dest, src, n);
+}
@@ -1,60 +0,0 @@
-/*
-	This file is part of Fennix Kernel.
-
-	Fennix Kernel is free software: you can redistribute it and/or
-	modify it under the terms of the GNU General Public License as
-	published by the Free Software Foundation, either version 3 of
-	the License, or (at your option) any later version.
-
-	Fennix Kernel is distributed in the hope that it will be useful,
-	but WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
-	GNU General Public License for more details.
-
-	You should have received a copy of the GNU General Public License
-	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
-*/
-
-#include <convert.h>
-
-#include <memory.hpp>
-#include <limits.h>
-#include <debug.h>
-#include <cpu.hpp>
-
-/*
-TODO: Replace these functions with even more optimized versions.
-	  The current versions are fast but not as fast as they could be and also we need implementation for avx, not only sse.
-*/
-
-// TODO: Implement these functions
-
-EXTERNC void *memmove_sse(void *dest, const void *src, size_t n)
-{
-	return memmove_unsafe(dest, src, n);
-}
-
-EXTERNC void *memmove_sse2(void *dest, const void *src, size_t n)
-{
-	return memmove_sse(dest, src, n);
-}
-
-EXTERNC void *memmove_sse3(void *dest, const void *src, size_t n)
-{
-	return memmove_sse(dest, src, n);
-}
-
-EXTERNC void *memmove_ssse3(void *dest, const void *src, size_t n)
-{
-	return memmove_sse(dest, src, n);
-}
-
-EXTERNC void *memmove_sse4_1(void *dest, const void *src, size_t n)
-{
-	return memmove_sse(dest, src, n);
-}
-
-EXTERNC void *memmove_sse4_2(void *dest, const void *src, size_t n)
-{
-	return memmove_sse(dest, src, n);
-}
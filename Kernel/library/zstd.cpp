@@ -0,0 +1,1095 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <zstd.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <debug.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Largest accuracy logs and symbols of the sequence codes */
+#define ZSTD_LL_MAX_LOG 9
+#define ZSTD_ML_MAX_LOG 9
+#define ZSTD_OF_MAX_LOG 8
+#define ZSTD_LL_MAX_SYMBOL 35
+#define ZSTD_ML_MAX_SYMBOL 52
+#define ZSTD_OF_MAX_SYMBOL 31
+
+/* The predefined offset distribution stops at code 28 */
+#define ZSTD_OF_DEFAULT_SYMBOLS 29
+
+/* Huffman codes are at most 11 bits, their weights are FSE coded with log 6 */
+#define ZSTD_HUF_MAX_LOG 11
+#define ZSTD_HUF_MAX_SYMBOLS 256
+#define ZSTD_WEIGHT_MAX_LOG 6
+
+#define ZSTD_FSE_MAX_LOG 9
+#define ZSTD_FSE_MAX_SYMBOLS 53
+
+namespace ZSTD
+{
+	enum BlockType
+	{
+		BLOCK_RAW = 0,
+		BLOCK_RLE = 1,
+		BLOCK_COMPRESSED = 2,
+	};
+
+	enum LiteralsType
+	{
+		LITERALS_RAW = 0,
+		LITERALS_RLE = 1,
+		LITERALS_COMPRESSED = 2,
+		LITERALS_TREELESS = 3,
+	};
+
+	enum TableMode
+	{
+		MODE_PREDEFINED = 0,
+		MODE_RLE = 1,
+		MODE_COMPRESSED = 2,
+		MODE_REPEAT = 3,
+	};
+
+	static const int16_t LLDefault[ZSTD_LL_MAX_SYMBOL + 1] = {
+		4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+		-1, -1, -1, -1};
+
+	static const int16_t MLDefault[ZSTD_ML_MAX_SYMBOL + 1] = {
+		1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+		-1, -1, -1, -1, -1};
+
+	static const int16_t OFDefault[ZSTD_OF_DEFAULT_SYMBOLS] = {
+		1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1};
+
+	static const uint32_t LLBase[ZSTD_LL_MAX_SYMBOL + 1] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+		8192, 16384, 32768, 65536};
+
+	static const uint8_t LLExtra[ZSTD_LL_MAX_SYMBOL + 1] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+		13, 14, 15, 16};
+
+	static const uint32_t MLBase[ZSTD_ML_MAX_SYMBOL + 1] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+		19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+		35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+		4099, 8195, 16387, 32771, 65539};
+
+	static const uint8_t MLExtra[ZSTD_ML_MAX_SYMBOL + 1] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+		12, 13, 14, 15, 16};
+
+	static inline uint32_t Read32(const uint8_t *p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			   ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static inline uint64_t Read64(const uint8_t *p)
+	{
+		return (uint64_t)Read32(p) | ((uint64_t)Read32(p + 4) << 32);
+	}
+
+	static inline uint64_t ReadLE(const uint8_t *p, int Bytes)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < Bytes; i++)
+			value |= (uint64_t)p[i] << (8 * i);
+		return value;
+	}
+
+	static inline uint64_t Rotate(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static inline uint64_t Round(uint64_t Accumulator, uint64_t Input)
+	{
+		Accumulator += Input * XXH_PRIME64_2;
+		return Rotate(Accumulator, 31) * XXH_PRIME64_1;
+	}
+
+	static inline uint64_t Merge(uint64_t Accumulator, uint64_t Value)
+	{
+		Accumulator ^= Round(0, Value);
+		return Accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+
+	uint64_t XXH64(const void *Data, size_t Length, uint64_t Seed)
+	{
+		const uint8_t *p = (const uint8_t *)Data;
+		const uint8_t *end = p + Length;
+		uint64_t h;
+
+		if (Length >= 32)
+		{
+			uint64_t v1 = Seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+			uint64_t v2 = Seed + XXH_PRIME64_2;
+			uint64_t v3 = Seed;
+			uint64_t v4 = Seed - XXH_PRIME64_1;
+			do
+			{
+				v1 = Round(v1, Read64(p));
+				v2 = Round(v2, Read64(p + 8));
+				v3 = Round(v3, Read64(p + 16));
+				v4 = Round(v4, Read64(p + 24));
+				p += 32;
+			} while (end - p >= 32);
+
+			h = Rotate(v1, 1) + Rotate(v2, 7) + Rotate(v3, 12) + Rotate(v4, 18);
+			h = Merge(h, v1);
+			h = Merge(h, v2);
+			h = Merge(h, v3);
+			h = Merge(h, v4);
+		}
+		else
+			h = Seed + XXH_PRIME64_5;
+
+		h += (uint64_t)Length;
+		for (; end - p >= 8; p += 8)
+			h = Rotate(h ^ Round(0, Read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		if (end - p >= 4)
+		{
+			h = Rotate(h ^ (Read32(p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+			p += 4;
+		}
+		for (; p < end; p++)
+			h = Rotate(h ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+		h ^= h >> 33;
+		h *= XXH_PRIME64_2;
+		h ^= h >> 29;
+		h *= XXH_PRIME64_3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	static inline int HighBit(uint32_t x)
+	{
+		return 31 - __builtin_clz(x);
+	}
+
+	/* Bits from bit Offset on, least significant first. Bytes past Size read as zero. */
+	static inline uint64_t ReadBits(const uint8_t *Source, size_t Size, int Bits, size_t Offset)
+	{
+		if (Bits == 0)
+			return 0;
+
+		size_t byte = Offset / 8;
+		int shift = Offset % 8;
+		int bytes = (shift + Bits + 7) / 8;
+		uint64_t value = 0;
+		for (int i = 0; i < bytes && byte + i < Size; i++)
+			value |= (uint64_t)Source[byte + i] << (8 * i);
+		return (value >> shift) & (((uint64_t)1 << Bits) - 1);
+	}
+
+	/*
+		The entropy coded streams are read backwards, from the
+		last bit written towards the first. A valid stream ends
+		exactly at its first bit, reading past it gives zeros.
+	*/
+	struct BackwardStream
+	{
+		const uint8_t *Data;
+		size_t Size;
+		int64_t Offset;
+
+		/* The last byte is padded with zeros up to a one bit */
+		bool Open(const uint8_t *Source, size_t Length)
+		{
+			if (Length == 0 || Source[Length - 1] == 0)
+				return false;
+
+			Data = Source;
+			Size = Length;
+			Offset = (int64_t)(Length - 1) * 8 + HighBit(Source[Length - 1]);
+			return true;
+		}
+
+		uint64_t Read(int Bits)
+		{
+			Offset -= Bits;
+			if (likely(Offset >= 0))
+				return ReadBits(Data, Size, Bits, Offset);
+
+			int available = Bits + (int)Offset;
+			if (available <= 0)
+				return 0;
+			return ReadBits(Data, Size, available, 0) << (Bits - available);
+		}
+	};
+
+	struct FSETable
+	{
+		uint8_t Symbol[1 << ZSTD_FSE_MAX_LOG];
+		uint8_t Bits[1 << ZSTD_FSE_MAX_LOG];
+		uint16_t Base[1 << ZSTD_FSE_MAX_LOG];
+		int Log;
+	};
+
+	struct FSEState
+	{
+		const FSETable *Table;
+		uint16_t State;
+
+		void Init(const FSETable *fse, BackwardStream &Stream)
+		{
+			Table = fse;
+			State = Stream.Read(fse->Log);
+		}
+
+		uint8_t Peek() { return Table->Symbol[State]; }
+
+		void Update(BackwardStream &Stream)
+		{
+			State = Table->Base[State] + Stream.Read(Table->Bits[State]);
+		}
+	};
+
+	static bool BuildFSE(FSETable *Table, const int16_t *Counts, int Symbols, int Log)
+	{
+		size_t size = (size_t)1 << Log;
+		size_t high = size;
+		uint16_t next[ZSTD_FSE_MAX_SYMBOLS];
+
+		/* Symbols with a "less than one" probability go at the end */
+		for (int s = 0; s < Symbols; s++)
+		{
+			if (Counts[s] == -1)
+			{
+				Table->Symbol[--high] = s;
+				next[s] = 1;
+			}
+			else
+				next[s] = Counts[s];
+		}
+
+		size_t step = (size >> 1) + (size >> 3) + 3;
+		size_t mask = size - 1;
+		size_t position = 0;
+		for (int s = 0; s < Symbols; s++)
+		{
+			for (int i = 0; i < Counts[s]; i++)
+			{
+				Table->Symbol[position] = s;
+				do
+					position = (position + step) & mask;
+				while (position >= high);
+			}
+		}
+
+		if (position != 0)
+			return false;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			uint8_t s = Table->Symbol[i];
+			uint16_t state = next[s]++;
+			Table->Bits[i] = Log - HighBit(state);
+			Table->Base[i] = (state << Table->Bits[i]) - size;
+		}
+
+		Table->Log = Log;
+		return true;
+	}
+
+	static void BuildRLE(FSETable *Table, uint8_t Symbol)
+	{
+		Table->Symbol[0] = Symbol;
+		Table->Bits[0] = 0;
+		Table->Base[0] = 0;
+		Table->Log = 0;
+	}
+
+	/**
+	 * Read the normalized counts of an FSE table
+	 *
+	 * @return Bytes used, -1 if corrupted
+	 */
+	static ssize_t ReadFSE(FSETable *Table, const uint8_t *Source, size_t Size,
+						   int MaxLog, int MaxSymbol)
+	{
+		if (Size == 0)
+			return -1;
+
+		int log = (Source[0] & 0xF) + 5;
+		if (log > MaxLog)
+			return -1;
+
+		int16_t counts[ZSTD_FSE_MAX_SYMBOLS] = {};
+		int32_t remaining = 1 << log;
+		size_t offset = 4;
+		int symbol = 0;
+		while (remaining > 0 && symbol <= MaxSymbol)
+		{
+			int bits = HighBit(remaining + 1) + 1;
+			uint32_t value = ReadBits(Source, Size, bits, offset);
+			offset += bits;
+
+			/* Small values take one bit less */
+			uint32_t lower = (1U << (bits - 1)) - 1;
+			uint32_t threshold = (1U << bits) - 1 - (remaining + 1);
+			if ((value & lower) < threshold)
+			{
+				offset--;
+				value &= lower;
+			}
+			else if (value > lower)
+				value -= threshold;
+
+			int16_t count = (int16_t)value - 1;
+			remaining -= count < 0 ? -count : count;
+			counts[symbol++] = count;
+
+			if (count == 0)
+			{
+				/* Runs of zero counts are stored as 2 bit repeats */
+				uint32_t repeat;
+				do
+				{
+					repeat = ReadBits(Source, Size, 2, offset);
+					offset += 2;
+					for (uint32_t i = 0; i < repeat && symbol <= MaxSymbol; i++)
+						counts[symbol++] = 0;
+				} while (repeat == 3 && offset <= Size * 8);
+			}
+
+			if (offset > Size * 8)
+				return -1;
+		}
+
+		if (remaining != 0)
+			return -1;
+
+		if (!BuildFSE(Table, counts, symbol, log))
+			return -1;
+		return (offset + 7) / 8;
+	}
+
+	struct HuffmanTable
+	{
+		uint8_t Symbol[1 << ZSTD_HUF_MAX_LOG];
+		uint8_t Bits[1 << ZSTD_HUF_MAX_LOG];
+		int Log;
+	};
+
+	static bool BuildHuffman(HuffmanTable *Table, uint8_t *Weights, int Symbols)
+	{
+		/* The last weight is implied, it completes a power of two */
+		uint32_t total = 0;
+		for (int i = 0; i < Symbols; i++)
+		{
+			if (Weights[i] > ZSTD_HUF_MAX_LOG)
+				return false;
+			if (Weights[i])
+				total += 1U << (Weights[i] - 1);
+		}
+
+		if (total == 0 || Symbols >= ZSTD_HUF_MAX_SYMBOLS)
+			return false;
+
+		int log = HighBit(total) + 1;
+		uint32_t left = (1U << log) - total;
+		if (log > ZSTD_HUF_MAX_LOG || (left & (left - 1)))
+			return false;
+		Weights[Symbols++] = HighBit(left) + 1;
+
+		uint32_t count[ZSTD_HUF_MAX_LOG + 1] = {};
+		uint8_t bits[ZSTD_HUF_MAX_SYMBOLS];
+		for (int i = 0; i < Symbols; i++)
+		{
+			bits[i] = Weights[i] ? log + 1 - Weights[i] : 0;
+			count[bits[i]]++;
+		}
+
+		/* Longest codes first, each code length takes a run of the table */
+		uint32_t start[ZSTD_HUF_MAX_LOG + 1];
+		start[log] = 0;
+		for (int i = log; i >= 1; i--)
+		{
+			start[i - 1] = start[i] + count[i] * (1U << (log - i));
+			memset(&Table->Bits[start[i]], i, start[i - 1] - start[i]);
+		}
+
+		if (start[0] != (1U << log))
+			return false;
+
+		for (int i = 0; i < Symbols; i++)
+		{
+			if (bits[i] == 0)
+				continue;
+
+			uint32_t length = 1U << (log - bits[i]);
+			memset(&Table->Symbol[start[bits[i]]], i, length);
+			start[bits[i]] += length;
+		}
+
+		Table->Log = log;
+		return true;
+	}
+
+	/**
+	 * Read a Huffman tree description
+	 *
+	 * @return Bytes used, -1 if corrupted
+	 */
+	static ssize_t ReadHuffman(HuffmanTable *Table, FSETable *Scratch,
+							   const uint8_t *Source, size_t Size)
+	{
+		if (Size == 0)
+			return -1;
+
+		uint8_t weights[ZSTD_HUF_MAX_SYMBOLS] = {};
+		int symbols = 0;
+		size_t used;
+		uint8_t header = Source[0];
+		if (header >= 128)
+		{
+			/* Weights stored directly, two per byte */
+			symbols = header - 127;
+			used = 1 + (symbols + 1) / 2;
+			if (used > Size)
+				return -1;
+
+			for (int i = 0; i < symbols; i++)
+			{
+				uint8_t b = Source[1 + i / 2];
+				weights[i] = i % 2 ? b & 0xF : b >> 4;
+			}
+		}
+		else
+		{
+			/* Weights compressed with two interleaved FSE states */
+			used = 1 + header;
+			if (used > Size)
+				return -1;
+
+			ssize_t ret = ReadFSE(Scratch, Source + 1, header, ZSTD_WEIGHT_MAX_LOG, 255);
+			if (ret < 0)
+				return -1;
+
+			BackwardStream stream;
+			if (!stream.Open(Source + 1 + ret, header - ret))
+				return -1;
+
+			FSEState a, b;
+			a.Init(Scratch, stream);
+			b.Init(Scratch, stream);
+			while (true)
+			{
+				if (symbols > ZSTD_HUF_MAX_SYMBOLS - 3)
+					return -1;
+
+				weights[symbols++] = a.Peek();
+				a.Update(stream);
+				if (stream.Offset < 0)
+				{
+					weights[symbols++] = b.Peek();
+					break;
+				}
+
+				weights[symbols++] = b.Peek();
+				b.Update(stream);
+				if (stream.Offset < 0)
+				{
+					weights[symbols++] = a.Peek();
+					break;
+				}
+			}
+		}
+
+		if (!BuildHuffman(Table, weights, symbols))
+			return -1;
+		return used;
+	}
+
+	static bool DecodeHuffmanStream(const HuffmanTable *Table, const uint8_t *Source,
+									size_t Size, uint8_t *Out, size_t Count)
+	{
+		BackwardStream stream;
+		if (!stream.Open(Source, Size))
+			return false;
+
+		uint32_t mask = (1U << Table->Log) - 1;
+		uint32_t state = stream.Read(Table->Log);
+		for (size_t i = 0; i < Count; i++)
+		{
+			Out[i] = Table->Symbol[state];
+			int bits = Table->Bits[state];
+			state = ((state << bits) + stream.Read(bits)) & mask;
+		}
+
+		/* The state was read ahead, it must cover the first bits exactly */
+		return stream.Offset == -Table->Log;
+	}
+
+	struct Context
+	{
+		FSETable LL, ML, OF;
+		bool HasLL = false, HasML = false, HasOF = false;
+
+		HuffmanTable Huffman;
+		FSETable Weights;
+		bool HasHuffman = false;
+
+		uint32_t Repeat[3] = {1, 4, 8};
+		uint8_t Literals[ZSTD_BLOCK_SIZE_MAX];
+	};
+
+	/**
+	 * Decode the literals section of a block
+	 *
+	 * @return Bytes used, -1 if corrupted
+	 */
+	static ssize_t DecodeLiterals(Context *ctx, const uint8_t *Source, size_t Size,
+								  const uint8_t **Literals, size_t *Count)
+	{
+		if (Size == 0)
+			return -1;
+
+		int type = Source[0] & 3;
+		int format = (Source[0] >> 2) & 3;
+		if (type == LITERALS_RAW || type == LITERALS_RLE)
+		{
+			size_t header, regenerated;
+			switch (format)
+			{
+			case 1:
+				header = 2;
+				break;
+			case 3:
+				header = 3;
+				break;
+			default:
+				header = 1;
+				break;
+			}
+
+			if (Size < header)
+				return -1;
+			if (header == 1)
+				regenerated = Source[0] >> 3;
+			else
+				regenerated = ReadLE(Source, header) >> 4;
+
+			if (regenerated > ZSTD_BLOCK_SIZE_MAX)
+				return -1;
+
+			*Count = regenerated;
+			if (type == LITERALS_RAW)
+			{
+				if (Size - header < regenerated)
+					return -1;
+				*Literals = Source + header;
+				return header + regenerated;
+			}
+
+			if (Size - header < 1)
+				return -1;
+			memset(ctx->Literals, Source[header], regenerated);
+			*Literals = ctx->Literals;
+			return header + 1;
+		}
+
+		/* Huffman coded in one or four streams */
+		size_t header = format < 2 ? 3 : format + 2;
+		int sizeBits = format < 2 ? 10 : format == 2 ? 14 : 18;
+		if (Size < header)
+			return -1;
+
+		uint64_t sizes = ReadLE(Source, header) >> 4;
+		size_t regenerated = sizes & ((1U << sizeBits) - 1);
+		size_t compressed = sizes >> sizeBits;
+		if (regenerated > ZSTD_BLOCK_SIZE_MAX || Size - header < compressed)
+			return -1;
+
+		const uint8_t *p = Source + header;
+		size_t remaining = compressed;
+		if (type == LITERALS_COMPRESSED)
+		{
+			ssize_t ret = ReadHuffman(&ctx->Huffman, &ctx->Weights, p, remaining);
+			if (ret < 0)
+				return -1;
+
+			ctx->HasHuffman = true;
+			p += ret;
+			remaining -= ret;
+		}
+		else if (!ctx->HasHuffman)
+			return -1;
+
+		if (format == 0)
+		{
+			if (!DecodeHuffmanStream(&ctx->Huffman, p, remaining, ctx->Literals, regenerated))
+				return -1;
+		}
+		else
+		{
+			if (remaining < 6)
+				return -1;
+
+			size_t streams[4];
+			streams[0] = p[0] | (p[1] << 8);
+			streams[1] = p[2] | (p[3] << 8);
+			streams[2] = p[4] | (p[5] << 8);
+			size_t first = streams[0] + streams[1] + streams[2];
+			if (remaining - 6 < first)
+				return -1;
+			streams[3] = remaining - 6 - first;
+
+			size_t segment = (regenerated + 3) / 4;
+			if (segment * 3 > regenerated)
+				return -1;
+
+			const uint8_t *in = p + 6;
+			uint8_t *out = ctx->Literals;
+			for (int i = 0; i < 4; i++)
+			{
+				size_t count = i < 3 ? segment : regenerated - segment * 3;
+				if (!DecodeHuffmanStream(&ctx->Huffman, in, streams[i], out, count))
+					return -1;
+				in += streams[i];
+				out += count;
+			}
+		}
+
+		*Literals = ctx->Literals;
+		*Count = regenerated;
+		return header + compressed;
+	}
+
+	/**
+	 * Set up the table of one sequence code
+	 *
+	 * @return Bytes used, -1 if corrupted
+	 */
+	static ssize_t ReadTable(FSETable *Table, bool &Valid, int Mode,
+							 const uint8_t *Source, size_t Size,
+							 const int16_t *Default, int DefaultSymbols, int DefaultLog,
+							 int MaxLog, int MaxSymbol)
+	{
+		switch (Mode)
+		{
+		case MODE_PREDEFINED:
+			Valid = BuildFSE(Table, Default, DefaultSymbols, DefaultLog);
+			return Valid ? 0 : -1;
+		case MODE_RLE:
+			if (Size < 1 || Source[0] > MaxSymbol)
+				return -1;
+			BuildRLE(Table, Source[0]);
+			Valid = true;
+			return 1;
+		case MODE_COMPRESSED:
+		{
+			ssize_t ret = ReadFSE(Table, Source, Size, MaxLog, MaxSymbol);
+			Valid = ret >= 0;
+			return ret;
+		}
+		default:
+			return Valid ? 0 : -1;
+		}
+	}
+
+	/**
+	 * Decode and execute the sequences of a block
+	 *
+	 * @return Bytes written, -1 if corrupted
+	 */
+	static ssize_t DecodeSequences(Context *ctx, const uint8_t *Source, size_t Size,
+								   const uint8_t *Literals, size_t LiteralCount,
+								   uint8_t *FrameStart, uint8_t *Out, uint8_t *End)
+	{
+		if (Size == 0)
+			return -1;
+
+		const uint8_t *p = Source;
+		const uint8_t *iend = Source + Size;
+		size_t sequences = p[0];
+		if (sequences < 128)
+			p++;
+		else if (sequences < 255)
+		{
+			if (Size < 2)
+				return -1;
+			sequences = ((sequences - 128) << 8) + p[1];
+			p += 2;
+		}
+		else
+		{
+			if (Size < 3)
+				return -1;
+			sequences = p[1] + (p[2] << 8) + 0x7F00;
+			p += 3;
+		}
+
+		uint8_t *op = Out;
+		const uint8_t *literalsEnd = Literals + LiteralCount;
+		if (sequences > 0)
+		{
+			if (p >= iend)
+				return -1;
+
+			uint8_t modes = *p++;
+			if (modes & 3)
+				return -1;
+
+			ssize_t ret = ReadTable(&ctx->LL, ctx->HasLL, modes >> 6, p, iend - p,
+									LLDefault, ZSTD_LL_MAX_SYMBOL + 1, 6, ZSTD_LL_MAX_LOG, ZSTD_LL_MAX_SYMBOL);
+			if (ret < 0)
+				return -1;
+			p += ret;
+
+			ret = ReadTable(&ctx->OF, ctx->HasOF, (modes >> 4) & 3, p, iend - p,
+							OFDefault, ZSTD_OF_DEFAULT_SYMBOLS, 5, ZSTD_OF_MAX_LOG, ZSTD_OF_MAX_SYMBOL);
+			if (ret < 0)
+				return -1;
+			p += ret;
+
+			ret = ReadTable(&ctx->ML, ctx->HasML, (modes >> 2) & 3, p, iend - p,
+							MLDefault, ZSTD_ML_MAX_SYMBOL + 1, 6, ZSTD_ML_MAX_LOG, ZSTD_ML_MAX_SYMBOL);
+			if (ret < 0)
+				return -1;
+			p += ret;
+
+			BackwardStream stream;
+			if (!stream.Open(p, iend - p))
+				return -1;
+
+			FSEState ll, of, ml;
+			ll.Init(&ctx->LL, stream);
+			of.Init(&ctx->OF, stream);
+			ml.Init(&ctx->ML, stream);
+
+			for (size_t i = 0; i < sequences; i++)
+			{
+				uint8_t ofCode = of.Peek();
+				uint8_t llCode = ll.Peek();
+				uint8_t mlCode = ml.Peek();
+				if (ofCode > ZSTD_OF_MAX_SYMBOL || llCode > ZSTD_LL_MAX_SYMBOL ||
+					mlCode > ZSTD_ML_MAX_SYMBOL)
+					return -1;
+
+				uint32_t offsetValue = (1U << ofCode) + stream.Read(ofCode);
+				size_t match = MLBase[mlCode] + stream.Read(MLExtra[mlCode]);
+				size_t literals = LLBase[llCode] + stream.Read(LLExtra[llCode]);
+
+				/* The last sequence doesn't move the states */
+				if (i + 1 < sequences)
+				{
+					ll.Update(stream);
+					ml.Update(stream);
+					of.Update(stream);
+				}
+
+				uint32_t *rep = ctx->Repeat;
+				size_t offset;
+				if (offsetValue > 3)
+				{
+					offset = offsetValue - 3;
+					rep[2] = rep[1];
+					rep[1] = rep[0];
+					rep[0] = offset;
+				}
+				else
+				{
+					/* Repeat codes shift by one without literals */
+					uint32_t index = offsetValue - 1 + (literals == 0);
+					if (index == 0)
+						offset = rep[0];
+					else
+					{
+						offset = index < 3 ? rep[index] : rep[0] - 1;
+						if (index > 1)
+							rep[2] = rep[1];
+						rep[1] = rep[0];
+						rep[0] = offset;
+					}
+				}
+
+				if ((size_t)(literalsEnd - Literals) < literals ||
+					(size_t)(End - op) < literals + match)
+					return -1;
+
+				memcpy(op, Literals, literals);
+				op += literals;
+				Literals += literals;
+
+				if (offset == 0 || offset > (size_t)(op - FrameStart))
+					return -1;
+
+				const uint8_t *from = op - offset;
+				if (offset >= match)
+					memcpy(op, from, match);
+				else
+				{
+					/* Overlapping match, repeats the last offset bytes */
+					for (size_t j = 0; j < match; j++)
+						op[j] = from[j];
+				}
+				op += match;
+			}
+
+			if (stream.Offset != 0)
+				return -1;
+		}
+		else if (p != iend)
+			return -1;
+
+		/* Literals after the last match */
+		size_t rest = literalsEnd - Literals;
+		if ((size_t)(End - op) < rest)
+			return -1;
+		memcpy(op, Literals, rest);
+		op += rest;
+		return op - Out;
+	}
+
+	struct FrameHeader
+	{
+		size_t Size;
+		uint64_t WindowSize;
+		uint64_t ContentSize;
+		bool Known;
+		bool Checksum;
+		uint32_t Dictionary;
+	};
+
+	static bool ReadHeader(const uint8_t *p, size_t Size, FrameHeader *Header)
+	{
+		if (!IsFrame(p, Size) || Size < 5)
+			return false;
+
+		uint8_t descriptor = p[4];
+		int contentFlag = descriptor >> 6;
+		bool singleSegment = descriptor & 0x20;
+		if (descriptor & 0x08)
+			return false;
+
+		size_t position = 5;
+		Header->WindowSize = 0;
+		if (!singleSegment)
+		{
+			if (Size <= position)
+				return false;
+
+			uint8_t window = p[position++];
+			int log = 10 + (window >> 3);
+			uint64_t base = (uint64_t)1 << log;
+			Header->WindowSize = base + (base / 8) * (window & 7);
+		}
+
+		static const int DictionaryBytes[4] = {0, 1, 2, 4};
+		int dictionary = DictionaryBytes[descriptor & 3];
+		int content = contentFlag == 0 ? (singleSegment ? 1 : 0) : 1 << contentFlag;
+		if (Size < position + dictionary + content)
+			return false;
+
+		Header->Dictionary = ReadLE(p + position, dictionary);
+		position += dictionary;
+
+		Header->ContentSize = ReadLE(p + position, content);
+		if (content == 2)
+			Header->ContentSize += 256;
+		position += content;
+
+		Header->Known = content > 0;
+		if (singleSegment)
+			Header->WindowSize = Header->ContentSize;
+
+		Header->Checksum = descriptor & 0x04;
+		Header->Size = position;
+		return true;
+	}
+
+	bool GetFrameInfo(const void *Data, size_t Size, FrameInfo *Info)
+	{
+		const uint8_t *p = (const uint8_t *)Data;
+		if (IsSkippableFrame(Data, Size))
+		{
+			uint32_t length = Read32(p + 4);
+			if (Size - 8 < length)
+				return false;
+
+			Info->FrameSize = 8 + length;
+			Info->ContentSize = 0;
+			Info->Known = true;
+			Info->Bound = 0;
+			Info->Skippable = true;
+			return true;
+		}
+
+		FrameHeader header;
+		if (!ReadHeader(p, Size, &header))
+			return false;
+
+		size_t blockMax = std::min(header.WindowSize, (uint64_t)ZSTD_BLOCK_SIZE_MAX);
+		size_t position = header.Size;
+		size_t bound = 0;
+		while (true)
+		{
+			if (Size - position < 3)
+				return false;
+
+			uint32_t block = ReadLE(p + position, 3);
+			size_t length = block >> 3;
+			int type = (block >> 1) & 3;
+			position += 3;
+
+			size_t stored = type == BLOCK_RLE ? 1 : length;
+			if (type > BLOCK_COMPRESSED || Size - position < stored)
+				return false;
+
+			bound += type == BLOCK_COMPRESSED ? blockMax : length;
+			position += stored;
+			if (block & 1)
+				break;
+		}
+
+		if (header.Checksum)
+		{
+			if (Size - position < 4)
+				return false;
+			position += 4;
+		}
+
+		Info->FrameSize = position;
+		Info->ContentSize = header.ContentSize;
+		Info->Known = header.Known;
+		Info->Bound = header.Known ? header.ContentSize : bound;
+		Info->Skippable = false;
+		return true;
+	}
+
+	ssize_t DecompressFrame(const void *Source, size_t SourceSize,
+							void *Destination, size_t Capacity)
+	{
+		const uint8_t *ip = (const uint8_t *)Source;
+		const uint8_t *iend = ip + SourceSize;
+		uint8_t *ostart = (uint8_t *)Destination;
+		uint8_t *op = ostart;
+		uint8_t *oend = ostart + Capacity;
+
+		FrameHeader header;
+		if (!ReadHeader(ip, SourceSize, &header))
+			return -1;
+
+		if (header.Dictionary)
+		{
+			error("zstd frames with a dictionary are not supported");
+			return -1;
+		}
+
+		if (header.Known && header.ContentSize > Capacity)
+			return -1;
+
+		Context *ctx = new Context;
+		ip += header.Size;
+		bool valid = false;
+		while (true)
+		{
+			if (iend - ip < 3)
+				break;
+
+			uint32_t block = ReadLE(ip, 3);
+			size_t length = block >> 3;
+			int type = (block >> 1) & 3;
+			ip += 3;
+
+			if (type == BLOCK_RAW)
+			{
+				if ((size_t)(iend - ip) < length || (size_t)(oend - op) < length)
+					break;
+				memcpy(op, ip, length);
+				op += length;
+				ip += length;
+			}
+			else if (type == BLOCK_RLE)
+			{
+				if (iend - ip < 1 || (size_t)(oend - op) < length)
+					break;
+				memset(op, *ip, length);
+				op += length;
+				ip++;
+			}
+			else if (type == BLOCK_COMPRESSED)
+			{
+				if ((size_t)(iend - ip) < length || length > ZSTD_BLOCK_SIZE_MAX)
+					break;
+
+				const uint8_t *literals;
+				size_t count;
+				ssize_t used = DecodeLiterals(ctx, ip, length, &literals, &count);
+				if (used < 0)
+					break;
+
+				uint8_t *end = op + std::min((size_t)(oend - op), (size_t)ZSTD_BLOCK_SIZE_MAX);
+				ssize_t written = DecodeSequences(ctx, ip + used, length - used,
+												  literals, count, ostart, op, end);
+				if (written < 0)
+					break;
+				op += written;
+				ip += length;
+			}
+			else
+				break;
+
+			if (block & 1)
+			{
+				valid = true;
+				break;
+			}
+		}
+		delete ctx;
+
+		if (!valid)
+			return -1;
+
+		if (header.Known && header.ContentSize != (uint64_t)(op - ostart))
+			return -1;
+
+		if (header.Checksum)
+		{
+			if (iend - ip < 4)
+				return -1;
+
+			uint32_t checksum = XXH64(ostart, op - ostart, 0) & 0xFFFFFFFF;
+			if (checksum != Read32(ip))
+			{
+				error("zstd content checksum mismatch");
+				return -1;
+			}
+		}
+
+		return op - ostart;
+	}
+}
@@ -16,229 +16,380 @@
 */
 
 #include <net/arp.hpp>
+#include <task.hpp>
+#include <rand.hpp>
 #include <debug.h>
+#include <vector>
 
 #include "../kernel.h"
 
 /* conversion from 'uint48_t' {aka 'long unsigned int'} to 'long unsigned int:48' may change value */
 #pragma GCC diagnostic ignored "-Wconversion"
 
+#define BROADCAST_MAC 0xFFFFFFFFFFFF
+
 namespace NetworkARP
 {
-	DiscoveredAddress *ARP::ManageDiscoveredAddresses(DAType Type, InternetProtocol IP, MediaAccessControl MAC)
+	/* Every ARP instance, aged by the "ARP" thread */
+	NewLock(InstancesLock);
+	std::vector<ARP *> Instances;
+	Tasking::TCB *AgingThread = nullptr;
+
+	static void AgingLoop()
+	{
+		while (true)
+		{
+			TaskManager->Sleep(Time::FromMilliseconds(ARP_TICK_MS));
+			uint64_t now = TimeManager->GetTimeNs();
+
+			SmartLock(InstancesLock);
+			for (ARP *arp : Instances)
+				arp->Age(now);
+		}
+	}
+
+	std::list<Neighbour *> &ARP::Bucket(uint32_t Address)
+	{
+		return Table[NetworkHashMix(Address ^ HashSecret) & (ARP_HASH_SIZE - 1)];
+	}
+
+	Neighbour *ARP::Find(uint32_t Address)
+	{
+		for (Neighbour *n : Bucket(Address))
+		{
+			if (n->Address == Address)
+				return n;
+		}
+		return nullptr;
+	}
+
+	Neighbour *ARP::Create(uint32_t Address, uint64_t Now)
 	{
-		switch (Type)
+		if (Entries >= ARP_MAX_ENTRIES)
 		{
-		case DA_ADD:
+			warn("Neighbour table is full, not adding %#x", Address);
+			return nullptr;
+		}
+
+		Neighbour *n = new Neighbour;
+		n->Address = Address;
+		n->Used = Now;
+		Bucket(Address).push_back(n);
+		Entries++;
+		return n;
+	}
+
+	void ARP::Remove(Neighbour *Entry)
+	{
+		Bucket(Entry->Address).remove(Entry);
+		Entries--;
+		for (auto &frame : Entry->Queue)
+			frame.Packet->Put();
+		delete Entry;
+	}
+
+	void ARP::Request(uint32_t Target, uint48_t MAC)
+	{
+		ARPHeader Header;
+		Header.HardwareType = b16(ARPHardwareType::HTYPE_ETHERNET);
+		Header.ProtocolType = b16(NetworkEthernet::FrameType::TYPE_IPV4);
+		Header.HardwareSize = b8(6);
+		Header.ProtocolSize = b8(4);
+		Header.Operation = b16(ARPOperation::REQUEST);
+		Header.SenderMAC = b48(Ethernet->GetInterface()->MAC.ToHex());
+		Header.SenderIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
+		Header.TargetMAC = b48(MAC == BROADCAST_MAC ? 0 : MAC);
+		Header.TargetIP = b32(Target);
+		netdbg("Requesting %#x", Target);
+		Ethernet->Send(MediaAccessControl().FromHex(MAC), NetworkEthernet::FrameType::TYPE_ARP,
+					   (uint8_t *)&Header, sizeof(ARPHeader));
+	}
+
+	ARP::ARP(NetworkEthernet::Ethernet *Ethernet) : NetworkEthernet::EthernetEvents(NetworkEthernet::TYPE_ARP)
+	{
+		debug("ARP interface %#lx created.", this);
+		this->Ethernet = Ethernet;
+		this->HashSecret = Random::rand64();
+
+		SmartLock(InstancesLock);
+		Instances.push_back(this);
+		if (AgingThread == nullptr)
 		{
-			DiscoveredAddress *tmp = new DiscoveredAddress;
-			tmp->IP = IP;
-			tmp->MAC = MAC;
-			DiscoveredAddresses.push_back(tmp);
-			netdbg("Added %s to discovered addresses", IP.v4.ToStringLittleEndian());
-			return tmp;
+			AgingThread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													Tasking::IP(AgingLoop));
+			AgingThread->Rename("ARP");
 		}
-		case DA_DEL:
+	}
+
+	ARP::~ARP()
+	{
 		{
-			forItr(itr, DiscoveredAddresses)
+			SmartLock(InstancesLock);
+			forItr(itr, Instances)
 			{
-				if ((*itr)->IP.v4 == IP.v4)
+				if (*itr == this)
 				{
-					DiscoveredAddress *tmp = *itr;
-					netdbg("Removed %s from discovered addresses", IP.v4.ToStringLittleEndian());
-					delete tmp, tmp = nullptr;
-					DiscoveredAddresses.erase(itr);
+					Instances.erase(itr);
 					break;
 				}
 			}
+		}
 
-			return nullptr;
+		SmartLock(TableLock);
+		for (size_t i = 0; i < ARP_HASH_SIZE; i++)
+		{
+			while (!Table[i].empty())
+				Remove(Table[i].front());
 		}
-		case DA_SEARCH:
+		debug("ARP interface %#lx destroyed.", this);
+	}
+
+	uint48_t ARP::Resolve(InternetProtocol IP)
+	{
+		netdbg("Resolving %s", IP.v4.ToStringLittleEndian());
+		uint32_t address = IP.v4.ToHex();
+		if (address == 0xFFFFFFFF)
+			return BROADCAST_MAC;
+
+		/* The aging thread retries the request, we only wait for it */
+		int wait = ARP_MAX_PROBES * ARP_RETRANSMIT_MS / 100;
+		for (int i = 0; i <= wait; i++)
 		{
-			for (size_t i = 0; i < DiscoveredAddresses.size(); i++)
+			bool request = false;
 			{
-				if (DiscoveredAddresses[i]->IP.v4 == IP.v4)
+				SmartLock(TableLock);
+				uint64_t now = TimeManager->GetTimeNs();
+				Neighbour *n = Find(address);
+				if (n && n->State != NEIGHBOUR_INCOMPLETE)
+				{
+					n->Used = now;
+					return n->MAC;
+				}
+
+				if (n == nullptr)
 				{
-					netdbg("Found %s in discovered addresses", IP.v4.ToStringLittleEndian());
-					return DiscoveredAddresses[i];
+					n = Create(address, now);
+					if (n == nullptr)
+						return 0;
+					n->Probed = now;
+					n->Probes = 1;
+					request = true;
 				}
 			}
-			return nullptr;
+
+			if (request)
+				Request(address, BROADCAST_MAC);
+			TaskManager->Sleep(Time::FromMilliseconds(100));
 		}
-		case DA_UPDATE:
+
+		warn("Request timeout.");
+		return 0;
+	}
+
+	void ARP::Output(InternetProtocol IP, NetworkEthernet::FrameType Type, NetworkPacket::Buffer *Packet)
+	{
+		uint32_t address = IP.v4.ToHex();
+		if (address == 0xFFFFFFFF)
 		{
-			for (size_t i = 0; i < DiscoveredAddresses.size(); i++)
+			Ethernet->Send(MediaAccessControl().FromHex(BROADCAST_MAC), Type, Packet);
+			return;
+		}
+
+		TableLock.Lock(__FUNCTION__);
+		uint64_t now = TimeManager->GetTimeNs();
+		Neighbour *n = Find(address);
+		if (n && n->State != NEIGHBOUR_INCOMPLETE)
+		{
+			uint48_t mac = n->MAC;
+			n->Used = now;
+
+			/* Keep using a stale address, but ask if it is still valid */
+			bool probe = n->State == NEIGHBOUR_STALE &&
+						 now - n->Probed >= Time::FromMilliseconds(ARP_RETRANSMIT_MS);
+			if (probe)
+				n->Probed = now;
+			TableLock.Unlock();
+
+			Ethernet->Send(MediaAccessControl().FromHex(mac), Type, Packet);
+			if (probe)
+				Request(address, mac);
+			return;
+		}
+
+		bool request = false;
+		if (n == nullptr)
+		{
+			n = Create(address, now);
+			if (n == nullptr)
 			{
-				if (DiscoveredAddresses[i]->IP.v4 == IP.v4)
-				{
-					DiscoveredAddresses[i]->MAC = MAC;
-					netdbg("Updated %s in discovered addresses", IP.v4.ToStringLittleEndian());
-					return DiscoveredAddresses[i];
-				}
+				TableLock.Unlock();
+				Packet->Put();
+				return;
 			}
-			return nullptr;
+			n->Probed = now;
+			n->Probes = 1;
+			request = true;
 		}
-		default:
+
+		if (n->Queue.size() >= ARP_QUEUE_LENGTH)
 		{
-			return nullptr;
-		}
+			n->Queue.front().Packet->Put();
+			n->Queue.pop_front();
 		}
-		return nullptr;
-	}
+		n->Queue.push_back({Type, Packet});
+		n->Used = now;
+		TableLock.Unlock();
 
-	ARP::ARP(NetworkEthernet::Ethernet *Ethernet) : NetworkEthernet::EthernetEvents(NetworkEthernet::TYPE_ARP)
-	{
-		debug("ARP interface %#lx created.", this);
-		this->Ethernet = Ethernet;
+		if (request)
+			Request(address, BROADCAST_MAC);
 	}
 
-	ARP::~ARP()
+	void ARP::Broadcast(InternetProtocol IP)
 	{
-		debug("ARP interface %#lx destroyed.", this);
+		netdbg("Sending broadcast");
+		uint48_t ResolvedMAC = this->Resolve(IP);
+		Request(IP.v4.ToHex(), ResolvedMAC ? ResolvedMAC : BROADCAST_MAC);
 	}
 
-	MediaAccessControl InvalidMAC;
-	InternetProtocol InvalidIP;
-	DiscoveredAddress InvalidRet = {.MAC = InvalidMAC, .IP = InvalidIP};
-
-	DiscoveredAddress *ARP::Search(InternetProtocol TargetIP)
+	void ARP::Announce()
 	{
-		DiscoveredAddress *ret = ManageDiscoveredAddresses(DA_SEARCH, TargetIP, MediaAccessControl());
-		if (ret)
-			return ret;
-		warn("No address found for %s", TargetIP.v4.ToStringLittleEndian());
-		return &InvalidRet;
-	}
+		uint32_t self = Ethernet->GetInterface()->IP.v4.ToHex();
+		if (self == 0)
+			return;
 
-	DiscoveredAddress *ARP::Update(InternetProtocol TargetIP, MediaAccessControl TargetMAC)
-	{
-		DiscoveredAddress *ret = ManageDiscoveredAddresses(DA_UPDATE, TargetIP, TargetMAC);
-		if (ret)
-			return ret;
-		warn("No address found for %s", TargetIP.v4.ToStringLittleEndian());
-		return &InvalidRet;
+		netdbg("Announcing %#x", self);
+		Request(self, BROADCAST_MAC);
 	}
 
-	uint48_t ARP::Resolve(InternetProtocol IP)
+	void ARP::Age(uint64_t Now)
 	{
-		netdbg("Resolving %s", IP.v4.ToStringLittleEndian());
-		if (IP.v4 == 0xFFFFFFFF)
-			return 0xFFFFFFFFFFFF;
-
-		/* If we can't find the MAC, return the default value which is 0xFFFFFFFFFFFF. */
-		uint48_t ret = this->Search(IP)->MAC.ToHex();
-		netdbg("Resolved %s to %lx", IP.v4.ToStringLittleEndian(), ret);
-
-		if (ret == 0xFFFFFFFFFFFF)
-		{
-			netdbg("Sending request");
-			/* If we can't find the MAC, send a request.
-			   Because we are going to send this over the network, we need to byteswap first.
-			   This is actually very confusing for me. */
-			ARPHeader *Header = new ARPHeader;
-			Header->HardwareType = b16(ARPHardwareType::HTYPE_ETHERNET);
-			Header->ProtocolType = b16(NetworkEthernet::FrameType::TYPE_IPV4);
-			Header->HardwareSize = b8(6);
-			Header->ProtocolSize = b8(4);
-			Header->Operation = b16(ARPOperation::REQUEST);
-			Header->SenderMAC = b48(Ethernet->GetInterface()->MAC.ToHex());
-			Header->SenderIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
-			Header->TargetMAC = b48(0xFFFFFFFFFFFF);
-			Header->TargetIP = b32(IP.v4.ToHex());
-			netdbg("SIP: %s; TIP: %s", InternetProtocol().v4.FromHex(Header->SenderIP).ToStringLittleEndian(),
-				   InternetProtocol().v4.FromHex(Header->TargetIP).ToStringLittleEndian());
-			/* Send the request to the broadcast MAC address. */
-			Ethernet->Send({.Address = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}}, NetworkEthernet::FrameType::TYPE_ARP, (uint8_t *)Header, sizeof(ARPHeader));
-			delete Header, Header = nullptr;
-		}
-
-		int RequestTimeout = 20;
-		debug("Waiting for response");
-		while (ret == 0xFFFFFFFFFFFF)
-		{
-			ret = this->Search(IP)->MAC.ToHex();
-			if (--RequestTimeout == 0)
+		std::vector<uint32_t> retry;
+
+		TableLock.Lock(__FUNCTION__);
+		for (size_t i = 0; i < ARP_HASH_SIZE; i++)
+		{
+			for (auto itr = Table[i].begin(); itr != Table[i].end();)
 			{
-				warn("Request timeout.");
-				return 0;
+				Neighbour *n = *itr++;
+				switch (n->State)
+				{
+				case NEIGHBOUR_INCOMPLETE:
+				{
+					if (Now - n->Probed < Time::FromMilliseconds(ARP_RETRANSMIT_MS))
+						break;
+
+					if (n->Probes >= ARP_MAX_PROBES)
+					{
+						netdbg("No reply from %#x, dropping %ld frames",
+							   n->Address, n->Queue.size());
+						Remove(n);
+						break;
+					}
+
+					n->Probed = Now;
+					n->Probes++;
+					retry.push_back(n->Address);
+					break;
+				}
+				case NEIGHBOUR_REACHABLE:
+				{
+					if (Now - n->Confirmed >= Time::FromMilliseconds(ARP_REACHABLE_MS))
+						n->State = NEIGHBOUR_STALE;
+					break;
+				}
+				case NEIGHBOUR_STALE:
+				{
+					if (Now - n->Used >= Time::FromMilliseconds(ARP_GC_MS))
+						Remove(n);
+					break;
+				}
+				default:
+					break;
+				}
 			}
-			netdbg("Still waiting...");
-			TaskManager->Sleep(1000);
 		}
+		TableLock.Unlock();
 
-		return ret;
-	}
-
-	void ARP::Broadcast(InternetProtocol IP)
-	{
-		netdbg("Sending broadcast");
-		uint48_t ResolvedMAC = this->Resolve(IP);
-		ARPHeader *Header = new ARPHeader;
-		Header->HardwareType = b16(ARPHardwareType::HTYPE_ETHERNET);
-		Header->ProtocolType = b16(NetworkEthernet::FrameType::TYPE_IPV4);
-		Header->HardwareSize = b8(0x6);
-		Header->ProtocolSize = b8(0x4);
-		Header->Operation = b16(ARPOperation::REQUEST);
-		Header->SenderMAC = b48(Ethernet->GetInterface()->MAC.ToHex());
-		Header->SenderIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
-		Header->TargetMAC = b48(ResolvedMAC);
-		Header->TargetIP = b32(IP.v4.ToHex());
-		Ethernet->Send(MediaAccessControl().FromHex(ResolvedMAC), NetworkEthernet::FrameType::TYPE_ARP, (uint8_t *)Header, sizeof(ARPHeader));
-		delete Header, Header = nullptr;
+		for (uint32_t address : retry)
+			Request(address, BROADCAST_MAC);
 	}
 
 	bool ARP::OnEthernetPacketReceived(uint8_t *Data, size_t Length)
 	{
-		UNUSED(Length);
-		netdbg("Received packet");
-		ARPHeader *Header = (ARPHeader *)Data;
+		if (Length < sizeof(ARPHeader))
+			return false;
 
-		InternetProtocol SenderIPv4;
-		SenderIPv4.v4 = SenderIPv4.v4.FromHex(b32(Header->SenderIP));
+		ARPHeader *Header = (ARPHeader *)Data;
 
 		/* We only support Ethernet and IPv4. */
-		if (b16(Header->HardwareType) != ARPHardwareType::HTYPE_ETHERNET || b16(Header->ProtocolType) != NetworkEthernet::FrameType::TYPE_IPV4)
+		if (b16(Header->HardwareType) != ARPHardwareType::HTYPE_ETHERNET ||
+			b16(Header->ProtocolType) != NetworkEthernet::FrameType::TYPE_IPV4 ||
+			Header->HardwareSize != 6 || Header->ProtocolSize != 4)
 		{
 			warn("Invalid hardware/protocol type (%d/%d)", b16(Header->HardwareType), b16(Header->ProtocolType));
 			return false;
 		}
 
-		InternetProtocol TmpIPStruct;
-		InternetProtocol().v4.FromHex(b32(Header->SenderIP));
+		uint32_t sender = b32(Header->SenderIP);
+		uint32_t target = b32(Header->TargetIP);
+		uint48_t senderMAC = b48(Header->SenderMAC);
+		uint32_t self = Ethernet->GetInterface()->IP.v4.ToHex();
+		uint48_t selfMAC = Ethernet->GetInterface()->MAC.ToHex();
+
+		netdbg("%s from %#x", sender == target ? "Gratuitous ARP" : "ARP", sender);
+		if (senderMAC == selfMAC)
+			return false;
 
-		if (ManageDiscoveredAddresses(DA_SEARCH, TmpIPStruct, MediaAccessControl().FromHex(b48(Header->SenderMAC))) == nullptr)
+		if (self != 0 && sender == self)
 		{
-			netdbg("Discovered new address %s", SenderIPv4.v4.ToStringLittleEndian());
-			TmpIPStruct.v4.FromHex(b32(Header->SenderIP));
-			ManageDiscoveredAddresses(DA_ADD, TmpIPStruct, MediaAccessControl().FromHex(b48(Header->SenderMAC)));
+			warn("Address conflict, %#lx claims our address", senderMAC);
+			return false;
 		}
-		else
+
+		/*
+			RFC 826 merge: update the sender if we know it, and only
+			add it when the packet is meant for us. Gratuitous ARPs
+			target the sender itself, so they only refresh existing
+			entries. A zero sender is an address probe (RFC 5227)
+			and is never cached.
+		*/
+		std::list<Neighbour::PendingFrame> flush;
+		if (sender != 0)
 		{
-			netdbg("Updated address %s", SenderIPv4.v4.ToStringLittleEndian());
-			TmpIPStruct.v4.FromHex(b32(Header->SenderIP));
-			ManageDiscoveredAddresses(DA_UPDATE, TmpIPStruct, MediaAccessControl().FromHex(b48(Header->SenderMAC)));
+			SmartLock(TableLock);
+			uint64_t now = TimeManager->GetTimeNs();
+			Neighbour *n = Find(sender);
+			if (n == nullptr && self != 0 && target == self)
+				n = Create(sender, now);
+
+			if (n)
+			{
+				n->MAC = senderMAC;
+				n->State = NEIGHBOUR_REACHABLE;
+				n->Confirmed = now;
+				n->Probes = 0;
+				flush.swap(n->Queue);
+			}
 		}
 
-		switch (b16(Header->Operation))
+		for (auto &frame : flush)
+			Ethernet->Send(MediaAccessControl().FromHex(senderMAC), frame.Type, frame.Packet);
+
+		if (b16(Header->Operation) == ARPOperation::REQUEST && self != 0 && target == self)
 		{
-		case ARPOperation::REQUEST:
-			netdbg("Received request from %s", SenderIPv4.v4.ToStringLittleEndian());
-			/* We need to byteswap before we send it back. */
-			Header->TargetMAC = b48(Header->SenderMAC);
-			Header->TargetIP = b32(Header->SenderIP);
-			Header->SenderMAC = b48(Ethernet->GetInterface()->MAC.ToHex());
-			Header->SenderIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
-			Header->Operation = b16(ARPOperation::REPLY);
-			Ethernet->Send(MediaAccessControl().FromHex(Header->TargetMAC), NetworkEthernet::FrameType::TYPE_ARP, (uint8_t *)Header, sizeof(ARPHeader));
-			netdbg("Sent request for %s", SenderIPv4.v4.ToStringLittleEndian());
-			break;
-		case ARPOperation::REPLY:
-			fixme("Received reply from %s", SenderIPv4.v4.ToStringLittleEndian());
-			break;
-		default:
-			warn("Invalid operation (%d)", b16(Header->Operation));
-			break;
+			netdbg("Received request from %#x", sender);
+			ARPHeader Reply;
+			Reply.HardwareType = b16(ARPHardwareType::HTYPE_ETHERNET);
+			Reply.ProtocolType = b16(NetworkEthernet::FrameType::TYPE_IPV4);
+			Reply.HardwareSize = b8(6);
+			Reply.ProtocolSize = b8(4);
+			Reply.Operation = b16(ARPOperation::REPLY);
+			Reply.SenderMAC = b48(selfMAC);
+			Reply.SenderIP = b32(self);
+			Reply.TargetMAC = b48(senderMAC);
+			Reply.TargetIP = b32(sender);
+			Ethernet->Send(MediaAccessControl().FromHex(senderMAC), NetworkEthernet::FrameType::TYPE_ARP,
+						   (uint8_t *)&Reply, sizeof(ARPHeader));
 		}
 		return false;
 	}
@@ -17,15 +17,335 @@
 
 #include <net/net.hpp>
 
+#include <convert.h>
+#include <debug.h>
+#include <cpu.hpp>
+
+#include "../kernel.h"
+
+/*
+	The sum is byte order independent (RFC 1071 2.B), so words
+	are added as they are in memory and the result is stored
+	the same way. 32-bit words go into 64-bit accumulators, which
+	can't carry out for any length we will ever see, and are
+	folded down to 16 bits only at the end.
+
+	  - Scalar: unrolled 32 bytes per iteration, two accumulators
+	  - SSE2: 64 bytes per iteration, words widened to 64-bit lanes
+	  - AVX2: 128 bytes per iteration, only with Config.SIMD and YMM
+	    state enabled in XCR0
+*/
+
+#define CHECKSUM_SIMD_THRESHOLD 64
+#define CHECKSUM_AVX2_THRESHOLD 256
+
+namespace
+{
+	struct
+	{
+		bool Detected;
+		bool AVX2;
+	} ChecksumFeatures;
+
+	void DetectChecksumFeatures()
+	{
+		ChecksumFeatures.Detected = true;
+
+#if defined(__amd64__)
+		bool osxsave = false, avx = false;
+		if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_AMD) == 0)
+		{
+			CPU::x86::AMD::CPUID0x00000001 cpuid1;
+			CPU::x86::AMD::CPUID0x00000007_ECX_0 cpuid7;
+			osxsave = cpuid1.ECX.OSXSAVE;
+			avx = cpuid1.ECX.AVX;
+			ChecksumFeatures.AVX2 = cpuid7.EBX.AVX2;
+		}
+		else if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_INTEL) == 0)
+		{
+			CPU::x86::Intel::CPUID0x00000001 cpuid1;
+			CPU::x86::Intel::CPUID0x00000007_0 cpuid7;
+			osxsave = cpuid1.ECX.OSXSAVE;
+			avx = cpuid1.ECX.AVX;
+			ChecksumFeatures.AVX2 = cpuid7.EBX.AVX2;
+		}
+
+		if (!osxsave || !avx || !CPU::x64::readxcr0().AVX)
+			ChecksumFeatures.AVX2 = false;
+
+		debug("AVX2: %d", ChecksumFeatures.AVX2);
+#endif
+	}
+
+	inline __always_inline void CheckChecksumFeatures()
+	{
+		if (unlikely(!ChecksumFeatures.Detected))
+			DetectChecksumFeatures();
+	}
+
+	inline __always_inline uint64_t AddCarry(uint64_t a, uint64_t b)
+	{
+		a += b;
+		return a + (a < b);
+	}
+
+	inline __always_inline uint32_t Load32(const uint8_t *p)
+	{
+		uint32_t v;
+		__builtin_memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline __always_inline uint16_t Load16(const uint8_t *p)
+	{
+		uint16_t v;
+		__builtin_memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	/* The last byte of an odd length is the first byte of a word */
+	inline __always_inline uint64_t TailByte(uint8_t Byte)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return Byte;
+#else
+		return (uint64_t)Byte << 8;
+#endif
+	}
+}
+
+uint64_t ChecksumScalar(const void *Data, size_t Length, uint64_t Sum)
+{
+	const uint8_t *p = (const uint8_t *)Data;
+	uint64_t a = 0, b = 0;
+
+	for (; Length >= 32; Length -= 32, p += 32)
+	{
+		a += Load32(p + 0);
+		b += Load32(p + 4);
+		a += Load32(p + 8);
+		b += Load32(p + 12);
+		a += Load32(p + 16);
+		b += Load32(p + 20);
+		a += Load32(p + 24);
+		b += Load32(p + 28);
+	}
+
+	for (; Length >= 4; Length -= 4, p += 4)
+		a += Load32(p);
+	if (Length >= 2)
+	{
+		b += Load16(p);
+		Length -= 2;
+		p += 2;
+	}
+	if (Length)
+		a += TailByte(*p);
+
+	return AddCarry(AddCarry(Sum, a), b);
+}
+
+uint64_t ChecksumSSE2(const void *Data, size_t Length, uint64_t Sum)
+{
+#if defined(__amd64__)
+	const uint8_t *p = (const uint8_t *)Data;
+	if (Length >= 64)
+	{
+		uint64_t lanes[2];
+		asmv("pxor %%xmm4, %%xmm4\n"
+			 "pxor %%xmm5, %%xmm5\n"
+			 "pxor %%xmm6, %%xmm6\n"
+			 "1:\n"
+			 "movdqu 0(%0), %%xmm0\n"
+			 "movdqu 16(%0), %%xmm1\n"
+			 "movdqa %%xmm0, %%xmm2\n"
+			 "movdqa %%xmm1, %%xmm3\n"
+			 "punpckldq %%xmm4, %%xmm0\n"
+			 "punpckhdq %%xmm4, %%xmm2\n"
+			 "punpckldq %%xmm4, %%xmm1\n"
+			 "punpckhdq %%xmm4, %%xmm3\n"
+			 "paddq %%xmm0, %%xmm5\n"
+			 "paddq %%xmm2, %%xmm6\n"
+			 "paddq %%xmm1, %%xmm5\n"
+			 "paddq %%xmm3, %%xmm6\n"
+			 "movdqu 32(%0), %%xmm0\n"
+			 "movdqu 48(%0), %%xmm1\n"
+			 "movdqa %%xmm0, %%xmm2\n"
+			 "movdqa %%xmm1, %%xmm3\n"
+			 "punpckldq %%xmm4, %%xmm0\n"
+			 "punpckhdq %%xmm4, %%xmm2\n"
+			 "punpckldq %%xmm4, %%xmm1\n"
+			 "punpckhdq %%xmm4, %%xmm3\n"
+			 "paddq %%xmm0, %%xmm5\n"
+			 "paddq %%xmm2, %%xmm6\n"
+			 "paddq %%xmm1, %%xmm5\n"
+			 "paddq %%xmm3, %%xmm6\n"
+			 "add $64, %0\n"
+			 "sub $64, %1\n"
+			 "cmp $64, %1\n"
+			 "jae 1b\n"
+			 "paddq %%xmm6, %%xmm5\n"
+			 "movdqu %%xmm5, (%2)\n"
+			 : "+r"(p), "+r"(Length)
+			 : "r"(lanes)
+			 : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "memory", "cc");
+		Sum = AddCarry(AddCarry(Sum, lanes[0]), lanes[1]);
+	}
+	return ChecksumScalar(p, Length, Sum);
+#else
+	return ChecksumScalar(Data, Length, Sum);
+#endif
+}
+
+uint64_t ChecksumAVX2(const void *Data, size_t Length, uint64_t Sum)
+{
+#if defined(__amd64__)
+	CheckChecksumFeatures();
+	if (!ChecksumFeatures.AVX2)
+		return ChecksumSSE2(Data, Length, Sum);
+
+	const uint8_t *p = (const uint8_t *)Data;
+	if (Length >= 128)
+	{
+		uint64_t lanes[4];
+		asmv("vpxor %%ymm4, %%ymm4, %%ymm4\n"
+			 "vpxor %%ymm5, %%ymm5, %%ymm5\n"
+			 "vpxor %%ymm6, %%ymm6, %%ymm6\n"
+			 "1:\n"
+			 "vmovdqu 0(%0), %%ymm0\n"
+			 "vmovdqu 32(%0), %%ymm1\n"
+			 "vpunpckldq %%ymm4, %%ymm0, %%ymm2\n"
+			 "vpunpckhdq %%ymm4, %%ymm0, %%ymm3\n"
+			 "vpaddq %%ymm2, %%ymm5, %%ymm5\n"
+			 "vpaddq %%ymm3, %%ymm6, %%ymm6\n"
+			 "vpunpckldq %%ymm4, %%ymm1, %%ymm2\n"
+			 "vpunpckhdq %%ymm4, %%ymm1, %%ymm3\n"
+			 "vpaddq %%ymm2, %%ymm5, %%ymm5\n"
+			 "vpaddq %%ymm3, %%ymm6, %%ymm6\n"
+			 "vmovdqu 64(%0), %%ymm0\n"
+			 "vmovdqu 96(%0), %%ymm1\n"
+			 "vpunpckldq %%ymm4, %%ymm0, %%ymm2\n"
+			 "vpunpckhdq %%ymm4, %%ymm0, %%ymm3\n"
+			 "vpaddq %%ymm2, %%ymm5, %%ymm5\n"
+			 "vpaddq %%ymm3, %%ymm6, %%ymm6\n"
+			 "vpunpckldq %%ymm4, %%ymm1, %%ymm2\n"
+			 "vpunpckhdq %%ymm4, %%ymm1, %%ymm3\n"
+			 "vpaddq %%ymm2, %%ymm5, %%ymm5\n"
+			 "vpaddq %%ymm3, %%ymm6, %%ymm6\n"
+			 "add $128, %0\n"
+			 "sub $128, %1\n"
+			 "cmp $128, %1\n"
+			 "jae 1b\n"
+			 "vpaddq %%ymm6, %%ymm5, %%ymm5\n"
+			 "vmovdqu %%ymm5, (%2)\n"
+			 "vzeroupper\n"
+			 : "+r"(p), "+r"(Length)
+			 : "r"(lanes)
+			 : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "memory", "cc");
+		for (int i = 0; i < 4; i++)
+			Sum = AddCarry(Sum, lanes[i]);
+	}
+	return ChecksumSSE2(p, Length, Sum);
+#else
+	return ChecksumScalar(Data, Length, Sum);
+#endif
+}
+
+uint64_t ChecksumPartial(const void *Data, size_t Length, uint64_t Sum)
+{
+	if (Length < CHECKSUM_SIMD_THRESHOLD)
+		return ChecksumScalar(Data, Length, Sum);
+
+#if defined(__amd64__)
+	CheckChecksumFeatures();
+	if (ChecksumFeatures.AVX2 && Config.SIMD && Length >= CHECKSUM_AVX2_THRESHOLD)
+		return ChecksumAVX2(Data, Length, Sum);
+	return ChecksumSSE2(Data, Length, Sum);
+#else
+	return ChecksumScalar(Data, Length, Sum);
+#endif
+}
+
+uint64_t ChecksumCopy(void *Destination, const void *Source, size_t Length, uint64_t Sum)
+{
+	uint8_t *d = (uint8_t *)Destination;
+	const uint8_t *s = (const uint8_t *)Source;
+	uint64_t a = 0, b = 0;
+
+	for (; Length >= 16; Length -= 16, d += 16, s += 16)
+	{
+		uint32_t w0 = Load32(s + 0), w1 = Load32(s + 4);
+		uint32_t w2 = Load32(s + 8), w3 = Load32(s + 12);
+		__builtin_memcpy(d + 0, &w0, 4);
+		__builtin_memcpy(d + 4, &w1, 4);
+		__builtin_memcpy(d + 8, &w2, 4);
+		__builtin_memcpy(d + 12, &w3, 4);
+		a += w0;
+		b += w1;
+		a += w2;
+		b += w3;
+	}
+
+	for (; Length >= 4; Length -= 4, d += 4, s += 4)
+	{
+		uint32_t w = Load32(s);
+		__builtin_memcpy(d, &w, 4);
+		a += w;
+	}
+	if (Length >= 2)
+	{
+		uint16_t w = Load16(s);
+		__builtin_memcpy(d, &w, 2);
+		b += w;
+		Length -= 2;
+		d += 2;
+		s += 2;
+	}
+	if (Length)
+	{
+		*d = *s;
+		a += TailByte(*s);
+	}
+
+	return AddCarry(AddCarry(Sum, a), b);
+}
+
+uint16_t ChecksumFold(uint64_t Sum)
+{
+	Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+	Sum = (Sum & 0xFFFFFFFF) + (Sum >> 32);
+	Sum = (Sum & 0xFFFF) + (Sum >> 16);
+	Sum = (Sum & 0xFFFF) + (Sum >> 16);
+	return (uint16_t)Sum;
+}
+
+uint64_t ChecksumAdd(uint64_t Sum, uint64_t Partial, size_t Offset)
+{
+	/* A block at an odd offset has its bytes in the other halves of the words */
+	if (Offset & 1)
+	{
+		uint16_t folded = ChecksumFold(Partial);
+		Partial = (uint16_t)((folded >> 8) | (folded << 8));
+	}
+	return AddCarry(Sum, Partial);
+}
+
+uint16_t ChecksumUpdate16(uint16_t Checksum, uint16_t Old, uint16_t New)
+{
+	/* HC' = ~(~HC + ~m + m') */
+	uint32_t sum = (uint16_t)~Checksum + (uint16_t)~Old + (uint32_t)New;
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+uint16_t ChecksumUpdate32(uint16_t Checksum, uint32_t Old, uint32_t New)
+{
+	Checksum = ChecksumUpdate16(Checksum, (uint16_t)Old, (uint16_t)New);
+	return ChecksumUpdate16(Checksum, (uint16_t)(Old >> 16), (uint16_t)(New >> 16));
+}
+
 uint16_t CalculateChecksum(uint16_t *Data, size_t Length)
 {
-	uint16_t *Data16 = (uint16_t *)Data;
-	uint64_t Checksum = 0;
-	for (uint64_t i = 0; i < Length / 2; i++)
-		Checksum += ((Data16[i] & 0xFF00) >> 8) | ((Data16[i] & 0x00FF) << 8);
-	if (Length % 2)
-		Checksum += ((uint16_t)((char *)Data16)[Length - 1]) << 8;
-	while (Checksum & 0xFFFF0000)
-		Checksum = (Checksum & 0xFFFF) + (Checksum >> 16);
-	return (uint16_t)(((~Checksum & 0xFF00) >> 8) | ((~Checksum & 0x00FF) << 8));
+	return ChecksumFinish(ChecksumPartial(Data, Length));
 }
@@ -16,6 +16,7 @@
 */
 
 #include <net/eth.hpp>
+#include <net/loopback.hpp>
 #include <debug.h>
 
 #include "../kernel.h"
@@ -45,29 +46,44 @@ namespace NetworkEthernet
 	}
 
 	void Ethernet::Send(MediaAccessControl MAC, FrameType Type, uint8_t *Data, size_t Length)
+	{
+		NetworkPacket::Buffer *Packet = NetworkPacket::FromData(Data, Length);
+		if (Packet == nullptr)
+		{
+			warn("Out of packet buffers, dropping frame");
+			return;
+		}
+		this->Send(MAC, Type, Packet);
+	}
+
+	void Ethernet::Send(MediaAccessControl MAC, FrameType Type, NetworkPacket::Buffer *Packet)
 	{
 		netdbg("Sending frame type %#x to %s", Type, MAC.ToString());
-		size_t PacketLength = sizeof(EthernetHeader) + Length;
-		EthernetPacket *Packet = (EthernetPacket *)kmalloc(PacketLength);
+		EthernetHeader *Header = (EthernetHeader *)Packet->Push(sizeof(EthernetHeader));
+		Header->DestinationMAC = b48(MAC.ToHex());
+		Header->SourceMAC = b48(this->Interface->MAC.ToHex());
+		Header->Type = b16(Type);
 
-		Packet->Header.DestinationMAC = b48(MAC.ToHex());
-		Packet->Header.SourceMAC = b48(this->Interface->MAC.ToHex());
-		Packet->Header.Type = b16(Type);
+		if (NetworkLoopback::IsLoopback(this->Interface))
+		{
+			NetworkLoopback::Transmit(this->Interface, Packet);
+			return;
+		}
 
-		memcpy(Packet->Data, Data, Length);
 		/* Network Interface Manager takes care of physical allocation.
 		   So basically, we allocate here and then it allocates again but 1:1 mapped. */
 		// NIManager->Send(Interface, (uint8_t *)Packet, PacketLength);
 		assert(!"Function not implemented");
-		kfree(Packet);
+		Packet->Put();
 	}
 
 	void Ethernet::Receive(uint8_t *Data, size_t Length)
 	{
+		if (Length < sizeof(EthernetHeader))
+			return;
+
 		EthernetPacket *Packet = (EthernetPacket *)Data;
 		size_t PacketLength = Length - sizeof(EthernetHeader);
-		/* TODO: I have to do checks here to be sure that PacketLength is right */
-		UNUSED(PacketLength);
 
 		MediaAccessControl SourceMAC;
 		SourceMAC.FromHex(b48(Packet->Header.SourceMAC));
@@ -90,22 +106,22 @@ namespace NetworkEthernet
 			case TYPE_IPV4:
 				for (auto e : RegisteredEvents)
 					if (e.Type == TYPE_IPV4)
-						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, Length);
+						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, PacketLength);
 				break;
 			case TYPE_ARP:
 				for (auto e : RegisteredEvents)
 					if (e.Type == TYPE_ARP)
-						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, Length);
+						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, PacketLength);
 				break;
 			case TYPE_RARP:
 				for (auto e : RegisteredEvents)
 					if (e.Type == TYPE_RARP)
-						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, Length);
+						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, PacketLength);
 				break;
 			case TYPE_IPV6:
 				for (auto e : RegisteredEvents)
 					if (e.Type == TYPE_IPV6)
-						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, Length);
+						Reply = e.Ptr->OnEthernetPacketReceived((uint8_t *)Packet->Data, PacketLength);
 				break;
 			default:
 				warn("Unknown packet type %#lx", Packet->Header.Type);
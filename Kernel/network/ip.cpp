@@ -16,6 +16,7 @@
 */
 
 #include <net/ipv4.hpp>
+#include <net/loopback.hpp>
 #include <debug.h>
 
 #include "../kernel.h"
@@ -36,34 +37,52 @@ namespace NetworkIPv4
 
 	void IPv4::Send(uint8_t *Data, size_t Length, uint8_t Protocol, InternetProtocol DestinationIP)
 	{
+		NetworkPacket::Buffer *Packet = NetworkPacket::FromData(Data, Length);
+		if (Packet == nullptr)
+		{
+			warn("Out of packet buffers, dropping packet");
+			return;
+		}
+		this->Send(Packet, Protocol, DestinationIP);
+	}
+
+	void IPv4::Send(NetworkPacket::Buffer *Packet, uint8_t Protocol, InternetProtocol DestinationIP)
+	{
+		size_t Length = Packet->TotalLength();
 		netdbg("Sending %ld bytes to %s", Length, DestinationIP.v4.ToStringLittleEndian());
-		IPv4Packet *Packet = (IPv4Packet *)kmalloc(Length + sizeof(IPv4Header));
+		IPv4Header *Header = (IPv4Header *)Packet->Push(sizeof(IPv4Header));
 
 		/* This part is the most confusing one for me. */
-		Packet->Header.Version = b8(4);
-		Packet->Header.IHL = b8(sizeof(IPv4Header) / 4);
-		Packet->Header.TypeOfService = b8(0);
+		Header->Version = b8(4);
+		Header->IHL = b8(sizeof(IPv4Header) / 4);
+		Header->TypeOfService = b8(0);
 		/* We don't byteswap. */
-		Packet->Header.TotalLength = s_cst(uint16_t, Length + sizeof(IPv4Header));
-		Packet->Header.TotalLength = s_cst(uint16_t, ((Packet->Header.TotalLength & 0xFF00) >> 8) | ((Packet->Header.TotalLength & 0x00FF) << 8));
-
-		Packet->Header.Identification = b16(0x0000);
-		Packet->Header.Flags = b8(0x0);
-		Packet->Header.FragmentOffset = b8(0x0);
-		Packet->Header.TimeToLive = b8(64);
-		Packet->Header.Protocol = b8(Protocol);
-		Packet->Header.DestinationIP = b32(DestinationIP.v4.ToHex());
-		Packet->Header.SourceIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
-		Packet->Header.HeaderChecksum = b16(0x0);
-		Packet->Header.HeaderChecksum = CalculateChecksum((uint16_t *)Packet, sizeof(IPv4Header));
-
-		memcpy(Packet->Data, Data, Length);
+		Header->TotalLength = s_cst(uint16_t, Length + sizeof(IPv4Header));
+		Header->TotalLength = s_cst(uint16_t, ((Header->TotalLength & 0xFF00) >> 8) | ((Header->TotalLength & 0x00FF) << 8));
+
+		Header->Identification = b16(0x0000);
+		Header->Flags = b8(0x0);
+		Header->FragmentOffset = b8(0x0);
+		Header->TimeToLive = b8(64);
+		Header->Protocol = b8(Protocol);
+		Header->DestinationIP = b32(DestinationIP.v4.ToHex());
+		Header->SourceIP = b32(Ethernet->GetInterface()->IP.v4.ToHex());
+		Header->HeaderChecksum = b16(0x0);
+		Header->HeaderChecksum = CalculateChecksum((uint16_t *)Header, sizeof(IPv4Header));
+
 		InternetProtocol DestinationRoute = DestinationIP;
-		if ((DestinationIP.v4.ToHex() & SubNetworkMaskIP.v4.ToHex()) != (b32(Packet->Header.SourceIP) & SubNetworkMaskIP.v4.ToHex()))
-			DestinationRoute = SubNetworkMaskIP;
+		if ((DestinationIP.v4.ToHex() & SubNetworkMaskIP.v4.ToHex()) != (b32(Header->SourceIP) & SubNetworkMaskIP.v4.ToHex()))
+			DestinationRoute = GatewayIP;
 
-		Ethernet->Send(MediaAccessControl().FromHex(ARP->Resolve(DestinationRoute)), this->GetFrameType(), (uint8_t *)Packet, Length + sizeof(IPv4Header));
-		kfree(Packet);
+		/* Loopback frames never leave the interface, there is nothing to resolve */
+		if (NetworkLoopback::IsLoopback(Ethernet->GetInterface()))
+		{
+			Ethernet->Send(Ethernet->GetInterface()->MAC, this->GetFrameType(), Packet);
+			return;
+		}
+
+		/* Held by ARP until the next hop is resolved */
+		ARP->Output(DestinationRoute, this->GetFrameType(), Packet);
 	}
 
 	std::vector<IPv4Events *> RegisteredEvents;
@@ -80,9 +99,13 @@ namespace NetworkIPv4
 
 		bool Reply = false;
 
-		if (b32(Packet->Header.DestinationIP) == Ethernet->GetInterface()->IP.v4.ToHex() || b32(Packet->Header.DestinationIP) == 0xFFFFFFFF || Ethernet->GetInterface()->IP.v4.ToHex() == 0)
+		/* The loopback interface owns all of 127.0.0.0/8 */
+		bool Loopback = NetworkLoopback::IsLoopback(Ethernet->GetInterface()) &&
+						(b32(Packet->Header.DestinationIP) >> 24) == 127;
+
+		if (b32(Packet->Header.DestinationIP) == Ethernet->GetInterface()->IP.v4.ToHex() || b32(Packet->Header.DestinationIP) == 0xFFFFFFFF || Ethernet->GetInterface()->IP.v4.ToHex() == 0 || Loopback)
 		{
-			size_t TotalLength = Packet->Header.TotalLength;
+			size_t TotalLength = b16(Packet->Header.TotalLength);
 			if (TotalLength > Length)
 				TotalLength = Length;
 
@@ -0,0 +1,143 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <net/loopback.hpp>
+
+#include <net/eth.hpp>
+#include <net/arp.hpp>
+#include <net/ipv4.hpp>
+#include <net/udp.hpp>
+#include <net/tcp.hpp>
+#include <fs/poll.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+namespace NetworkLoopback
+{
+	NewLock(LoopbackLock);
+	NewLock(StackLock);
+	NetworkPacket::Buffer *Queue[LOOPBACK_QUEUE_LENGTH];
+	size_t QueueHead = 0;
+	size_t QueueLength = 0;
+	vfs::WaitQueue QueueWait;
+	Statistics Stats{};
+
+	NetworkInterfaceManager::DeviceInterface *LoopbackInterface = nullptr;
+	Stack *LoopbackStack = nullptr;
+
+	/*
+		Frames are received on a thread of their own. Receiving
+		them from Transmit() would re-enter the protocols from
+		their send path.
+	*/
+	static void LoopbackThread()
+	{
+		vfs::PollWaiter waiter;
+		waiter.Table.Wait(QueueWait);
+
+		while (true)
+		{
+			waiter.Arm();
+
+			LoopbackLock.Lock(__FUNCTION__);
+			if (QueueLength == 0)
+			{
+				LoopbackLock.Unlock();
+				waiter.Sleep(0);
+				continue;
+			}
+
+			NetworkPacket::Buffer *packet = Queue[QueueHead];
+			QueueHead = (QueueHead + 1) % LOOPBACK_QUEUE_LENGTH;
+			QueueLength--;
+			LoopbackLock.Unlock();
+
+			NetworkInterfaceManager::DeliverFrame(LoopbackInterface, packet);
+		}
+	}
+
+	bool IsLoopback(NetworkInterfaceManager::DeviceInterface *Interface)
+	{
+		return Interface != nullptr && Interface == LoopbackInterface;
+	}
+
+	void Transmit(NetworkInterfaceManager::DeviceInterface *Interface, NetworkPacket::Buffer *Packet)
+	{
+		assert(IsLoopback(Interface));
+
+		/* The frame never leaves memory, there is nothing to check */
+		if (Packet->Checksum == NetworkPacket::CHECKSUM_PARTIAL)
+			Packet->Checksum = NetworkPacket::CHECKSUM_VERIFIED;
+
+		LoopbackLock.Lock(__FUNCTION__);
+		if (QueueLength >= LOOPBACK_QUEUE_LENGTH)
+		{
+			Stats.Dropped++;
+			LoopbackLock.Unlock();
+			Packet->Put();
+			return;
+		}
+
+		Queue[(QueueHead + QueueLength) % LOOPBACK_QUEUE_LENGTH] = Packet;
+		QueueLength++;
+		Stats.Frames++;
+		Stats.Bytes += Packet->TotalLength();
+		LoopbackLock.Unlock();
+
+		QueueWait.Wake(POLLIN);
+	}
+
+	Statistics GetStatistics()
+	{
+		SmartLock(LoopbackLock);
+		return Stats;
+	}
+
+	Stack *GetStack()
+	{
+		SmartLock(StackLock);
+		if (LoopbackStack)
+			return LoopbackStack;
+
+		NetworkInterfaceManager::DeviceInterface *lo = new NetworkInterfaceManager::DeviceInterface{};
+		strcpy(lo->Name, "lo");
+		lo->ID = -1;
+		lo->MAC.FromHex(0);
+		lo->IP.v4.FromHex(0x7F000001);
+		lo->Features = NetworkInterfaceManager::FEATURE_TX_CHECKSUM;
+		LoopbackInterface = lo;
+
+		Stack *stack = new Stack;
+		stack->Interface = lo;
+		stack->Ethernet = new NetworkEthernet::Ethernet(lo);
+		stack->ARP = new NetworkARP::ARP(stack->Ethernet);
+		stack->IPv4 = new NetworkIPv4::IPv4(stack->ARP, stack->Ethernet);
+		stack->IPv4->SubNetworkMaskIP.v4.FromHex(0xFF000000);
+		stack->IPv4->GatewayIP.v4.FromHex(0x7F000001);
+		stack->UDP = new NetworkUDP::UDP(stack->IPv4, lo);
+		stack->TCP = new NetworkTCP::TCP(stack->IPv4, lo);
+
+		Tasking::TCB *thread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+														 Tasking::IP(LoopbackThread));
+		thread->Rename("Loopback");
+
+		LoopbackStack = stack;
+		debug("Loopback interface %#lx is up", lo);
+		return stack;
+	}
+}
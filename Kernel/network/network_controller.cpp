@@ -24,6 +24,8 @@
 #include <net/ntp.hpp>
 #include <net/dns.hpp>
 #include <net/udp.hpp>
+#include <net/tcp.hpp>
+#include <net/loopback.hpp>
 #include <debug.h>
 
 #include "../kernel.h"
@@ -34,6 +36,75 @@ namespace NetworkInterfaceManager
 {
 	std::vector<Events *> RegisteredEvents;
 
+	/* Interfaces backed by a device, looked up by ReceiveFrame() */
+	NewLock(DevicesLock);
+	std::vector<DeviceInterface *> Devices;
+
+	/*
+		Drivers report frames from their interrupt handlers.
+		The frames wait here and the protocols see them on the
+		receive thread, where they are free to take locks and
+		allocate memory. Wait queues take locks that are not
+		safe there, so the thread is woken directly.
+	*/
+	struct BacklogEntry
+	{
+		DeviceInterface *Interface;
+		NetworkPacket::Buffer *Packet;
+	};
+
+	NewLock(BacklogLock);
+	BacklogEntry Backlog[NETWORK_BACKLOG_LENGTH];
+	size_t BacklogHead = 0;
+	size_t BacklogLength = 0;
+	std::atomic_bool BacklogPending = false;
+	Tasking::TCB *ReceiveThread = nullptr;
+
+	static void ReceiveThreadEntry()
+	{
+		while (true)
+		{
+			BacklogPending.store(false);
+
+			BacklogEntry entry;
+			{
+				SmartCriticalSection(BacklogLock);
+				if (BacklogLength)
+				{
+					entry = Backlog[BacklogHead];
+					BacklogHead = (BacklogHead + 1) % NETWORK_BACKLOG_LENGTH;
+					BacklogLength--;
+				}
+				else
+					entry.Packet = nullptr;
+			}
+
+			/* Interrupt handlers can't grow the pool, do it for them */
+			NetworkPacket::Refill();
+
+			if (entry.Packet == nullptr)
+			{
+				thisThread->Block();
+
+				/* A wakeup may have come before we blocked */
+				if (BacklogPending.load())
+					thisThread->Unblock();
+
+				TaskManager->Yield();
+				continue;
+			}
+
+			DeliverFrame(entry.Interface, entry.Packet);
+		}
+	}
+
+	void WakeReceiveThread()
+	{
+		BacklogPending.store(true);
+		if (ReceiveThread)
+			ReceiveThread->Unblock();
+	}
+
 	NetworkInterface::NetworkInterface()
 	{
 		this->vma = new Memory::VirtualMemoryArea(nullptr);
@@ -60,6 +131,21 @@ namespace NetworkInterfaceManager
 		// Unregister all events
 		RegisteredEvents.clear();
 
+		{
+			SmartCriticalSection(DevicesLock);
+			for (auto inf : Interfaces)
+			{
+				forItr(itr, Devices)
+				{
+					if (*itr == inf)
+					{
+						Devices.erase(itr);
+						break;
+					}
+				}
+			}
+		}
+
 		forItr(itr, Interfaces) delete *itr;
 		Interfaces.clear();
 
@@ -80,6 +166,17 @@ namespace NetworkInterfaceManager
 		// Iface->MAC.FromHex(cb.NetworkCallback.Fetch.MAC);
 		Iface->DriverID = modUniqueID;
 		Interfaces.push_back(Iface);
+		if (ReceiveThread == nullptr)
+		{
+			ReceiveThread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													  Tasking::IP(ReceiveThreadEntry));
+			ReceiveThread->Rename("Network RX");
+		}
+
+		{
+			SmartCriticalSection(DevicesLock);
+			Devices.push_back(Iface);
+		}
 
 		for (auto var : RegisteredEvents)
 			var->OnInterfaceAdded(Iface);
@@ -106,10 +203,15 @@ namespace NetworkInterfaceManager
 			}
 		}
 
+		/* The loopback interface works without any hardware */
+		NetworkLoopback::Stack *lo = NetworkLoopback::GetStack();
+		debug("lo: %s (%s)", lo->Interface->Name,
+			  lo->Interface->IP.v4.ToStringLittleEndian());
+
 		if (!DefaultDevice)
 		{
-			error("No network device found!");
-			KPrint("\eE85230No network device found!");
+			warn("No network device found!");
+			KPrint("\eE85230No network device found! Only loopback is available.");
 			thisThread->SetPriority(Tasking::TaskPriority::Idle);
 			CPU::Halt(true);
 		}
@@ -120,16 +222,18 @@ namespace NetworkInterfaceManager
 		NetworkARP::ARP *arp = new NetworkARP::ARP(eth);
 		NetworkIPv4::IPv4 *ipv4 = new NetworkIPv4::IPv4(arp, eth);
 		NetworkUDP::UDP *udp = new NetworkUDP::UDP(ipv4, DefaultDevice);
+		NetworkTCP::TCP *tcp = new NetworkTCP::TCP(ipv4, DefaultDevice);
 		NetworkUDP::Socket *DHCP_Socket = udp->Connect(InternetProtocol() /* Default value is 255.255.255.255 */, 67);
 		NetworkDHCP::DHCP *dhcp = new NetworkDHCP::DHCP(DHCP_Socket, DefaultDevice);
-		debug("eth: %p; arp: %p; ipv4: %p; udp: %p; dhcp: %p",
-			  eth, arp, ipv4, udp, dhcp);
+		debug("eth: %p; arp: %p; ipv4: %p; udp: %p; tcp: %p; dhcp: %p",
+			  eth, arp, ipv4, udp, tcp, dhcp);
 		udp->Bind(DHCP_Socket, dhcp);
 		dhcp->Request();
 
 		DefaultDevice->IP.v4.FromHex(dhcp->IP.v4.ToHex());
 		ipv4->SubNetworkMaskIP = dhcp->SubNetworkMask;
 		ipv4->GatewayIP = dhcp->Gateway;
+		arp->Announce();
 		arp->Broadcast(dhcp->Gateway);
 		TaskManager->Sleep(200);
 		DbgWriteScreen("IP: %s", dhcp->IP.v4.ToStringLittleEndian());
@@ -214,10 +318,61 @@ namespace NetworkInterfaceManager
 			ev->OnInterfaceSent(Interface, Data, Length);
 	}
 
-	void NetworkInterface::Receive(DeviceInterface *Interface, uint8_t *Data, size_t Length)
+	void DeliverFrame(DeviceInterface *Interface, NetworkPacket::Buffer *Packet)
 	{
+		/* The protocols parse headers in place, they need one piece */
+		Packet = NetworkPacket::Linearize(Packet);
+		if (Packet == nullptr)
+			return;
+
+		Interface->Current = Packet;
 		for (auto re : RegisteredEvents)
-			re->OnInterfaceReceived(Interface, Data, Length);
+			re->OnInterfaceReceived(Interface, Packet->Data, Packet->Length);
+		Interface->Current = nullptr;
+		Packet->Put();
+	}
+
+	void ReceiveFrame(dev_t Device, NetworkPacket::Buffer *Packet)
+	{
+		DeviceInterface *Interface = nullptr;
+		{
+			SmartCriticalSection(DevicesLock);
+			for (auto inf : Devices)
+			{
+				if (inf->DriverID == Device)
+				{
+					Interface = inf;
+					break;
+				}
+			}
+		}
+
+		if (Interface == nullptr)
+		{
+			netdbg("No interface for device %d, dropping frame", Device);
+			Packet->Put();
+			return;
+		}
+
+		{
+			SmartCriticalSection(BacklogLock);
+			if (BacklogLength >= NETWORK_BACKLOG_LENGTH)
+			{
+				Packet->Put();
+				return;
+			}
+
+			Backlog[(BacklogHead + BacklogLength) % NETWORK_BACKLOG_LENGTH] = {Interface, Packet};
+			BacklogLength++;
+		}
+		WakeReceiveThread();
+	}
+
+	void NetworkInterface::Receive(DeviceInterface *Interface, uint8_t *Data, size_t Length)
+	{
+		NetworkPacket::Buffer *Packet = NetworkPacket::FromData(Data, Length);
+		if (Packet)
+			DeliverFrame(Interface, Packet);
 	}
 
 	Events::Events(DeviceInterface *Interface)
@@ -0,0 +1,328 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <net/packet.hpp>
+
+#include <net/nc.hpp>
+#include <smp.hpp>
+#include <lock.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+/* Pages added to the pool when it runs dry */
+#define PACKET_GROW_PAGES 16
+
+namespace NetworkPacket
+{
+	/*
+		Free buffers are kept on a small list per CPU, only
+		touched with interrupts disabled so a driver can
+		take one from its interrupt handler. The lists are
+		refilled from and drained to a global list in batches.
+		Memory is only requested with interrupts enabled, an
+		interrupt handler that finds the pool empty fails.
+	*/
+	struct CPUCache
+	{
+		Buffer *Free = nullptr;
+		size_t Count = 0;
+	};
+
+	NewLock(PoolLock);
+	CPUCache Caches[MAX_CPU];
+	Buffer *GlobalFree = nullptr;
+	std::atomic<size_t> GlobalCount = 0;
+
+	std::atomic<uint64_t> Created = 0;
+	std::atomic<uint64_t> InUse = 0;
+	std::atomic<uint64_t> CacheHits = 0;
+	std::atomic<uint64_t> Oversized = 0;
+
+	/* Never with interrupts disabled, the allocator isn't safe there */
+	static bool Grow()
+	{
+		uint8_t *pages = (uint8_t *)KernelAllocator.RequestPages(PACKET_GROW_PAGES);
+		if (pages == nullptr)
+			return false;
+
+		size_t count = FROM_PAGES(PACKET_GROW_PAGES) / PACKET_BUFFER_SIZE;
+		Buffer *buffers = new Buffer[count];
+		for (size_t i = 0; i < count; i++)
+		{
+			buffers[i].Head = pages + i * PACKET_BUFFER_SIZE;
+			buffers[i].Size = PACKET_BUFFER_SIZE;
+			buffers[i].Pooled = true;
+			if (i + 1 < count)
+				buffers[i].Next = &buffers[i + 1];
+		}
+
+		{
+			SmartCriticalSection(PoolLock);
+			buffers[count - 1].Next = GlobalFree;
+			GlobalFree = &buffers[0];
+			GlobalCount += count;
+		}
+
+		Created += count;
+		debug("Packet pool grew by %ld buffers", count);
+		return true;
+	}
+
+	static Buffer *PoolGet()
+	{
+		CriticalSection cs;
+		CPUCache &cache = Caches[GetCurrentCPU()->ID];
+		if (likely(cache.Free))
+		{
+			Buffer *buffer = cache.Free;
+			cache.Free = buffer->Next;
+			cache.Count--;
+			CacheHits++;
+			return buffer;
+		}
+
+		PoolLock.Lock(__FUNCTION__);
+		if (GlobalFree == nullptr)
+		{
+			PoolLock.Unlock();
+			return nullptr;
+		}
+
+		Buffer *buffer = GlobalFree;
+		GlobalFree = buffer->Next;
+		GlobalCount--;
+		for (size_t i = 0; i < PACKET_CACHE_BATCH && GlobalFree; i++)
+		{
+			Buffer *next = GlobalFree->Next;
+			GlobalFree->Next = cache.Free;
+			cache.Free = GlobalFree;
+			cache.Count++;
+			GlobalFree = next;
+			GlobalCount--;
+		}
+		PoolLock.Unlock();
+		return buffer;
+	}
+
+	static void PoolPut(Buffer *Packet)
+	{
+		CriticalSection cs;
+		CPUCache &cache = Caches[GetCurrentCPU()->ID];
+		Packet->Next = cache.Free;
+		cache.Free = Packet;
+		if (likely(++cache.Count <= PACKET_CACHE_SIZE))
+			return;
+
+		PoolLock.Lock(__FUNCTION__);
+		for (size_t i = 0; i < PACKET_CACHE_BATCH; i++)
+		{
+			Buffer *buffer = cache.Free;
+			cache.Free = buffer->Next;
+			buffer->Next = GlobalFree;
+			GlobalFree = buffer;
+		}
+		cache.Count -= PACKET_CACHE_BATCH;
+		GlobalCount += PACKET_CACHE_BATCH;
+		PoolLock.Unlock();
+	}
+
+	static void Release(Buffer *Packet)
+	{
+		InUse--;
+		if (Packet->Pooled)
+		{
+			PoolPut(Packet);
+			return;
+		}
+
+		kfree(Packet->Head);
+		delete Packet;
+	}
+
+	size_t Buffer::TotalLength()
+	{
+		size_t total = 0;
+		for (Buffer *b = this; b; b = b->Next)
+			total += b->Length;
+		return total;
+	}
+
+	uint8_t *Buffer::Push(size_t Bytes)
+	{
+		assert(Bytes <= this->Headroom());
+		this->Data -= Bytes;
+		this->Length += Bytes;
+		return this->Data;
+	}
+
+	uint8_t *Buffer::Pull(size_t Bytes)
+	{
+		assert(Bytes <= this->Length);
+		this->Data += Bytes;
+		this->Length -= Bytes;
+		return this->Data;
+	}
+
+	uint8_t *Buffer::Append(size_t Bytes)
+	{
+		assert(Bytes <= this->Tailroom());
+		uint8_t *tail = this->Data + this->Length;
+		this->Length += Bytes;
+		return tail;
+	}
+
+	void Buffer::Trim(size_t Length)
+	{
+		if (Length < this->Length)
+			this->Length = Length;
+	}
+
+	void Buffer::Chain(Buffer *Fragment)
+	{
+		Buffer *last = this;
+		while (last->Next)
+			last = last->Next;
+		last->Next = Fragment;
+	}
+
+	size_t Buffer::Copy(size_t Offset, void *Destination, size_t Length)
+	{
+		uint8_t *out = (uint8_t *)Destination;
+		size_t copied = 0;
+		for (Buffer *b = this; b && copied < Length; b = b->Next)
+		{
+			if (Offset >= b->Length)
+			{
+				Offset -= b->Length;
+				continue;
+			}
+
+			size_t count = std::min(b->Length - Offset, Length - copied);
+			memcpy(out + copied, b->Data + Offset, count);
+			copied += count;
+			Offset = 0;
+		}
+		return copied;
+	}
+
+	void Buffer::Put()
+	{
+		if (--this->References > 0)
+			return;
+
+		Buffer *b = this;
+		while (b)
+		{
+			Buffer *next = b->Next;
+			Release(b);
+			b = next;
+		}
+	}
+
+	void Initialize()
+	{
+		while (Created.load() < PACKET_POOL_RESERVE)
+		{
+			if (!Grow())
+			{
+				warn("Packet pool has only %ld buffers", Created.load());
+				break;
+			}
+		}
+	}
+
+	void Refill()
+	{
+		while (GlobalCount.load() < PACKET_POOL_LOW)
+		{
+			if (!Grow())
+				break;
+		}
+	}
+
+	Buffer *Allocate(size_t Length, size_t Headroom)
+	{
+		bool canGrow = CPU::Interrupts(CPU::Check);
+		Buffer *buffer;
+		if (likely(Headroom + Length <= PACKET_BUFFER_SIZE))
+		{
+			buffer = PoolGet();
+			if (unlikely(buffer == nullptr))
+			{
+				if (!canGrow)
+				{
+					NetworkInterfaceManager::WakeReceiveThread();
+					return nullptr;
+				}
+
+				if (!Grow() || (buffer = PoolGet()) == nullptr)
+					return nullptr;
+			}
+		}
+		else
+		{
+			if (!canGrow)
+				return nullptr;
+
+			buffer = new Buffer;
+			buffer->Head = (uint8_t *)kmalloc(Headroom + Length);
+			buffer->Size = Headroom + Length;
+			buffer->Pooled = false;
+			Oversized++;
+		}
+
+		buffer->References = 1;
+		buffer->Data = buffer->Head + Headroom;
+		buffer->Length = 0;
+		buffer->Next = nullptr;
+		buffer->Checksum = CHECKSUM_NONE;
+		InUse++;
+		return buffer;
+	}
+
+	Buffer *FromData(const void *Data, size_t Length, size_t Headroom)
+	{
+		Buffer *buffer = Allocate(Length, Headroom);
+		if (buffer)
+			memcpy(buffer->Append(Length), Data, Length);
+		return buffer;
+	}
+
+	Buffer *Linearize(Buffer *Packet)
+	{
+		if (Packet->Next == nullptr)
+			return Packet;
+
+		size_t total = Packet->TotalLength();
+		Buffer *linear = Allocate(total, Packet->Headroom());
+		if (linear)
+			Packet->Copy(0, linear->Append(total), total);
+		Packet->Put();
+		return linear;
+	}
+
+	Statistics GetStatistics()
+	{
+		return {
+			.Created = Created.load(),
+			.InUse = InUse.load(),
+			.CacheHits = CacheHits.load(),
+			.Oversized = Oversized.load(),
+		};
+	}
+}
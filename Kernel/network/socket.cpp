@@ -0,0 +1,150 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <net/socket.hpp>
+
+#include <net/ipv4.hpp>
+#include <net/tcp.hpp>
+#include <fs/poll.hpp>
+#include <debug.h>
+#include <atomic>
+
+#include "../kernel.h"
+
+namespace NetworkSocket
+{
+	struct SocketInode
+	{
+		struct Inode Node;
+		Socket *Owner = nullptr;
+	};
+
+	static ssize_t SocketRead(struct Inode *Node, void *Buffer, size_t Size, off_t)
+	{
+		Socket *sock = ((SocketInode *)Node)->Owner;
+		return sock->Receive(Buffer, Size, 0, Node->Flags & O_NONBLOCK);
+	}
+
+	static ssize_t SocketWrite(struct Inode *Node, const void *Buffer, size_t Size, off_t)
+	{
+		Socket *sock = ((SocketInode *)Node)->Owner;
+		return sock->Send(Buffer, Size, 0, Node->Flags & O_NONBLOCK);
+	}
+
+	static off_t SocketSeek(struct Inode *, off_t)
+	{
+		return -ESPIPE;
+	}
+
+	static int SocketPoll(struct Inode *Node, struct PollTable *Table)
+	{
+		Socket *sock = ((SocketInode *)Node)->Owner;
+		return sock->Poll(Table);
+	}
+
+	static int SocketStat(struct Inode *Node, struct kstat *Stat)
+	{
+		*Stat = {};
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		Stat->BlockSize = PAGE_SIZE;
+		return 0;
+	}
+
+	static FileSystemInfo *GetSocketFileSystem()
+	{
+		static FileSystemInfo *fsi = nullptr;
+		if (likely(fsi))
+			return fsi;
+
+		fsi = new FileSystemInfo{};
+		fsi->Name = "sockfs";
+		fsi->Ops.Read = SocketRead;
+		fsi->Ops.Write = SocketWrite;
+		fsi->Ops.Seek = SocketSeek;
+		fsi->Ops.Stat = SocketStat;
+		fsi->Ops.Poll = SocketPoll;
+		return fsi;
+	}
+
+	static std::atomic<ino_t> NextSocketIndex = 1;
+
+	class SocketNode : public NodeCache
+	{
+	public:
+		SocketInode Sock;
+
+		SocketNode(Socket *Owner, ino_t Index, int Flags)
+		{
+			Sock.Owner = Owner;
+			Sock.Node.Index = Index;
+			Sock.Node.Mode = S_IFSOCK | S_IRWXU | S_IRWXG | S_IRWXO;
+			Sock.Node.Flags = O_RDWR | Flags;
+
+			this->inode = &Sock.Node;
+			this->fsi = GetSocketFileSystem();
+			this->Flags.raw = 0;
+
+			char name[32];
+			snprintf(name, sizeof(name), "socket:[%ld]", (long)Index);
+			this->Name = std::string(name);
+			this->Path = this->Name;
+		}
+
+		~SocketNode()
+		{
+			Sock.Owner->Release();
+		}
+	};
+
+	int Create(int Domain, int Type, int Protocol, Socket **Result)
+	{
+		if (Domain != DOMAIN_INET)
+			return -EAFNOSUPPORT;
+
+		switch (Type)
+		{
+		case TYPE_STREAM:
+			if (Protocol != 0 && Protocol != NetworkIPv4::PROTOCOL_TCP)
+				return -EPROTONOSUPPORT;
+			*Result = NetworkTCP::CreateSocket();
+			return 0;
+		case TYPE_DGRAM:
+			fixme("UDP sockets are not implemented");
+			return -EPROTONOSUPPORT;
+		default:
+			return -EPROTOTYPE;
+		}
+	}
+
+	Node CreateNode(Socket *Sock, int Flags)
+	{
+		ino_t index = NextSocketIndex++;
+		return Node(new SocketNode(Sock, index, Flags & O_NONBLOCK),
+					[](SocketNode *node)
+					{ delete node; });
+	}
+
+	Socket *FromNode(Node &node)
+	{
+		if (node == nullptr || node->fsi != GetSocketFileSystem())
+			return nullptr;
+
+		return ((SocketInode *)node->inode)->Owner;
+	}
+}
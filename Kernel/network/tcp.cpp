@@ -16,10 +16,2458 @@
 */
 
 #include <net/tcp.hpp>
+
+#include <net/loopback.hpp>
+#include <signal.hpp>
+#include <task.hpp>
+#include <rand.hpp>
 #include <debug.h>
+#include <vector>
 
 #include "../kernel.h"
 
+using namespace Tasking;
+using namespace NetworkSocket;
+
+/* Retransmission timeout bounds (RFC 6298), in microseconds */
+#define TCP_RTO_INITIAL 1000000
+#define TCP_RTO_MIN 200000
+#define TCP_RTO_MAX 60000000
+
+#define TCP_SYN_RETRIES 6
+#define TCP_DATA_RETRIES 15
+
+/* Delayed ACK timeout, RFC 9293 3.8.6.3 asks for less than 0.5 s */
+#define TCP_DELACK_MS 40
+
+/* TIME-WAIT and orphaned FIN-WAIT-2 lifetime */
+#define TCP_LINGER_MS 60000
+
 namespace NetworkTCP
 {
+	/*
+		All connections share one lock. Segments and wakeups
+		produced while it is held are queued and flushed by
+		UnlockStack(), transmitting can loop back into
+		OnIPv4PacketReceived and wait queue callbacks may
+		call back into the socket.
+	*/
+	NewLock(TCPLock);
+
+	struct PendingSegment
+	{
+		TCP *Stack;
+		uint32_t Destination;
+		NetworkPacket::Buffer *Packet;
+	};
+
+	struct PendingWake
+	{
+		Connection *Conn;
+		int Events;
+	};
+
+	std::vector<TCP *> Stacks;
+	std::list<Connection *> ConnectionTable[TCP_CONN_HASH_SIZE];
+	std::list<Connection *> ListenTable[TCP_LISTEN_HASH_SIZE];
+	std::list<Connection *> BindTable[TCP_LISTEN_HASH_SIZE];
+	std::list<PendingSegment> PendingSegments;
+	std::list<PendingWake> PendingWakes;
+	TimerWheel Wheel;
+	TCB *TimerThread = nullptr;
+	uint64_t HashSecret = 0;
+	uint64_t SequenceSecret = 0;
+
+	static void LockStack() { TCPLock.Lock(__FUNCTION__); }
+
+	static void UnlockStack()
+	{
+		std::list<PendingSegment> segments;
+		std::list<PendingWake> wakes;
+		segments.swap(PendingSegments);
+		wakes.swap(PendingWakes);
+		TCPLock.Unlock();
+
+		for (auto &seg : segments)
+			seg.Stack->Transmit(seg.Destination, seg.Packet);
+
+		for (auto &wake : wakes)
+		{
+			wake.Conn->Queue.Wake(wake.Events);
+			wake.Conn->Put();
+		}
+	}
+
+	static void QueueWake(Connection *c, int Events)
+	{
+		c->Get();
+		PendingWakes.push_back({c, Events});
+	}
+
+	static inline uint64_t NowUs() { return TimeManager->GetTimeNs() / 1000; }
+
+	static inline uint64_t UsToTicks(uint64_t Us)
+	{
+		uint64_t ticks = (Us + TCP_TICK_MS * 1000 - 1) / (TCP_TICK_MS * 1000);
+		return ticks ? ticks : 1;
+	}
+
+#pragma region Helpers
+
+	static uint64_t TupleHash(uint64_t Secret, uint32_t LocalAddress, uint16_t LocalPort,
+							  uint32_t RemoteAddress, uint16_t RemotePort)
+	{
+		uint64_t addresses = ((uint64_t)LocalAddress << 32) | RemoteAddress;
+		uint64_t ports = ((uint64_t)LocalPort << 16) | RemotePort;
+		return NetworkHashMix(addresses ^ NetworkHashMix(ports ^ Secret));
+	}
+
+	static std::list<Connection *> &ConnectionBucket(Connection *c)
+	{
+		uint64_t hash = TupleHash(HashSecret, c->LocalAddress, c->LocalPort,
+								  c->RemoteAddress, c->RemotePort);
+		return ConnectionTable[hash & (TCP_CONN_HASH_SIZE - 1)];
+	}
+
+	static inline size_t PortHash(uint16_t Port)
+	{
+		return NetworkHashMix(Port ^ HashSecret) & (TCP_LISTEN_HASH_SIZE - 1);
+	}
+
+	/**
+	 * RFC 6528: a keyed hash of the connection plus
+	 * a clock ticking every 4 microseconds
+	 */
+	static uint32_t InitialSequence(Connection *c)
+	{
+		uint64_t hash = TupleHash(SequenceSecret, c->LocalAddress, c->LocalPort,
+								  c->RemoteAddress, c->RemotePort);
+		return (uint32_t)hash + (uint32_t)(NowUs() / 4);
+	}
+
+	/* Pseudo-header (RFC 9293 3.1), summed as it would be in memory */
+	static uint64_t PseudoHeaderSum(uint32_t Source, uint32_t Destination, size_t Length)
+	{
+		return (uint64_t)b32(Source) + b32(Destination) +
+			   b16((uint16_t)NetworkIPv4::PROTOCOL_TCP) + b16((uint16_t)Length);
+	}
+
+	/**
+	 * @return The checksum as stored in the header, zero
+	 *         when checking a segment that is valid
+	 */
+	static uint16_t SegmentChecksum(uint32_t Source, uint32_t Destination,
+									const uint8_t *Segment, size_t Length)
+	{
+		uint64_t sum = PseudoHeaderSum(Source, Destination, Length);
+		return ChecksumFinish(ChecksumPartial(Segment, Length, sum));
+	}
+
+	static inline void Put32(uint8_t *p, uint32_t v)
+	{
+		p[0] = (uint8_t)(v >> 24);
+		p[1] = (uint8_t)(v >> 16);
+		p[2] = (uint8_t)(v >> 8);
+		p[3] = (uint8_t)v;
+	}
+
+	static inline uint32_t Get32(const uint8_t *p)
+	{
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+			   ((uint32_t)p[2] << 8) | p[3];
+	}
+
+	/**
+	 * Insert a range into a sorted list of disjoint
+	 * ranges, merging it with the ranges it touches.
+	 */
+	static void InsertRange(std::list<SequenceRange> &List, SequenceRange Range)
+	{
+		auto it = List.begin();
+		while (it != List.end() && SeqLT(it->End, Range.Start))
+			++it;
+
+		while (it != List.end() && SeqLE(it->Start, Range.End))
+		{
+			if (SeqLT(it->Start, Range.Start))
+				Range.Start = it->Start;
+			if (SeqGT(it->End, Range.End))
+				Range.End = it->End;
+			it = List.erase(it);
+		}
+		List.insert(it, Range);
+	}
+
+#pragma endregion Helpers
+
+#pragma region Buffers
+
+	ByteRing::ByteRing(size_t Capacity)
+	{
+		this->Data = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(Capacity));
+		this->Capacity = Capacity;
+	}
+
+	ByteRing::~ByteRing()
+	{
+		KernelAllocator.FreePages(this->Data, TO_PAGES(this->Capacity));
+	}
+
+	size_t ByteRing::WriteAt(size_t Offset, const void *Buffer, size_t Length)
+	{
+		if (Offset >= Free())
+			return 0;
+
+		Length = std::min(Length, Free() - Offset);
+		size_t pos = (Head + Size + Offset) % Capacity;
+		size_t first = std::min(Length, Capacity - pos);
+		memcpy(Data + pos, Buffer, first);
+		memcpy(Data, (const uint8_t *)Buffer + first, Length - first);
+		return Length;
+	}
+
+	size_t ByteRing::Write(const void *Buffer, size_t Length)
+	{
+		size_t n = WriteAt(0, Buffer, Length);
+		Size += n;
+		return n;
+	}
+
+	size_t ByteRing::Peek(size_t Offset, void *Buffer, size_t Length, uint64_t *Sum)
+	{
+		if (Offset >= Size)
+			return 0;
+
+		Length = std::min(Length, Size - Offset);
+		size_t pos = (Head + Offset) % Capacity;
+		size_t first = std::min(Length, Capacity - pos);
+		if (Sum)
+		{
+			*Sum = ChecksumAdd(*Sum, ChecksumCopy(Buffer, Data + pos, first), 0);
+			*Sum = ChecksumAdd(*Sum, ChecksumCopy((uint8_t *)Buffer + first, Data, Length - first), first);
+			return Length;
+		}
+
+		memcpy(Buffer, Data + pos, first);
+		memcpy((uint8_t *)Buffer + first, Data, Length - first);
+		return Length;
+	}
+
+	void ByteRing::Commit(size_t Length)
+	{
+		Size += std::min(Length, Free());
+	}
+
+	void ByteRing::Consume(size_t Length)
+	{
+		Length = std::min(Length, Size);
+		Head = (Head + Length) % Capacity;
+		Size -= Length;
+	}
+
+#pragma endregion Buffers
+
+#pragma region Timers
+
+	void TimerWheel::Schedule(Timer *t, uint64_t Ticks)
+	{
+		Cancel(t);
+		t->Expires = Current + (Ticks ? Ticks : 1);
+		std::list<Timer *> &slot = Slots[t->Expires % TCP_WHEEL_SLOTS];
+		t->Entry = slot.insert(slot.end(), t);
+		t->Armed = true;
+	}
+
+	void TimerWheel::Cancel(Timer *t)
+	{
+		if (!t->Armed)
+			return;
+
+		Slots[t->Expires % TCP_WHEEL_SLOTS].erase(t->Entry);
+		t->Armed = false;
+	}
+
+	Timer *TimerWheel::Expire(uint64_t Now)
+	{
+		while (true)
+		{
+			std::list<Timer *> &slot = Slots[Current % TCP_WHEEL_SLOTS];
+			for (auto it = slot.begin(); it != slot.end(); ++it)
+			{
+				Timer *t = *it;
+				if (t->Expires > Current)
+					continue;
+
+				slot.erase(it);
+				t->Armed = false;
+				return t;
+			}
+
+			if (Current >= Now)
+				return nullptr;
+			Current++;
+		}
+	}
+
+#pragma endregion Timers
+
+#pragma region Tables
+
+	static void Hash(Connection *c)
+	{
+		assert(!c->Hashed);
+		c->Get();
+		if (c->State == STATE_LISTEN)
+			ListenTable[PortHash(c->LocalPort)].push_back(c);
+		else
+			ConnectionBucket(c).push_back(c);
+		c->Hashed = true;
+	}
+
+	/**
+	 * Drop the table reference, the caller
+	 * must hold one of its own.
+	 */
+	static void Unhash(Connection *c)
+	{
+		if (!c->Hashed)
+			return;
+
+		if (c->State == STATE_LISTEN)
+			ListenTable[PortHash(c->LocalPort)].remove(c);
+		else
+			ConnectionBucket(c).remove(c);
+		c->Hashed = false;
+		c->Put();
+	}
+
+	static Connection *Lookup(uint32_t LocalAddress, uint16_t LocalPort,
+							  uint32_t RemoteAddress, uint16_t RemotePort)
+	{
+		uint64_t hash = TupleHash(HashSecret, LocalAddress, LocalPort,
+								  RemoteAddress, RemotePort);
+		for (Connection *c : ConnectionTable[hash & (TCP_CONN_HASH_SIZE - 1)])
+		{
+			if (c->LocalPort == LocalPort && c->RemotePort == RemotePort &&
+				c->LocalAddress == LocalAddress && c->RemoteAddress == RemoteAddress)
+				return c;
+		}
+
+		/* A listener bound to the address wins over a wildcard one */
+		Connection *wildcard = nullptr;
+		for (Connection *c : ListenTable[PortHash(LocalPort)])
+		{
+			if (c->LocalPort != LocalPort)
+				continue;
+			if (c->LocalAddress == LocalAddress)
+				return c;
+			if (c->LocalAddress == 0)
+				wildcard = c;
+		}
+		return wildcard;
+	}
+
+	static void AddBind(Connection *c)
+	{
+		BindTable[PortHash(c->LocalPort)].push_back(c);
+		c->Bound = true;
+	}
+
+	static void RemoveBind(Connection *c)
+	{
+		if (!c->Bound)
+			return;
+
+		BindTable[PortHash(c->LocalPort)].remove(c);
+		c->Bound = false;
+	}
+
+	static bool PortUsed(uint16_t Port)
+	{
+		for (Connection *o : BindTable[PortHash(Port)])
+		{
+			if (o->LocalPort == Port)
+				return true;
+		}
+		return false;
+	}
+
+	static bool BindConflict(Connection *c, uint32_t Address, uint16_t Port)
+	{
+		for (Connection *o : BindTable[PortHash(Port)])
+		{
+			if (o == c || o->LocalPort != Port)
+				continue;
+			if (o->LocalAddress != 0 && Address != 0 && o->LocalAddress != Address)
+				continue;
+
+			/* SO_REUSEADDR lets everything but listeners share the port */
+			if (c->ReuseAddress && o->ReuseAddress && o->State != STATE_LISTEN)
+				continue;
+			if (c->ReuseAddress && o->State == STATE_TIME_WAIT)
+				continue;
+			return true;
+		}
+		return false;
+	}
+
+	static uint16_t EphemeralPort()
+	{
+		const uint32_t count = TCP_EPHEMERAL_LAST - TCP_EPHEMERAL_FIRST + 1;
+		uint32_t start = Random::rand32() % count;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint16_t port = (uint16_t)(TCP_EPHEMERAL_FIRST + (start + i) % count);
+			if (!PortUsed(port))
+				return port;
+		}
+		return 0;
+	}
+
+	/**
+	 * Pick the interface used to reach Destination
+	 */
+	static TCP *Route(uint32_t Destination)
+	{
+		TCP *fallback = nullptr;
+		for (TCP *stack : Stacks)
+		{
+			uint32_t address = stack->GetAddress();
+			if (address == Destination)
+				return stack;
+			if ((Destination >> 24) == 127 && (address >> 24) == 127)
+				return stack;
+			if (!fallback && (address >> 24) != 127)
+				fallback = stack;
+		}
+
+		if (!fallback && !Stacks.empty())
+			fallback = Stacks.front();
+		return fallback;
+	}
+
+	static bool LocalAddress(uint32_t Address)
+	{
+		for (TCP *stack : Stacks)
+		{
+			uint32_t address = stack->GetAddress();
+			if (address == Address)
+				return true;
+			if ((Address >> 24) == 127 && (address >> 24) == 127)
+				return true;
+		}
+		return false;
+	}
+
+#pragma endregion Tables
+
+#pragma region Output
+
+	struct SegmentOptions
+	{
+		uint16_t MSS = 0;
+		int Scale = -1;
+		bool SackPermitted = false;
+		int SackCount = 0;
+		SequenceRange Sack[4];
+	};
+
+	struct Segment
+	{
+		TCP *Stack;
+		uint32_t Source;
+		uint32_t Destination;
+		uint16_t SourcePort;
+		uint16_t DestinationPort;
+		uint32_t Sequence;
+		uint32_t Ack;
+		uint8_t Flags;
+		uint16_t Window;
+		uint8_t *Payload;
+		size_t Length;
+		SegmentOptions Options;
+	};
+
+	static bool ChecksumOffload(TCP *Stack)
+	{
+		return Stack->GetInterface()->Features & NetworkInterfaceManager::FEATURE_TX_CHECKSUM;
+	}
+
+	/**
+	 * @param HeaderLength Bytes of header and options
+	 * @param PayloadSum Partial sum of the payload, taken while
+	 *                   copying it. Unused with checksum offload.
+	 */
+	static void QueueSegment(TCP *Stack, uint32_t Source, uint32_t Destination,
+							 NetworkPacket::Buffer *Packet, size_t HeaderLength,
+							 uint64_t PayloadSum)
+	{
+		TCPHeader *header = (TCPHeader *)Packet->Data;
+		header->Checksum = 0;
+
+		uint64_t sum = PseudoHeaderSum(Source, Destination, Packet->Length);
+		if (ChecksumOffload(Stack))
+		{
+			header->Checksum = ChecksumFold(sum);
+			Packet->Checksum = NetworkPacket::CHECKSUM_PARTIAL;
+			Packet->ChecksumStart = 0;
+			Packet->ChecksumOffset = offsetof(TCPHeader, Checksum);
+		}
+		else
+		{
+			sum = ChecksumPartial(Packet->Data, HeaderLength, sum);
+			header->Checksum = ChecksumFinish(ChecksumAdd(sum, PayloadSum, HeaderLength));
+		}
+
+		PendingSegments.push_back({Stack, Destination, Packet});
+	}
+
+	static size_t BuildOptions(Connection *c, uint8_t Flags, uint8_t *Options)
+	{
+		size_t n = 0;
+		if (Flags & FLAG_SYN)
+		{
+			uint16_t mss = c->Stack->GetMSS();
+			Options[n++] = OPTION_MSS;
+			Options[n++] = 4;
+			Options[n++] = (uint8_t)(mss >> 8);
+			Options[n++] = (uint8_t)mss;
+
+			if (c->WindowScaling)
+			{
+				Options[n++] = OPTION_NOP;
+				Options[n++] = OPTION_WINDOW_SCALE;
+				Options[n++] = 3;
+				Options[n++] = c->ReceiveScale;
+			}
+
+			if (c->SackPermitted)
+			{
+				Options[n++] = OPTION_NOP;
+				Options[n++] = OPTION_NOP;
+				Options[n++] = OPTION_SACK_PERMITTED;
+				Options[n++] = 2;
+			}
+			return n;
+		}
+
+		if (!c->SackPermitted || c->OutOfOrder.empty())
+			return n;
+
+		/* The block with the latest segment goes first (RFC 2018 4) */
+		SequenceRange blocks[4];
+		size_t count = 0;
+		for (auto &range : c->OutOfOrder)
+		{
+			if (SeqLE(range.Start, c->LastOutOfOrder) && SeqLT(c->LastOutOfOrder, range.End))
+			{
+				blocks[count++] = range;
+				break;
+			}
+		}
+
+		for (auto &range : c->OutOfOrder)
+		{
+			if (count == 4)
+				break;
+			if (count && range.Start == blocks[0].Start)
+				continue;
+			blocks[count++] = range;
+		}
+
+		Options[n++] = OPTION_NOP;
+		Options[n++] = OPTION_NOP;
+		Options[n++] = OPTION_SACK;
+		Options[n++] = (uint8_t)(2 + 8 * count);
+		for (size_t i = 0; i < count; i++)
+		{
+			Put32(Options + n, blocks[i].Start);
+			Put32(Options + n + 4, blocks[i].End);
+			n += 8;
+		}
+		return n;
+	}
+
+	static uint16_t AdvertiseWindow(Connection *c, bool Syn)
+	{
+		uint32_t window = (uint32_t)c->ReceiveBuffer.Free();
+
+		/* The window in a SYN is never scaled (RFC 7323 2.2) */
+		uint8_t scale = Syn ? 0 : c->ReceiveScale;
+		uint32_t field = std::min(window >> scale, (uint32_t)0xFFFF);
+		c->ReceiveAdvertised = c->ReceiveNext + (field << scale);
+		return (uint16_t)field;
+	}
+
+	/**
+	 * Queue a segment of the connection
+	 *
+	 * @param Offset Payload offset in the send buffer
+	 * @param Length Payload length
+	 */
+	static void Output(Connection *c, uint32_t Sequence, uint8_t Flags, size_t Offset, size_t Length)
+	{
+		uint8_t options[40];
+		size_t optionsLength = BuildOptions(c, Flags, options);
+		size_t headerLength = sizeof(TCPHeader) + ALIGN_UP(optionsLength, 4);
+		for (size_t i = optionsLength; i < headerLength - sizeof(TCPHeader); i++)
+			options[i] = OPTION_END;
+
+		NetworkPacket::Buffer *packet = NetworkPacket::Allocate(headerLength + Length);
+		if (unlikely(packet == nullptr))
+			return;
+
+		uint8_t *data = packet->Append(headerLength + Length);
+		TCPHeader *header = (TCPHeader *)data;
+		header->SourcePort = b16(c->LocalPort);
+		header->DestinationPort = b16(c->RemotePort);
+		header->SequenceNumber = b32(Sequence);
+		header->AcknowledgementNumber = (Flags & FLAG_ACK) ? b32(c->ReceiveNext) : 0;
+		header->Reserved = 0;
+		header->DataOffset = (uint8_t)(headerLength / 4);
+		header->Flags = Flags;
+		header->Window = b16(AdvertiseWindow(c, Flags & FLAG_SYN));
+		header->UrgentPointer = 0;
+		memcpy(data + sizeof(TCPHeader), options, headerLength - sizeof(TCPHeader));
+		/* The payload is summed while it is copied, unless the device does it */
+		uint64_t payloadSum = 0;
+		if (Length)
+			c->SendBuffer.Peek(Offset, data + headerLength, Length,
+							   ChecksumOffload(c->Stack) ? nullptr : &payloadSum);
+
+		QueueSegment(c->Stack, c->LocalAddress, c->RemoteAddress, packet, headerLength, payloadSum);
+
+		if (Flags & FLAG_ACK)
+		{
+			c->UnackedSegments = 0;
+			c->AckNow = false;
+			Wheel.Cancel(&c->DelayedAckTimer);
+		}
+	}
+
+	static void SendAck(Connection *c)
+	{
+		Output(c, c->SendNext, FLAG_ACK, 0, 0);
+	}
+
+	/**
+	 * Answer a segment that has no connection (RFC 9293 3.10.7.1)
+	 */
+	static void SendReset(Segment &s)
+	{
+		if (s.Flags & FLAG_RST)
+			return;
+
+		NetworkPacket::Buffer *packet = NetworkPacket::Allocate(sizeof(TCPHeader));
+		if (unlikely(packet == nullptr))
+			return;
+
+		TCPHeader *header = (TCPHeader *)packet->Append(sizeof(TCPHeader));
+		header->SourcePort = b16(s.DestinationPort);
+		header->DestinationPort = b16(s.SourcePort);
+		if (s.Flags & FLAG_ACK)
+		{
+			header->SequenceNumber = b32(s.Ack);
+			header->AcknowledgementNumber = 0;
+			header->Flags = FLAG_RST;
+		}
+		else
+		{
+			uint32_t length = (uint32_t)s.Length;
+			if (s.Flags & FLAG_SYN)
+				length++;
+			if (s.Flags & FLAG_FIN)
+				length++;
+			header->SequenceNumber = 0;
+			header->AcknowledgementNumber = b32(s.Sequence + length);
+			header->Flags = FLAG_RST | FLAG_ACK;
+		}
+		header->Reserved = 0;
+		header->DataOffset = sizeof(TCPHeader) / 4;
+		header->Window = 0;
+		header->UrgentPointer = 0;
+		QueueSegment(s.Stack, s.Destination, s.Source, packet, sizeof(TCPHeader), 0);
+	}
+
+	static uint32_t InFlight(Connection *c)
+	{
+		uint32_t outstanding = c->SendNext - c->SendUnacked;
+		return outstanding > c->SackedBytes ? outstanding - c->SackedBytes : 0;
+	}
+
+	static bool CanSend(Connection *c)
+	{
+		switch (c->State)
+		{
+		case STATE_ESTABLISHED:
+		case STATE_CLOSE_WAIT:
+		case STATE_FIN_WAIT_1:
+		case STATE_CLOSING:
+		case STATE_LAST_ACK:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static void ArmPersist(Connection *c)
+	{
+		if (c->PersistTimer.Armed)
+			return;
+
+		uint64_t timeout = std::min(c->RTO << c->PersistBackoff, (uint64_t)TCP_RTO_MAX);
+		Wheel.Schedule(&c->PersistTimer, UsToTicks(timeout));
+	}
+
+	/**
+	 * Send as much queued data as the send and
+	 * congestion windows allow.
+	 */
+	static void TryOutput(Connection *c)
+	{
+		if (!CanSend(c))
+			return;
+
+		while (true)
+		{
+			uint32_t dataEnd = c->SendUnacked + (uint32_t)c->SendBuffer.Used();
+			uint32_t window = std::min(c->SendWindow, c->CongestionWindow);
+			uint32_t flight = InFlight(c);
+			size_t available = SeqLT(c->SendNext, dataEnd) ? dataEnd - c->SendNext : 0;
+			size_t room = window > flight ? window - flight : 0;
+			size_t length = std::min(std::min(available, (size_t)c->SendMSS), room);
+			bool fin = c->FinQueued && c->SendNext + length == dataEnd;
+
+			if (length == 0 && !fin)
+			{
+				if (available && flight == 0)
+					ArmPersist(c);
+				break;
+			}
+
+			/* Nagle (RFC 9293 3.7.4) and sender side SWS avoidance */
+			if (!fin && length < c->SendMSS)
+			{
+				bool everything = length == available && (flight == 0 || c->NoDelay);
+				bool halfWindow = flight == 0 && length >= c->MaxSendWindow / 2;
+				if (!everything && !halfWindow)
+				{
+					if (flight == 0)
+						ArmPersist(c);
+					break;
+				}
+			}
+
+			uint8_t flags = FLAG_ACK;
+			if (length && length == available)
+				flags |= FLAG_PSH;
+			if (fin)
+				flags |= FLAG_FIN;
+
+			/* Karn: only time segments that are not retransmitted */
+			if (length && !c->RTTTiming && !SeqLT(c->SendNext, c->SendMax))
+			{
+				c->RTTTiming = true;
+				c->RTTSequence = c->SendNext;
+				c->RTTStart = NowUs();
+			}
+
+			Output(c, c->SendNext, flags, c->SendNext - c->SendUnacked, length);
+			c->SendNext += (uint32_t)length;
+			if (fin)
+			{
+				c->FinSent = true;
+				c->FinSequence = c->SendNext;
+				c->SendNext++;
+			}
+
+			if (SeqGT(c->SendNext, c->SendMax))
+				c->SendMax = c->SendNext;
+
+			if (!c->RetransmitTimer.Armed)
+				Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+			Wheel.Cancel(&c->PersistTimer);
+			c->PersistBackoff = 0;
+
+			if (fin)
+				break;
+		}
+	}
+
+	/**
+	 * Send output and any acknowledgement that is due,
+	 * or start the delayed ACK timer.
+	 */
+	static void Flush(Connection *c)
+	{
+		TryOutput(c);
+
+		if (c->AckNow)
+			SendAck(c);
+		else if (c->UnackedSegments && !c->DelayedAckTimer.Armed)
+			Wheel.Schedule(&c->DelayedAckTimer, UsToTicks(TCP_DELACK_MS * 1000));
+	}
+
+	/**
+	 * Retransmit one segment starting at Sequence, stopping
+	 * at the next block the receiver already has.
+	 */
+	static void Retransmit(Connection *c, uint32_t Sequence)
+	{
+		uint32_t dataEnd = c->SendUnacked + (uint32_t)c->SendBuffer.Used();
+		size_t length = 0;
+		if (SeqLT(Sequence, dataEnd))
+			length = std::min((size_t)(dataEnd - Sequence), (size_t)c->SendMSS);
+
+		for (auto &range : c->Scoreboard)
+		{
+			if (SeqGT(range.Start, Sequence) && SeqLT(range.Start, Sequence + (uint32_t)length))
+			{
+				length = range.Start - Sequence;
+				break;
+			}
+		}
+
+		uint8_t flags = FLAG_ACK;
+		if (c->FinSent && Sequence + length == c->FinSequence)
+			flags |= FLAG_FIN;
+		if (length == 0 && !(flags & FLAG_FIN))
+			return;
+
+		c->RTTTiming = false;
+		Output(c, Sequence, flags, Sequence - c->SendUnacked, length);
+		c->HighRetransmitted = Sequence + (uint32_t)length + ((flags & FLAG_FIN) ? 1 : 0);
+	}
+
+	/**
+	 * Find the first hole past HighRetransmitted that has
+	 * SACKed data above it (RFC 6675 NextSeg, rule 1)
+	 */
+	static bool NextHole(Connection *c, uint32_t &Sequence)
+	{
+		uint32_t seq = SeqGT(c->HighRetransmitted, c->SendUnacked) ? c->HighRetransmitted
+																   : c->SendUnacked;
+		for (auto &range : c->Scoreboard)
+		{
+			if (SeqLE(range.End, seq))
+				continue;
+			if (SeqLT(seq, range.Start))
+			{
+				Sequence = seq;
+				return true;
+			}
+			seq = range.End;
+		}
+		return false;
+	}
+
+#pragma endregion Output
+
+#pragma region State
+
+	static void Terminate(Connection *c)
+	{
+		Wheel.Cancel(&c->RetransmitTimer);
+		Wheel.Cancel(&c->DelayedAckTimer);
+		Wheel.Cancel(&c->PersistTimer);
+		Wheel.Cancel(&c->LingerTimer);
+
+		if (c->Parent)
+		{
+			c->Parent->Pending--;
+			c->Parent->Put();
+			c->Parent = nullptr;
+		}
+
+		RemoveBind(c);
+		Unhash(c);
+		c->State = STATE_CLOSED;
+		QueueWake(c, POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM | POLLHUP | POLLRDHUP | POLLERR);
+	}
+
+	/**
+	 * Reset the connection and forget it
+	 */
+	static void Abort(Connection *c)
+	{
+		switch (c->State)
+		{
+		case STATE_SYN_RECEIVED:
+		case STATE_ESTABLISHED:
+		case STATE_FIN_WAIT_1:
+		case STATE_FIN_WAIT_2:
+		case STATE_CLOSE_WAIT:
+			Output(c, c->SendNext, FLAG_RST | FLAG_ACK, 0, 0);
+			break;
+		default:
+			break;
+		}
+		Terminate(c);
+	}
+
+	static void EnterTimeWait(Connection *c)
+	{
+		c->State = STATE_TIME_WAIT;
+		Wheel.Cancel(&c->RetransmitTimer);
+		Wheel.Cancel(&c->PersistTimer);
+		Wheel.Schedule(&c->LingerTimer, UsToTicks(TCP_LINGER_MS * 1000ULL));
+		QueueWake(c, POLLIN | POLLRDNORM | POLLHUP);
+	}
+
+	static void SampleRTT(Connection *c, uint64_t Rtt)
+	{
+		if (c->SmoothedRTT == 0)
+		{
+			c->SmoothedRTT = Rtt;
+			c->RTTVariance = Rtt / 2;
+		}
+		else
+		{
+			uint64_t delta = c->SmoothedRTT > Rtt ? c->SmoothedRTT - Rtt : Rtt - c->SmoothedRTT;
+			c->RTTVariance = (3 * c->RTTVariance + delta) / 4;
+			c->SmoothedRTT = (7 * c->SmoothedRTT + Rtt) / 8;
+		}
+
+		uint64_t rto = c->SmoothedRTT + std::max((uint64_t)TCP_TICK_MS * 1000, 4 * c->RTTVariance);
+		c->RTO = std::min(std::max(rto, (uint64_t)TCP_RTO_MIN), (uint64_t)TCP_RTO_MAX);
+	}
+
+	static uint8_t ChooseScale(size_t Buffer)
+	{
+		uint8_t scale = 0;
+		while (scale < 14 && (Buffer >> scale) > 0xFFFF)
+			scale++;
+		return scale;
+	}
+
+	static void ApplySynOptions(Connection *c, SegmentOptions &Options)
+	{
+		uint16_t mss = Options.MSS ? Options.MSS : TCP_DEFAULT_MSS;
+		c->SendMSS = std::min(mss, c->Stack->GetMSS());
+
+		if (c->WindowScaling && Options.Scale >= 0)
+		{
+			c->SendScale = (uint8_t)Options.Scale;
+			c->ReceiveScale = ChooseScale(c->ReceiveBuffer.GetCapacity());
+		}
+		else
+		{
+			c->WindowScaling = false;
+			c->SendScale = 0;
+			c->ReceiveScale = 0;
+		}
+
+		c->SackPermitted = c->SackPermitted && Options.SackPermitted;
+	}
+
+	static void Establish(Connection *c)
+	{
+		c->State = STATE_ESTABLISHED;
+		c->WasConnected = true;
+		c->Retries = 0;
+		Wheel.Cancel(&c->RetransmitTimer);
+
+		/* Initial window (RFC 6928) */
+		uint32_t mss = c->SendMSS;
+		c->CongestionWindow = std::min(10 * mss, std::max(2 * mss, (uint32_t)14600));
+		c->Congestion->Initialize(c);
+
+		if (c->Parent)
+		{
+			Connection *listener = c->Parent;
+			listener->Pending--;
+			listener->AcceptQueue.push_back(c);
+			c->Get();
+			c->Parent = nullptr;
+			QueueWake(listener, POLLIN | POLLRDNORM);
+			listener->Put();
+		}
+		else
+			QueueWake(c, POLLOUT | POLLWRNORM);
+	}
+
+	static void EnterRecovery(Connection *c)
+	{
+		c->Congestion->OnLoss(c, false);
+		c->InRecovery = true;
+		c->RecoveryPoint = c->SendMax;
+		c->HighRetransmitted = c->SendUnacked;
+		c->CongestionWindow = c->SlowStartThreshold + 3 * c->SendMSS;
+		Retransmit(c, c->SendUnacked);
+		Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+	}
+
+	static void PruneScoreboard(Connection *c)
+	{
+		c->SackedBytes = 0;
+		for (auto it = c->Scoreboard.begin(); it != c->Scoreboard.end();)
+		{
+			if (SeqLE(it->End, c->SendUnacked))
+			{
+				it = c->Scoreboard.erase(it);
+				continue;
+			}
+
+			if (SeqLT(it->Start, c->SendUnacked))
+				it->Start = c->SendUnacked;
+			c->SackedBytes += it->End - it->Start;
+			++it;
+		}
+	}
+
+	static void UpdateScoreboard(Connection *c, SegmentOptions &Options)
+	{
+		for (int i = 0; i < Options.SackCount; i++)
+		{
+			SequenceRange range = Options.Sack[i];
+
+			/* Skip D-SACKs and blocks for data we never sent */
+			if (!SeqLT(range.Start, range.End) || SeqLE(range.End, c->SendUnacked) ||
+				SeqGT(range.End, c->SendMax))
+				continue;
+
+			if (SeqLT(range.Start, c->SendUnacked))
+				range.Start = c->SendUnacked;
+			InsertRange(c->Scoreboard, range);
+		}
+		PruneScoreboard(c);
+	}
+
+	/**
+	 * Process the acknowledgement field (RFC 9293 3.10.7.4, fifth check)
+	 *
+	 * @return false if the segment must be dropped
+	 */
+	static bool ProcessAck(Connection *c, Segment &s)
+	{
+		if (SeqGT(s.Ack, c->SendMax))
+		{
+			SendAck(c);
+			return false;
+		}
+
+		if (c->SackPermitted && s.Options.SackCount)
+			UpdateScoreboard(c, s.Options);
+
+		uint32_t window = (uint32_t)s.Window << c->SendScale;
+		if (SeqGT(s.Ack, c->SendUnacked))
+		{
+			uint32_t acked = s.Ack - c->SendUnacked;
+			uint32_t data = std::min(acked, (uint32_t)c->SendBuffer.Used());
+			c->SendBuffer.Consume(data);
+			c->SendUnacked = s.Ack;
+			if (SeqLT(c->SendNext, s.Ack))
+				c->SendNext = s.Ack;
+			PruneScoreboard(c);
+			c->Retries = 0;
+
+			if (c->RTTTiming && SeqGT(s.Ack, c->RTTSequence))
+			{
+				SampleRTT(c, NowUs() - c->RTTStart);
+				c->RTTTiming = false;
+			}
+
+			if (c->InRecovery)
+			{
+				if (SeqGE(s.Ack, c->RecoveryPoint))
+				{
+					/* Full acknowledgement, deflate the window (RFC 6582 3.2) */
+					uint32_t flight = std::max(InFlight(c), (uint32_t)c->SendMSS);
+					c->CongestionWindow = std::min(c->SlowStartThreshold, flight + c->SendMSS);
+					c->InRecovery = false;
+					c->DuplicateAcks = 0;
+				}
+				else
+				{
+					/* Partial acknowledgement, retransmit the next hole */
+					c->CongestionWindow = c->CongestionWindow > acked ? c->CongestionWindow - acked : c->SendMSS;
+					if (acked >= c->SendMSS)
+						c->CongestionWindow += c->SendMSS;
+
+					if (SeqLT(c->HighRetransmitted, s.Ack))
+						c->HighRetransmitted = s.Ack;
+
+					uint32_t hole;
+					if (c->SackPermitted && NextHole(c, hole))
+						Retransmit(c, hole);
+					else if (!c->SackPermitted)
+						Retransmit(c, s.Ack);
+				}
+			}
+			else
+			{
+				c->DuplicateAcks = 0;
+				if (data)
+					c->Congestion->OnAck(c, data);
+			}
+
+			/* RFC 6298 5.2 and 5.3 */
+			if (c->SendUnacked == c->SendMax)
+				Wheel.Cancel(&c->RetransmitTimer);
+			else
+				Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+
+			if (data)
+				QueueWake(c, POLLOUT | POLLWRNORM);
+		}
+		else if (s.Ack == c->SendUnacked && s.Length == 0 &&
+				 !(s.Flags & (FLAG_SYN | FLAG_FIN)) &&
+				 SeqLT(c->SendUnacked, c->SendMax) &&
+				 window == c->SendWindow)
+		{
+			/* Duplicate acknowledgement (RFC 5681 2) */
+			c->DuplicateAcks++;
+			if (c->InRecovery)
+			{
+				c->CongestionWindow += c->SendMSS;
+				uint32_t hole;
+				if (c->SackPermitted && NextHole(c, hole))
+					Retransmit(c, hole);
+			}
+			else if ((c->DuplicateAcks >= 3 ||
+					  (c->SackPermitted && c->SackedBytes >= 3u * c->SendMSS)) &&
+					 SeqGE(c->SendUnacked, c->RecoveryPoint))
+			{
+				EnterRecovery(c);
+			}
+		}
+
+		/* Window update */
+		if (SeqLT(c->SendWL1, s.Sequence) ||
+			(c->SendWL1 == s.Sequence && SeqLE(c->SendWL2, s.Ack)))
+		{
+			c->SendWindow = window;
+			c->SendWL1 = s.Sequence;
+			c->SendWL2 = s.Ack;
+			if (window > c->MaxSendWindow)
+				c->MaxSendWindow = window;
+			if (window)
+			{
+				Wheel.Cancel(&c->PersistTimer);
+				c->PersistBackoff = 0;
+			}
+		}
+		return true;
+	}
+
+	static void ReceiveData(Connection *c, Segment &s)
+	{
+		size_t offset = s.Sequence - c->ReceiveNext;
+		size_t n = c->ReceiveBuffer.WriteAt(offset, s.Payload, s.Length);
+		if (n == 0)
+			return;
+
+		if (offset != 0)
+		{
+			/* Out of order, send a duplicate ACK right away (RFC 5681 4.2) */
+			InsertRange(c->OutOfOrder, {s.Sequence, s.Sequence + (uint32_t)n});
+			c->LastOutOfOrder = s.Sequence;
+			c->AckNow = true;
+			return;
+		}
+
+		c->ReceiveBuffer.Commit(n);
+		c->ReceiveNext += (uint32_t)n;
+
+		/* Pull in the out-of-order data that is contiguous now */
+		bool filled = false;
+		while (!c->OutOfOrder.empty() && SeqLE(c->OutOfOrder.front().Start, c->ReceiveNext))
+		{
+			SequenceRange range = c->OutOfOrder.front();
+			c->OutOfOrder.pop_front();
+			if (SeqGT(range.End, c->ReceiveNext))
+			{
+				uint32_t more = range.End - c->ReceiveNext;
+				c->ReceiveBuffer.Commit(more);
+				c->ReceiveNext += more;
+			}
+			filled = true;
+		}
+
+		c->UnackedSegments++;
+		if (filled || !c->OutOfOrder.empty() || c->UnackedSegments >= 2)
+			c->AckNow = true;
+
+		QueueWake(c, POLLIN | POLLRDNORM);
+	}
+
+	static void InputListen(Connection *l, Segment &s)
+	{
+		if (s.Flags & FLAG_RST)
+			return;
+
+		if (s.Flags & FLAG_ACK)
+		{
+			SendReset(s);
+			return;
+		}
+
+		if (!(s.Flags & FLAG_SYN))
+			return;
+
+		if (l->Pending + (int)l->AcceptQueue.size() >= l->Backlog)
+		{
+			netdbg("Backlog of port %d is full", l->LocalPort);
+			return;
+		}
+
+		Connection *c = new Connection;
+		c->Stack = s.Stack;
+		c->LocalAddress = s.Destination;
+		c->LocalPort = s.DestinationPort;
+		c->RemoteAddress = s.Source;
+		c->RemotePort = s.SourcePort;
+		c->ReuseAddress = l->ReuseAddress;
+		c->NoDelay = l->NoDelay;
+		c->Congestion = l->Congestion;
+
+		c->InitialReceive = s.Sequence;
+		c->ReceiveNext = s.Sequence + 1;
+		ApplySynOptions(c, s.Options);
+
+		c->InitialSend = InitialSequence(c);
+		c->SendUnacked = c->InitialSend;
+		c->SendNext = c->InitialSend + 1;
+		c->SendMax = c->SendNext;
+		c->RecoveryPoint = c->InitialSend;
+		c->SendWindow = s.Window;
+		c->MaxSendWindow = s.Window;
+		c->SendWL1 = s.Sequence;
+		c->SendWL2 = c->InitialSend;
+		c->State = STATE_SYN_RECEIVED;
+
+		c->Parent = l;
+		l->Get();
+		l->Pending++;
+
+		Hash(c);
+		AddBind(c);
+
+		Output(c, c->InitialSend, FLAG_SYN | FLAG_ACK, 0, 0);
+		Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+		c->Put();
+	}
+
+	static void InputSynSent(Connection *c, Segment &s)
+	{
+		if ((s.Flags & FLAG_ACK) &&
+			(SeqLE(s.Ack, c->InitialSend) || SeqGT(s.Ack, c->SendNext)))
+		{
+			SendReset(s);
+			return;
+		}
+
+		if (s.Flags & FLAG_RST)
+		{
+			if (s.Flags & FLAG_ACK)
+			{
+				c->Error = ECONNREFUSED;
+				Terminate(c);
+			}
+			return;
+		}
+
+		if (!(s.Flags & FLAG_SYN))
+			return;
+
+		c->InitialReceive = s.Sequence;
+		c->ReceiveNext = s.Sequence + 1;
+		ApplySynOptions(c, s.Options);
+
+		if (!(s.Flags & FLAG_ACK))
+		{
+			/* Simultaneous open */
+			c->State = STATE_SYN_RECEIVED;
+			Output(c, c->InitialSend, FLAG_SYN | FLAG_ACK, 0, 0);
+			return;
+		}
+
+		c->SendUnacked = s.Ack;
+		if (c->RTTTiming)
+		{
+			SampleRTT(c, NowUs() - c->RTTStart);
+			c->RTTTiming = false;
+		}
+
+		c->SendWindow = s.Window;
+		c->MaxSendWindow = s.Window;
+		c->SendWL1 = s.Sequence;
+		c->SendWL2 = s.Ack;
+		Establish(c);
+
+		c->AckNow = true;
+		Flush(c);
+	}
+
+	static void Input(Connection *c, Segment &s)
+	{
+		switch (c->State)
+		{
+		case STATE_CLOSED:
+			SendReset(s);
+			return;
+		case STATE_LISTEN:
+			InputListen(c, s);
+			return;
+		case STATE_SYN_SENT:
+			InputSynSent(c, s);
+			return;
+		default:
+			break;
+		}
+
+		/* First check, sequence number */
+		uint32_t window = (uint32_t)c->ReceiveBuffer.Free();
+		uint32_t length = (uint32_t)s.Length;
+		if (s.Flags & FLAG_SYN)
+			length++;
+		if (s.Flags & FLAG_FIN)
+			length++;
+
+		auto inWindow = [c, window](uint32_t Sequence)
+		{
+			return SeqGE(Sequence, c->ReceiveNext) && SeqLT(Sequence, c->ReceiveNext + window);
+		};
+
+		bool acceptable;
+		if (window == 0)
+		{
+			/* Still take ACKs and RSTs, the data is trimmed below */
+			acceptable = s.Sequence == c->ReceiveNext;
+		}
+		else if (length == 0)
+			acceptable = inWindow(s.Sequence);
+		else
+			acceptable = inWindow(s.Sequence) || inWindow(s.Sequence + length - 1);
+
+		if (!acceptable)
+		{
+			if (!(s.Flags & FLAG_RST))
+				SendAck(c);
+			return;
+		}
+
+		if (SeqLT(s.Sequence, c->ReceiveNext))
+		{
+			uint32_t skip = c->ReceiveNext - s.Sequence;
+			if (s.Flags & FLAG_SYN)
+			{
+				s.Flags &= ~FLAG_SYN;
+				s.Sequence++;
+				skip--;
+			}
+
+			skip = std::min(skip, (uint32_t)s.Length);
+			s.Payload += skip;
+			s.Length -= skip;
+			s.Sequence += skip;
+		}
+
+		uint32_t rightEdge = c->ReceiveNext + window;
+		if (SeqGT(s.Sequence + (uint32_t)s.Length, rightEdge))
+		{
+			s.Length = SeqGT(rightEdge, s.Sequence) ? rightEdge - s.Sequence : 0;
+			s.Flags &= ~FLAG_FIN;
+		}
+
+		/* Second check, RST (RFC 5961 3.2) */
+		if (s.Flags & FLAG_RST)
+		{
+			if (s.Sequence != c->ReceiveNext)
+			{
+				SendAck(c);
+				return;
+			}
+
+			switch (c->State)
+			{
+			case STATE_SYN_RECEIVED:
+				if (!c->Parent)
+					c->Error = ECONNREFUSED;
+				break;
+			case STATE_ESTABLISHED:
+			case STATE_FIN_WAIT_1:
+			case STATE_FIN_WAIT_2:
+			case STATE_CLOSE_WAIT:
+				c->Error = ECONNRESET;
+				break;
+			default:
+				break;
+			}
+			Terminate(c);
+			return;
+		}
+
+		/* Fourth check, SYN in a synchronized state (RFC 5961 4.2) */
+		if (s.Flags & FLAG_SYN)
+		{
+			SendAck(c);
+			return;
+		}
+
+		/* Fifth check, ACK */
+		if (!(s.Flags & FLAG_ACK))
+			return;
+
+		if (c->State == STATE_SYN_RECEIVED)
+		{
+			if (SeqLE(s.Ack, c->SendUnacked) || SeqGT(s.Ack, c->SendNext))
+			{
+				SendReset(s);
+				return;
+			}
+
+			c->SendWindow = (uint32_t)s.Window << c->SendScale;
+			c->MaxSendWindow = c->SendWindow;
+			c->SendWL1 = s.Sequence;
+			c->SendWL2 = s.Ack;
+			Establish(c);
+		}
+
+		if (!ProcessAck(c, s))
+			return;
+
+		bool finAcked = c->FinSent && SeqGT(c->SendUnacked, c->FinSequence);
+		switch (c->State)
+		{
+		case STATE_FIN_WAIT_1:
+			if (finAcked)
+			{
+				c->State = STATE_FIN_WAIT_2;
+				if (c->Orphaned)
+					Wheel.Schedule(&c->LingerTimer, UsToTicks(TCP_LINGER_MS * 1000ULL));
+			}
+			break;
+		case STATE_CLOSING:
+			if (finAcked)
+				EnterTimeWait(c);
+			break;
+		case STATE_LAST_ACK:
+			if (finAcked)
+			{
+				Terminate(c);
+				return;
+			}
+			break;
+		case STATE_TIME_WAIT:
+			if (s.Flags & FLAG_FIN)
+			{
+				SendAck(c);
+				Wheel.Schedule(&c->LingerTimer, UsToTicks(TCP_LINGER_MS * 1000ULL));
+			}
+			return;
+		default:
+			break;
+		}
+
+		/* Seventh, segment text */
+		if (s.Length)
+		{
+			switch (c->State)
+			{
+			case STATE_ESTABLISHED:
+			case STATE_FIN_WAIT_1:
+			case STATE_FIN_WAIT_2:
+				/* Nobody will read it (RFC 2525 2.17) */
+				if (c->Orphaned)
+				{
+					Abort(c);
+					return;
+				}
+				ReceiveData(c, s);
+				break;
+			default:
+				break;
+			}
+		}
+
+		/* Eighth, FIN. Only taken in order, the peer retransmits it otherwise. */
+		if ((s.Flags & FLAG_FIN) && s.Sequence + (uint32_t)s.Length == c->ReceiveNext)
+		{
+			c->ReceiveNext++;
+			c->FinReceived = true;
+			c->AckNow = true;
+			QueueWake(c, POLLIN | POLLRDNORM | POLLRDHUP);
+
+			switch (c->State)
+			{
+			case STATE_SYN_RECEIVED:
+			case STATE_ESTABLISHED:
+				c->State = STATE_CLOSE_WAIT;
+				break;
+			case STATE_FIN_WAIT_1:
+				c->State = STATE_CLOSING;
+				break;
+			case STATE_FIN_WAIT_2:
+				SendAck(c);
+				EnterTimeWait(c);
+				return;
+			default:
+				break;
+			}
+		}
+
+		Flush(c);
+	}
+
+#pragma endregion State
+
+#pragma region Timer Callbacks
+
+	static void RetransmitTimeout(Timer *t)
+	{
+		Connection *c = (Connection *)t->Private;
+		bool syn = c->State == STATE_SYN_SENT || c->State == STATE_SYN_RECEIVED;
+		if (++c->Retries > (syn ? TCP_SYN_RETRIES : TCP_DATA_RETRIES))
+		{
+			netdbg("Connection to port %d timed out", c->RemotePort);
+			c->Error = ETIMEDOUT;
+			Abort(c);
+			return;
+		}
+
+		/* Back off the timer (RFC 6298 5.5) */
+		c->RTO = std::min(c->RTO * 2, (uint64_t)TCP_RTO_MAX);
+		c->RTTTiming = false;
+
+		switch (c->State)
+		{
+		case STATE_SYN_SENT:
+			Output(c, c->InitialSend, FLAG_SYN, 0, 0);
+			break;
+		case STATE_SYN_RECEIVED:
+			Output(c, c->InitialSend, FLAG_SYN | FLAG_ACK, 0, 0);
+			break;
+		default:
+			if (!CanSend(c) || c->SendUnacked == c->SendMax)
+				return;
+
+			/* Loss window of one segment and go back to SND.UNA (RFC 5681 3.1) */
+			c->Congestion->OnLoss(c, true);
+			c->CongestionWindow = c->SendMSS;
+			c->InRecovery = false;
+			c->DuplicateAcks = 0;
+			c->RecoveryPoint = c->SendMax;
+
+			/* The receiver may have reneged on SACKed data (RFC 2018 8) */
+			c->Scoreboard.clear();
+			c->SackedBytes = 0;
+			c->SendNext = c->SendUnacked;
+			TryOutput(c);
+			break;
+		}
+
+		Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+	}
+
+	static void DelayedAckTimeout(Timer *t)
+	{
+		Connection *c = (Connection *)t->Private;
+		if (c->UnackedSegments || c->AckNow)
+			SendAck(c);
+	}
+
+	static void PersistTimeout(Timer *t)
+	{
+		Connection *c = (Connection *)t->Private;
+		if (!CanSend(c) || c->SendWindow >= c->SendMSS)
+		{
+			TryOutput(c);
+			return;
+		}
+
+		/* A segment below the window makes the peer send its window */
+		Output(c, c->SendUnacked - 1, FLAG_ACK, 0, 0);
+		if (c->PersistBackoff < 16)
+			c->PersistBackoff++;
+		ArmPersist(c);
+	}
+
+	static void LingerTimeout(Timer *t)
+	{
+		Connection *c = (Connection *)t->Private;
+		Terminate(c);
+	}
+
+	static void TimerLoop()
+	{
+		while (true)
+		{
+			TaskManager->Sleep(Time::FromMilliseconds(TCP_TICK_MS));
+			uint64_t now = TimeManager->GetTimeNs() / (TCP_TICK_MS * 1000000ULL);
+
+			LockStack();
+			Timer *t;
+			while ((t = Wheel.Expire(now)) != nullptr)
+			{
+				Connection *c = (Connection *)t->Private;
+				c->Get();
+				t->Callback(t);
+				c->Put();
+			}
+			UnlockStack();
+		}
+	}
+
+#pragma endregion Timer Callbacks
+
+#pragma region Connection
+
+	Connection::Connection()
+		: SendBuffer(TCP_SEND_BUFFER),
+		  ReceiveBuffer(TCP_RECEIVE_BUFFER)
+	{
+		RTO = TCP_RTO_INITIAL;
+		ReceiveScale = ChooseScale(ReceiveBuffer.GetCapacity());
+		Congestion = GetDefaultCongestionControl();
+
+		RetransmitTimer.Callback = RetransmitTimeout;
+		DelayedAckTimer.Callback = DelayedAckTimeout;
+		PersistTimer.Callback = PersistTimeout;
+		LingerTimer.Callback = LingerTimeout;
+		RetransmitTimer.Private = this;
+		DelayedAckTimer.Private = this;
+		PersistTimer.Private = this;
+		LingerTimer.Private = this;
+	}
+
+	Connection::~Connection()
+	{
+		assert(!Hashed && !Bound);
+		assert(!RetransmitTimer.Armed && !DelayedAckTimer.Armed &&
+			   !PersistTimer.Armed && !LingerTimer.Armed);
+	}
+
+	void Connection::Put()
+	{
+		if (--References == 0)
+			delete this;
+	}
+
+#pragma endregion Connection
+
+#pragma region Socket
+
+	/**
+	 * Wait until Ready() is true. Called and
+	 * returns with the stack locked.
+	 */
+	template <typename F>
+	static int Wait(Connection *c, F Ready, bool NonBlock)
+	{
+		if (Ready())
+			return 0;
+
+		if (NonBlock)
+			return -EAGAIN;
+
+		vfs::PollWaiter waiter;
+		UnlockStack();
+		waiter.Table.Wait(c->Queue);
+
+		while (true)
+		{
+			waiter.Arm();
+			LockStack();
+			if (Ready())
+				return 0;
+			UnlockStack();
+
+			if (waiter.Sleep(0) == -EINTR)
+			{
+				LockStack();
+				return -EINTR;
+			}
+		}
+	}
+
+	static bool Synchronizing(Connection *c)
+	{
+		return c->State == STATE_SYN_SENT || c->State == STATE_SYN_RECEIVED;
+	}
+
+	/**
+	 * Send a window update once the application
+	 * freed a worthwhile part of the buffer
+	 */
+	static void WindowUpdate(Connection *c)
+	{
+		if (c->State != STATE_ESTABLISHED && c->State != STATE_FIN_WAIT_1 &&
+			c->State != STATE_FIN_WAIT_2)
+			return;
+
+		uint32_t edge = c->ReceiveNext + (uint32_t)c->ReceiveBuffer.Free();
+		if (!SeqGT(edge, c->ReceiveAdvertised))
+			return;
+
+		uint32_t opened = edge - c->ReceiveAdvertised;
+		if (opened >= 2u * c->Stack->GetMSS() || opened >= c->ReceiveBuffer.GetCapacity() / 2)
+			SendAck(c);
+	}
+
+	static void CloseWrite(Connection *c)
+	{
+		if (c->FinQueued)
+			return;
+
+		switch (c->State)
+		{
+		case STATE_SYN_RECEIVED:
+		case STATE_ESTABLISHED:
+			c->State = STATE_FIN_WAIT_1;
+			break;
+		case STATE_CLOSE_WAIT:
+			c->State = STATE_LAST_ACK;
+			break;
+		default:
+			return;
+		}
+
+		c->FinQueued = true;
+		TryOutput(c);
+		QueueWake(c, POLLOUT | POLLWRNORM);
+	}
+
+	static void CloseListener(Connection *l)
+	{
+		std::vector<Connection *> children;
+		for (Connection *child : l->AcceptQueue)
+			children.push_back(child);
+		l->AcceptQueue.clear();
+
+		for (auto &bucket : ConnectionTable)
+		{
+			for (Connection *c : bucket)
+			{
+				if (c->Parent == l)
+				{
+					c->Get();
+					children.push_back(c);
+				}
+			}
+		}
+
+		/* Each child holds a reference taken above or by the accept queue */
+		for (Connection *child : children)
+		{
+			Abort(child);
+			child->Put();
+		}
+	}
+
+	class TCPSocket : public Socket
+	{
+	private:
+		Connection *Conn;
+
+	public:
+		int Bind(const SocketAddress &Address)
+		{
+			Connection *c = Conn;
+			int ret = 0;
+
+			LockStack();
+			if (c->Bound || c->State != STATE_CLOSED)
+				ret = -EINVAL;
+			else if (Address.Address != 0 && !LocalAddress(Address.Address))
+				ret = -EADDRNOTAVAIL;
+			else
+			{
+				uint16_t port = Address.Port;
+				if (port == 0)
+					port = EphemeralPort();
+
+				if (port == 0 || BindConflict(c, Address.Address, port))
+					ret = -EADDRINUSE;
+				else
+				{
+					c->LocalAddress = Address.Address;
+					c->LocalPort = port;
+					AddBind(c);
+				}
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int Connect(const SocketAddress &Address, bool NonBlock)
+		{
+			Connection *c = Conn;
+			int ret = 0;
+
+			LockStack();
+			if (c->State == STATE_LISTEN)
+				ret = -EINVAL;
+			else if (Synchronizing(c))
+				ret = -EALREADY;
+			else if (c->State != STATE_CLOSED || c->WasConnected)
+				ret = -EISCONN;
+			else if (Address.Port == 0)
+				ret = -ECONNREFUSED;
+
+			TCP *stack = ret == 0 ? Route(Address.Address) : nullptr;
+			if (ret == 0 && !stack)
+				ret = -ENETUNREACH;
+
+			if (ret == 0)
+			{
+				c->Stack = stack;
+				if (c->LocalAddress == 0)
+					c->LocalAddress = stack->GetAddress();
+
+				if (!c->Bound)
+				{
+					c->LocalPort = EphemeralPort();
+					if (c->LocalPort == 0)
+						ret = -EADDRNOTAVAIL;
+					else
+						AddBind(c);
+				}
+			}
+
+			if (ret == 0)
+			{
+				c->RemoteAddress = Address.Address;
+				c->RemotePort = Address.Port;
+				Connection *other = Lookup(c->LocalAddress, c->LocalPort,
+										   c->RemoteAddress, c->RemotePort);
+				if (other && other->State != STATE_LISTEN)
+					ret = -EADDRINUSE;
+			}
+
+			if (ret == 0)
+			{
+				c->Error = 0;
+				c->Retries = 0;
+				c->RTO = TCP_RTO_INITIAL;
+				c->InitialSend = InitialSequence(c);
+				c->SendUnacked = c->InitialSend;
+				c->SendNext = c->InitialSend + 1;
+				c->SendMax = c->SendNext;
+				c->RecoveryPoint = c->InitialSend;
+				c->State = STATE_SYN_SENT;
+				Hash(c);
+
+				c->RTTTiming = true;
+				c->RTTSequence = c->InitialSend;
+				c->RTTStart = NowUs();
+				Output(c, c->InitialSend, FLAG_SYN, 0, 0);
+				Wheel.Schedule(&c->RetransmitTimer, UsToTicks(c->RTO));
+
+				if (NonBlock)
+					ret = -EINPROGRESS;
+				else
+				{
+					ret = Wait(c, [c]
+							   { return !Synchronizing(c); }, false);
+					if (ret == 0 && c->State == STATE_CLOSED)
+					{
+						ret = -(c->Error ? c->Error : ECONNREFUSED);
+						c->Error = 0;
+					}
+				}
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int Listen(int Backlog)
+		{
+			Connection *c = Conn;
+			int ret = 0;
+			Backlog = std::min(std::max(Backlog, 1), TCP_MAX_BACKLOG);
+
+			LockStack();
+			if (c->State == STATE_LISTEN)
+				c->Backlog = Backlog;
+			else if (c->State != STATE_CLOSED || c->WasConnected)
+				ret = -EINVAL;
+			else
+			{
+				if (!c->Bound)
+				{
+					c->LocalPort = EphemeralPort();
+					if (c->LocalPort == 0)
+						ret = -EADDRINUSE;
+					else
+						AddBind(c);
+				}
+				else
+				{
+					/* SO_REUSEADDR doesn't allow two listeners */
+					for (Connection *o : ListenTable[PortHash(c->LocalPort)])
+					{
+						if (o->LocalPort == c->LocalPort &&
+							(o->LocalAddress == 0 || c->LocalAddress == 0 ||
+							 o->LocalAddress == c->LocalAddress))
+							ret = -EADDRINUSE;
+					}
+				}
+
+				if (ret == 0)
+				{
+					c->Backlog = Backlog;
+					c->State = STATE_LISTEN;
+					Hash(c);
+				}
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int Accept(Socket **Result, SocketAddress *Peer, bool NonBlock)
+		{
+			Connection *c = Conn;
+			LockStack();
+			if (c->State != STATE_LISTEN)
+			{
+				UnlockStack();
+				return -EINVAL;
+			}
+
+			int ret = Wait(c, [c]
+						   { return !c->AcceptQueue.empty() || c->State != STATE_LISTEN; },
+						   NonBlock);
+			if (ret == 0 && c->State != STATE_LISTEN)
+				ret = -EINVAL;
+
+			if (ret == 0)
+			{
+				/* The accept queue reference goes to the socket */
+				Connection *child = c->AcceptQueue.front();
+				c->AcceptQueue.pop_front();
+				if (Peer)
+				{
+					Peer->Address = child->RemoteAddress;
+					Peer->Port = child->RemotePort;
+				}
+				*Result = new TCPSocket(child);
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		ssize_t Send(const void *Buffer, size_t Length, int Flags, bool NonBlock)
+		{
+			Connection *c = Conn;
+			const uint8_t *src = (const uint8_t *)Buffer;
+			NonBlock = NonBlock || (Flags & MESSAGE_DONTWAIT);
+			size_t done = 0;
+			ssize_t ret = 0;
+			bool broken = false;
+
+			LockStack();
+			while (true)
+			{
+				if (c->Error)
+				{
+					ret = -c->Error;
+					c->Error = 0;
+					break;
+				}
+
+				if (Synchronizing(c))
+				{
+					ret = Wait(c, [c]
+							   { return !Synchronizing(c); }, NonBlock);
+					if (ret < 0)
+						break;
+					continue;
+				}
+
+				if ((c->State != STATE_ESTABLISHED && c->State != STATE_CLOSE_WAIT) || c->FinQueued)
+				{
+					if (c->State == STATE_CLOSED && !c->WasConnected)
+						ret = -ENOTCONN;
+					else
+					{
+						ret = -EPIPE;
+						broken = true;
+					}
+					break;
+				}
+
+				if (done == Length)
+					break;
+
+				size_t n = c->SendBuffer.Write(src + done, Length - done);
+				done += n;
+				if (n)
+					TryOutput(c);
+				if (done == Length)
+					break;
+
+				size_t want = std::min(Length - done, c->SendBuffer.GetCapacity() / 4);
+				ret = Wait(c, [c, want]
+						   { return c->SendBuffer.Free() >= want || c->Error ||
+									(c->State != STATE_ESTABLISHED && c->State != STATE_CLOSE_WAIT); },
+						   NonBlock);
+				if (ret < 0)
+					break;
+			}
+			UnlockStack();
+
+			if (done)
+				return done;
+
+			if (broken && !(Flags & MESSAGE_NOSIGNAL))
+				thisProcess->SendSignal(SIGPIPE);
+			return ret;
+		}
+
+		ssize_t Receive(void *Buffer, size_t Length, int Flags, bool NonBlock)
+		{
+			Connection *c = Conn;
+			uint8_t *dst = (uint8_t *)Buffer;
+			NonBlock = NonBlock || (Flags & MESSAGE_DONTWAIT);
+			bool peek = Flags & MESSAGE_PEEK;
+			bool all = (Flags & MESSAGE_WAITALL) && !peek && !NonBlock;
+			size_t done = 0;
+			ssize_t ret = 0;
+
+			LockStack();
+			if (c->State == STATE_LISTEN || (c->State == STATE_CLOSED && !c->WasConnected && !c->Error))
+			{
+				UnlockStack();
+				return -ENOTCONN;
+			}
+
+			while (done < Length)
+			{
+				size_t available = c->ReceiveBuffer.Used();
+				if (available && !c->ReadShutdown)
+				{
+					size_t n = c->ReceiveBuffer.Peek(0, dst + done, Length - done);
+					done += n;
+					if (!peek)
+					{
+						c->ReceiveBuffer.Consume(n);
+						WindowUpdate(c);
+					}
+
+					if (!all)
+						break;
+					continue;
+				}
+
+				if (c->Error)
+				{
+					if (!done)
+						ret = -c->Error;
+					c->Error = 0;
+					break;
+				}
+
+				if (c->FinReceived || c->ReadShutdown || c->State == STATE_CLOSED)
+					break;
+
+				ret = Wait(c, [c]
+						   { return c->ReceiveBuffer.Used() || c->FinReceived || c->Error ||
+									c->ReadShutdown || c->State == STATE_CLOSED; },
+						   NonBlock);
+				if (ret < 0)
+					break;
+			}
+			UnlockStack();
+			return done ? (ssize_t)done : ret;
+		}
+
+		int Shutdown(int How)
+		{
+			Connection *c = Conn;
+			int ret = 0;
+
+			LockStack();
+			if (c->State == STATE_CLOSED || c->State == STATE_LISTEN || c->State == STATE_SYN_SENT)
+				ret = -ENOTCONN;
+			else
+			{
+				if (How & SHUTDOWN_READ)
+				{
+					c->ReadShutdown = true;
+					QueueWake(c, POLLIN | POLLRDNORM);
+				}
+
+				if (How & SHUTDOWN_WRITE)
+					CloseWrite(c);
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int GetName(SocketAddress *Address)
+		{
+			LockStack();
+			Address->Address = Conn->LocalAddress;
+			Address->Port = Conn->LocalPort;
+			UnlockStack();
+			return 0;
+		}
+
+		int GetPeerName(SocketAddress *Address)
+		{
+			Connection *c = Conn;
+			int ret = 0;
+
+			LockStack();
+			if (c->State == STATE_CLOSED || c->State == STATE_LISTEN || c->State == STATE_SYN_SENT)
+				ret = -ENOTCONN;
+			else
+			{
+				Address->Address = c->RemoteAddress;
+				Address->Port = c->RemotePort;
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int SetOption(int Option, const void *Value, size_t Length)
+		{
+			Connection *c = Conn;
+			if (Option == OPTION_CONGESTION)
+			{
+				char name[16] = {};
+				memcpy(name, Value, std::min(Length, sizeof(name) - 1));
+				CongestionControl *cc = GetCongestionControl(name);
+				if (!cc)
+					return -ENOENT;
+
+				LockStack();
+				c->Congestion = cc;
+				if (c->State != STATE_CLOSED && c->State != STATE_LISTEN && !Synchronizing(c))
+					cc->Initialize(c);
+				UnlockStack();
+				return 0;
+			}
+
+			if (Length < sizeof(int))
+				return -EINVAL;
+			int value = *(const int *)Value;
+
+			int ret = 0;
+			LockStack();
+			switch (Option)
+			{
+			case OPTION_REUSEADDR:
+				c->ReuseAddress = value != 0;
+				break;
+			case OPTION_NODELAY:
+				c->NoDelay = value != 0;
+				if (c->NoDelay)
+					TryOutput(c);
+				break;
+			case OPTION_KEEPALIVE:
+			case OPTION_SNDBUF:
+			case OPTION_RCVBUF:
+			case OPTION_MAXSEG:
+				/* Accepted, the buffers and segment size are fixed */
+				break;
+			default:
+				ret = -ENOPROTOOPT;
+				break;
+			}
+			UnlockStack();
+			return ret;
+		}
+
+		int GetOption(int Option, void *Value, size_t *Length)
+		{
+			Connection *c = Conn;
+			if (Option == OPTION_CONGESTION)
+			{
+				const char *name = c->Congestion->Name;
+				size_t n = std::min(*Length, strlen(name) + 1);
+				memcpy(Value, name, n);
+				*Length = n;
+				return 0;
+			}
+
+			if (*Length < sizeof(int))
+				return -EINVAL;
+
+			int value = 0;
+			int ret = 0;
+			LockStack();
+			switch (Option)
+			{
+			case OPTION_REUSEADDR:
+				value = c->ReuseAddress;
+				break;
+			case OPTION_KEEPALIVE:
+				value = 0;
+				break;
+			case OPTION_ERROR:
+				value = c->Error;
+				c->Error = 0;
+				break;
+			case OPTION_TYPE:
+				value = TYPE_STREAM;
+				break;
+			case OPTION_ACCEPTCONN:
+				value = c->State == STATE_LISTEN;
+				break;
+			case OPTION_SNDBUF:
+				value = (int)c->SendBuffer.GetCapacity();
+				break;
+			case OPTION_RCVBUF:
+				value = (int)c->ReceiveBuffer.GetCapacity();
+				break;
+			case OPTION_NODELAY:
+				value = c->NoDelay;
+				break;
+			case OPTION_MAXSEG:
+				value = c->SendMSS;
+				break;
+			default:
+				ret = -ENOPROTOOPT;
+				break;
+			}
+			UnlockStack();
+
+			if (ret == 0)
+			{
+				*(int *)Value = value;
+				*Length = sizeof(int);
+			}
+			return ret;
+		}
+
+		int Poll(PollTable *Table)
+		{
+			Connection *c = Conn;
+			PollWait(Table, c->Queue);
+
+			int events = 0;
+			LockStack();
+			if (c->State == STATE_LISTEN)
+			{
+				if (!c->AcceptQueue.empty())
+					events |= POLLIN | POLLRDNORM;
+			}
+			else
+			{
+				if (c->ReceiveBuffer.Used() || c->FinReceived || c->ReadShutdown)
+					events |= POLLIN | POLLRDNORM;
+				if (c->FinReceived)
+					events |= POLLRDHUP;
+				if ((c->State == STATE_ESTABLISHED || c->State == STATE_CLOSE_WAIT) && !c->FinQueued &&
+					c->SendBuffer.Free() >= c->SendBuffer.GetCapacity() / 4)
+					events |= POLLOUT | POLLWRNORM;
+				if (c->Error)
+					events |= POLLERR;
+				if (c->State == STATE_CLOSED)
+				{
+					events |= POLLHUP;
+					if (c->WasConnected || c->Error)
+						events |= POLLIN | POLLRDNORM;
+				}
+			}
+			UnlockStack();
+			return events;
+		}
+
+		void Release()
+		{
+			Connection *c = Conn;
+			LockStack();
+			c->Orphaned = true;
+			switch (c->State)
+			{
+			case STATE_LISTEN:
+				CloseListener(c);
+				Terminate(c);
+				break;
+			case STATE_CLOSED:
+			case STATE_SYN_SENT:
+				Terminate(c);
+				break;
+			default:
+				/* Unread data is lost, tell the peer (RFC 2525 2.17) */
+				if (c->ReceiveBuffer.Used())
+				{
+					Abort(c);
+					break;
+				}
+
+				CloseWrite(c);
+				if (c->State == STATE_FIN_WAIT_2)
+					Wheel.Schedule(&c->LingerTimer, UsToTicks(TCP_LINGER_MS * 1000ULL));
+				break;
+			}
+			UnlockStack();
+
+			c->Put();
+			delete this;
+		}
+
+		TCPSocket(Connection *Conn) : Socket(TYPE_STREAM), Conn(Conn) {}
+		~TCPSocket() = default;
+	};
+
+	Socket *CreateSocket()
+	{
+		return new TCPSocket(new Connection);
+	}
+
+#pragma endregion Socket
+
+#pragma region Stack
+
+	static void ParseOptions(const uint8_t *Options, size_t Length, SegmentOptions &Result)
+	{
+		size_t i = 0;
+		while (i < Length)
+		{
+			uint8_t kind = Options[i];
+			if (kind == OPTION_END)
+				break;
+
+			if (kind == OPTION_NOP)
+			{
+				i++;
+				continue;
+			}
+
+			if (i + 1 >= Length)
+				break;
+
+			uint8_t length = Options[i + 1];
+			if (length < 2 || i + length > Length)
+				break;
+
+			const uint8_t *data = Options + i + 2;
+			switch (kind)
+			{
+			case OPTION_MSS:
+				if (length == 4)
+					Result.MSS = (uint16_t)((data[0] << 8) | data[1]);
+				break;
+			case OPTION_WINDOW_SCALE:
+				if (length == 3)
+					Result.Scale = std::min(data[0], (uint8_t)14);
+				break;
+			case OPTION_SACK_PERMITTED:
+				if (length == 2)
+					Result.SackPermitted = true;
+				break;
+			case OPTION_SACK:
+				for (size_t j = 0; j + 8 <= (size_t)length - 2 && Result.SackCount < 4; j += 8)
+					Result.Sack[Result.SackCount++] = {Get32(data + j), Get32(data + j + 4)};
+				break;
+			default:
+				break;
+			}
+			i += length;
+		}
+	}
+
+	bool TCP::OnIPv4PacketReceived(InternetProtocol SourceIP, InternetProtocol DestinationIP, uint8_t *Data, size_t Length)
+	{
+		/* Every TCP instance sees the packets of every interface */
+		uint32_t destination = DestinationIP.v4.ToHex();
+		bool loopback = NetworkLoopback::IsLoopback(this->Interface) && (destination >> 24) == 127;
+		if (destination != this->GetAddress() && !loopback)
+			return false;
+
+		if (Length < sizeof(TCPHeader))
+			return false;
+
+		TCPHeader *header = (TCPHeader *)Data;
+		size_t headerLength = header->DataOffset * 4;
+		if (headerLength < sizeof(TCPHeader) || headerLength > Length)
+			return false;
+
+		uint32_t source = SourceIP.v4.ToHex();
+		NetworkPacket::Buffer *frame = this->Interface->Current;
+		bool verified = frame && frame->Checksum == NetworkPacket::CHECKSUM_VERIFIED;
+		if (!verified && SegmentChecksum(source, destination, Data, Length) != 0)
+		{
+			netdbg("Bad checksum from %s", SourceIP.v4.ToStringLittleEndian());
+			return false;
+		}
+
+		Segment s;
+		s.Stack = this;
+		s.Source = source;
+		s.Destination = destination;
+		s.SourcePort = b16(header->SourcePort);
+		s.DestinationPort = b16(header->DestinationPort);
+		s.Sequence = b32(header->SequenceNumber);
+		s.Ack = b32(header->AcknowledgementNumber);
+		s.Flags = header->Flags;
+		s.Window = b16(header->Window);
+		s.Payload = Data + headerLength;
+		s.Length = Length - headerLength;
+		ParseOptions(Data + sizeof(TCPHeader), headerLength - sizeof(TCPHeader), s.Options);
+
+		LockStack();
+		Connection *c = Lookup(destination, s.DestinationPort, source, s.SourcePort);
+		if (c)
+		{
+			c->Get();
+			Input(c, s);
+			c->Put();
+		}
+		else
+			SendReset(s);
+		UnlockStack();
+		return false;
+	}
+
+	uint16_t TCP::GetMSS()
+	{
+		/* Ethernet MTU minus the IPv4 and TCP headers */
+		return 1500 - sizeof(NetworkIPv4::IPv4Header) - sizeof(TCPHeader);
+	}
+
+	void TCP::Transmit(uint32_t Destination, NetworkPacket::Buffer *Segment)
+	{
+		InternetProtocol ip;
+		ip.v4.FromHex(Destination);
+		this->ipv4->Send(Segment, NetworkIPv4::PROTOCOL_TCP, ip);
+	}
+
+	TCP::TCP(NetworkIPv4::IPv4 *ipv4, NetworkInterfaceManager::DeviceInterface *Interface)
+		: NetworkIPv4::IPv4Events(NetworkIPv4::PROTOCOL_TCP)
+	{
+		this->ipv4 = ipv4;
+		this->Interface = Interface;
+
+		bool first;
+		{
+			SmartLock(TCPLock);
+			first = Stacks.empty() && TimerThread == nullptr;
+			if (first)
+			{
+				HashSecret = Random::rand64();
+				SequenceSecret = Random::rand64();
+				Wheel.Start(TimeManager->GetTimeNs() / (TCP_TICK_MS * 1000000ULL));
+			}
+			Stacks.push_back(this);
+		}
+
+		if (first)
+		{
+			TimerThread = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													Tasking::IP(TimerLoop));
+			TimerThread->Rename("TCP timer");
+		}
+		debug("TCP interface %#lx created.", this);
+	}
+
+	TCP::~TCP()
+	{
+		SmartLock(TCPLock);
+		forItr(itr, Stacks)
+		{
+			if (*itr == this)
+			{
+				Stacks.erase(itr);
+				break;
+			}
+		}
+		debug("TCP interface %#lx destroyed.", this);
+	}
+
+#pragma endregion Stack
 }
@@ -0,0 +1,217 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <net/tcp.hpp>
+
+#include <debug.h>
+
+#include "../kernel.h"
+
+/* CUBIC constants (RFC 9438 4.6 and 5), scaled by 1024 */
+#define CUBIC_BETA 717
+#define CUBIC_C 410
+#define CUBIC_ALPHA 542
+
+namespace NetworkTCP
+{
+	static uint32_t FlightSize(Connection *c)
+	{
+		uint32_t outstanding = c->SendMax - c->SendUnacked;
+		return outstanding > c->SackedBytes ? outstanding - c->SackedBytes : 0;
+	}
+
+	/**
+	 * Slow start with appropriate byte counting (RFC 3465),
+	 * growth is limited to two segments per ACK.
+	 *
+	 * @return Bytes left for congestion avoidance
+	 */
+	static uint32_t SlowStart(Connection *c, uint32_t Acked)
+	{
+		if (c->CongestionWindow >= c->SlowStartThreshold)
+			return Acked;
+
+		uint32_t grow = std::min(Acked, 2u * c->SendMSS);
+		c->CongestionWindow = std::min(c->CongestionWindow + grow, c->SlowStartThreshold);
+		return Acked > grow ? Acked - grow : 0;
+	}
+
+	class NewReno : public CongestionControl
+	{
+	public:
+		void Initialize(Connection *c)
+		{
+			c->BytesAcked = 0;
+		}
+
+		void OnAck(Connection *c, uint32_t Acked)
+		{
+			Acked = SlowStart(c, Acked);
+			if (Acked == 0)
+				return;
+
+			/* One segment per window (RFC 5681 3.1) */
+			c->BytesAcked += Acked;
+			if (c->BytesAcked >= c->CongestionWindow)
+			{
+				c->BytesAcked -= c->CongestionWindow;
+				c->CongestionWindow += c->SendMSS;
+			}
+		}
+
+		void OnLoss(Connection *c, bool Timeout)
+		{
+			c->SlowStartThreshold = std::max(FlightSize(c) / 2, 2u * c->SendMSS);
+			c->BytesAcked = 0;
+		}
+
+		NewReno() : CongestionControl("reno") {}
+	};
+
+	class Cubic : public CongestionControl
+	{
+	private:
+		static uint64_t CubeRoot(uint64_t x)
+		{
+			uint64_t r = 0;
+			for (int s = 63; s >= 0; s -= 3)
+			{
+				r <<= 1;
+				uint64_t b = 3 * r * (r + 1) + 1;
+				if ((x >> s) >= b)
+				{
+					x -= b << s;
+					r++;
+				}
+			}
+			return r;
+		}
+
+		static uint64_t NowMs() { return TimeManager->GetTimeNs() / 1000000; }
+
+		/**
+		 * Start a new congestion avoidance epoch (RFC 9438 4.2)
+		 */
+		static void StartEpoch(Connection *c)
+		{
+			uint32_t mss = c->SendMSS;
+			c->Cubic.EpochStart = NowMs();
+			c->Cubic.Estimate = c->CongestionWindow;
+			c->Cubic.Credit = 0;
+
+			if (c->Cubic.LastMax > c->CongestionWindow)
+			{
+				/* K = cbrt((W_max - cwnd) / C), in ms */
+				uint64_t segments = (c->Cubic.LastMax - c->CongestionWindow) / mss;
+				uint64_t k3 = segments * 1024 / CUBIC_C * 1000000000ULL;
+				c->Cubic.K = CubeRoot(k3);
+				c->Cubic.Origin = c->Cubic.LastMax;
+			}
+			else
+			{
+				c->Cubic.K = 0;
+				c->Cubic.Origin = c->CongestionWindow;
+			}
+		}
+
+	public:
+		void Initialize(Connection *c)
+		{
+			c->Cubic = {};
+			c->BytesAcked = 0;
+		}
+
+		void OnAck(Connection *c, uint32_t Acked)
+		{
+			Acked = SlowStart(c, Acked);
+			if (Acked == 0)
+				return;
+
+			if (c->Cubic.EpochStart == 0)
+				StartEpoch(c);
+
+			uint32_t mss = c->SendMSS;
+			uint32_t cwnd = c->CongestionWindow;
+
+			/* W_cubic(t + RTT) = C * (t - K)^3 + W_max */
+			uint64_t t = NowMs() - c->Cubic.EpochStart + c->SmoothedRTT / 1000;
+			uint64_t distance = t > c->Cubic.K ? t - c->Cubic.K : c->Cubic.K - t;
+			uint64_t cube = std::min(distance * distance * distance, (uint64_t)1 << 62);
+			uint64_t offset = (cube / 1000000) * CUBIC_C / 1024 * mss / 1000;
+
+			uint64_t target;
+			if (t > c->Cubic.K)
+				target = c->Cubic.Origin + offset;
+			else
+				target = c->Cubic.Origin > offset ? c->Cubic.Origin - offset : mss;
+
+			/* Reno-friendly region (RFC 9438 4.3) */
+			c->Cubic.Estimate += (uint32_t)((uint64_t)CUBIC_ALPHA * Acked / 1024 * mss / std::max(cwnd, mss));
+			if (c->Cubic.Estimate > target)
+				target = c->Cubic.Estimate;
+
+			/* Never more than 1.5 cwnd per RTT (RFC 9438 4.4) */
+			target = std::min(target, (uint64_t)cwnd * 3 / 2);
+			if (target <= cwnd)
+				return;
+
+			/* cwnd grows by (target - cwnd) / cwnd per acknowledged segment */
+			c->Cubic.Credit += (target - cwnd) * Acked;
+			uint64_t grow = c->Cubic.Credit / cwnd;
+			if (grow)
+			{
+				c->CongestionWindow += (uint32_t)std::min(grow, (uint64_t)Acked);
+				c->Cubic.Credit -= grow * cwnd;
+			}
+		}
+
+		void OnLoss(Connection *c, bool Timeout)
+		{
+			uint32_t mss = c->SendMSS;
+			uint32_t cwnd = std::max(c->CongestionWindow, FlightSize(c));
+
+			/* Fast convergence (RFC 9438 4.7) */
+			if (cwnd < c->Cubic.LastMax)
+				c->Cubic.LastMax = (uint32_t)((uint64_t)cwnd * (1024 + CUBIC_BETA) / 2048);
+			else
+				c->Cubic.LastMax = cwnd;
+
+			c->SlowStartThreshold = std::max((uint32_t)((uint64_t)cwnd * CUBIC_BETA / 1024), 2 * mss);
+			c->Cubic.EpochStart = 0;
+			c->BytesAcked = 0;
+		}
+
+		Cubic() : CongestionControl("cubic") {}
+	};
+
+	static NewReno RenoInstance;
+	static Cubic CubicInstance;
+
+	CongestionControl *GetCongestionControl(const char *Name)
+	{
+		if (strcmp(Name, RenoInstance.Name) == 0)
+			return &RenoInstance;
+		if (strcmp(Name, CubicInstance.Name) == 0)
+			return &CubicInstance;
+		return nullptr;
+	}
+
+	CongestionControl *GetDefaultCongestionControl()
+	{
+		return &CubicInstance;
+	}
+}
@@ -16,79 +16,217 @@
 */
 
 #include <net/udp.hpp>
+#include <net/loopback.hpp>
+#include <rand.hpp>
 #include <debug.h>
 
 #include "../kernel.h"
 
 namespace NetworkUDP
 {
-	struct EventInfo
-	{
-		Socket *UDPSocket;
-		uint16_t Port;
-	};
-	std::vector<EventInfo> RegisteredEvents;
-
 	UDPEvents::UDPEvents() {}
 
 	UDPEvents::~UDPEvents() {}
 
 	/* -------------------------------------------------------------------------------------------------------------------------------- */
 
+	/* Pseudo-header (RFC 768), summed as it would be in memory */
+	static uint64_t PseudoHeaderSum(uint32_t Source, uint32_t Destination, size_t Length)
+	{
+		return (uint64_t)b32(Source) + b32(Destination) +
+			   b16((uint16_t)NetworkIPv4::PROTOCOL_UDP) + b16((uint16_t)Length);
+	}
+
+	/* Sockets that receive from a single peer */
+	static inline bool IsConnected(Socket *Socket)
+	{
+		uint32_t address = Socket->RemoteIP.v4.ToHex();
+		return Socket->RemotePort != 0 && address != 0 && address != 0xFFFFFFFF;
+	}
+
+	std::list<Socket *> &UDP::Bucket(uint16_t LocalPort, uint32_t RemoteAddress, uint16_t RemotePort)
+	{
+		uint64_t key = ((uint64_t)RemoteAddress << 32) | ((uint32_t)LocalPort << 16) | RemotePort;
+		return Sockets[NetworkHashMix(key ^ HashSecret) & (UDP_HASH_SIZE - 1)];
+	}
+
+	std::list<Socket *> &UDP::PortBucket(uint16_t LocalPort)
+	{
+		return Ports[NetworkHashMix(LocalPort ^ HashSecret) & (UDP_PORT_HASH_SIZE - 1)];
+	}
+
+	void UDP::Hash(Socket *Socket)
+	{
+		if (IsConnected(Socket))
+			Bucket(Socket->LocalPort, Socket->RemoteIP.v4.ToHex(), Socket->RemotePort).push_back(Socket);
+		else
+			Bucket(Socket->LocalPort, 0, 0).push_back(Socket);
+		PortBucket(Socket->LocalPort).push_back(Socket);
+	}
+
+	void UDP::Unhash(Socket *Socket)
+	{
+		if (IsConnected(Socket))
+			Bucket(Socket->LocalPort, Socket->RemoteIP.v4.ToHex(), Socket->RemotePort).remove(Socket);
+		else
+			Bucket(Socket->LocalPort, 0, 0).remove(Socket);
+		PortBucket(Socket->LocalPort).remove(Socket);
+	}
+
+	Socket *UDP::Lookup(uint16_t LocalPort, uint32_t RemoteAddress, uint16_t RemotePort)
+	{
+		for (Socket *sock : Bucket(LocalPort, RemoteAddress, RemotePort))
+		{
+			if (sock->LocalPort == LocalPort &&
+				sock->RemotePort == RemotePort &&
+				sock->RemoteIP.v4.ToHex() == RemoteAddress &&
+				IsConnected(sock))
+				return sock;
+		}
+
+		for (Socket *sock : Bucket(LocalPort, 0, 0))
+		{
+			if (sock->LocalPort == LocalPort && !IsConnected(sock))
+				return sock;
+		}
+		return nullptr;
+	}
+
+	bool UDP::PortInUse(uint16_t Port)
+	{
+		for (Socket *sock : PortBucket(Port))
+		{
+			if (sock->LocalPort == Port)
+				return true;
+		}
+		return false;
+	}
+
+	uint16_t UDP::AllocatePort()
+	{
+		const int range = UDP_EPHEMERAL_LAST - UDP_EPHEMERAL_FIRST + 1;
+		for (int i = 0; i < range; i++)
+		{
+			uint16_t port = b16(NextPort);
+			if (++NextPort > UDP_EPHEMERAL_LAST)
+				NextPort = UDP_EPHEMERAL_FIRST;
+
+			if (!PortInUse(port))
+				return port;
+		}
+		return 0;
+	}
+
 	UDP::UDP(NetworkIPv4::IPv4 *ipv4, NetworkInterfaceManager::DeviceInterface *Interface) : NetworkIPv4::IPv4Events(NetworkIPv4::PROTOCOL_UDP)
 	{
 		debug("UDP interface %#lx created.", this);
 		this->ipv4 = ipv4;
 		this->Interface = Interface;
+		this->HashSecret = Random::rand64();
+		this->NextPort = s_cst(uint16_t, UDP_EPHEMERAL_FIRST + HashSecret % (UDP_EPHEMERAL_LAST - UDP_EPHEMERAL_FIRST + 1));
 	}
 
 	UDP::~UDP()
 	{
+		SmartLock(SocketLock);
+		for (size_t i = 0; i < UDP_PORT_HASH_SIZE; i++)
+		{
+			while (!Ports[i].empty())
+			{
+				Socket *sock = Ports[i].front();
+				Unhash(sock);
+				delete sock;
+			}
+		}
 		debug("UDP interface %#lx destroyed.", this);
 	}
 
-	uint16_t UsablePort = 0x200;
-
 	Socket *UDP::Connect(InternetProtocol IP, uint16_t Port)
 	{
 		netdbg("Connecting to %s", IP.v4.ToStringLittleEndian(), Port);
+		SmartLock(SocketLock);
+		uint16_t local = AllocatePort();
+		if (local == 0)
+		{
+			warn("Out of UDP ports");
+			return nullptr;
+		}
+
 		Socket *socket = new Socket(this);
 		socket->RemoteIP = IP;
-		socket->RemotePort = Port;
-		socket->LocalPort = UsablePort++; // TODO: track ports
+		socket->RemotePort = b16(Port);
 		socket->LocalIP = Interface->IP;
-		socket->LocalPort = b16(socket->LocalPort);
-		socket->RemotePort = b16(socket->RemotePort);
-		RegisteredEvents.push_back({.UDPSocket = socket, .Port = socket->LocalPort});
+		socket->LocalPort = local;
+		Hash(socket);
 		return socket;
 	}
 
 	Socket *UDP::Listen(uint16_t Port)
 	{
-		UNUSED(Port);
-		fixme("Not implemented");
-		return nullptr;
+		SmartLock(SocketLock);
+		uint16_t local = Port ? b16(Port) : AllocatePort();
+		if (local == 0 || PortInUse(local))
+		{
+			warn("UDP port %d is not available", Port);
+			return nullptr;
+		}
+
+		Socket *socket = new Socket(this);
+		socket->RemoteIP.v4.FromHex(0);
+		socket->LocalIP = Interface->IP;
+		socket->LocalPort = local;
+		socket->Listening = true;
+		Hash(socket);
+		return socket;
 	}
 
 	void UDP::Disconnect(Socket *Socket)
 	{
-		UNUSED(Socket);
-		fixme("Not implemented");
+		{
+			SmartLock(SocketLock);
+			Unhash(Socket);
+		}
+		delete Socket;
 	}
 
 	void UDP::Send(Socket *Socket, uint8_t *Data, size_t Length)
 	{
 		netdbg("Sending %d bytes to %s", Length, Socket->RemoteIP.v4.ToStringLittleEndian(), Socket->RemotePort);
 		uint16_t TotalLength = s_cst(uint16_t, Length + sizeof(UDPHeader));
-		UDPPacket *packet = (UDPPacket *)kmalloc(TotalLength);
+		NetworkPacket::Buffer *buffer = NetworkPacket::Allocate(TotalLength);
+		if (buffer == nullptr)
+		{
+			warn("Out of packet buffers, dropping datagram");
+			return;
+		}
+
+		UDPPacket *packet = (UDPPacket *)buffer->Append(TotalLength);
 		packet->Header.SourcePort = Socket->LocalPort;
 		packet->Header.DestinationPort = Socket->RemotePort;
 		packet->Header.Length = b16(TotalLength);
-		memcpy(packet->Data, Data, Length);
-		packet->Header.Checksum = 0; // I totally should do this. Some devices may require it.
-		// packet->Header.Checksum = CalculateChecksum((uint16_t *)packet, TotalLength);
-		this->ipv4->Send((uint8_t *)packet, TotalLength, 0x11, Socket->RemoteIP);
-		kfree(packet);
+		packet->Header.Checksum = 0;
+
+		uint64_t sum = PseudoHeaderSum(Interface->IP.v4.ToHex(), Socket->RemoteIP.v4.ToHex(), TotalLength);
+		if (Interface->Features & NetworkInterfaceManager::FEATURE_TX_CHECKSUM)
+		{
+			packet->Header.Checksum = ChecksumFold(sum);
+			buffer->Checksum = NetworkPacket::CHECKSUM_PARTIAL;
+			buffer->ChecksumStart = 0;
+			buffer->ChecksumOffset = offsetof(UDPHeader, Checksum);
+			memcpy(packet->Data, Data, Length);
+		}
+		else
+		{
+			uint64_t partial = ChecksumPartial(packet, sizeof(UDPHeader), sum);
+			partial = ChecksumAdd(partial, ChecksumCopy(packet->Data, Data, Length), sizeof(UDPHeader));
+			packet->Header.Checksum = ChecksumFinish(partial);
+
+			/* Zero means no checksum (RFC 768) */
+			if (packet->Header.Checksum == 0)
+				packet->Header.Checksum = 0xFFFF;
+		}
+
+		this->ipv4->Send(buffer, 0x11, Socket->RemoteIP);
 	}
 
 	void UDP::Bind(Socket *Socket, UDPEvents *EventHandler)
@@ -107,34 +245,51 @@ namespace NetworkUDP
 
 		netdbg("SP:%d | DP:%d | L:%d | CHK:%#x", b16(udp->SourcePort), b16(udp->DestinationPort), b16(udp->Length), b16(udp->Checksum));
 
-		Socket *GoodSocket = nullptr;
-
-		for (auto &var : RegisteredEvents)
+		NetworkPacket::Buffer *frame = this->Interface->Current;
+		bool verified = frame && frame->Checksum == NetworkPacket::CHECKSUM_VERIFIED;
+		if (udp->Checksum != 0 && !verified)
 		{
-			netdbg("UDP->SKT[]: LP:%d | LIP:%s | RP:%d | RIP:%s | LST:%d",
-				   b16(var.UDPSocket->LocalPort),
-				   var.UDPSocket->LocalIP.v4.ToStringLittleEndian(),
-				   b16(var.UDPSocket->RemotePort),
-				   var.UDPSocket->RemoteIP.v4.ToStringLittleEndian(),
-				   b16(var.UDPSocket->Listening));
-			if (var.UDPSocket->LocalPort == udp->DestinationPort &&
-				var.UDPSocket->LocalIP.v4 == DestinationIP.v4 &&
-				var.UDPSocket->Listening == true)
+			uint64_t sum = PseudoHeaderSum(SourceIP.v4.ToHex(), DestinationIP.v4.ToHex(), Length);
+			if (ChecksumFinish(ChecksumPartial(Data, Length, sum)) != 0)
 			{
-				var.UDPSocket->Listening = false;
-				var.UDPSocket->RemotePort = b16(udp->SourcePort);
-				var.UDPSocket->RemoteIP = SourceIP;
-				netdbg("E1");
-				return true;
+				netdbg("Bad checksum from %s", SourceIP.v4.ToStringLittleEndian());
+				return false;
 			}
+		}
+
+		/* Every UDP instance sees every datagram, only take our own */
+		bool Loopback = NetworkLoopback::IsLoopback(this->Interface) &&
+						(DestinationIP.v4.ToHex() >> 24) == 127;
+		if (!Loopback && this->Interface->IP.v4.ToHex() != 0 &&
+			DestinationIP.v4 != this->Interface->IP.v4 &&
+			DestinationIP.v4.ToHex() != 0xFFFFFFFF)
+			return false;
+
+		size_t DataLength = Length - sizeof(UDPHeader);
 
-			GoodSocket = var.UDPSocket;
+		/* Handlers run under the lock so that Disconnect() can't free a socket in use */
+		SmartLock(SocketLock);
+		Socket *sock = Lookup(udp->DestinationPort, SourceIP.v4.ToHex(), udp->SourcePort);
+		if (sock == nullptr)
+		{
+			netdbg("No socket on port %d", b16(udp->DestinationPort));
+			return false;
 		}
-		if (GoodSocket)
-			GoodSocket->EventHandler->OnUDPPacketReceived(GoodSocket, ((UDPPacket *)Data)->Data, Length);
 
-		netdbg("E0 (Success)");
-		return false;
+		if (sock->Listening)
+		{
+			Unhash(sock);
+			sock->Listening = false;
+			sock->RemotePort = udp->SourcePort;
+			sock->RemoteIP = SourceIP;
+			Hash(sock);
+		}
+
+		if (sock->EventHandler == nullptr)
+			return false;
+
+		sock->EventHandler->OnUDPPacketReceived(sock, ((UDPPacket *)Data)->Data, DataLength);
+		return true;
 	}
 
 	/* -------------------------------------------------------------------------------------------------------------------------------- */
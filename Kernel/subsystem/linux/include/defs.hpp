@@ -142,6 +142,8 @@
 #define linux_F_OFD_SETLKW 38
 
 #define linux_F_DUPFD_CLOEXEC 1030
+#define linux_F_SETPIPE_SZ 1031
+#define linux_F_GETPIPE_SZ 1032
 
 #define linux_FD_CLOEXEC 1
 
@@ -155,6 +157,16 @@
 #define linux_DT_SOCK 12
 #define linux_DT_WHT 14
 
+#define linux_O_NONBLOCK 04000
+#define linux_O_CLOEXEC 02000000
+
+#define linux_SPLICE_F_MOVE 1
+#define linux_SPLICE_F_NONBLOCK 2
+#define linux_SPLICE_F_MORE 4
+#define linux_SPLICE_F_GIFT 8
+
+#define linux_UIO_MAXIOV 1024
+
 #define linux_AT_FDCWD (-100)
 #define linux_AT_SYMLINK_NOFOLLOW 0x100
 #define linux_AT_REMOVEDIR 0x200
@@ -469,4 +481,84 @@ typedef unsigned long nfds_t;
 #define linux_POLLMSG    0x400
 #define linux_POLLRDHUP  0x2000
 
+#define linux_FD_SETSIZE 1024
+
+typedef struct
+{
+	unsigned long fds_bits[linux_FD_SETSIZE / (8 * sizeof(unsigned long))];
+} linux_fd_set;
+
+#define linux_EPOLL_CLOEXEC 02000000
+
+#define linux_EPOLL_CTL_ADD 1
+#define linux_EPOLL_CTL_DEL 2
+#define linux_EPOLL_CTL_MOD 3
+
+#define linux_EPOLLIN        0x001
+#define linux_EPOLLPRI       0x002
+#define linux_EPOLLOUT       0x004
+#define linux_EPOLLERR       0x008
+#define linux_EPOLLHUP       0x010
+#define linux_EPOLLRDNORM    0x040
+#define linux_EPOLLRDBAND    0x080
+#define linux_EPOLLWRNORM    0x100
+#define linux_EPOLLWRBAND    0x200
+#define linux_EPOLLMSG       0x400
+#define linux_EPOLLRDHUP     0x2000
+#define linux_EPOLLEXCLUSIVE (1U << 28)
+#define linux_EPOLLWAKEUP    (1U << 29)
+#define linux_EPOLLONESHOT   (1U << 30)
+#define linux_EPOLLET        (1U << 31)
+
+struct linux_epoll_event
+{
+	uint32_t events;
+	uint64_t data;
+#if defined(__amd64__)
+} __attribute__((packed));
+#else
+};
+#endif
+
+typedef uint32_t linux_socklen_t;
+
+#define linux_AF_INET 2
+
+#define linux_SOCK_STREAM 1
+#define linux_SOCK_DGRAM 2
+#define linux_SOCK_NONBLOCK 04000
+#define linux_SOCK_CLOEXEC 02000000
+
+#define linux_IPPROTO_TCP 6
+
+#define linux_MSG_PEEK 0x2
+#define linux_MSG_DONTWAIT 0x40
+#define linux_MSG_WAITALL 0x100
+#define linux_MSG_NOSIGNAL 0x4000
+
+#define linux_SHUT_RD 0
+#define linux_SHUT_WR 1
+#define linux_SHUT_RDWR 2
+
+#define linux_SOL_SOCKET 1
+#define linux_SO_REUSEADDR 2
+#define linux_SO_TYPE 3
+#define linux_SO_ERROR 4
+#define linux_SO_SNDBUF 7
+#define linux_SO_RCVBUF 8
+#define linux_SO_KEEPALIVE 9
+#define linux_SO_ACCEPTCONN 30
+
+#define linux_TCP_NODELAY 1
+#define linux_TCP_MAXSEG 2
+#define linux_TCP_CONGESTION 13
+
+struct linux_sockaddr_in
+{
+	uint16_t sin_family;
+	uint16_t sin_port;
+	uint32_t sin_addr;
+	uint8_t sin_zero[8];
+};
+
 #endif // !__FENNIX_KERNEL_LINUX_DEFS_H__
@@ -29,6 +29,11 @@
 #include <cpu.hpp>
 #include <time.h>
 
+#include <fs/epoll.hpp>
+#include <fs/pipe.hpp>
+#include <fs/poll.hpp>
+#include <fs/uring.hpp>
+#include <net/socket.hpp>
 #include <memory.hpp>
 #define INI_IMPLEMENTATION
 #include <ini.h>
@@ -899,30 +904,55 @@ static int linux_lstat(SysFrm *, const char *pathname, struct linux_kstat *statb
 	return ret;
 }
 
-static int linux_poll(SysFrm *, linux_pollfd *fds, nfds_t nfds, int timeout)
+static int DoPoll(linux_pollfd *fds, nfds_t nfds, int64_t Timeout)
 {
+	static_assert(linux_POLLIN == POLLIN && linux_POLLOUT == POLLOUT);
+	static_assert(linux_POLLERR == POLLERR && linux_POLLHUP == POLLHUP);
+	static_assert(linux_POLLNVAL == POLLNVAL && linux_POLLRDHUP == POLLRDHUP);
+
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-	auto pFds = vma->UserCheckAndGetAddress(fds, nfds * sizeof(linux_pollfd));
-	if (pFds == nullptr)
-		return -linux_EFAULT;
+	if (nfds > linux_FD_SETSIZE * 64)
+		return -linux_EINVAL;
 
-	for (int i = 0; i < nfds; i++)
+	linux_pollfd *pFds = nullptr;
+	if (nfds)
 	{
-		if (pFds[i].fd < 0)
-			return -linux_EBADF;
+		pFds = vma->UserCheckAndGetAddress(fds, nfds * sizeof(linux_pollfd));
+		if (pFds == nullptr)
+			return -linux_EFAULT;
+	}
 
-		debug("poll[%zu].fd=%d .events=%d .revents=%d",
-			  i, pFds[i].fd, pFds[i].events, pFds[i].revents);
+	/* Negative descriptors are skipped, unknown ones get POLLNVAL */
+	std::vector<vfs::PollRequest> requests;
+	std::vector<nfds_t> index;
+	for (nfds_t i = 0; i < nfds; i++)
+	{
 		pFds[i].revents = 0;
+		if (pFds[i].fd < 0)
+			continue;
+
+		auto file = fdt->GetFileDescriptor(pFds[i].fd);
+		Node node = file == nullptr ? nullptr : file->node;
+		requests.push_back({node, (uint16_t)pFds[i].events, 0});
+		index.push_back(i);
 	}
 
-	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	UNUSED(fdt);
-	UNUSED(timeout);
-	fixme("poll is stub! returning 1");
-	return 1;
+	int ret = vfs::PollNodes(requests.data(), requests.size(), Timeout);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	for (size_t i = 0; i < requests.size(); i++)
+		pFds[index[i]].revents = (short)requests[i].Revents;
+	return ret;
+}
+
+static int linux_poll(SysFrm *, linux_pollfd *fds, nfds_t nfds, int timeout)
+{
+	int64_t ns = timeout < 0 ? -1 : (int64_t)timeout * 1000000;
+	return DoPoll(fds, nfds, ns);
 }
 
 // #include "../syscalls.h"
@@ -989,13 +1019,27 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 		fixme("File mapping not fully implemented");
 		vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-		auto _fd = fdt->FileMap.find(fildes);
-		if (_fd == fdt->FileMap.end())
+		auto file = fdt->GetFileDescriptor(fildes);
+		if (file == nullptr)
 		{
 			debug("Invalid file descriptor %d", fildes);
 			return (void *)-linux_EBADF;
 		}
 
+		/* The rings are already mapped at setup, hand out their address */
+		vfs::IoUring *ring = vfs::IoUring::FromNode(file->node);
+		if (ring)
+		{
+			/* Only in the process they were mapped into */
+			if (!ring->IsOwner(pcb))
+				return (void *)-linux_EPERM;
+
+			void *mapping = ring->GetMapping(offset, length);
+			if (mapping == nullptr)
+				return (void *)-linux_EINVAL;
+			return mapping;
+		}
+
 		if (p_Read)
 		{
 			void *pBuf = vma->RequestPages(TO_PAGES(length));
@@ -1325,10 +1369,112 @@ static int linux_pipe(SysFrm *, int pipefd[2])
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	int *pPipefd = vma->UserCheckAndGetAddress(pipefd);
-	debug("pipefd=%#lx", pPipefd);
-	fixme("pipefd=[%d, %d]", pPipefd[0], pPipefd[1]);
-	return -linux_ENOSYS;
+	int *pPipefd = vma->UserCheckAndGetAddress(pipefd, sizeof(int) * 2);
+	if (pPipefd == nullptr)
+		return -linux_EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_pipe(pPipefd, 0));
+}
+
+#define SELECT_IN (POLLIN | POLLRDNORM | POLLHUP | POLLERR)
+#define SELECT_OUT (POLLOUT | POLLWRNORM | POLLERR)
+#define SELECT_EX (POLLPRI)
+
+static int DoSelect(int nfds, linux_fd_set *readfds, linux_fd_set *writefds,
+					linux_fd_set *exceptfds, int64_t Timeout)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	if (nfds < 0 || nfds > linux_FD_SETSIZE)
+		return -linux_EINVAL;
+
+	linux_fd_set *sets[3] = {readfds, writefds, exceptfds};
+	for (auto &set : sets)
+	{
+		if (set == nullptr)
+			continue;
+
+		set = vma->UserCheckAndGetAddress(set);
+		if (set == nullptr)
+			return -linux_EFAULT;
+	}
+
+	const int bits = 8 * sizeof(unsigned long);
+	auto isSet = [bits](linux_fd_set *set, int fd)
+	{
+		return set && (set->fds_bits[fd / bits] & (1UL << (fd % bits)));
+	};
+
+	std::vector<vfs::PollRequest> requests;
+	std::vector<int> index;
+	for (int fd = 0; fd < nfds; fd++)
+	{
+		int events = 0;
+		if (isSet(sets[0], fd))
+			events |= SELECT_IN;
+		if (isSet(sets[1], fd))
+			events |= SELECT_OUT;
+		if (isSet(sets[2], fd))
+			events |= SELECT_EX;
+		if (events == 0)
+			continue;
+
+		auto file = fdt->GetFileDescriptor(fd);
+		if (file == nullptr)
+			return -linux_EBADF;
+
+		requests.push_back({file->node, events, 0});
+		index.push_back(fd);
+	}
+
+	int ret = vfs::PollNodes(requests.data(), requests.size(), Timeout);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	for (auto set : sets)
+	{
+		if (set)
+			memset(set->fds_bits, 0, (nfds + bits - 1) / bits * sizeof(unsigned long));
+	}
+
+	/* Each set bit is counted, like Linux does */
+	int count = 0;
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		const int masks[3] = {SELECT_IN, SELECT_OUT, SELECT_EX};
+		int fd = index[i];
+		for (int s = 0; s < 3; s++)
+		{
+			if (!(requests[i].Events & masks[s]) || !(requests[i].Revents & masks[s]))
+				continue;
+
+			sets[s]->fds_bits[fd / bits] |= 1UL << (fd % bits);
+			count++;
+		}
+	}
+	return count;
+}
+
+static int linux_select(SysFrm *, int nfds, linux_fd_set *readfds, linux_fd_set *writefds,
+						linux_fd_set *exceptfds, struct timeval *timeout)
+{
+	int64_t ns = -1;
+	if (timeout)
+	{
+		auto pTimeout = thisProcess->vma->UserCheckAndGetAddress(timeout);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+
+		if (pTimeout->tv_sec < 0 || pTimeout->tv_usec < 0)
+			return -linux_EINVAL;
+
+		ns = Time::FromSeconds(pTimeout->tv_sec) + pTimeout->tv_usec * 1000;
+	}
+
+	return DoSelect(nfds, readfds, writefds, exceptfds, ns);
 }
 
 static int linux_madvise(SysFrm *, void *addr, size_t length, int advice)
@@ -1425,6 +1571,46 @@ static pid_t linux_getpid(SysFrm *)
 	return pcb->ID;
 }
 
+static ssize_t linux_sendfile(SysFrm *, int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	off_t *pOffset = nullptr;
+	if (offset)
+	{
+		pOffset = pcb->vma->UserCheckAndGetAddress(offset);
+		if (pOffset == nullptr)
+			return -linux_EFAULT;
+	}
+
+	ssize_t ret = fdt->usr_sendfile(out_fd, in_fd, pOffset, count);
+	debug("sendfile(%d, %d, %ld) = %ld", out_fd, in_fd, count, ret);
+	return ConvertErrnoToLinux(ret);
+}
+
+/* i386 sendfile takes a 32-bit offset, sendfile64 is linux_sendfile */
+static ssize_t linux_sendfile32(SysFrm *, int out_fd, int in_fd, int32_t *offset, size_t count)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	int32_t *pOffset = nullptr;
+	off_t off = 0;
+	if (offset)
+	{
+		pOffset = pcb->vma->UserCheckAndGetAddress(offset);
+		if (pOffset == nullptr)
+			return -linux_EFAULT;
+		off = *pOffset;
+	}
+
+	ssize_t ret = fdt->usr_sendfile(out_fd, in_fd, pOffset ? &off : nullptr, count);
+	if (pOffset && ret > 0)
+		*pOffset = (int32_t)off;
+	return ConvertErrnoToLinux(ret);
+}
+
 static int linux_setitimer(SysFrm *, int which,
 						   const struct itimerspec64 *new_value,
 						   struct itimerspec64 *old_value)
@@ -1464,12 +1650,405 @@ static int linux_setitimer(SysFrm *, int which,
 	return 0;
 }
 
-static int linux_shutdown(SysFrm *, int sockfd, int how)
-{
-	stub;
-	return -linux_ENOSYS;
-}
-
+static NetworkSocket::Socket *LinuxGetSocket(int sockfd, Node &node, int *Result)
+{
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	auto file = fdt->GetFileDescriptor(sockfd);
+	if (file == nullptr)
+	{
+		*Result = -linux_EBADF;
+		return nullptr;
+	}
+
+	/* Hold the node, the descriptor may be closed while we block */
+	node = file->node;
+	NetworkSocket::Socket *sock = NetworkSocket::FromNode(node);
+	*Result = sock ? 0 : -linux_ENOTSOCK;
+	return sock;
+}
+
+static int LinuxReadAddress(const struct linux_sockaddr_in *addr, linux_socklen_t addrlen,
+							NetworkSocket::SocketAddress *Result)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	if (addrlen < sizeof(struct linux_sockaddr_in))
+		return -linux_EINVAL;
+
+	const struct linux_sockaddr_in *pAddr = vma->UserCheckAndGetAddress(addr, sizeof(struct linux_sockaddr_in));
+	if (pAddr == nullptr)
+		return -linux_EFAULT;
+
+	if (pAddr->sin_family != linux_AF_INET)
+		return -linux_EAFNOSUPPORT;
+
+	Result->Address = b32(pAddr->sin_addr);
+	Result->Port = b16(pAddr->sin_port);
+	return 0;
+}
+
+/* Like Linux, a short buffer gets a truncated address and the full length */
+static int LinuxWriteAddress(const NetworkSocket::SocketAddress &Address,
+							 struct linux_sockaddr_in *addr, linux_socklen_t *addrlen)
+{
+	if (addr == nullptr)
+		return 0;
+
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	linux_socklen_t *pAddrlen = vma->UserCheckAndGetAddress(addrlen, sizeof(linux_socklen_t));
+	if (pAddrlen == nullptr)
+		return -linux_EFAULT;
+	if ((int)*pAddrlen < 0)
+		return -linux_EINVAL;
+
+	struct linux_sockaddr_in sin = {};
+	sin.sin_family = linux_AF_INET;
+	sin.sin_port = b16(Address.Port);
+	sin.sin_addr = b32(Address.Address);
+
+	size_t length = std::min((size_t)*pAddrlen, sizeof(sin));
+	if (length)
+	{
+		void *pAddr = vma->UserCheckAndGetAddress(addr, length);
+		if (pAddr == nullptr)
+			return -linux_EFAULT;
+		memcpy(pAddr, &sin, length);
+	}
+	*pAddrlen = sizeof(sin);
+	return 0;
+}
+
+static int LinuxConvertMessageFlags(int flags)
+{
+	int ret = 0;
+	if (flags & linux_MSG_PEEK)
+		ret |= NetworkSocket::MESSAGE_PEEK;
+	if (flags & linux_MSG_DONTWAIT)
+		ret |= NetworkSocket::MESSAGE_DONTWAIT;
+	if (flags & linux_MSG_WAITALL)
+		ret |= NetworkSocket::MESSAGE_WAITALL;
+	if (flags & linux_MSG_NOSIGNAL)
+		ret |= NetworkSocket::MESSAGE_NOSIGNAL;
+	return ret;
+}
+
+static int linux_socket(SysFrm *, int domain, int type, int protocol)
+{
+	if (domain != linux_AF_INET)
+		return -linux_EAFNOSUPPORT;
+
+	int flags = 0;
+	if (type & linux_SOCK_NONBLOCK)
+		flags |= O_NONBLOCK;
+	if (type & linux_SOCK_CLOEXEC)
+		flags |= O_CLOEXEC;
+	type &= ~(linux_SOCK_NONBLOCK | linux_SOCK_CLOEXEC);
+
+	int kType;
+	switch (type)
+	{
+	case linux_SOCK_STREAM:
+		kType = NetworkSocket::TYPE_STREAM;
+		break;
+	case linux_SOCK_DGRAM:
+		kType = NetworkSocket::TYPE_DGRAM;
+		break;
+	default:
+		return -linux_EINVAL;
+	}
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_socket(NetworkSocket::DOMAIN_INET, kType, protocol, flags));
+}
+
+static int linux_connect(SysFrm *, int sockfd, const struct linux_sockaddr_in *addr, linux_socklen_t addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = LinuxReadAddress(addr, addrlen, &address);
+	if (ret < 0)
+		return ret;
+	return ConvertErrnoToLinux(sock->Connect(address, node->inode->Flags & O_NONBLOCK));
+}
+
+static int linux_accept4(SysFrm *, int sockfd, struct linux_sockaddr_in *addr, linux_socklen_t *addrlen, int flags)
+{
+	if (flags & ~(linux_SOCK_NONBLOCK | linux_SOCK_CLOEXEC))
+		return -linux_EINVAL;
+
+	int kFlags = 0;
+	if (flags & linux_SOCK_NONBLOCK)
+		kFlags |= O_NONBLOCK;
+	if (flags & linux_SOCK_CLOEXEC)
+		kFlags |= O_CLOEXEC;
+
+	NetworkSocket::SocketAddress peer;
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	int ret = fdt->usr_accept(sockfd, &peer, kFlags);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	int err = LinuxWriteAddress(peer, addr, addrlen);
+	if (err < 0)
+	{
+		fdt->usr_close(ret);
+		return err;
+	}
+	return ret;
+}
+
+static int linux_accept(SysFrm *sf, int sockfd, struct linux_sockaddr_in *addr, linux_socklen_t *addrlen)
+{
+	return linux_accept4(sf, sockfd, addr, addrlen, 0);
+}
+
+static ssize_t linux_sendto(SysFrm *, int sockfd, const void *buf, size_t len, int flags,
+							const struct linux_sockaddr_in *dest_addr, linux_socklen_t addrlen)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	const void *pBuf = vma->UserCheckAndGetAddress(buf, len);
+	if (pBuf == nullptr)
+		return -linux_EFAULT;
+
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	/* Connection oriented sockets ignore the destination */
+	if (dest_addr != nullptr && sock->Type != NetworkSocket::TYPE_STREAM)
+		return -linux_EOPNOTSUPP;
+
+	return ConvertErrnoToLinux(sock->Send(pBuf, len, LinuxConvertMessageFlags(flags),
+										  node->inode->Flags & O_NONBLOCK));
+}
+
+static ssize_t linux_recvfrom(SysFrm *, int sockfd, void *buf, size_t len, int flags,
+							  struct linux_sockaddr_in *src_addr, linux_socklen_t *addrlen)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	void *pBuf = vma->UserCheckAndGetAddress(buf, len);
+	if (pBuf == nullptr)
+		return -linux_EFAULT;
+
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	ssize_t n = sock->Receive(pBuf, len, LinuxConvertMessageFlags(flags),
+							  node->inode->Flags & O_NONBLOCK);
+	if (n < 0)
+		return ConvertErrnoToLinux(n);
+
+	NetworkSocket::SocketAddress peer;
+	if (src_addr != nullptr && sock->GetPeerName(&peer) == 0)
+	{
+		ret = LinuxWriteAddress(peer, src_addr, addrlen);
+		if (ret < 0)
+			return ret;
+	}
+	return n;
+}
+
+static int linux_shutdown(SysFrm *, int sockfd, int how)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	switch (how)
+	{
+	case linux_SHUT_RD:
+		return ConvertErrnoToLinux(sock->Shutdown(NetworkSocket::SHUTDOWN_READ));
+	case linux_SHUT_WR:
+		return ConvertErrnoToLinux(sock->Shutdown(NetworkSocket::SHUTDOWN_WRITE));
+	case linux_SHUT_RDWR:
+		return ConvertErrnoToLinux(sock->Shutdown(NetworkSocket::SHUTDOWN_BOTH));
+	default:
+		return -linux_EINVAL;
+	}
+}
+
+static int linux_bind(SysFrm *, int sockfd, const struct linux_sockaddr_in *addr, linux_socklen_t addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = LinuxReadAddress(addr, addrlen, &address);
+	if (ret < 0)
+		return ret;
+	return ConvertErrnoToLinux(sock->Bind(address));
+}
+
+static int linux_listen(SysFrm *, int sockfd, int backlog)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+	return ConvertErrnoToLinux(sock->Listen(backlog));
+}
+
+static int linux_getsockname(SysFrm *, int sockfd, struct linux_sockaddr_in *addr, linux_socklen_t *addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = sock->GetName(&address);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+	if (addr == nullptr)
+		return -linux_EFAULT;
+	return LinuxWriteAddress(address, addr, addrlen);
+}
+
+static int linux_getpeername(SysFrm *, int sockfd, struct linux_sockaddr_in *addr, linux_socklen_t *addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = sock->GetPeerName(&address);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+	if (addr == nullptr)
+		return -linux_EFAULT;
+	return LinuxWriteAddress(address, addr, addrlen);
+}
+
+static int LinuxConvertSocketOption(int level, int optname)
+{
+	if (level == linux_SOL_SOCKET)
+	{
+		switch (optname)
+		{
+		case linux_SO_REUSEADDR:
+			return NetworkSocket::OPTION_REUSEADDR;
+		case linux_SO_TYPE:
+			return NetworkSocket::OPTION_TYPE;
+		case linux_SO_ERROR:
+			return NetworkSocket::OPTION_ERROR;
+		case linux_SO_SNDBUF:
+			return NetworkSocket::OPTION_SNDBUF;
+		case linux_SO_RCVBUF:
+			return NetworkSocket::OPTION_RCVBUF;
+		case linux_SO_KEEPALIVE:
+			return NetworkSocket::OPTION_KEEPALIVE;
+		case linux_SO_ACCEPTCONN:
+			return NetworkSocket::OPTION_ACCEPTCONN;
+		default:
+			return -1;
+		}
+	}
+
+	if (level == linux_IPPROTO_TCP)
+	{
+		switch (optname)
+		{
+		case linux_TCP_NODELAY:
+			return NetworkSocket::OPTION_NODELAY;
+		case linux_TCP_MAXSEG:
+			return NetworkSocket::OPTION_MAXSEG;
+		case linux_TCP_CONGESTION:
+			return NetworkSocket::OPTION_CONGESTION;
+		default:
+			return -1;
+		}
+	}
+	return -1;
+}
+
+static int linux_setsockopt(SysFrm *, int sockfd, int level, int optname,
+							const void *optval, linux_socklen_t optlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	int option = LinuxConvertSocketOption(level, optname);
+	if (option < 0)
+	{
+		debug("Unsupported socket option %d:%d", level, optname);
+		return -linux_ENOPROTOOPT;
+	}
+
+	if ((int)optlen < 0)
+		return -linux_EINVAL;
+
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	const void *pOptval = vma->UserCheckAndGetAddress(optval, optlen);
+	if (pOptval == nullptr)
+		return -linux_EFAULT;
+
+	return ConvertErrnoToLinux(sock->SetOption(option, pOptval, optlen));
+}
+
+static int linux_getsockopt(SysFrm *, int sockfd, int level, int optname,
+							void *optval, linux_socklen_t *optlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = LinuxGetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	int option = LinuxConvertSocketOption(level, optname);
+	if (option < 0)
+	{
+		debug("Unsupported socket option %d:%d", level, optname);
+		return -linux_ENOPROTOOPT;
+	}
+
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	linux_socklen_t *pOptlen = vma->UserCheckAndGetAddress(optlen, sizeof(linux_socklen_t));
+	if (pOptlen == nullptr)
+		return -linux_EFAULT;
+	if ((int)*pOptlen < 0)
+		return -linux_EINVAL;
+
+	void *pOptval = vma->UserCheckAndGetAddress(optval, *pOptlen);
+	if (pOptval == nullptr)
+		return -linux_EFAULT;
+
+	size_t length = *pOptlen;
+	ret = sock->GetOption(option, pOptval, &length);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	/* SO_TYPE is reported in Linux values */
+	if (option == NetworkSocket::OPTION_TYPE)
+	{
+		int *type = (int *)pOptval;
+		*type = *type == NetworkSocket::TYPE_STREAM ? linux_SOCK_STREAM : linux_SOCK_DGRAM;
+	}
+
+	*pOptlen = (linux_socklen_t)length;
+	return 0;
+}
+
 static pid_t linux_fork(SysFrm *sf)
 {
 	TCB *Thread = thisThread;
@@ -2265,11 +2844,11 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 	switch (cmd)
 	{
 	case linux_F_DUPFD:
-		return ConvertErrnoToLinux(fdt->usr_dup2(fd, s_cst(int, (uintptr_t)arg)));
+		return ConvertErrnoToLinux(fdt->usr_dupfd(fd, s_cst(int, (uintptr_t)arg), 0));
 	case linux_F_GETFD:
-		return ConvertErrnoToLinux(fdt->GetFlags(fd));
+		return ConvertErrnoToLinux(fdt->GetDescriptorFlags(fd));
 	case linux_F_SETFD:
-		return ConvertErrnoToLinux(fdt->SetFlags(fd, s_cst(int, (uintptr_t)arg)));
+		return ConvertErrnoToLinux(fdt->SetDescriptorFlags(fd, s_cst(int, (uintptr_t)arg)));
 	case linux_F_GETFL:
 	{
 		fixme("F_GETFL is stub?");
@@ -2283,20 +2862,35 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 			fdt->SetFlags(fd, fdt->GetFlags(fd) | O_APPEND);
 		else
 			fdt->SetFlags(fd, fdt->GetFlags(fd) & ~O_APPEND);
+
+		/* Pipes and sockets keep O_NONBLOCK on the shared node */
+		auto file = fdt->GetFileDescriptor(fd);
+		if (file != nullptr &&
+			(vfs::Pipe::FromNode(file->node) || NetworkSocket::FromNode(file->node)))
+		{
+			if (flags & linux_O_NONBLOCK)
+				file->node->inode->Flags |= O_NONBLOCK;
+			else
+				file->node->inode->Flags &= ~O_NONBLOCK;
+		}
 		return 0;
 	}
 	case linux_F_DUPFD_CLOEXEC:
+		return ConvertErrnoToLinux(fdt->usr_dupfd(fd, s_cst(int, (uintptr_t)arg), O_CLOEXEC));
+	case linux_F_SETPIPE_SZ:
+	case linux_F_GETPIPE_SZ:
 	{
-		int ret = fdt->usr_dup2(fd, s_cst(int, (uintptr_t)arg));
-		if (ret < 0)
-			return ConvertErrnoToLinux(ret);
-
-		auto it = fdt->FileMap.find(fd);
-		if (it == fdt->FileMap.end())
+		auto file = fdt->GetFileDescriptor(fd);
+		if (file == nullptr)
 			ReturnLogError(-linux_EBADF, "Invalid fd %d", fd);
 
-		it->second.Flags |= linux_FD_CLOEXEC;
-		return ret;
+		vfs::Pipe *pipe = vfs::Pipe::FromNode(file->node);
+		if (pipe == nullptr)
+			return -linux_EBADF;
+
+		if (cmd == linux_F_GETPIPE_SZ)
+			return pipe->GetSize();
+		return ConvertErrnoToLinux(pipe->SetSize(s_cst(size_t, (uintptr_t)arg)));
 	}
 	case linux_F_SETOWN:
 	case linux_F_GETOWN:
@@ -2375,12 +2969,12 @@ static int linux_fchdir(SysFrm *, int fd)
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
 		return -linux_EBADF;
 
-	pcb->SetWorkingDirectory(it->second.node);
-	debug("Changed cwd to \"%s\"", it->second.node->GetPath().c_str());
+	pcb->SetWorkingDirectory(file->node);
+	debug("Changed cwd to \"%s\"", file->node->GetPath().c_str());
 	return 0;
 }
 
@@ -2428,12 +3022,11 @@ static ssize_t linux_readlink(SysFrm *, const char *pathname,
 	if (fd < 0)
 		return -linux_ENOENT;
 
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
 		ReturnLogError(-linux_EBADF, "Invalid fd %d", fd);
 
-	vfs::FileDescriptorTable::Fildes &fildes = it->second;
-	Node node = fildes.node;
+	Node node = file->node;
 	fdt->usr_close(fd);
 
 	if (!node->IsSymbolicLink())
@@ -2447,7 +3040,8 @@ static int linux_fchmod(SysFrm *, int fd, mode_t mode)
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-	if (fdt->FileMap.find(fd) == fdt->FileMap.end())
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
 		return -linux_EBADF;
 
 	struct kstat stat;
@@ -2460,7 +3054,7 @@ static int linux_fchmod(SysFrm *, int fd, mode_t mode)
 
 	/* TODO: check if FS is read-only: -linux_EROFS */
 
-	mode_t current = pcb->FileDescriptors->FileMap[fd].Mode;
+	mode_t current = file->Mode;
 	mode_t newMode = (current & ~07777) | (mode & 07777);
 
 	/* TODO: add CAP_FSETID check */
@@ -2468,7 +3062,7 @@ static int linux_fchmod(SysFrm *, int fd, mode_t mode)
 		newMode &= ~S_ISGID;
 
 	/* FIXME: actually write to FS; maybe with fdt->usr_chmod or similar? */
-	pcb->FileDescriptors->FileMap[fd].Mode = newMode;
+	file->Mode = newMode;
 	return 0;
 }
 
@@ -3085,6 +3679,15 @@ static int linux_sched_getaffinity(SysFrm *, pid_t pid, size_t cpusetsize, cpu_s
 	return 0;
 }
 
+static int linux_epoll_create(SysFrm *, int size)
+{
+	if (size <= 0)
+		return -linux_EINVAL;
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_epoll_create(0));
+}
+
 static pid_t linux_set_tid_address(SysFrm *, int *tidptr)
 {
 	if (tidptr == nullptr)
@@ -3107,15 +3710,14 @@ __no_sanitize("undefined") static ssize_t linux_getdents64(SysFrm *,
 
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
 	{
 		debug("Invalid fd %d", fd);
 		return -linux_EBADF;
 	}
 
-	vfs::FileDescriptorTable::Fildes &fildes = it->second;
-	if (!fildes.node->IsDirectory())
+	if (!file->node->IsDirectory())
 	{
 		debug("Not a directory");
 		return -ENOTDIR;
@@ -3139,10 +3741,8 @@ __no_sanitize("undefined") static ssize_t linux_getdents64(SysFrm *,
 #endif
 
 	/* The structs are the same, no need for conversion. */
-	ssize_t ret = fs->ReadDirectory(fildes.node, (struct kdirent *)pDirp, count, fildes.Offset, count / sizeof(kdirent));
-
-	if (ret > 0)
-		fildes.Offset += ret;
+	SmartLock(file->DirectoryLock);
+	ssize_t ret = fs->ReadDirectory(file->node, file->Directory, (struct kdirent *)pDirp, count, file->Offset);
 
 #ifdef DEBUG
 	if (ret > 0)
@@ -3281,6 +3881,91 @@ static __noreturn void linux_exit_group(SysFrm *sf, int status)
 	linux_exit(sf, status);
 }
 
+static int GetEventPoll(int epfd, Node &EpollNode, vfs::EventPoll **Result)
+{
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	auto file = fdt->GetFileDescriptor(epfd);
+	if (file == nullptr)
+		return -linux_EBADF;
+
+	EpollNode = file->node;
+	*Result = vfs::EventPoll::FromNode(EpollNode);
+	if (*Result == nullptr)
+		return -linux_EINVAL;
+	return 0;
+}
+
+static int DoEpollWait(int epfd, struct linux_epoll_event *events,
+					   int maxevents, int64_t Timeout)
+{
+	if (maxevents <= 0 || (size_t)maxevents > INT_MAX / sizeof(linux_epoll_event))
+		return -linux_EINVAL;
+
+	/* Holding the node keeps the instance alive if epfd is closed meanwhile */
+	Node epNode;
+	vfs::EventPoll *ep;
+	int ret = GetEventPoll(epfd, epNode, &ep);
+	if (ret < 0)
+		return ret;
+
+	auto pEvents = thisProcess->vma->UserCheckAndGetAddress(events, maxevents * sizeof(linux_epoll_event));
+	if (pEvents == nullptr)
+		return -linux_EFAULT;
+
+	/* Anything above the batch stays queued for the next call */
+	std::vector<vfs::EventPoll::Event> kEvents(maxevents < 256 ? maxevents : 256);
+	ret = ep->Wait(kEvents.data(), (int)kEvents.size(), Timeout);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	for (int i = 0; i < ret; i++)
+	{
+		pEvents[i].events = kEvents[i].Events;
+		pEvents[i].data = kEvents[i].Data;
+	}
+	return ret;
+}
+
+static int linux_epoll_wait(SysFrm *, int epfd, struct linux_epoll_event *events,
+							int maxevents, int timeout)
+{
+	int64_t ns = timeout < 0 ? -1 : (int64_t)timeout * 1000000;
+	return DoEpollWait(epfd, events, maxevents, ns);
+}
+
+static int linux_epoll_ctl(SysFrm *, int epfd, int op, int fd,
+						   struct linux_epoll_event *event)
+{
+	static_assert(linux_EPOLL_CTL_ADD == EPOLL_CTL_ADD);
+	static_assert(linux_EPOLL_CTL_DEL == EPOLL_CTL_DEL);
+	static_assert(linux_EPOLL_CTL_MOD == EPOLL_CTL_MOD);
+	static_assert(linux_EPOLLET == EPOLLET && linux_EPOLLONESHOT == EPOLLONESHOT);
+
+	Node epNode;
+	vfs::EventPoll *ep;
+	int ret = GetEventPoll(epfd, epNode, &ep);
+	if (ret < 0)
+		return ret;
+
+	vfs::EventPoll::Event kEvent{};
+	if (op != linux_EPOLL_CTL_DEL)
+	{
+		auto pEvent = thisProcess->vma->UserCheckAndGetAddress(event);
+		if (pEvent == nullptr)
+			return -linux_EFAULT;
+
+		kEvent.Events = pEvent->events;
+		kEvent.Data = pEvent->data;
+	}
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
+		return -linux_EBADF;
+
+	return ConvertErrnoToLinux(ep->Control(op, fd, file.get(), &kEvent));
+}
+
 static int linux_tgkill(SysFrm *sf, pid_t tgid, pid_t tid, int sig)
 {
 	Tasking::TCB *tcb = thisProcess->GetThread(tid);
@@ -3384,12 +4069,11 @@ static long linux_newfstatat(SysFrm *, int dirfd, const char *pathname,
 	default:
 	{
 		debug("dirfd is %d for \"%s\"", dirfd, pPathname);
-		auto it = fdt->FileMap.find(dirfd);
-		if (it == fdt->FileMap.end())
+		auto file = fdt->GetFileDescriptor(dirfd);
+		if (file == nullptr)
 			ReturnLogError(-linux_EBADF, "Invalid fd %d", dirfd);
 
-		vfs::FileDescriptorTable::Fildes &fildes = it->second;
-		Node node = fs->Lookup(fildes.node, pPathname);
+		Node node = fs->Lookup(file->node, pPathname);
 		debug("node: %s", node->GetPath().c_str());
 		if (!node)
 			return -linux_ENOENT;
@@ -3402,6 +4086,272 @@ static long linux_newfstatat(SysFrm *, int dirfd, const char *pathname,
 	}
 }
 
+static int GetTimeout(const struct timespec *timeout, int64_t *Result)
+{
+	*Result = -1;
+	if (timeout == nullptr)
+		return 0;
+
+	auto pTimeout = thisProcess->vma->UserCheckAndGetAddress(timeout);
+	if (pTimeout == nullptr)
+		return -linux_EFAULT;
+
+	if (pTimeout->tv_sec < 0 || pTimeout->tv_nsec < 0 || pTimeout->tv_nsec > 999999999)
+		return -linux_EINVAL;
+
+	*Result = Time::FromSeconds(pTimeout->tv_sec) + pTimeout->tv_nsec;
+	return 0;
+}
+
+/**
+ * Install the signal mask of pselect6/ppoll/epoll_pwait
+ * for the duration of the call
+ */
+static int SwapSignalMask(const sigset_t *sigmask, size_t sigsetsize, sigset_t *Old)
+{
+	if (sigmask == nullptr)
+		return 0;
+
+	if (sigsetsize != sizeof(sigset_t))
+		return -linux_EINVAL;
+
+	auto pMask = thisProcess->vma->UserCheckAndGetAddress(sigmask);
+	if (pMask == nullptr)
+		return -linux_EFAULT;
+
+	*Old = thisThread->Signals.SetMask(ConvertMaskToNative(*pMask));
+	return 0;
+}
+
+static int linux_pselect6(SysFrm *, int nfds, linux_fd_set *readfds, linux_fd_set *writefds,
+						  linux_fd_set *exceptfds, const struct timespec *timeout, void *sig)
+{
+	struct
+	{
+		const sigset_t *ss;
+		size_t ss_len;
+	} *pSig = nullptr;
+
+	int64_t ns;
+	int ret = GetTimeout(timeout, &ns);
+	if (ret < 0)
+		return ret;
+
+	if (sig)
+	{
+		pSig = (decltype(pSig))thisProcess->vma->UserCheckAndGetAddress(sig, sizeof(*pSig));
+		if (pSig == nullptr)
+			return -linux_EFAULT;
+	}
+
+	sigset_t old;
+	const sigset_t *mask = pSig ? pSig->ss : nullptr;
+	ret = SwapSignalMask(mask, pSig ? pSig->ss_len : 0, &old);
+	if (ret < 0)
+		return ret;
+
+	ret = DoSelect(nfds, readfds, writefds, exceptfds, ns);
+	if (mask)
+		thisThread->Signals.SetMask(old);
+	return ret;
+}
+
+static int linux_ppoll(SysFrm *, linux_pollfd *fds, nfds_t nfds, const struct timespec *tmo_p,
+					   const sigset_t *sigmask, size_t sigsetsize)
+{
+	int64_t ns;
+	int ret = GetTimeout(tmo_p, &ns);
+	if (ret < 0)
+		return ret;
+
+	sigset_t old;
+	ret = SwapSignalMask(sigmask, sigsetsize, &old);
+	if (ret < 0)
+		return ret;
+
+	ret = DoPoll(fds, nfds, ns);
+	if (sigmask)
+		thisThread->Signals.SetMask(old);
+	return ret;
+}
+
+static vfs::Pipe *GetPipeEnd(Node &node, int AccessMode)
+{
+	vfs::Pipe *pipe = vfs::Pipe::FromNode(node);
+	if (pipe == nullptr || (node->inode->Flags & O_ACCMODE) != AccessMode)
+		return nullptr;
+	return pipe;
+}
+
+static ssize_t linux_splice(SysFrm *, int fd_in, off_t *off_in,
+							int fd_out, off_t *off_out,
+							size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto in = fdt->GetFileDescriptor(fd_in);
+	auto out = fdt->GetFileDescriptor(fd_out);
+	if (in == nullptr || out == nullptr)
+		return -linux_EBADF;
+
+	/* Hold the nodes, the descriptors may be closed while we block */
+	Node inNode = in->node;
+	Node outNode = out->node;
+	bool nonBlock = flags & linux_SPLICE_F_NONBLOCK;
+
+	bool inPipe = vfs::Pipe::FromNode(inNode) != nullptr;
+	bool outPipe = vfs::Pipe::FromNode(outNode) != nullptr;
+	vfs::Pipe *pIn = GetPipeEnd(inNode, O_RDONLY);
+	vfs::Pipe *pOut = GetPipeEnd(outNode, O_WRONLY);
+	if ((inPipe && pIn == nullptr) || (outPipe && pOut == nullptr))
+		return -linux_EBADF;
+
+	if (inPipe && outPipe)
+	{
+		if (off_in || off_out)
+			return -linux_ESPIPE;
+		return ConvertErrnoToLinux(vfs::Pipe::Splice(pIn, pOut, len, nonBlock));
+	}
+
+	if (!inPipe && !outPipe)
+		return -linux_EINVAL;
+
+	if ((inPipe && off_in) || (outPipe && off_out))
+		return -linux_ESPIPE;
+
+	int fileFd = inPipe ? fd_out : fd_in;
+	off_t *offPtr = inPipe ? off_out : off_in;
+	off_t offset = inPipe ? out->Offset : in->Offset;
+
+	off_t *pOff = nullptr;
+	if (offPtr)
+	{
+		pOff = vma->UserCheckAndGetAddress(offPtr);
+		if (pOff == nullptr)
+			return -linux_EFAULT;
+		offset = *pOff;
+	}
+
+	ssize_t ret;
+	if (inPipe)
+		ret = pIn->SpliceTo(outNode, offset, len, nonBlock);
+	else
+		ret = pOut->SpliceFrom(inNode, offset, len, nonBlock);
+
+	if (ret > 0)
+	{
+		if (pOff)
+			*pOff += ret;
+		else
+			fdt->usr_lseek(fileFd, ret, SEEK_CUR);
+	}
+
+	debug("splice(%d, %d, %ld) = %ld", fd_in, fd_out, len, ret);
+	return ConvertErrnoToLinux(ret);
+}
+
+static ssize_t linux_tee(SysFrm *, int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto in = fdt->GetFileDescriptor(fd_in);
+	auto out = fdt->GetFileDescriptor(fd_out);
+	if (in == nullptr || out == nullptr)
+		return -linux_EBADF;
+
+	Node inNode = in->node;
+	Node outNode = out->node;
+
+	vfs::Pipe *pIn = GetPipeEnd(inNode, O_RDONLY);
+	vfs::Pipe *pOut = GetPipeEnd(outNode, O_WRONLY);
+	if (pIn == nullptr || pOut == nullptr)
+		return -linux_EINVAL;
+
+	bool nonBlock = flags & linux_SPLICE_F_NONBLOCK;
+	return ConvertErrnoToLinux(vfs::Pipe::Tee(pIn, pOut, len, nonBlock));
+}
+
+static ssize_t linux_vmsplice(SysFrm *, int fd, const struct iovec *iov,
+							  unsigned long nr_segs, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	if (nr_segs > linux_UIO_MAXIOV)
+		return -linux_EINVAL;
+
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
+		return -linux_EBADF;
+
+	Node node = file->node;
+	vfs::Pipe *pipe = vfs::Pipe::FromNode(node);
+	if (pipe == nullptr)
+		return -linux_EBADF;
+
+	const struct iovec *pIov = vma->UserCheckAndGetAddress(iov, sizeof(struct iovec) * nr_segs);
+	if (pIov == nullptr)
+		return -linux_EFAULT;
+
+	/* User pages can't be mapped into the pipe, SPLICE_F_GIFT is a copy too */
+	bool writer = (node->inode->Flags & O_ACCMODE) == O_WRONLY;
+	bool nonBlock = flags & linux_SPLICE_F_NONBLOCK;
+	ssize_t total = 0;
+	for (unsigned long i = 0; i < nr_segs; i++)
+	{
+		if (pIov[i].iov_len == 0)
+			continue;
+
+		void *pBase = vma->UserCheckAndGetAddress(pIov[i].iov_base, pIov[i].iov_len);
+		if (pBase == nullptr)
+			return total ? total : -linux_EFAULT;
+
+		ssize_t ret;
+		if (writer)
+			ret = pipe->Write(pBase, pIov[i].iov_len, nonBlock);
+		else
+			ret = pipe->Read(pBase, pIov[i].iov_len, nonBlock);
+
+		if (ret < 0)
+			return total ? total : ConvertErrnoToLinux(ret);
+
+		total += ret;
+		if ((size_t)ret < pIov[i].iov_len)
+			break;
+	}
+	return total;
+}
+
+static int linux_epoll_pwait(SysFrm *, int epfd, struct linux_epoll_event *events,
+							 int maxevents, int timeout, const sigset_t *sigmask,
+							 size_t sigsetsize)
+{
+	sigset_t old;
+	int ret = SwapSignalMask(sigmask, sigsetsize, &old);
+	if (ret < 0)
+		return ret;
+
+	int64_t ns = timeout < 0 ? -1 : (int64_t)timeout * 1000000;
+	ret = DoEpollWait(epfd, events, maxevents, ns);
+	if (sigmask)
+		thisThread->Signals.SetMask(old);
+	return ret;
+}
+
+static int linux_epoll_create1(SysFrm *, int flags)
+{
+	if (flags & ~linux_EPOLL_CLOEXEC)
+		return -linux_EINVAL;
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	int nFlags = (flags & linux_EPOLL_CLOEXEC) ? O_CLOEXEC : 0;
+	return ConvertErrnoToLinux(fdt->usr_epoll_create(nFlags));
+}
+
 static int linux_pipe2(SysFrm *sf, int pipefd[2], int flags)
 {
 	if (flags == 0)
@@ -3410,13 +4360,21 @@ static int linux_pipe2(SysFrm *sf, int pipefd[2], int flags)
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	int *pPipefd = vma->UserCheckAndGetAddress(pipefd);
+	int *pPipefd = vma->UserCheckAndGetAddress(pipefd, sizeof(int) * 2);
 	if (pPipefd == nullptr)
 		return -linux_EFAULT;
 
-	debug("pipefd=%#lx", pPipefd);
-	fixme("pipefd=[%d, %d] flags=%#x", pPipefd[0], pPipefd[1], flags);
-	return -linux_ENOSYS;
+	if (flags & ~(linux_O_NONBLOCK | linux_O_CLOEXEC))
+		return -linux_EINVAL;
+
+	int pipeFlags = 0;
+	if (flags & linux_O_NONBLOCK)
+		pipeFlags |= O_NONBLOCK;
+	if (flags & linux_O_CLOEXEC)
+		pipeFlags |= O_CLOEXEC;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_pipe(pPipefd, pipeFlags));
 }
 
 static int linux_prlimit64(SysFrm *, pid_t pid, int resource,
@@ -3585,6 +4543,118 @@ static ssize_t linux_getrandom(SysFrm *, void *buf,
 	return 0;
 }
 
+static ssize_t linux_copy_file_range(SysFrm *, int fd_in, off_t *off_in,
+									 int fd_out, off_t *off_out,
+									 size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	off_t *pOffIn = nullptr, *pOffOut = nullptr;
+	if (off_in)
+	{
+		pOffIn = vma->UserCheckAndGetAddress(off_in);
+		if (pOffIn == nullptr)
+			return -linux_EFAULT;
+	}
+
+	if (off_out)
+	{
+		pOffOut = vma->UserCheckAndGetAddress(off_out);
+		if (pOffOut == nullptr)
+			return -linux_EFAULT;
+	}
+
+	ssize_t ret = fdt->usr_copy_file_range(fd_in, pOffIn, fd_out, pOffOut, len, flags);
+	debug("copy_file_range(%d, %d, %ld) = %ld", fd_in, fd_out, len, ret);
+	return ConvertErrnoToLinux(ret);
+}
+
+/* The ring layout is the one of Linux, only results need translating */
+static_assert(sizeof(kio_uring_sqe) == 64);
+static_assert(sizeof(kio_uring_cqe) == 16);
+static_assert(sizeof(kio_uring_params) == 120);
+
+static int LinuxUringResult(int Result)
+{
+	return (int)ConvertErrnoToLinux(Result);
+}
+
+static vfs::IoUring *GetIoUring(int fd)
+{
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	auto file = fdt->GetFileDescriptor(fd);
+	if (file == nullptr)
+		return nullptr;
+	return vfs::IoUring::FromNode(file->node);
+}
+
+static int linux_io_uring_setup(SysFrm *, uint32_t entries, kio_uring_params *p)
+{
+	PCB *pcb = thisProcess;
+	auto pParams = pcb->vma->UserCheckAndGetAddress(p, sizeof(kio_uring_params));
+	if (pParams == nullptr)
+		return -linux_EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	int ret = fdt->usr_io_uring_setup(entries, pParams, LinuxUringResult);
+	return (int)ConvertErrnoToLinux(ret);
+}
+
+static int linux_io_uring_enter(SysFrm *, unsigned int fd, uint32_t to_submit,
+								uint32_t min_complete, uint32_t flags,
+								const sigset_t *sig, size_t sz)
+{
+	vfs::IoUring *ring = GetIoUring(fd);
+	if (ring == nullptr)
+		return -linux_EBADF;
+	if (!ring->IsOwner(thisProcess))
+		return -linux_EPERM;
+
+	sigset_t old;
+	int ret = SwapSignalMask(sig, sz, &old);
+	if (ret < 0)
+		return ret;
+
+	ret = ring->Enter(to_submit, min_complete, flags);
+	if (sig)
+		thisThread->Signals.SetMask(old);
+	return (int)ConvertErrnoToLinux(ret);
+}
+
+static int linux_io_uring_register(SysFrm *, unsigned int fd, unsigned int opcode,
+								   void *arg, unsigned int nr_args)
+{
+	vfs::IoUring *ring = GetIoUring(fd);
+	if (ring == nullptr)
+		return -linux_EBADF;
+	if (!ring->IsOwner(thisProcess))
+		return -linux_EPERM;
+
+	return (int)ConvertErrnoToLinux(ring->Register(opcode, arg, nr_args));
+}
+
+static int linux_epoll_pwait2(SysFrm *, int epfd, struct linux_epoll_event *events,
+							  int maxevents, const struct timespec *timeout,
+							  const sigset_t *sigmask, size_t sigsetsize)
+{
+	int64_t ns;
+	int ret = GetTimeout(timeout, &ns);
+	if (ret < 0)
+		return ret;
+
+	sigset_t old;
+	ret = SwapSignalMask(sigmask, sigsetsize, &old);
+	if (ret < 0)
+		return ret;
+
+	ret = DoEpollWait(epfd, events, maxevents, ns);
+	if (sigmask)
+		thisThread->Signals.SetMask(old);
+	return ret;
+}
+
 static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_read] = {"read", (void *)linux_read},
 	[__NR_amd64_write] = {"write", (void *)linux_write},
@@ -3609,7 +4679,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_writev] = {"writev", (void *)linux_writev},
 	[__NR_amd64_access] = {"access", (void *)linux_access},
 	[__NR_amd64_pipe] = {"pipe", (void *)linux_pipe},
-	[__NR_amd64_select] = {"select", (void *)nullptr},
+	[__NR_amd64_select] = {"select", (void *)linux_select},
 	[__NR_amd64_sched_yield] = {"sched_yield", (void *)nullptr},
 	[__NR_amd64_mremap] = {"mremap", (void *)nullptr},
 	[__NR_amd64_msync] = {"msync", (void *)nullptr},
@@ -3626,22 +4696,22 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_alarm] = {"alarm", (void *)nullptr},
 	[__NR_amd64_setitimer] = {"setitimer", (void *)linux_setitimer},
 	[__NR_amd64_getpid] = {"getpid", (void *)linux_getpid},
-	[__NR_amd64_sendfile] = {"sendfile", (void *)nullptr},
-	[__NR_amd64_socket] = {"socket", (void *)nullptr},
-	[__NR_amd64_connect] = {"connect", (void *)nullptr},
-	[__NR_amd64_accept] = {"accept", (void *)nullptr},
-	[__NR_amd64_sendto] = {"sendto", (void *)nullptr},
-	[__NR_amd64_recvfrom] = {"recvfrom", (void *)nullptr},
+	[__NR_amd64_sendfile] = {"sendfile", (void *)linux_sendfile},
+	[__NR_amd64_socket] = {"socket", (void *)linux_socket},
+	[__NR_amd64_connect] = {"connect", (void *)linux_connect},
+	[__NR_amd64_accept] = {"accept", (void *)linux_accept},
+	[__NR_amd64_sendto] = {"sendto", (void *)linux_sendto},
+	[__NR_amd64_recvfrom] = {"recvfrom", (void *)linux_recvfrom},
 	[__NR_amd64_sendmsg] = {"sendmsg", (void *)nullptr},
 	[__NR_amd64_recvmsg] = {"recvmsg", (void *)nullptr},
 	[__NR_amd64_shutdown] = {"shutdown", (void *)linux_shutdown},
-	[__NR_amd64_bind] = {"bind", (void *)nullptr},
-	[__NR_amd64_listen] = {"listen", (void *)nullptr},
-	[__NR_amd64_getsockname] = {"getsockname", (void *)nullptr},
-	[__NR_amd64_getpeername] = {"getpeername", (void *)nullptr},
+	[__NR_amd64_bind] = {"bind", (void *)linux_bind},
+	[__NR_amd64_listen] = {"listen", (void *)linux_listen},
+	[__NR_amd64_getsockname] = {"getsockname", (void *)linux_getsockname},
+	[__NR_amd64_getpeername] = {"getpeername", (void *)linux_getpeername},
 	[__NR_amd64_socketpair] = {"socketpair", (void *)nullptr},
-	[__NR_amd64_setsockopt] = {"setsockopt", (void *)nullptr},
-	[__NR_amd64_getsockopt] = {"getsockopt", (void *)nullptr},
+	[__NR_amd64_setsockopt] = {"setsockopt", (void *)linux_setsockopt},
+	[__NR_amd64_getsockopt] = {"getsockopt", (void *)linux_getsockopt},
 	[__NR_amd64_clone] = {"clone", (void *)nullptr},
 	[__NR_amd64_fork] = {"fork", (void *)linux_fork},
 	[__NR_amd64_vfork] = {"vfork", (void *)linux_vfork},
@@ -3799,7 +4869,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_io_cancel] = {"io_cancel", (void *)nullptr},
 	[__NR_amd64_get_thread_area] = {"get_thread_area", (void *)nullptr},
 	[__NR_amd64_lookup_dcookie] = {"lookup_dcookie", (void *)nullptr},
-	[__NR_amd64_epoll_create] = {"epoll_create", (void *)nullptr},
+	[__NR_amd64_epoll_create] = {"epoll_create", (void *)linux_epoll_create},
 	[__NR_amd64_epoll_ctl_old] = {"epoll_ctl_old", (void *)nullptr},
 	[__NR_amd64_epoll_wait_old] = {"epoll_wait_old", (void *)nullptr},
 	[__NR_amd64_remap_file_pages] = {"remap_file_pages", (void *)nullptr},
@@ -3818,8 +4888,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_clock_getres] = {"clock_getres", (void *)nullptr},
 	[__NR_amd64_clock_nanosleep] = {"clock_nanosleep", (void *)linux_clock_nanosleep},
 	[__NR_amd64_exit_group] = {"exit_group", (void *)linux_exit_group},
-	[__NR_amd64_epoll_wait] = {"epoll_wait", (void *)nullptr},
-	[__NR_amd64_epoll_ctl] = {"epoll_ctl", (void *)nullptr},
+	[__NR_amd64_epoll_wait] = {"epoll_wait", (void *)linux_epoll_wait},
+	[__NR_amd64_epoll_ctl] = {"epoll_ctl", (void *)linux_epoll_ctl},
 	[__NR_amd64_tgkill] = {"tgkill", (void *)linux_tgkill},
 	[__NR_amd64_utimes] = {"utimes", (void *)nullptr},
 	[__NR_amd64_vserver] = {"vserver", (void *)nullptr},
@@ -3856,28 +4926,28 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_readlinkat] = {"readlinkat", (void *)nullptr},
 	[__NR_amd64_fchmodat] = {"fchmodat", (void *)nullptr},
 	[__NR_amd64_faccessat] = {"faccessat", (void *)nullptr},
-	[__NR_amd64_pselect6] = {"pselect6", (void *)nullptr},
-	[__NR_amd64_ppoll] = {"ppoll", (void *)nullptr},
+	[__NR_amd64_pselect6] = {"pselect6", (void *)linux_pselect6},
+	[__NR_amd64_ppoll] = {"ppoll", (void *)linux_ppoll},
 	[__NR_amd64_unshare] = {"unshare", (void *)nullptr},
 	[__NR_amd64_set_robust_list] = {"set_robust_list", (void *)nullptr},
 	[__NR_amd64_get_robust_list] = {"get_robust_list", (void *)nullptr},
-	[__NR_amd64_splice] = {"splice", (void *)nullptr},
-	[__NR_amd64_tee] = {"tee", (void *)nullptr},
+	[__NR_amd64_splice] = {"splice", (void *)linux_splice},
+	[__NR_amd64_tee] = {"tee", (void *)linux_tee},
 	[__NR_amd64_sync_file_range] = {"sync_file_range", (void *)nullptr},
-	[__NR_amd64_vmsplice] = {"vmsplice", (void *)nullptr},
+	[__NR_amd64_vmsplice] = {"vmsplice", (void *)linux_vmsplice},
 	[__NR_amd64_move_pages] = {"move_pages", (void *)nullptr},
 	[__NR_amd64_utimensat] = {"utimensat", (void *)nullptr},
-	[__NR_amd64_epoll_pwait] = {"epoll_pwait", (void *)nullptr},
+	[__NR_amd64_epoll_pwait] = {"epoll_pwait", (void *)linux_epoll_pwait},
 	[__NR_amd64_signalfd] = {"signalfd", (void *)nullptr},
 	[__NR_amd64_timerfd_create] = {"timerfd_create", (void *)nullptr},
 	[__NR_amd64_eventfd] = {"eventfd", (void *)nullptr},
 	[__NR_amd64_fallocate] = {"fallocate", (void *)nullptr},
 	[__NR_amd64_timerfd_settime] = {"timerfd_settime", (void *)nullptr},
 	[__NR_amd64_timerfd_gettime] = {"timerfd_gettime", (void *)nullptr},
-	[__NR_amd64_accept4] = {"accept4", (void *)nullptr},
+	[__NR_amd64_accept4] = {"accept4", (void *)linux_accept4},
 	[__NR_amd64_signalfd4] = {"signalfd4", (void *)nullptr},
 	[__NR_amd64_eventfd2] = {"eventfd2", (void *)nullptr},
-	[__NR_amd64_epoll_create1] = {"epoll_create1", (void *)nullptr},
+	[__NR_amd64_epoll_create1] = {"epoll_create1", (void *)linux_epoll_create1},
 	[__NR_amd64_dup3] = {"dup3", (void *)nullptr},
 	[__NR_amd64_pipe2] = {"pipe2", (void *)linux_pipe2},
 	[__NR_amd64_inotify_init1] = {"inotify_init1", (void *)nullptr},
@@ -3912,7 +4982,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_userfaultfd] = {"userfaultfd", (void *)nullptr},
 	[__NR_amd64_membarrier] = {"membarrier", (void *)nullptr},
 	[__NR_amd64_mlock2] = {"mlock2", (void *)nullptr},
-	[__NR_amd64_copy_file_range] = {"copy_file_range", (void *)nullptr},
+	[__NR_amd64_copy_file_range] = {"copy_file_range", (void *)linux_copy_file_range},
 	[__NR_amd64_preadv2] = {"preadv2", (void *)nullptr},
 	[__NR_amd64_pwritev2] = {"pwritev2", (void *)nullptr},
 	[__NR_amd64_pkey_mprotect] = {"pkey_mprotect", (void *)nullptr},
@@ -4011,9 +5081,9 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[422] = {"reserved", (void *)nullptr},
 	[423] = {"reserved", (void *)nullptr},
 	[__NR_amd64_pidfd_send_signal] = {"pidfd_send_signal", (void *)nullptr},
-	[__NR_amd64_io_uring_setup] = {"io_uring_setup", (void *)nullptr},
-	[__NR_amd64_io_uring_enter] = {"io_uring_enter", (void *)nullptr},
-	[__NR_amd64_io_uring_register] = {"io_uring_register", (void *)nullptr},
+	[__NR_amd64_io_uring_setup] = {"io_uring_setup", (void *)linux_io_uring_setup},
+	[__NR_amd64_io_uring_enter] = {"io_uring_enter", (void *)linux_io_uring_enter},
+	[__NR_amd64_io_uring_register] = {"io_uring_register", (void *)linux_io_uring_register},
 	[__NR_amd64_open_tree] = {"open_tree", (void *)nullptr},
 	[__NR_amd64_move_mount] = {"move_mount", (void *)nullptr},
 	[__NR_amd64_fsopen] = {"fsopen", (void *)nullptr},
@@ -4027,7 +5097,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_pidfd_getfd] = {"pidfd_getfd", (void *)nullptr},
 	[__NR_amd64_faccessat2] = {"faccessat2", (void *)nullptr},
 	[__NR_amd64_process_madvise] = {"process_madvise", (void *)nullptr},
-	[__NR_amd64_epoll_pwait2] = {"epoll_pwait2", (void *)nullptr},
+	[__NR_amd64_epoll_pwait2] = {"epoll_pwait2", (void *)linux_epoll_pwait2},
 	[__NR_amd64_mount_setattr] = {"mount_setattr", (void *)nullptr},
 	[443] = {"reserved", (void *)nullptr},
 	[__NR_amd64_landlock_create_ruleset] = {"landlock_create_ruleset", (void *)nullptr},
@@ -4223,7 +5293,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_capget] = {"capget", (void *)nullptr},
 	[__NR_i386_capset] = {"capset", (void *)nullptr},
 	[__NR_i386_sigaltstack] = {"sigaltstack", (void *)nullptr},
-	[__NR_i386_sendfile] = {"sendfile", (void *)nullptr},
+	[__NR_i386_sendfile] = {"sendfile", (void *)linux_sendfile32},
 	[__NR_i386_getpmsg] = {"getpmsg", (void *)nullptr},
 	[__NR_i386_putpmsg] = {"putpmsg", (void *)nullptr},
 	[__NR_i386_vfork] = {"vfork", (void *)linux_vfork},
@@ -4275,7 +5345,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_lremovexattr] = {"lremovexattr", (void *)nullptr},
 	[__NR_i386_fremovexattr] = {"fremovexattr", (void *)nullptr},
 	[__NR_i386_tkill] = {"tkill", (void *)linux_tkill},
-	[__NR_i386_sendfile64] = {"sendfile64", (void *)nullptr},
+	[__NR_i386_sendfile64] = {"sendfile64", (void *)linux_sendfile},
 	[__NR_i386_futex] = {"futex", (void *)nullptr},
 	[__NR_i386_sched_setaffinity] = {"sched_setaffinity", (void *)linux_sched_setaffinity},
 	[__NR_i386_sched_getaffinity] = {"sched_getaffinity", (void *)linux_sched_getaffinity},
@@ -4395,25 +5465,25 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_memfd_create] = {"memfd_create", (void *)nullptr},
 	[__NR_i386_bpf] = {"bpf", (void *)nullptr},
 	[__NR_i386_execveat] = {"execveat", (void *)nullptr},
-	[__NR_i386_socket] = {"socket", (void *)nullptr},
+	[__NR_i386_socket] = {"socket", (void *)linux_socket},
 	[__NR_i386_socketpair] = {"socketpair", (void *)nullptr},
-	[__NR_i386_bind] = {"bind", (void *)nullptr},
-	[__NR_i386_connect] = {"connect", (void *)nullptr},
-	[__NR_i386_listen] = {"listen", (void *)nullptr},
-	[__NR_i386_accept4] = {"accept4", (void *)nullptr},
-	[__NR_i386_getsockopt] = {"getsockopt", (void *)nullptr},
-	[__NR_i386_setsockopt] = {"setsockopt", (void *)nullptr},
-	[__NR_i386_getsockname] = {"getsockname", (void *)nullptr},
-	[__NR_i386_getpeername] = {"getpeername", (void *)nullptr},
-	[__NR_i386_sendto] = {"sendto", (void *)nullptr},
+	[__NR_i386_bind] = {"bind", (void *)linux_bind},
+	[__NR_i386_connect] = {"connect", (void *)linux_connect},
+	[__NR_i386_listen] = {"listen", (void *)linux_listen},
+	[__NR_i386_accept4] = {"accept4", (void *)linux_accept4},
+	[__NR_i386_getsockopt] = {"getsockopt", (void *)linux_getsockopt},
+	[__NR_i386_setsockopt] = {"setsockopt", (void *)linux_setsockopt},
+	[__NR_i386_getsockname] = {"getsockname", (void *)linux_getsockname},
+	[__NR_i386_getpeername] = {"getpeername", (void *)linux_getpeername},
+	[__NR_i386_sendto] = {"sendto", (void *)linux_sendto},
 	[__NR_i386_sendmsg] = {"sendmsg", (void *)nullptr},
-	[__NR_i386_recvfrom] = {"recvfrom", (void *)nullptr},
+	[__NR_i386_recvfrom] = {"recvfrom", (void *)linux_recvfrom},
 	[__NR_i386_recvmsg] = {"recvmsg", (void *)nullptr},
 	[__NR_i386_shutdown] = {"shutdown", (void *)linux_shutdown},
 	[__NR_i386_userfaultfd] = {"userfaultfd", (void *)nullptr},
 	[__NR_i386_membarrier] = {"membarrier", (void *)nullptr},
 	[__NR_i386_mlock2] = {"mlock2", (void *)nullptr},
-	[__NR_i386_copy_file_range] = {"copy_file_range", (void *)nullptr},
+	[__NR_i386_copy_file_range] = {"copy_file_range", (void *)linux_copy_file_range},
 	[__NR_i386_preadv2] = {"preadv2", (void *)nullptr},
 	[__NR_i386_pwritev2] = {"pwritev2", (void *)nullptr},
 	[__NR_i386_pkey_mprotect] = {"pkey_mprotect", (void *)nullptr},
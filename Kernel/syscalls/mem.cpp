@@ -84,8 +84,7 @@ void *sys_mmap(SysFrm *, void *addr, size_t length, int prot, int flags, int fd,
 		fixme("File mapping not fully implemented");
 		vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-		auto _fd = fdt->FileMap.find(fd);
-		if (_fd == fdt->FileMap.end())
+		if (fdt->GetFileDescriptor(fd) == nullptr)
 		{
 			debug("Invalid file descriptor %d", fd);
 			return (void *)-EBADF;
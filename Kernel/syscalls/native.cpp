@@ -18,6 +18,8 @@
 #include <interface/syscalls.h>
 
 #include <syscalls.hpp>
+#include <fs/uring.hpp>
+#include <net/socket.hpp>
 #include <memory.hpp>
 #include <lock.hpp>
 #include <exec.hpp>
@@ -136,6 +138,121 @@ static int sys_close(SysFrm *Frame, int fd)
 
 static int sys_ioctl(SysFrm *Frame, int fd, unsigned long request, void *argp) { return -ENOSYS; }
 static int sys_fcntl(SysFrm *Frame, int fd, int cmd, void *arg) { return -ENOSYS; }
+
+static ssize_t sys_readv(SysFrm *Frame, int fildes, const struct kiovec *iov, int iovcnt)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if (iovcnt < 0 || iovcnt > KIOV_MAX)
+		return -EINVAL;
+
+	const struct kiovec *pIov = vma->UserCheckAndGetAddress(iov, sizeof(struct kiovec) * iovcnt);
+	if (pIov == nullptr)
+		return -EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	ssize_t total = 0;
+	for (int i = 0; i < iovcnt; i++)
+	{
+		if (pIov[i].iov_len == 0)
+			continue;
+
+		void *pBuf = vma->UserCheckAndGetAddress(pIov[i].iov_base, pIov[i].iov_len);
+		if (pBuf == nullptr)
+			return total ? total : -EFAULT;
+
+		ssize_t ret = fdt->usr_read(fildes, pBuf, pIov[i].iov_len);
+		if (ret < 0)
+			return total ? total : ret;
+
+		fdt->usr_lseek(fildes, ret, SEEK_CUR);
+		total += ret;
+		if ((size_t)ret < pIov[i].iov_len)
+			break;
+	}
+	return total;
+}
+
+static ssize_t sys_writev(SysFrm *Frame, int fildes, const struct kiovec *iov, int iovcnt)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if (iovcnt < 0 || iovcnt > KIOV_MAX)
+		return -EINVAL;
+
+	const struct kiovec *pIov = vma->UserCheckAndGetAddress(iov, sizeof(struct kiovec) * iovcnt);
+	if (pIov == nullptr)
+		return -EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	ssize_t total = 0;
+	for (int i = 0; i < iovcnt; i++)
+	{
+		if (pIov[i].iov_len == 0)
+			continue;
+
+		const void *pBuf = vma->UserCheckAndGetAddress(pIov[i].iov_base, pIov[i].iov_len);
+		if (pBuf == nullptr)
+			return total ? total : -EFAULT;
+
+		ssize_t ret = fdt->usr_write(fildes, pBuf, pIov[i].iov_len);
+		if (ret < 0)
+			return total ? total : ret;
+
+		fdt->usr_lseek(fildes, ret, SEEK_CUR);
+		total += ret;
+		if ((size_t)ret < pIov[i].iov_len)
+			break;
+	}
+	return total;
+}
+
+static int sys_io_uring_setup(SysFrm *Frame, unsigned int entries, struct kio_uring_params *params)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	struct kio_uring_params *pParams = vma->UserCheckAndGetAddress(params, sizeof(struct kio_uring_params));
+	if (pParams == nullptr)
+		return -EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return fdt->usr_io_uring_setup(entries, pParams);
+}
+
+static vfs::IoUring *GetIoUring(PCB *pcb, int fd)
+{
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	vfs::FileDescriptorTable::FildesReference fildes = fdt->GetFileDescriptor(fd);
+	if (fildes == nullptr)
+		return nullptr;
+	return vfs::IoUring::FromNode(fildes->node);
+}
+
+static int sys_io_uring_enter(SysFrm *Frame, int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	vfs::IoUring *ring = GetIoUring(thisProcess, fd);
+	if (ring == nullptr)
+		return -EBADF;
+	if (!ring->IsOwner(thisProcess))
+		return -EPERM;
+
+	return ring->Enter(to_submit, min_complete, flags);
+}
+
+static int sys_io_uring_register(SysFrm *Frame, int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	vfs::IoUring *ring = GetIoUring(thisProcess, fd);
+	if (ring == nullptr)
+		return -EBADF;
+	if (!ring->IsOwner(thisProcess))
+		return -EPERM;
+
+	return ring->Register(opcode, arg, nr_args);
+}
+
 static int sys_stat(SysFrm *Frame, const char *pathname, struct stat *statbuf) { return -ENOSYS; }
 static int sys_fstat(SysFrm *Frame, int fd, struct stat *statbuf) { return -ENOSYS; }
 static int sys_lstat(SysFrm *Frame, const char *pathname, struct stat *statbuf) { return -ENOSYS; }
@@ -191,17 +308,222 @@ int sys_munmap(SysFrm *Frame, void *addr, size_t length);
 int sys_mprotect(SysFrm *Frame, void *addr, size_t length, int prot);
 int sys_madvise(SysFrm *Frame, void *addr, size_t length, int advice);
 
-static int sys_pipe(SysFrm *Frame, int pipefd[2]) { return -ENOSYS; }
+static int sys_pipe(SysFrm *Frame, int pipefd[2])
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	int *pPipefd = vma->UserCheckAndGetAddress(pipefd, sizeof(int) * 2);
+	if (pPipefd == nullptr)
+		return -EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return fdt->usr_pipe(pPipefd, 0);
+}
+
 static int sys_dup(SysFrm *Frame, int oldfd) { return -ENOSYS; }
 static int sys_dup2(SysFrm *Frame, int oldfd, int newfd) { return -ENOSYS; }
-static int sys_socket(SysFrm *Frame, int domain, int type, int protocol) { return -ENOSYS; }
-static int sys_bind(SysFrm *Frame, int sockfd, const struct sockaddr *addr, __SYS_socklen_t addrlen) { return -ENOSYS; }
-static int sys_connect(SysFrm *Frame, int sockfd, const struct sockaddr *addr, __SYS_socklen_t addrlen) { return -ENOSYS; }
-static int sys_listen(SysFrm *Frame, int sockfd, int backlog) { return -ENOSYS; }
-static int sys_accept(SysFrm *Frame, int sockfd, struct sockaddr *addr, __SYS_socklen_t *addrlen) { return -ENOSYS; }
-static ssize_t sys_send(SysFrm *Frame, int sockfd, const void *buf, size_t len, int flags) { return -ENOSYS; }
-static ssize_t sys_recv(SysFrm *Frame, int sockfd, void *buf, size_t len, int flags) { return -ENOSYS; }
-static int sys_shutdown(SysFrm *Frame, int sockfd, int how) { return -ENOSYS; }
+static NetworkSocket::Socket *GetSocket(int sockfd, Node &node, int *Result)
+{
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	vfs::FileDescriptorTable::FildesReference fildes = fdt->GetFileDescriptor(sockfd);
+	if (fildes == nullptr)
+	{
+		*Result = -EBADF;
+		return nullptr;
+	}
+
+	/* Hold the node, the descriptor may be closed while we block */
+	node = fildes->node;
+	NetworkSocket::Socket *sock = NetworkSocket::FromNode(node);
+	*Result = sock ? 0 : -ENOTSOCK;
+	return sock;
+}
+
+static int ConvertSocketAddress(const struct ksockaddr_in *addr, __SYS_socklen_t addrlen,
+								NetworkSocket::SocketAddress *Result)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	if (addrlen < sizeof(struct ksockaddr_in))
+		return -EINVAL;
+
+	const struct ksockaddr_in *pAddr = vma->UserCheckAndGetAddress(addr, sizeof(struct ksockaddr_in));
+	if (pAddr == nullptr)
+		return -EFAULT;
+
+	if (pAddr->sin_family != __SYS_AF_INET)
+		return -EAFNOSUPPORT;
+
+	Result->Address = b32(pAddr->sin_addr);
+	Result->Port = b16(pAddr->sin_port);
+	return 0;
+}
+
+static int sys_socket(SysFrm *Frame, int domain, int type, int protocol)
+{
+	if (domain != __SYS_AF_INET)
+		return -EAFNOSUPPORT;
+
+	int flags = 0;
+	if (type & __SYS_SOCK_NONBLOCK)
+		flags |= O_NONBLOCK;
+	if (type & __SYS_SOCK_CLOEXEC)
+		flags |= O_CLOEXEC;
+	type &= ~(__SYS_SOCK_NONBLOCK | __SYS_SOCK_CLOEXEC);
+
+	int kType;
+	switch (type)
+	{
+	case __SYS_SOCK_STREAM:
+		kType = NetworkSocket::TYPE_STREAM;
+		break;
+	case __SYS_SOCK_DGRAM:
+		kType = NetworkSocket::TYPE_DGRAM;
+		break;
+	default:
+		return -EPROTOTYPE;
+	}
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	return fdt->usr_socket(NetworkSocket::DOMAIN_INET, kType, protocol, flags);
+}
+
+static int sys_bind(SysFrm *Frame, int sockfd, const struct ksockaddr_in *addr, __SYS_socklen_t addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = ConvertSocketAddress(addr, addrlen, &address);
+	if (ret < 0)
+		return ret;
+	return sock->Bind(address);
+}
+
+static int sys_connect(SysFrm *Frame, int sockfd, const struct ksockaddr_in *addr, __SYS_socklen_t addrlen)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	NetworkSocket::SocketAddress address;
+	ret = ConvertSocketAddress(addr, addrlen, &address);
+	if (ret < 0)
+		return ret;
+	return sock->Connect(address, node->inode->Flags & O_NONBLOCK);
+}
+
+static int sys_listen(SysFrm *Frame, int sockfd, int backlog)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+	return sock->Listen(backlog);
+}
+
+static int sys_accept(SysFrm *Frame, int sockfd, struct ksockaddr_in *addr, __SYS_socklen_t *addrlen)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	struct ksockaddr_in *pAddr = nullptr;
+	__SYS_socklen_t *pAddrlen = nullptr;
+	if (addr != nullptr)
+	{
+		pAddrlen = vma->UserCheckAndGetAddress(addrlen, sizeof(__SYS_socklen_t));
+		if (pAddrlen == nullptr)
+			return -EFAULT;
+		if (*pAddrlen < sizeof(struct ksockaddr_in))
+			return -EINVAL;
+
+		pAddr = vma->UserCheckAndGetAddress(addr, sizeof(struct ksockaddr_in));
+		if (pAddr == nullptr)
+			return -EFAULT;
+	}
+
+	NetworkSocket::SocketAddress peer;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	int ret = fdt->usr_accept(sockfd, &peer, 0);
+	if (ret < 0 || pAddr == nullptr)
+		return ret;
+
+	pAddr->sin_family = __SYS_AF_INET;
+	pAddr->sin_port = b16(peer.Port);
+	pAddr->sin_addr = b32(peer.Address);
+	*pAddrlen = sizeof(struct ksockaddr_in);
+	return ret;
+}
+
+static int ConvertMessageFlags(int flags)
+{
+	int ret = 0;
+	if (flags & __SYS_MSG_PEEK)
+		ret |= NetworkSocket::MESSAGE_PEEK;
+	if (flags & __SYS_MSG_WAITALL)
+		ret |= NetworkSocket::MESSAGE_WAITALL;
+	if (flags & __SYS_MSG_NOSIGNAL)
+		ret |= NetworkSocket::MESSAGE_NOSIGNAL;
+	return ret;
+}
+
+static ssize_t sys_send(SysFrm *Frame, int sockfd, const void *buf, size_t len, int flags)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	const void *pBuf = vma->UserCheckAndGetAddress(buf, len);
+	if (pBuf == nullptr)
+		return -EFAULT;
+
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+	return sock->Send(pBuf, len, ConvertMessageFlags(flags), node->inode->Flags & O_NONBLOCK);
+}
+
+static ssize_t sys_recv(SysFrm *Frame, int sockfd, void *buf, size_t len, int flags)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	void *pBuf = vma->UserCheckAndGetAddress(buf, len);
+	if (pBuf == nullptr)
+		return -EFAULT;
+
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+	return sock->Receive(pBuf, len, ConvertMessageFlags(flags), node->inode->Flags & O_NONBLOCK);
+}
+
+static int sys_shutdown(SysFrm *Frame, int sockfd, int how)
+{
+	Node node;
+	int ret;
+	NetworkSocket::Socket *sock = GetSocket(sockfd, node, &ret);
+	if (sock == nullptr)
+		return ret;
+
+	switch (how)
+	{
+	case __SYS_SHUT_RD:
+		return sock->Shutdown(NetworkSocket::SHUTDOWN_READ);
+	case __SYS_SHUT_WR:
+		return sock->Shutdown(NetworkSocket::SHUTDOWN_WRITE);
+	case __SYS_SHUT_RDWR:
+		return sock->Shutdown(NetworkSocket::SHUTDOWN_BOTH);
+	default:
+		return -EINVAL;
+	}
+}
+
 static time_t sys_time(SysFrm *Frame, time_t *t) { return -ENOSYS; }
 static int sys_clock_gettime(SysFrm *Frame, __SYS_clockid_t clockid, struct timespec *tp) { return -ENOSYS; }
 static int sys_clock_settime(SysFrm *Frame, __SYS_clockid_t clockid, const struct timespec *tp) { return -ENOSYS; }
@@ -280,6 +602,11 @@ __constructor void __init_native_syscalls(void)
 	init_syscall(SYS_CLOSE, sys_close);
 	init_syscall(SYS_IOCTL, sys_ioctl);
 	init_syscall(SYS_FCNTL, sys_fcntl);
+	init_syscall(SYS_READV, sys_readv);
+	init_syscall(SYS_WRITEV, sys_writev);
+	init_syscall(SYS_IO_URING_SETUP, sys_io_uring_setup);
+	init_syscall(SYS_IO_URING_ENTER, sys_io_uring_enter);
+	init_syscall(SYS_IO_URING_REGISTER, sys_io_uring_register);
 
 	/* File Status */
 	init_syscall(SYS_STAT, sys_stat);
@@ -17,6 +17,7 @@
 
 #include <task.hpp>
 
+#include <fs/uring.hpp>
 #include <dumper.hpp>
 #include <signal.hpp>
 #include <convert.h>
@@ -269,6 +270,9 @@ namespace Tasking
 			don't get scheduled anymore */
 		ctx->PopProcess(this);
 
+		/* Rings must not reach the address space past this point */
+		vfs::IoUring::DetachOwner(this);
+
 		debug("Freeing allocated memory");
 		delete this->ProgramBreak;
 		delete this->vma;
@@ -134,7 +134,7 @@ namespace Tasking::Scheduler
 
 	bool Custom::RemoveProcess(PCB *Process)
 	{
-		if (Process->State == Terminated)
+		if (Process->State == Terminated && Process->Holds.load() == 0)
 		{
 			delete Process;
 			return true;
@@ -553,6 +553,9 @@ namespace Tasking::Scheduler
 		{
 			if (pcb->State.load() == TaskState::Terminated)
 			{
+				if (pcb->Holds.load() > 0)
+					continue;
+
 				debug("Found terminated process %s(%d)", pcb->Name, pcb->ID);
 				delete pcb;
 				continue;
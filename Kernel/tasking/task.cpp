@@ -415,7 +415,7 @@ namespace Tasking
 	Task::Task(const IP EntryPoint)
 	{
 		Node root = fs->GetRoot(0);
-		FileSystemInfo *fsi = new FileSystemInfo;
+		FileSystemInfo *fsi = new FileSystemInfo{};
 		fsi->Name = "procfs";
 		fsi->SuperOps.AllocateInode = __task_AllocateInode;
 		fsi->SuperOps.DeleteInode = __task_DeleteInode;
@@ -427,6 +427,7 @@ namespace Tasking
 		fsi->Ops.SymLink = __task_SymLink;
 		fsi->Ops.ReadLink = __task_ReadLink;
 		fsi->Ops.Stat = __task_Stat;
+		fsi->Ops.Poll = nullptr;
 
 		/* d rwx rwx rwx */
 		mode_t mode = S_IRWXU |
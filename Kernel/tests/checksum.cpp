@@ -0,0 +1,134 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include <net/net.hpp>
+#include <convert.h>
+#include <debug.h>
+#include <cpu.hpp>
+
+typedef uint64_t (*SumFunction)(const void *, size_t, uint64_t);
+
+static const struct
+{
+	const char *Name;
+	SumFunction Sum;
+} ChecksumFunctions[] = {
+	{"scalar", ChecksumScalar},
+	{"sse2", ChecksumSSE2},
+	{"avx2", ChecksumAVX2},
+	{"partial", ChecksumPartial},
+};
+
+/* One big-endian word at a time, the way RFC 1071 describes it */
+static uint16_t ReferenceChecksum(const uint8_t *Data, size_t Length)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i + 1 < Length; i += 2)
+		sum += (uint16_t)((Data[i] << 8) | Data[i + 1]);
+	if (Length % 2)
+		sum += (uint16_t)(Data[Length - 1] << 8);
+	while (sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	return b16((uint16_t)~sum);
+}
+
+__constructor void TestChecksum()
+{
+	static uint8_t src[2048 + 64];
+	static uint8_t dst[2048 + 64];
+	const size_t sizes[] = {0, 1, 2, 3, 20, 63, 64, 65, 127, 128, 129,
+							255, 256, 257, 1023, 1460, 1500, 2048};
+
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = (uint8_t)(i * 131 + 17);
+
+	for (size_t n : sizes)
+	{
+		for (size_t align = 0; align < 16; align += 5)
+		{
+			const uint8_t *data = src + align;
+			uint16_t expected = ReferenceChecksum(data, n);
+
+			for (auto &fn : ChecksumFunctions)
+			{
+				if (ChecksumFinish(fn.Sum(data, n, 0)) != expected)
+				{
+					error("Checksum%s failed! (size %ld, align %ld)", fn.Name, n, align);
+					inf_loop;
+				}
+			}
+
+			if (ChecksumFinish(ChecksumCopy(dst + 3, data, n)) != expected ||
+				memcmp(dst + 3, data, n) != 0)
+			{
+				error("ChecksumCopy failed! (size %ld, align %ld)", n, align);
+				inf_loop;
+			}
+
+			/* Split at an odd and at an even offset */
+			const size_t splits[] = {n / 2, n / 3};
+			for (size_t split : splits)
+			{
+				uint64_t sum = ChecksumPartial(data, split);
+				sum = ChecksumAdd(sum, ChecksumPartial(data + split, n - split), split);
+				if (ChecksumFinish(sum) != expected)
+				{
+					error("ChecksumAdd failed! (size %ld, split %ld)", n, split);
+					inf_loop;
+				}
+			}
+		}
+	}
+
+	/* Rewrite a 16-bit and a 32-bit field, like a TTL and an address */
+	uint8_t header[20];
+	memcpy(header, src, sizeof(header));
+	uint16_t checksum = ReferenceChecksum(header, sizeof(header));
+
+	uint16_t old16, new16 = 0x4011;
+	memcpy(&old16, header + 8, 2);
+	memcpy(header + 8, &new16, 2);
+	checksum = ChecksumUpdate16(checksum, old16, new16);
+
+	uint32_t old32, new32 = 0x0100007F;
+	memcpy(&old32, header + 12, 4);
+	memcpy(header + 12, &new32, 4);
+	checksum = ChecksumUpdate32(checksum, old32, new32);
+
+	if (checksum != ReferenceChecksum(header, sizeof(header)))
+	{
+		error("Incremental checksum update failed!");
+		inf_loop;
+	}
+
+	/* Throughput on a full frame, in bytes per 1000 TSC cycles */
+	for (auto &fn : ChecksumFunctions)
+	{
+		const size_t iterations = 4096;
+		uint64_t sink = 0;
+		uint64_t start = CPU::Counter();
+		for (size_t i = 0; i < iterations; i++)
+			sink += fn.Sum(src, 1500, 0);
+		uint64_t cycles = CPU::Counter() - start;
+		debug("%-7s 1500 bytes: %ld B/kcycle (%#x)", fn.Name,
+			  (1500 * iterations * 1000) / (cycles ? cycles : 1), ChecksumFold(sink));
+	}
+}
+
+#endif // DEBUG
@@ -0,0 +1,131 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/dcache.hpp>
+#include <fs/vfs.hpp>
+
+#include "../kernel.h"
+
+#define DCACHE_TEST_FILES 64
+
+static void FillNameCache(NodeCache *Parent, const char *Prefix, size_t Count)
+{
+	char name[32];
+	for (size_t i = 0; i < Count; i++)
+	{
+		int length = snprintf(name, sizeof(name), "%s%ld", Prefix, i);
+		vfs::NameCacheInsert(Parent, name, length, vfs::HashName(name, length), nullptr);
+	}
+}
+
+static void DropNameCache(NodeCache *Parent, const char *Prefix, size_t Count)
+{
+	char name[32];
+	for (size_t i = 0; i < Count; i++)
+	{
+		int length = snprintf(name, sizeof(name), "%s%ld", Prefix, i);
+		vfs::NameCacheInvalidate(Parent, name, length);
+	}
+}
+
+static vfs::NameCacheResult NameCacheProbe(NodeCache *Parent, const char *Name)
+{
+	Node result;
+	size_t length = strlen(Name);
+	return vfs::NameCacheLookup(Parent, Name, length, vfs::HashName(Name, length), &result);
+}
+
+/* The least recently used entry goes first, a lookup makes an entry young again */
+static void TestNameCacheEviction(Node &Directory)
+{
+	NodeCache *parent = Directory.get();
+
+	/* Push everything else out so the order below is all ours */
+	FillNameCache(parent, "a", DCACHE_MAX_ENTRIES);
+	vfs::NameCacheInsert(parent, "old", 3, vfs::HashName("old", 3), nullptr);
+	vfs::NameCacheInsert(parent, "young", 5, vfs::HashName("young", 5), nullptr);
+	assert(vfs::GetNameCacheStatistics().Entries == DCACHE_MAX_ENTRIES);
+
+	assert(NameCacheProbe(parent, "old") == vfs::NAME_CACHE_NEGATIVE);
+
+	/* The rest of the first batch goes, then "young" */
+	vfs::NameCacheStatistics before = vfs::GetNameCacheStatistics();
+	FillNameCache(parent, "b", DCACHE_MAX_ENTRIES - 1);
+	vfs::NameCacheStatistics after = vfs::GetNameCacheStatistics();
+	assert(after.Evictions >= before.Evictions + DCACHE_MAX_ENTRIES - 1);
+
+	assert(NameCacheProbe(parent, "young") == vfs::NAME_CACHE_MISS);
+	assert(NameCacheProbe(parent, "old") == vfs::NAME_CACHE_NEGATIVE);
+	assert(NameCacheProbe(parent, "a0") == vfs::NAME_CACHE_MISS);
+	assert(NameCacheProbe(parent, "b0") == vfs::NAME_CACHE_NEGATIVE);
+
+	DropNameCache(parent, "b", DCACHE_MAX_ENTRIES - 1);
+	vfs::NameCacheInvalidate(parent, "old", 3);
+}
+
+void TestNameCache()
+{
+	TmpDirectory tmp("dcache_test");
+	if (!tmp.Valid())
+		return;
+
+	Node root = fs->GetRoot(0);
+	Node &dir = tmp.Directory;
+	char name[32];
+	for (int i = 0; i < DCACHE_TEST_FILES; i++)
+	{
+		snprintf(name, sizeof(name), "f%d", i);
+		assert(fs->Create(dir, name, S_IRWXU | S_IFREG, false));
+	}
+
+	/* Every step is a cache hit, "." and ".." are walked in place */
+	Node found = fs->Lookup(root, "/tmp/./dcache_test/../dcache_test/f7");
+	assert(found != nullptr && found->Name == "f7");
+	assert(found->Parent == dir);
+
+	vfs::NameCacheStatistics before = vfs::GetNameCacheStatistics();
+	Node again = fs->Lookup(root, "/tmp/dcache_test/f7");
+	assert(again == found);
+	vfs::NameCacheStatistics after = vfs::GetNameCacheStatistics();
+	assert(after.Hits >= before.Hits + 3);
+
+	before = vfs::GetNameCacheStatistics();
+	assert(fs->Lookup(dir, "missing").Error == -ENOENT);
+	assert(fs->Lookup(dir, "missing").Error == -ENOENT);
+	after = vfs::GetNameCacheStatistics();
+	if (dir->fsi->Flags & FS_NEGATIVE_CACHE)
+		assert(after.NegativeHits == before.NegativeHits + 1);
+
+	/* Creating the name must drop the negative entry */
+	Node created = fs->Create(dir, "missing", S_IRWXU | S_IFREG, true);
+	assert(created != nullptr);
+	eNode lookup = fs->Lookup(dir, "missing");
+	assert(lookup && lookup.Value == created);
+
+	/* and removing it must not leave the positive one behind */
+	assert(fs->Remove(dir, "missing") == 0);
+	assert(NameCacheProbe(dir.get(), "missing") == vfs::NAME_CACHE_MISS);
+	assert(fs->Lookup(dir, "missing").Error == -ENOENT);
+
+	TestNameCacheEviction(dir);
+}
+
+#endif // DEBUG
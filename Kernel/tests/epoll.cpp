@@ -0,0 +1,106 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/epoll.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+static vfs::EventPoll *EpollOf(vfs::FileDescriptorTable *fdt, int fd)
+{
+	auto file = fdt->GetFileDescriptor(fd);
+	assert(file != nullptr);
+	return vfs::EventPoll::FromNode(file->node);
+}
+
+static int EpollAdd(vfs::FileDescriptorTable *fdt, int epfd, int fd, uint64_t Data)
+{
+	vfs::EventPoll::Event event = {POLLIN, Data};
+	auto file = fdt->GetFileDescriptor(fd);
+	assert(file != nullptr);
+	return EpollOf(fdt, epfd)->Control(EPOLL_CTL_ADD, fd, file.get(), &event);
+}
+
+void TestEventPoll()
+{
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	vfs::EventPoll::Event events[4];
+
+	int a = fdt->usr_epoll_create(0);
+	int b = fdt->usr_epoll_create(0);
+	int c = fdt->usr_epoll_create(0);
+	assert(a >= 0 && b >= 0 && c >= 0);
+
+	/* Nesting is fine, closing a loop is not */
+	assert(EpollAdd(fdt, a, a, 0) == -EINVAL);
+	assert(EpollAdd(fdt, a, b, 0) == 0);
+	assert(EpollAdd(fdt, b, c, 0) == 0);
+	assert(EpollAdd(fdt, b, a, 0) == -ELOOP);
+	assert(EpollAdd(fdt, c, a, 0) == -ELOOP);
+
+	/* Each add nests everything below it one level deeper */
+	int chain[EPOLL_MAX_NESTS + 2];
+	for (int i = 0; i < EPOLL_MAX_NESTS + 2; i++)
+	{
+		chain[i] = fdt->usr_epoll_create(0);
+		assert(chain[i] >= 0);
+	}
+	for (int i = EPOLL_MAX_NESTS; i > 0; i--)
+		assert(EpollAdd(fdt, chain[i], chain[i + 1], 0) == 0);
+	assert(EpollAdd(fdt, chain[0], chain[1], 0) == -ELOOP);
+	for (int i = 0; i < EPOLL_MAX_NESTS + 2; i++)
+		assert(fdt->usr_close(chain[i]) == 0);
+
+	/* Closing the last descriptor of a file drops it from the interest list */
+	int pipefd[2];
+	assert(fdt->usr_pipe(pipefd, 0) == 0);
+	assert(EpollAdd(fdt, c, pipefd[0], 42) == 0);
+	assert(fdt->usr_write(pipefd[1], "x", 1) == 1);
+	assert(EpollOf(fdt, c)->Wait(events, 4, 0) == 1);
+	assert(events[0].Data == 42);
+
+	int dup = fdt->usr_dup(pipefd[0]);
+	assert(dup >= 0);
+	assert(fdt->usr_close(pipefd[0]) == 0);
+	assert(EpollOf(fdt, c)->Wait(events, 4, 0) == 1);
+	assert(fdt->usr_close(dup) == 0);
+	assert(EpollOf(fdt, c)->Wait(events, 4, 0) == 0);
+
+	/* The fd number is free again for a new item */
+	assert(fdt->usr_pipe(pipefd, 0) == 0);
+	assert(EpollAdd(fdt, c, pipefd[0], 43) == 0);
+	assert(fdt->usr_close(pipefd[0]) == 0);
+	assert(fdt->usr_close(pipefd[1]) == 0);
+
+	/* A closed nested instance goes away with its items */
+	assert(fdt->usr_close(c) == 0);
+	assert(EpollOf(fdt, b)->Wait(events, 4, 0) == 0);
+	assert(EpollAdd(fdt, b, a, 0) == -ELOOP);
+	assert(fdt->usr_close(a) == 0);
+	c = fdt->usr_epoll_create(0);
+	assert(c >= 0);
+	assert(EpollAdd(fdt, c, b, 0) == 0);
+	assert(fdt->usr_close(b) == 0);
+	assert(fdt->usr_close(c) == 0);
+	debug("epoll test passed");
+}
+
+#endif // DEBUG
@@ -0,0 +1,97 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/vfs.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+#define FDT_TEST_DESCRIPTORS 200
+
+void TestFileDescriptors()
+{
+	TmpDirectory tmp("fdt_test");
+	if (!tmp.Valid())
+		return;
+
+	Node file = fs->Create(tmp.Directory, "file", S_IRWXU | S_IFREG, false);
+	assert(file != nullptr);
+	assert(fs->Write(file, "0123456789", 10, 0) == 10);
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	int fd = fdt->usr_open(tmp.PathOf("file").c_str(), O_RDWR, 0);
+	assert(fd >= 0);
+
+	/* Duplicates share the offset */
+	int dup = fdt->usr_dup(fd);
+	assert(dup > fd);
+	assert(fdt->usr_lseek(fd, 3, SEEK_SET) == 3);
+	assert(fdt->usr_lseek(dup, 0, SEEK_CUR) == 3);
+
+	/* but not FD_CLOEXEC */
+	int high = fdt->usr_dupfd(fd, 100, O_CLOEXEC);
+	assert(high == 100);
+	assert(fdt->GetDescriptorFlags(high) == FD_CLOEXEC);
+	assert(fdt->GetDescriptorFlags(fd) == 0);
+	assert(fdt->usr_close(high) == 0);
+	assert(fdt->GetFileDescriptor(high) == nullptr);
+	assert(fdt->usr_close(dup) == 0);
+
+	int fds[FDT_TEST_DESCRIPTORS];
+	for (int i = 0; i < FDT_TEST_DESCRIPTORS; i++)
+	{
+		fds[i] = fdt->usr_dup(fd);
+		assert(fds[i] >= 0);
+		if (i > 0)
+			assert(fds[i] > fds[i - 1]);
+	}
+
+	/* Closed descriptors come back lowest first, whatever order they were closed in */
+	const int closed[] = {150, 3, 70, 199, 64, 65};
+	for (int i : closed)
+		assert(fdt->usr_close(fds[i]) == 0);
+
+	const int reused[] = {3, 64, 65, 70, 150, 199};
+	for (int i : reused)
+		assert(fdt->usr_dup(fd) == fds[i]);
+
+	/* A minimum skips the free ones below it */
+	assert(fdt->usr_close(fds[10]) == 0);
+	assert(fdt->usr_close(fds[20]) == 0);
+	assert(fdt->usr_dupfd(fd, fds[10] + 1, 0) == fds[20]);
+	assert(fdt->usr_dup(fd) == fds[10]);
+
+	/* dup2 replaces an open descriptor in place */
+	assert(fdt->usr_dup2(fd, fds[0]) == fds[0]);
+	assert(fdt->usr_lseek(fds[0], 0, SEEK_CUR) == 3);
+	assert(fdt->usr_dup2(fd, fd) == fd);
+
+	for (int i = 0; i < FDT_TEST_DESCRIPTORS; i++)
+		assert(fdt->usr_close(fds[i]) == 0);
+	assert(fdt->usr_close(fd) == 0);
+	assert(fdt->usr_close(fd) == -EBADF);
+	assert(fdt->GetFileDescriptor(fds[0]) == nullptr);
+
+	/* Closing never removes the file itself */
+	assert(fs->Lookup(tmp.Directory, "file"));
+}
+
+#endif // DEBUG
@@ -0,0 +1,53 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include "../kernel.h"
+
+TmpDirectory::TmpDirectory(const char *Name) : Name(Name)
+{
+	Node root = fs->GetRoot(0);
+	eNode tmp = fs->Lookup(root, "/tmp");
+	if (!tmp)
+	{
+		KPrint("%s: /tmp is missing", Name);
+		return;
+	}
+
+	this->Tmp = tmp.Value;
+	this->Directory = fs->Create(this->Tmp, Name, S_IRWXU | S_IFDIR, false);
+	assert(this->Directory != nullptr);
+	this->Path = std::string("/tmp/") + Name;
+}
+
+TmpDirectory::~TmpDirectory()
+{
+	if (!this->Valid())
+		return;
+
+	/* Tests only create files, so one level is enough */
+	for (const Node &entry : fs->ReadDirectory(this->Directory))
+		assert(fs->Remove(this->Directory, entry->Name) == 0);
+
+	assert(fs->Remove(this->Tmp, this->Name) == 0);
+	assert(!fs->Lookup(this->Tmp, this->Name.c_str()));
+}
+
+#endif // DEBUG
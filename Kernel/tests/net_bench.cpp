@@ -0,0 +1,305 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <net/loopback.hpp>
+#include <net/packet.hpp>
+#include <net/socket.hpp>
+#include <net/udp.hpp>
+#include <atomic>
+
+#include "../kernel.h"
+
+/*
+	Loopback benchmarks for the network stack. Everything runs
+	over lo, so the numbers are the cost of the protocol code
+	and the copies, not of any NIC.
+*/
+
+#define BENCH_PORT 5201
+#define BENCH_STREAM_BYTES (64 * 1024 * 1024)
+#define BENCH_RTT_ROUNDS 2000
+#define BENCH_UDP_PACKETS 20000
+#define BENCH_TIMEOUT_NS (10ULL * 1000 * 1000 * 1000)
+
+using namespace NetworkSocket;
+
+static uint64_t NowNs() { return TimeManager->GetTimeNs(); }
+
+/* Bytes over nanoseconds, in Mbit/s */
+static unsigned long long Mbits(uint64_t Bytes, uint64_t Elapsed)
+{
+	if (Elapsed == 0)
+		return 0;
+	return (unsigned long long)(Bytes * 8 * 1000 / Elapsed);
+}
+
+static bool TcpPair(Socket **Client, Socket **Server, uint16_t Port)
+{
+	Socket *listener = nullptr, *client = nullptr, *server = nullptr;
+	SocketAddress address = {.Address = 0x7F000001, .Port = Port};
+
+	if (Create(DOMAIN_INET, TYPE_STREAM, 0, &listener) < 0)
+		return false;
+
+	int one = 1;
+	listener->SetOption(OPTION_REUSEADDR, &one, sizeof(one));
+	if (listener->Bind(address) < 0 || listener->Listen(1) < 0)
+		goto Fail;
+
+	if (Create(DOMAIN_INET, TYPE_STREAM, 0, &client) < 0)
+		goto Fail;
+
+	if (client->Connect(address, false) < 0)
+		goto Fail;
+
+	if (listener->Accept(&server, nullptr, false) < 0)
+		goto Fail;
+
+	listener->Release();
+	*Client = client;
+	*Server = server;
+	return true;
+
+Fail:
+	if (client)
+		client->Release();
+	listener->Release();
+	return false;
+}
+
+static Socket *StreamReceiver = nullptr;
+static std::atomic_size_t StreamReceived = 0;
+
+static void StreamReceiveThread()
+{
+	uint8_t *buffer = (uint8_t *)kmalloc(64 * 1024);
+	while (true)
+	{
+		ssize_t ret = StreamReceiver->Receive(buffer, 64 * 1024, 0, false);
+		if (ret <= 0)
+			break;
+		StreamReceived.fetch_add(ret);
+	}
+	kfree(buffer);
+}
+
+static void BenchTcpStream()
+{
+	Socket *client, *server;
+	if (!TcpPair(&client, &server, BENCH_PORT))
+	{
+		KPrint("netbench: tcp stream: \x1b[31mconnection failed");
+		return;
+	}
+
+	StreamReceiver = server;
+	StreamReceived.store(0);
+	Tasking::TCB *rx = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+												 Tasking::IP(StreamReceiveThread));
+	rx->Rename("netbench rx");
+
+	uint8_t *buffer = (uint8_t *)kmalloc(64 * 1024);
+	memset(buffer, 0xAA, 64 * 1024);
+
+	size_t sent = 0;
+	uint64_t start = NowNs();
+	while (sent < BENCH_STREAM_BYTES)
+	{
+		ssize_t ret = client->Send(buffer, 64 * 1024, 0, false);
+		if (ret < 0)
+			break;
+		sent += ret;
+	}
+	client->Shutdown(SHUTDOWN_WRITE);
+	TaskManager->WaitForThread(rx);
+	uint64_t elapsed = NowNs() - start;
+	kfree(buffer);
+
+	KPrint("netbench: tcp stream: %llu MiB in %llu ms, %llu Mbit/s",
+		   (unsigned long long)TO_MiB(StreamReceived.load()),
+		   (unsigned long long)(elapsed / 1000000),
+		   Mbits(StreamReceived.load(), elapsed));
+
+	client->Release();
+	server->Release();
+}
+
+static void BenchTcpLatency()
+{
+	Socket *client, *server;
+	if (!TcpPair(&client, &server, BENCH_PORT + 1))
+	{
+		KPrint("netbench: tcp rtt: \x1b[31mconnection failed");
+		return;
+	}
+
+	int one = 1;
+	client->SetOption(OPTION_NODELAY, &one, sizeof(one));
+	server->SetOption(OPTION_NODELAY, &one, sizeof(one));
+
+	uint8_t byte = 0;
+	int rounds = 0;
+	uint64_t start = NowNs();
+	for (; rounds < BENCH_RTT_ROUNDS; rounds++)
+	{
+		if (client->Send(&byte, 1, 0, false) != 1 ||
+			server->Receive(&byte, 1, 0, false) != 1 ||
+			server->Send(&byte, 1, 0, false) != 1 ||
+			client->Receive(&byte, 1, 0, false) != 1)
+			break;
+	}
+	uint64_t elapsed = NowNs() - start;
+
+	if (rounds == 0)
+		KPrint("netbench: tcp rtt: \x1b[31mno round trips completed");
+	else
+		KPrint("netbench: tcp rtt: %d rounds, %llu us average",
+			   rounds, (unsigned long long)(elapsed / rounds / 1000));
+
+	client->Release();
+	server->Release();
+}
+
+class UdpCounter : public NetworkUDP::UDPEvents
+{
+public:
+	std::atomic_size_t Packets = 0;
+	std::atomic_size_t Bytes = 0;
+	bool Echo = false;
+
+	void OnUDPPacketReceived(NetworkUDP::Socket *Socket, uint8_t *Data, size_t Length)
+	{
+		if (Echo)
+			Socket->SocketUDP->Send(Socket, Data, Length);
+		Packets.fetch_add(1);
+		Bytes.fetch_add(Length);
+	}
+};
+
+static void BenchUdpFlood(NetworkUDP::UDP *udp, size_t Size)
+{
+	InternetProtocol lo = {};
+	lo.v4.FromHex(0x7F000001);
+
+	UdpCounter counter;
+	NetworkUDP::Socket *rx = udp->Listen(0);
+	udp->Bind(rx, &counter);
+	NetworkUDP::Socket *tx = udp->Connect(lo, b16(rx->LocalPort));
+
+	uint8_t *buffer = (uint8_t *)kmalloc(Size);
+	memset(buffer, 0x55, Size);
+
+	NetworkLoopback::Statistics before = NetworkLoopback::GetStatistics();
+	uint64_t start = NowNs();
+	for (size_t i = 0; i < BENCH_UDP_PACKETS; i++)
+		udp->Send(tx, buffer, Size);
+
+	size_t dropped = 0;
+	while (NowNs() - start < BENCH_TIMEOUT_NS)
+	{
+		dropped = NetworkLoopback::GetStatistics().Dropped - before.Dropped;
+		if (counter.Packets.load() + dropped >= BENCH_UDP_PACKETS)
+			break;
+		TaskManager->Yield();
+	}
+	uint64_t elapsed = NowNs() - start;
+	kfree(buffer);
+
+	size_t received = counter.Packets.load();
+	KPrint("netbench: udp %ld bytes: %ld/%d received, %ld dropped, %llu pps, %llu Mbit/s",
+		   Size, received, BENCH_UDP_PACKETS, dropped,
+		   (unsigned long long)(elapsed ? received * 1000000000ULL / elapsed : 0),
+		   Mbits(counter.Bytes.load(), elapsed));
+
+	udp->Disconnect(tx);
+	udp->Disconnect(rx);
+}
+
+static void BenchUdpLatency(NetworkUDP::UDP *udp)
+{
+	InternetProtocol lo = {};
+	lo.v4.FromHex(0x7F000001);
+
+	UdpCounter echo, reply;
+	echo.Echo = true;
+
+	/* rx connects itself to tx on the first datagram */
+	NetworkUDP::Socket *rx = udp->Listen(0);
+	NetworkUDP::Socket *tx = udp->Connect(lo, b16(rx->LocalPort));
+	udp->Bind(rx, &echo);
+	udp->Bind(tx, &reply);
+
+	uint8_t byte = 0;
+	int rounds = 0;
+	uint64_t start = NowNs();
+	for (; rounds < BENCH_RTT_ROUNDS; rounds++)
+	{
+		udp->Send(tx, &byte, 1);
+		while (reply.Packets.load() <= (size_t)rounds &&
+			   NowNs() - start < BENCH_TIMEOUT_NS)
+			TaskManager->Yield();
+
+		if (reply.Packets.load() <= (size_t)rounds)
+			break;
+	}
+	uint64_t elapsed = NowNs() - start;
+
+	if (rounds == 0)
+		KPrint("netbench: udp rtt: \x1b[31mno round trips completed");
+	else
+		KPrint("netbench: udp rtt: %d rounds, %llu us average",
+			   rounds, (unsigned long long)(elapsed / rounds / 1000));
+
+	udp->Disconnect(tx);
+	udp->Disconnect(rx);
+}
+
+void NetworkBenchmark()
+{
+	NetworkLoopback::Stack *lo = NetworkLoopback::GetStack();
+	if (lo == nullptr)
+	{
+		KPrint("netbench: \x1b[31mloopback interface is not available");
+		return;
+	}
+
+	KPrint("netbench: running over %s", lo->Interface->Name);
+	BenchTcpStream();
+	BenchTcpLatency();
+	BenchUdpFlood(lo->UDP, 18);
+	BenchUdpFlood(lo->UDP, 1400);
+	BenchUdpLatency(lo->UDP);
+
+	NetworkLoopback::Statistics stats = NetworkLoopback::GetStatistics();
+	KPrint("netbench: lo %llu frames, %llu bytes, %llu dropped",
+		   (unsigned long long)stats.Frames,
+		   (unsigned long long)stats.Bytes,
+		   (unsigned long long)stats.Dropped);
+
+	NetworkPacket::Statistics pool = NetworkPacket::GetStatistics();
+	KPrint("netbench: packet pool %llu buffers, %llu in use, %llu cache hits, %llu oversized",
+		   (unsigned long long)pool.Created,
+		   (unsigned long long)pool.InUse,
+		   (unsigned long long)pool.CacheHits,
+		   (unsigned long long)pool.Oversized);
+}
+
+#endif // DEBUG
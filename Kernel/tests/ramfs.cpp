@@ -0,0 +1,117 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/vfs.hpp>
+
+#include "../kernel.h"
+
+#define RAMFS_TEST_PAGES 16
+
+static void AssertZeros(const uint8_t *Buffer, size_t Size)
+{
+	for (size_t i = 0; i < Size; i++)
+		assert(Buffer[i] == 0);
+}
+
+void TestRAMFS()
+{
+	TmpDirectory tmp("ramfs_test");
+	if (!tmp.Valid())
+		return;
+
+	if (strcmp(tmp.Directory->fsi->Name, "tmpfs") != 0)
+	{
+		KPrint("ramfs: /tmp is not a tmpfs mount");
+		return;
+	}
+
+	Node file = fs->Create(tmp.Directory, "sparse", S_IRWXU | S_IFREG, false);
+	assert(file != nullptr);
+
+	/* Sparse write, the first pages stay a hole */
+	const char data[] = "fennix";
+	off_t far = 3 * PAGE_SIZE + 100;
+	assert(fs->Write(file, data, sizeof(data), far) == sizeof(data));
+
+	struct kstat st;
+	assert(fs->Stat(file, &st) == 0);
+	assert(st.Size == far + (off_t)sizeof(data));
+	assert(st.Blocks == PAGE_SIZE / 512);
+
+	/* Holes read as zeros, also when a read runs from one into data */
+	uint8_t *buf = new uint8_t[PAGE_SIZE];
+	memset(buf, 0xFF, PAGE_SIZE);
+	assert(fs->Read(file, buf, PAGE_SIZE, 0) == PAGE_SIZE);
+	AssertZeros(buf, PAGE_SIZE);
+
+	memset(buf, 0xFF, PAGE_SIZE);
+	assert(fs->Read(file, buf, 200, far - 100) == 100 + sizeof(data));
+	AssertZeros(buf, 100);
+	assert(memcmp(buf + 100, data, sizeof(data)) == 0);
+
+	/* Reading a hole must not fill it */
+	assert(fs->Stat(file, &st) == 0);
+	assert(st.Blocks == PAGE_SIZE / 512);
+
+	/* Shrinking frees the tail and growing back reads zeros */
+	assert(fs->Truncate(file, far + 2) == 0);
+	assert(fs->Truncate(file, far + sizeof(data)) == 0);
+	memset(buf, 0xFF, PAGE_SIZE);
+	assert(fs->Read(file, buf, sizeof(data), far) == sizeof(data));
+	assert(buf[0] == 'f' && buf[1] == 'e');
+	AssertZeros(buf + 2, sizeof(data) - 2);
+
+	assert(fs->Truncate(file, 0) == 0);
+	assert(fs->Stat(file, &st) == 0);
+	assert(st.Size == 0 && st.Blocks == 0);
+
+	/* Appends that straddle pages land where they were written */
+	for (off_t i = 0; i < RAMFS_TEST_PAGES * 3; i++)
+	{
+		memset(buf, (uint8_t)(i + 1), PAGE_SIZE / 3);
+		assert(fs->Write(file, buf, PAGE_SIZE / 3, i * (PAGE_SIZE / 3)) == PAGE_SIZE / 3);
+	}
+	assert(fs->Stat(file, &st) == 0);
+	assert(st.Size == RAMFS_TEST_PAGES * 3 * (PAGE_SIZE / 3));
+	assert(st.Blocks == (off_t)TO_PAGES(st.Size) * (PAGE_SIZE / 512));
+
+	for (off_t i = 0; i < RAMFS_TEST_PAGES * 3; i++)
+	{
+		assert(fs->Read(file, buf, PAGE_SIZE / 3, i * (PAGE_SIZE / 3)) == PAGE_SIZE / 3);
+		for (size_t j = 0; j < PAGE_SIZE / 3; j++)
+			assert(buf[j] == (uint8_t)(i + 1));
+	}
+
+	/* Down to the first page, where the tree collapses to the page itself, and back */
+	assert(fs->Truncate(file, PAGE_SIZE / 3) == 0);
+	assert(fs->Stat(file, &st) == 0);
+	assert(st.Blocks == PAGE_SIZE / 512);
+	assert(fs->Write(file, data, sizeof(data), far) == sizeof(data));
+	assert(fs->Read(file, buf, PAGE_SIZE / 3, 0) == PAGE_SIZE / 3);
+	for (size_t j = 0; j < PAGE_SIZE / 3; j++)
+		assert(buf[j] == 1);
+	assert(fs->Read(file, buf, sizeof(data), far) == sizeof(data));
+	assert(memcmp(buf, data, sizeof(data)) == 0);
+
+	delete[] buf;
+}
+
+#endif // DEBUG
@@ -15,11 +15,181 @@
 	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#ifdef DEBUG
+
+#include "t.h"
+
 #include <fs/vfs.hpp>
+#include <task.hpp>
+#include <atomic>
 
 #include "../kernel.h"
 
-#ifdef DEBUG
+#define READDIR_TEST_FILES 1000
+#define READDIR_TEST_CREATES 256
+
+static Node SnapshotDirectory;
+static std::atomic_bool CreatorDone = false;
+
+/* Index of a "f123" style name, or -1 for other names */
+static int EntryIndex(const char *Name, char Prefix)
+{
+	if (Name[0] != Prefix || Name[1] == '\0')
+		return -1;
+
+	int index = 0;
+	for (const char *c = Name + 1; *c; c++)
+		index = index * 10 + (*c - '0');
+	return index;
+}
+
+/**
+ * Read the directory through Snapshot from the start, a
+ * small buffer at a time so creates land in the middle
+ *
+ * @return Number of entries read
+ */
+static size_t ReadPass(Node &Target, vfs::DirectorySnapshot *&Snapshot, uint8_t *Seen, uint8_t *SeenCreated)
+{
+	memset(Seen, 0, READDIR_TEST_FILES);
+	memset(SeenCreated, 0, READDIR_TEST_CREATES);
+
+	uint8_t buf[512];
+	off_t offset = 0;
+	size_t count = 0;
+	while (true)
+	{
+		ssize_t bytes = fs->ReadDirectory(Target, Snapshot, (kdirent *)buf, sizeof(buf), offset);
+		assert(bytes >= 0);
+		if (bytes == 0)
+			break;
+
+		for (ssize_t pos = 0; pos < bytes;)
+		{
+			kdirent *ent = (kdirent *)(buf + pos);
+			assert(ent->d_reclen != 0);
+			pos += ent->d_reclen;
+			count++;
+
+			/* No entry may be listed twice, however the directory grows */
+			int index = EntryIndex(ent->d_name, 'f');
+			if (index >= 0)
+			{
+				assert(index < READDIR_TEST_FILES && Seen[index]++ == 0);
+				continue;
+			}
+
+			index = EntryIndex(ent->d_name, 'c');
+			if (index >= 0)
+			{
+				assert(index < READDIR_TEST_CREATES && SeenCreated[index]++ == 0);
+				continue;
+			}
+
+			assert(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 ||
+				   strcmp(ent->d_name, "late") == 0);
+		}
+	}
+
+	/* and none that was there before the pass started may be missed */
+	for (int i = 0; i < READDIR_TEST_FILES; i++)
+		assert(Seen[i] == 1);
+	return count;
+}
+
+/**
+ * Read the directory through Snapshot from the start and
+ * remove each "f" entry as soon as it is listed, like rm -r
+ */
+static void RemovePass(Node &Target, vfs::DirectorySnapshot *&Snapshot, uint8_t *Seen)
+{
+	memset(Seen, 0, READDIR_TEST_FILES);
+
+	uint8_t buf[512];
+	off_t offset = 0;
+	while (true)
+	{
+		ssize_t bytes = fs->ReadDirectory(Target, Snapshot, (kdirent *)buf, sizeof(buf), offset);
+		assert(bytes >= 0);
+		if (bytes == 0)
+			break;
+
+		for (ssize_t pos = 0; pos < bytes;)
+		{
+			kdirent *ent = (kdirent *)(buf + pos);
+			assert(ent->d_reclen != 0);
+			pos += ent->d_reclen;
+
+			int index = EntryIndex(ent->d_name, 'f');
+			if (index < 0)
+				continue;
+
+			assert(index < READDIR_TEST_FILES && Seen[index]++ == 0);
+			assert(fs->Remove(Target, ent->d_name) == 0);
+		}
+	}
+
+	/* Removing entries before the cursor must not skip the ones after it */
+	for (int i = 0; i < READDIR_TEST_FILES; i++)
+		assert(Seen[i] == 1);
+}
+
+static void SnapshotCreator()
+{
+	char name[16];
+	for (int i = 0; i < READDIR_TEST_CREATES; i++)
+	{
+		sprintf(name, "c%d", i);
+		assert(fs->Create(SnapshotDirectory, name, S_IRWXU | S_IFREG));
+	}
+	CreatorDone.store(true);
+}
+
+void TestDirectorySnapshot()
+{
+	TmpDirectory tmp("readdir_test");
+	if (!tmp.Valid())
+		return;
+
+	Node &dir = tmp.Directory;
+	char name[16];
+	for (int i = 0; i < READDIR_TEST_FILES; i++)
+	{
+		sprintf(name, "f%d", i);
+		assert(fs->Create(dir, name, S_IRWXU | S_IFREG));
+	}
+
+	uint8_t *seen = new uint8_t[READDIR_TEST_FILES];
+	uint8_t *seenCreated = new uint8_t[READDIR_TEST_CREATES];
+	vfs::DirectorySnapshot *snapshot = nullptr;
+	assert(ReadPass(dir, snapshot, seen, seenCreated) == READDIR_TEST_FILES + 2);
+
+	/* A file created between passes is picked up by the rewind */
+	assert(fs->Create(dir, "late", S_IRWXU | S_IFREG));
+	assert(ReadPass(dir, snapshot, seen, seenCreated) == READDIR_TEST_FILES + 3);
+	assert(snapshot->Entries.size() == READDIR_TEST_FILES + 3);
+
+	/* Entries keep their place while another thread adds more */
+	SnapshotDirectory = dir;
+	CreatorDone.store(false);
+	Tasking::TCB *creator = TaskManager->CreateThread(thisProcess, Tasking::IP(SnapshotCreator));
+	creator->Rename("readdir creator");
+	while (!CreatorDone.load())
+		ReadPass(dir, snapshot, seen, seenCreated);
+	TaskManager->WaitForThread(creator);
+	SnapshotDirectory = nullptr;
+
+	assert(ReadPass(dir, snapshot, seen, seenCreated) == READDIR_TEST_FILES + READDIR_TEST_CREATES + 3);
+	for (int i = 0; i < READDIR_TEST_CREATES; i++)
+		assert(seenCreated[i] == 1);
+
+	RemovePass(dir, snapshot, seen);
+	assert(fs->ReadDirectory(dir).size() == READDIR_TEST_CREATES + 1);
+
+	delete snapshot;
+	delete[] seen;
+	delete[] seenCreated;
+}
 
 void TestReadDirectory(Node &Target)
 {
@@ -0,0 +1,229 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include <flat_hash_map>
+#include <unordered_map>
+#include <cassert>
+#include <debug.h>
+#include <string>
+#include <cpu.hpp>
+
+#define BENCH_KEYS 4096
+
+void __stl_flat_hash_map_test_insert_find_erase()
+{
+	flat_hash_map<int, int> map;
+	assert(map.empty());
+
+	for (int i = 0; i < 1000; i++)
+		assert(map.insert({i, i * 2}).second);
+	assert(map.size() == 1000);
+	assert(!map.insert({5, 0}).second);
+
+	for (int i = 0; i < 1000; i++)
+	{
+		auto it = map.find(i);
+		assert(it != map.end());
+		assert(it->second == i * 2);
+	}
+	assert(map.find(1000) == map.end());
+
+	for (int i = 0; i < 1000; i += 2)
+		assert(map.erase(i) == 1);
+	assert(map.erase(0) == 0);
+	assert(map.size() == 500);
+
+	for (int i = 0; i < 1000; i++)
+		assert(map.contains(i) == (i % 2 == 1));
+
+	size_t count = 0;
+	for (auto &&[key, value] : map)
+	{
+		assert(value == key * 2);
+		count++;
+	}
+	assert(count == 500);
+
+	for (auto it = map.begin(); it != map.end();)
+	{
+		if (it->first % 3 == 0)
+			it = map.erase(it);
+		else
+			++it;
+	}
+	for (int i = 1; i < 1000; i += 2)
+		assert(map.contains(i) == (i % 3 != 0));
+
+	map.clear();
+	assert(map.empty());
+	assert(map.find(1) == map.end());
+}
+
+void __stl_flat_hash_map_test_strings_copy_move()
+{
+	flat_hash_map<std::string, int> map;
+	map["one"] = 1;
+	map["two"] = 2;
+	map["a key that is longer than the inline string buffer"] = 3;
+	assert(map.at("one") == 1);
+	assert(map.at(std::string("two")) == 2);
+	assert(map["a key that is longer than the inline string buffer"] == 3);
+
+	flat_hash_map<std::string, int> copy(map);
+	copy["one"] = 10;
+	assert(map["one"] == 1);
+	assert(copy["one"] == 10);
+	assert(copy.size() == 3);
+
+	flat_hash_map<std::string, int> moved(std::move(copy));
+	assert(copy.empty());
+	assert(moved["two"] == 2);
+
+	flat_hash_map<std::string, int> list = {{"x", 1}, {"y", 2}};
+	assert(list.size() == 2);
+	assert(list.count("y") == 1);
+}
+
+/* Catches comparisons against slots that hold no key */
+struct __stl_flat_hash_map_probe_key
+{
+	static constexpr uint32_t Alive = 0x4b455931;
+	uint32_t Magic = Alive;
+	int Value;
+
+	__stl_flat_hash_map_probe_key(int Value) : Value(Value) {}
+	__stl_flat_hash_map_probe_key(const __stl_flat_hash_map_probe_key &other) : Value(other.Value) {}
+	~__stl_flat_hash_map_probe_key() { Magic = 0; }
+	__stl_flat_hash_map_probe_key &operator=(const __stl_flat_hash_map_probe_key &) = default;
+
+	bool operator==(const __stl_flat_hash_map_probe_key &other) const
+	{
+		assert(Magic == Alive && other.Magic == Alive);
+		return Value == other.Value;
+	}
+};
+
+/* Sends every key home to slot 0 until the table is larger than 512 */
+struct __stl_flat_hash_map_clustered_hash
+{
+	size_t operator()(const __stl_flat_hash_map_probe_key &key) const { return (size_t)key.Value * 512; }
+};
+
+void __stl_flat_hash_map_test_long_probe()
+{
+	flat_hash_map<__stl_flat_hash_map_probe_key, int, __stl_flat_hash_map_clustered_hash> map;
+
+	/* The 255th key needs a longer probe than the distance byte can hold */
+	for (int i = 0; i < 300; i++)
+	{
+		assert(map.insert({i, i}).second);
+		for (int j = 0; j <= i; j++)
+			assert(map.find(j)->second == j);
+		assert(map.find(i + 1) == map.end());
+	}
+
+	for (int i = 0; i < 300; i += 2)
+		assert(map.erase(i) == 1);
+	for (int i = 0; i < 300; i++)
+		assert(map.contains(i) == (i % 2 == 1));
+}
+
+/* Sends every key home to the last slot of the smallest table */
+struct __stl_flat_hash_map_last_slot_hash
+{
+	size_t operator()(int) const { return 7; }
+};
+
+/* Erase the keys in Erased while iterating, the collision chain wraps past slot 0 */
+void __stl_flat_hash_map_test_erase_wrapping(unsigned Erased)
+{
+	flat_hash_map<int, int, __stl_flat_hash_map_last_slot_hash> map;
+	for (int i = 0; i < 6; i++)
+		assert(map.insert({i, i}).second);
+
+	int visits[6] = {};
+	for (auto it = map.begin(); it != map.end();)
+	{
+		assert(visits[it->first]++ == 0);
+		if (Erased & (1 << it->first))
+			it = map.erase(it);
+		else
+			++it;
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		assert(visits[i] == 1);
+		assert(map.contains(i) == !(Erased & (1 << i)));
+	}
+}
+
+void __stl_flat_hash_map_bench()
+{
+	static_assert(BENCH_KEYS % 4 == 0);
+
+	std::unordered_map<uint64_t, uint64_t> chained;
+	flat_hash_map<uint64_t, uint64_t> flat;
+	uint64_t sum = 0;
+
+	uint64_t start = CPU::Counter();
+	for (uint64_t i = 0; i < BENCH_KEYS; i++)
+		chained[i * 7919] = i;
+	for (int round = 0; round < 4; round++)
+		for (uint64_t i = 0; i < BENCH_KEYS; i++)
+			sum += chained.find(i * 7919)->second;
+	uint64_t chainedCycles = CPU::Counter() - start;
+
+	start = CPU::Counter();
+	for (uint64_t i = 0; i < BENCH_KEYS; i++)
+		flat[i * 7919] = i;
+	for (int round = 0; round < 4; round++)
+		for (uint64_t i = 0; i < BENCH_KEYS; i++)
+			sum -= flat.find(i * 7919)->second;
+	uint64_t flatCycles = CPU::Counter() - start;
+
+	assert(sum == 0);
+	debug("%d inserts and %d lookups: unordered_map %lld cycles, flat_hash_map %lld cycles",
+		  BENCH_KEYS, BENCH_KEYS * 4, chainedCycles, flatCycles);
+}
+
+void test_stl_flat_hash_map()
+{
+	debug("flat_hash_map  ...");
+
+	debug("flat_hash_map  insert, find, erase");
+	__stl_flat_hash_map_test_insert_find_erase();
+
+	debug("flat_hash_map  strings, copy and move");
+	__stl_flat_hash_map_test_strings_copy_move();
+
+	debug("flat_hash_map  long probe runs");
+	__stl_flat_hash_map_test_long_probe();
+
+	debug("flat_hash_map  erase while iterating a wrapped chain");
+	for (unsigned erased = 0; erased < (1 << 6); erased++)
+		__stl_flat_hash_map_test_erase_wrapping(erased);
+
+	debug("flat_hash_map  benchmark");
+	__stl_flat_hash_map_bench();
+
+	debug("flat_hash_map  OK");
+}
+
+#endif // DEBUG
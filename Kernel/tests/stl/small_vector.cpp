@@ -0,0 +1,149 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include <small_vector>
+#include <cassert>
+#include <debug.h>
+#include <string>
+#include <vector>
+#include <cpu.hpp>
+
+#define BENCH_ROUNDS 4096
+
+void __stl_small_vector_test_inline_spill()
+{
+	small_vector<int, 4> v;
+	assert(v.empty());
+	assert(v.capacity() == 4);
+
+	for (int i = 0; i < 4; i++)
+		v.push_back(i);
+	assert(v.capacity() == 4);
+
+	v.push_back(4);
+	assert(v.capacity() > 4);
+	assert(v.size() == 5);
+	for (int i = 0; i < 5; i++)
+		assert(v[i] == i);
+
+	v.erase(v.begin() + 1);
+	assert(v.size() == 4);
+	assert(v[1] == 2);
+	assert(v.back() == 4);
+
+	v.pop_back();
+	v.resize(8);
+	assert(v.size() == 8);
+	assert(v[7] == 0);
+
+	v.clear();
+	assert(v.empty());
+}
+
+void __stl_small_vector_test_copy_move()
+{
+	small_vector<std::string, 2> a = {"one", "two"};
+	small_vector<std::string, 2> b(a);
+	assert(b.size() == 2 && b[1] == "two");
+
+	b.push_back("three");
+	small_vector<std::string, 2> c(std::move(b));
+	assert(b.empty());
+	assert(c.size() == 3 && c[2] == "three");
+
+	small_vector<std::string, 2> d(std::move(a));
+	assert(a.empty());
+	assert(d.size() == 2 && d[0] == "one");
+
+	d = c;
+	assert(d.size() == 3 && d[2] == "three");
+
+	c = std::move(d);
+	assert(c.size() == 3);
+}
+
+void __stl_small_vector_bench()
+{
+	uint64_t sum = 0;
+
+	uint64_t start = CPU::Counter();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		std::vector<int> v;
+		for (int i = 0; i < 8; i++)
+			v.push_back(i);
+		for (int i : v)
+			sum += i;
+	}
+	uint64_t vectorCycles = CPU::Counter() - start;
+
+	start = CPU::Counter();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		small_vector<int, 8> v;
+		for (int i = 0; i < 8; i++)
+			v.push_back(i);
+		for (int i : v)
+			sum -= i;
+	}
+	uint64_t smallCycles = CPU::Counter() - start;
+
+	assert(sum == 0);
+	debug("%d lists of 8: vector %lld cycles, small_vector %lld cycles",
+		  BENCH_ROUNDS, vectorCycles, smallCycles);
+
+	start = CPU::Counter();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		std::string s = "short name";
+		std::string copy = s;
+		sum += copy.size();
+	}
+	uint64_t shortCycles = CPU::Counter() - start;
+
+	start = CPU::Counter();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		std::string s = "a name that does not fit in the inline buffer";
+		std::string copy = s;
+		sum -= copy.size();
+	}
+	uint64_t longCycles = CPU::Counter() - start;
+
+	debug("%d string copies: inline %lld cycles, heap %lld cycles",
+		  BENCH_ROUNDS, shortCycles, longCycles);
+}
+
+void test_stl_small_vector()
+{
+	debug("small_vector  ...");
+
+	debug("small_vector  inline and spilled");
+	__stl_small_vector_test_inline_spill();
+
+	debug("small_vector  copy and move");
+	__stl_small_vector_test_copy_move();
+
+	debug("small_vector  benchmark");
+	__stl_small_vector_bench();
+
+	debug("small_vector  OK");
+}
+
+#endif // DEBUG
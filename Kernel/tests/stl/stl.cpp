@@ -32,6 +32,8 @@ void test_stl_array();
 void test_stl_shared_ptr();
 void test_stl_set();
 void test_stl_compare();
+void test_stl_flat_hash_map();
+void test_stl_small_vector();
 
 void Test_stl()
 {
@@ -50,6 +52,8 @@ void Test_stl()
 	test_stl_shared_ptr();
 	test_stl_set();
 	test_stl_compare();
+	test_stl_flat_hash_map();
+	test_stl_small_vector();
 }
 
 #endif // DEBUG
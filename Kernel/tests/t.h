@@ -22,6 +22,28 @@
 #include <types.h>
 #include <fs/vfs.hpp>
 
+/**
+ * A directory in /tmp for one test, removed together
+ * with the files in it when it goes out of scope
+ */
+class TmpDirectory
+{
+public:
+	Node Tmp;
+	Node Directory;
+	std::string Name;
+	std::string Path;
+
+	/** @return false if there is no /tmp to work in */
+	bool Valid() { return Directory != nullptr; }
+
+	/** @return Absolute path of Entry in the directory */
+	std::string PathOf(const char *Entry) { return Path + "/" + Entry; }
+
+	TmpDirectory(const char *Name);
+	~TmpDirectory();
+};
+
 void Test_stl();
 void TestMemoryAllocation();
 void tasking_test_fb();
@@ -30,6 +52,14 @@ void TaskMgr();
 void TreeFS(Node node, int Depth);
 void TaskHeartbeat();
 void StressKernel();
+void NetworkBenchmark();
+void TestNameCache();
+void TestRAMFS();
+void TestFileDescriptors();
+void TestEventPoll();
+void TestIoUring();
+void TestDirectorySnapshot();
+void TestVFSConcurrency();
 void coroutineTest();
 void __early_playground();
 void __late_playground();
@@ -0,0 +1,172 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/uring.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+struct TestRing
+{
+	Node node;
+	vfs::IoUring *Ring;
+	kio_uring_params Params;
+	uint8_t *Rings;
+	kio_uring_sqe *Entries;
+
+	uint32_t *At(uint32_t Offset) { return (uint32_t *)(Rings + Offset); }
+};
+
+static void SetupRing(TestRing &t, Tasking::PCB *pcb)
+{
+	t.Params = {};
+	assert(vfs::IoUring::Create(4, &t.Params, pcb, t.node) == 0);
+	t.Ring = vfs::IoUring::FromNode(t.node);
+	assert(t.Ring != nullptr);
+
+	/* Mapped at the same address in the process */
+	t.Rings = (uint8_t *)t.Params.cq_off.user_addr;
+	t.Entries = (kio_uring_sqe *)t.Params.sq_off.user_addr;
+}
+
+static void Push(TestRing &t, uint8_t Opcode, int fd, void *Address, uint32_t Length,
+				 uint64_t Offset, uint64_t UserData)
+{
+	uint32_t tail = *t.At(t.Params.sq_off.tail);
+	uint32_t index = tail & (t.Params.sq_entries - 1);
+
+	kio_uring_sqe &sqe = t.Entries[index];
+	sqe = {};
+	sqe.opcode = Opcode;
+	sqe.fd = fd;
+	sqe.addr = (uintptr_t)Address;
+	sqe.len = Length;
+	sqe.off = Offset;
+	sqe.user_data = UserData;
+
+	t.At(t.Params.sq_off.array)[index] = index;
+	__atomic_store_n(t.At(t.Params.sq_off.tail), tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Submit one entry and wait for its completion */
+static int32_t Complete(TestRing &t, uint8_t Opcode, int fd, void *Address, uint32_t Length,
+						uint64_t Offset, uint64_t UserData)
+{
+	Push(t, Opcode, fd, Address, Length, Offset, UserData);
+	assert(t.Ring->Enter(1, 1, __SYS_IORING_ENTER_GETEVENTS) == 1);
+
+	uint32_t head = *t.At(t.Params.cq_off.head);
+	assert(__atomic_load_n(t.At(t.Params.cq_off.tail), __ATOMIC_ACQUIRE) == head + 1);
+
+	kio_uring_cqe *cqes = (kio_uring_cqe *)(t.Rings + t.Params.cq_off.cqes);
+	kio_uring_cqe cqe = cqes[head & (t.Params.cq_entries - 1)];
+	__atomic_store_n(t.At(t.Params.cq_off.head), head + 1, __ATOMIC_RELEASE);
+
+	assert(cqe.user_data == UserData);
+	return cqe.res;
+}
+
+void TestIoUring()
+{
+	TmpDirectory tmp("uring_test");
+	if (!tmp.Valid())
+		return;
+
+	uint8_t pattern[512];
+	for (size_t i = 0; i < sizeof(pattern); i++)
+		pattern[i] = (uint8_t)i;
+
+	Node file = fs->Create(tmp.Directory, "file", S_IRWXU | S_IFREG, false);
+	assert(file != nullptr);
+	assert(fs->Write(file, pattern, sizeof(pattern), 0) == sizeof(pattern));
+
+	/* Buffers have to be user pages of the owner, not kernel memory */
+	Tasking::PCB *pcb = TaskManager->CreateProcess(thisProcess, "io_uring test",
+												   Tasking::TaskExecutionMode::User);
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	int fd = fdt->usr_open(tmp.PathOf("file").c_str(), O_RDWR, 0);
+	assert(fd >= 0);
+
+	TestRing t;
+	SetupRing(t, pcb);
+	assert(t.Ring->IsOwner(pcb) && !t.Ring->IsOwner(thisProcess));
+	assert(Complete(t, __SYS_IORING_OP_NOP, -1, nullptr, 0, 0, 1) == 0);
+
+	/* Copied page by page, the buffer crosses a page boundary */
+	uint8_t *buffer = (uint8_t *)pcb->vma->RequestPages(2, true);
+	uint8_t *split = buffer + PAGE_SIZE - 100;
+	assert(Complete(t, __SYS_IORING_OP_READ, fd, split, sizeof(pattern), 0, 2) == sizeof(pattern));
+	assert(memcmp(split, pattern, sizeof(pattern)) == 0);
+
+	memset(split, 'w', 64);
+	assert(Complete(t, __SYS_IORING_OP_WRITE, fd, split, 64, sizeof(pattern), 3) == 64);
+	uint8_t check[64];
+	assert(fs->Read(file, check, sizeof(check), sizeof(pattern)) == sizeof(check));
+	for (uint8_t c : check)
+		assert(c == 'w');
+
+	/* Kernel memory is not reachable through a request */
+	uint8_t kernel[16] = {};
+	assert(Complete(t, __SYS_IORING_OP_READ, fd, kernel, sizeof(kernel), 0, 4) == -EFAULT);
+	for (uint8_t c : kernel)
+		assert(c == 0);
+
+	kiovec *iov = (kiovec *)pcb->vma->RequestPages(1, true);
+	iov[0] = {kernel, sizeof(kernel)};
+	assert(t.Ring->Register(__SYS_IORING_REGISTER_BUFFERS, iov, 1) == -EFAULT);
+
+	uint8_t *fixed = (uint8_t *)pcb->vma->RequestPages(1, true);
+	iov[0] = {fixed, PAGE_SIZE};
+	assert(t.Ring->Register(__SYS_IORING_REGISTER_BUFFERS, iov, 1) == 0);
+	assert(Complete(t, __SYS_IORING_OP_READ_FIXED, fd, fixed, 16, 0, 5) == 16);
+	assert(memcmp(fixed, pattern, 16) == 0);
+	assert(Complete(t, __SYS_IORING_OP_READ_FIXED, fd, fixed + PAGE_SIZE - 8, 16, 0, 6) == -EFAULT);
+
+	/* Registered buffers are not pinned, unmapping one fails the next request */
+	pcb->vma->FreePages(fixed, 1);
+	assert(Complete(t, __SYS_IORING_OP_READ_FIXED, fd, fixed, 16, 0, 7) == -EFAULT);
+
+	/* Closing the ring cancels a read still waiting on the pipe */
+	int pipefd[2];
+	assert(fdt->usr_pipe(pipefd, 0) == 0);
+	Push(t, __SYS_IORING_OP_READ, pipefd[0], buffer, 1, (uint64_t)-1, 8);
+	assert(t.Ring->Enter(1, 0, 0) == 1);
+	t.node = nullptr;
+
+	char c = 0;
+	assert(fdt->usr_write(pipefd[1], "x", 1) == 1);
+	assert(fdt->usr_read(pipefd[0], &c, 1) == 1);
+	assert(c == 'x');
+
+	/* A ring that outlives its process refuses new entries */
+	SetupRing(t, pcb);
+	Tasking::PID id = pcb->ID;
+	TaskManager->KillProcess(pcb, Tasking::KILL_BY_OTHER_PROCESS);
+	while (TaskManager->GetProcessByID(id) != nullptr)
+		TaskManager->Yield();
+
+	Push(t, __SYS_IORING_OP_NOP, -1, nullptr, 0, 0, 9);
+	assert(t.Ring->Enter(1, 0, 0) == -EOWNERDEAD);
+	t.node = nullptr;
+	debug("io_uring test passed");
+}
+
+#endif // DEBUG
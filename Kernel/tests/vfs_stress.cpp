@@ -0,0 +1,175 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include <fs/vfs.hpp>
+#include <task.hpp>
+#include <atomic>
+
+#include "../kernel.h"
+
+/*
+	Several threads hammer one directory and one file at once.
+	Lookups and creates race on the directory lock,
+	whole records of the shared file are written and read
+	back in parallel and must never be seen half written.
+*/
+
+#define VFS_STRESS_THREADS 8
+#define VFS_STRESS_ROUNDS 256
+#define VFS_STRESS_RECORD 4096
+#define VFS_STRESS_RECORDS 16
+
+static Node StressDirectory;
+static Node StressFile;
+static std::atomic_int StressNextID = 0;
+static std::atomic_size_t StressOperations = 0;
+
+static uint32_t StressRandom(uint32_t &State)
+{
+	State ^= State << 13;
+	State ^= State >> 17;
+	State ^= State << 5;
+	return State;
+}
+
+static void VFSStressThread()
+{
+	int id = StressNextID.fetch_add(1);
+	uint32_t seed = 0x9E3779B9 * (id + 1);
+	uint8_t *record = new uint8_t[VFS_STRESS_RECORD];
+	char name[32];
+	char path[64];
+	size_t ops = 0;
+
+	for (int round = 0; round < VFS_STRESS_ROUNDS; round++)
+	{
+		/* Entries are added next to the ones of the other threads */
+		sprintf(name, "t%d_%d", id, round);
+		eNode created = fs->Create(StressDirectory, name, S_IRWXU | S_IFREG);
+		assert(created);
+		Node file = created.Value;
+
+		memset(record, id, 512);
+		assert(fs->Write(file, record, 512, 0) == 512);
+
+		sprintf(path, "/tmp/vfs_stress/%s", name);
+		eNode found = fs->Lookup(StressDirectory, path);
+		assert(found && found.Value == file);
+
+		kstat st{};
+		assert(fs->Stat(file, &st) == 0);
+		assert(st.Size == 512);
+		ops += 4;
+
+		/* Might not be there yet, a miss must not hide it later */
+		sprintf(name, "t%d_%d", (int)(StressRandom(seed) % VFS_STRESS_THREADS), round);
+		found = fs->Lookup(StressDirectory, name);
+		assert(found || found.Error == -ENOENT);
+		if (found)
+			assert(found.Value->Name == name);
+		ops++;
+
+		/* A record is written whole, a reader sees it all or not at all */
+		off_t offset = (StressRandom(seed) % VFS_STRESS_RECORDS) * VFS_STRESS_RECORD;
+		if (StressRandom(seed) % 4 == 0)
+		{
+			memset(record, (uint8_t)StressRandom(seed), VFS_STRESS_RECORD);
+			assert(fs->Write(StressFile, record, VFS_STRESS_RECORD, offset) == VFS_STRESS_RECORD);
+		}
+		else
+		{
+			assert(fs->Read(StressFile, record, VFS_STRESS_RECORD, offset) == VFS_STRESS_RECORD);
+			for (size_t i = 1; i < VFS_STRESS_RECORD; i++)
+				assert(record[i] == record[0]);
+		}
+		ops++;
+	}
+
+	delete[] record;
+	StressOperations.fetch_add(ops);
+}
+
+void TestVFSConcurrency()
+{
+	TmpDirectory tmp("vfs_stress");
+	if (!tmp.Valid())
+		return;
+
+	StressDirectory = tmp.Directory;
+	StressFile = fs->Create(StressDirectory, "shared", S_IRWXU | S_IFREG, false);
+	assert(StressFile != nullptr);
+
+	uint8_t *zero = new uint8_t[VFS_STRESS_RECORD]{};
+	for (int i = 0; i < VFS_STRESS_RECORDS; i++)
+		assert(fs->Write(StressFile, zero, VFS_STRESS_RECORD, i * VFS_STRESS_RECORD) == VFS_STRESS_RECORD);
+	delete[] zero;
+
+	StressNextID.store(0);
+	StressOperations.store(0);
+
+	Tasking::TCB *threads[VFS_STRESS_THREADS];
+	for (int i = 0; i < VFS_STRESS_THREADS; i++)
+	{
+		threads[i] = TaskManager->CreateThread(thisProcess, Tasking::IP(VFSStressThread));
+		threads[i]->Rename("vfs stress");
+	}
+	for (int i = 0; i < VFS_STRESS_THREADS; i++)
+		TaskManager->WaitForThread(threads[i]);
+
+	/* Every thread got through every round */
+	assert(StressOperations.load() == VFS_STRESS_THREADS * VFS_STRESS_ROUNDS * 6);
+
+	char name[32];
+	for (int id = 0; id < VFS_STRESS_THREADS; id++)
+	{
+		for (int round = 0; round < VFS_STRESS_ROUNDS; round++)
+		{
+			sprintf(name, "t%d_%d", id, round);
+			eNode found = fs->Lookup(StressDirectory, name);
+			assert(found);
+
+			/* Each file holds just what its thread wrote */
+			kstat st{};
+			assert(fs->Stat(found.Value, &st) == 0);
+			assert(st.Size == 512);
+		}
+	}
+
+	std::list<Node> entries = fs->ReadDirectory(StressDirectory);
+	assert(entries.size() == VFS_STRESS_THREADS * VFS_STRESS_ROUNDS + 1);
+	assert(StressDirectory->ChildrenLock.Locked() == false);
+	assert(StressFile->IOLock.Locked() == false);
+
+	/* A directory with entries in it can't go */
+	assert(fs->Remove(tmp.Tmp, "vfs_stress") == -ENOTEMPTY);
+
+	/* Still open here, so it must stay readable after the unlink */
+	assert(fs->Remove(StressDirectory, "shared") == 0);
+	uint8_t byte = 0xFF;
+	assert(fs->Read(StressFile, &byte, 1, 0) == 1);
+	assert(!fs->Lookup(StressDirectory, "shared"));
+
+	StressFile = nullptr;
+	StressDirectory = nullptr;
+}
+
+#endif // DEBUG
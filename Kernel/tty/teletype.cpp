@@ -56,6 +56,11 @@ namespace TTY
 		return -ENOSYS;
 	}
 
+	int TeletypeDriver::Poll(PollTable *Table)
+	{
+		return TermBuf.Poll(Table);
+	}
+
 	TeletypeDriver::TeletypeDriver() : TermBuf(1024)
 	{
 		if (thisProcess)
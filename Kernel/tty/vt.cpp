@@ -226,6 +226,17 @@ namespace KernelConsole
 		}
 	}
 
+	int VirtualTerminal::Poll(PollTable *Table)
+	{
+		/* Input comes straight from the keyboard reports, output never blocks.
+		   Modifier-only reports may make this report POLLIN too early. */
+		PollWait(Table, DriverManager->GlobalKeyboardInputQueue);
+		int mask = POLLOUT | POLLWRNORM;
+		if (DriverManager->GlobalKeyboardInputReports.Count() > 0)
+			mask |= POLLIN | POLLRDNORM;
+		return mask;
+	}
+
 	void VirtualTerminal::Clear(unsigned short StartX, unsigned short StartY, unsigned short EndX, unsigned short EndY)
 	{
 		assert(this->PaintCB != nullptr);
@@ -0,0 +1,108 @@
+/*
+	This file is part of Fennix Userspace.
+
+	Fennix Userspace is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Userspace is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Userspace. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Measures the libc string/memory routines, reports MiB/s for each size */
+
+#define MAX_SIZE (16 << 20)
+#define TOTAL_BYTES (256ULL << 20)
+
+static unsigned char *volatile Source;
+static unsigned char *volatile Destination;
+static volatile size_t Sink;
+
+static uint64_t NowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void RunMemcpy(size_t n) { memcpy(Destination, Source, n); }
+static void RunMemcpyUnaligned(size_t n) { memcpy(Destination + 3, Source + 1, n); }
+static void RunMemmove(size_t n) { memmove(Destination + 1, Destination, n); }
+static void RunMemset(size_t n) { memset(Destination, (int)n, n); }
+static void RunMemcmp(size_t n) { Sink += memcmp(Destination, Source, n); }
+static void RunStrlen(size_t n) { Sink += strlen((const char *)Source + MAX_SIZE - n); }
+static void RunStrchr(size_t n) { Sink += (size_t)strchr((const char *)Source + MAX_SIZE - n, 'x'); }
+
+static const struct
+{
+	const char *Name;
+	void (*Run)(size_t);
+} Tests[] = {
+	{"memcpy", RunMemcpy},
+	{"memcpy (unaligned)", RunMemcpyUnaligned},
+	{"memmove (overlap)", RunMemmove},
+	{"memset", RunMemset},
+	{"memcmp", RunMemcmp},
+	{"strlen", RunStrlen},
+	{"strchr", RunStrchr},
+};
+
+int main(int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	Source = malloc(MAX_SIZE + 64);
+	Destination = malloc(MAX_SIZE + 64);
+	if (!Source || !Destination)
+	{
+		printf("membench: out of memory\n");
+		return 1;
+	}
+
+	/* A long string without 'x' and a NUL right at the end */
+	memset(Source, 'a', MAX_SIZE + 64);
+	Source[MAX_SIZE - 1] = '\0';
+
+	printf("%-20s %10s %12s\n", "function", "size", "MiB/s");
+	for (size_t t = 0; t < sizeof(Tests) / sizeof(Tests[0]); t++)
+	{
+		/* memcmp has to walk the whole buffer */
+		memcpy(Destination, Source, MAX_SIZE + 64);
+		for (size_t n = 16; n <= MAX_SIZE; n *= 4)
+		{
+			size_t iterations = TOTAL_BYTES / n;
+			if (iterations > 1000000)
+				iterations = 1000000;
+
+			Tests[t].Run(n);
+			uint64_t start = NowNs();
+			for (size_t i = 0; i < iterations; i++)
+				Tests[t].Run(n);
+			uint64_t elapsed = NowNs() - start;
+			if (elapsed == 0)
+				elapsed = 1;
+
+			uint64_t mibs = ((uint64_t)n * iterations * 1000000000ULL / elapsed) >> 20;
+			printf("%-20s %10zu %12llu\n", Tests[t].Name, n, (unsigned long long)mibs);
+		}
+	}
+
+	free(Source);
+	free(Destination);
+	return (int)(Sink & 0);
+}
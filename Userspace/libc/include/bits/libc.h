@@ -22,6 +22,7 @@
 #include <sys/utsname.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #ifdef __kernel__
 #error "Kernel code should not include this header"
@@ -40,19 +41,26 @@ int sysdep(Bind)(int Socket, const struct sockaddr *Address, socklen_t AddressLe
 int sysdep(Connect)(int Socket, const struct sockaddr *Address, socklen_t AddressLength);
 int sysdep(Listen)(int Socket, int Backlog);
 int sysdep(Socket)(int Domain, int Type, int Protocol);
+ssize_t sysdep(Send)(int Socket, const void *Buffer, size_t Length, int Flags);
+ssize_t sysdep(Receive)(int Socket, void *Buffer, size_t Length, int Flags);
+int sysdep(Shutdown)(int Socket, int How);
 int sysdep(UnixName)(struct utsname *Name);
 int sysdep(WaitProcessID)(pid_t ProcessID, int *Status, int Options);
 int sysdep(IOControl)(int Descriptor, unsigned long Operation, void *Argument);
 void *sysdep(MemoryMap)(void *Address, size_t Length, int Protection, int Flags, int Descriptor, off_t Offset);
 int sysdep(MemoryUnmap)(void *Address, size_t Length);
 int sysdep(MemoryProtect)(void *Address, size_t Length, int Protection);
+int sysdep(MemoryAdvise)(void *Address, size_t Length, int Advice);
 int sysdep(Fork)(void);
 int sysdep(Read)(int Descriptor, void *Buffer, size_t Size);
 int sysdep(Write)(int Descriptor, const void *Buffer, size_t Size);
 int sysdep(PRead)(int Descriptor, void *Buffer, size_t Size, off_t Offset);
 int sysdep(PWrite)(int Descriptor, const void *Buffer, size_t Size, off_t Offset);
+ssize_t sysdep(ReadV)(int Descriptor, const struct iovec *Vector, int Count);
+ssize_t sysdep(WriteV)(int Descriptor, const struct iovec *Vector, int Count);
 int sysdep(Open)(const char *Pathname, int Flags, mode_t Mode);
 int sysdep(Close)(int Descriptor);
+int sysdep(Pipe)(int Descriptors[2]);
 int sysdep(Access)(const char *Pathname, int Mode);
 int sysdep(Tell)(int Descriptor);
 int sysdep(Seek)(int Descriptor, off_t Offset, int Whence);
@@ -27,7 +27,7 @@ extern "C"
 #include <stddef.h>
 #include <stdarg.h>
 
-#define BUFSIZ 512
+#define BUFSIZ 4096
 #define FILENAME_MAX 255
 #define FOPEN_MAX 8
 #define _IOFBF 0
@@ -56,8 +56,12 @@ extern "C"
 	{
 		int fd;
 		char *buffer;
-		size_t buffer_size;
-		size_t buffer_pos;
+		size_t buffer_size;	/* capacity of buffer */
+		size_t buffer_pos;	/* next byte to read, or pending bytes to write */
+		size_t buffer_end;	/* valid bytes while reading, 0 while writing */
+		int buffer_mode;	/* _IOFBF, _IOLBF or _IONBF */
+		int buffer_owned;	/* buffer was allocated by the library */
+		char buffer_unbuf;	/* single byte buffer for _IONBF streams */
 		int flags;
 		int error;
 		int eof;
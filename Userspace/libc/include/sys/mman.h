@@ -45,6 +45,12 @@ extern "C"
 
 #define MAP_FAILED ((void *)-1)
 
+#define POSIX_MADV_NORMAL 0
+#define POSIX_MADV_RANDOM 1
+#define POSIX_MADV_SEQUENTIAL 2
+#define POSIX_MADV_WILLNEED 3
+#define POSIX_MADV_DONTNEED 4
+
 	typedef struct posix_typed_mem_info
 	{
 		/* Maximum length which may be allocated from a typed memory object. */
@@ -122,6 +122,8 @@ extern "C"
 		__UINTPTR_TYPE__ *Storage;
 
 		int CurrentError;
+		/* Per-thread malloc cache, see src/mem/tcalloc.c */
+		void *AllocatorCache;
 	} __pthread;
 
 #ifdef __cplusplus
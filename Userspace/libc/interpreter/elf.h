@@ -188,6 +188,7 @@ enum RelocationTypes
 	R_AARCH64_JUMP_SLOT = 1026,
 	R_AARCH64_RELATIVE = 1027,
 	R_AARCH64_TLS_DTPMOD64 = 1028,
+	R_AARCH64_IRELATIVE = 1032,
 
 	R_ARM_NONE = 0,
 	R_ARM_COPY = 1024,
@@ -197,6 +198,7 @@ enum RelocationTypes
 	R_ARM_TLS_DTPMOD32 = 1028,
 	R_ARM_TLS_DTPOFF32 = 1029,
 	R_ARM_TLS_TPOFF32 = 1030,
+	R_ARM_IRELATIVE = 160,
 
 #if defined(__x86_64__)
 	R_NONE = R_X86_64_NONE,
@@ -207,6 +209,7 @@ enum RelocationTypes
 	R_DTPMOD64 = R_X86_64_DTPMOD64,
 	R_DTPOFF64 = R_X86_64_DTPOFF64,
 	R_TPOFF64 = R_X86_64_TPOFF64,
+	R_IRELATIVE = R_X86_64_IRELATIVE,
 #elif defined(__i386__)
 	R_NONE = R_386_NONE,
 	R_COPY = R_386_COPY,
@@ -216,6 +219,7 @@ enum RelocationTypes
 	R_DTPMOD64 = R_386_NONE,
 	R_DTPOFF64 = R_386_NONE,
 	R_TPOFF64 = R_386_NONE,
+	R_IRELATIVE = R_386_IRELATIVE,
 #elif defined(__aarch64__)
 	R_NONE = R_AARCH64_NONE,
 	R_COPY = R_AARCH64_COPY,
@@ -225,6 +229,7 @@ enum RelocationTypes
 	R_DTPMOD64 = R_AARCH64_TLS_DTPMOD64,
 	R_DTPOFF64 = R_AARCH64_NONE,
 	R_TPOFF64 = R_AARCH64_NONE,
+	R_IRELATIVE = R_AARCH64_IRELATIVE,
 #elif defined(__arm__)
 	R_NONE = R_ARM_NONE,
 	R_COPY = R_ARM_COPY,
@@ -234,6 +239,7 @@ enum RelocationTypes
 	R_DTPMOD64 = R_ARM_TLS_DTPMOD32,
 	R_DTPOFF64 = R_ARM_TLS_DTPOFF32,
 	R_TPOFF64 = R_ARM_TLS_TPOFF32,
+	R_IRELATIVE = R_ARM_IRELATIVE,
 #endif
 };
 
@@ -265,6 +271,7 @@ enum SymbolTypes
 	STT_FILE = 4,
 	STT_COMMON = 5,
 	STT_LOOS = 10,
+	STT_GNU_IFUNC = 10,
 	STT_HIOS = 12,
 	STT_LOPROC = 13,
 	STT_SPARC_REGISTER = 13,
@@ -345,6 +352,7 @@ enum DynamicArrayTags
 	DT_SYMINENT = 0x6ffffdff,
 	DT_VALRNGHI = 0x6ffffdff,
 	DT_ADDRRNGLO = 0x6ffffe00,
+	DT_GNU_HASH = 0x6ffffef5,
 	DT_CONFIG = 0x6ffffefa,
 	DT_DEPAUDIT = 0x6ffffefb,
 	DT_AUDIT = 0x6ffffefc,
@@ -367,6 +375,16 @@ enum DynamicArrayTags
 	DT_HIPROC = 0x7fffffff
 };
 
+/* Used for DT_FLAGS */
+#define DF_ORIGIN 0x1
+#define DF_SYMBOLIC 0x2
+#define DF_TEXTREL 0x4
+#define DF_BIND_NOW 0x8
+#define DF_STATIC_TLS 0x10
+
+/* Used for DT_FLAGS_1 */
+#define DF_1_NOW 0x1
+
 /* Used for Elf64_Sym st_info */
 #define ELF32_ST_BIND(info) ((info) >> 4)
 #define ELF32_ST_TYPE(info) ((info) & 0xf)
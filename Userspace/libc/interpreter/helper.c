@@ -251,3 +251,55 @@ Elf64_Sym *find_symbol(const char *name, uint32_t *hash_table, Elf64_Sym *symtab
 	}
 	return NULL;
 }
+
+Elf_Sym *find_symbol_gnu(const char *name, uint32_t hash, uint32_t *hash_table, Elf_Sym *symtab, const char *strtab)
+{
+	/* GNU Hash Table
+	|-----------------------|
+	|       nbuckets        |
+	|-----------------------|
+	|       symoffset       |
+	|-----------------------|
+	|      bloom_size       |
+	|-----------------------|
+	|      bloom_shift      |
+	|-----------------------|
+	|   bloom[bloom_size]   | Elf_Addr sized words
+	|-----------------------|
+	|  buckets[nbuckets]    |
+	|-----------------------|
+	|   chain[] (hash|end)  | one per symbol from symoffset
+	|-----------------------|
+	*/
+	const size_t bits = sizeof(Elf_Addr) * 8;
+	uint32_t nbuckets = hash_table[0];
+	uint32_t symoffset = hash_table[1];
+	uint32_t bloom_size = hash_table[2];
+	uint32_t bloom_shift = hash_table[3];
+	const Elf_Addr *bloom = (const Elf_Addr *)&hash_table[4];
+	const uint32_t *buckets = (const uint32_t *)&bloom[bloom_size];
+	const uint32_t *chain = &buckets[nbuckets];
+
+	/* Most misses stop here without touching the symbol table */
+	Elf_Addr word = bloom[(hash / bits) % bloom_size];
+	Elf_Addr mask = ((Elf_Addr)1 << (hash % bits)) |
+					((Elf_Addr)1 << ((hash >> bloom_shift) % bits));
+	if ((word & mask) != mask)
+		return NULL;
+
+	uint32_t i = buckets[hash % nbuckets];
+	if (i < symoffset)
+		return NULL;
+
+	for (;; i++)
+	{
+		uint32_t h = chain[i - symoffset];
+		if ((hash | 1) == (h | 1) && !strcmp(&strtab[symtab[i].st_name], name))
+			return &symtab[i];
+
+		/* The lowest bit marks the end of the chain */
+		if (h & 1)
+			break;
+	}
+	return NULL;
+}
@@ -38,11 +38,18 @@ typedef struct ElfInfo
 	Elf_Dyn *Dynamic;
 	char *Path;
 
+	/* DT_SONAME, or the DT_NEEDED name it was loaded by */
+	const char *Name;
+
+	/* Loaded DT_NEEDED libraries, in DT_NEEDED order */
+	struct ElfInfo **Needed;
+	size_t NeededCount;
+
 	struct
 	{
-		Elf_Addr PLTGOT, HASH, STRTAB, SYMTAB, RELA, REL, TEXTREL, JMPREL;
-		Elf_Addr BIND_NOW, INIT, FINI, RPATH, SYMBOLIC, INIT_ARRAY;
-		Elf_Addr FINI_ARRAY, PREINIT_ARRAY, RUNPATH, FLAGS;
+		Elf_Addr PLTGOT, HASH, GNU_HASH, STRTAB, SYMTAB, RELA, REL, TEXTREL, JMPREL;
+		Elf_Addr BIND_NOW, INIT, FINI, SONAME, RPATH, SYMBOLIC, INIT_ARRAY;
+		Elf_Addr FINI_ARRAY, PREINIT_ARRAY, RUNPATH, FLAGS, FLAGS_1;
 	} DynamicTable;
 
 	struct
@@ -53,7 +60,7 @@ typedef struct ElfInfo
 		_Static_assert(sizeof(Elf32_Word) == sizeof(size_t), "Elf32_Word and size_t are not the same size");
 #endif
 		size_t PLTRELSZ, RELASZ, RELAENT, STRSZ, SYMENT, RELSZ, RELENT, PLTREL;
-		size_t INIT_ARRAYSZ, FINI_ARRAYSZ, PREINIT_ARRAYSZ;
+		size_t INIT_ARRAYSZ, FINI_ARRAYSZ, PREINIT_ARRAYSZ, RELACOUNT, RELCOUNT;
 	} DynamicSize;
 
 	union
@@ -127,6 +134,104 @@ ElfInfo *SearchLib(char *Path)
 	return NULL;
 }
 
+ElfInfo *SearchLibName(const char *Name)
+{
+	ElfInfo *current = elf_list_head;
+	while (current)
+	{
+		if (current->Name && strcmp(current->Name, Name) == 0)
+			return current;
+		current = current->next;
+	}
+	return NULL;
+}
+
+/*
+	Process wide cache of resolved symbols. Lookups go through the
+	global scope in load order, so the first definition found for a
+	name stays valid for every object that references it.
+*/
+
+typedef struct SymbolCacheEntry
+{
+	const char *Name;
+	uint32_t Hash;
+	uintptr_t Address;
+} SymbolCacheEntry;
+
+#define SYMBOL_CACHE_INITIAL 512
+
+SymbolCacheEntry *SymbolCache = NULL;
+size_t SymbolCacheSize = 0;
+size_t SymbolCacheCount = 0;
+
+SymbolCacheEntry *SymbolCacheFind(SymbolCacheEntry *Table, size_t Size, const char *Name, uint32_t Hash)
+{
+	size_t mask = Size - 1;
+	for (size_t i = Hash & mask;; i = (i + 1) & mask)
+	{
+		SymbolCacheEntry *entry = &Table[i];
+		if (entry->Name == NULL)
+			return entry;
+		if (entry->Hash == Hash && strcmp(entry->Name, Name) == 0)
+			return entry;
+	}
+}
+
+int SymbolCacheGrow()
+{
+	size_t newSize = SymbolCacheSize ? SymbolCacheSize * 2 : SYMBOL_CACHE_INITIAL;
+	SymbolCacheEntry *newTable = request_page(newSize * sizeof(SymbolCacheEntry));
+	if (newTable == NULL)
+		return -ENOMEM;
+
+	/* Anonymous mappings are already zeroed */
+	for (size_t i = 0; i < SymbolCacheSize; i++)
+	{
+		SymbolCacheEntry *entry = &SymbolCache[i];
+		if (entry->Name)
+			*SymbolCacheFind(newTable, newSize, entry->Name, entry->Hash) = *entry;
+	}
+
+	if (SymbolCache)
+		free_page(SymbolCache, SymbolCacheSize * sizeof(SymbolCacheEntry));
+
+	SymbolCache = newTable;
+	SymbolCacheSize = newSize;
+	return 0;
+}
+
+int SymbolCacheLookup(const char *Name, uint32_t Hash, uintptr_t *Address)
+{
+	if (SymbolCache == NULL)
+		return 0;
+
+	SymbolCacheEntry *entry = SymbolCacheFind(SymbolCache, SymbolCacheSize, Name, Hash);
+	if (entry->Name == NULL)
+		return 0;
+
+	*Address = entry->Address;
+	return 1;
+}
+
+void SymbolCacheInsert(const char *Name, uint32_t Hash, uintptr_t Address)
+{
+	/* Keep the load factor under 3/4 */
+	if ((SymbolCacheCount + 1) * 4 > SymbolCacheSize * 3)
+	{
+		if (SymbolCacheGrow() < 0)
+			return;
+	}
+
+	SymbolCacheEntry *entry = SymbolCacheFind(SymbolCache, SymbolCacheSize, Name, Hash);
+	if (entry->Name == NULL)
+		SymbolCacheCount++;
+
+	entry->Name = Name;
+	entry->Hash = Hash;
+	entry->Address = Address;
+}
+
 __attribute__((naked, used, no_stack_protector)) void _dl_runtime_resolve()
 {
 #if defined(__amd64__)
@@ -140,12 +245,35 @@ __attribute__((naked, used, no_stack_protector)) void _dl_runtime_resolve()
 		"push %rcx\n"
 		"push %r8\n"
 		"push %r9\n"
+		"push %rax\n" /* Number of vector registers used by variadic calls */
+
+		/* Floating point arguments, this also realigns the stack to 16 bytes */
+		"sub $128, %rsp\n"
+		"movdqu %xmm0, 0(%rsp)\n"
+		"movdqu %xmm1, 16(%rsp)\n"
+		"movdqu %xmm2, 32(%rsp)\n"
+		"movdqu %xmm3, 48(%rsp)\n"
+		"movdqu %xmm4, 64(%rsp)\n"
+		"movdqu %xmm5, 80(%rsp)\n"
+		"movdqu %xmm6, 96(%rsp)\n"
+		"movdqu %xmm7, 112(%rsp)\n"
 
 		"mov %r11, %rdi\n" /* Move the first argument to rdi */
 		"mov %r10, %rsi\n" /* Move the second argument to rsi (rel index) */
 		"call _dl_fixup\n" /* Call _dl_fixup */
 		"mov %rax, %r11\n" /* Move the return value to r11 */
 
+		"movdqu 0(%rsp), %xmm0\n"
+		"movdqu 16(%rsp), %xmm1\n"
+		"movdqu 32(%rsp), %xmm2\n"
+		"movdqu 48(%rsp), %xmm3\n"
+		"movdqu 64(%rsp), %xmm4\n"
+		"movdqu 80(%rsp), %xmm5\n"
+		"movdqu 96(%rsp), %xmm6\n"
+		"movdqu 112(%rsp), %xmm7\n"
+		"add $128, %rsp\n"
+
+		"pop %rax\n"
 		"pop %r9\n"
 		"pop %r8\n"
 		"pop %rcx\n"
@@ -202,6 +330,7 @@ void AdjustDynamicTable(Elf_Dyn *elem, ElfInfo *Info)
 	{
 	case DT_PLTGOT:
 	case DT_HASH:
+	case DT_GNU_HASH:
 	case DT_STRTAB:
 	case DT_SYMTAB:
 	case DT_RELA:
@@ -224,6 +353,7 @@ void CreateInfoTables(Elf_Dyn *elem, ElfInfo *Info)
 	switch (elem->d_tag)
 	{
 	case DT_NEEDED:
+		Info->NeededCount++;
 		break;
 	case DT_PLTRELSZ:
 		Info->DynamicSize.PLTRELSZ = elem->d_un.d_val;
@@ -235,6 +365,12 @@ void CreateInfoTables(Elf_Dyn *elem, ElfInfo *Info)
 	case DT_HASH:
 		Info->DynamicTable.HASH = elem->d_un.d_ptr;
 		break;
+	case DT_GNU_HASH:
+		Info->DynamicTable.GNU_HASH = elem->d_un.d_ptr;
+		break;
+	case DT_SONAME:
+		Info->DynamicTable.SONAME = elem->d_un.d_val;
+		break;
 	case DT_STRTAB:
 		Info->DynamicTable.STRTAB = elem->d_un.d_ptr;
 		break;
@@ -315,6 +451,15 @@ void CreateInfoTables(Elf_Dyn *elem, ElfInfo *Info)
 	case DT_PREINIT_ARRAYSZ:
 		Info->DynamicSize.PREINIT_ARRAYSZ = elem->d_un.d_val;
 		break;
+	case DT_RELACOUNT:
+		Info->DynamicSize.RELACOUNT = elem->d_un.d_val;
+		break;
+	case DT_RELCOUNT:
+		Info->DynamicSize.RELCOUNT = elem->d_un.d_val;
+		break;
+	case DT_FLAGS_1:
+		Info->DynamicTable.FLAGS_1 = elem->d_un.d_val;
+		break;
 	case DT_LOOS:
 	case DT_SUNW_RTLDINF:
 	case DT_HIOS:
@@ -336,9 +481,6 @@ void CreateInfoTables(Elf_Dyn *elem, ElfInfo *Info)
 	case DT_MOVETAB:
 	case DT_SYMINFO:
 	// case DT_ADDRRNGHI:
-	case DT_RELACOUNT:
-	case DT_RELCOUNT:
-	case DT_FLAGS_1:
 	case DT_VERDEF:
 	case DT_VERDEFNUM:
 	case DT_VERNEED:
@@ -358,7 +500,14 @@ int LoadElf(int, char *, ElfInfo **);
 void ProcessNeededLibraries(Elf_Dyn *elem, ElfInfo *Info)
 {
 	char *libPath = (char *)Info->DynamicTable.STRTAB + elem->d_un.d_val;
-	ElfInfo *info = NULL;
+	ElfInfo *info = SearchLibName(libPath);
+
+	/* Already loaded by another object, skip the path search */
+	if (info != NULL)
+	{
+		Info->Needed[Info->NeededCount++] = info;
+		return;
+	}
 
 	char fullLibPath[PATH_MAX];
 	int found = 0;
@@ -420,10 +569,16 @@ void ProcessNeededLibraries(Elf_Dyn *elem, ElfInfo *Info)
 load_lib:
 	int fd = sysdep(Open)(fullLibPath, O_RDONLY, 0644);
 	int status = LoadElf(fd, fullLibPath, &info);
-	elem->d_un.d_ptr = (uintptr_t)info; /* if LoadElf fails, info will still be NULL */
 	sysdep(Close)(fd);
 	if (status < 0) /* announce that LoadElf failed */
+	{
 		printf("dl: Can't load %s\n", fullLibPath);
+		return;
+	}
+
+	if (info->Name == NULL)
+		info->Name = libPath;
+	Info->Needed[Info->NeededCount++] = info;
 }
 
 void ProcessDynamicTable(ElfInfo *Info)
@@ -437,8 +592,24 @@ void ProcessDynamicTable(ElfInfo *Info)
 		CreateInfoTables(elem, Info);
 	}
 
-	/* TODO: Optimize this, we don't have to recheck every element */
-	for (size_t i = 0;; i++)
+	if (Info->DynamicTable.SONAME)
+		Info->Name = (const char *)Info->DynamicTable.STRTAB + Info->DynamicTable.SONAME;
+
+	size_t neededCount = Info->NeededCount;
+	Info->NeededCount = 0;
+	if (neededCount == 0)
+		return;
+
+	Info->Needed = mini_malloc(neededCount * sizeof(ElfInfo *));
+	if (Info->Needed == NULL)
+	{
+		printf("dl: Can't allocate memory for %s dependencies\n", Info->Path);
+		return;
+	}
+
+	/* DT_STRTAB may come after DT_NEEDED, so this needs a second pass.
+	   Linkers put DT_NEEDED first, stop after the last one. */
+	for (size_t i = 0, found = 0; found < neededCount; i++)
 	{
 		Elf_Dyn *elem = &Info->Dynamic[i];
 		if (elem->d_tag == DT_NULL)
@@ -446,6 +617,7 @@ void ProcessDynamicTable(ElfInfo *Info)
 		if (elem->d_tag != DT_NEEDED)
 			continue;
 		ProcessNeededLibraries(elem, Info);
+		found++;
 	}
 }
 
@@ -717,36 +889,65 @@ int LoadElf(int fd, char *Path, ElfInfo **Out)
 	return 0;
 }
 
-uintptr_t GetSymbolAddress(ElfInfo *Info, const char *SymbolName)
+/* STT_GNU_IFUNC symbols point to a resolver that returns the real address */
+uintptr_t ResolveIndirect(uintptr_t Resolver)
+{
+	return ((uintptr_t(*)(void))Resolver)();
+}
+
+uintptr_t LookupSymbol(ElfInfo *Info, const char *SymbolName, uint32_t GnuHash)
 {
-	Elf64_Sym *sym = find_symbol(SymbolName,
-								 (uint32_t *)Info->DynamicTable.HASH,
-								 (Elf64_Sym *)Info->DynamicTable.SYMTAB,
-								 (const char *)Info->DynamicTable.STRTAB);
-	if (sym == NULL)
+	Elf_Sym *sym = NULL;
+	if (Info->DynamicTable.GNU_HASH)
+	{
+		sym = find_symbol_gnu(SymbolName, GnuHash,
+							  (uint32_t *)Info->DynamicTable.GNU_HASH,
+							  (Elf_Sym *)Info->DynamicTable.SYMTAB,
+							  (const char *)Info->DynamicTable.STRTAB);
+	}
+	else if (Info->DynamicTable.HASH)
+	{
+		sym = find_symbol(SymbolName,
+						  (uint32_t *)Info->DynamicTable.HASH,
+						  (Elf64_Sym *)Info->DynamicTable.SYMTAB,
+						  (const char *)Info->DynamicTable.STRTAB);
+	}
+
+	/* Undefined entries are imports of that object, not definitions */
+	if (sym == NULL || sym->st_shndx == SHN_UNDEF)
 		return (-ENOSYS);
+	if (ELF_ST_TYPE(sym->st_info) == STT_GNU_IFUNC)
+		return ResolveIndirect(Info->BaseAddress + sym->st_value);
 	return Info->BaseAddress + sym->st_value;
 }
 
-int ResolveExternalSymbol(ElfInfo *Info, uintptr_t *symAddress, Elf_Sym *sym, const char *symName)
+uintptr_t GetSymbolAddress(ElfInfo *Info, const char *SymbolName)
 {
-	*symAddress = (-ENOSYS);
+	return LookupSymbol(Info, SymbolName, gnu_hash(SymbolName));
+}
 
-	for (size_t i = 0; *symAddress == (-ENOSYS); i++)
-	{
-		Elf_Dyn *dyn = &Info->Dynamic[i];
-		if (dyn->d_tag == DT_NULL)
-			break;
+int ResolveExternalSymbol(ElfInfo *Info, uintptr_t *symAddress, Elf_Sym *sym, const char *symName, short IsCopy)
+{
+	uint32_t hash = gnu_hash(symName);
 
-		if (dyn->d_tag != DT_NEEDED)
-			continue;
+	/* R_COPY must skip the executable's own copy, so it isn't cached */
+	if (!IsCopy && SymbolCacheLookup(symName, hash, symAddress))
+		return 0;
 
-		ElfInfo *lib = (ElfInfo *)dyn->d_un.d_ptr;
-		*symAddress = GetSymbolAddress(lib, symName);
+	*symAddress = (-ENOSYS);
+	for (ElfInfo *lib = elf_list_head; lib && *symAddress == (-ENOSYS); lib = lib->next)
+	{
+		if (IsCopy && lib == Info)
+			continue;
+		*symAddress = LookupSymbol(lib, symName, hash);
 	}
 
 	if (*symAddress != (-ENOSYS))
+	{
+		if (!IsCopy)
+			SymbolCacheInsert(symName, hash, *symAddress);
 		return 0;
+	}
 
 	printf("%s: Unresolved symbol: %s\n", Info->Path, symName);
 	if (ELF_ST_BIND(sym->st_info) != STB_WEAK)
@@ -823,8 +1024,12 @@ int RelocateHelper(ElfInfo *Info, Elf_Rela *Rela, short IsRel, void **Relocated)
 		symSize = sym->st_size;
 
 		if (!(ELF_R_TYPE(Rela->r_info) == R_COPY) && sym->st_shndx)
+		{
 			symAddress = Info->BaseAddress + sym->st_value;
-		else if (ResolveExternalSymbol(Info, &symAddress, sym, symName) < 0)
+			if (ELF_ST_TYPE(sym->st_info) == STT_GNU_IFUNC)
+				symAddress = ResolveIndirect(symAddress);
+		}
+		else if (ResolveExternalSymbol(Info, &symAddress, sym, symName, ELF_R_TYPE(Rela->r_info) == R_COPY) < 0)
 			return -EINVAL;
 	}
 
@@ -869,6 +1074,17 @@ int RelocateHelper(ElfInfo *Info, Elf_Rela *Rela, short IsRel, void **Relocated)
 		addAddend = 1;
 		break;
 	}
+	case R_IRELATIVE:
+	{
+		reloSize = 8;
+		reloc = Info->BaseAddress;
+		if (IsRel == 0)
+			reloc += Rela->r_addend;
+		else if (ApplyRelocation(Info, &reloc, Rela, reloSize) < 0)
+			return -EINVAL;
+		reloc = ResolveIndirect(reloc);
+		break;
+	}
 #if __LP64__
 	case R_DTPMOD64:
 	{
@@ -915,34 +1131,63 @@ int RelocateHelper(ElfInfo *Info, Elf_Rela *Rela, short IsRel, void **Relocated)
 int HandleRelocations(ElfInfo *Info);
 void SearchNeeded(ElfInfo *Info)
 {
-	for (size_t i = 0;; i++)
-	{
-		Elf_Dyn *elem = &Info->Dynamic[i];
-		if (elem->d_tag == DT_NULL)
-			break;
-
-		if (elem->d_tag != DT_NEEDED)
-			continue;
+	for (size_t i = 0; i < Info->NeededCount; i++)
+		HandleRelocations(Info->Needed[i]);
+}
 
-		HandleRelocations((ElfInfo *)elem->d_un.d_ptr);
+int IsBindNow(ElfInfo *Info)
+{
+	static int bindNowEnv = -1;
+	if (bindNowEnv < 0)
+	{
+		char *env = getenv("LD_BIND_NOW");
+		bindNowEnv = env && *env;
 	}
+
+	return bindNowEnv ||
+		   Info->DynamicTable.BIND_NOW != ((Elf_Addr)0) ||
+		   (Info->DynamicTable.FLAGS & DF_BIND_NOW) ||
+		   (Info->DynamicTable.FLAGS_1 & DF_1_NOW);
 }
 
 int HandleRelocations(ElfInfo *Info)
 {
 	if (Info->Flags.Relocated)
 		return 0;
+
+	/* Set early so circular dependencies don't recurse forever */
+	Info->Flags.Relocated = 1;
 	SearchNeeded(Info);
 
 	if (Info->DynamicTable.REL != ((Elf_Addr)0) && Info->DynamicSize.RELENT != 0)
 	{
-		for (size_t i = 0; i < Info->DynamicSize.RELSZ / Info->DynamicSize.RELENT; i++)
+		size_t count = Info->DynamicSize.RELSZ / Info->DynamicSize.RELENT;
+		size_t i = 0;
+
+		/* DT_RELCOUNT leading entries are R_RELATIVE, no symbol lookup needed */
+		for (; i < Info->DynamicSize.RELCOUNT && i < count; i++)
+		{
+			Elf_Rel *rel = (Elf_Rel *)(Info->DynamicTable.REL + i * Info->DynamicSize.RELENT);
+			*(Elf_Addr *)(Info->BaseAddress + rel->r_offset) += Info->BaseAddress;
+		}
+
+		for (; i < count; i++)
 			RelocateHelper(Info, (Elf_Rela *)(Info->DynamicTable.REL + i * Info->DynamicSize.RELENT), 1, NULL);
 	}
 
 	if (Info->DynamicTable.RELA != ((Elf_Addr)0) && Info->DynamicSize.RELAENT != 0)
 	{
-		for (size_t i = 0; i < Info->DynamicSize.RELASZ / Info->DynamicSize.RELAENT; i++)
+		size_t count = Info->DynamicSize.RELASZ / Info->DynamicSize.RELAENT;
+		size_t i = 0;
+
+		/* Same for DT_RELACOUNT */
+		for (; i < Info->DynamicSize.RELACOUNT && i < count; i++)
+		{
+			Elf_Rela *rela = (Elf_Rela *)(Info->DynamicTable.RELA + i * Info->DynamicSize.RELAENT);
+			*(Elf_Addr *)(Info->BaseAddress + rela->r_offset) = Info->BaseAddress + rela->r_addend;
+		}
+
+		for (; i < count; i++)
 			RelocateHelper(Info, (Elf_Rela *)(Info->DynamicTable.RELA + i * Info->DynamicSize.RELAENT), 0, NULL);
 	}
 
@@ -955,7 +1200,7 @@ int HandleRelocations(ElfInfo *Info)
 		return -EINVAL;
 	}
 
-	if (Info->DynamicTable.BIND_NOW != ((Elf_Addr)0))
+	if (IsBindNow(Info))
 	{
 		if (Info->DynamicSize.PLTREL == DT_REL)
 		{
@@ -967,8 +1212,6 @@ int HandleRelocations(ElfInfo *Info)
 			for (size_t i = 0; i < Info->DynamicSize.PLTRELSZ / sizeof(Elf_Rela); i++)
 				RelocateHelper(Info, (Elf_Rela *)&((Elf_Rela *)Info->DynamicTable.JMPREL)[i], 0, NULL);
 		}
-
-		Info->Flags.Relocated = 1;
 		return 0;
 	}
 
@@ -983,31 +1226,38 @@ int HandleRelocations(ElfInfo *Info)
 							   ? ((Elf_Rel *)Info->DynamicTable.JMPREL)[i].r_offset
 							   : ((Elf_Rela *)Info->DynamicTable.JMPREL)[i].r_offset);
 
+		/* Local IFUNCs can't be bound lazily, the slot has no symbol to look up */
+		if (ELF_R_TYPE(info) == R_IRELATIVE)
+		{
+			if (Info->DynamicSize.PLTREL == DT_REL)
+				RelocateHelper(Info, (Elf_Rela *)&((Elf_Rel *)Info->DynamicTable.JMPREL)[i], 1, NULL);
+			else
+				RelocateHelper(Info, (Elf_Rela *)&((Elf_Rela *)Info->DynamicTable.JMPREL)[i], 0, NULL);
+			continue;
+		}
+
 		if (ELF_R_TYPE(info) != R_JMP_SLOT)
 		{
 			printf("dl: Wrong JMPREL type %d\n", ELF_R_TYPE(info));
 			return -EINVAL;
 		}
 
-		/* FIXME: HANDLE THIS RIGHT */
-		if (Info->DynamicSize.PLTREL == DT_REL)
+		/* The slot points back into the PLT stub, which pushes the index
+		   and enters _dl_runtime_resolve on the first call. Slots without
+		   a stub (-fno-plt) can't be bound lazily. */
+		Elf_Addr *slot = (Elf_Addr *)(Info->BaseAddress + offset);
+		if (*slot != 0)
 		{
-			Elf_Addr *slot = (Elf_Addr *)(Info->BaseAddress + offset);
 			*slot += Info->BaseAddress;
-			if (*slot == Info->BaseAddress)
-				RelocateHelper(Info, (Elf_Rela *)&((Elf_Rel *)Info->DynamicTable.JMPREL)[i], 1, NULL);
-		}
-		else if (Info->DynamicSize.PLTREL == DT_RELA)
-		{
-			Elf64_Sxword addend = ((Elf_Rela *)Info->DynamicTable.JMPREL)[i].r_addend;
-			Elf_Addr *slot = (Elf_Addr *)(Info->BaseAddress + offset);
-			*slot += Info->BaseAddress + addend;
-			if (*slot == Info->BaseAddress)
-				RelocateHelper(Info, (Elf_Rela *)&((Elf_Rela *)Info->DynamicTable.JMPREL)[i], 0, NULL);
+			continue;
 		}
+
+		if (Info->DynamicSize.PLTREL == DT_REL)
+			RelocateHelper(Info, (Elf_Rela *)&((Elf_Rel *)Info->DynamicTable.JMPREL)[i], 1, NULL);
+		else
+			RelocateHelper(Info, (Elf_Rela *)&((Elf_Rela *)Info->DynamicTable.JMPREL)[i], 0, NULL);
 	}
 
-	Info->Flags.Relocated = 1;
 	return 0;
 }
 
@@ -46,6 +46,7 @@ char *getenv(const char *name);
 unsigned long elf_hash(const unsigned char *name);
 uint32_t gnu_hash(const char *name);
 Elf64_Sym *find_symbol(const char *name, uint32_t *hash_table, Elf64_Sym *symtab, const char *strtab);
+Elf_Sym *find_symbol_gnu(const char *name, uint32_t hash, uint32_t *hash_table, Elf_Sym *symtab, const char *strtab);
 
 void __init_print_buffer();
 void __fini_print_buffer();
@@ -53,5 +54,7 @@ int printf(const char *format, ...);
 
 void *mini_malloc(size_t size);
 void mini_free(void *ptr);
+void *request_page(size_t size);
+void free_page(void *addr, size_t size);
 
 #endif // !__FENNIX_DL_HELPER_H__
@@ -25,6 +25,30 @@ extern void (*__init_array_end[])(void) __attribute__((weak));
 extern void (*__fini_array_start[])(void) __attribute__((weak));
 extern void (*__fini_array_end[])(void) __attribute__((weak));
 
+typedef struct
+{
+	__UINT64_TYPE__ r_offset;
+	__UINT64_TYPE__ r_info;
+	__INT64_TYPE__ r_addend;
+} __crt_rela;
+
+/* Only set by the linker for static executables, ld.so handles the rest */
+extern const __crt_rela __rela_iplt_start[] __attribute__((weak, visibility("hidden")));
+extern const __crt_rela __rela_iplt_end[] __attribute__((weak, visibility("hidden")));
+
+void __crt_apply_irelative(void)
+{
+	for (const __crt_rela *rela = __rela_iplt_start; rela < __rela_iplt_end; rela++)
+	{
+		/* R_X86_64_IRELATIVE */
+		if ((rela->r_info & 0xFFFFFFFF) != 37)
+			continue;
+
+		__UINT64_TYPE__ (*resolver)(void) = (__UINT64_TYPE__(*)(void))rela->r_addend;
+		*(__UINT64_TYPE__ *)rela->r_offset = resolver();
+	}
+}
+
 void __crt_init_array(void)
 {
 	for (fct *func = __init_array_start; func != __init_array_end; func++)
@@ -43,12 +67,13 @@ __attribute__((naked, used, no_stack_protector, section(".text"))) void _start()
 		"andq $-16, %rsp\n"
 		"movq %rsp, %rbp\n"
 
-		"movq %rdx, %rax\n"
 		"pushq %rcx\n"
 		"pushq %rdx\n"
 		"pushq %rsi\n"
 		"pushq %rdi\n"
-		"movq %rax, %rdi\n"
+
+		"call __crt_apply_irelative\n"
+		"movq 16(%rsp), %rdi\n"
 
 		"call __libc_init\n"
 		"call __crt_init_array\n"
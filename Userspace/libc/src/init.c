@@ -18,6 +18,8 @@
 #include <bits/libc.h>
 #include <stdio.h>
 
+#include "mem/liballoc_1_1.h"
+
 int __init_pthread(void);
 void __init_stdio(void);
 extern char **environ;
@@ -33,6 +35,11 @@ __attribute__((visibility("default"))) void _exit(int Code)
 {
 	fflush(stdout);
 	fflush(stderr);
+
+	/* Threads only end here for now, hand back the cached blocks */
+	if (__tcalloc_thread_exit)
+		__tcalloc_thread_exit();
+
 	sysdep(Exit)(Code);
 	while (1)
 		;
@@ -68,6 +68,11 @@ extern "C"
     extern void *PREFIX(calloc)(size_t, size_t);  ///< The standard function.
     extern void PREFIX(free)(void *);             ///< The standard function.
 
+    /** Returns the per-thread cache of tcalloc to the central lists. Only
+     * defined when tcalloc is the allocator, check the address first.
+     */
+    extern void __tcalloc_thread_exit(void) __attribute__((weak));
+
 #ifdef __cplusplus
 }
 #endif
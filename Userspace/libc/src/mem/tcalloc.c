@@ -0,0 +1,747 @@
+/*
+	This file is part of Fennix C Library.
+
+	Fennix C Library is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix C Library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix C Library. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Thread-caching, size-class allocator.
+ *
+ * Memory is obtained from the system in 1 MiB aligned chunks. The first
+ * pages of every chunk hold its header: a free-page bitmap and one span
+ * descriptor per page. Small requests (<= TC_SMALL_MAX) are rounded up to
+ * one of TC_CLASSES size classes and served from spans, which are page runs
+ * carved into equally sized objects. Medium requests are served as page runs
+ * directly and anything at or above TC_MMAP_THRESHOLD gets its own mapping.
+ *
+ * Every thread keeps a cache of free objects per size class in
+ * __pthread::AllocatorCache, so the common malloc/free path takes no locks.
+ * Caches are refilled from and flushed to the per-class central lists in
+ * batches. Freed page runs are marked dirty and handed back to the system
+ * with posix_madvise(POSIX_MADV_DONTNEED) once enough of them accumulate.
+ *
+ * Selected with -DLIBC_ALLOCATOR=tcalloc at libc configure time.
+ */
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include "liballoc_1_1.h"
+
+#define TC_PAGE_SHIFT 12
+#define TC_PAGE_SIZE (1UL << TC_PAGE_SHIFT)
+#define TC_CHUNK_SHIFT 20
+#define TC_CHUNK_SIZE (1UL << TC_CHUNK_SHIFT)
+#define TC_CHUNK_PAGES (TC_CHUNK_SIZE / TC_PAGE_SIZE)
+#define TC_CHUNK_MAGIC 0x7C41110C
+
+#define TC_CLASSES 40
+#define TC_SMALL_MAX 0x8000
+#define TC_MMAP_THRESHOLD 0x40000
+#define TC_MEDIUM_CLASS 0xFF
+
+/* Pages of freed-but-resident memory we tolerate before trimming */
+#define TC_DIRTY_MAX 256
+
+#define TC_ALIGN_UP(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+
+enum tc_chunk_kind
+{
+	TC_CHUNK_RUNS,
+	TC_CHUNK_LARGE
+};
+
+struct tc_span
+{
+	struct tc_span *Next;
+	struct tc_span *Prev;
+	void *FreeList;
+	char *Base;
+	uint32_t Used;
+	uint32_t Carved;
+	uint32_t Capacity;
+	uint16_t Pages;
+	/* Page index of the run head, valid for every page of the run */
+	uint16_t Head;
+	uint8_t Class;
+	uint8_t OnList;
+};
+
+struct tc_chunk
+{
+	uint32_t Magic;
+	uint32_t Kind;
+	size_t MapSize;
+	/* Links in RunBins[Bin], by longest free run */
+	struct tc_chunk *Next;
+	struct tc_chunk *Prev;
+	struct tc_chunk *NextDirty;
+	uint16_t FreePageCount;
+	uint16_t LongestRun;
+	uint8_t Bin;
+	uint8_t OnDirtyList;
+	uint64_t FreePages[TC_CHUNK_PAGES / 64];
+	uint64_t DirtyPages[TC_CHUNK_PAGES / 64];
+	struct tc_span Spans[TC_CHUNK_PAGES];
+};
+
+#define TC_HEADER_PAGES ((sizeof(struct tc_chunk) + TC_PAGE_SIZE - 1) / TC_PAGE_SIZE)
+
+struct tc_bin
+{
+	void *Head;
+	uint32_t Count;
+};
+
+struct tc_cache
+{
+	struct tc_bin Bins[TC_CLASSES];
+};
+
+struct tc_central
+{
+	volatile int Lock;
+	struct tc_span *Partial;
+};
+
+static struct tc_central Central[TC_CLASSES];
+
+/* Chunks binned by floor(log2(longest free run)), TC_RUN_BINS means full */
+#define TC_RUN_BINS 9
+static volatile int HeapLock;
+static struct tc_chunk *RunBins[TC_RUN_BINS];
+static struct tc_chunk *DirtyChunks;
+static struct tc_chunk *EmptyChunk;
+static size_t DirtyPageCount;
+
+static volatile int CacheLock;
+static struct tc_cache *CacheFreeList;
+
+static inline void tc_lock(volatile int *lock)
+{
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+	{
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+		{
+#if defined(__amd64__) || defined(__i386__)
+			__asm__ __volatile__("pause");
+#endif
+		}
+	}
+}
+
+static inline void tc_unlock(volatile int *lock)
+{
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline size_t tc_class_index(size_t size)
+{
+	if (size <= 128)
+		return size ? (size + 15) / 16 - 1 : 0;
+
+	size_t lg = 63 - __builtin_clzl(size - 1);
+	return 8 + (lg - 7) * 4 + (((size - 1) >> (lg - 2)) & 3);
+}
+
+static inline size_t tc_class_size(size_t index)
+{
+	if (index < 8)
+		return (index + 1) * 16;
+
+	size_t lg = 7 + (index - 8) / 4;
+	return (1UL << lg) + ((index - 8) % 4 + 1) * (1UL << (lg - 2));
+}
+
+/* Objects moved between a thread cache and the central list at once */
+static inline uint32_t tc_batch_size(size_t index)
+{
+	size_t n = 0x4000 / tc_class_size(index);
+	if (n < 2)
+		return 2;
+	if (n > 32)
+		return 32;
+	return (uint32_t)n;
+}
+
+static inline uint16_t tc_span_pages(size_t index)
+{
+	size_t bytes = tc_class_size(index) * 8;
+	if (bytes < 0x4000)
+		bytes = 0x4000;
+	return (uint16_t)(TC_ALIGN_UP(bytes, TC_PAGE_SIZE) / TC_PAGE_SIZE);
+}
+
+static inline struct tc_chunk *tc_chunk_of(const void *ptr)
+{
+	return (struct tc_chunk *)((uintptr_t)ptr & ~(TC_CHUNK_SIZE - 1));
+}
+
+static inline struct tc_span *tc_span_of(struct tc_chunk *chunk, const void *ptr)
+{
+	size_t page = ((uintptr_t)ptr - (uintptr_t)chunk) >> TC_PAGE_SHIFT;
+	return &chunk->Spans[chunk->Spans[page].Head];
+}
+
+static inline int tc_test(const uint64_t *map, size_t bit)
+{
+	return (map[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void tc_set_range(uint64_t *map, size_t start, size_t count, int value)
+{
+	for (size_t i = start; i < start + count; i++)
+	{
+		if (value)
+			map[i / 64] |= 1UL << (i % 64);
+		else
+			map[i / 64] &= ~(1UL << (i % 64));
+	}
+}
+
+/* Maps `size` bytes aligned to TC_CHUNK_SIZE */
+static void *tc_map_aligned(size_t size)
+{
+	size_t length = size + TC_CHUNK_SIZE;
+	char *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	char *aligned = (char *)TC_ALIGN_UP((uintptr_t)p, TC_CHUNK_SIZE);
+	if (aligned != p)
+		munmap(p, aligned - p);
+	if (aligned + size != p + length)
+		munmap(aligned + size, (p + length) - (aligned + size));
+	return aligned;
+}
+
+static uint16_t tc_longest_run(struct tc_chunk *chunk)
+{
+	size_t longest = 0, run = 0;
+	for (size_t i = 0; i < TC_CHUNK_PAGES / 64; i++)
+	{
+		uint64_t word = chunk->FreePages[i];
+		if (word == 0)
+		{
+			run = 0;
+			continue;
+		}
+
+		if (word == ~0UL)
+		{
+			run += 64;
+			if (run > longest)
+				longest = run;
+			continue;
+		}
+
+		for (size_t bit = 0; bit < 64; bit++)
+		{
+			if ((word >> bit) & 1)
+			{
+				if (++run > longest)
+					longest = run;
+			}
+			else
+				run = 0;
+		}
+	}
+	return (uint16_t)longest;
+}
+
+static inline uint8_t tc_run_bin(uint16_t pages)
+{
+	return pages ? (uint8_t)(31 - __builtin_clz(pages)) : TC_RUN_BINS;
+}
+
+static void tc_bin_unlink(struct tc_chunk *chunk)
+{
+	if (chunk->Bin == TC_RUN_BINS)
+		return;
+
+	if (chunk->Prev)
+		chunk->Prev->Next = chunk->Next;
+	else
+		RunBins[chunk->Bin] = chunk->Next;
+	if (chunk->Next)
+		chunk->Next->Prev = chunk->Prev;
+	chunk->Next = chunk->Prev = NULL;
+	chunk->Bin = TC_RUN_BINS;
+}
+
+/* Recomputes the longest free run and moves the chunk to the matching bin */
+static void tc_bin_update(struct tc_chunk *chunk)
+{
+	tc_bin_unlink(chunk);
+	chunk->LongestRun = tc_longest_run(chunk);
+	chunk->Bin = tc_run_bin(chunk->LongestRun);
+	if (chunk->Bin == TC_RUN_BINS)
+		return;
+
+	chunk->Prev = NULL;
+	chunk->Next = RunBins[chunk->Bin];
+	if (chunk->Next)
+		chunk->Next->Prev = chunk;
+	RunBins[chunk->Bin] = chunk;
+}
+
+static struct tc_chunk *tc_chunk_create(void)
+{
+	struct tc_chunk *chunk = tc_map_aligned(TC_CHUNK_SIZE);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->Magic = TC_CHUNK_MAGIC;
+	chunk->Kind = TC_CHUNK_RUNS;
+	chunk->MapSize = TC_CHUNK_SIZE;
+	chunk->FreePageCount = TC_CHUNK_PAGES - TC_HEADER_PAGES;
+	chunk->Bin = TC_RUN_BINS;
+	tc_set_range(chunk->FreePages, TC_HEADER_PAGES, chunk->FreePageCount, 1);
+	tc_bin_update(chunk);
+	return chunk;
+}
+
+/* Must be called with HeapLock held */
+static void tc_trim_locked(void)
+{
+	while (DirtyChunks)
+	{
+		struct tc_chunk *chunk = DirtyChunks;
+		DirtyChunks = chunk->NextDirty;
+		chunk->NextDirty = NULL;
+		chunk->OnDirtyList = 0;
+
+		if (chunk->FreePageCount == TC_CHUNK_PAGES - TC_HEADER_PAGES)
+		{
+			/* Keep one empty chunk around to absorb alloc/free cycles */
+			if (EmptyChunk && EmptyChunk != chunk &&
+				EmptyChunk->FreePageCount == TC_CHUNK_PAGES - TC_HEADER_PAGES)
+			{
+				tc_bin_unlink(chunk);
+				munmap(chunk, TC_CHUNK_SIZE);
+				continue;
+			}
+			EmptyChunk = chunk;
+		}
+
+		size_t page = TC_HEADER_PAGES;
+		while (page < TC_CHUNK_PAGES)
+		{
+			if (!tc_test(chunk->DirtyPages, page) || !tc_test(chunk->FreePages, page))
+			{
+				page++;
+				continue;
+			}
+
+			size_t start = page;
+			while (page < TC_CHUNK_PAGES &&
+				   tc_test(chunk->DirtyPages, page) &&
+				   tc_test(chunk->FreePages, page))
+				page++;
+
+			posix_madvise((char *)chunk + (start << TC_PAGE_SHIFT),
+						  (page - start) << TC_PAGE_SHIFT, POSIX_MADV_DONTNEED);
+			tc_set_range(chunk->DirtyPages, start, page - start, 0);
+		}
+	}
+
+	DirtyPageCount = 0;
+}
+
+static size_t tc_find_run(struct tc_chunk *chunk, uint16_t pages)
+{
+	size_t run = 0;
+	for (size_t i = TC_HEADER_PAGES; i < TC_CHUNK_PAGES; i++)
+	{
+		if (!tc_test(chunk->FreePages, i))
+		{
+			run = 0;
+			continue;
+		}
+
+		if (++run == pages)
+			return i + 1 - pages;
+	}
+	return 0;
+}
+
+static struct tc_span *tc_run_alloc(uint16_t pages)
+{
+	tc_lock(&HeapLock);
+
+	struct tc_chunk *chunk = NULL;
+	/* Chunks in the request's own bin may still be too short, later bins always fit */
+	for (struct tc_chunk *c = RunBins[tc_run_bin(pages)]; c; c = c->Next)
+	{
+		if (c->LongestRun >= pages)
+		{
+			chunk = c;
+			break;
+		}
+	}
+
+	for (size_t bin = tc_run_bin(pages) + 1; chunk == NULL && bin < TC_RUN_BINS; bin++)
+		chunk = RunBins[bin];
+
+	if (chunk == NULL)
+	{
+		chunk = tc_chunk_create();
+		if (chunk == NULL)
+		{
+			tc_unlock(&HeapLock);
+			return NULL;
+		}
+	}
+
+	size_t start = tc_find_run(chunk, pages);
+	tc_set_range(chunk->FreePages, start, pages, 0);
+	chunk->FreePageCount -= pages;
+	for (size_t i = start; i < start + pages; i++)
+	{
+		if (tc_test(chunk->DirtyPages, i))
+			DirtyPageCount--;
+		chunk->Spans[i].Head = (uint16_t)start;
+	}
+	tc_set_range(chunk->DirtyPages, start, pages, 0);
+	tc_bin_update(chunk);
+
+	tc_unlock(&HeapLock);
+
+	struct tc_span *span = &chunk->Spans[start];
+	span->Next = span->Prev = NULL;
+	span->FreeList = NULL;
+	span->Base = (char *)chunk + (start << TC_PAGE_SHIFT);
+	span->Used = span->Carved = span->Capacity = 0;
+	span->Pages = pages;
+	span->OnList = 0;
+	return span;
+}
+
+static void tc_run_free(struct tc_span *span)
+{
+	struct tc_chunk *chunk = tc_chunk_of(span->Base);
+	size_t start = span->Head;
+
+	tc_lock(&HeapLock);
+	tc_set_range(chunk->FreePages, start, span->Pages, 1);
+	tc_set_range(chunk->DirtyPages, start, span->Pages, 1);
+	chunk->FreePageCount += span->Pages;
+	tc_bin_update(chunk);
+
+	if (!chunk->OnDirtyList)
+	{
+		chunk->NextDirty = DirtyChunks;
+		DirtyChunks = chunk;
+		chunk->OnDirtyList = 1;
+	}
+
+	DirtyPageCount += span->Pages;
+	if (DirtyPageCount > TC_DIRTY_MAX)
+		tc_trim_locked();
+	tc_unlock(&HeapLock);
+}
+
+static inline void tc_list_remove(struct tc_central *c, struct tc_span *span)
+{
+	if (span->Prev)
+		span->Prev->Next = span->Next;
+	else
+		c->Partial = span->Next;
+	if (span->Next)
+		span->Next->Prev = span->Prev;
+	span->Next = span->Prev = NULL;
+	span->OnList = 0;
+}
+
+static inline void tc_list_push(struct tc_central *c, struct tc_span *span)
+{
+	span->Prev = NULL;
+	span->Next = c->Partial;
+	if (c->Partial)
+		c->Partial->Prev = span;
+	c->Partial = span;
+	span->OnList = 1;
+}
+
+/* Moves up to `count` objects of class `index` into `bin` */
+static uint32_t tc_central_fetch(size_t index, struct tc_bin *bin, uint32_t count)
+{
+	struct tc_central *c = &Central[index];
+	size_t size = tc_class_size(index);
+	uint32_t fetched = 0;
+
+	tc_lock(&c->Lock);
+	while (fetched < count)
+	{
+		struct tc_span *span = c->Partial;
+		if (span == NULL)
+		{
+			span = tc_run_alloc(tc_span_pages(index));
+			if (span == NULL)
+				break;
+
+			span->Class = (uint8_t)index;
+			span->Capacity = (uint32_t)((span->Pages << TC_PAGE_SHIFT) / size);
+			tc_list_push(c, span);
+		}
+
+		while (fetched < count && span->Used < span->Capacity)
+		{
+			void *obj = span->FreeList;
+			if (obj)
+				span->FreeList = *(void **)obj;
+			else
+				obj = span->Base + size * span->Carved++;
+
+			*(void **)obj = bin->Head;
+			bin->Head = obj;
+			span->Used++;
+			fetched++;
+		}
+
+		if (span->Used == span->Capacity)
+			tc_list_remove(c, span);
+	}
+	tc_unlock(&c->Lock);
+
+	bin->Count += fetched;
+	return fetched;
+}
+
+/* Returns up to `count` objects from `bin` to the central list */
+static void tc_central_release(size_t index, struct tc_bin *bin, uint32_t count)
+{
+	struct tc_central *c = &Central[index];
+
+	tc_lock(&c->Lock);
+	while (count-- && bin->Head)
+	{
+		void *obj = bin->Head;
+		bin->Head = *(void **)obj;
+		bin->Count--;
+
+		struct tc_span *span = tc_span_of(tc_chunk_of(obj), obj);
+		*(void **)obj = span->FreeList;
+		span->FreeList = obj;
+		span->Used--;
+
+		if (!span->OnList)
+			tc_list_push(c, span);
+
+		/* Keep at least one partial span so a lone object doesn't thrash pages */
+		if (span->Used == 0 && (span->Next || span->Prev))
+		{
+			tc_list_remove(c, span);
+			tc_run_free(span);
+		}
+	}
+	tc_unlock(&c->Lock);
+}
+
+static struct tc_cache *tc_cache_get(void)
+{
+	pthread_t self = pthread_self();
+	if (self == NULL)
+		return NULL;
+
+	if (self->AllocatorCache)
+		return self->AllocatorCache;
+
+	tc_lock(&CacheLock);
+	struct tc_cache *cache = CacheFreeList;
+	if (cache)
+		CacheFreeList = *(struct tc_cache **)cache;
+	tc_unlock(&CacheLock);
+
+	if (cache == NULL)
+	{
+		struct tc_span *span = tc_run_alloc(TC_ALIGN_UP(sizeof(struct tc_cache), TC_PAGE_SIZE) / TC_PAGE_SIZE);
+		if (span == NULL)
+			return NULL;
+		span->Class = TC_MEDIUM_CLASS;
+		cache = (struct tc_cache *)span->Base;
+	}
+
+	memset(cache, 0, sizeof(struct tc_cache));
+	self->AllocatorCache = cache;
+	return cache;
+}
+
+/* Flushes the calling thread's cache, called by _exit */
+void __tcalloc_thread_exit(void)
+{
+	pthread_t self = pthread_self();
+	if (self == NULL || self->AllocatorCache == NULL)
+		return;
+
+	struct tc_cache *cache = self->AllocatorCache;
+	for (size_t i = 0; i < TC_CLASSES; i++)
+		tc_central_release(i, &cache->Bins[i], cache->Bins[i].Count);
+
+	self->AllocatorCache = NULL;
+	tc_lock(&CacheLock);
+	*(struct tc_cache **)cache = CacheFreeList;
+	CacheFreeList = cache;
+	tc_unlock(&CacheLock);
+}
+
+static void *tc_large_alloc(size_t size)
+{
+	size_t mapSize = TC_ALIGN_UP(size + TC_PAGE_SIZE, TC_PAGE_SIZE);
+	if (mapSize < size)
+		return NULL;
+
+	struct tc_chunk *chunk = tc_map_aligned(mapSize);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->Magic = TC_CHUNK_MAGIC;
+	chunk->Kind = TC_CHUNK_LARGE;
+	chunk->MapSize = mapSize;
+	return (char *)chunk + TC_PAGE_SIZE;
+}
+
+static size_t tc_usable_size(void *ptr)
+{
+	struct tc_chunk *chunk = tc_chunk_of(ptr);
+	if (chunk->Kind == TC_CHUNK_LARGE)
+		return chunk->MapSize - TC_PAGE_SIZE;
+
+	struct tc_span *span = tc_span_of(chunk, ptr);
+	if (span->Class == TC_MEDIUM_CLASS)
+		return (size_t)span->Pages << TC_PAGE_SHIFT;
+	return tc_class_size(span->Class);
+}
+
+void *PREFIX(malloc)(size_t size)
+{
+	if (size > TC_SMALL_MAX)
+	{
+		if (size >= TC_MMAP_THRESHOLD)
+		{
+			void *ptr = tc_large_alloc(size);
+			if (ptr == NULL)
+				errno = ENOMEM;
+			return ptr;
+		}
+
+		struct tc_span *span = tc_run_alloc((uint16_t)(TC_ALIGN_UP(size, TC_PAGE_SIZE) / TC_PAGE_SIZE));
+		if (span == NULL)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		span->Class = TC_MEDIUM_CLASS;
+		return span->Base;
+	}
+
+	size_t index = tc_class_index(size);
+	struct tc_cache *cache = tc_cache_get();
+	struct tc_bin localBin = {NULL, 0};
+	struct tc_bin *bin = cache ? &cache->Bins[index] : &localBin;
+
+	if (bin->Head == NULL && tc_central_fetch(index, bin, cache ? tc_batch_size(index) : 1) == 0)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	void *obj = bin->Head;
+	bin->Head = *(void **)obj;
+	bin->Count--;
+	return obj;
+}
+
+void PREFIX(free)(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	struct tc_chunk *chunk = tc_chunk_of(ptr);
+	if (chunk->Kind == TC_CHUNK_LARGE)
+	{
+		munmap(chunk, chunk->MapSize);
+		return;
+	}
+
+	struct tc_span *span = tc_span_of(chunk, ptr);
+	if (span->Class == TC_MEDIUM_CLASS)
+	{
+		tc_run_free(span);
+		return;
+	}
+
+	size_t index = span->Class;
+	struct tc_cache *cache = tc_cache_get();
+	if (cache == NULL)
+	{
+		struct tc_bin localBin = {ptr, 1};
+		*(void **)ptr = NULL;
+		tc_central_release(index, &localBin, 1);
+		return;
+	}
+
+	struct tc_bin *bin = &cache->Bins[index];
+	*(void **)ptr = bin->Head;
+	bin->Head = ptr;
+	bin->Count++;
+
+	uint32_t batch = tc_batch_size(index);
+	if (bin->Count > batch * 2)
+		tc_central_release(index, bin, batch);
+}
+
+void *PREFIX(calloc)(size_t nobj, size_t size)
+{
+	if (nobj && size > __SIZE_MAX__ / nobj)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size_t total = nobj * size;
+	void *ptr = PREFIX(malloc)(total);
+	/* Fresh mappings are already zeroed */
+	if (ptr && total < TC_MMAP_THRESHOLD)
+		memset(ptr, 0, total);
+	return ptr;
+}
+
+void *PREFIX(realloc)(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return PREFIX(malloc)(size);
+
+	if (size == 0)
+	{
+		PREFIX(free)(ptr);
+		return NULL;
+	}
+
+	size_t usable = tc_usable_size(ptr);
+	/* Shrink in place unless we'd waste more than half of the block */
+	if (size <= usable && size >= usable / 2)
+		return ptr;
+
+	void *newPtr = PREFIX(malloc)(size);
+	if (newPtr == NULL)
+		return NULL;
+
+	memcpy(newPtr, ptr, size < usable ? size : usable);
+	PREFIX(free)(ptr);
+	return newPtr;
+}
@@ -30,34 +30,107 @@ export FILE *stdin;
 export FILE *stdout;
 export FILE *stderr;
 
+static FILE *__stdio_new(int fd, int flags, int mode)
+{
+	FILE *stream = malloc(sizeof(FILE));
+	if (!stream)
+		return NULL;
+
+	stream->fd = fd;
+	stream->buffer = &stream->buffer_unbuf;
+	stream->buffer_size = 1;
+	stream->buffer_pos = 0;
+	stream->buffer_end = 0;
+	stream->buffer_mode = _IONBF;
+	stream->buffer_owned = 0;
+	stream->flags = flags;
+	stream->error = 0;
+	stream->eof = 0;
+
+	/* If the allocation fails the stream stays unbuffered */
+	setvbuf(stream, NULL, mode, BUFSIZ);
+	return stream;
+}
+
+/* Writes all the entries of iov, continuing after short writes */
+static int __stdio_writev(FILE *stream, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0)
+	{
+		if (iov->iov_len == 0)
+		{
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		ssize_t ret = sysdep(WriteV)(stream->fd, iov, iovcnt);
+		if (ret <= 0)
+		{
+			stream->error = 1;
+			return EOF;
+		}
+
+		while (iovcnt > 0 && (size_t)ret >= iov->iov_len)
+		{
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+/* A stream holds either read data or pending writes, never both */
+static int __stdio_to_read(FILE *stream)
+{
+	if (stream->buffer_end == 0 && stream->buffer_pos > 0)
+		return fflush(stream);
+	return 0;
+}
+
+static int __stdio_to_write(FILE *stream)
+{
+	if (stream->buffer_end > 0)
+		return fflush(stream);
+	return 0;
+}
+
+static int __stdio_fill(FILE *stream)
+{
+	if (__stdio_to_read(stream) == EOF)
+		return EOF;
+
+	/* Reading from an interactive stream shows pending output first */
+	if (stream->buffer_mode != _IOFBF && stream != stdout)
+		fflush(stdout);
+
+	ssize_t ret = sysdep(Read)(stream->fd, stream->buffer, stream->buffer_size);
+	stream->buffer_pos = 0;
+	stream->buffer_end = ret > 0 ? ret : 0;
+	if (ret <= 0)
+	{
+		if (ret == 0)
+			stream->eof = 1;
+		else
+			stream->error = 1;
+		return EOF;
+	}
+	return 0;
+}
+
 void __init_stdio(void)
 {
-	stdin = malloc(sizeof(FILE));
-	stdin->fd = 0;
-	stdin->buffer = malloc(4096);
-	stdin->buffer_size = 4096;
-	stdin->buffer_pos = 0;
-	stdin->flags = _i_READ;
-	stdin->error = 0;
-	stdin->eof = 0;
-
-	stdout = malloc(sizeof(FILE));
-	stdout->fd = 1;
-	stdout->buffer = malloc(4096);
-	stdout->buffer_size = 4096;
-	stdout->buffer_pos = 0;
-	stdout->flags = _i_WRITE;
-	stdout->error = 0;
-	stdout->eof = 0;
-
-	stderr = malloc(sizeof(FILE));
-	stderr->fd = 2;
-	stderr->buffer = malloc(4096);
-	stderr->buffer_size = 4096;
-	stderr->buffer_pos = 0;
-	stderr->flags = _i_WRITE;
-	stderr->error = 0;
-	stderr->eof = 0;
+	/* No isatty() yet, so assume stdin and stdout are a terminal */
+	stdin = __stdio_new(0, _i_READ, _IOLBF);
+	stdout = __stdio_new(1, _i_WRITE, _IOLBF);
+	stderr = __stdio_new(2, _i_WRITE, _IONBF);
 
 	_i_open_files[0] = stdin;
 	_i_open_files[1] = stdout;
@@ -73,13 +146,15 @@ export int fclose(FILE *stream)
 	if (!stream)
 		return EOF;
 
-	if (stream->buffer)
+	int ret = fflush(stream);
+	if (stream->buffer_owned)
 		free(stream->buffer);
 
-	sysdep(Close)(stream->fd);
+	if (sysdep(Close)(stream->fd) < 0)
+		ret = EOF;
 	_i_open_files[stream->fd] = NULL;
 	free(stream);
-	return 0;
+	return ret;
 }
 
 export FILE *fdopen(int, const char *);
@@ -101,25 +176,34 @@ export int ferror(FILE *stream)
 export int fflush(FILE *stream)
 {
 	if (!stream)
-		return EOF;
-
-	if (stream->flags & _i_WRITE)
 	{
-		if (stream->buffer_pos > 0)
+		/* Only output streams, read ahead of input streams is kept */
+		int ret = 0;
+		for (size_t i = 0; i < sizeof(_i_open_files) / sizeof(_i_open_files[0]); i++)
 		{
-			ssize_t written = sysdep(Write)(stream->fd, stream->buffer, stream->buffer_pos);
-			if (written < 0)
-			{
-				stream->error = 1;
-				return EOF;
-			}
-			stream->buffer_pos = 0;
+			FILE *file = _i_open_files[i];
+			if (file && file->buffer_end == 0 && fflush(file) == EOF)
+				ret = EOF;
 		}
+		return ret;
+	}
+
+	if (stream->buffer_end > 0)
+	{
+		/* Give back the read ahead so the file offset matches the stream */
+		if (stream->buffer_pos < stream->buffer_end)
+			sysdep(Seek)(stream->fd, -(off_t)(stream->buffer_end - stream->buffer_pos), SEEK_CUR);
+		stream->buffer_pos = 0;
+		stream->buffer_end = 0;
+		return 0;
 	}
-	else if (stream->flags & _i_READ)
+
+	if (stream->buffer_pos > 0)
 	{
+		struct iovec iov = {stream->buffer, stream->buffer_pos};
 		stream->buffer_pos = 0;
-		stream->buffer_size = 0;
+		if (__stdio_writev(stream, &iov, 1) == EOF)
+			return EOF;
 	}
 	return 0;
 }
@@ -129,19 +213,10 @@ export int fgetc(FILE *stream)
 	if (!stream || !(stream->flags & _i_READ))
 		return EOF;
 
-	if (stream->buffer_pos >= stream->buffer_size)
+	if (stream->buffer_pos >= stream->buffer_end)
 	{
-		int res = sysdep(Read)(stream->fd, stream->buffer, 4096);
-		if (res <= 0)
-		{
-			if (res == 0)
-				stream->eof = 1;
-			else
-				stream->error = 1;
+		if (__stdio_fill(stream) == EOF)
 			return EOF;
-		}
-		stream->buffer_pos = 0;
-		stream->buffer_size = res;
 	}
 
 	return (unsigned char)stream->buffer[stream->buffer_pos++];
@@ -212,17 +287,12 @@ export FILE *fopen(const char *restrict pathname, const char *restrict mode)
 	if (fd < 0)
 		return NULL;
 
-	FILE *file = malloc(sizeof(FILE));
+	FILE *file = __stdio_new(fd, flags, _IOFBF);
 	if (!file)
+	{
+		sysdep(Close)(fd);
 		return NULL;
-
-	file->fd = fd;
-	file->buffer = malloc(4096);
-	file->buffer_size = 4096;
-	file->buffer_pos = -1;
-	file->flags = flags;
-	file->error = 0;
-	file->eof = 0;
+	}
 
 	_i_open_files[fd] = file;
 	return file;
@@ -242,9 +312,13 @@ export int fputc(int c, FILE *stream)
 	if (!stream || !(stream->flags & _i_WRITE))
 		return EOF;
 
+	if (__stdio_to_write(stream) == EOF)
+		return EOF;
+
 	stream->buffer[stream->buffer_pos++] = (char)c;
 
-	if (stream->buffer_pos >= stream->buffer_size)
+	if (stream->buffer_pos >= stream->buffer_size ||
+		(stream->buffer_mode == _IOLBF && c == '\n'))
 	{
 		if (fflush(stream) == EOF)
 			return EOF;
@@ -258,45 +332,73 @@ export int fputs(const char *restrict s, FILE *restrict stream)
 	if (!stream || !(stream->flags & _i_WRITE))
 		return EOF;
 
-	while (*s)
-	{
-		if (fputc(*s++, stream) == EOF)
-			return EOF;
-	}
-
+	size_t len = strlen(s);
+	if (fwrite(s, 1, len, stream) != len)
+		return EOF;
 	return 0;
 }
 
 export size_t fread(void *restrict ptr, size_t size, size_t nitems, FILE *restrict stream)
 {
 	size_t total_bytes = size * nitems;
+	if (!stream || !(stream->flags & _i_READ) || total_bytes == 0)
+		return 0;
+
 	size_t bytes_read = 0;
+	if (stream->buffer_pos < stream->buffer_end)
+	{
+		bytes_read = stream->buffer_end - stream->buffer_pos;
+		if (bytes_read > total_bytes)
+			bytes_read = total_bytes;
+
+		memcpy(ptr, stream->buffer + stream->buffer_pos, bytes_read);
+		stream->buffer_pos += bytes_read;
+	}
 
 	while (bytes_read < total_bytes)
 	{
-		if (stream->buffer_pos >= stream->buffer_size)
+		size_t left = total_bytes - bytes_read;
+		if (left < stream->buffer_size)
 		{
-			int res = sysdep(Read)(stream->fd, stream->buffer, stream->buffer_size);
-			if (res <= 0)
-			{
-				if (res == 0)
-					stream->eof = 1;
-				else
-					stream->error = 1;
+			if (__stdio_fill(stream) == EOF)
 				break;
-			}
-			stream->buffer_pos = 0;
-			stream->buffer_size = res;
+
+			size_t bytes_to_copy = stream->buffer_end;
+			if (bytes_to_copy > left)
+				bytes_to_copy = left;
+
+			memcpy((char *)ptr + bytes_read, stream->buffer, bytes_to_copy);
+			stream->buffer_pos = bytes_to_copy;
+			bytes_read += bytes_to_copy;
+			continue;
 		}
 
-		size_t bytes_to_copy = total_bytes - bytes_read;
-		size_t available = stream->buffer_size - stream->buffer_pos;
-		if (bytes_to_copy > available)
-			bytes_to_copy = available;
+		/* Large reads go straight to the caller, the buffer only takes the read ahead */
+		if (__stdio_to_read(stream) == EOF)
+			break;
+
+		struct iovec iov[2] = {
+			{(char *)ptr + bytes_read, left},
+			{stream->buffer, stream->buffer_size},
+		};
+		ssize_t ret = sysdep(ReadV)(stream->fd, iov, 2);
+		stream->buffer_pos = 0;
+		stream->buffer_end = 0;
+		if (ret <= 0)
+		{
+			if (ret == 0)
+				stream->eof = 1;
+			else
+				stream->error = 1;
+			break;
+		}
 
-		memcpy((char *)ptr + bytes_read, stream->buffer + stream->buffer_pos, bytes_to_copy);
-		stream->buffer_pos += bytes_to_copy;
-		bytes_read += bytes_to_copy;
+		if ((size_t)ret > left)
+		{
+			stream->buffer_end = ret - left;
+			ret = left;
+		}
+		bytes_read += ret;
 	}
 
 	return bytes_read / size;
@@ -307,14 +409,16 @@ export int fscanf(FILE *restrict, const char *restrict, ...);
 
 export int fseek(FILE *stream, long offset, int whence)
 {
+	if (fflush(stream) == EOF)
+		return EOF;
+
 	int res = sysdep(Seek)(stream->fd, offset, whence);
 	if (res < 0)
 	{
 		stream->error = 1;
 		return EOF;
 	}
-	stream->buffer_pos = 0;
-	stream->buffer_size = 0;
+	stream->eof = 0;
 	return 0;
 }
 
@@ -323,7 +427,13 @@ export int fsetpos(FILE *, const fpos_t *);
 
 export long ftell(FILE *stream)
 {
-	return sysdep(Tell)(stream->fd);
+	long pos = sysdep(Tell)(stream->fd);
+	if (pos < 0)
+		return __check_errno(pos, -1);
+
+	if (stream->buffer_end > 0)
+		return pos - (long)(stream->buffer_end - stream->buffer_pos);
+	return pos + (long)stream->buffer_pos;
 }
 
 export off_t ftello(FILE *);
@@ -333,32 +443,34 @@ export void funlockfile(FILE *);
 export size_t fwrite(const void *restrict ptr, size_t size, size_t nitems, FILE *restrict stream)
 {
 	size_t total_bytes = size * nitems;
-	size_t bytes_written = 0;
-
-	while (bytes_written < total_bytes)
-	{
-		size_t bytes_to_copy = total_bytes - bytes_written;
-		size_t space_available = stream->buffer_size - stream->buffer_pos;
+	if (!stream || !(stream->flags & _i_WRITE) || total_bytes == 0)
+		return 0;
 
-		if (bytes_to_copy > space_available)
-			bytes_to_copy = space_available;
+	if (__stdio_to_write(stream) == EOF)
+		return 0;
 
-		memcpy(stream->buffer + stream->buffer_pos, (const char *)ptr + bytes_written, bytes_to_copy);
-		stream->buffer_pos += bytes_to_copy;
-		bytes_written += bytes_to_copy;
+	if (total_bytes < stream->buffer_size - stream->buffer_pos)
+	{
+		memcpy(stream->buffer + stream->buffer_pos, ptr, total_bytes);
+		stream->buffer_pos += total_bytes;
 
-		if (stream->buffer_pos == stream->buffer_size)
+		if (stream->buffer_mode == _IOLBF && memchr(ptr, '\n', total_bytes))
 		{
-			if (sysdep(Write)(stream->fd, stream->buffer, stream->buffer_size) != stream->buffer_size)
-			{
-				stream->error = 1;
-				break;
-			}
-			stream->buffer_pos = 0;
+			if (fflush(stream) == EOF)
+				return 0;
 		}
+		return nitems;
 	}
 
-	return bytes_written / size;
+	/* Doesn't fit, send the pending bytes and the data with one call */
+	struct iovec iov[2] = {
+		{stream->buffer, stream->buffer_pos},
+		{(void *)ptr, total_bytes},
+	};
+	stream->buffer_pos = 0;
+	if (__stdio_writev(stream, iov, 2) == EOF)
+		return 0;
+	return nitems;
 }
 
 export int getc(FILE *stream)
@@ -448,7 +560,7 @@ export int printf(const char *restrict format, ...)
 {
 	va_list args;
 	va_start(args, format);
-	int ret = vprintf_(format, args);
+	int ret = vfprintf(stdout, format, args);
 	va_end(args);
 	return ret;
 }
@@ -489,8 +601,51 @@ export int rename(const char *, const char *);
 export int renameat(int, const char *, int, const char *);
 export void rewind(FILE *);
 export int scanf(const char *restrict, ...);
-export void setbuf(FILE *restrict, char *restrict);
-export int setvbuf(FILE *restrict, char *restrict, int, size_t);
+
+export void setbuf(FILE *restrict stream, char *restrict buf)
+{
+	setvbuf(stream, buf, buf ? _IOFBF : _IONBF, BUFSIZ);
+}
+
+export int setvbuf(FILE *restrict stream, char *restrict buf, int type, size_t size)
+{
+	if (!stream || (type != _IOFBF && type != _IOLBF && type != _IONBF))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (fflush(stream) == EOF)
+		return -1;
+
+	char *buffer = &stream->buffer_unbuf;
+	int owned = 0;
+	if (type == _IONBF)
+		size = 1;
+	else
+	{
+		if (size == 0)
+			size = BUFSIZ;
+
+		buffer = buf;
+		if (!buffer)
+		{
+			buffer = malloc(size);
+			if (!buffer)
+				return -1;
+			owned = 1;
+		}
+	}
+
+	if (stream->buffer_owned)
+		free(stream->buffer);
+
+	stream->buffer = buffer;
+	stream->buffer_size = size;
+	stream->buffer_mode = type;
+	stream->buffer_owned = owned;
+	return 0;
+}
 
 export int snprintf(char *restrict s, size_t n, const char *restrict format, ...)
 {
@@ -626,33 +781,54 @@ export char *tmpnam(char *);
 export int ungetc(int, FILE *);
 export int vdprintf(int, const char *restrict, va_list);
 
+struct __stdio_chunk
+{
+	FILE *stream;
+	size_t length;
+	int error;
+	char data[128];
+};
+
+static void __stdio_chunk_flush(struct __stdio_chunk *chunk)
+{
+	if (chunk->length && fwrite(chunk->data, 1, chunk->length, chunk->stream) != chunk->length)
+		chunk->error = 1;
+	chunk->length = 0;
+}
+
+static void __stdio_chunk_out(char c, void *arg)
+{
+	struct __stdio_chunk *chunk = arg;
+	chunk->data[chunk->length++] = c;
+	if (chunk->length == sizeof(chunk->data))
+		__stdio_chunk_flush(chunk);
+}
+
 export int vfprintf(FILE *restrict stream, const char *restrict format, va_list ap)
 {
 	if (!stream || !(stream->flags & _i_WRITE))
 		return EOF;
 
-	int ret = vprintf_(format, ap);
-	if (ret < 0)
+	/* Formatted output is handed to the stream in chunks, not per character */
+	struct __stdio_chunk chunk = {.stream = stream};
+	int ret = vfctprintf(__stdio_chunk_out, &chunk, format, ap);
+	__stdio_chunk_flush(&chunk);
+	if (ret < 0 || chunk.error)
 	{
 		stream->error = 1;
 		return EOF;
 	}
 
-	const char *p = format;
-	while (*p)
-	{
-		if (fputc(*p++, stream) == EOF)
-		{
-			stream->error = 1;
-			return EOF;
-		}
-	}
-
 	return ret;
 }
 
 export int vfscanf(FILE *restrict, const char *restrict, va_list);
-export int vprintf(const char *restrict, va_list);
+
+export int vprintf(const char *restrict format, va_list ap)
+{
+	return vfprintf(stdout, format, ap);
+}
+
 export int vscanf(const char *restrict, va_list);
 
 export int vsnprintf(char *restrict s, size_t n, const char *restrict format, va_list ap)
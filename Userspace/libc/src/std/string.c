@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "string_simd.h"
 
 export void *memccpy(void *restrict s1, const void *restrict s2, int c, size_t n)
 {
@@ -53,7 +54,7 @@ export void *memchr(const void *s, int c, size_t n)
 	return NULL;
 }
 
-export int memcmp(const void *s1, const void *s2, size_t n)
+STRING_EXPORT int STRING_GENERIC(memcmp)(const void *s1, const void *s2, size_t n)
 {
 	const unsigned char *p1 = (const unsigned char *)s1;
 	const unsigned char *p2 = (const unsigned char *)s2;
@@ -68,7 +69,7 @@ export int memcmp(const void *s1, const void *s2, size_t n)
 	return 0;
 }
 
-export void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+STRING_EXPORT void *STRING_GENERIC(memcpy)(void *restrict s1, const void *restrict s2, size_t n)
 {
 	unsigned char *dest = (unsigned char *)s1;
 	const unsigned char *src = (const unsigned char *)s2;
@@ -106,13 +107,23 @@ export void *memmem(const void *haystack, size_t haystacklen, const void *needle
 	return NULL;
 }
 
-export void *memmove(void *s1, const void *s2, size_t n)
+STRING_EXPORT void *STRING_GENERIC(memmove)(void *s1, const void *s2, size_t n)
 {
 	unsigned char *dest = (unsigned char *)s1;
 	const unsigned char *src = (const unsigned char *)s2;
+	typedef unsigned long __attribute__((may_alias, aligned(1))) word_t;
 
-	if (dest < src)
+	if ((__UINTPTR_TYPE__)dest - (__UINTPTR_TYPE__)src >= n)
 	{
+		/* dest is below src or the buffers don't overlap, copy forward */
+		while (n >= sizeof(word_t))
+		{
+			*(word_t *)dest = *(const word_t *)src;
+			dest += sizeof(word_t);
+			src += sizeof(word_t);
+			n -= sizeof(word_t);
+		}
+
 		while (n--)
 			*dest++ = *src++;
 	}
@@ -120,6 +131,14 @@ export void *memmove(void *s1, const void *s2, size_t n)
 	{
 		dest += n;
 		src += n;
+		while (n >= sizeof(word_t))
+		{
+			dest -= sizeof(word_t);
+			src -= sizeof(word_t);
+			n -= sizeof(word_t);
+			*(word_t *)dest = *(const word_t *)src;
+		}
+
 		while (n--)
 			*--dest = *--src;
 	}
@@ -127,9 +146,19 @@ export void *memmove(void *s1, const void *s2, size_t n)
 	return s1;
 }
 
-export void *memset(void *s, int c, size_t n)
+STRING_EXPORT void *STRING_GENERIC(memset)(void *s, int c, size_t n)
 {
 	unsigned char *p = (unsigned char *)s;
+	typedef unsigned long __attribute__((may_alias, aligned(1))) word_t;
+	word_t pattern = (unsigned char)c * (~0UL / 0xFF);
+
+	while (n >= sizeof(word_t))
+	{
+		*(word_t *)p = pattern;
+		p += sizeof(word_t);
+		n -= sizeof(word_t);
+	}
+
 	while (n--)
 		*p++ = (unsigned char)c;
 	return s;
@@ -170,7 +199,7 @@ export char *strcat(char *restrict s1, const char *restrict s2)
 	return s1;
 }
 
-export char *strchr(const char *s, int c)
+STRING_EXPORT char *STRING_GENERIC(strchr)(const char *s, int c)
 {
 	while (*s)
 	{
@@ -465,7 +494,7 @@ size_t strlcpy(char *restrict dst, const char *restrict src, size_t dstsize)
 	return src_len;
 }
 
-export size_t strlen(const char *s)
+STRING_EXPORT size_t STRING_GENERIC(strlen)(const char *s)
 {
 	const char *start = s;
 	while (*s)
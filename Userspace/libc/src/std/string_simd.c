@@ -0,0 +1,811 @@
+/*
+	This file is part of Fennix C Library.
+
+	Fennix C Library is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix C Library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix C Library. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <bits/libc.h>
+#include "string_simd.h"
+
+#ifdef STRING_IFUNC
+
+#include <inttypes.h>
+#include <immintrin.h>
+#include <cpuid.h>
+
+/* Above this size stores bypass the cache, the destination won't fit anyway */
+#define NT_THRESHOLD 0x1000000
+/* With ERMS `rep movsb`/`rep stosb` beat vector loops from here on */
+#define ERMS_THRESHOLD 0x800
+/* With FSRM `rep movsb` is fast even for short copies */
+#define FSRM_THRESHOLD 0x400
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64u;
+typedef uint32_t __attribute__((may_alias, aligned(1))) u32u;
+typedef uint16_t __attribute__((may_alias, aligned(1))) u16u;
+
+static struct
+{
+	int Detected;
+	int AVX2;
+	int ERMS;
+	int FSRM;
+} CPU;
+
+static void DetectCPU(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (CPU.Detected)
+		return;
+	CPU.Detected = 1;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return;
+
+	/* AVX state must be enabled by the OS in XCR0, not only supported by the CPU */
+	int ymmEnabled = 0;
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX))
+	{
+		uint32_t xcr0Low, xcr0High;
+		__asm__ __volatile__("xgetbv"
+							 : "=a"(xcr0Low), "=d"(xcr0High)
+							 : "c"(0));
+		ymmEnabled = (xcr0Low & 0x6) == 0x6;
+	}
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return;
+
+	CPU.AVX2 = ymmEnabled && (ebx & bit_AVX2);
+	CPU.ERMS = (ebx & (1 << 9)) != 0;
+	CPU.FSRM = (edx & (1 << 4)) != 0;
+}
+
+static inline __attribute__((always_inline)) void RepMovsb(void *d, const void *s, size_t n)
+{
+	__asm__ __volatile__("rep movsb"
+						 : "+D"(d), "+S"(s), "+c"(n)
+						 :
+						 : "memory");
+}
+
+static inline __attribute__((always_inline)) void RepStosb(void *d, int c, size_t n)
+{
+	__asm__ __volatile__("rep stosb"
+						 : "+D"(d), "+c"(n)
+						 : "a"(c)
+						 : "memory");
+}
+
+/* n < 16. All loads happen before the stores, so overlapping buffers are fine */
+static inline __attribute__((always_inline)) void CopySmall(unsigned char *d, const unsigned char *s, size_t n)
+{
+	if (n >= 8)
+	{
+		uint64_t a = *(const u64u *)s, b = *(const u64u *)(s + n - 8);
+		*(u64u *)d = a;
+		*(u64u *)(d + n - 8) = b;
+	}
+	else if (n >= 4)
+	{
+		uint32_t a = *(const u32u *)s, b = *(const u32u *)(s + n - 4);
+		*(u32u *)d = a;
+		*(u32u *)(d + n - 4) = b;
+	}
+	else if (n >= 2)
+	{
+		uint16_t a = *(const u16u *)s, b = *(const u16u *)(s + n - 2);
+		*(u16u *)d = a;
+		*(u16u *)(d + n - 2) = b;
+	}
+	else if (n)
+		*d = *s;
+}
+
+static inline __attribute__((always_inline)) void SetSmall(unsigned char *d, uint64_t pattern, size_t n)
+{
+	if (n >= 8)
+	{
+		*(u64u *)d = pattern;
+		*(u64u *)(d + n - 8) = pattern;
+	}
+	else if (n >= 4)
+	{
+		*(u32u *)d = (uint32_t)pattern;
+		*(u32u *)(d + n - 4) = (uint32_t)pattern;
+	}
+	else if (n >= 2)
+	{
+		*(u16u *)d = (uint16_t)pattern;
+		*(u16u *)(d + n - 2) = (uint16_t)pattern;
+	}
+	else if (n)
+		*d = (unsigned char)pattern;
+}
+
+#pragma region SSE2
+
+/*
+ * Copies n > 64 bytes forward. The head and the tail are loaded before
+ * anything is stored, so this is also correct for memmove when d < s.
+ */
+static inline __attribute__((always_inline)) void CopyForwardSSE2(unsigned char *d, const unsigned char *s, size_t n, int erms)
+{
+	if (erms && n >= (CPU.FSRM ? FSRM_THRESHOLD : ERMS_THRESHOLD) && n < NT_THRESHOLD)
+	{
+		RepMovsb(d, s, n);
+		return;
+	}
+
+	__m128i head = _mm_loadu_si128((const __m128i *)s);
+	__m128i t0 = _mm_loadu_si128((const __m128i *)(s + n - 64));
+	__m128i t1 = _mm_loadu_si128((const __m128i *)(s + n - 48));
+	__m128i t2 = _mm_loadu_si128((const __m128i *)(s + n - 32));
+	__m128i t3 = _mm_loadu_si128((const __m128i *)(s + n - 16));
+	unsigned char *end = d + n;
+
+	size_t skew = 16 - ((uintptr_t)d & 15);
+	unsigned char *dst = d + skew;
+	const unsigned char *src = s + skew;
+	size_t left = n - skew;
+
+	if (n >= NT_THRESHOLD && ((uintptr_t)d - (uintptr_t)s) >= n)
+	{
+		for (; left > 64; left -= 64, dst += 64, src += 64)
+		{
+			_mm_prefetch((const char *)src + 512, _MM_HINT_NTA);
+			__m128i a = _mm_loadu_si128((const __m128i *)src);
+			__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+			__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+			__m128i e = _mm_loadu_si128((const __m128i *)(src + 48));
+			_mm_stream_si128((__m128i *)dst, a);
+			_mm_stream_si128((__m128i *)(dst + 16), b);
+			_mm_stream_si128((__m128i *)(dst + 32), c);
+			_mm_stream_si128((__m128i *)(dst + 48), e);
+		}
+		_mm_sfence();
+	}
+	else
+	{
+		for (; left > 64; left -= 64, dst += 64, src += 64)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i *)src);
+			__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+			__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+			__m128i e = _mm_loadu_si128((const __m128i *)(src + 48));
+			_mm_store_si128((__m128i *)dst, a);
+			_mm_store_si128((__m128i *)(dst + 16), b);
+			_mm_store_si128((__m128i *)(dst + 32), c);
+			_mm_store_si128((__m128i *)(dst + 48), e);
+		}
+	}
+
+	_mm_storeu_si128((__m128i *)(end - 64), t0);
+	_mm_storeu_si128((__m128i *)(end - 48), t1);
+	_mm_storeu_si128((__m128i *)(end - 32), t2);
+	_mm_storeu_si128((__m128i *)(end - 16), t3);
+	_mm_storeu_si128((__m128i *)d, head);
+}
+
+/* Copies n > 64 bytes backward, for memmove when d > s and the buffers overlap */
+static inline __attribute__((always_inline)) void CopyBackwardSSE2(unsigned char *d, const unsigned char *s, size_t n)
+{
+	__m128i h0 = _mm_loadu_si128((const __m128i *)s);
+	__m128i h1 = _mm_loadu_si128((const __m128i *)(s + 16));
+	__m128i h2 = _mm_loadu_si128((const __m128i *)(s + 32));
+	__m128i h3 = _mm_loadu_si128((const __m128i *)(s + 48));
+	__m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+
+	unsigned char *dst = (unsigned char *)((uintptr_t)(d + n) & ~(uintptr_t)15);
+	const unsigned char *src = s + (dst - d);
+	size_t left = dst - d;
+
+	for (; left > 64; left -= 64)
+	{
+		dst -= 64;
+		src -= 64;
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 48));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i e = _mm_loadu_si128((const __m128i *)src);
+		_mm_store_si128((__m128i *)(dst + 48), a);
+		_mm_store_si128((__m128i *)(dst + 32), b);
+		_mm_store_si128((__m128i *)(dst + 16), c);
+		_mm_store_si128((__m128i *)dst, e);
+	}
+
+	_mm_storeu_si128((__m128i *)(d + n - 16), tail);
+	_mm_storeu_si128((__m128i *)(d + 48), h3);
+	_mm_storeu_si128((__m128i *)(d + 32), h2);
+	_mm_storeu_si128((__m128i *)(d + 16), h1);
+	_mm_storeu_si128((__m128i *)d, h0);
+}
+
+/* n <= 64, overlap safe */
+static inline __attribute__((always_inline)) void CopyUpTo64SSE2(unsigned char *d, const unsigned char *s, size_t n)
+{
+	if (n < 16)
+	{
+		CopySmall(d, s, n);
+		return;
+	}
+
+	if (n <= 32)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + n - 16));
+		_mm_storeu_si128((__m128i *)d, a);
+		_mm_storeu_si128((__m128i *)(d + n - 16), b);
+		return;
+	}
+
+	__m128i a = _mm_loadu_si128((const __m128i *)s);
+	__m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+	__m128i c = _mm_loadu_si128((const __m128i *)(s + n - 32));
+	__m128i e = _mm_loadu_si128((const __m128i *)(s + n - 16));
+	_mm_storeu_si128((__m128i *)d, a);
+	_mm_storeu_si128((__m128i *)(d + 16), b);
+	_mm_storeu_si128((__m128i *)(d + n - 32), c);
+	_mm_storeu_si128((__m128i *)(d + n - 16), e);
+}
+
+static void *memcpy_sse2(void *restrict s1, const void *restrict s2, size_t n)
+{
+	if (n <= 64)
+		CopyUpTo64SSE2(s1, s2, n);
+	else
+		CopyForwardSSE2(s1, s2, n, 0);
+	return s1;
+}
+
+static void *memcpy_sse2_erms(void *restrict s1, const void *restrict s2, size_t n)
+{
+	if (n <= 64)
+		CopyUpTo64SSE2(s1, s2, n);
+	else
+		CopyForwardSSE2(s1, s2, n, 1);
+	return s1;
+}
+
+static void *memmove_sse2(void *s1, const void *s2, size_t n)
+{
+	if (n <= 64)
+		CopyUpTo64SSE2(s1, s2, n);
+	else if ((uintptr_t)s1 - (uintptr_t)s2 >= n)
+		CopyForwardSSE2(s1, s2, n, 0);
+	else
+		CopyBackwardSSE2(s1, s2, n);
+	return s1;
+}
+
+static void *memmove_sse2_erms(void *s1, const void *s2, size_t n)
+{
+	if (n <= 64)
+		CopyUpTo64SSE2(s1, s2, n);
+	else if ((uintptr_t)s1 - (uintptr_t)s2 >= n)
+		CopyForwardSSE2(s1, s2, n, 1);
+	else
+		CopyBackwardSSE2(s1, s2, n);
+	return s1;
+}
+
+static inline __attribute__((always_inline)) void *MemsetSSE2(void *s, int c, size_t n, int erms)
+{
+	unsigned char *d = s;
+	uint64_t pattern = (unsigned char)c * 0x0101010101010101ULL;
+
+	if (n < 16)
+	{
+		SetSmall(d, pattern, n);
+		return s;
+	}
+
+	__m128i v = _mm_set1_epi8((char)c);
+	if (n <= 64)
+	{
+		_mm_storeu_si128((__m128i *)d, v);
+		_mm_storeu_si128((__m128i *)(d + n - 16), v);
+		if (n > 32)
+		{
+			_mm_storeu_si128((__m128i *)(d + 16), v);
+			_mm_storeu_si128((__m128i *)(d + n - 32), v);
+		}
+		return s;
+	}
+
+	if (erms && n >= ERMS_THRESHOLD && n < NT_THRESHOLD)
+	{
+		RepStosb(d, c, n);
+		return s;
+	}
+
+	unsigned char *end = d + n;
+	_mm_storeu_si128((__m128i *)d, v);
+	d = (unsigned char *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+
+	if (n >= NT_THRESHOLD)
+	{
+		for (; end - d > 64; d += 64)
+		{
+			_mm_stream_si128((__m128i *)d, v);
+			_mm_stream_si128((__m128i *)(d + 16), v);
+			_mm_stream_si128((__m128i *)(d + 32), v);
+			_mm_stream_si128((__m128i *)(d + 48), v);
+		}
+		_mm_sfence();
+	}
+	else
+	{
+		for (; end - d > 64; d += 64)
+		{
+			_mm_store_si128((__m128i *)d, v);
+			_mm_store_si128((__m128i *)(d + 16), v);
+			_mm_store_si128((__m128i *)(d + 32), v);
+			_mm_store_si128((__m128i *)(d + 48), v);
+		}
+	}
+
+	_mm_storeu_si128((__m128i *)(end - 64), v);
+	_mm_storeu_si128((__m128i *)(end - 48), v);
+	_mm_storeu_si128((__m128i *)(end - 32), v);
+	_mm_storeu_si128((__m128i *)(end - 16), v);
+	return s;
+}
+
+static void *memset_sse2(void *s, int c, size_t n) { return MemsetSSE2(s, c, n, 0); }
+static void *memset_sse2_erms(void *s, int c, size_t n) { return MemsetSSE2(s, c, n, 1); }
+
+static int memcmp_sse2(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *a = s1, *b = s2;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+		if (mask)
+		{
+			i += __builtin_ctz(mask);
+			return a[i] - b[i];
+		}
+	}
+
+	for (; i < n; i++)
+	{
+		if (a[i] != b[i])
+			return a[i] - b[i];
+	}
+	return 0;
+}
+
+/* Aligned loads never cross a page boundary, so reading past the terminator is safe */
+static size_t strlen_sse2(const char *s)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+	unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+	mask >>= (uintptr_t)s & 15;
+	if (mask)
+		return __builtin_ctz(mask);
+
+	for (;;)
+	{
+		p += 16;
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+		if (mask)
+			return (p - s) + __builtin_ctz(mask);
+	}
+}
+
+static char *strchr_sse2(const char *s, int c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i cv = _mm_set1_epi8((char)c);
+	const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+
+	__m128i v = _mm_load_si128((const __m128i *)p);
+	unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, cv)));
+	mask >>= (uintptr_t)s & 15;
+	if (mask)
+	{
+		p = s + __builtin_ctz(mask);
+		return *p == (char)c ? (char *)p : NULL;
+	}
+
+	for (;;)
+	{
+		p += 16;
+		v = _mm_load_si128((const __m128i *)p);
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, cv)));
+		if (mask)
+		{
+			p += __builtin_ctz(mask);
+			return *p == (char)c ? (char *)p : NULL;
+		}
+	}
+}
+
+#pragma endregion SSE2
+
+#pragma region AVX2
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+static inline __attribute__((always_inline)) TARGET_AVX2 void CopyForwardAVX2(unsigned char *d, const unsigned char *s, size_t n, int erms)
+{
+	if (erms && n >= (CPU.FSRM ? FSRM_THRESHOLD : ERMS_THRESHOLD) && n < NT_THRESHOLD)
+	{
+		RepMovsb(d, s, n);
+		return;
+	}
+
+	__m256i head = _mm256_loadu_si256((const __m256i *)s);
+	__m256i t0 = _mm256_loadu_si256((const __m256i *)(s + n - 128));
+	__m256i t1 = _mm256_loadu_si256((const __m256i *)(s + n - 96));
+	__m256i t2 = _mm256_loadu_si256((const __m256i *)(s + n - 64));
+	__m256i t3 = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+	unsigned char *end = d + n;
+
+	size_t skew = 32 - ((uintptr_t)d & 31);
+	unsigned char *dst = d + skew;
+	const unsigned char *src = s + skew;
+	size_t left = n - skew;
+
+	if (n >= NT_THRESHOLD && ((uintptr_t)d - (uintptr_t)s) >= n)
+	{
+		for (; left > 128; left -= 128, dst += 128, src += 128)
+		{
+			_mm_prefetch((const char *)src + 1024, _MM_HINT_NTA);
+			__m256i a = _mm256_loadu_si256((const __m256i *)src);
+			__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+			__m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+			__m256i e = _mm256_loadu_si256((const __m256i *)(src + 96));
+			_mm256_stream_si256((__m256i *)dst, a);
+			_mm256_stream_si256((__m256i *)(dst + 32), b);
+			_mm256_stream_si256((__m256i *)(dst + 64), c);
+			_mm256_stream_si256((__m256i *)(dst + 96), e);
+		}
+		_mm_sfence();
+	}
+	else
+	{
+		for (; left > 128; left -= 128, dst += 128, src += 128)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i *)src);
+			__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+			__m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+			__m256i e = _mm256_loadu_si256((const __m256i *)(src + 96));
+			_mm256_store_si256((__m256i *)dst, a);
+			_mm256_store_si256((__m256i *)(dst + 32), b);
+			_mm256_store_si256((__m256i *)(dst + 64), c);
+			_mm256_store_si256((__m256i *)(dst + 96), e);
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *)(end - 128), t0);
+	_mm256_storeu_si256((__m256i *)(end - 96), t1);
+	_mm256_storeu_si256((__m256i *)(end - 64), t2);
+	_mm256_storeu_si256((__m256i *)(end - 32), t3);
+	_mm256_storeu_si256((__m256i *)d, head);
+}
+
+static inline __attribute__((always_inline)) TARGET_AVX2 void CopyBackwardAVX2(unsigned char *d, const unsigned char *s, size_t n)
+{
+	__m256i h0 = _mm256_loadu_si256((const __m256i *)s);
+	__m256i h1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+	__m256i h2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+	__m256i h3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+	__m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+
+	unsigned char *dst = (unsigned char *)((uintptr_t)(d + n) & ~(uintptr_t)31);
+	const unsigned char *src = s + (dst - d);
+	size_t left = dst - d;
+
+	for (; left > 128; left -= 128)
+	{
+		dst -= 128;
+		src -= 128;
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + 96));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + 64));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(src + 32));
+		__m256i e = _mm256_loadu_si256((const __m256i *)src);
+		_mm256_store_si256((__m256i *)(dst + 96), a);
+		_mm256_store_si256((__m256i *)(dst + 64), b);
+		_mm256_store_si256((__m256i *)(dst + 32), c);
+		_mm256_store_si256((__m256i *)dst, e);
+	}
+
+	_mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+	_mm256_storeu_si256((__m256i *)(d + 96), h3);
+	_mm256_storeu_si256((__m256i *)(d + 64), h2);
+	_mm256_storeu_si256((__m256i *)(d + 32), h1);
+	_mm256_storeu_si256((__m256i *)d, h0);
+}
+
+/* n <= 128, overlap safe */
+static inline __attribute__((always_inline)) TARGET_AVX2 void CopyUpTo128AVX2(unsigned char *d, const unsigned char *s, size_t n)
+{
+	if (n < 32)
+	{
+		CopyUpTo64SSE2(d, s, n);
+		return;
+	}
+
+	if (n <= 64)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+		_mm256_storeu_si256((__m256i *)d, a);
+		_mm256_storeu_si256((__m256i *)(d + n - 32), b);
+		return;
+	}
+
+	__m256i a = _mm256_loadu_si256((const __m256i *)s);
+	__m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+	__m256i c = _mm256_loadu_si256((const __m256i *)(s + n - 64));
+	__m256i e = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+	_mm256_storeu_si256((__m256i *)d, a);
+	_mm256_storeu_si256((__m256i *)(d + 32), b);
+	_mm256_storeu_si256((__m256i *)(d + n - 64), c);
+	_mm256_storeu_si256((__m256i *)(d + n - 32), e);
+}
+
+static TARGET_AVX2 void *memcpy_avx2(void *restrict s1, const void *restrict s2, size_t n)
+{
+	if (n <= 128)
+		CopyUpTo128AVX2(s1, s2, n);
+	else
+		CopyForwardAVX2(s1, s2, n, 0);
+	_mm256_zeroupper();
+	return s1;
+}
+
+static TARGET_AVX2 void *memcpy_avx2_erms(void *restrict s1, const void *restrict s2, size_t n)
+{
+	if (n <= 128)
+		CopyUpTo128AVX2(s1, s2, n);
+	else
+		CopyForwardAVX2(s1, s2, n, 1);
+	_mm256_zeroupper();
+	return s1;
+}
+
+static TARGET_AVX2 void *memmove_avx2(void *s1, const void *s2, size_t n)
+{
+	if (n <= 128)
+		CopyUpTo128AVX2(s1, s2, n);
+	else if ((uintptr_t)s1 - (uintptr_t)s2 >= n)
+		CopyForwardAVX2(s1, s2, n, 0);
+	else
+		CopyBackwardAVX2(s1, s2, n);
+	_mm256_zeroupper();
+	return s1;
+}
+
+static TARGET_AVX2 void *memmove_avx2_erms(void *s1, const void *s2, size_t n)
+{
+	if (n <= 128)
+		CopyUpTo128AVX2(s1, s2, n);
+	else if ((uintptr_t)s1 - (uintptr_t)s2 >= n)
+		CopyForwardAVX2(s1, s2, n, 1);
+	else
+		CopyBackwardAVX2(s1, s2, n);
+	_mm256_zeroupper();
+	return s1;
+}
+
+static inline __attribute__((always_inline)) TARGET_AVX2 void *MemsetAVX2(void *s, int c, size_t n, int erms)
+{
+	unsigned char *d = s;
+	if (n < 32)
+		return MemsetSSE2(s, c, n, 0);
+
+	__m256i v = _mm256_set1_epi8((char)c);
+	if (n <= 128)
+	{
+		_mm256_storeu_si256((__m256i *)d, v);
+		_mm256_storeu_si256((__m256i *)(d + n - 32), v);
+		if (n > 64)
+		{
+			_mm256_storeu_si256((__m256i *)(d + 32), v);
+			_mm256_storeu_si256((__m256i *)(d + n - 64), v);
+		}
+		_mm256_zeroupper();
+		return s;
+	}
+
+	if (erms && n >= ERMS_THRESHOLD && n < NT_THRESHOLD)
+	{
+		RepStosb(d, c, n);
+		_mm256_zeroupper();
+		return s;
+	}
+
+	unsigned char *end = d + n;
+	_mm256_storeu_si256((__m256i *)d, v);
+	d = (unsigned char *)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+
+	if (n >= NT_THRESHOLD)
+	{
+		for (; end - d > 128; d += 128)
+		{
+			_mm256_stream_si256((__m256i *)d, v);
+			_mm256_stream_si256((__m256i *)(d + 32), v);
+			_mm256_stream_si256((__m256i *)(d + 64), v);
+			_mm256_stream_si256((__m256i *)(d + 96), v);
+		}
+		_mm_sfence();
+	}
+	else
+	{
+		for (; end - d > 128; d += 128)
+		{
+			_mm256_store_si256((__m256i *)d, v);
+			_mm256_store_si256((__m256i *)(d + 32), v);
+			_mm256_store_si256((__m256i *)(d + 64), v);
+			_mm256_store_si256((__m256i *)(d + 96), v);
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *)(end - 128), v);
+	_mm256_storeu_si256((__m256i *)(end - 96), v);
+	_mm256_storeu_si256((__m256i *)(end - 64), v);
+	_mm256_storeu_si256((__m256i *)(end - 32), v);
+	_mm256_zeroupper();
+	return s;
+}
+
+static TARGET_AVX2 void *memset_avx2(void *s, int c, size_t n) { return MemsetAVX2(s, c, n, 0); }
+static TARGET_AVX2 void *memset_avx2_erms(void *s, int c, size_t n) { return MemsetAVX2(s, c, n, 1); }
+
+static TARGET_AVX2 int memcmp_avx2(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *a = s1, *b = s2;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+		if (mask)
+		{
+			_mm256_zeroupper();
+			i += __builtin_ctz(mask);
+			return a[i] - b[i];
+		}
+	}
+
+	_mm256_zeroupper();
+	return memcmp_sse2(a + i, b + i, n - i);
+}
+
+static TARGET_AVX2 size_t strlen_avx2(const char *s)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+	unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+	mask >>= (uintptr_t)s & 31;
+	if (mask)
+	{
+		_mm256_zeroupper();
+		return __builtin_ctz(mask);
+	}
+
+	for (;;)
+	{
+		p += 32;
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+		if (mask)
+		{
+			_mm256_zeroupper();
+			return (p - s) + __builtin_ctz(mask);
+		}
+	}
+}
+
+static TARGET_AVX2 char *strchr_avx2(const char *s, int c)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i cv = _mm256_set1_epi8((char)c);
+	const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+
+	__m256i v = _mm256_load_si256((const __m256i *)p);
+	unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, cv)));
+	mask >>= (uintptr_t)s & 31;
+	if (mask)
+		p = s + __builtin_ctz(mask);
+	else
+	{
+		for (;;)
+		{
+			p += 32;
+			v = _mm256_load_si256((const __m256i *)p);
+			mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, cv)));
+			if (mask)
+			{
+				p += __builtin_ctz(mask);
+				break;
+			}
+		}
+	}
+
+	_mm256_zeroupper();
+	return *p == (char)c ? (char *)p : NULL;
+}
+
+#pragma endregion AVX2
+
+#pragma region Resolvers
+
+/*
+ * Resolvers run while the dynamic linker (or __crt_apply_irelative for
+ * static executables) processes R_X86_64_IRELATIVE relocations, so they
+ * must not depend on anything else in libc being relocated.
+ */
+
+static void *(*memcpy_resolve(void))(void *restrict, const void *restrict, size_t)
+{
+	DetectCPU();
+	if (CPU.AVX2)
+		return CPU.ERMS ? memcpy_avx2_erms : memcpy_avx2;
+	return CPU.ERMS ? memcpy_sse2_erms : memcpy_sse2;
+}
+
+static void *(*memmove_resolve(void))(void *, const void *, size_t)
+{
+	DetectCPU();
+	if (CPU.AVX2)
+		return CPU.ERMS ? memmove_avx2_erms : memmove_avx2;
+	return CPU.ERMS ? memmove_sse2_erms : memmove_sse2;
+}
+
+static void *(*memset_resolve(void))(void *, int, size_t)
+{
+	DetectCPU();
+	if (CPU.AVX2)
+		return CPU.ERMS ? memset_avx2_erms : memset_avx2;
+	return CPU.ERMS ? memset_sse2_erms : memset_sse2;
+}
+
+static int (*memcmp_resolve(void))(const void *, const void *, size_t)
+{
+	DetectCPU();
+	return CPU.AVX2 ? memcmp_avx2 : memcmp_sse2;
+}
+
+static size_t (*strlen_resolve(void))(const char *)
+{
+	DetectCPU();
+	return CPU.AVX2 ? strlen_avx2 : strlen_sse2;
+}
+
+static char *(*strchr_resolve(void))(const char *, int)
+{
+	DetectCPU();
+	return CPU.AVX2 ? strchr_avx2 : strchr_sse2;
+}
+
+#pragma endregion Resolvers
+
+export void *memcpy(void *restrict s1, const void *restrict s2, size_t n) __attribute__((ifunc("memcpy_resolve")));
+export void *memmove(void *s1, const void *s2, size_t n) __attribute__((ifunc("memmove_resolve")));
+export void *memset(void *s, int c, size_t n) __attribute__((ifunc("memset_resolve")));
+export int memcmp(const void *s1, const void *s2, size_t n) __attribute__((ifunc("memcmp_resolve")));
+export size_t strlen(const char *s) __attribute__((ifunc("strlen_resolve")));
+export char *strchr(const char *s, int c) __attribute__((ifunc("strchr_resolve")));
+
+#endif // STRING_IFUNC
@@ -0,0 +1,44 @@
+/*
+	This file is part of Fennix C Library.
+
+	Fennix C Library is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix C Library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix C Library. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STRING_SIMD_H
+#define _STRING_SIMD_H
+
+#include <stddef.h>
+
+/*
+ * On amd64 the public memcpy, memmove, memset, memcmp, strlen and strchr
+ * are IFUNCs defined in string_simd.c. The portable versions in string.c
+ * are then renamed out of the way; elsewhere they stay the implementation.
+ */
+#if defined(__amd64__)
+#define STRING_IFUNC 1
+#define STRING_GENERIC(name) __##name##_generic
+#define STRING_EXPORT
+#else
+#define STRING_GENERIC(name) name
+#define STRING_EXPORT export
+#endif
+
+void *STRING_GENERIC(memcpy)(void *restrict s1, const void *restrict s2, size_t n);
+void *STRING_GENERIC(memmove)(void *s1, const void *s2, size_t n);
+void *STRING_GENERIC(memset)(void *s, int c, size_t n);
+int STRING_GENERIC(memcmp)(const void *s1, const void *s2, size_t n);
+size_t STRING_GENERIC(strlen)(const char *s);
+char *STRING_GENERIC(strchr)(const char *s, int c);
+
+#endif // !_STRING_SIMD_H
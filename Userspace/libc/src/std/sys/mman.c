@@ -41,7 +41,12 @@ export int munmap(void *addr, size_t len)
 	return __check_errno(sysdep(MemoryUnmap)(addr, len), -1);
 }
 
-export int posix_madvise(void *, size_t, int);
+export int posix_madvise(void *addr, size_t len, int advice)
+{
+	/* posix_madvise reports errors through the return value, not errno */
+	int ret = sysdep(MemoryAdvise)(addr, len, advice);
+	return ret < 0 ? -ret : 0;
+}
 export int posix_mem_offset(const void *restrict, size_t, off_t *restrict, size_t *restrict, int *restrict);
 export int posix_typed_mem_get_info(int, struct posix_typed_mem_info *);
 export int posix_typed_mem_open(const char *, int, int);
@@ -45,14 +45,28 @@ export int listen(int socket, int backlog)
 	return __check_errno(sysdep(Listen)(socket, backlog), -1);
 }
 
-export ssize_t recv(int, void *, size_t, int);
+export ssize_t recv(int socket, void *buffer, size_t length, int flags)
+{
+	return __check_errno(sysdep(Receive)(socket, buffer, length, flags), -1);
+}
+
 export ssize_t recvfrom(int, void *restrict, size_t, int, struct sockaddr *restrict, socklen_t *restrict);
 export ssize_t recvmsg(int, struct msghdr *, int);
-export ssize_t send(int, const void *, size_t, int);
+
+export ssize_t send(int socket, const void *message, size_t length, int flags)
+{
+	return __check_errno(sysdep(Send)(socket, message, length, flags), -1);
+}
+
 export ssize_t sendmsg(int, const struct msghdr *, int);
 export ssize_t sendto(int, const void *, size_t, int, const struct sockaddr *, socklen_t);
 export int setsockopt(int, int, int, const void *, socklen_t);
-export int shutdown(int, int);
+
+export int shutdown(int socket, int how)
+{
+	return __check_errno(sysdep(Shutdown)(socket, how), -1);
+}
+
 export int sockatmark(int);
 
 export int socket(int domain, int type, int protocol)
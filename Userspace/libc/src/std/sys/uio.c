@@ -0,0 +1,30 @@
+/*
+	This file is part of Fennix C Library.
+
+	Fennix C Library is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix C Library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix C Library. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <sys/uio.h>
+#include <bits/libc.h>
+#include <errno.h>
+
+export ssize_t readv(int fildes, const struct iovec *iov, int iovcnt)
+{
+	return __check_errno(sysdep(ReadV)(fildes, iov, iovcnt), -1);
+}
+
+export ssize_t writev(int fildes, const struct iovec *iov, int iovcnt)
+{
+	return __check_errno(sysdep(WriteV)(fildes, iov, iovcnt), -1);
+}
@@ -273,7 +273,10 @@ export int pause(void)
 	return __check_errno(-ENOSYS, -1);
 }
 
-export int pipe(int[2]);
+export int pipe(int fildes[2])
+{
+	return __check_errno(sysdep(Pipe)(fildes), -1);
+}
 
 export ssize_t pread(int fildes, void *buf, size_t nbyte, off_t offset)
 {
@@ -51,6 +51,21 @@ int sysdep(Socket)(int Domain, int Type, int Protocol)
 	return call_socket(Domain, Type, Protocol);
 }
 
+ssize_t sysdep(Send)(int Socket, const void *Buffer, size_t Length, int Flags)
+{
+	return call_send(Socket, Buffer, Length, Flags);
+}
+
+ssize_t sysdep(Receive)(int Socket, void *Buffer, size_t Length, int Flags)
+{
+	return call_recv(Socket, Buffer, Length, Flags);
+}
+
+int sysdep(Shutdown)(int Socket, int How)
+{
+	return call_shutdown(Socket, How);
+}
+
 int sysdep(UnixName)(struct utsname *Name)
 {
 	struct kutsname kname;
@@ -92,6 +107,11 @@ int sysdep(MemoryProtect)(void *Address, size_t Length, int Protection)
 	return call_mprotect(Address, Length, Protection);
 }
 
+int sysdep(MemoryAdvise)(void *Address, size_t Length, int Advice)
+{
+	return call_madvise(Address, Length, Advice);
+}
+
 int sysdep(Fork)(void)
 {
 	return call_fork();
@@ -117,6 +137,16 @@ int sysdep(PWrite)(int Descriptor, const void *Buffer, size_t Size, off_t Offset
 	return call_pwrite(Descriptor, Buffer, Size, Offset);
 }
 
+ssize_t sysdep(ReadV)(int Descriptor, const struct iovec *Vector, int Count)
+{
+	return call_readv(Descriptor, Vector, Count);
+}
+
+ssize_t sysdep(WriteV)(int Descriptor, const struct iovec *Vector, int Count)
+{
+	return call_writev(Descriptor, Vector, Count);
+}
+
 int sysdep(Open)(const char *Pathname, int Flags, mode_t Mode)
 {
 	return call_open(Pathname, Flags, Mode);
@@ -127,6 +157,11 @@ int sysdep(Close)(int Descriptor)
 	return call_close(Descriptor);
 }
 
+int sysdep(Pipe)(int Descriptors[2])
+{
+	return call_pipe(Descriptors);
+}
+
 int sysdep(Access)(const char *Pathname, int Mode)
 {
 	return call_access(Pathname, Mode);
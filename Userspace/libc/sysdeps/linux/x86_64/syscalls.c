@@ -49,6 +49,21 @@ int sysdep(Socket)(int Domain, int Type, int Protocol)
 	return syscall3(sys_socket, Domain, Type, Protocol);
 }
 
+ssize_t sysdep(Send)(int Socket, const void *Buffer, size_t Length, int Flags)
+{
+	return syscall6(sys_sendto, Socket, Buffer, Length, Flags, 0, 0);
+}
+
+ssize_t sysdep(Receive)(int Socket, void *Buffer, size_t Length, int Flags)
+{
+	return syscall6(sys_recvfrom, Socket, Buffer, Length, Flags, 0, 0);
+}
+
+int sysdep(Shutdown)(int Socket, int How)
+{
+	return syscall2(sys_shutdown, Socket, How);
+}
+
 int sysdep(UnixName)(struct utsname *Name)
 {
 	struct kutsname kname;
@@ -90,6 +105,11 @@ int sysdep(MemoryProtect)(void *Address, size_t Length, int Protection)
 	return syscall3(sys_mprotect, (scarg)Address, Length, Protection);
 }
 
+int sysdep(MemoryAdvise)(void *Address, size_t Length, int Advice)
+{
+	return syscall3(sys_madvise, (scarg)Address, Length, Advice);
+}
+
 int sysdep(Fork)(void)
 {
 	return syscall0(sys_fork);
@@ -115,6 +135,16 @@ int sysdep(PWrite)(int Descriptor, const void *Buffer, size_t Size, off_t Offset
 	return syscall4(sys_pwrite64, Descriptor, (scarg)Buffer, Size, Offset);
 }
 
+ssize_t sysdep(ReadV)(int Descriptor, const struct iovec *Vector, int Count)
+{
+	return syscall3(sys_readv, Descriptor, (scarg)Vector, Count);
+}
+
+ssize_t sysdep(WriteV)(int Descriptor, const struct iovec *Vector, int Count)
+{
+	return syscall3(sys_writev, Descriptor, (scarg)Vector, Count);
+}
+
 int sysdep(Open)(const char *Pathname, int Flags, mode_t Mode)
 {
 	return syscall3(sys_open, (scarg)Pathname, Flags, Mode);
@@ -125,6 +155,11 @@ int sysdep(Close)(int Descriptor)
 	return syscall1(sys_close, Descriptor);
 }
 
+int sysdep(Pipe)(int Descriptors[2])
+{
+	return syscall1(sys_pipe, (scarg)Descriptors);
+}
+
 int sysdep(Access)(const char *Pathname, int Mode)
 {
 	return syscall2(sys_access, (scarg)Pathname, Mode);